@@ -533,7 +533,6 @@ void main()
 //    float scaling_factor = static_cast<float>(swapchain_extent.width) / static_cast<float>(swapchain_extent.height);
 
     wait_command_buffer_completed();
-    m_logical_device->reset_fences({ *m_current_frame.m_frame_resources->m_command_buffers_completed });
 
     auto command_buffer = frame_resources->m_command_buffer;
     Dout(dc::vkframe, "Start recording command buffer.");
@@ -551,19 +550,7 @@ void main()
     command_buffer->end();
     Dout(dc::vkframe, "End recording command buffer.");
 
-    vk::PipelineStageFlags wait_dst_stage_mask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-    vk::SubmitInfo submit_info{
-      .waitSemaphoreCount = 1,
-      .pWaitSemaphores = swapchain().vhp_current_image_available_semaphore(),
-      .pWaitDstStageMask = &wait_dst_stage_mask,
-      .commandBufferCount = 1,
-      .pCommandBuffers = command_buffer.get_array(),
-      .signalSemaphoreCount = 1,
-      .pSignalSemaphores = swapchain().vhp_current_rendering_finished_semaphore()
-    };
-
-    Dout(dc::vkframe, "Submitting command buffer: submit({" << submit_info << "}, " << *frame_resources->m_command_buffers_completed << ")");
-    presentation_surface().vh_graphics_queue().submit({ submit_info }, *frame_resources->m_command_buffers_completed);
+    submit(command_buffer);
 
     Dout(dc::vkframe, "Leaving Window::draw_frame.");
   }
@@ -63,7 +63,7 @@ class SingleButtonWindow : public task::SynchronousWindow
     vulkan::FrameResourcesData* frame_resources = m_current_frame.m_frame_resources;
     imgui_pass.update_image_views(swapchain(), frame_resources);
 
-    m_logical_device->reset_fences({ *frame_resources->m_command_buffers_completed });
+    wait_command_buffer_completed();
     auto command_buffer = frame_resources->m_command_buffer;
 
     Dout(dc::vkframe, "Start recording command buffer.");
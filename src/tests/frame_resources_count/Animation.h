@@ -0,0 +1,48 @@
+#pragma once
+
+#include "vulkan/SimulationTask.h"
+#include <atomic>
+#include <cmath>
+#include <chrono>
+
+// The state of the animation: the rectangles move left and right, driven by m_angle.
+struct AnimationState
+{
+  double m_angle = 0.0;                                 // Not wrapped, so that interpolation never goes the long way around.
+
+  static AnimationState interpolate(AnimationState const& from, AnimationState const& to, float alpha)
+  {
+    return { from.m_angle + (to.m_angle - from.m_angle) * alpha };
+  }
+
+  // The horizontal offset of all rectangles.
+  float offset() const { return 0.25f * static_cast<float>(std::sin(m_angle)); }
+};
+
+// Animates the rectangles at a fixed tick rate of 100 Hz, independent of the frame rate.
+// The CPU cost of a tick can be increased (see set_work_time) to show that heavy ticks
+// don't slow down rendering, while PreSubmitCpuWorkTime and PostSubmitCpuWorkTime show
+// that slow frames don't slow down the animation.
+class Animation final : public task::Simulation<AnimationState>
+{
+  static constexpr double s_angular_velocity = 2.0;     // Radians per second.
+
+  std::atomic_int m_work_time_us{0};                    // The CPU time that each tick costs.
+
+ public:
+  Animation(CWDEBUG_ONLY(bool debug = false)) :
+    task::Simulation<AnimationState>(threadpool::Interval<10, std::chrono::milliseconds>{}, {} COMMA_CWDEBUG_ONLY(debug)) { }
+
+  void set_work_time(std::chrono::microseconds work_time) { m_work_time_us.store(work_time.count(), std::memory_order::relaxed); }
+
+ private:
+  void update(AnimationState& state, double dt) override
+  {
+    state.m_angle += s_angular_velocity * dt;
+
+    // Simulate an expensive tick.
+    auto const end = std::chrono::steady_clock::now() + std::chrono::microseconds{m_work_time_us.load(std::memory_order::relaxed)};
+    while (std::chrono::steady_clock::now() < end)
+      ;
+  }
+};
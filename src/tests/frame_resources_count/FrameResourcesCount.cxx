@@ -48,8 +48,13 @@ int main(int argc, char* argv[])
     // Assume logical_device also supports presenting on root_window2.
 //    application.create_root_window<WindowEvents, SlowWindow>({400, 400}, LogicalDevice::root_window_request_cookie1, *logical_device, "Second window");
 
+    // Animate the rectangles from the thread pool.
+    application.start_animation();
+
     // Run the application.
     application.run();
+
+    application.stop_animation();
   }
   catch (AIAlert::Error const& error)
   {
@@ -1,11 +1,16 @@
 #pragma once
 
+#include "Animation.h"
 #include "vulkan/Application.h"
+#include "statefultask/AIStatefulTask.h"
 
 class FrameResourcesCount : public vulkan::Application
 {
   using vulkan::Application::Application;
 
+ private:
+  boost::intrusive_ptr<Animation> m_animation;          // Runs on the thread pool, independent of the render loop.
+
  private:
   int thread_pool_number_of_worker_threads() const override
   {
@@ -18,4 +23,18 @@ class FrameResourcesCount : public vulkan::Application
   {
     return u8"FrameResourcesCount";
   }
+
+  // Start and stop the animation task (after initialize(), and after run() returned respectively).
+  void start_animation()
+  {
+    m_animation = statefultask::create<Animation>(CWDEBUG_ONLY(false));
+    m_animation->run(medium_priority_queue());
+  }
+
+  void stop_animation()
+  {
+    m_animation->terminate();
+  }
+
+  Animation& animation() const { return *m_animation; }
 };
@@ -8,6 +8,7 @@ struct SampleParameters
   int ObjectCount;
   int PreSubmitCpuWorkTime;
   int PostSubmitCpuWorkTime;
+  int SimulationTickWorkTime;
   int SwapchainCount;
   int FrameResourcesCount;
   float m_frame_generation_time;
@@ -18,6 +19,7 @@ struct SampleParameters
     ObjectCount(889),
     PreSubmitCpuWorkTime(4),
     PostSubmitCpuWorkTime(4),
+    SimulationTickWorkTime(0),
     SwapchainCount(3),
     FrameResourcesCount(2),
     m_frame_generation_time(0),
@@ -9,8 +9,10 @@
 #include "queues/CopyDataToImage.h"
 #include "vulkan/SynchronousWindow.h"
 #include "vulkan/Pipeline.h"
+#include "vulkan/pipeline/PushConstantUpdater.h"
 #include "vulkan/shader_builder/ShaderIndex.h"
 #include "vk_utils/ImageData.h"
+#include "vk_utils/MipChain.h"
 #include "utils/threading/aithreadid.h"
 #include <imgui.h>
 #include "debug.h"
@@ -55,10 +57,13 @@ class Window : public task::SynchronousWindow
   vulkan::Texture m_background_texture{"m_background_texture"};
   vulkan::Texture m_benchmark_texture{"m_benchmark_texture"};
   vulkan::Pipeline m_graphics_pipeline;
+  vulkan::pipeline::PushConstantUpdater<PushConstant> m_push_constant_updater;
 
   imgui::StatsWindow m_imgui_stats_window;
   SampleParameters m_sample_parameters;
   int m_frame_count = 0;
+  AnimationState m_animation_state;
+  bool m_continuous_capture = false;
 
  private:
   void set_default_clear_values(vulkan::rendergraph::ClearValue& color, vulkan::rendergraph::ClearValue& depth_stencil) override
@@ -94,6 +99,17 @@ class Window : public task::SynchronousWindow
     m_render_graph.generate(this);
   }
 
+  bool use_frame_capture() const override
+  {
+    return true;
+  }
+
+  // Present (and acquire) on a separate task; return false to compare the frame time distributions without it.
+  bool use_present_task() const override
+  {
+    return true;
+  }
+
   vulkan::FrameResourceIndex max_number_of_frame_resources() const override
   {
     return vulkan::FrameResourceIndex{5};
@@ -110,7 +126,7 @@ class Window : public task::SynchronousWindow
 
     // Background texture.
     {
-      vk_utils::stbi::ImageData texture_data(m_application->path_of(Directory::resources) / "textures/background.png", 4);
+      vk_utils::stbi::ImageData texture_data(m_application->path_of(Directory::resources) / "textures/background.png", 4, m_application->file_reader());
 
       // Create descriptor resources.
       static vulkan::ImageKind const background_image_kind({
@@ -136,27 +152,35 @@ class Window : public task::SynchronousWindow
 
     // Sample texture.
     {
-      vk_utils::stbi::ImageData texture_data(m_application->path_of(Directory::resources) / "textures/frame_resources.png", 4);
+      vk_utils::stbi::ImageData texture_data(m_application->path_of(Directory::resources) / "textures/frame_resources.png", 4, m_application->file_reader());
+      // The quads are scaled down with distance: give the texture a full mip chain.
+      uint32_t const mip_levels = vk_utils::mip_level_count(texture_data.extent());
 
       // Create descriptor resources.
       static vulkan::ImageKind const sample_image_kind({
         .format = vk::Format::eR8G8B8A8Unorm,
-        .usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled
+        .mip_levels = mip_levels,
+        .usage = vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled
       });
 
-      static vulkan::ImageViewKind const sample_image_view_kind(sample_image_kind, {});
+      static vulkan::ImageViewKind const sample_image_view_kind(sample_image_kind, {
+        .subresource_range = vk_defaults::ImageSubresourceRange{vk::ImageAspectFlagBits::eColor, 0, mip_levels}
+      });
 
       m_benchmark_texture = vulkan::Texture(
           "benchmark",
           m_logical_device,
           texture_data.extent(), sample_image_view_kind,
-          { .mipmapMode = vk::SamplerMipmapMode::eNearest,
-            .anisotropyEnable = VK_FALSE },
+          { .mipmapMode = vk::SamplerMipmapMode::eLinear,
+            .anisotropyEnable = VK_FALSE,
+            .maxLod = VK_LOD_CLAMP_NONE },
           graphics_settings(),
           { .properties = vk::MemoryPropertyFlagBits::eDeviceLocal }
           COMMA_CWDEBUG_ONLY(debug_name_prefix("m_benchmark_texture")));
 
-      m_benchmark_texture.upload(texture_data.extent(), sample_image_view_kind, this, std::make_unique<vk_utils::stbi::ImageDataFeeder>(std::move(texture_data)), this, sample_texture_uploaded);
+      // If the transfer queue can't blit, draw_frame records the blits (see Texture::record_mip_generation).
+      m_benchmark_texture.upload_with_mipmaps(texture_data.extent(), sample_image_view_kind, this,
+          std::make_unique<vk_utils::stbi::ImageDataFeeder>(std::move(texture_data)), this, sample_texture_uploaded);
     }
   }
 
@@ -179,6 +203,7 @@ void main()
   position.y *= PushConstant::aspect_scale;             // Adjust to screen aspect ration.
   position.xy *= pow(v_Distance, 0.5);                  // Scale with distance.
   gl_Position = position + InstanceData::m_position[1];
+  gl_Position.x += PushConstant::pc1;                   // Animation.
 }
 )glsl";
 
@@ -533,12 +558,18 @@ void main()
 
     float scaling_factor = static_cast<float>(swapchain_extent.width) / static_cast<float>(swapchain_extent.height);
 
+    // Get the latest state of the animation (it is updated on the thread pool, at a fixed rate).
+    application().animation().interpolated(std::chrono::steady_clock::now(), m_animation_state);
+
     wait_command_buffer_completed();
-    m_logical_device->reset_fences({ *frame_resources->m_command_buffers_completed });
     auto command_buffer = frame_resources->m_command_buffer;
 
     Dout(dc::vkframe, "Start recording command buffer.");
     command_buffer->begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+    // Push constants are undefined at the start of a command buffer.
+    m_push_constant_updater.invalidate();
+    // Generate the mip levels of the benchmark texture once its level 0 arrived, if that wasn't done by the transfer queue.
+    m_benchmark_texture.record_mip_generation(command_buffer);
     {
 #if 0
       CwTracyVkZone(presentation_surface().tracy_context(), static_cast<vk::CommandBuffer>(command_buffer), main_pass.name(),
@@ -564,8 +595,9 @@ else
         command_buffer->bindVertexBuffers(0 /* uint32_t first_binding */, { vertex_buffers[0].m_vh_buffer, vertex_buffers[1].m_vh_buffer }, { 0, 0 });
       }
       command_buffer->setViewport(0, { viewport });
-      //FIXME: this should become something like: update_push_constant(scaling_factor, command_buffer);
-      command_buffer->pushConstants(m_graphics_pipeline.layout(), vk::ShaderStageFlagBits::eVertex|vk::ShaderStageFlagBits::eFragment, offsetof(PushConstant, aspect_scale), sizeof(float), &scaling_factor);
+      m_push_constant_updater.set<&PushConstant::aspect_scale>(scaling_factor);
+      m_push_constant_updater.set<&PushConstant::pc1>(m_animation_state.offset());
+      m_push_constant_updater.flush(command_buffer, m_graphics_pipeline);
       command_buffer->setScissor(0, { scissor });
       command_buffer->draw(6 * SampleParameters::s_quad_tessellation * SampleParameters::s_quad_tessellation, m_sample_parameters.ObjectCount, 0, 0);
 }
@@ -589,6 +621,7 @@ else
       TracyVkCollect(presentation_surface().tracy_context(), static_cast<vk::CommandBuffer>(command_buffer));
     }
 #endif
+    record_frame_capture(command_buffer);
     command_buffer->end();
     Dout(dc::vkframe, "End recording command buffer.");
 
@@ -631,8 +664,23 @@ else
     ImGui::SliderInt("Frame resources count", &m_sample_parameters.FrameResourcesCount, 1, max_number_of_frame_resources().get_value());
     ImGui::SliderInt("Pre-submit CPU work time [ms]", &m_sample_parameters.PreSubmitCpuWorkTime, 0, 20);
     ImGui::SliderInt("Post-submit CPU work time [ms]", &m_sample_parameters.PostSubmitCpuWorkTime, 0, 20);
+    if (ImGui::SliderInt("Simulation tick CPU work time [ms]", &m_sample_parameters.SimulationTickWorkTime, 0, 20))
+      application().animation().set_work_time(std::chrono::milliseconds{m_sample_parameters.SimulationTickWorkTime});
     ImGui::Text("Frame generation time: %5.2f ms", m_sample_parameters.m_frame_generation_time);
     ImGui::Text("Total frame time: %5.2f ms", m_sample_parameters.m_total_frame_time);
+    if (ImGui::Button("Capture frame"))
+      capture_frame("frame_resources_count.png");
+    ImGui::SameLine();
+    if (ImGui::Checkbox("Continuous capture", &m_continuous_capture))
+      set_continuous_capture(m_continuous_capture ? "frame_resources_count_capture" : "");
+    ImGui::Text("Captured frames: %lu (dropped %lu)", frame_capture().captured(), frame_capture().dropped());
+    ImGui::Text("Present task: %s", has_present_task() ? "yes" : "no");
+    ImGui::Text("Frame interval: p50 %5.2f ms, p99 %5.2f ms, max %5.2f ms", frame_interval_histogram().percentile(0.5f),
+        frame_interval_histogram().percentile(0.99f), frame_interval_histogram().max());
+    ImGui::Text("Acquire + present: p50 %5.2f ms, p99 %5.2f ms, max %5.2f ms", swapchain_wait_histogram().percentile(0.5f),
+        swapchain_wait_histogram().percentile(0.99f), swapchain_wait_histogram().max());
+    if (ImGui::Button("Reset frame times"))
+      reset_frame_time_histograms();
     ImGui::End();
 
     if (current_SwapchainCount != m_sample_parameters.SwapchainCount)
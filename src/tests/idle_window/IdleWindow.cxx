@@ -0,0 +1,157 @@
+#include "sys.h"
+#include "Application.inl.h"
+#include "IdleWindow.h"
+#include "Window.h"
+#include "LogicalDevice.h"
+#include <xcb/xcb.h>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <ctime>
+#include "debug.h"
+
+// Opens a window and measures the CPU time of the whole process during a fixed interval while the window is
+//
+//   rendering    - idle_when_static() returns false: a frame is rendered every 16 ms.
+//   static       - idle_when_static() returns true and nothing happens: the render loop is idle.
+//   minimized    - the window is unmapped.
+//   occluded     - WindowEvents::on_visibility_changed(true) was called.
+//
+// Usage: idle_window [--interval MILLISECONDS]
+
+namespace {
+
+double process_cpu_time_s()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+struct Measurement
+{
+  char const* m_state;
+  double m_cpu_time_s;                  // The process CPU time used during the interval.
+  uint64_t m_frames;                    // The number of frames rendered during the interval.
+};
+
+// Runs in its own thread: puts the window in each state and measures the CPU usage of the process.
+class Controller
+{
+  // Time for the render loop to settle after a state change (the last frames in flight, the X server replying, etc).
+  static constexpr std::chrono::milliseconds s_settle_time{500};
+
+  IdleWindow& m_application;
+  std::vector<Measurement> m_measurements;
+
+ public:
+  Controller(IdleWindow& application) : m_application(application) { }
+
+  void run()
+  {
+    // Wait until the window is rendering.
+    while (m_application.frames() < 10)
+      std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    Window* window = m_application.window();
+    if (!window)
+      return;
+    vulkan::WindowEvents const* window_events = window->window_events();
+    linuxviewer::OS::WindowParameters const& window_parameters = window_events->window_parameters();
+    xcb_connection_t* connection = *window_parameters.m_xcb_connection;
+
+    window->set_static(false);
+    measure("rendering");
+
+    window->set_static(true);
+    measure("static");
+
+    // Waking up a static window must render a few frames and then become idle again.
+    uint64_t const frames_before_invalidate = m_application.frames();
+    window->invalidate({ { 0, 0 }, { 10, 10 } });
+    std::this_thread::sleep_for(s_settle_time);
+    std::cout << "invalidate() rendered " << (m_application.frames() - frames_before_invalidate) << " frames.\n";
+
+    window->set_static(false);
+    xcb_unmap_window(connection, window_parameters.m_handle);
+    xcb_flush(connection);
+    measure("minimized");
+    xcb_map_window(connection, window_parameters.m_handle);
+    xcb_flush(connection);
+
+    window_events->on_visibility_changed(true);
+    measure("occluded");
+    window_events->on_visibility_changed(false);
+
+    // Check that the window renders again.
+    uint64_t const frames_before_visible = m_application.frames();
+    std::this_thread::sleep_for(s_settle_time);
+    std::cout << "Rendered " << (m_application.frames() - frames_before_visible) << " frames after becoming visible again.\n";
+
+    window->close();
+  }
+
+  void print_on(std::ostream& os) const
+  {
+    double const interval_s = std::chrono::duration<double>(m_application.interval()).count();
+    for (Measurement const& measurement : m_measurements)
+      os << std::setw(10) << measurement.m_state << ": " << std::fixed << std::setprecision(3) << measurement.m_cpu_time_s << " s CPU in " <<
+        interval_s << " s (" << std::setprecision(1) << (100.0 * measurement.m_cpu_time_s / interval_s) << "%), " <<
+        measurement.m_frames << " frames\n";
+  }
+
+ private:
+  void measure(char const* state)
+  {
+    std::this_thread::sleep_for(s_settle_time);
+    uint64_t const frames_begin = m_application.frames();
+    double const cpu_begin = process_cpu_time_s();
+    std::this_thread::sleep_for(m_application.interval());
+    m_measurements.push_back({ state, process_cpu_time_s() - cpu_begin, m_application.frames() - frames_begin });
+  }
+};
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  Debug(NAMESPACE_DEBUG::init());
+  Dout(dc::notice, "Entering main()");
+
+  try
+  {
+    // Create the application object.
+    IdleWindow application;
+
+    // Initialize application; this parses the command line.
+    application.initialize(argc, argv);
+
+    // Create a window and a logical device that supports presenting to it.
+    auto root_window = application.create_root_window<vulkan::WindowEvents, Window>({400, 300}, LogicalDevice::root_window_request_cookie);
+    application.create_logical_device(std::make_unique<LogicalDevice>(), std::move(root_window));
+
+    // Measure from a separate thread: the controller closes the window when it is done, which terminates run().
+    Controller controller(application);
+    std::thread controller_thread([&controller]{ controller.run(); });
+
+    // Run the application until the window is closed.
+    application.run();
+    controller_thread.join();
+
+    controller.print_on(std::cout);
+    std::cout << std::flush;
+  }
+  catch (AIAlert::Error const& error)
+  {
+    // Application terminated with an error.
+    Dout(dc::warning, "\e[31m" << error << ", caught in IdleWindow.cxx\e[0m");
+  }
+#ifndef CWDEBUG // Commented out so we can see in gdb where an exception is thrown from.
+  catch (std::exception& exception)
+  {
+    DoutFatal(dc::core, "\e[31mstd::exception: " << exception.what() << " caught in IdleWindow.cxx\e[0m");
+  }
+#endif
+
+  Dout(dc::notice, "Leaving main()");
+}
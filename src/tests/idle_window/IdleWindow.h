@@ -0,0 +1,52 @@
+#pragma once
+
+#include "vulkan/Application.h"
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <algorithm>
+
+class Window;
+
+class IdleWindow : public vulkan::Application
+{
+  using vulkan::Application::Application;
+
+ private:
+  std::chrono::milliseconds m_interval{2000};   // The length of each measurement.
+  std::atomic<Window*> m_window{nullptr};
+  std::atomic<uint64_t> m_frames{0};            // The total number of frames rendered by the window.
+
+ private:
+  int thread_pool_number_of_worker_threads() const override
+  {
+    // Lets use 4 worker threads in the thread pool.
+    return 4;
+  }
+
+  // Usage: idle_window [--interval MILLISECONDS]
+  void parse_command_line_parameters(int argc, char* argv[]) override
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      std::string const arg = argv[i];
+      if (arg == "--interval" && i + 1 < argc)
+        m_interval = std::chrono::milliseconds{std::max(100, std::stoi(argv[++i]))};
+    }
+  }
+
+ public:
+  std::u8string application_name() const override
+  {
+    return u8"IdleWindow";
+  }
+
+  // Accessors.
+  std::chrono::milliseconds interval() const { return m_interval; }
+  Window* window() const { return m_window.load(std::memory_order::acquire); }
+  uint64_t frames() const { return m_frames.load(std::memory_order::relaxed); }
+
+  // Called by Window.
+  void set_window(Window* window) { m_window.store(window, std::memory_order::release); }
+  void frame_rendered() { m_frames.fetch_add(1, std::memory_order::relaxed); }
+};
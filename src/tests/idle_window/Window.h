@@ -0,0 +1,110 @@
+#pragma once
+
+#include "IdleWindow.h"
+#include "SynchronousWindow.h"
+#include <imgui.h>
+#include <atomic>
+#include "debug.h"
+
+// A window that only draws an ImGui window, and that can be switched between rendering
+// every frame and only rendering when something changed (see idle_when_static).
+class Window : public task::SynchronousWindow
+{
+ private:
+  IdleWindow& m_application;
+  std::atomic_bool m_static{false};
+
+ public:
+  Window(vulkan::Application* application COMMA_CWDEBUG_ONLY(bool debug)) :
+    task::SynchronousWindow(application COMMA_CWDEBUG_ONLY(debug)), m_application(static_cast<IdleWindow&>(*application))
+  {
+    m_application.set_window(this);
+  }
+
+  ~Window() override
+  {
+    m_application.set_window(nullptr);
+  }
+
+  // Thread-safe. Switch between rendering continuously and only when invalidated.
+  void set_static(bool is_static)
+  {
+    m_static.store(is_static, std::memory_order::relaxed);
+    // Wake up the render loop, in case it is idle.
+    invalidate();
+  }
+
+ private:
+  bool idle_when_static() const override
+  {
+    return m_static.load(std::memory_order::relaxed);
+  }
+
+  void create_render_graph() override
+  {
+    DoutEntering(dc::vulkan, "Window::create_render_graph() [" << this << "]");
+
+    // This must be a reference.
+    auto& output = swapchain().presentation_attachment();
+
+    // This window draws nothing but an ImGui window.
+    m_render_graph = imgui_pass->stores(~output);
+
+    // Generate everything.
+    m_render_graph.generate(this);
+  }
+
+  void register_shader_templates() override { }
+  void create_textures() override { }
+  void create_graphics_pipelines() override { }
+
+  threadpool::Timer::Interval get_frame_rate_interval() const override
+  {
+    // Render at 60 frames per second while not idle.
+    return threadpool::Interval<16, std::chrono::milliseconds>{};
+  }
+
+  //===========================================================================
+  //
+  // Frame code (called every frame)
+  //
+  //===========================================================================
+
+  void render_frame() override
+  {
+    DoutEntering(dc::vkframe, "Window::render_frame() [" << this << "]");
+
+    start_frame();
+    acquire_image();                    // Can throw vulkan::OutOfDateKHR_Exception.
+
+    vulkan::FrameResourcesData* frame_resources = m_current_frame.m_frame_resources;
+    imgui_pass.update_image_views(swapchain(), frame_resources);
+
+    wait_command_buffer_completed();
+    auto command_buffer = frame_resources->m_command_buffer;
+    command_buffer->begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+    command_buffer->beginRenderPass(imgui_pass.begin_info(), vk::SubpassContents::eInline);
+    m_imgui.render_frame(command_buffer, m_current_frame.m_resource_index COMMA_CWDEBUG_ONLY(debug_name_prefix("m_imgui")));
+    command_buffer->endRenderPass();
+    command_buffer->end();
+
+    submit(command_buffer);
+    finish_frame();
+
+    m_application.frame_rendered();
+  }
+
+  void draw_imgui() override final
+  {
+    ImGuiIO& io = ImGui::GetIO();
+
+    ImGui::SetNextWindowPos(ImVec2(0.0f, 0.0f));
+    ImGui::SetNextWindowSize(io.DisplaySize);
+    ImGui::Begin("IdleWindow", nullptr,
+        ImGuiWindowFlags_NoDecoration |
+        ImGuiWindowFlags_NoMove |
+        ImGuiWindowFlags_NoSavedSettings);
+    ImGui::Text(m_static.load(std::memory_order::relaxed) ? "Static" : "Rendering");
+    ImGui::End();
+  }
+};
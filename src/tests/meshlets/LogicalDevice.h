@@ -0,0 +1,43 @@
+#pragma once
+
+#include "vulkan/LogicalDevice.h"
+#include "vulkan/infos/DeviceCreateInfo.h"
+
+class LogicalDevice : public vulkan::LogicalDevice
+{
+ public:
+  // We only have one window.
+  static constexpr int root_window_request_cookie = 1;
+
+ public:
+  LogicalDevice()
+  {
+    DoutEntering(dc::notice, "LogicalDevice::LogicalDevice() [" << this << "]");
+  }
+
+  ~LogicalDevice() override
+  {
+    DoutEntering(dc::notice, "LogicalDevice::~LogicalDevice() [" << this << "]");
+  }
+
+  void prepare_logical_device(vulkan::DeviceCreateInfo& device_create_info) const override
+  {
+    using vulkan::QueueFlagBits;
+
+    device_create_info
+    // {0}
+    .addQueueRequest({
+        .queue_flags = QueueFlagBits::eGraphics,
+        .max_number_of_queues = 1,
+        .cookies = root_window_request_cookie})
+    // {1}
+    .combineQueueRequest({
+        .queue_flags = QueueFlagBits::ePresentation,
+        .max_number_of_queues = 1,      // Only used when it can not be combined.
+        .cookies = root_window_request_cookie})
+#ifdef CWDEBUG
+    .setDebugName("LogicalDevice");
+#endif
+    ;
+  }
+};
@@ -0,0 +1,48 @@
+#include "sys.h"
+#include "Application.inl.h"
+#include "Meshlets.h"
+#include "Window.h"
+#include "LogicalDevice.h"
+#include "debug.h"
+
+// Splits a sphere into meshlets and draws it with the task and mesh shaders of vulkan::meshlet
+// (see MeshletShaders.h), at a dynamic resolution (see SynchronousWindow::use_dynamic_resolution)
+// with an ImGui window on top. The draws are the result of two-phase occlusion culling (see
+// culling/OcclusionShaders.h), whose compute passes are part of the render graph. After a few frames
+// that were drawn with the mesh shader pipeline the window closes itself. Requires VK_EXT_mesh_shader,
+// buffer device addresses and drawIndirectCount.
+
+int main(int argc, char* argv[])
+{
+  Debug(NAMESPACE_DEBUG::init());
+  Dout(dc::notice, "Entering main()");
+
+  try
+  {
+    // Create the application object.
+    Meshlets application;
+
+    // Initialize application; this parses the command line.
+    application.initialize(argc, argv);
+
+    // Create a window and a logical device that supports presenting to it.
+    auto root_window = application.create_root_window<vulkan::WindowEvents, Window>({400, 400}, LogicalDevice::root_window_request_cookie);
+    application.create_logical_device(std::make_unique<LogicalDevice>(), std::move(root_window));
+
+    // Run the application until the window closes itself.
+    application.run();
+  }
+  catch (AIAlert::Error const& error)
+  {
+    // Application terminated with an error.
+    Dout(dc::warning, "\e[31m" << error << ", caught in Meshlets.cxx\e[0m");
+  }
+#ifndef CWDEBUG // Commented out so we can see in gdb where an exception is thrown from.
+  catch (std::exception& exception)
+  {
+    DoutFatal(dc::core, "\e[31mstd::exception: " << exception.what() << " caught in Meshlets.cxx\e[0m");
+  }
+#endif
+
+  Dout(dc::notice, "Leaving main()");
+}
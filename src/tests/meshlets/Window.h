@@ -0,0 +1,739 @@
+#pragma once
+
+#include "SynchronousWindow.h"
+#include "Pipeline.h"
+#include "memory/Buffer.h"
+#include "memory/DataFeeder.h"
+#include "meshlet/MeshletBuilder.h"
+#include "meshlet/MeshletShaders.h"
+#include "culling/DepthPyramidPass.h"
+#include "culling/OcclusionShaders.h"
+#include "queues/CopyDataToBuffer.h"
+#include "pipeline/FactoryCharacteristicId.h"
+#include "pipeline/PushConstantUpdater.h"
+#include "pipeline/PipelineTable.h"
+#include "shader_builder/ShaderIndex.h"
+#include "shader_builder/ShaderInfo.h"
+#include "utils/Array.h"
+
+#include "pipeline/ShaderInputData.inl.h"
+
+#include <imgui.h>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <numbers>
+#include <string_view>
+#include <vector>
+#include "debug.h"
+
+class Window : public task::SynchronousWindow
+{
+ public:
+  using task::SynchronousWindow::SynchronousWindow;
+
+ private:
+  // The scene is rendered at a dynamic resolution (see use_dynamic_resolution) and blitted into the swapchain image.
+  static inline vulkan::ImageKind const s_scene_image_kind{{
+    .usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc,
+    .initial_layout = vk::ImageLayout::eColorAttachmentOptimal
+  }};
+  static inline vulkan::ImageViewKind const s_scene_image_view_kind{s_scene_image_kind, {}};
+  // The depth buffer is stored and copied by the depth pyramid pass (see vulkan::culling::DepthPyramidPass).
+  static inline vulkan::ImageKind const s_copied_depth_image_kind{{
+    .format = s_default_depth_format,
+    .usage = vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eTransferSrc,
+    .initial_layout = vk::ImageLayout::eUndefined
+  }};
+  static inline vulkan::ImageViewKind const s_copied_depth_image_view_kind{s_copied_depth_image_kind, {}};
+
+  // Define renderpass / attachment objects.
+  // Two-phase occlusion culling (see vulkan::culling::OcclusionShaders.h): early_cull, depth_pyramid_pass and
+  // late_cull are compute passes, main_pass and late_pass draw the output of the culling pass before them.
+  RenderPass early_cull{this, "early_cull"};
+  RenderPass main_pass{this, "main_pass"};
+  RenderPass depth_pyramid_pass{this, "depth_pyramid_pass"};
+  RenderPass late_cull{this, "late_cull"};
+  RenderPass late_pass{this, "late_pass"};
+  Attachment     scene{this, "scene", s_scene_image_view_kind};
+  Attachment     depth{this, "depth", s_copied_depth_image_view_kind};
+
+  enum class LocalShaderIndex {
+    task,
+    mesh,
+    frag,
+    depth_pyramid,
+    occlusion_cull
+  };
+  utils::Array<vulkan::shader_builder::ShaderIndex, 5, LocalShaderIndex> m_shader_indices;
+
+  // The uploaded buffers whose device addresses are passed in the push constants MeshletDraw and OcclusionCull.
+  enum class BufferIndex {
+    meshlets,
+    vertex_indices,
+    primitive_indices,
+    vertices,
+    camera,
+    objects,
+    visibility
+  };
+  static constexpr int number_of_buffers = 7;
+  utils::Array<vulkan::memory::Buffer, number_of_buffers, BufferIndex> m_buffers;
+  std::atomic_int m_number_of_uploaded_buffers{0};
+  uint32_t m_meshlet_count{};
+
+  // The output of the culling passes: the indirect draws and their number.
+  vulkan::memory::Buffer m_draws;
+  vulkan::memory::Buffer m_draw_count;
+
+  vulkan::Pipeline m_graphics_pipeline;         // Used by main_pass and late_pass (their render passes are compatible).
+  vulkan::pipeline::FactoryHandle m_pipeline_factory;
+  vulkan::pipeline::PushConstantUpdater<vulkan::meshlet::MeshletDraw> m_push_constant_updater;
+
+  vulkan::Pipeline m_depth_pyramid_pipeline;
+  vulkan::pipeline::FactoryHandle m_depth_pyramid_pipeline_factory;
+  vulkan::culling::DepthPyramidPass m_depth_pyramid;
+
+  vulkan::Pipeline m_occlusion_cull_pipeline;
+  vulkan::pipeline::FactoryHandle m_occlusion_cull_pipeline_factory;
+  vulkan::pipeline::PushConstantUpdater<vulkan::culling::OcclusionCull> m_occlusion_cull_push_constant_updater;
+
+  // The pipelines of the current frame; set by draw_frame for the record functions of the render graph.
+  vk::Pipeline m_vh_graphics_pipeline;
+  vk::Pipeline m_vh_depth_pyramid_pipeline;
+  vk::Pipeline m_vh_occlusion_cull_pipeline;
+  bool m_ready = false;                         // Set when all pipelines exist and all buffers were uploaded.
+
+  // Test state; only accessed from the render loop.
+  std::atomic_bool m_unsupported = false;       // Set when the logical device can't run the meshlet shaders.
+  int m_frames_drawn = 0;
+
+  // The number of frames to draw with the mesh shader pipeline before closing the window.
+  static constexpr int s_frames_to_draw = 10;
+
+  // The sphere that is split into meshlets.
+  static constexpr int s_stacks = 32;
+  static constexpr int s_slices = 64;
+  // The sphere is the only object that is culled.
+  static constexpr uint32_t s_object_count = 1;
+
+  static constexpr std::string_view meshlet_frag_glsl = R"glsl(
+layout(location = 0) in vec3 v_normal;
+layout(location = 0) out vec4 outColor;
+
+void main()
+{
+  // Simple diffuse lighting from the upper right front.
+  float diffuse = max(dot(normalize(v_normal), normalize(vec3(1.0, 1.0, 1.0))), 0.0);
+  outColor = vec4(vec3(0.1 + 0.9 * diffuse), 1.0);
+}
+)glsl";
+
+  // Feeds the contents of a vector as a single chunk.
+  class BytesDataFeeder final : public vulkan::DataFeeder
+  {
+   private:
+    std::vector<unsigned char> m_bytes;
+
+   public:
+    BytesDataFeeder(void const* data, size_t size) : m_bytes(static_cast<unsigned char const*>(data), static_cast<unsigned char const*>(data) + size) { }
+
+    uint32_t chunk_size() const override { return m_bytes.size(); }
+    int chunk_count() const override { return 1; }
+    int next_batch() override { return 1; }
+    void get_chunks(unsigned char* chunk_ptr) override { std::memcpy(chunk_ptr, m_bytes.data(), m_bytes.size()); }
+  };
+
+  void create_render_graph() override
+  {
+    DoutEntering(dc::vulkan, "Window::create_render_graph() [" << this << "]");
+
+    // This must be a reference.
+    auto& output = swapchain().presentation_attachment();
+
+    // The culling passes and the depth pyramid pass are compute passes. This window doesn't use an async-compute
+    // queue (see use_async_compute), so they are recorded into the same command buffer as the render passes.
+    early_cull.set_preferred_queue(vulkan::rendergraph::QueueType::async_compute);
+    depth_pyramid_pass.set_preferred_queue(vulkan::rendergraph::QueueType::async_compute);
+    late_cull.set_preferred_queue(vulkan::rendergraph::QueueType::async_compute);
+
+    // Define the render graph. The compute passes don't know about the attachments; depth_pyramid_pass copies
+    // the depth attachment that main_pass stored and leaves it in the layout that late_pass loads it from.
+    // The imgui_pass loads the scene that upscale_scene blitted into the swapchain image.
+    m_render_graph = early_cull >> main_pass->stores(~scene, ~depth) >> depth_pyramid_pass >> late_cull >>
+      late_pass[+scene][+depth]->stores(scene, depth) >> imgui_pass[-scene][-depth][+output]->stores(output);
+
+    early_cull.set_record_function([this](vulkan::handle::CommandBuffer command_buffer){ record_occlusion_cull(command_buffer, false); });
+    main_pass.set_record_function([this](vulkan::handle::CommandBuffer command_buffer){ record_meshlets(command_buffer, main_pass); });
+    depth_pyramid_pass.set_record_function([this](vulkan::handle::CommandBuffer command_buffer){ record_depth_pyramid(command_buffer); });
+    late_cull.set_record_function([this](vulkan::handle::CommandBuffer command_buffer){ record_occlusion_cull(command_buffer, true); });
+    late_pass.set_record_function([this](vulkan::handle::CommandBuffer command_buffer){ record_meshlets(command_buffer, late_pass); });
+    imgui_pass.set_record_function([this](vulkan::handle::CommandBuffer command_buffer){
+      upscale_scene(command_buffer, scene);
+      command_buffer->beginRenderPass(imgui_pass.begin_info(), vk::SubpassContents::eInline);
+      m_imgui.render_frame(command_buffer, m_current_frame.m_resource_index COMMA_CWDEBUG_ONLY(debug_name_prefix("m_imgui")));
+      command_buffer->endRenderPass();
+    });
+
+    // Generate everything.
+    m_render_graph.generate(this);
+  }
+
+  void register_shader_templates() override
+  {
+    DoutEntering(dc::notice, "Window::register_shader_templates() [" << this << "]");
+
+    using namespace vulkan::shader_builder;
+
+    // GL_EXT_mesh_shader requires SPIR-V 1.4.
+    ShaderCompilerOptions compiler_options;
+    compiler_options.set_target_env(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_3);
+
+    std::vector<ShaderInfo> shader_info = {
+      { vk::ShaderStageFlagBits::eTaskEXT,  "meshlet.task.glsl", compiler_options },
+      { vk::ShaderStageFlagBits::eMeshEXT,  "meshlet.mesh.glsl", compiler_options },
+      { vk::ShaderStageFlagBits::eFragment, "meshlet.frag.glsl" },
+      { vk::ShaderStageFlagBits::eCompute,  "depth_pyramid.comp.glsl", compiler_options },
+      { vk::ShaderStageFlagBits::eCompute,  "occlusion_cull.comp.glsl", compiler_options }
+    };
+    shader_info[0].load(vulkan::meshlet::meshlet_task_glsl);
+    shader_info[1].load(vulkan::meshlet::meshlet_mesh_glsl);
+    shader_info[2].load(meshlet_frag_glsl);
+    shader_info[3].load(vulkan::culling::depth_pyramid_glsl);
+    shader_info[4].load(vulkan::culling::occlusion_cull_glsl);
+
+    auto indices = application().register_shaders(std::move(shader_info));
+
+    // Copy the returned "shader indices" into our local array.
+    ASSERT(indices.size() == m_shader_indices.size());
+    for (int i = 0; i < indices.size(); ++i)
+      m_shader_indices[static_cast<LocalShaderIndex>(i)] = indices[i];
+  }
+
+  void create_textures() override { }
+
+  bool use_dynamic_resolution(vulkan::DynamicResolution::Settings& UNUSED_ARG(settings)) const override
+  {
+    return true;
+  }
+
+  // Generate a unit sphere with counter-clockwise (seen from the outside) triangles.
+  static void generate_sphere(std::vector<glsl::vec3>& positions, std::vector<uint32_t>& indices)
+  {
+    for (int stack = 0; stack <= s_stacks; ++stack)
+    {
+      float const theta = std::numbers::pi_v<float> * stack / s_stacks;
+      for (int slice = 0; slice <= s_slices; ++slice)
+      {
+        float const phi = 2.0f * std::numbers::pi_v<float> * slice / s_slices;
+        positions.emplace_back(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+      }
+    }
+    for (uint32_t stack = 0; stack < s_stacks; ++stack)
+      for (uint32_t slice = 0; slice < s_slices; ++slice)
+      {
+        uint32_t const a = stack * (s_slices + 1) + slice;
+        uint32_t const b = a + s_slices + 1;
+        indices.insert(indices.end(), { a, a + 1, b, a + 1, b + 1, b });
+      }
+  }
+
+  // A camera at (0, 0, 3) looking at the origin, with y up and vulkan clip space.
+  static vulkan::meshlet::MeshletCamera make_camera()
+  {
+    float const near = 0.1f;
+    float const far = 10.0f;
+    float const f = 1.0f / std::tan(std::numbers::pi_v<float> / 8);     // A vertical field of view of 45 degrees.
+    glsl::mat4 projection = glsl::mat4::Zero();
+    projection(0, 0) = f;                               // The window is square.
+    projection(1, 1) = -f;                              // Vulkan's y axis points down.
+    projection(2, 2) = far / (near - far);
+    projection(2, 3) = near * far / (near - far);
+    projection(3, 2) = -1.0f;
+    glsl::mat4 view = glsl::mat4::Identity();
+    view(2, 3) = -3.0f;
+
+    vulkan::meshlet::MeshletCamera camera;
+    camera.m_view_projection = projection * view;
+    camera.m_frustum_planes = vulkan::meshlet::frustum_planes(camera.m_view_projection);
+    camera.m_camera_position = glsl::vec4{0.0f, 0.0f, 3.0f, 1.0f};
+    return camera;
+  }
+
+  // Create the buffer with index buffer_index and upload size bytes from data to it. The visibility buffer is also written by the culling shader.
+  void upload_buffer(BufferIndex buffer_index, void const* data, size_t size)
+  {
+    m_buffers[buffer_index] = vulkan::memory::Buffer{logical_device(), size,
+        { .usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eTransferDst,
+          .properties = vk::MemoryPropertyFlagBits::eDeviceLocal }
+        COMMA_CWDEBUG_ONLY(debug_name_prefix("m_buffers[" + std::to_string(static_cast<int>(buffer_index)) + "]"))};
+
+    auto copy_data_to_buffer = statefultask::create<task::CopyDataToBuffer>(logical_device(), size, m_buffers[buffer_index].m_vh_buffer, 0, vk::AccessFlags(0),
+        vk::PipelineStageFlagBits::eTopOfPipe, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite,
+        vk::PipelineStageFlagBits::eTaskShaderEXT | vk::PipelineStageFlagBits::eMeshShaderEXT | vk::PipelineStageFlagBits::eComputeShader
+        COMMA_CWDEBUG_ONLY(true));
+
+    copy_data_to_buffer->set_resource_owner(this);    // Wait for this task to finish before destroying this window, because this window owns the buffer.
+    copy_data_to_buffer->set_data_feeder(std::make_unique<BytesDataFeeder>(data, size));
+    copy_data_to_buffer->run(vulkan::Application::instance().low_priority_queue(), [this](bool success){
+      if (success)
+        ++m_number_of_uploaded_buffers;
+    });
+  }
+
+  void create_meshlet_buffers()
+  {
+    DoutEntering(dc::vulkan, "Window::create_meshlet_buffers() [" << this << "]");
+
+    using namespace vulkan::meshlet;
+
+    std::vector<glsl::vec3> positions;
+    std::vector<uint32_t> indices;
+    generate_sphere(positions, indices);
+
+    MeshletBuilder builder;
+    MeshletMesh meshlet_mesh = builder.build(positions, indices);
+    m_meshlet_count = meshlet_mesh.m_meshlets.size();
+    Dout(dc::notice, "The sphere was split into " << m_meshlet_count << " meshlets.");
+
+    // The normal of a point on a unit sphere is its position.
+    std::vector<MeshletVertex> meshlet_vertices;
+    for (glsl::vec3 const& position : positions)
+      meshlet_vertices.push_back({ .m_position = { position.x(), position.y(), position.z(), 1.0f }, .m_normal = { position.x(), position.y(), position.z(), 0.0f } });
+    std::vector<uint8_t> const padded_primitive_indices = meshlet_mesh.padded_primitive_indices();
+    MeshletCamera const camera = make_camera();
+
+    using namespace vulkan::culling;
+
+    // The bounding sphere of the whole mesh. Its draw is read by drawMeshTasksIndirectCountEXT as the number of task shader workgroups.
+    CullObject const object{
+      .m_center = { 0.0f, 0.0f, 0.0f },
+      .m_radius = 1.0f,
+      .m_index_count = (m_meshlet_count + task_workgroup_size - 1) / task_workgroup_size,
+      .m_first_index = 1,
+      .m_vertex_offset = 0,
+      .m_first_instance = 0
+    };
+    std::vector<uint32_t> const visibility(s_object_count, 0);
+
+    upload_buffer(BufferIndex::meshlets, meshlet_mesh.m_meshlets.data(), meshlet_mesh.m_meshlets.size() * sizeof(Meshlet));
+    upload_buffer(BufferIndex::vertex_indices, meshlet_mesh.m_vertex_indices.data(), meshlet_mesh.m_vertex_indices.size() * sizeof(uint32_t));
+    upload_buffer(BufferIndex::primitive_indices, padded_primitive_indices.data(), padded_primitive_indices.size());
+    upload_buffer(BufferIndex::vertices, meshlet_vertices.data(), meshlet_vertices.size() * sizeof(MeshletVertex));
+    upload_buffer(BufferIndex::camera, &camera, sizeof(MeshletCamera));
+    upload_buffer(BufferIndex::objects, &object, sizeof(CullObject));
+    upload_buffer(BufferIndex::visibility, visibility.data(), visibility.size() * sizeof(uint32_t));
+
+    m_draws = vulkan::memory::Buffer{logical_device(), s_object_count * sizeof(DrawIndexedIndirectCommand),
+        { .usage = vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+          .properties = vk::MemoryPropertyFlagBits::eDeviceLocal }
+        COMMA_CWDEBUG_ONLY(debug_name_prefix("m_draws"))};
+    m_draw_count = vulkan::memory::Buffer{logical_device(), sizeof(uint32_t),
+        { .usage = vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress |
+            vk::BufferUsageFlagBits::eTransferDst,
+          .properties = vk::MemoryPropertyFlagBits::eDeviceLocal }
+        COMMA_CWDEBUG_ONLY(debug_name_prefix("m_draw_count"))};
+
+    m_push_constant_updater.set<&MeshletDraw::m_meshlets>(to_uvec2(logical_device()->get_buffer_address(m_buffers[BufferIndex::meshlets].m_vh_buffer)));
+    m_push_constant_updater.set<&MeshletDraw::m_vertex_indices>(to_uvec2(logical_device()->get_buffer_address(m_buffers[BufferIndex::vertex_indices].m_vh_buffer)));
+    m_push_constant_updater.set<&MeshletDraw::m_primitive_indices>(to_uvec2(logical_device()->get_buffer_address(m_buffers[BufferIndex::primitive_indices].m_vh_buffer)));
+    m_push_constant_updater.set<&MeshletDraw::m_vertices>(to_uvec2(logical_device()->get_buffer_address(m_buffers[BufferIndex::vertices].m_vh_buffer)));
+    m_push_constant_updater.set<&MeshletDraw::m_camera>(to_uvec2(logical_device()->get_buffer_address(m_buffers[BufferIndex::camera].m_vh_buffer)));
+    m_push_constant_updater.set<&MeshletDraw::m_meshlet_count>(m_meshlet_count);
+
+    m_occlusion_cull_push_constant_updater.set<&OcclusionCull::m_objects>(to_uvec2(logical_device()->get_buffer_address(m_buffers[BufferIndex::objects].m_vh_buffer)));
+    m_occlusion_cull_push_constant_updater.set<&OcclusionCull::m_visibility>(to_uvec2(logical_device()->get_buffer_address(m_buffers[BufferIndex::visibility].m_vh_buffer)));
+    m_occlusion_cull_push_constant_updater.set<&OcclusionCull::m_draws>(to_uvec2(logical_device()->get_buffer_address(m_draws.m_vh_buffer)));
+    m_occlusion_cull_push_constant_updater.set<&OcclusionCull::m_draw_count>(to_uvec2(logical_device()->get_buffer_address(m_draw_count.m_vh_buffer)));
+    // OcclusionCullCamera is a prefix of MeshletCamera.
+    m_occlusion_cull_push_constant_updater.set<&OcclusionCull::m_camera>(to_uvec2(logical_device()->get_buffer_address(m_buffers[BufferIndex::camera].m_vh_buffer)));
+    m_occlusion_cull_push_constant_updater.set<&OcclusionCull::m_object_count>(s_object_count);
+  }
+
+  class MeshletPipelineCharacteristic : public vulkan::pipeline::Characteristic
+  {
+   private:
+    std::vector<vk::PipelineColorBlendAttachmentState> m_pipeline_color_blend_attachment_states;
+    std::vector<vk::DynamicState> m_dynamic_states = {
+      vk::DynamicState::eViewport,
+      vk::DynamicState::eScissor
+    };
+    std::vector<vk::PushConstantRange> m_push_constant_ranges;
+
+   protected:
+    using direct_base_type = vulkan::pipeline::Characteristic;
+
+    // The different states of this task.
+    enum MeshletPipelineCharacteristic_state_type {
+      MeshletPipelineCharacteristic_initialize = direct_base_type::state_end,
+      MeshletPipelineCharacteristic_compile
+    };
+
+    ~MeshletPipelineCharacteristic() override
+    {
+      DoutEntering(dc::vulkan, "MeshletPipelineCharacteristic::~MeshletPipelineCharacteristic() [" << this << "]");
+    }
+
+   public:
+    static constexpr state_type state_end = MeshletPipelineCharacteristic_compile + 1;
+
+    MeshletPipelineCharacteristic(task::SynchronousWindow const* owning_window COMMA_CWDEBUG_ONLY(bool debug)) :
+      vulkan::pipeline::Characteristic(owning_window COMMA_CWDEBUG_ONLY(debug)) { }
+
+   protected:
+    char const* state_str_impl(state_type run_state) const override
+    {
+      switch(run_state)
+      {
+        AI_CASE_RETURN(MeshletPipelineCharacteristic_initialize);
+        AI_CASE_RETURN(MeshletPipelineCharacteristic_compile);
+      }
+      return direct_base_type::state_str_impl(run_state);
+    }
+
+    void initialize_impl() override
+    {
+      set_state(MeshletPipelineCharacteristic_initialize);
+    }
+
+    void multiplex_impl(state_type run_state) override
+    {
+      switch (run_state)
+      {
+        case MeshletPipelineCharacteristic_initialize:
+        {
+          Window const* window = static_cast<Window const*>(m_owning_window);
+
+          // Register the vectors that we will fill. There are no vertex buffers or descriptors: everything is passed in the push constant.
+          m_flat_create_info->add(&shader_stage_create_infos());
+          m_flat_create_info->add(&m_pipeline_color_blend_attachment_states);
+          m_flat_create_info->add(&m_dynamic_states);
+          m_flat_create_info->add_descriptor_set_layouts(&sorted_descriptor_set_layouts());
+          m_flat_create_info->add(&m_push_constant_ranges);
+
+          add_push_constant<vulkan::meshlet::MeshletDraw>();
+
+          // Add default color blend.
+          m_pipeline_color_blend_attachment_states.push_back(vk_defaults::PipelineColorBlendAttachmentState{});
+
+          preprocess1(m_owning_window->application().get_shader_info(window->m_shader_indices[LocalShaderIndex::task]));
+          preprocess1(m_owning_window->application().get_shader_info(window->m_shader_indices[LocalShaderIndex::mesh]));
+          preprocess1(m_owning_window->application().get_shader_info(window->m_shader_indices[LocalShaderIndex::frag]));
+
+          m_push_constant_ranges = push_constant_ranges();
+
+          realize_descriptor_set_layouts(m_owning_window->logical_device());
+
+          set_continue_state(MeshletPipelineCharacteristic_compile);
+          run_state = Characteristic_initialized;
+          break;
+        }
+        case MeshletPipelineCharacteristic_compile:
+        {
+          using namespace vulkan::shader_builder;
+          Window const* window = static_cast<Window const*>(m_owning_window);
+
+          ShaderCompiler compiler;
+          for (LocalShaderIndex local_shader_index : { LocalShaderIndex::task, LocalShaderIndex::mesh, LocalShaderIndex::frag })
+            build_shader(m_owning_window, window->m_shader_indices[local_shader_index], compiler, m_set_index_hint_map
+                COMMA_CWDEBUG_ONLY({ m_owning_window, "PipelineFactory::m_shader_input_data" }));
+
+          run_state = Characteristic_compiled;
+          break;
+        }
+      }
+      direct_base_type::multiplex_impl(run_state);
+    }
+
+   public:
+#ifdef CWDEBUG
+    void print_on(std::ostream& os) const override
+    {
+      os << "{ (MeshletPipelineCharacteristic*)" << this << " }";
+    }
+#endif
+  };
+
+  // The characteristic of the compute pipelines: a single compute shader whose only input is the push constant ENTRY.
+  template<typename ENTRY>
+  class ComputePipelineCharacteristic : public vulkan::pipeline::Characteristic
+  {
+   private:
+    LocalShaderIndex m_local_shader_index;
+    std::vector<vk::PushConstantRange> m_push_constant_ranges;
+
+   protected:
+    using direct_base_type = vulkan::pipeline::Characteristic;
+
+    // The different states of this task.
+    enum ComputePipelineCharacteristic_state_type {
+      ComputePipelineCharacteristic_initialize = direct_base_type::state_end,
+      ComputePipelineCharacteristic_compile
+    };
+
+    ~ComputePipelineCharacteristic() override
+    {
+      DoutEntering(dc::vulkan, "ComputePipelineCharacteristic::~ComputePipelineCharacteristic() [" << this << "]");
+    }
+
+   public:
+    static constexpr state_type state_end = ComputePipelineCharacteristic_compile + 1;
+
+    ComputePipelineCharacteristic(task::SynchronousWindow const* owning_window, LocalShaderIndex local_shader_index COMMA_CWDEBUG_ONLY(bool debug)) :
+      vulkan::pipeline::Characteristic(owning_window COMMA_CWDEBUG_ONLY(debug)), m_local_shader_index(local_shader_index) { }
+
+   protected:
+    char const* state_str_impl(state_type run_state) const override
+    {
+      switch(run_state)
+      {
+        AI_CASE_RETURN(ComputePipelineCharacteristic_initialize);
+        AI_CASE_RETURN(ComputePipelineCharacteristic_compile);
+      }
+      return direct_base_type::state_str_impl(run_state);
+    }
+
+    void initialize_impl() override
+    {
+      set_state(ComputePipelineCharacteristic_initialize);
+    }
+
+    void multiplex_impl(state_type run_state) override
+    {
+      switch (run_state)
+      {
+        case ComputePipelineCharacteristic_initialize:
+        {
+          Window const* window = static_cast<Window const*>(m_owning_window);
+
+          // Only a shader stage and the push constant: the pipeline factory then creates a compute pipeline.
+          m_flat_create_info->add(&shader_stage_create_infos());
+          m_flat_create_info->add_descriptor_set_layouts(&sorted_descriptor_set_layouts());
+          m_flat_create_info->add(&m_push_constant_ranges);
+
+          add_push_constant<ENTRY>();
+
+          preprocess1(m_owning_window->application().get_shader_info(window->m_shader_indices[m_local_shader_index]));
+
+          m_push_constant_ranges = push_constant_ranges();
+
+          realize_descriptor_set_layouts(m_owning_window->logical_device());
+
+          set_continue_state(ComputePipelineCharacteristic_compile);
+          run_state = Characteristic_initialized;
+          break;
+        }
+        case ComputePipelineCharacteristic_compile:
+        {
+          using namespace vulkan::shader_builder;
+          Window const* window = static_cast<Window const*>(m_owning_window);
+
+          ShaderCompiler compiler;
+          build_shader(m_owning_window, window->m_shader_indices[m_local_shader_index], compiler, m_set_index_hint_map
+              COMMA_CWDEBUG_ONLY({ m_owning_window, "PipelineFactory::m_shader_input_data" }));
+
+          run_state = Characteristic_compiled;
+          break;
+        }
+      }
+      direct_base_type::multiplex_impl(run_state);
+    }
+
+   public:
+#ifdef CWDEBUG
+    void print_on(std::ostream& os) const override
+    {
+      os << "{ (ComputePipelineCharacteristic<" << ::NAMESPACE_DEBUG::type_name_of<ENTRY>() << ">*)" << this << " }";
+    }
+#endif
+  };
+
+  bool is_supported() const
+  {
+    return logical_device()->supports_mesh_shader() && logical_device()->supports_buffer_device_address() &&
+      logical_device()->supports_draw_indirect_count();
+  }
+
+  void create_graphics_pipelines() override
+  {
+    DoutEntering(dc::vulkan, "Window::create_graphics_pipelines() [" << this << "]");
+
+    if (!is_supported())
+    {
+      std::cout << "The logical device does not support mesh shaders, buffer device addresses and indirect draw counts; skipping this test." << std::endl;
+      m_unsupported = true;
+      return;
+    }
+
+    // This is called again when the pipeline factories are recreated; the buffers only have to be created once.
+    if (!m_draws.m_vh_buffer)
+      create_meshlet_buffers();
+
+    m_pipeline_factory = create_pipeline_factory(m_graphics_pipeline, main_pass.vh_render_pass() COMMA_CWDEBUG_ONLY(true));
+    m_pipeline_factory.add_characteristic<MeshletPipelineCharacteristic>(this COMMA_CWDEBUG_ONLY(true));
+    m_pipeline_factory.generate(this);
+
+    // The compute pipelines don't have a render pass.
+    m_depth_pyramid_pipeline_factory = create_pipeline_factory(m_depth_pyramid_pipeline, vk::RenderPass{} COMMA_CWDEBUG_ONLY(true));
+    m_depth_pyramid_pipeline_factory.add_characteristic<ComputePipelineCharacteristic<vulkan::culling::DepthPyramidLevel>>(this,
+        LocalShaderIndex::depth_pyramid COMMA_CWDEBUG_ONLY(true));
+    m_depth_pyramid_pipeline_factory.generate(this);
+
+    m_occlusion_cull_pipeline_factory = create_pipeline_factory(m_occlusion_cull_pipeline, vk::RenderPass{} COMMA_CWDEBUG_ONLY(true));
+    m_occlusion_cull_pipeline_factory.add_characteristic<ComputePipelineCharacteristic<vulkan::culling::OcclusionCull>>(this,
+        LocalShaderIndex::occlusion_cull COMMA_CWDEBUG_ONLY(true));
+    m_occlusion_cull_pipeline_factory.generate(this);
+  }
+
+  // Called after all frames completed: (re)create the depth pyramid buffers for the new depth attachments.
+  void on_window_size_changed_post() override
+  {
+    task::SynchronousWindow::on_window_size_changed_post();
+    if (is_supported())
+      m_depth_pyramid.create_buffers(logical_device(), swapchain().extent() COMMA_CWDEBUG_ONLY(debug_name_prefix("m_depth_pyramid")));
+  }
+
+  //===========================================================================
+  //
+  // Called from initialize_impl.
+  //
+  threadpool::Timer::Interval get_frame_rate_interval() const override
+  {
+    // Limit the frame rate of this window to 100 frames per second.
+    return threadpool::Interval<10, std::chrono::milliseconds>{};
+  }
+
+  //===========================================================================
+  //
+  // Frame code (called every frame)
+  //
+  //===========================================================================
+
+  void render_frame() override
+  {
+    DoutEntering(dc::vkframe, "Window::render_frame() [" << this << "]");
+
+    if (m_unsupported)
+    {
+      close();
+      return;
+    }
+
+    start_frame();
+    acquire_image();                    // Can throw vulkan::OutOfDateKHR_Exception.
+    draw_frame();
+    finish_frame();
+  }
+
+  void draw_frame()
+  {
+    vulkan::FrameResourcesData* frame_resources = m_current_frame.m_frame_resources;
+    main_pass.update_image_views(swapchain(), frame_resources);
+    late_pass.update_image_views(swapchain(), frame_resources);
+    imgui_pass.update_image_views(swapchain(), frame_resources);
+
+    m_vh_graphics_pipeline = pipeline_table(m_pipeline_factory.factory_index()).lookup(0);
+    m_vh_depth_pyramid_pipeline = pipeline_table(m_depth_pyramid_pipeline_factory.factory_index()).lookup(0);
+    m_vh_occlusion_cull_pipeline = pipeline_table(m_occlusion_cull_pipeline_factory.factory_index()).lookup(0);
+    m_ready = m_vh_graphics_pipeline && m_vh_depth_pyramid_pipeline && m_vh_occlusion_cull_pipeline && m_number_of_uploaded_buffers == number_of_buffers;
+
+    // Calls the record functions of the render passes (see create_render_graph).
+    submit_render_graph();
+
+    if (m_ready && ++m_frames_drawn == s_frames_to_draw)
+    {
+      std::cout << "Drew " << m_meshlet_count << " meshlets with occlusion culling " << s_frames_to_draw << " times. Success!" << std::endl;
+      close();
+    }
+  }
+
+  // Record the early or late culling pass (see OcclusionShaders.h): writes the draws of the next render pass into m_draws and m_draw_count.
+  void record_occlusion_cull(vulkan::handle::CommandBuffer command_buffer, bool is_late_pass)
+  {
+    if (!m_ready)
+      return;
+
+    // The buffers are shared by all frames: wait until the previous render pass read the draws and the previous
+    // culling pass wrote the visibility, then zero the draw count.
+    vk::MemoryBarrier const to_transfer_barrier{
+      .srcAccessMask = vk::AccessFlagBits::eShaderWrite,
+      .dstAccessMask = vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite
+    };
+    command_buffer->pipelineBarrier(vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eComputeShader,
+        vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader, {}, { to_transfer_barrier }, {}, {});
+    command_buffer->fillBuffer(m_draw_count.m_vh_buffer, 0, sizeof(uint32_t), 0);
+    vk::MemoryBarrier const to_compute_barrier{
+      .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+      .dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite
+    };
+    command_buffer->pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {}, { to_compute_barrier }, {}, {});
+
+    command_buffer->bindPipeline(vk::PipelineBindPoint::eCompute, m_vh_occlusion_cull_pipeline);
+    // Each node of the render graph could be recorded into its own command buffer.
+    m_occlusion_cull_push_constant_updater.invalidate();
+    m_occlusion_cull_push_constant_updater.set<&vulkan::culling::OcclusionCull::m_late_pass>(is_late_pass ? 1U : 0U);
+    if (is_late_pass)
+    {
+      // The depth pyramid that depth_pyramid_pass just recorded.
+      vk::Extent2D const pyramid_extent = m_depth_pyramid.extent();
+      m_occlusion_cull_push_constant_updater.set<&vulkan::culling::OcclusionCull::m_depth_pyramid>(vulkan::meshlet::to_uvec2(m_depth_pyramid.pyramid_address()));
+      m_occlusion_cull_push_constant_updater.set<&vulkan::culling::OcclusionCull::m_depth_extent>(glsl::uvec2{pyramid_extent.width, pyramid_extent.height});
+      m_occlusion_cull_push_constant_updater.set<&vulkan::culling::OcclusionCull::m_pyramid_level_count>(m_depth_pyramid.level_count());
+    }
+    m_occlusion_cull_push_constant_updater.flush(command_buffer, m_occlusion_cull_pipeline);
+    command_buffer->dispatch((s_object_count + vulkan::culling::occlusion_cull_workgroup_size - 1) / vulkan::culling::occlusion_cull_workgroup_size, 1, 1);
+
+    // The draws are read by the next render pass.
+    vk::MemoryBarrier const to_draw_indirect_barrier{
+      .srcAccessMask = vk::AccessFlagBits::eShaderWrite,
+      .dstAccessMask = vk::AccessFlagBits::eIndirectCommandRead
+    };
+    command_buffer->pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eDrawIndirect, {}, { to_draw_indirect_barrier }, {}, {});
+  }
+
+  // Record render_pass (main_pass or late_pass): draw the meshlets of the objects that the culling pass before it wrote to m_draws.
+  void record_meshlets(vulkan::handle::CommandBuffer command_buffer, RenderPass const& render_pass)
+  {
+    command_buffer->beginRenderPass(render_pass.begin_info(), vk::SubpassContents::eInline);
+    if (m_ready)
+    {
+      // Only the scene_extent() part of the scene is rendered to.
+      vk::Extent2D const extent = scene_extent();
+      command_buffer->setViewport(0, { vk::Viewport{
+          .x = 0, .y = 0, .width = static_cast<float>(extent.width), .height = static_cast<float>(extent.height),
+          .minDepth = 0.0f, .maxDepth = 1.0f } });
+      command_buffer->setScissor(0, { vk::Rect2D{ .offset = {}, .extent = extent } });
+      command_buffer->bindPipeline(vk::PipelineBindPoint::eGraphics, m_vh_graphics_pipeline);
+      // Each node of the render graph could be recorded into its own command buffer.
+      m_push_constant_updater.invalidate();
+      m_push_constant_updater.flush(command_buffer, m_graphics_pipeline);
+      // Each draw is the number of task shader workgroups of an object (see OcclusionShaders.h).
+      command_buffer->drawMeshTasksIndirectCountEXT(m_draws.m_vh_buffer, 0, m_draw_count.m_vh_buffer, 0, s_object_count,
+          sizeof(vulkan::culling::DrawIndexedIndirectCommand));
+    }
+    command_buffer->endRenderPass();
+  }
+
+  // Record the depth pyramid of the depth attachment that main_pass stored.
+  void record_depth_pyramid(vulkan::handle::CommandBuffer command_buffer)
+  {
+    if (!m_ready)
+      return;
+    vulkan::FrameResourcesData* frame_resources = m_current_frame.m_frame_resources;
+    m_depth_pyramid.record(command_buffer, m_depth_pyramid_pipeline, m_vh_depth_pyramid_pipeline, frame_resources->m_attachments[depth].m_vh_image,
+        main_pass.get_final_layout(&depth, logical_device()->supports_separate_depth_stencil_layouts()), scene_extent());
+  }
+
+  void draw_imgui() override final
+  {
+    vk::Extent2D const extent = scene_extent();
+    ImGui::SetNextWindowPos(ImVec2(0.0f, 0.0f));
+    ImGui::Begin("Meshlets", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoSavedSettings);
+    ImGui::Text("Scene: %ux%u", extent.width, extent.height);
+    vk::Extent2D const pyramid_extent = m_depth_pyramid.extent();
+    ImGui::Text("Depth pyramid: %ux%u, %u levels", pyramid_extent.width, pyramid_extent.height, m_depth_pyramid.level_count());
+    ImGui::End();
+  }
+};
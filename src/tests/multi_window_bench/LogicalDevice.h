@@ -0,0 +1,47 @@
+#pragma once
+
+#include "vulkan/LogicalDevice.h"
+#include "vulkan/infos/DeviceCreateInfo.h"
+
+class LogicalDevice : public vulkan::LogicalDevice
+{
+ public:
+  // All windows use the same cookie: they all use the same queue request.
+  static constexpr int root_window_request_cookie = 1;
+
+ private:
+  uint32_t m_number_of_windows;
+
+ public:
+  LogicalDevice(int number_of_windows) : m_number_of_windows(number_of_windows)
+  {
+    DoutEntering(dc::notice, "LogicalDevice::LogicalDevice(" << number_of_windows << ") [" << this << "]");
+  }
+
+  ~LogicalDevice() override
+  {
+    DoutEntering(dc::notice, "LogicalDevice::~LogicalDevice() [" << this << "]");
+  }
+
+  void prepare_logical_device(vulkan::DeviceCreateInfo& device_create_info) const override
+  {
+    using vulkan::QueueFlagBits;
+
+    device_create_info
+    // {0}
+    .addQueueRequest({
+        .queue_flags = QueueFlagBits::eGraphics,
+        // Without coalescing every window needs its own queue; with coalescing they all share the first one.
+        .max_number_of_queues = m_number_of_windows,
+        .cookies = root_window_request_cookie})
+    // {1}
+    .combineQueueRequest({
+        .queue_flags = QueueFlagBits::ePresentation,
+        .max_number_of_queues = m_number_of_windows,    // Only used when it can not be combined.
+        .cookies = root_window_request_cookie})
+#ifdef CWDEBUG
+    .setDebugName("LogicalDevice");
+#endif
+    ;
+  }
+};
@@ -0,0 +1,99 @@
+#include "sys.h"
+#include "Application.inl.h"
+#include "MultiWindowBench.h"
+#include "Window.h"
+#include "LogicalDevice.h"
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <ctime>
+#include "debug.h"
+
+// Opens N windows on one logical device that do nothing but clear and present, and reports
+// the frame time and CPU time per window. Compare
+//
+//   multi_window_bench --windows N
+//   multi_window_bench --windows N --coalesce
+//
+// to see the effect of the SubmitCoalescer. Without --coalesce every window needs its own
+// graphics queue; use a device with enough queues (or lavapipe) for large N.
+
+namespace {
+
+double process_cpu_time_s()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  Debug(NAMESPACE_DEBUG::init());
+  Dout(dc::notice, "Entering main()");
+
+  try
+  {
+    // Create the application object.
+    MultiWindowBench application;
+
+    // Initialize application; this parses the command line.
+    application.initialize(argc, argv);
+    int const number_of_windows = application.number_of_windows();
+
+    double const cpu_begin = process_cpu_time_s();
+
+    // Create the first window and a logical device that supports presenting to it.
+    auto root_window = application.create_root_window<vulkan::WindowEvents, Window>({400, 300}, LogicalDevice::root_window_request_cookie);
+    auto logical_device = application.create_logical_device(std::make_unique<LogicalDevice>(number_of_windows), std::move(root_window));
+
+    // Create the other windows, using the same logical device.
+    for (int w = 1; w < number_of_windows; ++w)
+      application.create_root_window<vulkan::WindowEvents, Window>({400, 300}, LogicalDevice::root_window_request_cookie, *logical_device);
+
+    // Run the application until all windows closed themselves.
+    application.run();
+
+    double const cpu_total = process_cpu_time_s() - cpu_begin;
+
+    std::vector<WindowStatistics> statistics = application.statistics();
+    std::ranges::sort(statistics, {}, &WindowStatistics::m_window_number);
+    std::cout << number_of_windows << " window(s), coalescing " << (application.coalesce() ? "on" : "off") << ":\n";
+    double sum_frame_time_ms = 0.0;
+    double sum_render_cpu_us = 0.0;
+    for (WindowStatistics const& window : statistics)
+    {
+      std::cout << "  window " << window.m_window_number << ": " << window.m_frames << " frames, " <<
+        std::fixed << std::setprecision(3) << window.m_average_frame_time_ms << " ms/frame, " <<
+        std::setprecision(1) << window.m_average_render_cpu_us << " us CPU/frame in render_frame\n";
+      sum_frame_time_ms += window.m_average_frame_time_ms;
+      sum_render_cpu_us += window.m_average_render_cpu_us;
+    }
+    if (!statistics.empty())
+    {
+      std::cout << "  average: " << std::setprecision(3) << sum_frame_time_ms / statistics.size() << " ms/frame, " <<
+        std::setprecision(1) << sum_render_cpu_us / statistics.size() << " us CPU/frame in render_frame\n";
+      // The coalescer statistics are shared by all windows; use the largest (last) snapshot.
+      auto const last = std::ranges::max_element(statistics, {}, &WindowStatistics::m_number_of_coalesced_frames);
+      if (last->m_number_of_submits > 0)
+        std::cout << "  " << last->m_number_of_coalesced_frames << " frames in " << last->m_number_of_submits << " submits (" <<
+          std::setprecision(2) << static_cast<double>(last->m_number_of_coalesced_frames) / last->m_number_of_submits << " frames/submit)\n";
+    }
+    std::cout << "  total process CPU time: " << std::setprecision(3) << cpu_total << " s" << std::endl;
+  }
+  catch (AIAlert::Error const& error)
+  {
+    // Application terminated with an error.
+    Dout(dc::warning, "\e[31m" << error << ", caught in MultiWindowBench.cxx\e[0m");
+  }
+#ifndef CWDEBUG // Commented out so we can see in gdb where an exception is thrown from.
+  catch (std::exception& exception)
+  {
+    DoutFatal(dc::core, "\e[31mstd::exception: " << exception.what() << " caught in MultiWindowBench.cxx\e[0m");
+  }
+#endif
+
+  Dout(dc::notice, "Leaving main()");
+}
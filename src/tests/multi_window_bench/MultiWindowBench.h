@@ -0,0 +1,69 @@
+#pragma once
+
+#include "vulkan/Application.h"
+#include "threadsafe/aithreadsafe.h"
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <mutex>
+
+// The measurements of a single window.
+struct WindowStatistics
+{
+  int m_window_number;
+  int m_frames;                         // The number of measured frames.
+  double m_average_frame_time_ms;       // The average time between the start of two consecutive frames.
+  double m_average_render_cpu_us;       // The average CPU time (of the render thread) spent in render_frame.
+  uint64_t m_number_of_submits;         // The number of vkQueueSubmit calls of the SubmitCoalescer (zero when not coalescing).
+  uint64_t m_number_of_coalesced_frames;        // The number of frames submitted by the SubmitCoalescer.
+};
+
+class MultiWindowBench : public vulkan::Application
+{
+  using vulkan::Application::Application;
+
+ private:
+  int m_number_of_windows = 4;
+  int m_number_of_frames = 600;         // The number of frames that each window renders before it closes.
+  bool m_coalesce = false;
+
+  using statistics_t = aithreadsafe::Wrapper<std::vector<WindowStatistics>, aithreadsafe::policy::Primitive<std::mutex>>;
+  statistics_t m_statistics;
+
+ private:
+  int thread_pool_number_of_worker_threads() const override
+  {
+    // Lets use 8 worker threads in the thread pool.
+    return 8;
+  }
+
+  // Usage: multi_window_bench [--windows N] [--frames N] [--coalesce]
+  void parse_command_line_parameters(int argc, char* argv[]) override
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      std::string const arg = argv[i];
+      if (arg == "--coalesce")
+        m_coalesce = true;
+      else if (arg == "--windows" && i + 1 < argc)
+        m_number_of_windows = std::max(1, std::stoi(argv[++i]));
+      else if (arg == "--frames" && i + 1 < argc)
+        m_number_of_frames = std::max(1, std::stoi(argv[++i]));
+    }
+  }
+
+ public:
+  std::u8string application_name() const override
+  {
+    return u8"MultiWindowBench";
+  }
+
+  // Accessors.
+  int number_of_windows() const { return m_number_of_windows; }
+  int number_of_frames() const { return m_number_of_frames; }
+  bool coalesce() const { return m_coalesce; }
+
+  // Called by each Window when it is done.
+  void report(WindowStatistics const& statistics) { statistics_t::wat(m_statistics)->push_back(statistics); }
+  std::vector<WindowStatistics> statistics() const { return *statistics_t::crat(m_statistics); }
+};
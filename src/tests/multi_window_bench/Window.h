@@ -0,0 +1,137 @@
+#pragma once
+
+#include "MultiWindowBench.h"
+#include "SynchronousWindow.h"
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include "debug.h"
+
+// A window that does nothing but clear its swapchain image, so that the CPU overhead of
+// submitting and presenting dominates. Closes itself after MultiWindowBench::number_of_frames() frames.
+class Window : public task::SynchronousWindow
+{
+  using clock_type = std::chrono::steady_clock;
+
+  // The first frames are not measured (swapchain creation, first submits, etc).
+  static constexpr int s_warmup_frames = 10;
+
+ private:
+  MultiWindowBench& m_bench;
+  int const m_window_number;
+
+  RenderPass main_pass{this, "main_pass"};
+
+  int m_frame_count = 0;
+  clock_type::time_point m_first_measured_frame_time;
+  double m_render_cpu_us = 0.0;
+
+  static int next_window_number()
+  {
+    static std::atomic<int> s_window_count;
+    return s_window_count++;
+  }
+
+  static double thread_cpu_time_us()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec * 1e-3;
+  }
+
+ public:
+  Window(vulkan::Application* application COMMA_CWDEBUG_ONLY(bool debug)) :
+    task::SynchronousWindow(application COMMA_CWDEBUG_ONLY(debug)),
+    m_bench(static_cast<MultiWindowBench&>(*application)), m_window_number(next_window_number()) { }
+
+ private:
+  void set_default_clear_values(vulkan::rendergraph::ClearValue& color, vulkan::rendergraph::ClearValue& depth_stencil) override
+  {
+    // Give every window a different color.
+    float const hue = static_cast<float>(m_window_number % 6) / 6.0f;
+    color = { hue, 1.0f - hue, 0.5f, 1.0f };
+  }
+
+  void create_render_graph() override
+  {
+    DoutEntering(dc::vulkan, "Window::create_render_graph() [" << this << "]");
+
+    // This must be a reference.
+    auto& output = swapchain().presentation_attachment();
+
+    // Just clear the swapchain image.
+    m_render_graph = main_pass->stores(~output);
+
+    // Generate everything.
+    m_render_graph.generate(this);
+  }
+
+  void register_shader_templates() override { }
+  void create_textures() override { }
+  void create_graphics_pipelines() override { }
+
+  threadpool::Timer::Interval get_frame_rate_interval() const override
+  {
+    // Don't limit the frame rate (other than by the FIFO present mode).
+    return threadpool::Interval<1, std::chrono::milliseconds>{};
+  }
+
+  bool coalesce_submits() const override
+  {
+    return m_bench.coalesce();
+  }
+
+  //===========================================================================
+  //
+  // Frame code (called every frame)
+  //
+  //===========================================================================
+
+  void render_frame() override
+  {
+    DoutEntering(dc::vkframe, "Window::render_frame() [" << this << "]");
+
+    if (m_frame_count == s_warmup_frames)
+      m_first_measured_frame_time = clock_type::now();
+    double const cpu_begin = thread_cpu_time_us();
+
+    start_frame();
+    acquire_image();                    // Can throw vulkan::OutOfDateKHR_Exception.
+
+    vulkan::FrameResourcesData* frame_resources = m_current_frame.m_frame_resources;
+    main_pass.update_image_views(swapchain(), frame_resources);
+
+    wait_command_buffer_completed();
+    auto command_buffer = frame_resources->m_command_buffer;
+    command_buffer->begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+    command_buffer->beginRenderPass(main_pass.begin_info(), vk::SubpassContents::eInline);
+    command_buffer->endRenderPass();
+    command_buffer->end();
+
+    submit(command_buffer);
+    finish_frame();
+
+    if (m_frame_count >= s_warmup_frames)
+      m_render_cpu_us += thread_cpu_time_us() - cpu_begin;
+    if (++m_frame_count == s_warmup_frames + m_bench.number_of_frames())
+      report_and_close();
+  }
+
+  void report_and_close()
+  {
+    int const frames = m_bench.number_of_frames();
+    std::chrono::duration<double, std::milli> const total_time = clock_type::now() - m_first_measured_frame_time;
+    vulkan::SubmitCoalescer::Statistics coalescer_statistics;
+    if (submit_coalescer())
+      coalescer_statistics = submit_coalescer()->statistics();
+    m_bench.report({
+      .m_window_number = m_window_number,
+      .m_frames = frames,
+      .m_average_frame_time_ms = total_time.count() / frames,
+      .m_average_render_cpu_us = m_render_cpu_us / frames,
+      .m_number_of_submits = coalescer_statistics.m_number_of_submits,
+      .m_number_of_coalesced_frames = coalescer_statistics.m_number_of_frames
+    });
+    close();
+  }
+};
@@ -0,0 +1,46 @@
+#include "sys.h"
+#include "Application.inl.h"
+#include "ShaderReload.h"
+#include "Window.h"
+#include "LogicalDevice.h"
+#include "debug.h"
+
+// Draws with two pipeline factories that share a vertex shader but each have their own fragment
+// shader, all loaded from files. After a few frames the window rewrites the fragment shader of the
+// second factory and checks that the ShaderWatcher only lets it regenerate that factory: the
+// pipeline of the first factory must stay the same object.
+
+int main(int argc, char* argv[])
+{
+  Debug(NAMESPACE_DEBUG::init());
+  Dout(dc::notice, "Entering main()");
+
+  try
+  {
+    // Create the application object.
+    ShaderReload application;
+
+    // Initialize application; this parses the command line.
+    application.initialize(argc, argv);
+
+    // Create a window and a logical device that supports presenting to it.
+    auto root_window = application.create_root_window<vulkan::WindowEvents, Window>({400, 200}, LogicalDevice::root_window_request_cookie);
+    application.create_logical_device(std::make_unique<LogicalDevice>(), std::move(root_window));
+
+    // Run the application until the window closes itself.
+    application.run();
+  }
+  catch (AIAlert::Error const& error)
+  {
+    // Application terminated with an error.
+    Dout(dc::warning, "\e[31m" << error << ", caught in ShaderReload.cxx\e[0m");
+  }
+#ifndef CWDEBUG // Commented out so we can see in gdb where an exception is thrown from.
+  catch (std::exception& exception)
+  {
+    DoutFatal(dc::core, "\e[31mstd::exception: " << exception.what() << " caught in ShaderReload.cxx\e[0m");
+  }
+#endif
+
+  Dout(dc::notice, "Leaving main()");
+}
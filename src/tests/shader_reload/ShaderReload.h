@@ -0,0 +1,27 @@
+#pragma once
+
+#include "vulkan/Application.h"
+
+class ShaderReload : public vulkan::Application
+{
+  using vulkan::Application::Application;
+
+ private:
+  int thread_pool_number_of_worker_threads() const override
+  {
+    // Lets use 4 worker threads in the thread pool.
+    return 4;
+  }
+
+  // This is what this test is about.
+  bool use_shader_hot_reload() const override
+  {
+    return true;
+  }
+
+ public:
+  std::u8string application_name() const override
+  {
+    return u8"ShaderReload";
+  }
+};
@@ -0,0 +1,393 @@
+#pragma once
+
+#include "SynchronousWindow.h"
+#include "Pipeline.h"
+#include "pipeline/FactoryCharacteristicId.h"
+#include "pipeline/PipelineTable.h"
+#include "shader_builder/ShaderIndex.h"
+#include "shader_builder/ShaderInfo.h"
+#include "utils/Array.h"
+
+#include "pipeline/ShaderInputData.inl.h"
+
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string_view>
+#include <unistd.h>
+#include "debug.h"
+#ifdef CWDEBUG
+#include "debug/debug_ostream_operators.h"
+#endif
+
+class Window : public task::SynchronousWindow
+{
+ public:
+  using task::SynchronousWindow::SynchronousWindow;
+
+ private:
+  // Define renderpass / attachment objects.
+  RenderPass main_pass{this, "main_pass"};
+
+  enum class LocalShaderIndex {
+    vertex,
+    frag0,
+    frag1
+  };
+  utils::Array<vulkan::shader_builder::ShaderIndex, 3, LocalShaderIndex> m_shader_indices;
+
+  static constexpr int number_of_pipelines = 2;
+  std::array<vulkan::Pipeline, number_of_pipelines> m_graphics_pipelines;
+  std::array<vulkan::pipeline::FactoryHandle, number_of_pipelines> m_pipeline_factory;
+
+  // The directory that the shader source files are written to.
+  std::filesystem::path const m_shader_directory = std::filesystem::temp_directory_path() / ("shader_reload." + std::to_string(getpid()));
+
+  // Test state; only accessed from the render loop.
+  int m_frames_with_pipelines = 0;
+  std::array<vk::Pipeline, number_of_pipelines> m_vh_pipelines_before_reload;   // Set when frag1 is rewritten.
+  std::chrono::steady_clock::time_point m_reload_start;
+  bool m_reloading = false;
+  std::vector<std::vector<PipelineFactoryIndex>> m_recreated_factory_indices;  // The factory_indices passed to each call of recreate_graphics_pipelines.
+
+  // Wait this long for the new pipeline before giving up.
+  static constexpr std::chrono::seconds s_reload_timeout{10};
+
+  static constexpr std::string_view fullscreen_vert_glsl = R"glsl(
+out gl_PerVertex { vec4 gl_Position; };
+
+void main()
+{
+  // A triangle that covers the whole viewport.
+  vec2 position = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+  gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+}
+)glsl";
+
+  static constexpr std::string_view red_frag_glsl = R"glsl(
+layout(location = 0) out vec4 outColor;
+
+void main()
+{
+  outColor = vec4(1.0, 0.0, 0.0, 1.0);
+}
+)glsl";
+
+  static constexpr std::string_view green_frag_glsl = R"glsl(
+layout(location = 0) out vec4 outColor;
+
+void main()
+{
+  outColor = vec4(0.0, 1.0, 0.0, 1.0);
+}
+)glsl";
+
+  static constexpr std::string_view blue_frag_glsl = R"glsl(
+layout(location = 0) out vec4 outColor;
+
+void main()
+{
+  outColor = vec4(0.0, 0.0, 1.0, 1.0);
+}
+)glsl";
+
+  static void write_file(std::filesystem::path const& filename, std::string_view source)
+  {
+    // Write to a temporary file and rename it, like most editors do.
+    std::filesystem::path const tmp_filename = filename.string() + ".tmp";
+    {
+      std::ofstream ofs(tmp_filename);
+      ofs << source;
+      if (!ofs)
+        THROW_ALERT("Could not write [FILENAME]", AIArgs("[FILENAME]", tmp_filename));
+    }
+    std::filesystem::rename(tmp_filename, filename);
+  }
+
+ public:
+  ~Window() override
+  {
+    std::error_code ec;
+    std::filesystem::remove_all(m_shader_directory, ec);
+  }
+
+ private:
+  void create_render_graph() override
+  {
+    DoutEntering(dc::vulkan, "Window::create_render_graph() [" << this << "]");
+
+    // This must be a reference.
+    auto& output = swapchain().presentation_attachment();
+
+    // Define the render graph.
+    m_render_graph = main_pass->stores(~output);
+
+    // Generate everything.
+    m_render_graph.generate(this);
+  }
+
+  void register_shader_templates() override
+  {
+    DoutEntering(dc::notice, "Window::register_shader_templates() [" << this << "]");
+
+    using namespace vulkan::shader_builder;
+
+    std::filesystem::create_directories(m_shader_directory);
+    write_file(m_shader_directory / "fullscreen.vert.glsl", fullscreen_vert_glsl);
+    write_file(m_shader_directory / "frag0.frag.glsl", red_frag_glsl);
+    write_file(m_shader_directory / "frag1.frag.glsl", green_frag_glsl);
+
+    // Load the shaders from disk, so that the ShaderWatcher watches them.
+    std::vector<ShaderInfo> shader_info = {
+      { vk::ShaderStageFlagBits::eVertex },
+      { vk::ShaderStageFlagBits::eFragment },
+      { vk::ShaderStageFlagBits::eFragment }
+    };
+    shader_info[0].load(m_shader_directory / "fullscreen.vert.glsl");
+    shader_info[1].load(m_shader_directory / "frag0.frag.glsl");
+    shader_info[2].load(m_shader_directory / "frag1.frag.glsl");
+
+    auto indices = application().register_shaders(std::move(shader_info));
+
+    // Copy the returned "shader indices" into our local array.
+    ASSERT(indices.size() == m_shader_indices.size());
+    for (int i = 0; i < indices.size(); ++i)
+      m_shader_indices[static_cast<LocalShaderIndex>(i)] = indices[i];
+  }
+
+  void create_textures() override { }
+
+  class FullscreenPipelineCharacteristic : public vulkan::pipeline::Characteristic
+  {
+   private:
+    std::vector<vk::PipelineColorBlendAttachmentState> m_pipeline_color_blend_attachment_states;
+    std::vector<vk::DynamicState> m_dynamic_states = {
+      vk::DynamicState::eViewport,
+      vk::DynamicState::eScissor
+    };
+    int m_pipeline;
+
+   protected:
+    using direct_base_type = vulkan::pipeline::Characteristic;
+
+    // The different states of this task.
+    enum FullscreenPipelineCharacteristic_state_type {
+      FullscreenPipelineCharacteristic_initialize = direct_base_type::state_end,
+      FullscreenPipelineCharacteristic_compile
+    };
+
+    ~FullscreenPipelineCharacteristic() override
+    {
+      DoutEntering(dc::vulkan, "FullscreenPipelineCharacteristic::~FullscreenPipelineCharacteristic() [" << this << "]");
+    }
+
+   public:
+    static constexpr state_type state_end = FullscreenPipelineCharacteristic_compile + 1;
+
+    FullscreenPipelineCharacteristic(task::SynchronousWindow const* owning_window, int pipeline COMMA_CWDEBUG_ONLY(bool debug)) :
+      vulkan::pipeline::Characteristic(owning_window COMMA_CWDEBUG_ONLY(debug)), m_pipeline(pipeline) { }
+
+   protected:
+    char const* state_str_impl(state_type run_state) const override
+    {
+      switch(run_state)
+      {
+        AI_CASE_RETURN(FullscreenPipelineCharacteristic_initialize);
+        AI_CASE_RETURN(FullscreenPipelineCharacteristic_compile);
+      }
+      return direct_base_type::state_str_impl(run_state);
+    }
+
+    void initialize_impl() override
+    {
+      set_state(FullscreenPipelineCharacteristic_initialize);
+    }
+
+    vulkan::shader_builder::ShaderIndex frag_index() const
+    {
+      Window const* window = static_cast<Window const*>(m_owning_window);
+      return window->m_shader_indices[m_pipeline == 0 ? LocalShaderIndex::frag0 : LocalShaderIndex::frag1];
+    }
+
+    void multiplex_impl(state_type run_state) override
+    {
+      switch (run_state)
+      {
+        case FullscreenPipelineCharacteristic_initialize:
+        {
+          Window const* window = static_cast<Window const*>(m_owning_window);
+
+          // Register the vectors that we will fill. There are no vertex buffers, descriptors or push constants.
+          m_flat_create_info->add(&shader_stage_create_infos());
+          m_flat_create_info->add(&m_pipeline_color_blend_attachment_states);
+          m_flat_create_info->add(&m_dynamic_states);
+          m_flat_create_info->add_descriptor_set_layouts(&sorted_descriptor_set_layouts());
+
+          // Add default color blend.
+          m_pipeline_color_blend_attachment_states.push_back(vk_defaults::PipelineColorBlendAttachmentState{});
+
+          preprocess1(m_owning_window->application().get_shader_info(window->m_shader_indices[LocalShaderIndex::vertex]));
+          preprocess1(m_owning_window->application().get_shader_info(frag_index()));
+
+          m_flat_create_info->m_pipeline_input_assembly_state_create_info.topology = vk::PrimitiveTopology::eTriangleList;
+
+          realize_descriptor_set_layouts(m_owning_window->logical_device());
+
+          set_continue_state(FullscreenPipelineCharacteristic_compile);
+          run_state = Characteristic_initialized;
+          break;
+        }
+        case FullscreenPipelineCharacteristic_compile:
+        {
+          using namespace vulkan::shader_builder;
+          Window const* window = static_cast<Window const*>(m_owning_window);
+
+          // Compile the shaders; only the changed shader is actually compiled again when reloading.
+          ShaderCompiler compiler;
+          build_shader(m_owning_window, window->m_shader_indices[LocalShaderIndex::vertex], compiler, m_set_index_hint_map
+              COMMA_CWDEBUG_ONLY({ m_owning_window, "PipelineFactory::m_shader_input_data" }));
+          build_shader(m_owning_window, frag_index(), compiler, m_set_index_hint_map
+              COMMA_CWDEBUG_ONLY({ m_owning_window, "PipelineFactory::m_shader_input_data" }));
+
+          run_state = Characteristic_compiled;
+          break;
+        }
+      }
+      direct_base_type::multiplex_impl(run_state);
+    }
+
+   public:
+#ifdef CWDEBUG
+    void print_on(std::ostream& os) const override
+    {
+      os << "{ (FullscreenPipelineCharacteristic*)" << this << " }";
+    }
+#endif
+  };
+
+  void create_graphics_pipelines() override
+  {
+    DoutEntering(dc::vulkan, "Window::create_graphics_pipelines() [" << this << "]");
+
+    for (int pipeline = 0; pipeline < number_of_pipelines; ++pipeline)
+    {
+      m_pipeline_factory[pipeline] = create_pipeline_factory(m_graphics_pipelines[pipeline], main_pass.vh_render_pass() COMMA_CWDEBUG_ONLY(true));
+      m_pipeline_factory[pipeline].add_characteristic<FullscreenPipelineCharacteristic>(this, pipeline COMMA_CWDEBUG_ONLY(true));
+      m_pipeline_factory[pipeline].generate(this);
+    }
+  }
+
+  void recreate_graphics_pipelines(std::vector<PipelineFactoryIndex> const& factory_indices) override
+  {
+    DoutEntering(dc::vulkan, "Window::recreate_graphics_pipelines(" << factory_indices << ") [" << this << "]");
+    m_recreated_factory_indices.push_back(factory_indices);
+    task::SynchronousWindow::recreate_graphics_pipelines(factory_indices);
+  }
+
+  //===========================================================================
+  //
+  // Called from initialize_impl.
+  //
+  threadpool::Timer::Interval get_frame_rate_interval() const override
+  {
+    // Limit the frame rate of this window to 100 frames per second.
+    return threadpool::Interval<10, std::chrono::milliseconds>{};
+  }
+
+  //===========================================================================
+  //
+  // Frame code (called every frame)
+  //
+  //===========================================================================
+
+  void render_frame() override
+  {
+    DoutEntering(dc::vkframe, "Window::render_frame() [" << this << "]");
+
+    start_frame();
+    acquire_image();                    // Can throw vulkan::OutOfDateKHR_Exception.
+    draw_frame();
+    finish_frame();
+  }
+
+  void draw_frame()
+  {
+    vulkan::FrameResourcesData* frame_resources = m_current_frame.m_frame_resources;
+    main_pass.update_image_views(swapchain(), frame_resources);
+
+    std::array<vk::Pipeline, number_of_pipelines> vh_pipelines;
+    for (int pl = 0; pl < number_of_pipelines; ++pl)
+      vh_pipelines[pl] = pipeline_table(m_pipeline_factory[pl].factory_index()).lookup(0);
+
+    wait_command_buffer_completed();
+    auto command_buffer = frame_resources->m_command_buffer;
+    command_buffer->begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+    command_buffer->beginRenderPass(main_pass.begin_info(), vk::SubpassContents::eInline);
+    if (vh_pipelines[0] && vh_pipelines[1])
+    {
+      // Draw the left half with the first pipeline and the right half with the second one.
+      vk::Extent2D const swapchain_extent = swapchain().extent();
+      uint32_t const half_width = swapchain_extent.width / 2;
+      for (int pl = 0; pl < number_of_pipelines; ++pl)
+      {
+        vk::Rect2D const rect{ .offset = { static_cast<int32_t>(pl * half_width), 0 }, .extent = { half_width, swapchain_extent.height } };
+        command_buffer->setViewport(0, { vk::Viewport{
+            .x = static_cast<float>(rect.offset.x), .y = 0, .width = static_cast<float>(half_width), .height = static_cast<float>(swapchain_extent.height),
+            .minDepth = 0.0f, .maxDepth = 1.0f } });
+        command_buffer->setScissor(0, { rect });
+        command_buffer->bindPipeline(vk::PipelineBindPoint::eGraphics, vh_pipelines[pl]);
+        command_buffer->draw(3, 1, 0, 0);
+      }
+    }
+    command_buffer->endRenderPass();
+    command_buffer->end();
+    submit(command_buffer);
+
+    if (vh_pipelines[0] && vh_pipelines[1])
+      test_reload(vh_pipelines);
+  }
+
+  void test_reload(std::array<vk::Pipeline, number_of_pipelines> const& vh_pipelines)
+  {
+    if (!m_reloading)
+    {
+      if (++m_frames_with_pipelines == 10)
+      {
+        // Turn the right half blue.
+        Dout(dc::notice, "Rewriting frag1.frag.glsl");
+        m_vh_pipelines_before_reload = vh_pipelines;
+        m_reload_start = std::chrono::steady_clock::now();
+        m_reloading = true;
+        write_file(m_shader_directory / "frag1.frag.glsl", blue_frag_glsl);
+      }
+      return;
+    }
+
+    bool const reloaded = vh_pipelines[1] != m_vh_pipelines_before_reload[1];
+    bool const timed_out = std::chrono::steady_clock::now() - m_reload_start > s_reload_timeout;
+    if (!reloaded && !timed_out)
+      return;
+
+    m_reloading = false;
+    int failures = 0;
+    auto check = [&](bool condition, char const* what){
+      if (!condition)
+      {
+        std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+      }
+    };
+    check(reloaded, "the pipeline of the second factory was regenerated");
+    check(vh_pipelines[0] == m_vh_pipelines_before_reload[0], "the pipeline of the first factory was kept");
+    check(m_recreated_factory_indices.size() == 1 && m_recreated_factory_indices[0].size() == 1 &&
+        m_recreated_factory_indices[0][0] == m_pipeline_factory[1].factory_index(), "only the second factory was recreated");
+    check(m_pipeline_factory[0].factory_index() != m_pipeline_factory[1].factory_index(), "the factories kept their index");
+    if (failures)
+      std::cerr << failures << " checks failed." << std::endl;
+    else
+      std::cout << "Success!" << std::endl;
+    close();
+  }
+};
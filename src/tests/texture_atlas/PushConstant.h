@@ -0,0 +1,34 @@
+#pragma once
+
+#include "shader_builder/ShaderVariableLayouts.h"
+
+struct PushConstant;
+
+LAYOUT_DECLARATION(PushConstant, push_constant_std430)
+{
+  static constexpr auto struct_layout = make_struct_layout(
+    LAYOUT(Float, m_x0),
+    LAYOUT(Float, m_y0),
+    LAYOUT(Float, m_x1),
+    LAYOUT(Float, m_y1),
+    LAYOUT(Float, m_u0),
+    LAYOUT(Float, m_v0),
+    LAYOUT(Float, m_u1),
+    LAYOUT(Float, m_v1),
+    LAYOUT(Int, m_layer)
+  );
+};
+
+// The rectangle that an image of the atlas is drawn at (in normalized device coordinates) and where it is in the atlas.
+struct PushConstant
+{
+  glsl::Float m_x0;
+  glsl::Float m_y0;
+  glsl::Float m_x1;
+  glsl::Float m_y1;
+  glsl::Float m_u0;
+  glsl::Float m_v0;
+  glsl::Float m_u1;
+  glsl::Float m_v1;
+  glsl::Int m_layer;
+};
@@ -0,0 +1,47 @@
+#include "sys.h"
+#include "Application.inl.h"
+#include "TextureAtlasTest.h"
+#include "Window.h"
+#include "LogicalDevice.h"
+#include "debug.h"
+
+// Draws a grid of small images that are packed into a vulkan::TextureAtlas. Every few frames one of
+// the images is replaced by an image of another size and another one gets new pixels; the atlas
+// uploads only the changed regions, in the command buffer of the frame, and repacks itself when the
+// removed images left too much unused space. After a couple of hundred frames the window checks
+// that no insert failed and that the atlas was repacked, and closes itself.
+
+int main(int argc, char* argv[])
+{
+  Debug(NAMESPACE_DEBUG::init());
+  Dout(dc::notice, "Entering main()");
+
+  try
+  {
+    // Create the application object.
+    TextureAtlasTest application;
+
+    // Initialize application; this parses the command line.
+    application.initialize(argc, argv);
+
+    // Create a window and a logical device that supports presenting to it.
+    auto root_window = application.create_root_window<vulkan::WindowEvents, Window>({400, 300}, LogicalDevice::root_window_request_cookie);
+    application.create_logical_device(std::make_unique<LogicalDevice>(), std::move(root_window));
+
+    // Run the application until the window closes itself.
+    application.run();
+  }
+  catch (AIAlert::Error const& error)
+  {
+    // Application terminated with an error.
+    Dout(dc::warning, "\e[31m" << error << ", caught in TextureAtlasTest.cxx\e[0m");
+  }
+#ifndef CWDEBUG // Commented out so we can see in gdb where an exception is thrown from.
+  catch (std::exception& exception)
+  {
+    DoutFatal(dc::core, "\e[31mstd::exception: " << exception.what() << " caught in TextureAtlasTest.cxx\e[0m");
+  }
+#endif
+
+  Dout(dc::notice, "Leaving main()");
+}
@@ -0,0 +1,456 @@
+#pragma once
+
+#include "PushConstant.h"
+#include "SynchronousWindow.h"
+#include "Pipeline.h"
+#include "SamplerKind.h"
+#include "TextureAtlas.h"
+#include "pipeline/FactoryCharacteristicId.h"
+#include "pipeline/PipelineTable.h"
+#include "pipeline/PushConstantUpdater.h"
+#include "shader_builder/ShaderIndex.h"
+#include "shader_builder/ShaderInfo.h"
+#include "shader_builder/shader_resource/CombinedImageSampler.h"
+#include "utils/Array.h"
+
+#include "pipeline/ShaderInputData.inl.h"
+
+#include <array>
+#include <cstddef>
+#include <iostream>
+#include <optional>
+#include <string_view>
+#include <vector>
+#include "debug.h"
+#ifdef CWDEBUG
+#include "debug/debug_ostream_operators.h"
+#endif
+
+class Window : public task::SynchronousWindow
+{
+ public:
+  using task::SynchronousWindow::SynchronousWindow;
+
+ private:
+  // Define renderpass / attachment objects.
+  RenderPass main_pass{this, "main_pass"};
+
+  enum class LocalShaderIndex {
+    vertex,
+    frag
+  };
+  utils::Array<vulkan::shader_builder::ShaderIndex, 2, LocalShaderIndex> m_shader_indices;
+
+  vulkan::Pipeline m_graphics_pipeline;
+  vulkan::pipeline::FactoryHandle m_pipeline_factory;
+  vulkan::pipeline::FactoryCharacteristicId m_pipeline_factory_characteristic_id;
+  vulkan::pipeline::PushConstantUpdater<PushConstant> m_push_constant_updater;
+  vulkan::shader_builder::shader_resource::CombinedImageSampler m_combined_image_sampler;
+
+  // The images are drawn in a grid of s_columns by s_rows cells.
+  static constexpr int s_columns = 4;
+  static constexpr int s_rows = 3;
+  static constexpr int number_of_images = s_columns * s_rows;
+  // The width and height of the images are in the range [s_min_image_size, s_max_image_size].
+  static constexpr uint32_t s_min_image_size = 16;
+  static constexpr uint32_t s_max_image_size = 48;
+  // The atlas is small, so that replacing images causes it to be repacked regularly.
+  static constexpr vk::Extent2D s_layer_extent{128, 128};
+  static constexpr uint32_t s_max_layers = 2;
+  static constexpr uint32_t s_padding = 1;
+
+  std::optional<vulkan::TextureAtlas> m_atlas;
+  std::array<std::optional<vulkan::TextureAtlas::id_type>, number_of_images> m_image_ids;       // Empty if the image didn't fit.
+  std::array<vk::Extent2D, number_of_images> m_image_extents;
+  std::array<vulkan::TextureAtlas::UVRect, number_of_images> m_uv_rects;
+  uint64_t m_uv_generation = 0;         // The generation of the atlas that m_uv_rects belong to.
+  uint32_t m_next_seed = 0;             // Determines the size and color of the next image.
+
+  // Test state; only accessed from the render loop.
+  int m_frame_count = 0;
+  int m_failed_inserts = 0;
+  int m_uploads = 0;                    // The number of frames in which the atlas uploaded something.
+
+  // Replace an image every s_replace_interval frames and give one new pixels every s_update_interval frames.
+  static constexpr int s_replace_interval = 5;
+  static constexpr int s_update_interval = 7;
+  // Check the results and close the window after this many frames.
+  static constexpr int s_number_of_frames = 200;
+
+  static constexpr std::string_view atlas_vert_glsl = R"glsl(
+out gl_PerVertex { vec4 gl_Position; };
+layout(location = 0) out vec2 v_Texcoord;
+
+void main()
+{
+  // Two triangles that cover the rectangle of the image: the corners (0,0), (1,0), (0,1), (0,1), (1,0), (1,1).
+  vec2 corner = vec2((0x32 >> gl_VertexIndex) & 1, (0x2C >> gl_VertexIndex) & 1);
+  gl_Position = vec4(mix(vec2(PushConstant::m_x0, PushConstant::m_y0), vec2(PushConstant::m_x1, PushConstant::m_y1), corner), 0.0, 1.0);
+  v_Texcoord = mix(vec2(PushConstant::m_u0, PushConstant::m_v0), vec2(PushConstant::m_u1, PushConstant::m_v1), corner);
+}
+)glsl";
+
+  static constexpr std::string_view atlas_frag_glsl = R"glsl(
+layout(location = 0) in vec2 v_Texcoord;
+layout(location = 0) out vec4 outColor;
+
+void main()
+{
+  outColor = texture(CombinedImageSampler::atlas, vec3(v_Texcoord, PushConstant::m_layer));
+}
+)glsl";
+
+  // The size of the image with seed.
+  static vk::Extent2D image_extent(uint32_t seed)
+  {
+    constexpr uint32_t range = s_max_image_size - s_min_image_size + 1;
+    return { s_min_image_size + (seed * 7919) % range, s_min_image_size + (seed * 104729) % range };
+  }
+
+  // The pixels of an image of extent: a checker board with a border, in a color that depends on seed.
+  static std::vector<std::byte> make_image(vk::Extent2D extent, uint32_t seed)
+  {
+    std::array<uint32_t, 3> const color = { 64 + (seed * 97) % 192, 64 + (seed * 57) % 192, 64 + (seed * 31) % 192 };
+    std::vector<std::byte> pixels(size_t{extent.width} * extent.height * 4);
+    for (uint32_t y = 0; y < extent.height; ++y)
+      for (uint32_t x = 0; x < extent.width; ++x)
+      {
+        bool const border = x == 0 || y == 0 || x == extent.width - 1 || y == extent.height - 1;
+        bool const dark = border || ((x / 4 + y / 4) & 1);
+        std::byte* texel = &pixels[(size_t{y} * extent.width + x) * 4];
+        for (int c = 0; c < 3; ++c)
+          texel[c] = static_cast<std::byte>(dark ? color[c] / 2 : color[c]);
+        texel[3] = std::byte{255};
+      }
+    return pixels;
+  }
+
+ private:
+  void create_render_graph() override
+  {
+    DoutEntering(dc::vulkan, "Window::create_render_graph() [" << this << "]");
+
+    // This must be a reference.
+    auto& output = swapchain().presentation_attachment();
+
+    // Define the render graph.
+    m_render_graph = main_pass->stores(~output);
+
+    // Generate everything.
+    m_render_graph.generate(this);
+  }
+
+  void register_shader_templates() override
+  {
+    DoutEntering(dc::notice, "Window::register_shader_templates() [" << this << "]");
+
+    using namespace vulkan::shader_builder;
+
+    std::vector<ShaderInfo> shader_info = {
+      { vk::ShaderStageFlagBits::eVertex,   "atlas.vert.glsl" },
+      { vk::ShaderStageFlagBits::eFragment, "atlas.frag.glsl" }
+    };
+    shader_info[0].load(atlas_vert_glsl);
+    shader_info[1].load(atlas_frag_glsl);
+
+    auto indices = application().register_shaders(std::move(shader_info));
+
+    // Copy the returned "shader indices" into our local array.
+    ASSERT(indices.size() == m_shader_indices.size());
+    for (int i = 0; i < indices.size(); ++i)
+      m_shader_indices[static_cast<LocalShaderIndex>(i)] = indices[i];
+  }
+
+  void create_textures() override
+  {
+    DoutEntering(dc::vulkan, "Window::create_textures() [" << this << "]");
+
+    m_atlas.emplace(m_logical_device, s_layer_extent, s_max_layers, s_padding, max_number_of_frame_resources(),
+        vulkan::SamplerKind{m_logical_device, { .mipmapMode = vk::SamplerMipmapMode::eNearest, .anisotropyEnable = VK_FALSE }},
+        graphics_settings()
+        COMMA_CWDEBUG_ONLY(debug_name_prefix("m_atlas")));
+
+    for (int i = 0; i < number_of_images; ++i)
+      insert_image(i);
+    fetch_uv_rects();
+
+    // The pixels are uploaded by the first frame, in front of the render pass that samples them.
+    m_combined_image_sampler.update_image_sampler(&m_atlas->texture(), m_pipeline_factory_characteristic_id);
+  }
+
+  // Add a new image, with the next seed, as image i.
+  void insert_image(int i)
+  {
+    uint32_t const seed = m_next_seed++;
+    m_image_extents[i] = image_extent(seed);
+    m_image_ids[i] = m_atlas->insert(m_image_extents[i], make_image(m_image_extents[i], seed));
+    if (!m_image_ids[i])
+    {
+      Dout(dc::warning, "Image " << i << " (" << m_image_extents[i] << ") doesn't fit in the atlas.");
+      ++m_failed_inserts;
+      return;
+    }
+    m_uv_rects[i] = m_atlas->uv(*m_image_ids[i]);
+  }
+
+  // The atlas was repacked: all images might have moved.
+  void fetch_uv_rects()
+  {
+    for (int i = 0; i < number_of_images; ++i)
+      if (m_image_ids[i])
+        m_uv_rects[i] = m_atlas->uv(*m_image_ids[i]);
+    m_uv_generation = m_atlas->generation();
+  }
+
+  class AtlasPipelineCharacteristic : public vulkan::pipeline::Characteristic
+  {
+   private:
+    std::vector<vk::PipelineColorBlendAttachmentState> m_pipeline_color_blend_attachment_states;
+    std::vector<vk::DynamicState> m_dynamic_states = {
+      vk::DynamicState::eViewport,
+      vk::DynamicState::eScissor
+    };
+    std::vector<vk::PushConstantRange> m_push_constant_ranges;
+
+   protected:
+    using direct_base_type = vulkan::pipeline::Characteristic;
+
+    // The different states of this task.
+    enum AtlasPipelineCharacteristic_state_type {
+      AtlasPipelineCharacteristic_initialize = direct_base_type::state_end,
+      AtlasPipelineCharacteristic_compile
+    };
+
+    ~AtlasPipelineCharacteristic() override
+    {
+      DoutEntering(dc::vulkan, "AtlasPipelineCharacteristic::~AtlasPipelineCharacteristic() [" << this << "]");
+    }
+
+   public:
+    static constexpr state_type state_end = AtlasPipelineCharacteristic_compile + 1;
+
+    AtlasPipelineCharacteristic(task::SynchronousWindow const* owning_window COMMA_CWDEBUG_ONLY(bool debug)) :
+      vulkan::pipeline::Characteristic(owning_window COMMA_CWDEBUG_ONLY(debug)) { }
+
+   protected:
+    char const* state_str_impl(state_type run_state) const override
+    {
+      switch(run_state)
+      {
+        AI_CASE_RETURN(AtlasPipelineCharacteristic_initialize);
+        AI_CASE_RETURN(AtlasPipelineCharacteristic_compile);
+      }
+      return direct_base_type::state_str_impl(run_state);
+    }
+
+    void initialize_impl() override
+    {
+      set_state(AtlasPipelineCharacteristic_initialize);
+    }
+
+    void multiplex_impl(state_type run_state) override
+    {
+      switch (run_state)
+      {
+        case AtlasPipelineCharacteristic_initialize:
+        {
+          Window const* window = static_cast<Window const*>(m_owning_window);
+
+          // Register the vectors that we will fill. There are no vertex buffers.
+          m_flat_create_info->add(&shader_stage_create_infos());
+          m_flat_create_info->add(&m_pipeline_color_blend_attachment_states);
+          m_flat_create_info->add(&m_dynamic_states);
+          m_flat_create_info->add_descriptor_set_layouts(&sorted_descriptor_set_layouts());
+          m_flat_create_info->add(&m_push_constant_ranges);
+
+          // Define the pipeline.
+          add_push_constant<PushConstant>();
+          add_combined_image_sampler(window->m_combined_image_sampler);
+
+          // Add default color blend.
+          m_pipeline_color_blend_attachment_states.push_back(vk_defaults::PipelineColorBlendAttachmentState{});
+
+          preprocess1(m_owning_window->application().get_shader_info(window->m_shader_indices[LocalShaderIndex::vertex]));
+          preprocess1(m_owning_window->application().get_shader_info(window->m_shader_indices[LocalShaderIndex::frag]));
+
+          m_push_constant_ranges = push_constant_ranges();
+          m_flat_create_info->m_pipeline_input_assembly_state_create_info.topology = vk::PrimitiveTopology::eTriangleList;
+
+          realize_descriptor_set_layouts(m_owning_window->logical_device());
+
+          set_continue_state(AtlasPipelineCharacteristic_compile);
+          run_state = Characteristic_initialized;
+          break;
+        }
+        case AtlasPipelineCharacteristic_compile:
+        {
+          using namespace vulkan::shader_builder;
+          Window const* window = static_cast<Window const*>(m_owning_window);
+
+          // Compile the shaders.
+          ShaderCompiler compiler;
+          build_shader(m_owning_window, window->m_shader_indices[LocalShaderIndex::vertex], compiler, m_set_index_hint_map
+              COMMA_CWDEBUG_ONLY({ m_owning_window, "PipelineFactory::m_shader_input_data" }));
+          build_shader(m_owning_window, window->m_shader_indices[LocalShaderIndex::frag], compiler, m_set_index_hint_map
+              COMMA_CWDEBUG_ONLY({ m_owning_window, "PipelineFactory::m_shader_input_data" }));
+
+          run_state = Characteristic_compiled;
+          break;
+        }
+      }
+      direct_base_type::multiplex_impl(run_state);
+    }
+
+   public:
+#ifdef CWDEBUG
+    void print_on(std::ostream& os) const override
+    {
+      os << "{ (AtlasPipelineCharacteristic*)" << this << " }";
+    }
+#endif
+  };
+
+  void create_graphics_pipelines() override
+  {
+    DoutEntering(dc::vulkan, "Window::create_graphics_pipelines() [" << this << "]");
+
+    // This is what the descriptor is recognized by in the shader code.
+    m_combined_image_sampler.set_glsl_id_postfix("atlas");
+    // The atlas is an array texture; the shader samples it with a sampler2DArray.
+    m_combined_image_sampler.set_image_view_type(vk::ImageViewType::e2DArray);
+
+    m_pipeline_factory = create_pipeline_factory(m_graphics_pipeline, main_pass.vh_render_pass() COMMA_CWDEBUG_ONLY(true));
+    m_pipeline_factory_characteristic_id = m_pipeline_factory.add_characteristic<AtlasPipelineCharacteristic>(this COMMA_CWDEBUG_ONLY(true));
+    m_pipeline_factory.generate(this);
+  }
+
+  //===========================================================================
+  //
+  // Called from initialize_impl.
+  //
+  threadpool::Timer::Interval get_frame_rate_interval() const override
+  {
+    // Limit the frame rate of this window to 100 frames per second.
+    return threadpool::Interval<10, std::chrono::milliseconds>{};
+  }
+
+  //===========================================================================
+  //
+  // Frame code (called every frame)
+  //
+  //===========================================================================
+
+  void render_frame() override
+  {
+    DoutEntering(dc::vkframe, "Window::render_frame() [" << this << "]");
+
+    ++m_frame_count;
+    start_frame();
+    acquire_image();                    // Can throw vulkan::OutOfDateKHR_Exception.
+    change_images();
+    draw_frame();
+    if (m_frame_count == s_number_of_frames)
+      check_and_close();
+    finish_frame();
+  }
+
+  // Replace one image by an image of another size and give another one new pixels.
+  void change_images()
+  {
+    if (m_frame_count % s_replace_interval == 0)
+    {
+      int const i = (m_frame_count / s_replace_interval) % number_of_images;
+      if (m_image_ids[i])
+        m_atlas->erase(*m_image_ids[i]);
+      insert_image(i);
+    }
+    if (m_frame_count % s_update_interval == 0)
+    {
+      int const i = (m_frame_count / s_update_interval * 5) % number_of_images;
+      if (m_image_ids[i])
+        m_atlas->update(*m_image_ids[i], make_image(m_image_extents[i], m_next_seed++));
+    }
+    // Inserting an image might have repacked the atlas.
+    if (m_atlas->generation() != m_uv_generation)
+      fetch_uv_rects();
+  }
+
+  void draw_frame()
+  {
+    vulkan::FrameResourcesData* frame_resources = m_current_frame.m_frame_resources;
+    main_pass.update_image_views(swapchain(), frame_resources);
+
+    vk::Pipeline const vh_pipeline = pipeline_table(m_pipeline_factory.factory_index()).lookup(0);
+
+    wait_command_buffer_completed();
+    auto command_buffer = frame_resources->m_command_buffer;
+    command_buffer->begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+    // Push constants are undefined at the start of a command buffer.
+    m_push_constant_updater.invalidate();
+    // Upload the regions of the atlas that changed, in front of the render pass that samples them.
+    if (m_atlas->record_flush(static_cast<vk::CommandBuffer>(command_buffer), m_current_frame.m_resource_index))
+      ++m_uploads;
+    command_buffer->beginRenderPass(main_pass.begin_info(), vk::SubpassContents::eInline);
+    if (m_graphics_pipeline.handle() && vh_pipeline)
+    {
+      vk::Extent2D const swapchain_extent = swapchain().extent();
+      command_buffer->setViewport(0, { vk::Viewport{
+          .x = 0, .y = 0, .width = static_cast<float>(swapchain_extent.width), .height = static_cast<float>(swapchain_extent.height),
+          .minDepth = 0.0f, .maxDepth = 1.0f } });
+      command_buffer->setScissor(0, { vk::Rect2D{ .offset = vk::Offset2D(), .extent = swapchain_extent } });
+      command_buffer->bindPipeline(vk::PipelineBindPoint::eGraphics, vh_pipeline);
+      command_buffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_graphics_pipeline.layout(), 0 /* uint32_t first_set */,
+          m_graphics_pipeline.vhv_descriptor_sets(m_current_frame.m_resource_index), {});
+
+      // Draw every image in the center of its cell, with a size relative to the largest possible image.
+      float const cell_width = 2.0f / s_columns;
+      float const cell_height = 2.0f / s_rows;
+      for (int i = 0; i < number_of_images; ++i)
+      {
+        if (!m_image_ids[i])
+          continue;
+        float const center_x = -1.0f + (i % s_columns + 0.5f) * cell_width;
+        float const center_y = -1.0f + (i / s_columns + 0.5f) * cell_height;
+        float const half_width = 0.5f * cell_width * m_image_extents[i].width / s_max_image_size;
+        float const half_height = 0.5f * cell_height * m_image_extents[i].height / s_max_image_size;
+        vulkan::TextureAtlas::UVRect const& uv = m_uv_rects[i];
+        m_push_constant_updater.set(PushConstant{
+          .m_x0 = center_x - half_width, .m_y0 = center_y - half_height, .m_x1 = center_x + half_width, .m_y1 = center_y + half_height,
+          .m_u0 = uv.m_u0, .m_v0 = uv.m_v0, .m_u1 = uv.m_u1, .m_v1 = uv.m_v1, .m_layer = static_cast<int>(uv.m_layer) });
+        m_push_constant_updater.flush(command_buffer, m_graphics_pipeline);
+        command_buffer->draw(6, 1, 0, 0);
+      }
+    }
+    command_buffer->endRenderPass();
+    command_buffer->end();
+    submit(command_buffer);
+  }
+
+  void check_and_close()
+  {
+    vk_utils::AtlasPacker::Stats const stats = m_atlas->stats();
+    Dout(dc::notice, "Atlas stats: " << stats);
+    size_t images = 0;
+    for (auto const& id : m_image_ids)
+      if (id)
+        ++images;
+
+    int failures = 0;
+    auto check = [&](bool condition, char const* what){
+      if (!condition)
+      {
+        std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+      }
+    };
+    check(m_failed_inserts == 0, "all images fit in the atlas");
+    check(stats.m_images == images, "the atlas contains all images");
+    check(stats.m_defragmentations > 0, "the atlas was repacked");
+    check(m_uploads >= s_number_of_frames / s_replace_interval, "every replaced image was uploaded");
+    if (failures)
+      std::cerr << failures << " checks failed." << std::endl;
+    else
+      std::cout << "Success!" << std::endl;
+    close();
+  }
+};
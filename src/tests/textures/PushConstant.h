@@ -8,7 +8,8 @@ LAYOUT_DECLARATION(PushConstant, push_constant_std430)
 {
   static constexpr auto struct_layout = make_struct_layout(
     LAYOUT(Float, m_x_position),
-    LAYOUT(Int, m_texture_index)
+    LAYOUT(Int, m_texture_index),
+    LAYOUT(Float, m_min_lod)
   );
 };
 
@@ -17,4 +18,5 @@ struct PushConstant
 {
   glsl::Float m_x_position;
   glsl::Int m_texture_index;
+  glsl::Float m_min_lod;
 };
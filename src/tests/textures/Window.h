@@ -15,12 +15,21 @@
 #include "shader_builder/shader_resource/UniformBuffer.h"
 #include "shader_builder/shader_resource/CombinedImageSampler.h"
 #include "pipeline/FactoryCharacteristicId.h"
+#include "pipeline/PushConstantUpdater.h"
+#include "pipeline/PipelineTable.h"
 #include "vk_utils/ImageData.h"
+#include "vk_utils/MipChain.h"
+#include "memory/TextureResidency.h"
 #include "statefultask/AITimer.h"
 
 #include "pipeline/ShaderInputData.inl.h"
 
 #include <imgui.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <optional>
+#include <sstream>
 #include "debug.h"
 #include "tracy/CwTracy.h"
 #ifdef TRACY_ENABLE
@@ -48,6 +57,23 @@ class Window : public task::SynchronousWindow
   using combined_image_samplers_t = std::array<vulkan::shader_builder::shader_resource::CombinedImageSampler, number_of_combined_image_samplers>;
   combined_image_samplers_t m_combined_image_samplers;
   std::array<vulkan::Texture, number_of_combined_image_samplers> m_textures;
+  // The textures have a full mip chain, which depends on their size.
+  std::array<std::optional<vulkan::ImageKind>, number_of_combined_image_samplers> m_texture_image_kinds;
+  std::array<std::optional<vulkan::ImageViewKind>, number_of_combined_image_samplers> m_texture_image_view_kinds;
+
+  // The mip levels of the textures are streamed in by m_texture_residency (see stream_in_texture); the pixels
+  // of all levels are kept, so that levels that were evicted can be loaded again. If the logical device supports
+  // sparse residency, every level has its own memory, which is freed some frames after it was evicted.
+  std::array<std::optional<vk_utils::MipChain>, number_of_combined_image_samplers> m_mip_chains;
+  std::array<std::chrono::steady_clock::time_point, number_of_combined_image_samplers> m_upload_starts;
+  std::array<vulkan::memory::TextureResidency::texture_id_type, number_of_combined_image_samplers> m_residency_ids;
+  vulkan::memory::TextureResidency m_texture_residency{
+    [this](vulkan::memory::TextureResidency::StreamIn const& stream_in){ stream_in_texture(stream_in); },
+    [this](vulkan::memory::TextureResidency::texture_id_type id, uint32_t resident_level){
+      m_textures[texture_index(id)].evict(resident_level, [this](vk::DeviceSize bytes){ m_texture_residency.released(bytes); });
+    },
+    64, true
+  };
 
   enum class LocalShaderIndex {
     vertex0,
@@ -63,6 +89,7 @@ class Window : public task::SynchronousWindow
 
   static constexpr int number_of_pipelines = 2;
   std::array<vulkan::Pipeline, number_of_pipelines> m_graphics_pipelines;
+  vulkan::pipeline::PushConstantUpdater<PushConstant> m_push_constant_updater;
 
   imgui::StatsWindow m_imgui_stats_window;
   int m_frame_count = 0;
@@ -101,35 +128,52 @@ class Window : public task::SynchronousWindow
  public:
   ~Window() { if (m_timer) m_timer->abort(); }
  private:
+  static constexpr std::array<char const*, number_of_combined_image_samplers> textures_names{
+    "textures/cat-tail-nature-grass-summer-whiskers-826101-wallhere.com.jpg",
+    "textures/nature-grass-sky-insect-green-Izmir-839795-wallhere.com.jpg",
+    "textures/tileable10b.png" //,
+#if 0
+    "textures/Tileable5.png"
+#endif
+  };
+
   void create_textures() override
   {
     DoutEntering(dc::vulkan, "Window::create_textures() [" << this << "]");
 
-    std::array<char const*, number_of_combined_image_samplers> textures_names{
-      "textures/cat-tail-nature-grass-summer-whiskers-826101-wallhere.com.jpg",
-      "textures/nature-grass-sky-insect-green-Izmir-839795-wallhere.com.jpg",
-      "textures/tileable10b.png" //,
-#if 0
-      "textures/Tileable5.png"
-#endif
-    };
-
     std::string const name_prefix("m_textures[");
 
     for (int t = 0; t < number_of_combined_image_samplers; ++t)
     {
+      // The time to first pixel includes decoding the image and building its mip chain.
+      m_upload_starts[t] = std::chrono::steady_clock::now();
       vk_utils::stbi::ImageData texture_data(m_application->path_of(Directory::resources) / textures_names[t], 4);
+      vk::Extent2D const extent = texture_data.extent();
+      uint32_t const mip_levels = vk_utils::mip_level_count(extent);
+
+      m_texture_image_kinds[t].emplace(vulkan::ImageKindPOD{
+        .format = vulkan::Texture::default_image_kind->format,
+        .mip_levels = mip_levels,
+        .usage = vulkan::Texture::default_image_kind->usage
+      });
+      m_texture_image_view_kinds[t].emplace(*m_texture_image_kinds[t], vulkan::ImageViewKindPOD{
+        .subresource_range = vk_defaults::ImageSubresourceRange{vk::ImageAspectFlagBits::eColor, 0, mip_levels}
+      });
 
       m_textures[t] = vulkan::Texture(m_logical_device,
-          texture_data.extent(),
+          extent, *m_texture_image_view_kinds[t],
           { .mipmapMode = vk::SamplerMipmapMode::eNearest,
-            .anisotropyEnable = VK_FALSE },
+            .anisotropyEnable = VK_FALSE,
+            .maxLod = VK_LOD_CLAMP_NONE },
           graphics_settings(),
-          { .properties = vk::MemoryPropertyFlagBits::eDeviceLocal }
+          { .properties = vk::MemoryPropertyFlagBits::eDeviceLocal, .sparse_mip_memory = sparse_mip_memory() }
           COMMA_CWDEBUG_ONLY(debug_name_prefix(name_prefix + glsl_id_postfixes[t] + ']')));
+      // Nothing is resident until m_texture_residency requests the mip tail.
+      m_textures[t].evict(mip_levels);
 
-      m_textures[t].upload(texture_data.extent(), this,
-          std::make_unique<vk_utils::stbi::ImageDataFeeder>(std::move(texture_data)), this, texture_uploaded);
+      // The levels are streamed coarse to fine by m_texture_residency, from the render loop (see render_frame).
+      m_mip_chains[t].emplace(texture_data.image_data(), extent, 4);          // Four components were requested.
+      m_residency_ids[t] = m_texture_residency.add(m_textures[t].residency_level_sizes(mip_levels));
     }
 
     m_timer = statefultask::create<AITimer>(CWDEBUG_ONLY(true));
@@ -181,10 +225,12 @@ layout(location = 0) out vec4 outColor;
 void main()
 {
   int foo = PushConstant::m_texture_index;
+  // Don't sample mip levels that weren't uploaded yet.
+  float min_lod = PushConstant::m_min_lod;
   if (instance_index == 0)
-    outColor = texture(CombinedImageSampler::top[0], v_Texcoord);
+    outColor = textureLod(CombinedImageSampler::top[0], v_Texcoord, max(textureQueryLod(CombinedImageSampler::top[0], v_Texcoord).x, min_lod));
   else
-    outColor = texture(CombinedImageSampler::bottom0[0], v_Texcoord);
+    outColor = textureLod(CombinedImageSampler::bottom0[0], v_Texcoord, max(textureQueryLod(CombinedImageSampler::bottom0[0], v_Texcoord).x, min_lod));
 }
 )glsl";
 
@@ -196,10 +242,12 @@ layout(location = 0) out vec4 outColor;
 void main()
 {
   int foo = PushConstant::m_texture_index;
+  // Don't sample mip levels that weren't uploaded yet.
+  float min_lod = PushConstant::m_min_lod;
   if (instance_index == 0)
-    outColor = texture(CombinedImageSampler::top[0], v_Texcoord);
+    outColor = textureLod(CombinedImageSampler::top[0], v_Texcoord, max(textureQueryLod(CombinedImageSampler::top[0], v_Texcoord).x, min_lod));
   else
-    outColor = texture(CombinedImageSampler::bottom1[0], v_Texcoord);
+    outColor = textureLod(CombinedImageSampler::bottom1[0], v_Texcoord, max(textureQueryLod(CombinedImageSampler::bottom1[0], v_Texcoord).x, min_lod));
 }
 )glsl";
 
@@ -406,6 +454,87 @@ void main()
 #endif
   };
 
+  // The cull modes that the pipelines are generated for; pipeline `pipeline` draws with cull_modes[pipeline].
+  static constexpr std::array<vk::CullModeFlagBits, number_of_pipelines> cull_modes{ vk::CullModeFlagBits::eBack, vk::CullModeFlagBits::eNone };
+
+  // A characteristic range over cull_modes. Since the pipelines of this range only differ in their cull mode,
+  // it is collapsed into the dynamic state vk::DynamicState::eCullMode when the logical device supports that:
+  // then only the pipeline for cull_modes[0] is generated and the cull mode is set while recording the command buffer.
+  class CullModeCharacteristicRange : public vulkan::pipeline::CharacteristicRange
+  {
+   protected:
+    using direct_base_type = vulkan::pipeline::CharacteristicRange;
+
+    // The different states of this task.
+    enum CullModeCharacteristicRange_state_type {
+      CullModeCharacteristicRange_initialize = direct_base_type::state_end,
+      CullModeCharacteristicRange_fill,
+      CullModeCharacteristicRange_compile
+    };
+
+    ~CullModeCharacteristicRange() override
+    {
+      DoutEntering(dc::vulkan, "CullModeCharacteristicRange::~CullModeCharacteristicRange() [" << this << "]");
+    }
+
+   public:
+    static constexpr state_type state_end = CullModeCharacteristicRange_compile + 1;
+
+    CullModeCharacteristicRange(task::SynchronousWindow const* owning_window COMMA_CWDEBUG_ONLY(bool debug)) :
+      vulkan::pipeline::CharacteristicRange(owning_window, 0, static_cast<int>(cull_modes.size()) COMMA_CWDEBUG_ONLY(debug))
+    {
+      set_dynamic_state_alternative({ vk::DynamicState::eCullMode });
+    }
+
+   protected:
+    char const* state_str_impl(state_type run_state) const override
+    {
+      switch(run_state)
+      {
+        AI_CASE_RETURN(CullModeCharacteristicRange_initialize);
+        AI_CASE_RETURN(CullModeCharacteristicRange_fill);
+        AI_CASE_RETURN(CullModeCharacteristicRange_compile);
+      }
+      return direct_base_type::state_str_impl(run_state);
+    }
+
+    void initialize_impl() override
+    {
+      set_state(CullModeCharacteristicRange_initialize);
+    }
+
+    void multiplex_impl(state_type run_state) override
+    {
+      switch (run_state)
+      {
+        case CullModeCharacteristicRange_initialize:
+          // Nothing to register: the cull mode is part of FlatCreateInfo::m_rasterization_state_create_info.
+          set_continue_state(CullModeCharacteristicRange_fill);
+          run_state = CharacteristicRange_initialized;
+          break;
+        case CullModeCharacteristicRange_fill:
+          m_flat_create_info->m_rasterization_state_create_info.cullMode = cull_modes[fill_index()];
+          set_continue_state(CullModeCharacteristicRange_compile);
+          run_state = CharacteristicRange_filled;
+          break;
+        case CullModeCharacteristicRange_compile:
+          // Nothing to compile.
+          set_continue_state(CullModeCharacteristicRange_fill);
+          run_state = CharacteristicRange_compiled;
+          break;
+      }
+      direct_base_type::multiplex_impl(run_state);
+    }
+
+   public:
+#ifdef CWDEBUG
+    void print_on(std::ostream& os) const override
+    {
+      os << "{ (CullModeCharacteristicRange*)" << this << " }";
+    }
+#endif
+  };
+
   std::array<vulkan::pipeline::FactoryHandle, number_of_pipelines> m_pipeline_factory;
   std::array<vulkan::pipeline::FactoryCharacteristicId, number_of_pipelines> m_pipeline_factory_characteristic_range_ids;
 
@@ -430,6 +559,8 @@ void main()
       // We have one factory/range pair per pipeline here.
       m_pipeline_factory_characteristic_range_ids[pipeline] =
         m_pipeline_factory[pipeline].add_characteristic<TextureTestPipelineCharacteristic>(this, pipeline COMMA_CWDEBUG_ONLY(true));
+      // This doubles the number of pipelines of this factory, unless the cull mode can be dynamic state.
+      m_pipeline_factory[pipeline].add_characteristic<CullModeCharacteristicRange>(this COMMA_CWDEBUG_ONLY(true));
 
       m_pipeline_factory[pipeline].generate(this);
     }
@@ -469,6 +600,55 @@ void main()
     }
   }
 
+  int texture_index(vulkan::memory::TextureResidency::texture_id_type id) const
+  {
+    auto iter = std::find(m_residency_ids.begin(), m_residency_ids.end(), id);
+    ASSERT(iter != m_residency_ids.end());
+    return iter - m_residency_ids.begin();
+  }
+
+  // Called by m_texture_residency.update (from render_frame): load the requested levels of a texture.
+  // Report how long it takes before the texture can be drawn at all and at full quality.
+  void stream_in_texture(vulkan::memory::TextureResidency::StreamIn const& stream_in)
+  {
+    DoutEntering(dc::vulkan, "Window::stream_in_texture({" << stream_in.m_id << ", " << stream_in.m_level << ", " << stream_in.m_count << "}) [" << this << "]");
+    int const t = texture_index(stream_in.m_id);
+    vk_utils::MipChain const& mip_chain = *m_mip_chains[t];
+    vk::Extent2D const extent = mip_chain.extent();
+    uint32_t const mip_levels = mip_chain.level_count();
+    m_textures[t].stream_in(stream_in.m_level, extent, *m_texture_image_view_kinds[t], this,
+        mip_chain.level_feeders(stream_in.m_level, stream_in.m_level + stream_in.m_count),
+        [this, id = stream_in.m_id, level = stream_in.m_level](bool success){
+          m_texture_residency.loaded(id, level, success);
+        },
+        [name = textures_names[t], extent, mip_levels, upload_start = m_upload_starts[t]](uint32_t base_mip_level){
+          std::chrono::duration<double, std::milli> const elapsed = std::chrono::steady_clock::now() - upload_start;
+          std::ostringstream report;
+          if (base_mip_level == mip_levels - 1)
+            report << name << " (" << extent.width << "x" << extent.height << "): time to first pixel: " << elapsed.count() << " ms\n";
+          if (base_mip_level == 0)
+            report << name << " (" << extent.width << "x" << extent.height << "): time to full quality: " << elapsed.count() << " ms\n";
+          std::cout << report.str() << std::flush;
+        },
+        [this](vk::DeviceSize bytes){ m_texture_residency.released(bytes); });
+  }
+
+  // Tell m_texture_residency which textures are drawn this frame, and let it stream in (or evict) mip levels.
+  void update_texture_residency()
+  {
+    // All textures are drawn at about their full size.
+    for (int t = 0; t < number_of_combined_image_samplers; ++t)
+      m_texture_residency.use(m_residency_ids[t], m_frame_count, 0, 1.0f);
+    // The heap usage includes the memory of the textures that m_texture_residency counts: resident, loading
+    // and evicted but not yet freed levels. Without sparse residency the images are allocated with all their
+    // levels, and those count as other usage of the heap (see Texture::residency_level_sizes).
+    vulkan::memory::HeapBudget const heap_budget = logical_device()->device_local_memory_budget();
+    vulkan::memory::TextureResidency::Stats const stats = m_texture_residency.stats();
+    m_texture_residency.set_budget(vulkan::memory::TextureResidency::texture_budget(
+          heap_budget.m_budget, heap_budget.m_usage, stats.m_resident_bytes + stats.m_loading_bytes + stats.m_releasing_bytes));
+    m_texture_residency.update(m_frame_count);
+  }
+
   //===========================================================================
   //
   // Called from initialize_impl.
@@ -506,6 +686,9 @@ void main()
     // Start frame.
     start_frame();
 
+    // Request the mip levels that are needed for this frame.
+    update_texture_residency();
+
     // Acquire swapchain image.
     acquire_image();                    // Can throw vulkan::OutOfDateKHR_Exception.
 
@@ -552,11 +735,12 @@ void main()
     };
 
     wait_command_buffer_completed();
-    m_logical_device->reset_fences({ *frame_resources->m_command_buffers_completed });
 
     auto command_buffer = frame_resources->m_command_buffer;
     Dout(dc::vkframe, "Start recording command buffer.");
     command_buffer->begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+    // Push constants are undefined at the start of a command buffer.
+    m_push_constant_updater.invalidate();
     {
       CwTracyVkNamedZone(presentation_surface().tracy_context(), __main_pass1, static_cast<vk::CommandBuffer>(command_buffer), main_pass.name(), true,
           max_number_of_frame_resources(), m_current_frame.m_resource_index);
@@ -564,11 +748,18 @@ void main()
           max_number_of_swapchain_images(), swapchain_index);
 
       command_buffer->beginRenderPass(main_pass.begin_info(), vk::SubpassContents::eInline);
+      // Look up the pipeline of each factory by its characteristic values (the TextureTestPipelineCharacteristic has only the value 0).
+      std::array<vk::Pipeline, number_of_pipelines> vh_pipelines;
+      for (int pl = 0; pl < number_of_pipelines; ++pl)
+        vh_pipelines[pl] = pipeline_table(m_pipeline_factory[pl].factory_index()).lookup(0, pl);
 // FIXME: this is a hack - what we really need is a vector with RenderProxy objects.
-if (!m_graphics_pipelines[0].handle() || !m_graphics_pipelines[1].handle())
+if (!m_graphics_pipelines[0].handle() || !m_graphics_pipelines[1].handle() || !vh_pipelines[0] || !vh_pipelines[1])
   Dout(dc::warning, "Pipeline not available");
+else if (!textures_drawable())
+  Dout(dc::vkframe, "Waiting for the coarsest mip level of all textures.");
 else
 {
+      report_number_of_pipelines();
       command_buffer->setViewport(0, { viewport });
       command_buffer->setScissor(0, { scissor });
       {
@@ -579,16 +770,21 @@ else
 
       for (int pl = 0; pl < number_of_pipelines; ++pl)
       {
-        command_buffer->bindPipeline(vk::PipelineBindPoint::eGraphics, vh_graphics_pipeline(m_graphics_pipelines[pl].handle()));
+        command_buffer->bindPipeline(vk::PipelineBindPoint::eGraphics, vh_pipelines[pl]);
+        // If the cull mode range was collapsed, then the pipeline was created for cull_modes[0] and the cull mode is dynamic state.
+        if (pipeline_table(m_pipeline_factory[pl].factory_index()).collapsed(1))
+          command_buffer->setCullMode(cull_modes[pl]);
         command_buffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_graphics_pipelines[pl].layout(), 0 /* uint32_t first_set */,
             m_graphics_pipelines[pl].vhv_descriptor_sets(m_current_frame.m_resource_index), {});
 
-        PushConstant pc = {
-          pl - 0.5f,
-          1
-        };
-        command_buffer->pushConstants(m_graphics_pipelines[pl].layout(), vk::ShaderStageFlagBits::eVertex, offsetof(PushConstant, m_x_position), sizeof(PushConstant::m_x_position), &pc.m_x_position);
-        command_buffer->pushConstants(m_graphics_pipelines[pl].layout(), vk::ShaderStageFlagBits::eFragment, offsetof(PushConstant, m_texture_index), sizeof(PushConstant::m_texture_index), &pc.m_texture_index);
+        m_push_constant_updater.set<&PushConstant::m_x_position>(pl - 0.5f);
+        m_push_constant_updater.set<&PushConstant::m_texture_index>(1);
+        // The textures are swapped between the samplers (see create_textures); use the highest min_lod of all of them.
+        float min_lod = 0.0f;
+        for (vulkan::Texture const& texture : m_textures)
+          min_lod = std::max(min_lod, texture.min_lod());
+        m_push_constant_updater.set<&PushConstant::m_min_lod>(min_lod);
+        m_push_constant_updater.flush(command_buffer, m_graphics_pipelines[pl]);
         command_buffer->draw(6 * square_steps * square_steps, 2, 0, 0);
       }
 
@@ -616,6 +812,34 @@ else
     Dout(dc::vkframe, "Leaving Window::draw_frame.");
   }
 
+  // Returns true when every texture has at least its coarsest mip level; before that nothing may be sampled.
+  bool textures_drawable() const
+  {
+    for (int t = 0; t < number_of_combined_image_samplers; ++t)
+      if (m_textures[t].min_lod() >= m_mip_chains[t]->level_count())
+        return false;
+    return true;
+  }
+
+  bool m_reported_number_of_pipelines = false;
+
+  // Print how many pipelines were generated, versus how many would have been needed without dynamic state.
+  void report_number_of_pipelines()
+  {
+    if (m_reported_number_of_pipelines)
+      return;
+    m_reported_number_of_pipelines = true;
+    size_t generated = 0;
+    size_t without_dynamic_state = 0;
+    for (int pl = 0; pl < number_of_pipelines; ++pl)
+    {
+      vulkan::pipeline::PipelineTable const& table = pipeline_table(m_pipeline_factory[pl].factory_index());
+      generated += table.size();
+      without_dynamic_state += table.number_of_pipelines_without_dynamic_state();
+    }
+    std::cout << "Generated " << generated << " pipelines (" << without_dynamic_state << " without dynamic state)." << std::endl;
+  }
+
   //===========================================================================
   //
   // ImGui
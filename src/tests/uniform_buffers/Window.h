@@ -461,7 +461,6 @@ void main()
     };
 
     wait_command_buffer_completed();
-    m_logical_device->reset_fences({ *frame_resources->m_command_buffers_completed });
 
     auto command_buffer = frame_resources->m_command_buffer;
     Dout(dc::vkframe, "Start recording command buffer.");
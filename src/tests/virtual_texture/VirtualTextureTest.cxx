@@ -0,0 +1,48 @@
+#include "sys.h"
+#include "Application.inl.h"
+#include "VirtualTextureTest.h"
+#include "Window.h"
+#include "LogicalDevice.h"
+#include "debug.h"
+
+// Draws a vulkan::VirtualTexture of 64x64 pages over the whole window with virtual_texture_frag_glsl,
+// zooming in and out every few frames. The pages are generated on request (a checker board with a
+// color per level) and uploaded into a physical texture with fewer slots than the pages that are
+// used, so pages are evicted when the zoom changes. On devices with sparse residency the physical
+// texture is sparse and the slots are bound and unbound as pages come and go. After a few hundred
+// frames the window checks that pages were loaded and evicted, and closes itself.
+
+int main(int argc, char* argv[])
+{
+  Debug(NAMESPACE_DEBUG::init());
+  Dout(dc::notice, "Entering main()");
+
+  try
+  {
+    // Create the application object.
+    VirtualTextureTest application;
+
+    // Initialize application; this parses the command line.
+    application.initialize(argc, argv);
+
+    // Create a window and a logical device that supports presenting to it.
+    auto root_window = application.create_root_window<vulkan::WindowEvents, Window>({400, 300}, LogicalDevice::root_window_request_cookie);
+    application.create_logical_device(std::make_unique<LogicalDevice>(), std::move(root_window));
+
+    // Run the application until the window closes itself.
+    application.run();
+  }
+  catch (AIAlert::Error const& error)
+  {
+    // Application terminated with an error.
+    Dout(dc::warning, "\e[31m" << error << ", caught in VirtualTextureTest.cxx\e[0m");
+  }
+#ifndef CWDEBUG // Commented out so we can see in gdb where an exception is thrown from.
+  catch (std::exception& exception)
+  {
+    DoutFatal(dc::core, "\e[31mstd::exception: " << exception.what() << " caught in VirtualTextureTest.cxx\e[0m");
+  }
+#endif
+
+  Dout(dc::notice, "Leaving main()");
+}
@@ -0,0 +1,406 @@
+#pragma once
+
+#include "SynchronousWindow.h"
+#include "Pipeline.h"
+#include "SamplerKind.h"
+#include "VirtualTexture.h"
+#include "VirtualTextureShaders.h"
+#include "pipeline/FactoryCharacteristicId.h"
+#include "pipeline/PipelineTable.h"
+#include "pipeline/PushConstantUpdater.h"
+#include "shader_builder/ShaderIndex.h"
+#include "shader_builder/ShaderInfo.h"
+#include "shader_builder/shader_resource/CombinedImageSampler.h"
+#include "utils/Array.h"
+
+#include "pipeline/ShaderInputData.inl.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <iostream>
+#include <optional>
+#include <string_view>
+#include <vector>
+#include "debug.h"
+#ifdef CWDEBUG
+#include "debug/debug_ostream_operators.h"
+#endif
+
+class Window : public task::SynchronousWindow
+{
+ public:
+  using task::SynchronousWindow::SynchronousWindow;
+
+ private:
+  // Define renderpass / attachment objects.
+  RenderPass main_pass{this, "main_pass"};
+
+  enum class LocalShaderIndex {
+    vertex,
+    frag
+  };
+  utils::Array<vulkan::shader_builder::ShaderIndex, 2, LocalShaderIndex> m_shader_indices;
+
+  vulkan::Pipeline m_graphics_pipeline;
+  vulkan::pipeline::FactoryHandle m_pipeline_factory;
+  vulkan::pipeline::FactoryCharacteristicId m_pipeline_factory_characteristic_id;
+  vulkan::pipeline::PushConstantUpdater<vulkan::VirtualTextureFeedback> m_push_constant_updater;
+  vulkan::shader_builder::shader_resource::CombinedImageSampler m_physical_texture_sampler;
+  vulkan::shader_builder::shader_resource::CombinedImageSampler m_indirection_texture_sampler;
+
+  // The virtual texture has s_extent pages of s_page_size texels (plus a border of s_border texels) at level 0, and
+  // s_slots slots: enough for the pages of one zoom factor, but not for those of all of them.
+  static constexpr vk::Extent2D s_extent{64, 64};
+  static constexpr uint32_t s_page_size = 120;
+  static constexpr uint32_t s_border = 4;                       // A slot is then 128 texels, the usual sparse block size.
+  static constexpr vk::Extent2D s_slots{8, 6};
+  // Room for the feedback of a framebuffer of up to 1024x1024 pixels.
+  static constexpr uint32_t s_feedback_entries = (1024 / vulkan::virtual_texture_feedback_tile_size) * (1024 / vulkan::virtual_texture_feedback_tile_size);
+
+  std::optional<vulkan::VirtualTexture> m_virtual_texture;
+
+  // Test state; only accessed from the render loop, except for m_requested_pages.
+  int m_frame_count = 0;
+  std::atomic<uint64_t> m_requested_pages = 0;                  // The number of pages that page_request was called for.
+  vk::DeviceSize m_max_sparse_bytes = 0;                        // The largest sparse_bytes() seen.
+  std::atomic_bool m_unsupported = false;                       // Set when the logical device can't run the feedback shader.
+
+  // The zoom factor is 1 << (m_frame_count / s_zoom_interval % s_zoom_steps).
+  static constexpr int s_zoom_interval = 25;
+  static constexpr int s_zoom_steps = 4;
+  // Check the results and close the window after this many frames.
+  static constexpr int s_number_of_frames = 300;
+
+  static constexpr std::string_view virtual_texture_vert_glsl = R"glsl(
+out gl_PerVertex { vec4 gl_Position; };
+layout(location = 0) out vec2 v_virtual_uv;
+
+void main()
+{
+  // Two triangles that cover the window: the corners (0,0), (1,0), (0,1), (0,1), (1,0), (1,1).
+  vec2 corner = vec2((0x32 >> gl_VertexIndex) & 1, (0x2C >> gl_VertexIndex) & 1);
+  gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+  // Zoom in on the center of the virtual texture by a factor of 2^gl_InstanceIndex (the first instance of the draw).
+  v_virtual_uv = 0.5 + (corner - 0.5) / float(1 << gl_InstanceIndex);
+}
+)glsl";
+
+  // The texels of the page of load, including its border: a checker board of 8x8 texels of the level of the page,
+  // in a color that depends on that level. The border is the same function evaluated outside the page.
+  static std::vector<std::byte> make_page(vulkan::VirtualTexture::Load const& load)
+  {
+    constexpr uint32_t slot_size = s_page_size + 2 * s_border;
+    uint32_t const level = load.m_page.m_level;
+    std::array<uint32_t, 3> const color = { 64 + (level * 97) % 192, 64 + (level * 57) % 192, 64 + (level * 31) % 192 };
+    std::vector<std::byte> pixels(size_t{slot_size} * slot_size * 4);
+    for (uint32_t y = 0; y < slot_size; ++y)
+      for (uint32_t x = 0; x < slot_size; ++x)
+      {
+        // The texel coordinates in the level (negative in the border of the first pages).
+        int32_t const level_x = static_cast<int32_t>(load.m_page.m_x * s_page_size + x) - static_cast<int32_t>(s_border);
+        int32_t const level_y = static_cast<int32_t>(load.m_page.m_y * s_page_size + y) - static_cast<int32_t>(s_border);
+        bool const dark = ((level_x >> 3) + (level_y >> 3)) & 1;
+        std::byte* texel = &pixels[(size_t{y} * slot_size + x) * 4];
+        for (int c = 0; c < 3; ++c)
+          texel[c] = static_cast<std::byte>(dark ? color[c] / 2 : color[c]);
+        texel[3] = std::byte{255};
+      }
+    return pixels;
+  }
+
+ private:
+  void create_render_graph() override
+  {
+    DoutEntering(dc::vulkan, "Window::create_render_graph() [" << this << "]");
+
+    // This must be a reference.
+    auto& output = swapchain().presentation_attachment();
+
+    // Define the render graph.
+    m_render_graph = main_pass->stores(~output);
+
+    // Generate everything.
+    m_render_graph.generate(this);
+  }
+
+  void register_shader_templates() override
+  {
+    DoutEntering(dc::notice, "Window::register_shader_templates() [" << this << "]");
+
+    using namespace vulkan::shader_builder;
+
+    // The feedback is written through a buffer device address, which requires SPIR-V 1.5.
+    ShaderCompilerOptions compiler_options;
+    compiler_options.set_target_env(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_2);
+
+    std::vector<ShaderInfo> shader_info = {
+      { vk::ShaderStageFlagBits::eVertex,   "virtual_texture.vert.glsl" },
+      { vk::ShaderStageFlagBits::eFragment, "virtual_texture.frag.glsl", compiler_options }
+    };
+    shader_info[0].load(virtual_texture_vert_glsl);
+    shader_info[1].load(vulkan::virtual_texture_frag_glsl);
+
+    auto indices = application().register_shaders(std::move(shader_info));
+
+    // Copy the returned "shader indices" into our local array.
+    ASSERT(indices.size() == m_shader_indices.size());
+    for (int i = 0; i < indices.size(); ++i)
+      m_shader_indices[static_cast<LocalShaderIndex>(i)] = indices[i];
+  }
+
+  void create_textures() override
+  {
+    DoutEntering(dc::vulkan, "Window::create_textures() [" << this << "]");
+
+    if (m_unsupported)
+      return;
+
+    // The pages are generated right away; upload_page() is thread-safe.
+    m_virtual_texture.emplace(m_logical_device, this, s_extent, s_page_size, s_border, s_slots, max_number_of_frame_resources(),
+        s_feedback_entries,
+        vulkan::SamplerKind{m_logical_device, { .mipmapMode = vk::SamplerMipmapMode::eNearest, .anisotropyEnable = VK_FALSE }},
+        graphics_settings(),
+        [this](vulkan::VirtualTexture::Load const& load){
+          ++m_requested_pages;
+          m_virtual_texture->upload_page(load, make_page(load));
+        },
+        {}
+        COMMA_CWDEBUG_ONLY(debug_name_prefix("m_virtual_texture")));
+
+    // The pages are uploaded by record_update(), in front of the render pass that samples them.
+    m_physical_texture_sampler.update_image_sampler(&m_virtual_texture->physical_texture(), m_pipeline_factory_characteristic_id);
+    m_indirection_texture_sampler.update_image_sampler(&m_virtual_texture->indirection_texture(), m_pipeline_factory_characteristic_id);
+  }
+
+  class VirtualTexturePipelineCharacteristic : public vulkan::pipeline::Characteristic
+  {
+   private:
+    std::vector<vk::PipelineColorBlendAttachmentState> m_pipeline_color_blend_attachment_states;
+    std::vector<vk::DynamicState> m_dynamic_states = {
+      vk::DynamicState::eViewport,
+      vk::DynamicState::eScissor
+    };
+    std::vector<vk::PushConstantRange> m_push_constant_ranges;
+
+   protected:
+    using direct_base_type = vulkan::pipeline::Characteristic;
+
+    // The different states of this task.
+    enum VirtualTexturePipelineCharacteristic_state_type {
+      VirtualTexturePipelineCharacteristic_initialize = direct_base_type::state_end,
+      VirtualTexturePipelineCharacteristic_compile
+    };
+
+    ~VirtualTexturePipelineCharacteristic() override
+    {
+      DoutEntering(dc::vulkan, "VirtualTexturePipelineCharacteristic::~VirtualTexturePipelineCharacteristic() [" << this << "]");
+    }
+
+   public:
+    static constexpr state_type state_end = VirtualTexturePipelineCharacteristic_compile + 1;
+
+    VirtualTexturePipelineCharacteristic(task::SynchronousWindow const* owning_window COMMA_CWDEBUG_ONLY(bool debug)) :
+      vulkan::pipeline::Characteristic(owning_window COMMA_CWDEBUG_ONLY(debug)) { }
+
+   protected:
+    char const* state_str_impl(state_type run_state) const override
+    {
+      switch(run_state)
+      {
+        AI_CASE_RETURN(VirtualTexturePipelineCharacteristic_initialize);
+        AI_CASE_RETURN(VirtualTexturePipelineCharacteristic_compile);
+      }
+      return direct_base_type::state_str_impl(run_state);
+    }
+
+    void initialize_impl() override
+    {
+      set_state(VirtualTexturePipelineCharacteristic_initialize);
+    }
+
+    void multiplex_impl(state_type run_state) override
+    {
+      switch (run_state)
+      {
+        case VirtualTexturePipelineCharacteristic_initialize:
+        {
+          Window const* window = static_cast<Window const*>(m_owning_window);
+
+          // Register the vectors that we will fill. There are no vertex buffers.
+          m_flat_create_info->add(&shader_stage_create_infos());
+          m_flat_create_info->add(&m_pipeline_color_blend_attachment_states);
+          m_flat_create_info->add(&m_dynamic_states);
+          m_flat_create_info->add_descriptor_set_layouts(&sorted_descriptor_set_layouts());
+          m_flat_create_info->add(&m_push_constant_ranges);
+
+          // Define the pipeline.
+          add_push_constant<vulkan::VirtualTextureFeedback>();
+          add_combined_image_sampler(window->m_physical_texture_sampler);
+          add_combined_image_sampler(window->m_indirection_texture_sampler);
+
+          // Add default color blend.
+          m_pipeline_color_blend_attachment_states.push_back(vk_defaults::PipelineColorBlendAttachmentState{});
+
+          preprocess1(m_owning_window->application().get_shader_info(window->m_shader_indices[LocalShaderIndex::vertex]));
+          preprocess1(m_owning_window->application().get_shader_info(window->m_shader_indices[LocalShaderIndex::frag]));
+
+          m_push_constant_ranges = push_constant_ranges();
+          m_flat_create_info->m_pipeline_input_assembly_state_create_info.topology = vk::PrimitiveTopology::eTriangleList;
+
+          realize_descriptor_set_layouts(m_owning_window->logical_device());
+
+          set_continue_state(VirtualTexturePipelineCharacteristic_compile);
+          run_state = Characteristic_initialized;
+          break;
+        }
+        case VirtualTexturePipelineCharacteristic_compile:
+        {
+          using namespace vulkan::shader_builder;
+          Window const* window = static_cast<Window const*>(m_owning_window);
+
+          // Compile the shaders.
+          ShaderCompiler compiler;
+          build_shader(m_owning_window, window->m_shader_indices[LocalShaderIndex::vertex], compiler, m_set_index_hint_map
+              COMMA_CWDEBUG_ONLY({ m_owning_window, "PipelineFactory::m_shader_input_data" }));
+          build_shader(m_owning_window, window->m_shader_indices[LocalShaderIndex::frag], compiler, m_set_index_hint_map
+              COMMA_CWDEBUG_ONLY({ m_owning_window, "PipelineFactory::m_shader_input_data" }));
+
+          run_state = Characteristic_compiled;
+          break;
+        }
+      }
+      direct_base_type::multiplex_impl(run_state);
+    }
+
+   public:
+#ifdef CWDEBUG
+    void print_on(std::ostream& os) const override
+    {
+      os << "{ (VirtualTexturePipelineCharacteristic*)" << this << " }";
+    }
+#endif
+  };
+
+  void create_graphics_pipelines() override
+  {
+    DoutEntering(dc::vulkan, "Window::create_graphics_pipelines() [" << this << "]");
+
+    if (!logical_device()->supports_buffer_device_address())
+    {
+      std::cout << "The logical device does not support buffer device addresses; skipping this test." << std::endl;
+      m_unsupported = true;
+      return;
+    }
+
+    // This is what the descriptors are recognized by in the shader code (see VirtualTextureShaders.h).
+    m_physical_texture_sampler.set_glsl_id_postfix("physical_texture");
+    m_indirection_texture_sampler.set_glsl_id_postfix("indirection_texture");
+
+    m_pipeline_factory = create_pipeline_factory(m_graphics_pipeline, main_pass.vh_render_pass() COMMA_CWDEBUG_ONLY(true));
+    m_pipeline_factory_characteristic_id = m_pipeline_factory.add_characteristic<VirtualTexturePipelineCharacteristic>(this COMMA_CWDEBUG_ONLY(true));
+    m_pipeline_factory.generate(this);
+  }
+
+  //===========================================================================
+  //
+  // Called from initialize_impl.
+  //
+  threadpool::Timer::Interval get_frame_rate_interval() const override
+  {
+    // Limit the frame rate of this window to 100 frames per second.
+    return threadpool::Interval<10, std::chrono::milliseconds>{};
+  }
+
+  //===========================================================================
+  //
+  // Frame code (called every frame)
+  //
+  //===========================================================================
+
+  void render_frame() override
+  {
+    DoutEntering(dc::vkframe, "Window::render_frame() [" << this << "]");
+
+    if (m_unsupported)
+    {
+      close();
+      return;
+    }
+
+    ++m_frame_count;
+    start_frame();
+    acquire_image();                    // Can throw vulkan::OutOfDateKHR_Exception.
+    draw_frame();
+    m_max_sparse_bytes = std::max(m_max_sparse_bytes, m_virtual_texture->sparse_bytes());
+    if (m_frame_count == s_number_of_frames)
+      check_and_close();
+    finish_frame();
+  }
+
+  void draw_frame()
+  {
+    vulkan::FrameResourcesData* frame_resources = m_current_frame.m_frame_resources;
+    main_pass.update_image_views(swapchain(), frame_resources);
+
+    vk::Pipeline const vh_pipeline = pipeline_table(m_pipeline_factory.factory_index()).lookup(0);
+
+    wait_command_buffer_completed();
+    auto command_buffer = frame_resources->m_command_buffer;
+    command_buffer->begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+    // Push constants are undefined at the start of a command buffer.
+    m_push_constant_updater.invalidate();
+    // Read back the feedback of the previous frame of this frame resource and upload what changed, in front of the render pass.
+    m_virtual_texture->record_update(static_cast<vk::CommandBuffer>(command_buffer), m_current_frame.m_resource_index);
+    command_buffer->beginRenderPass(main_pass.begin_info(), vk::SubpassContents::eInline);
+    if (m_graphics_pipeline.handle() && vh_pipeline)
+    {
+      vk::Extent2D const swapchain_extent = swapchain().extent();
+      command_buffer->setViewport(0, { vk::Viewport{
+          .x = 0, .y = 0, .width = static_cast<float>(swapchain_extent.width), .height = static_cast<float>(swapchain_extent.height),
+          .minDepth = 0.0f, .maxDepth = 1.0f } });
+      command_buffer->setScissor(0, { vk::Rect2D{ .offset = vk::Offset2D(), .extent = swapchain_extent } });
+      command_buffer->bindPipeline(vk::PipelineBindPoint::eGraphics, vh_pipeline);
+      command_buffer->bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_graphics_pipeline.layout(), 0 /* uint32_t first_set */,
+          m_graphics_pipeline.vhv_descriptor_sets(m_current_frame.m_resource_index), {});
+
+      m_push_constant_updater.set(m_virtual_texture->push_constant(m_current_frame.m_resource_index, swapchain_extent));
+      m_push_constant_updater.flush(command_buffer, m_graphics_pipeline);
+      // The first instance is the zoom step (see virtual_texture_vert_glsl).
+      uint32_t const zoom_step = m_frame_count / s_zoom_interval % s_zoom_steps;
+      command_buffer->draw(6, 1, 0, zoom_step);
+    }
+    command_buffer->endRenderPass();
+    // Make the feedback that the fragment shader wrote available to the record_update() that reuses this frame resource.
+    m_virtual_texture->record_feedback_barrier(static_cast<vk::CommandBuffer>(command_buffer), m_current_frame.m_resource_index);
+    command_buffer->end();
+    submit(command_buffer);
+  }
+
+  void check_and_close()
+  {
+    vulkan::memory::VirtualTexturePageTable::Stats const stats = m_virtual_texture->page_table().stats();
+    Dout(dc::notice, "Page table stats: " << stats);
+    if (m_virtual_texture->is_sparse())
+      std::cout << "The physical texture is sparse; at most " << m_max_sparse_bytes << " bytes were bound to its slots." << std::endl;
+
+    int failures = 0;
+    auto check = [&](bool condition, char const* what){
+      if (!condition)
+      {
+        std::cerr << "FAILED: " << what << std::endl;
+        ++failures;
+      }
+    };
+    check(stats.m_loads > 0 && m_requested_pages > 0, "pages were requested");
+    check(stats.m_failed_loads == 0, "no page failed to load");
+    check(stats.m_evictions > 0, "pages were evicted when zooming");
+    check(!m_virtual_texture->is_sparse() || m_max_sparse_bytes > 0, "memory was bound to the slots of the sparse physical texture");
+    if (failures)
+      std::cerr << failures << " checks failed." << std::endl;
+    else
+      std::cout << "Success!" << std::endl;
+    close();
+  }
+};
@@ -2,6 +2,8 @@
 #include "SynchronousWindow.h"
 #include "FrameResourcesData.h"
 #include "PersistentAsyncTask.h"
+#include "ShaderWatcher.h"
+#include "AsyncFileReader.h"
 #include "shader_builder/ShaderIndex.h"
 #include "pipeline/PipelineCache.h"
 #include "infos/ApplicationInfo.h"
@@ -36,7 +38,7 @@ Application::Application() : m_dmri(m_mpp.instance()), m_thread_pool(1), m_depen
 }
 
 // This instantiates the destructor of our std::unique_ptr's.
-// Because it is here instead of the header we can use forward declarations for EventLoop and DnsResolver.
+// Because it is here instead of the header we can use forward declarations for EventLoop, DnsResolver and AsyncFileReader.
 Application::~Application()
 {
   DoutEntering(dc::vulkan, "vulkan::Application::~Application()");
@@ -168,6 +170,13 @@ void Application::initialize(int argc, char** argv)
   m_xcb_connection_broker = statefultask::create<xcb_connection_broker_type>(CWDEBUG_ONLY(false));
   m_xcb_connection_broker->run(m_low_priority_queue);           // Note: the broker never finishes, until abort() is called on it.
 
+  // Start the shader watcher, if requested.
+  if (use_shader_hot_reload())
+  {
+    m_shader_watcher = statefultask::create<task::ShaderWatcher>(CWDEBUG_ONLY(false));
+    m_shader_watcher->run(m_low_priority_queue);                // Note: the shader watcher never finishes, until terminate() is called on it.
+  }
+
   ApplicationInfo application_info;
   application_info.set_application_name(application_name());
   application_info.set_application_version(application_version());
@@ -233,6 +242,13 @@ int Application::create_device(std::unique_ptr<LogicalDevice>&& logical_device,
   return logical_device_index;
 }
 
+AsyncFileReader& Application::file_reader() const
+{
+  // Falls back to reading on the low priority queue if io_uring isn't available.
+  std::call_once(m_file_reader_once, [this](){ m_file_reader = std::make_unique<AsyncFileReader>(m_low_priority_queue); });
+  return *m_file_reader;
+}
+
 void Application::synchronize_graphics_settings() const
 {
   DoutEntering(dc::vulkan, "vulkan::Application::synchronize_graphics_settings()");
@@ -272,6 +288,8 @@ void Application::remove(task::SynchronousWindow* window_task)
   window_list_w->erase(
       std::remove_if(window_list_w->begin(), window_list_w->end(), [window_task](auto element){ return element.get() == window_task; }),
       window_list_w->end());
+  if (m_shader_watcher)
+    m_shader_watcher->remove_window(window_task);
 }
 
 void Application::create_instance(InstanceCreateInfo const& instance_create_info)
@@ -313,11 +331,17 @@ void Application::run()
   {
     logical_device_list_t::rat logical_device_list_r(m_logical_device_list);
     for (auto& device : *logical_device_list_r)
+    {
       device->wait_idle();
+      // No more uploads will be enqueued; stop the task that admits them.
+      device->terminate_upload_scheduler();
+    }
   }
 
   // Stop the broker tasks.
   m_xcb_connection_broker->terminate();
+  if (m_shader_watcher)
+    m_shader_watcher->terminate();
 
   // Abort dependent tasks.
   m_dependent_tasks.abort_all();
@@ -360,7 +384,11 @@ std::vector<shader_builder::ShaderIndex> Application::register_shaders(std::vect
     for (size_t i = 0; i < number_of_new_shaders; ++i)
     {
       if (new_indices[i] >= first_new_index)
+      {
+        if (m_shader_watcher && !new_shader_info_list[i].source_filename().empty())
+          m_shader_watcher->add_source(new_shader_info_list[i].source_filename(), new_indices[i]);
         shader_infos_w->deque.push_back(std::move(new_shader_info_list[i]));
+      }
     }
   }
 
@@ -370,10 +398,27 @@ std::vector<shader_builder::ShaderIndex> Application::register_shaders(std::vect
 shader_builder::ShaderInfo const& Application::get_shader_info(shader_builder::ShaderIndex shader_index) const
 {
   shader_builder::ShaderInfos::rat shader_infos_r(m_shader_infos);
+  if (AI_UNLIKELY(!shader_infos_r->reloaded.empty()))
+  {
+    auto reloaded = shader_infos_r->reloaded.find(shader_index);
+    if (reloaded != shader_infos_r->reloaded.end())
+      shader_index = reloaded->second;
+  }
   // We can return a reference because m_shader_infos_r->list is a deque for which references are not invalidated by inserting more elements at the end.
   return shader_infos_r->deque[shader_index];
 }
 
+void Application::reload_shader(utils::Badge<task::ShaderWatcher>, shader_builder::ShaderIndex shader_index, shader_builder::ShaderInfo&& reloaded_shader_info) const
+{
+  DoutEntering(dc::vulkan, "Application::reload_shader({}, " << shader_index << ", " << reloaded_shader_info << ")");
+  shader_builder::ShaderInfos::wat shader_infos_w(m_shader_infos);
+  shader_builder::ShaderIndex reloaded_index{0};
+  reloaded_index += shader_infos_w->deque.size();
+  // Don't replace the old ShaderInfo: a pipeline factory might be using it right now.
+  shader_infos_w->deque.push_back(std::move(reloaded_shader_info));
+  shader_infos_w->reloaded[shader_index] = reloaded_index;
+}
+
 void Application::run_pipeline_factory(boost::intrusive_ptr<task::PipelineFactory> const& factory, task::SynchronousWindow* window, PipelineFactoryIndex index)
 {
   // Remember that this factory is running.
@@ -18,9 +18,11 @@
 #include "utils/threading/Gate.h"
 #include "utils/DequeMemoryResource.h"
 #include "utils/Vector.h"
+#include "utils/Badge.h"
 #include <boost/intrusive_ptr.hpp>
 #include <filesystem>
 #include <deque>
+#include <mutex>
 #ifdef CWDEBUG
 #include "debug/DebugUtilsMessenger.h"
 #include "cwds/debug_ostream_operators.h"
@@ -31,6 +33,7 @@ namespace task {
 class SynchronousWindow;
 class PipelineFactory;
 class PipelineCache;
+class ShaderWatcher;
 } // namespace task
 
 namespace evio {
@@ -46,6 +49,7 @@ namespace vulkan {
 class InstanceCreateInfo;
 class DeviceCreateInfo;
 class ImGui;
+class AsyncFileReader;
 
 class Application
 {
@@ -95,6 +99,12 @@ class Application
   std::unique_ptr<evio::EventLoop> m_event_loop;
   std::unique_ptr<resolver::Scope> m_resolver_scope;
 
+  // Reads files (assets, shaders) without blocking thread pool threads.
+  // Created by the first call to file_reader(), so that applications that never read files asynchronously
+  // don't pay for an io_uring instance and its completion thread.
+  mutable std::once_flag m_file_reader_once;
+  mutable std::unique_ptr<AsyncFileReader> m_file_reader;
+
   // A task that hands out connections to the X server.
   boost::intrusive_ptr<xcb_connection_broker_type> m_xcb_connection_broker;
 
@@ -139,6 +149,9 @@ class Application
   // Storage for all shader templates.
   mutable vulkan::shader_builder::ShaderInfos m_shader_infos;    // Mutable because it is updated by register_shaders, which is threadsafe-"const".
 
+  // Watches the source files of shader templates; only created when use_shader_hot_reload() returns true.
+  boost::intrusive_ptr<task::ShaderWatcher> m_shader_watcher;
+
   // We have one of these for each pipeline cache filename.
   struct PipelineCacheMerger
   {
@@ -220,6 +233,9 @@ class Application
   AIQueueHandle medium_priority_queue() const { return m_medium_priority_queue; }
   AIQueueHandle low_priority_queue() const { return m_low_priority_queue; }
 
+  // Accessor for the asynchronous file reader; creates it on first use (thread-safe).
+  AsyncFileReader& file_reader() const;
+
   std::filesystem::path path_of(Directory directory) const
   {
     return m_directories.path_of(directory);
@@ -299,8 +315,16 @@ class Application
   std::vector<vulkan::shader_builder::ShaderIndex> register_shaders(std::vector<vulkan::shader_builder::ShaderInfo>&& new_shader_info_list) const;
 
   // Return a reference to the ShaderInfo that corresponds to shader_index, as added by a call to register_shaders.
+  // If the shader was hot-reloaded then this returns the latest version.
   vulkan::shader_builder::ShaderInfo const& get_shader_info(vulkan::shader_builder::ShaderIndex shader_index) const;
 
+  // Called by ShaderWatcher when the source file of shader_index changed.
+  // Previous versions are kept (they might still be in use), so references returned by get_shader_info remain valid.
+  void reload_shader(utils::Badge<task::ShaderWatcher>, vulkan::shader_builder::ShaderIndex shader_index, vulkan::shader_builder::ShaderInfo&& reloaded_shader_info) const;
+
+  // Accessor. Returns nullptr when shader hot-reload is not enabled.
+  task::ShaderWatcher* shader_watcher() const { return m_shader_watcher.get(); }
+
   // Called by SynchronousWindow::create_pipeline_factory.
   void run_pipeline_factory(boost::intrusive_ptr<task::PipelineFactory> const& factory, task::SynchronousWindow* window, PipelineFactoryIndex index);
   // Called by SynchronousWindow::pipeline_factory_done.
@@ -327,6 +351,10 @@ class Application
   // Override this function to add Instance layers and/or extensions.
   virtual void prepare_instance_info(vulkan::InstanceCreateInfo& instance_create_info) const { }
 
+  // Override this function to return true in order to watch the source files of shaders that were loaded
+  // from disk and regenerate the pipelines that use them when they change (see ShaderWatcher).
+  virtual bool use_shader_hot_reload() const { return false; }
+
  public:
   // Override this function to change the default ApplicatioInfo values.
   virtual std::u8string application_name() const;
@@ -0,0 +1,407 @@
+#include "sys.h"
+#include "AsyncFileReader.h"
+#include "vk_utils/IoUring.h"
+#include "threadpool/AIThreadPool.h"
+#include "utils/AIAlert.h"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include "debug.h"
+
+namespace vulkan {
+
+namespace {
+
+// The largest read passed to the kernel at once (the length field of a submission queue entry is 32 bit).
+constexpr size_t max_read_size = size_t{1} << 30;
+
+} // namespace
+
+AsyncFileReader::AsyncFileReader(AIQueueHandle fallback_queue, bool use_io_uring, unsigned queue_depth) : m_fallback_queue(fallback_queue)
+{
+  DoutEntering(dc::vulkan, "AsyncFileReader::AsyncFileReader(<queue>, " << std::boolalpha << use_io_uring << ", " << queue_depth << ")");
+
+  if (use_io_uring)
+  {
+    try
+    {
+      m_ring = std::make_unique<vk_utils::IoUring>(queue_depth);
+    }
+    catch (AIAlert::Error const& error)
+    {
+      Dout(dc::warning, error << "; reading files on the thread pool instead.");
+    }
+  }
+  if (m_ring)
+    m_completion_thread = std::thread([this](){ reap_completions(); });
+}
+
+AsyncFileReader::~AsyncFileReader()
+{
+  DoutEntering(dc::vulkan, "AsyncFileReader::~AsyncFileReader()");
+  wait_idle();
+  if (m_completion_thread.joinable())
+  {
+    // Nothing is in flight, so the completion thread is (or will be) waiting for m_reaper_condition,
+    // unless it already returned because io_uring failed.
+    {
+      std::lock_guard<std::mutex> lock(m_reaper_mutex);
+      m_stop_reaping = true;
+    }
+    m_reaper_condition.notify_one();
+    m_completion_thread.join();
+  }
+}
+
+bool AsyncFileReader::register_buffers(std::vector<std::span<std::byte>> buffers)
+{
+  DoutEntering(dc::vulkan, "AsyncFileReader::register_buffers(<" << buffers.size() << " buffers>)");
+  state_t::wat state_w(m_state);
+  // Registering buffers while reads use them is not possible.
+  ASSERT(state_w->m_in_flight.empty() && state_w->m_queued.empty());
+  if (!uses_io_uring())
+  {
+    // Without io_uring there is nothing to gain from registering.
+    return true;
+  }
+  if (!state_w->m_registered_buffers.empty())
+    m_ring->unregister_buffers();
+  state_w->m_registered_buffers.clear();
+  std::vector<iovec> iovecs;
+  for (auto buffer : buffers)
+    iovecs.push_back({ buffer.data(), buffer.size() });
+  if (int error = m_ring->register_buffers(iovecs.data(), iovecs.size()); error < 0)
+  {
+    Dout(dc::warning, "Registering " << buffers.size() << " buffers failed: " << std::strerror(-error));
+    return false;
+  }
+  state_w->m_registered_buffers = std::move(buffers);
+  return true;
+}
+
+void AsyncFileReader::read(std::filesystem::path const& path, std::byte* dst, size_t size, uint64_t offset, callback_type callback)
+{
+  int const fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  queue(fd, dst, size, offset, std::move(callback));
+}
+
+void AsyncFileReader::read(std::filesystem::path const& path, std::byte* dst, size_t size, uint64_t offset,
+    Result& result, boost::intrusive_ptr<AIStatefulTask> task, AIStatefulTask::condition_type condition)
+{
+  read(path, dst, size, offset, [result_ptr = &result, task = std::move(task), condition](Result const& read_result){
+    *result_ptr = read_result;
+    task->signal(condition);
+  });
+}
+
+void AsyncFileReader::read_file(std::filesystem::path const& path, std::vector<std::byte>& data, callback_type callback)
+{
+  int const fd = open_file(path, data);
+  queue(fd, data.data(), data.size(), 0, std::move(callback));
+}
+
+AsyncFileReader::Result AsyncFileReader::read_file(std::filesystem::path const& path, std::vector<std::byte>& data)
+{
+  if (!uses_io_uring())
+  {
+    // This thread has to wait anyway, so read on this thread instead of occupying a thread pool thread too.
+    Request request{ .m_fd = open_file(path, data), .m_dst = data.data(), .m_size = data.size(), .m_offset = 0, .m_buffer_index = -1 };
+    if (request.m_fd < 0)
+      request.m_result.m_error = errno;
+    else
+    {
+      blocking_read(request);
+      close(request.m_fd);
+    }
+    return request.m_result;
+  }
+
+  std::mutex mutex;
+  std::condition_variable condition;
+  bool finished = false;
+  Result result;
+  read_file(path, data, [&](Result const& read_result){
+    std::lock_guard<std::mutex> lock(mutex);
+    result = read_result;
+    finished = true;
+    condition.notify_one();
+  });
+  submit();
+  std::unique_lock<std::mutex> lock(mutex);
+  condition.wait(lock, [&](){ return finished; });
+  return result;
+}
+
+//static
+int AsyncFileReader::open_file(std::filesystem::path const& path, std::vector<std::byte>& data)
+{
+  int const fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat file_status;
+  if (fd >= 0 && fstat(fd, &file_status) == 0)
+    data.resize(file_status.st_size);
+  else
+    data.clear();
+  return fd;
+}
+
+void AsyncFileReader::queue(int fd, std::byte* dst, size_t size, uint64_t offset, callback_type&& callback)
+{
+  auto request = std::make_unique<Request>(Request{ .m_fd = fd, .m_dst = dst, .m_size = size, .m_offset = offset, .m_buffer_index = -1, .m_callback = std::move(callback) });
+  m_outstanding.fetch_add(1, std::memory_order_relaxed);
+  if (fd < 0)
+  {
+    request->m_result.m_error = errno;
+    finish(std::move(request));
+    return;
+  }
+  bool batch_full;
+  {
+    state_t::wat state_w(m_state);
+    auto const& buffers = state_w->m_registered_buffers;
+    auto buffer = std::find_if(buffers.begin(), buffers.end(), [dst, size](std::span<std::byte> buffer){
+      return buffer.data() <= dst && dst + size <= buffer.data() + buffer.size();
+    });
+    if (buffer != buffers.end())
+      request->m_buffer_index = buffer - buffers.begin();
+    state_w->m_queued.push_back(std::move(request));
+    batch_full = state_w->m_queued.size() >= (m_ring ? m_ring->sq_entries() : s_default_queue_depth);
+  }
+  if (batch_full)
+    submit();
+}
+
+void AsyncFileReader::submit()
+{
+  if (uses_io_uring())
+  {
+    bool submitted;
+    {
+      state_t::wat state_w(m_state);
+      submitted = submit_queued(*state_w);
+    }
+    if (submitted)
+    {
+      // Wake up the completion thread if it is waiting for reads to be in flight.
+      std::lock_guard<std::mutex> lock(m_reaper_mutex);
+      m_reaper_condition.notify_one();
+      return;
+    }
+    // io_uring failed; read what is left on the thread pool.
+  }
+
+  std::deque<std::unique_ptr<Request>> queued;
+  {
+    state_t::wat state_w(m_state);
+    queued.swap(state_w->m_queued);
+  }
+  auto& queue = AIThreadPool::instance().get_queue(m_fallback_queue);
+  while (!queued.empty())
+  {
+    Request* request = queued.front().release();
+    queued.pop_front();
+    bool posted = false;
+    {
+      auto queue_access = queue.producer_access();
+      if (queue_access.length() < queue.capacity())
+      {
+        queue_access.move_in([this, request](){
+          blocking_read(*request);
+          finish(std::unique_ptr<Request>(request));
+          return false;
+        });
+        posted = true;
+      }
+    }
+    if (posted)
+      queue.notify_one();
+    else
+    {
+      // The thread pool queue is full; do the read on this thread.
+      blocking_read(*request);
+      finish(std::unique_ptr<Request>(request));
+    }
+  }
+}
+
+void AsyncFileReader::wait_idle()
+{
+  submit();
+  std::unique_lock<std::mutex> lock(m_idle_mutex);
+  m_idle_condition.wait(lock, [this](){ return m_outstanding.load(std::memory_order_acquire) == 0; });
+}
+
+bool AsyncFileReader::fill_submission_queue(State& state)
+{
+  bool added = false;
+  // Never have more reads in flight than fit in the submission queue: that way the completion queue (which is twice as large) can't overflow.
+  while (!state.m_queued.empty() && state.m_in_flight.size() < m_ring->sq_entries())
+  {
+    io_uring_sqe* sqe = m_ring->get_sqe();
+    if (!sqe)
+      break;
+    Request* request = state.m_queued.front().release();
+    state.m_queued.pop_front();
+    size_t const done = request->m_result.m_bytes_read;
+    sqe->opcode = request->m_buffer_index >= 0 ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe->fd = request->m_fd;
+    sqe->addr = reinterpret_cast<uint64_t>(request->m_dst + done);
+    sqe->len = std::min(request->m_size - done, max_read_size);
+    sqe->off = request->m_offset + done;
+    sqe->buf_index = std::max(request->m_buffer_index, 0);
+    sqe->user_data = reinterpret_cast<uint64_t>(request);
+    state.m_in_flight.insert(request);
+    added = true;
+  }
+  return added;
+}
+
+bool AsyncFileReader::submit_queued(State& state)
+{
+  // m_io_uring_failed is only set while m_state is locked, so nothing is added to m_in_flight after fail_in_flight emptied it.
+  if (m_io_uring_failed.load(std::memory_order_relaxed))
+    return false;
+  if (!fill_submission_queue(state))
+    return true;
+  int const result = m_ring->submit();
+  // Put the requests of the entries that the kernel did not take back in front of the queue, in the same order.
+  // That way m_in_flight only contains requests that will complete; the rest is passed again after the next completion.
+  std::vector<uint64_t> const unsubmitted = m_ring->take_unsubmitted();
+  for (auto user_data = unsubmitted.rbegin(); user_data != unsubmitted.rend(); ++user_data)
+  {
+    Request* request = reinterpret_cast<Request*>(*user_data);
+    state.m_in_flight.erase(request);
+    state.m_queued.emplace_front(request);
+  }
+  if (result >= 0 && !state.m_in_flight.empty())
+    return true;
+  // io_uring_enter failed, or it took nothing while there is nothing in flight whose completion would cause a retry.
+  Dout(dc::warning, "io_uring_enter failed: " << (result < 0 ? std::strerror(-result) : "no entries were consumed") <<
+      "; reading files on the thread pool from now on.");
+  // Reads that the kernel already took are still reaped by the completion thread.
+  m_io_uring_failed.store(true, std::memory_order_release);
+  return false;
+}
+
+void AsyncFileReader::fail_in_flight(int error)
+{
+  std::vector<std::unique_ptr<Request>> failed;
+  {
+    state_t::wat state_w(m_state);
+    m_io_uring_failed.store(true, std::memory_order_release);
+    for (Request* request : state_w->m_in_flight)
+    {
+      request->m_result.m_error = -error;
+      failed.emplace_back(request);
+    }
+    state_w->m_in_flight.clear();
+  }
+  Dout(dc::warning, "Waiting for io_uring completions failed: " << std::strerror(-error) << "; failing " << failed.size() <<
+      " reads in flight and reading files on the thread pool from now on.");
+  for (auto& request : failed)
+    finish(std::move(request));
+  // Pass what is still queued to the thread pool.
+  submit();
+}
+
+void AsyncFileReader::reap_completions()
+{
+  Debug(NAMESPACE_DEBUG::init_thread("AsyncFileReader"));
+  std::vector<std::unique_ptr<Request>> finished;
+  std::vector<std::unique_ptr<Request>> unfinished;
+  for (;;)
+  {
+    // Only wait for completions while the kernel is working on something; otherwise
+    // a failing submit would leave this thread blocked in io_uring_enter forever.
+    {
+      std::unique_lock<std::mutex> lock(m_reaper_mutex);
+      m_reaper_condition.wait(lock, [this](){ return m_stop_reaping || !state_t::crat(m_state)->m_in_flight.empty(); });
+      if (m_stop_reaping)
+        break;
+    }
+    if (int error = m_ring->wait(1); error < 0)
+    {
+      // Retrying would fail the same way; give up on io_uring.
+      fail_in_flight(error);
+      break;
+    }
+    for (io_uring_cqe* cqe; (cqe = m_ring->peek_cqe());)
+    {
+      std::unique_ptr<Request> request(reinterpret_cast<Request*>(cqe->user_data));
+      int const res = cqe->res;
+      m_ring->cqe_seen();
+      if (res == -EINTR || res == -EAGAIN)
+        unfinished.push_back(std::move(request));
+      else if (res < 0)
+      {
+        request->m_result.m_error = -res;
+        finished.push_back(std::move(request));
+      }
+      else
+      {
+        request->m_result.m_bytes_read += res;
+        // Continue after a short read, unless the end of the file was reached.
+        if (res > 0 && request->m_result.m_bytes_read < request->m_size)
+          unfinished.push_back(std::move(request));
+        else
+          finished.push_back(std::move(request));
+      }
+    }
+    bool submitted;
+    {
+      state_t::wat state_w(m_state);
+      for (auto& request : finished)
+        state_w->m_in_flight.erase(request.get());
+      // Continue the unfinished reads before starting new ones.
+      for (auto& request : unfinished)
+      {
+        state_w->m_in_flight.erase(request.get());
+        state_w->m_queued.push_front(std::move(request));
+      }
+      submitted = submit_queued(*state_w);
+    }
+    unfinished.clear();
+    for (auto& request : finished)
+      finish(std::move(request));
+    finished.clear();
+    if (!submitted)
+      submit();         // io_uring failed; read what is left on the thread pool.
+  }
+}
+
+//static
+void AsyncFileReader::blocking_read(Request& request)
+{
+  Result& result = request.m_result;
+  while (result.m_bytes_read < request.m_size)
+  {
+    ssize_t const n = pread(request.m_fd, request.m_dst + result.m_bytes_read, request.m_size - result.m_bytes_read, request.m_offset + result.m_bytes_read);
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      result.m_error = errno;
+      break;
+    }
+    if (n == 0)
+      break;
+    result.m_bytes_read += n;
+  }
+}
+
+void AsyncFileReader::finish(std::unique_ptr<Request> request)
+{
+  if (request->m_fd >= 0)
+    close(request->m_fd);
+  if (request->m_callback)
+    request->m_callback(request->m_result);
+  if (m_outstanding.fetch_sub(1, std::memory_order_acq_rel) == 1)
+  {
+    std::lock_guard<std::mutex> lock(m_idle_mutex);
+    m_idle_condition.notify_all();
+  }
+}
+
+} // namespace vulkan
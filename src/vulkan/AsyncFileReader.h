@@ -0,0 +1,148 @@
+#pragma once
+
+#include "threadpool/AIQueueHandle.h"
+#include "threadsafe/aithreadsafe.h"
+#include "statefultask/AIStatefulTask.h"
+#include <boost/intrusive_ptr.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+namespace vk_utils {
+class IoUring;
+} // namespace vk_utils
+
+namespace vulkan {
+
+// AsyncFileReader
+//
+// Reads files without blocking the calling thread, using io_uring when the kernel supports it and
+// the thread pool otherwise.
+//
+// Reads are queued with read() or read_file() and passed to the kernel as one batch by submit()
+// (or as soon as a full submission queue worth is queued). They read straight into memory that is
+// provided by the caller, for example a mapped staging buffer. Memory that is read into often can be
+// registered with register_buffers(), which saves the kernel from pinning the pages for every read.
+//
+// Opening the file (and, for read_file, getting its size) is done synchronously by read(), only the
+// reading of the data itself is asynchronous.
+//
+// Completion is reported either by calling a callback or by signalling a task. With io_uring that
+// happens on a dedicated completion thread that does nothing but wait for completions, so the
+// callback should be short (as in: signal a task). Without io_uring it happens on the thread pool
+// thread that did the read.
+//
+// If io_uring_enter fails (other than being interrupted by a signal) io_uring is abandoned. When
+// waiting for completions failed, the reads that the kernel was working on fail with that error.
+// Everything that is still queued, or queued later, is read on the thread pool.
+//
+class AsyncFileReader
+{
+ public:
+  struct Result
+  {
+    size_t m_bytes_read = 0;                    // The number of bytes read (less than requested if the end of the file was reached).
+    int m_error = 0;                            // Zero, or the errno value of the failure.
+  };
+
+  using callback_type = std::function<void(Result const&)>;
+
+  static constexpr unsigned s_default_queue_depth = 256;
+
+ private:
+  struct Request
+  {
+    int m_fd;
+    std::byte* m_dst;
+    size_t m_size;
+    uint64_t m_offset;
+    int m_buffer_index;                         // The index of the registered buffer that contains [m_dst, m_dst + m_size), or -1.
+    Result m_result;
+    callback_type m_callback;
+  };
+
+  struct State
+  {
+    std::deque<std::unique_ptr<Request>> m_queued;      // Requests that were not passed to the kernel yet.
+    std::vector<std::span<std::byte>> m_registered_buffers;
+    std::unordered_set<Request*> m_in_flight;           // The requests that the kernel is working on.
+  };
+  using state_t = aithreadsafe::Wrapper<State, aithreadsafe::policy::Primitive<std::mutex>>;
+
+  AIQueueHandle m_fallback_queue;               // The thread pool queue to do the reads on if io_uring isn't available.
+  std::unique_ptr<vk_utils::IoUring> m_ring;    // Null if io_uring isn't used.
+  std::atomic_bool m_io_uring_failed = false;   // Set when io_uring_enter failed; from then on the thread pool is used.
+  state_t m_state;
+  std::atomic<unsigned> m_outstanding = 0;      // The number of reads that were queued but did not complete yet.
+  std::mutex m_idle_mutex;
+  std::condition_variable m_idle_condition;     // Notified when m_outstanding drops to zero.
+  std::mutex m_reaper_mutex;
+  std::condition_variable m_reaper_condition;   // Notified when reads were passed to the kernel, or when m_stop_reaping was set.
+  bool m_stop_reaping = false;                  // Protected by m_reaper_mutex.
+  std::thread m_completion_thread;
+
+ public:
+  // Use io_uring with a submission queue of queue_depth entries if use_io_uring is true and the
+  // kernel supports it; otherwise read on the threads of fallback_queue.
+  AsyncFileReader(AIQueueHandle fallback_queue, bool use_io_uring = true, unsigned queue_depth = s_default_queue_depth);
+  // Waits for all reads that are in flight.
+  ~AsyncFileReader();
+
+  bool uses_io_uring() const { return m_ring && !m_io_uring_failed.load(std::memory_order_acquire); }
+
+  // Register memory regions that reads go into (replacing any previous registration).
+  // May only be called while no reads are in flight. Returns false if the kernel refused.
+  bool register_buffers(std::vector<std::span<std::byte>> buffers);
+
+  // Queue a read of size bytes at offset of the file at path into dst; callback is called when it finished.
+  void read(std::filesystem::path const& path, std::byte* dst, size_t size, uint64_t offset, callback_type callback);
+
+  // Same, but store the result in result and signal condition of task when finished.
+  void read(std::filesystem::path const& path, std::byte* dst, size_t size, uint64_t offset,
+      Result& result, boost::intrusive_ptr<AIStatefulTask> task, AIStatefulTask::condition_type condition);
+
+  // Queue a read of the whole file at path into data, which is resized to the size of the file.
+  // data must not be used until callback is called.
+  void read_file(std::filesystem::path const& path, std::vector<std::byte>& data, callback_type callback);
+
+  // Read the whole file at path into data, blocking the calling thread until it is read.
+  // Must not be called from a completion callback.
+  Result read_file(std::filesystem::path const& path, std::vector<std::byte>& data);
+
+  // Pass all queued reads to the kernel (or thread pool).
+  void submit();
+
+  // Block until all reads finished.
+  void wait_idle();
+
+ private:
+  // Queue a read from the open file fd (which is closed when the read finished); submits if a full batch is queued.
+  void queue(int fd, std::byte* dst, size_t size, uint64_t offset, callback_type&& callback);
+  // Open the file at path for reading and resize data to its size. Returns the file descriptor, or -1 with errno set.
+  static int open_file(std::filesystem::path const& path, std::vector<std::byte>& data);
+  // Put as many queued requests in the submission queue as fit. Returns true if anything was added.
+  bool fill_submission_queue(State& state);
+  // Pass as many queued requests to the kernel as possible. Returns false if io_uring failed,
+  // in which case the requests that the kernel did not take are in state.m_queued again.
+  bool submit_queued(State& state);
+  // Called when waiting for completions failed: fail all reads in flight and switch to the thread pool.
+  void fail_in_flight(int error);
+  // The main loop of m_completion_thread.
+  void reap_completions();
+  // Read request with pread(2) on the calling thread.
+  static void blocking_read(Request& request);
+  // Close the file of a finished request and call its callback.
+  void finish(std::unique_ptr<Request> request);
+};
+
+} // namespace vulkan
@@ -18,10 +18,11 @@ struct Attachment : public memory::Image
       vk::Extent2D extent,
       vulkan::ImageViewKind const& image_view_kind,
       VmaAllocationCreateFlags vma_allocation_create_flags,
-      vk::MemoryPropertyFlagBits memory_property
+      vk::MemoryPropertyFlagBits memory_property,
+      memory::ImagePool* image_pool             // If non-null, the image is acquired from (and later released to) this pool.
       COMMA_CWDEBUG_ONLY(Ambifix const& ambifix)) :
     memory::Image(logical_device, extent, image_view_kind,
-        { .properties = memory_property, .vma_allocation_create_flags = vma_allocation_create_flags }
+        { .properties = memory_property, .vma_allocation_create_flags = vma_allocation_create_flags, .image_pool = image_pool }
         COMMA_CWDEBUG_ONLY(ambifix)),
     m_image_view(logical_device->create_image_view(m_vh_image, image_view_kind
         COMMA_CWDEBUG_ONLY(".m_image_view" + ambifix)))
@@ -0,0 +1,89 @@
+#include "sys.h"
+#include "DynamicResolution.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include "debug.h"
+
+namespace vulkan {
+
+DynamicResolution::DynamicResolution(Settings const& settings) : m_settings(settings), m_scale(settings.max_scale)
+{
+  // Nonsensical settings.
+  ASSERT(0.0f < m_settings.min_scale && m_settings.min_scale <= m_settings.max_scale);
+  ASSERT(0.0f < m_settings.scale_step && 0.0f < m_settings.headroom);
+  ASSERT(0.0f < m_settings.smoothing && m_settings.smoothing <= 1.0f);
+}
+
+void DynamicResolution::reset()
+{
+  m_smoothed_gpu_ms = m_smoothed_cpu_ms = -1.0f;
+  m_number_of_samples = 0;
+}
+
+float DynamicResolution::quantize_down(float scale) const
+{
+  // The small epsilon prevents that a value that is (mathematically) a multiple of scale_step is rounded down one step.
+  float const quantized = std::floor(scale / m_settings.scale_step + 1e-4f) * m_settings.scale_step;
+  return std::clamp(quantized, m_settings.min_scale, m_settings.max_scale);
+}
+
+bool DynamicResolution::update(float cpu_frame_time_ms, float gpu_frame_time_ms)
+{
+  // Frames without GPU timing, and the frames that were still rendered at the old scale, are ignored.
+  if (gpu_frame_time_ms < 0.0f)
+    return false;
+  if (m_cooldown > 0)
+  {
+    --m_cooldown;
+    return false;
+  }
+
+  if (m_number_of_samples++ == 0)
+  {
+    m_smoothed_gpu_ms = gpu_frame_time_ms;
+    m_smoothed_cpu_ms = cpu_frame_time_ms;
+  }
+  else
+  {
+    float const alpha = m_settings.smoothing;
+    m_smoothed_gpu_ms += alpha * (gpu_frame_time_ms - m_smoothed_gpu_ms);
+    m_smoothed_cpu_ms += alpha * (cpu_frame_time_ms - m_smoothed_cpu_ms);
+  }
+  // Don't act on a moving average that is mostly determined by its first sample.
+  if (m_number_of_samples * m_settings.smoothing < 1.0f)
+    return false;
+
+  float const aimed_gpu_ms = m_settings.headroom * m_settings.target_frame_time_ms;
+  float const ratio = m_smoothed_gpu_ms / aimed_gpu_ms;
+  if (std::abs(ratio - 1.0f) <= m_settings.deadband)
+    return false;
+  // Lowering the resolution doesn't help when we're CPU bound.
+  if (ratio > 1.0f && m_smoothed_cpu_ms > m_settings.target_frame_time_ms)
+    return false;
+
+  // The largest scale that is predicted to keep the GPU time at or below the aimed time.
+  float desired_scale = m_scale / std::sqrt(ratio);
+  desired_scale = std::clamp(desired_scale, m_scale * (1.0f - m_settings.max_relative_change), m_scale * (1.0f + m_settings.max_relative_change));
+  float const new_scale = quantize_down(desired_scale);
+  if (new_scale == m_scale)
+    return false;
+
+  Dout(dc::vulkan, "DynamicResolution: GPU " << m_smoothed_gpu_ms << " ms, CPU " << m_smoothed_cpu_ms << " ms; scale " << m_scale << " --> " << new_scale);
+  m_scale = new_scale;
+  ++m_number_of_changes;
+  m_cooldown = m_settings.cooldown_frames;
+  reset();
+  return true;
+}
+
+void DynamicResolution::print_on(std::ostream& os) const
+{
+  os << "{m_scale:" << m_scale <<
+      ", m_smoothed_gpu_ms:" << m_smoothed_gpu_ms <<
+      ", m_smoothed_cpu_ms:" << m_smoothed_cpu_ms <<
+      ", m_cooldown:" << m_cooldown <<
+      ", m_number_of_changes:" << m_number_of_changes << '}';
+}
+
+} // namespace vulkan
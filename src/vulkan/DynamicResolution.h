@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+
+namespace vulkan {
+
+// The parameters of DynamicResolution.
+struct DynamicResolutionSettings
+{
+  float target_frame_time_ms = 1000.0f / 60;  // The frame time that we want to achieve.
+  float headroom = 0.9f;                      // Aim at this fraction of target_frame_time_ms for the GPU time.
+  float min_scale = 0.5f;                     // The smallest allowed scale (per axis).
+  float max_scale = 1.0f;                     // The largest allowed scale (per axis).
+  float scale_step = 1.0f / 32;               // The scale is always a multiple of this value.
+  float deadband = 0.08f;                     // Don't change the scale while the GPU time is within this fraction of the aimed time.
+  float max_relative_change = 0.15f;          // The scale changes by at most this fraction per step.
+  float smoothing = 0.2f;                     // Weight of a new measurement in the moving average.
+  int cooldown_frames = 4;                    // The number of measurements to ignore after a change (at least the number of frames in flight).
+};
+
+// DynamicResolution
+//
+// Controller for the resolution scale of the offscreen scene target of a window (see SynchronousWindow::use_dynamic_resolution).
+//
+// update() must be called once per frame with the measured CPU and GPU time of a completed frame.
+// The GPU cost of rendering the scene is roughly proportional to the number of pixels, thus to scale²;
+// the controller aims at a GPU time of `headroom * target_frame_time_ms` and picks the largest scale
+// that is predicted to stay below that (predicted_gpu_time = smoothed_gpu_time * (new_scale / scale)²).
+// If there is a fixed (resolution independent) part in the GPU cost then lowering the scale gains
+// less than predicted, so convergence happens from above in a few steps, while raising the scale
+// costs less than predicted: it never overshoots.
+//
+// The CPU time doesn't depend on the scale: if the frame is CPU bound then lowering the resolution
+// doesn't make it any faster, so the scale is not lowered in that case.
+//
+// Oscillation is prevented by
+// - an exponential moving average of the measured times,
+// - a deadband around the aimed GPU time in which the scale isn't changed,
+// - quantization of the scale (scale_step),
+// - a cooldown after every change (the measurements lag behind by the number of frames in flight),
+//   after which the moving averages are restarted and need 1/smoothing new measurements,
+// - a maximum relative change per step.
+//
+class DynamicResolution
+{
+ public:
+  using Settings = DynamicResolutionSettings;
+
+ private:
+  Settings m_settings;
+  float m_scale;                                // The current scale (per axis), in the range [min_scale, max_scale].
+  float m_smoothed_gpu_ms = -1.0f;              // Moving average of the GPU frame time, or negative when there are no measurements yet.
+  float m_smoothed_cpu_ms = -1.0f;              // Moving average of the CPU frame time, or negative when there are no measurements yet.
+  int m_cooldown = 0;                           // The number of measurements to ignore after a change (they were rendered at the old scale).
+  int m_number_of_samples = 0;                  // The number of measurements in the moving averages.
+  uint64_t m_number_of_changes = 0;             // The number of times that update() returned true.
+
+ public:
+  DynamicResolution(Settings const& settings = {});
+
+  // Feed the measured times (in milliseconds) of the last completed frame.
+  // A negative gpu_frame_time_ms means that the GPU time of this frame is not known; such frames are ignored.
+  // Returns true if the scale changed.
+  bool update(float cpu_frame_time_ms, float gpu_frame_time_ms);
+
+  // Forget all measurements (for example after the window was resized); the scale is kept.
+  void reset();
+
+  // Accessors.
+  Settings const& settings() const { return m_settings; }
+  float scale() const { return m_scale; }
+  float smoothed_gpu_frame_time_ms() const { return m_smoothed_gpu_ms; }
+  float smoothed_cpu_frame_time_ms() const { return m_smoothed_cpu_ms; }
+  uint64_t number_of_changes() const { return m_number_of_changes; }
+
+  // Return full_size scaled by the current scale, rounded to the nearest integer, but at least 1.
+  uint32_t scaled(uint32_t full_size) const
+  {
+    uint32_t const size = static_cast<uint32_t>(full_size * m_scale + 0.5f);
+    return size == 0 ? 1 : size;
+  }
+
+ private:
+  float quantize_down(float scale) const;
+
+ public:
+  void print_on(std::ostream& os) const;
+  friend std::ostream& operator<<(std::ostream& os, DynamicResolution const& dynamic_resolution)
+  {
+    dynamic_resolution.print_on(os);
+    return os;
+  }
+};
+
+} // namespace vulkan
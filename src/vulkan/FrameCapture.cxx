@@ -0,0 +1,308 @@
+#include "sys.h"
+#include "FrameCapture.h"
+#include "SynchronousWindow.h"
+#include "Application.h"
+#include "AsyncTask.h"
+#include "vk_utils/PngWriter.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+#include "debug.h"
+
+namespace task {
+
+// Writes the pixels of one slot of a FrameCapture to disk, on the thread pool.
+class EncodeFrameCapture final : public vulkan::AsyncTask
+{
+ private:
+  vulkan::FrameCapture* m_frame_capture;
+  vulkan::FrameCapture::Slot* m_slot;
+  SynchronousWindow* m_owning_window;   // Reset when we failed to increment its task counter gate.
+
+ protected:
+  using direct_base_type = vulkan::AsyncTask;
+
+  // The different states of the stateful task.
+  enum encode_frame_capture_state_type {
+    EncodeFrameCapture_start = direct_base_type::state_end
+  };
+
+ public:
+  // One beyond the largest state of this task.
+  static constexpr state_type state_end = EncodeFrameCapture_start + 1;
+
+  EncodeFrameCapture(vulkan::FrameCapture* frame_capture, vulkan::FrameCapture::Slot* slot, SynchronousWindow* owning_window COMMA_CWDEBUG_ONLY(bool debug)) :
+    direct_base_type(CWDEBUG_ONLY(debug)), m_frame_capture(frame_capture), m_slot(slot), m_owning_window(owning_window) { }
+
+ protected:
+  // Call finish() (or abort()), not delete.
+  ~EncodeFrameCapture() override = default;
+
+  char const* state_str_impl(state_type run_state) const override
+  {
+    switch (run_state)
+    {
+      AI_CASE_RETURN(EncodeFrameCapture_start);
+    }
+    AI_NEVER_REACHED
+  }
+
+  char const* task_name_impl() const override
+  {
+    return "EncodeFrameCapture";
+  }
+
+  void initialize_impl() override
+  {
+    set_state(EncodeFrameCapture_start);
+    try
+    {
+      // The window may not be destructed (taking the mapped buffer with it) while we're reading from it.
+      m_owning_window->m_task_counter_gate.increment();
+    }
+    catch (std::exception const&)
+    {
+      m_owning_window = nullptr;        // Stop finish_impl from calling decrement().
+      abort();
+    }
+  }
+
+  void finish_impl() override
+  {
+    if (m_owning_window)
+      m_owning_window->m_task_counter_gate.decrement();
+  }
+
+  void multiplex_impl(state_type run_state) override
+  {
+    switch (run_state)
+    {
+      case EncodeFrameCapture_start:
+        m_frame_capture->encode(*m_slot);
+        finish();
+        break;
+    }
+  }
+};
+
+} // namespace task
+
+namespace vulkan {
+
+void FrameCapture::create(task::SynchronousWindow* owning_window, LogicalDevice const* logical_device COMMA_CWDEBUG_ONLY(Ambifix const& ambifix))
+{
+  DoutEntering(dc::vulkan, "FrameCapture::create(" << owning_window << ", " << logical_device << ")");
+  m_owning_window = owning_window;
+  m_logical_device = logical_device;
+  Debug(m_ambifix = ambifix);
+}
+
+void FrameCapture::request(std::filesystem::path path, Encoding encoding)
+{
+  DoutEntering(dc::vulkan, "FrameCapture::request(" << path << ", " << static_cast<int>(encoding) << ")");
+  requests_t::wat requests_w(m_requests);
+  requests_w->m_single.push_back({ std::move(path), encoding });
+}
+
+void FrameCapture::set_continuous(std::filesystem::path directory, Encoding encoding)
+{
+  DoutEntering(dc::vulkan, "FrameCapture::set_continuous(" << directory << ", " << static_cast<int>(encoding) << ")");
+  std::error_code error;
+  if (!directory.empty() && !std::filesystem::create_directories(directory, error) && error)
+  {
+    Dout(dc::warning, "FrameCapture: can't create directory " << directory << ": " << error.message());
+    return;
+  }
+  requests_t::wat requests_w(m_requests);
+  requests_w->m_continuous_directory = std::move(directory);
+  requests_w->m_continuous_encoding = encoding;
+}
+
+bool FrameCapture::next_request(Request& request_out)
+{
+  requests_t::wat requests_w(m_requests);
+  if (!requests_w->m_single.empty())
+  {
+    request_out = std::move(requests_w->m_single.front());
+    requests_w->m_single.pop_front();
+    return true;
+  }
+  if (requests_w->m_continuous_directory.empty())
+    return false;
+  uint64_t const frame = m_continuous_frame++;
+  char filename[32];
+  std::snprintf(filename, sizeof(filename), "frame_%06" PRIu64 ".%s", frame, requests_w->m_continuous_encoding == Encoding::png ? "png" : "raw");
+  request_out = { requests_w->m_continuous_directory / filename, requests_w->m_continuous_encoding };
+  return true;
+}
+
+bool FrameCapture::drop_continuous_frame()
+{
+  requests_t::wat requests_w(m_requests);
+  // Single requests are kept until there is a free slot; they would have been taken before a continuous frame anyway.
+  if (!requests_w->m_single.empty() || requests_w->m_continuous_directory.empty())
+    return false;
+  // Continuous capture skips this frame (the number in the filename still increments).
+  ++m_continuous_frame;
+  return true;
+}
+
+void FrameCapture::record(vk::CommandBuffer vh_command_buffer, vk::Image vh_swapchain_image, vk::Extent2D extent, vk::Format format)
+{
+  // Find a free slot; never wait for one.
+  auto slot = std::find_if(m_slots.begin(), m_slots.end(), [](Slot const& slot){ return slot.m_state.load(std::memory_order::acquire) == slot_free; });
+  if (slot == m_slots.end())
+  {
+    if (drop_continuous_frame())
+    {
+      Dout(dc::warning, "FrameCapture: all readback buffers are in use; not capturing this frame.");
+      m_dropped.fetch_add(1, std::memory_order::relaxed);
+    }
+    return;
+  }
+
+  Request request;
+  if (!next_request(request))
+    return;
+
+  DoutEntering(dc::vkframe, "FrameCapture::record(" << vh_command_buffer << ", " << vh_swapchain_image << ", " << extent << ", " << vk::to_string(format) << ")");
+
+  bool swap_red_blue;
+  switch (format)
+  {
+    case vk::Format::eB8G8R8A8Unorm:
+    case vk::Format::eB8G8R8A8Srgb:
+      swap_red_blue = true;
+      break;
+    case vk::Format::eR8G8B8A8Unorm:
+    case vk::Format::eR8G8B8A8Srgb:
+    case vk::Format::eA8B8G8R8UnormPack32:
+    case vk::Format::eA8B8G8R8SrgbPack32:
+      swap_red_blue = false;
+      break;
+    default:
+      Dout(dc::warning, "FrameCapture: swapchain format " << vk::to_string(format) << " is not supported; not capturing " << request.m_path);
+      return;
+  }
+
+  vk::DeviceSize const size = static_cast<vk::DeviceSize>(extent.width) * extent.height * 4;
+  if (slot->m_buffer.m_size < size)
+  {
+    // (Re)allocate the buffer. This only happens for the first captures and after the window grew.
+    // Use cached memory: the host reads every byte.
+    slot->m_buffer = memory::StagingBuffer(m_logical_device, size
+        COMMA_CWDEBUG_ONLY(".m_slots[" + std::to_string(slot - m_slots.begin()) + "].m_buffer" + m_ambifix),
+        { .usage = vk::BufferUsageFlagBits::eTransferDst,
+          .properties = vk::MemoryPropertyFlagBits::eHostVisible,
+          .vma_allocation_create_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT });
+  }
+  slot->m_extent = extent;
+  slot->m_swap_red_blue = swap_red_blue;
+  slot->m_path = std::move(request.m_path);
+  slot->m_encoding = request.m_encoding;
+  slot->m_state.store(slot_recorded, std::memory_order::relaxed);
+
+  vk::ImageSubresourceRange const subresource_range{ .aspectMask = vk::ImageAspectFlagBits::eColor, .baseMipLevel = 0, .levelCount = 1, .baseArrayLayer = 0, .layerCount = 1 };
+
+  // Wait for the last render pass to finish writing the swapchain image.
+  vk::ImageMemoryBarrier const to_transfer_barrier{
+    .srcAccessMask = vk::AccessFlagBits::eColorAttachmentWrite,
+    .dstAccessMask = vk::AccessFlagBits::eTransferRead,
+    .oldLayout = vk::ImageLayout::ePresentSrcKHR,
+    .newLayout = vk::ImageLayout::eTransferSrcOptimal,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .image = vh_swapchain_image,
+    .subresourceRange = subresource_range
+  };
+  vh_command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eTransfer,
+      {}, {}, {}, to_transfer_barrier);
+
+  // Tightly packed rows.
+  vk::BufferImageCopy const region{
+    .bufferOffset = 0,
+    .bufferRowLength = 0,
+    .bufferImageHeight = 0,
+    .imageSubresource = { .aspectMask = vk::ImageAspectFlagBits::eColor, .mipLevel = 0, .baseArrayLayer = 0, .layerCount = 1 },
+    .imageOffset = {},
+    .imageExtent = { extent.width, extent.height, 1 }
+  };
+  vh_command_buffer.copyImageToBuffer(vh_swapchain_image, vk::ImageLayout::eTransferSrcOptimal, slot->m_buffer.m_vh_buffer, region);
+
+  // Return the swapchain image to the presentation layout (the semaphore that presentKHR waits for covers the
+  // execution dependency), and make the copy available to the host.
+  vk::ImageMemoryBarrier const to_present_barrier{
+    .srcAccessMask = vk::AccessFlagBits::eNoneKHR,
+    .dstAccessMask = vk::AccessFlagBits::eNoneKHR,
+    .oldLayout = vk::ImageLayout::eTransferSrcOptimal,
+    .newLayout = vk::ImageLayout::ePresentSrcKHR,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .image = vh_swapchain_image,
+    .subresourceRange = subresource_range
+  };
+  vk::BufferMemoryBarrier const to_host_barrier{
+    .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+    .dstAccessMask = vk::AccessFlagBits::eHostRead,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .buffer = slot->m_buffer.m_vh_buffer,
+    .offset = 0,
+    .size = size
+  };
+  vh_command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost | vk::PipelineStageFlagBits::eBottomOfPipe,
+      {}, {}, to_host_barrier, to_present_barrier);
+}
+
+void FrameCapture::submitted(uint64_t frame_value)
+{
+  for (Slot& slot : m_slots)
+    if (slot.m_state.load(std::memory_order::relaxed) == slot_recorded)
+    {
+      slot.m_frame_value = frame_value;
+      slot.m_state.store(slot_in_flight, std::memory_order::relaxed);
+    }
+}
+
+void FrameCapture::poll(uint64_t completed_value)
+{
+  for (Slot& slot : m_slots)
+  {
+    if (slot.m_state.load(std::memory_order::relaxed) != slot_in_flight || slot.m_frame_value > completed_value)
+      continue;
+    Dout(dc::vkframe, "FrameCapture: frame " << slot.m_frame_value << " completed; encoding " << slot.m_path);
+    // Make the device writes visible to the host (this does nothing for host coherent memory).
+    m_logical_device->invalidate_mapped_allocation(slot.m_buffer.m_vh_allocation, 0, VK_WHOLE_SIZE);
+    // Release: the encode task must see m_extent etc.
+    slot.m_state.store(slot_encoding, std::memory_order::release);
+    statefultask::create<task::EncodeFrameCapture>(this, &slot, m_owning_window COMMA_CWDEBUG_ONLY(false))->
+        run(Application::instance().low_priority_queue());
+  }
+}
+
+void FrameCapture::encode(Slot& slot)
+{
+  ZoneScopedN("FrameCapture::encode");
+  ASSERT(slot.m_state.load(std::memory_order::acquire) == slot_encoding);
+  uint32_t const width = slot.m_extent.width;
+  uint32_t const height = slot.m_extent.height;
+  std::byte const* pixels = static_cast<std::byte const*>(slot.m_buffer.m_pointer);
+  {
+    std::ofstream file(slot.m_path, std::ios::binary);
+    if (slot.m_encoding == Encoding::png)
+      vk_utils::write_png(file, width, height, 4, pixels, width * 4, slot.m_swap_red_blue);
+    else
+      vk_utils::write_raw(file, width, height, 4, pixels, width * 4, slot.m_swap_red_blue);
+    file.close();
+    if (file)
+      m_captured.fetch_add(1, std::memory_order::relaxed);
+    else
+      Dout(dc::warning, "FrameCapture: failed to write " << slot.m_path);
+  }
+  slot.m_path.clear();
+  // Release: record() may reuse the buffer after it sees that the slot is free.
+  slot.m_state.store(slot_free, std::memory_order::release);
+}
+
+} // namespace vulkan
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "memory/StagingBuffer.h"
+#include "debug/DebugSetName.h"
+#include "threadsafe/aithreadsafe.h"
+#include <vulkan/vulkan.hpp>
+#include <array>
+#include <atomic>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include "debug.h"
+
+namespace task {
+class SynchronousWindow;
+class EncodeFrameCapture;
+} // namespace task
+
+namespace vulkan {
+
+class LogicalDevice;
+
+// FrameCapture
+//
+// Reads back swapchain images for screenshots and continuous frame capture without stalling the render loop.
+//
+// The window records a copy of the swapchain image into a host-visible buffer at the end of the command
+// buffer of a frame that must be captured (see SynchronousWindow::record_frame_capture). Such a buffer is
+// only read once the frame semaphore reached the value of that frame, which is already known to be the case
+// when its frame resources are reused (see start_frame): detecting completion costs nothing. The pixels are
+// then written to disk by a task on the thread pool.
+//
+// There is a small ring of buffers. If all of them are still in use (the disk can't keep up with continuous
+// capture) then the frame is not captured, rather than stalling the render loop; see dropped(). Requests of
+// a single frame are kept until a slot is free.
+//
+// Only 8-bit, four channel swapchain formats (RGBA/BGRA) are supported.
+//
+class FrameCapture
+{
+ public:
+  enum class Encoding { png, raw };
+
+  static constexpr int number_of_slots = 3;
+
+ private:
+  friend class task::EncodeFrameCapture;
+
+  enum SlotState {
+    slot_free,                            // Can be used by record().
+    slot_recorded,                        // The copy was recorded in the current command buffer.
+    slot_in_flight,                       // The command buffer was submitted; waiting for m_frame_value.
+    slot_encoding                         // The pixels are being written to disk by an EncodeFrameCapture task.
+  };
+
+  struct Slot
+  {
+    memory::StagingBuffer m_buffer;       // Host-visible, mapped; m_buffer.m_pointer points to the pixels (tightly packed).
+    std::atomic<SlotState> m_state{slot_free};
+    vk::Extent2D m_extent;
+    bool m_swap_red_blue;                 // Set if the swapchain format is BGRA.
+    uint64_t m_frame_value;               // The value of the frame semaphore that signals completion of the copy.
+    std::filesystem::path m_path;
+    Encoding m_encoding;
+  };
+
+  struct Request
+  {
+    std::filesystem::path m_path;
+    Encoding m_encoding;
+  };
+
+  struct Requests
+  {
+    std::deque<Request> m_single;                       // Pending capture_frame requests.
+    std::filesystem::path m_continuous_directory;       // If not empty, capture every frame into this directory.
+    Encoding m_continuous_encoding;
+  };
+
+  using requests_t = aithreadsafe::Wrapper<Requests, aithreadsafe::policy::Primitive<std::mutex>>;
+
+  task::SynchronousWindow* m_owning_window = nullptr;
+  LogicalDevice const* m_logical_device = nullptr;
+  std::array<Slot, number_of_slots> m_slots;
+  requests_t m_requests;
+  uint64_t m_continuous_frame = 0;                      // The number used in the file name of the next continuously captured frame.
+  std::atomic<uint64_t> m_captured{0};                  // The number of frames written to disk.
+  std::atomic<uint64_t> m_dropped{0};                   // The number of continuously captured frames that were skipped because no slot was free.
+#ifdef CWDEBUG
+  Ambifix m_ambifix;                                    // Used for the debug names of the buffers.
+#endif
+
+ public:
+  FrameCapture() = default;
+
+  void create(task::SynchronousWindow* owning_window, LogicalDevice const* logical_device COMMA_CWDEBUG_ONLY(Ambifix const& ambifix));
+
+  bool is_created() const { return m_owning_window; }
+
+  // Thread-safe. Capture the next frame that is rendered and write it to path.
+  void request(std::filesystem::path path, Encoding encoding);
+  // Thread-safe. Capture every frame and write it to directory, as frame_000000.png, frame_000001.png etc.
+  // Pass an empty path to stop.
+  void set_continuous(std::filesystem::path directory, Encoding encoding);
+
+  // Called by the render loop, at the end of the command buffer of the current frame, after the last render pass.
+  // The swapchain image must be in layout ePresentSrcKHR, and is left in that layout.
+  void record(vk::CommandBuffer vh_command_buffer, vk::Image vh_swapchain_image, vk::Extent2D extent, vk::Format format);
+  // Called by the render loop after submitting the command buffer of the current frame, that signals frame_value.
+  void submitted(uint64_t frame_value);
+  // Called by the render loop when it is known that the frame semaphore reached completed_value.
+  void poll(uint64_t completed_value);
+
+  // Accessors.
+  uint64_t captured() const { return m_captured.load(std::memory_order::relaxed); }
+  uint64_t dropped() const { return m_dropped.load(std::memory_order::relaxed); }
+
+ private:
+  // Returns true if the current frame must be captured; if so the request is taken and stored in request_out.
+  bool next_request(Request& request_out);
+  // Called when there is no free slot. Returns true if that drops a frame of the continuous capture.
+  bool drop_continuous_frame();
+  // Called by EncodeFrameCapture, on the thread pool.
+  void encode(Slot& slot);
+};
+
+} // namespace vulkan
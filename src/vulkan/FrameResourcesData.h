@@ -3,7 +3,9 @@
 #include "Attachment.h"
 #include "CommandPool.h"
 #include "CommandBuffer.h"
+#include "rendergraph/QueueSchedule.h"
 #include "utils/Vector.h"
+#include <array>
 #include <memory>
 
 namespace vulkan {
@@ -20,8 +22,14 @@ struct FrameResourcesData
   // Command buffers (currently only one).
   handle::CommandBuffer   m_command_buffer;                     // Freed when the command pool is destructed.
 
-  // Fence that signals when all (aka, the last) command buffers have finished.
-  vk::UniqueFence         m_command_buffers_completed;          // This fence should be signaled when the last command buffer used for this frame completed.
+  // Only used when the queue schedule of the render graph uses an async-compute queue (see SynchronousWindow::submit_render_graph).
+  std::unique_ptr<command_pool_type> m_compute_command_pool;    // A command pool of the queue family of the async-compute queue.
+  // One command buffer per batch of each queue (see QueueSchedule::batches), except for the last graphics batch, which uses m_command_buffer.
+  std::array<std::vector<handle::CommandBuffer>, rendergraph::number_of_queue_types> m_batch_command_buffers;
+
+  // The value of the frame timeline semaphore of the window (SynchronousWindow::m_frame_semaphore) that signals
+  // that all (aka, the last) command buffers of the last frame that used these resources have finished.
+  uint64_t                m_command_buffers_completed_value = 0;  // Zero means: never submitted (the semaphore starts at zero).
 
   // Overlapping descriptor set handles.
   vk::UniqueDescriptorSet m_overlapping_descriptor_set;         // Used for resources that need to changed during rendering (e.g. uniform buffers).
@@ -34,11 +42,6 @@ struct FrameResourcesData
       COMMA_CWDEBUG_ONLY(AmbifixOwner const& command_pool_debug_name)) :
     m_attachments(number_of_attachments),
     m_command_pool(logical_device, queue_family COMMA_CWDEBUG_ONLY(command_pool_debug_name)) { }
-
-  ~FrameResourcesData()
-  {
-    Dout(dc::vulkan, "Destroying m_command_buffers_completed " << *m_command_buffers_completed);
-  }
 };
 
 } // namespace vulkan
@@ -0,0 +1,43 @@
+#include "sys.h"
+#include "FrameTimeHistogram.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include "debug.h"
+
+namespace vulkan {
+
+void FrameTimeHistogram::add(float ms)
+{
+  if (ms < 0.0f)
+    return;
+  int const bin = std::min(static_cast<int>(ms / bin_width_ms), number_of_bins - 1);
+  ++m_bins[bin];
+  ++m_count;
+  m_sum_ms += ms;
+  m_max_ms = std::max(m_max_ms, ms);
+}
+
+float FrameTimeHistogram::percentile(float p) const
+{
+  if (m_count == 0)
+    return 0.0f;
+  uint64_t const target = std::max<uint64_t>(1, std::ceil(p * m_count));
+  uint64_t seen = 0;
+  for (int bin = 0; bin < number_of_bins - 1; ++bin)
+  {
+    seen += m_bins[bin];
+    if (seen >= target)
+      return (bin + 1) * bin_width_ms;
+  }
+  // The sample is in the overflow bin.
+  return m_max_ms;
+}
+
+void FrameTimeHistogram::print_on(std::ostream& os) const
+{
+  os << "{count:" << m_count << ", mean:" << mean() << " ms, p50:" << percentile(0.5f) << " ms, p90:" << percentile(0.9f) <<
+    " ms, p99:" << percentile(0.99f) << " ms, max:" << m_max_ms << " ms}";
+}
+
+} // namespace vulkan
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <iosfwd>
+
+namespace vulkan {
+
+// FrameTimeHistogram
+//
+// The distribution of a per-frame time (in milliseconds), in bins of bin_width_ms up till max_ms;
+// larger values are counted in the last bin. Used to compare the frame time distributions of
+// different configurations (for example, with and without SynchronousWindow::use_present_task):
+// the tail (percentile(0.99)) is usually more telling than the mean.
+//
+class FrameTimeHistogram
+{
+ public:
+  static constexpr float bin_width_ms = 0.25f;
+  static constexpr float max_ms = 100.0f;
+  static constexpr int number_of_bins = static_cast<int>(max_ms / bin_width_ms) + 1;
+
+ private:
+  std::array<uint32_t, number_of_bins> m_bins = {};
+  uint64_t m_count = 0;
+  double m_sum_ms = 0.0;
+  float m_max_ms = 0.0f;
+
+ public:
+  // Add a sample. Negative values are ignored.
+  void add(float ms);
+
+  // Forget all samples.
+  void reset() { *this = FrameTimeHistogram{}; }
+
+  // Returns the smallest upper bin edge below which at least a fraction p of the samples lies; 0 if there are no samples.
+  float percentile(float p) const;
+
+  // Accessors.
+  uint64_t count() const { return m_count; }
+  float mean() const { return m_count ? m_sum_ms / m_count : 0.0f; }
+  float max() const { return m_max_ms; }
+
+  void print_on(std::ostream& os) const;
+};
+
+} // namespace vulkan
@@ -0,0 +1,45 @@
+#include "sys.h"
+#include "GpuFrameTimer.h"
+#include "LogicalDevice.h"
+#include <array>
+
+namespace vulkan {
+
+void GpuFrameTimer::create(LogicalDevice const* logical_device, FrameResourceIndex number_of_frame_resources COMMA_CWDEBUG_ONLY(Ambifix const& ambifix))
+{
+  DoutEntering(dc::vulkan, "GpuFrameTimer::create(" << logical_device << ", " << number_of_frame_resources << ")");
+  // Don't call create() unless timestamps are supported.
+  ASSERT(logical_device->supports_timestamps());
+  m_logical_device = logical_device;
+  m_query_pool = logical_device->create_timestamp_query_pool(2 * number_of_frame_resources.get_value()
+      COMMA_CWDEBUG_ONLY(".m_query_pool" + ambifix));
+  m_timestamp_period_ms = logical_device->timestamp_period() * 1e-6f;
+  m_written.resize(number_of_frame_resources.get_value(), false);
+}
+
+void GpuFrameTimer::write_begin_timestamp(vk::CommandBuffer vh_command_buffer, FrameResourceIndex index)
+{
+  uint32_t const first_query = 2 * index.get_value();
+  // The queries must be reset before they can be written again.
+  vh_command_buffer.resetQueryPool(*m_query_pool, first_query, 2);
+  vh_command_buffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, *m_query_pool, first_query);
+  m_written[index] = false;
+}
+
+void GpuFrameTimer::write_end_timestamp(vk::CommandBuffer vh_command_buffer, FrameResourceIndex index)
+{
+  vh_command_buffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *m_query_pool, 2 * index.get_value() + 1);
+  m_written[index] = true;
+}
+
+float GpuFrameTimer::get_frame_time_ms(FrameResourceIndex index) const
+{
+  if (!m_query_pool || !m_written[index])
+    return -1.0f;
+  std::array<uint64_t, 2> timestamps;
+  if (!m_logical_device->get_timestamps(*m_query_pool, 2 * index.get_value(), 2, timestamps.data()) || timestamps[1] < timestamps[0])
+    return -1.0f;
+  return (timestamps[1] - timestamps[0]) * m_timestamp_period_ms;
+}
+
+} // namespace vulkan
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "FrameResourceIndex.h"
+#include "utils/Vector.h"
+#include <vulkan/vulkan.hpp>
+#include "debug.h"
+
+namespace vulkan {
+
+// Forward declaration.
+class LogicalDevice;
+class Ambifix;
+
+// GpuFrameTimer
+//
+// Measures the GPU time of each frame with two timestamp queries per frame resources:
+// one written before the first command of the command buffer and one after the last.
+//
+// The result of a frame is read back when its frame resources are reused, at which point the
+// command buffer has completed; so reading the timestamps never stalls.
+//
+class GpuFrameTimer
+{
+ private:
+  LogicalDevice const* m_logical_device = nullptr;
+  vk::UniqueQueryPool m_query_pool;                             // Two queries per frame resources.
+  float m_timestamp_period_ms = {};                             // The number of milliseconds per timestamp tick.
+  utils::Vector<bool, FrameResourceIndex> m_written;            // Set when both timestamps of these frame resources were written.
+
+ public:
+  GpuFrameTimer() = default;
+
+  // Create the query pool. Only call this if logical_device->supports_timestamps().
+  void create(LogicalDevice const* logical_device, FrameResourceIndex number_of_frame_resources COMMA_CWDEBUG_ONLY(Ambifix const& ambifix));
+
+  bool is_created() const { return static_cast<bool>(m_query_pool); }
+
+  // Call at the start and at the end of recording the command buffer of the frame that uses frame resources index.
+  void write_begin_timestamp(vk::CommandBuffer vh_command_buffer, FrameResourceIndex index);
+  void write_end_timestamp(vk::CommandBuffer vh_command_buffer, FrameResourceIndex index);
+
+  // Return the GPU time, in milliseconds, of the last completed frame that used frame resources index,
+  // or a negative value if that isn't known. Call this only after that frame completed.
+  float get_frame_time_ms(FrameResourceIndex index) const;
+};
+
+} // namespace vulkan
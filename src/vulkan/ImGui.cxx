@@ -5,6 +5,7 @@
 #include "Application.h"
 #include "ImageKind.h"
 #include "InputEvent.h"
+#include "ImGuiFontAtlasCache.h"
 
 #include "memory/DataFeeder.h"
 #include "pipeline/ShaderInputData.h"
@@ -16,6 +17,8 @@
 
 #include <imgui.h>
 #include <xkbcommon/xkbcommon-keysyms.h>
+#include <chrono>
+#include <cstring>
 #include "debug.h"
 #include <Tracy.hpp>
 
@@ -54,37 +57,32 @@ LogicalDevice const* ImGui::logical_device() const
 }
 
 // Define a DataFeeder to read the font texture of imgui.
-struct TexPixelsRGBA32Feeder final : public DataFeeder
+// The alpha values are uploaded as-is into an R8 image; the image view swizzles them into (1, 1, 1, alpha).
+struct TexPixelsAlpha8Feeder final : public DataFeeder
 {
  private:
   unsigned char const* m_TexPixelsAlpha8;       // Stolen ownership from ImFontAtlas::TexPixelsAlpha8.
-  int m_size;                                   // The size of m_TexPixelsAlpha8 in bytes.
+  uint32_t m_size;                              // The size of m_TexPixelsAlpha8 in bytes.
 
  public:
-  TexPixelsRGBA32Feeder(ImFontAtlas* font_atlas) : m_TexPixelsAlpha8(font_atlas->TexPixelsAlpha8), m_size(font_atlas->TexWidth * font_atlas->TexHeight)
+  TexPixelsAlpha8Feeder(ImFontAtlas* font_atlas) : m_TexPixelsAlpha8(font_atlas->TexPixelsAlpha8), m_size(font_atlas->TexWidth * font_atlas->TexHeight)
   {
-    // m_size must fit in an int; but 4 * m_size must fit in an uint32_t.
-    ASSERT(m_size <= 0x3fffffff);
     // Prevent imgui from freeing this allocation.
     font_atlas->TexPixelsAlpha8 = nullptr;
   }
 
-  ~TexPixelsRGBA32Feeder() override
+  ~TexPixelsAlpha8Feeder() override
   {
     // Free the allocation that we borrowed from imgui.
     ::ImGui::MemFree(const_cast<unsigned char*>(m_TexPixelsAlpha8));
   }
 
-  uint32_t chunk_size() const override { return sizeof(unsigned int); }
-  int chunk_count() const override { return m_size; }
-  int next_batch() override { return m_size; }
+  uint32_t chunk_size() const override { return m_size; }
+  int chunk_count() const override { return 1; }
+  int next_batch() override { return 1; }
   void get_chunks(unsigned char* chunk_ptr) override
   {
-    // See ImFontAtlas::GetTexDataAsRGBA32.
-    unsigned char const* src = m_TexPixelsAlpha8;
-    unsigned int* dst = reinterpret_cast<unsigned int*>(chunk_ptr);
-    for (int n = m_size; n > 0; --n)
-      *dst++ = IM_COL32(255, 255, 255, (unsigned int)(*src++));
+    std::memcpy(chunk_ptr, m_TexPixelsAlpha8, m_size);
   }
 };
 
@@ -376,20 +374,35 @@ void ImGui::init(task::SynchronousWindow* owning_window, vk::SampleCountFlagBits
   // Create imgui descriptor set and layout. This must be done before calling upload_texture below.
   create_descriptor_set(CWDEBUG_ONLY(ambifix));
 
-  // Build and load the texture atlas into a texture.
+  // Build the texture atlas, or load it from the cache.
   vk::Extent2D extent;
   {
+    auto const start = std::chrono::steady_clock::now();
+    ImFontAtlas* font_atlas = io.Fonts;
+    // Build() adds the default font when no font was added; do that here so that it is part of the cache key.
+    if (font_atlas->ConfigData.empty())
+      font_atlas->AddFontDefault();
+    ImGuiFontAtlasCache const font_atlas_cache(owning_window->application().path_of(Directory::cache) / "imgui_font_atlas");
+    size_t const key = ImGuiFontAtlasCache::key(font_atlas);
+    bool const cached = font_atlas_cache.load(font_atlas, key);
     int w, h;
     unsigned char* d = nullptr;
-    io.Fonts->GetTexDataAsAlpha8(&d, &w, &h);
+    font_atlas->GetTexDataAsAlpha8(&d, &w, &h);         // This builds the atlas, unless it was loaded from the cache.
+    if (!cached)
+      font_atlas_cache.store(font_atlas, key);
     extent.width = w;
     extent.height = h;
+    Dout(dc::notice, "ImGui font atlas (" << extent << ") " << (cached ? "loaded from the cache" : "built") << " in " <<
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms.");
   }
   ImageKind const imgui_font_image_kind({
-    .format = vk::Format::eR8G8B8A8Unorm,       // This must be a 32bit format (we use TexPixelsRGBA32Feeder).
+    .format = vk::Format::eR8Unorm,             // This must be an 8bit format (we use TexPixelsAlpha8Feeder).
     .usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled
   });
-  ImageViewKind const imgui_font_image_view_kind(imgui_font_image_kind, {});
+  // Sample the alpha values as (1, 1, 1, alpha), which is what ImFontAtlas::GetTexDataAsRGBA32 would have produced.
+  ImageViewKind const imgui_font_image_view_kind(imgui_font_image_kind, {
+    .components = { vk::ComponentSwizzle::eOne, vk::ComponentSwizzle::eOne, vk::ComponentSwizzle::eOne, vk::ComponentSwizzle::eR }
+  });
   SamplerKind const imgui_font_sampler_kind(logical_device(), {});
   // Store a VkDescriptorSet (which is a pointer to an opague struct) as "texture ID".
   ASSERT(sizeof(ImTextureID) == sizeof(void*));
@@ -405,7 +418,7 @@ void ImGui::init(task::SynchronousWindow* owning_window, vk::SampleCountFlagBits
       COMMA_CWDEBUG_ONLY(".m_font_texture" + ambifix));
 
   m_font_texture.upload(extent, imgui_font_image_view_kind, owning_window,
-      std::make_unique<TexPixelsRGBA32Feeder>(std::move(io.Fonts)),
+      std::make_unique<TexPixelsAlpha8Feeder>(std::move(io.Fonts)),
       owning_window, imgui_font_texture_ready);
 
   // Update descriptor set.
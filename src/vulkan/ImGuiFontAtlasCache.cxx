@@ -0,0 +1,355 @@
+#include "sys.h"
+#include "ImGuiFontAtlasCache.h"
+#include <imgui.h>
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/serialization/binary_object.hpp>
+#include <boost/container_hash/hash.hpp>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include <unistd.h>
+#include "debug.h"
+
+namespace vulkan {
+
+namespace {
+
+// Increment this when the layout of the records below changes.
+constexpr unsigned int cache_version = 1;
+
+struct GlyphRecord
+{
+  uint32_t m_codepoint;
+  uint32_t m_colored;
+  uint32_t m_visible;
+  float m_advance_x;
+  float m_x0, m_y0, m_x1, m_y1;
+  float m_u0, m_v0, m_u1, m_v1;
+};
+
+struct CustomRectRecord
+{
+  uint16_t m_width, m_height;
+  uint16_t m_x, m_y;
+  uint32_t m_glyph_id;
+  float m_glyph_advance_x;
+  float m_glyph_offset_x, m_glyph_offset_y;
+  int32_t m_font_index;                         // The index into ImFontAtlas::Fonts, or -1.
+};
+
+struct FontRecord
+{
+  float m_font_size;
+  float m_ascent;
+  float m_descent;
+  uint32_t m_fallback_char;
+  uint32_t m_ellipsis_char;
+  std::vector<GlyphRecord> m_glyphs;
+};
+
+// Read or write a vector of trivially copyable elements as one binary object.
+template<typename Archive, typename T>
+void serialize_vector(Archive& archive, std::vector<T>& elements)
+{
+  static_assert(std::is_trivially_copyable_v<T>);
+  uint64_t size = elements.size();
+  archive & size;
+  if constexpr (Archive::is_loading::value)
+  {
+    // Protect against corrupt files.
+    if (size > (uint64_t{1} << 28) / sizeof(T))
+      throw boost::archive::archive_exception(boost::archive::archive_exception::input_stream_error);
+    elements.resize(size);
+  }
+  archive & boost::serialization::make_binary_object(elements.data(), size * sizeof(T));
+}
+
+struct AtlasRecord
+{
+  uint64_t m_key;
+  int32_t m_tex_width;
+  int32_t m_tex_height;
+  float m_white_pixel_u;
+  float m_white_pixel_v;
+  std::vector<float> m_uv_lines;                // ImFontAtlas::TexUvLines as four floats per width.
+  int32_t m_pack_id_mouse_cursors;
+  int32_t m_pack_id_lines;
+  std::vector<CustomRectRecord> m_custom_rects;
+  std::vector<FontRecord> m_fonts;
+  std::vector<unsigned char> m_pixels;          // TexWidth * TexHeight alpha values.
+
+  template<typename Archive>
+  void serialize(Archive& archive, unsigned int const UNUSED_ARG(version))
+  {
+    archive & m_key & m_tex_width & m_tex_height & m_white_pixel_u & m_white_pixel_v;
+    serialize_vector(archive, m_uv_lines);
+    archive & m_pack_id_mouse_cursors & m_pack_id_lines;
+    serialize_vector(archive, m_custom_rects);
+    uint64_t number_of_fonts = m_fonts.size();
+    archive & number_of_fonts;
+    if constexpr (Archive::is_loading::value)
+    {
+      if (number_of_fonts > 1024)
+        throw boost::archive::archive_exception(boost::archive::archive_exception::input_stream_error);
+      m_fonts.resize(number_of_fonts);
+    }
+    for (FontRecord& font : m_fonts)
+    {
+      archive & font.m_font_size & font.m_ascent & font.m_descent & font.m_fallback_char & font.m_ellipsis_char;
+      serialize_vector(archive, font.m_glyphs);
+    }
+    serialize_vector(archive, m_pixels);
+  }
+};
+
+int font_index(ImFontAtlas const* atlas, ImFont const* font)
+{
+  for (int i = 0; i < atlas->Fonts.Size; ++i)
+    if (atlas->Fonts[i] == font)
+      return i;
+  return -1;
+}
+
+} // namespace
+
+//static
+size_t ImGuiFontAtlasCache::key(ImFontAtlas const* atlas)
+{
+  size_t key = cache_version;
+  boost::hash_combine(key, IMGUI_VERSION_NUM);
+  boost::hash_combine(key, atlas->Flags);
+  boost::hash_combine(key, atlas->TexDesiredWidth);
+  boost::hash_combine(key, atlas->TexGlyphPadding);
+  boost::hash_combine(key, atlas->FontBuilderFlags);
+  for (ImFontConfig const& config : atlas->ConfigData)
+  {
+    boost::hash_combine(key, boost::hash<std::string_view>{}({ static_cast<char const*>(config.FontData), static_cast<size_t>(config.FontDataSize) }));
+    boost::hash_combine(key, config.FontNo);
+    boost::hash_combine(key, config.SizePixels);
+    boost::hash_combine(key, config.OversampleH);
+    boost::hash_combine(key, config.OversampleV);
+    boost::hash_combine(key, config.PixelSnapH);
+    boost::hash_combine(key, config.GlyphExtraSpacing.x);
+    boost::hash_combine(key, config.GlyphExtraSpacing.y);
+    boost::hash_combine(key, config.GlyphOffset.x);
+    boost::hash_combine(key, config.GlyphOffset.y);
+    boost::hash_combine(key, config.GlyphMinAdvanceX);
+    boost::hash_combine(key, config.GlyphMaxAdvanceX);
+    boost::hash_combine(key, config.MergeMode);
+    boost::hash_combine(key, config.FontBuilderFlags);
+    boost::hash_combine(key, config.RasterizerMultiply);
+    boost::hash_combine(key, config.EllipsisChar);
+    boost::hash_combine(key, font_index(atlas, config.DstFont));
+    // The ranges are pairs, terminated by a zero; no ranges means the default ranges.
+    for (ImWchar const* range = config.GlyphRanges; range && *range; ++range)
+      boost::hash_combine(key, *range);
+  }
+  // Rectangles that were added by the application.
+  for (ImFontAtlasCustomRect const& rect : atlas->CustomRects)
+  {
+    boost::hash_combine(key, rect.Width);
+    boost::hash_combine(key, rect.Height);
+    boost::hash_combine(key, rect.GlyphID);
+    boost::hash_combine(key, rect.GlyphAdvanceX);
+    boost::hash_combine(key, rect.GlyphOffset.x);
+    boost::hash_combine(key, rect.GlyphOffset.y);
+    boost::hash_combine(key, font_index(atlas, rect.Font));
+  }
+  return key;
+}
+
+bool ImGuiFontAtlasCache::load(ImFontAtlas* atlas, size_t key) const
+{
+  DoutEntering(dc::vulkan, "ImGuiFontAtlasCache::load(" << atlas << ", " << key << ")");
+
+  // The fonts must not have been built already.
+  ASSERT(!atlas->IsBuilt() && !atlas->TexPixelsAlpha8);
+
+  std::ifstream file(m_filename, std::ios::binary);
+  if (!file)
+  {
+    Dout(dc::vulkan, "No font atlas cache " << m_filename << ".");
+    return false;
+  }
+
+  AtlasRecord record;
+  try
+  {
+    boost::archive::binary_iarchive ia(file);
+    ia & record;
+  }
+  catch (boost::archive::archive_exception const& error)
+  {
+    Dout(dc::warning, "Caught boost::archive::archive_exception \"" << error.what() << "\" while trying to load " << m_filename << ". Ignoring it.");
+    return false;
+  }
+
+  if (record.m_key != key)
+  {
+    Dout(dc::vulkan, "The font atlas cache " << m_filename << " is for different fonts.");
+    return false;
+  }
+
+  // Paranoia: reject anything that doesn't match the fonts that were added.
+  bool consistent = record.m_fonts.size() == static_cast<size_t>(atlas->Fonts.Size) &&
+    record.m_tex_width > 0 && record.m_tex_height > 0 &&
+    record.m_pixels.size() == static_cast<size_t>(record.m_tex_width) * record.m_tex_height &&
+    record.m_uv_lines.size() == 4 * IM_ARRAYSIZE(atlas->TexUvLines);
+  for (CustomRectRecord const& rect : record.m_custom_rects)
+    consistent = consistent && rect.m_font_index >= -1 && rect.m_font_index < atlas->Fonts.Size;
+  if (!consistent)
+  {
+    Dout(dc::warning, "The font atlas cache " << m_filename << " is inconsistent. Ignoring it.");
+    return false;
+  }
+
+  // Restore what ImFontAtlas::Build would have produced.
+  atlas->CustomRects.resize(record.m_custom_rects.size());
+  for (size_t i = 0; i < record.m_custom_rects.size(); ++i)
+  {
+    CustomRectRecord const& in = record.m_custom_rects[i];
+    ImFontAtlasCustomRect& rect = atlas->CustomRects[i];
+    rect.Width = in.m_width;
+    rect.Height = in.m_height;
+    rect.X = in.m_x;
+    rect.Y = in.m_y;
+    rect.GlyphID = in.m_glyph_id;
+    rect.GlyphAdvanceX = in.m_glyph_advance_x;
+    rect.GlyphOffset = ImVec2(in.m_glyph_offset_x, in.m_glyph_offset_y);
+    rect.Font = in.m_font_index < 0 ? nullptr : atlas->Fonts[in.m_font_index];
+  }
+  atlas->PackIdMouseCursors = record.m_pack_id_mouse_cursors;
+  atlas->PackIdLines = record.m_pack_id_lines;
+
+  for (int i = 0; i < atlas->Fonts.Size; ++i)
+  {
+    FontRecord const& in = record.m_fonts[i];
+    ImFont* font = atlas->Fonts[i];
+    font->ContainerAtlas = atlas;
+    font->ConfigData = nullptr;
+    font->ConfigDataCount = 0;
+    for (ImFontConfig& config : atlas->ConfigData)
+      if (config.DstFont == font)
+      {
+        if (!font->ConfigData)
+          font->ConfigData = &config;
+        ++font->ConfigDataCount;
+      }
+    font->FontSize = in.m_font_size;
+    font->Ascent = in.m_ascent;
+    font->Descent = in.m_descent;
+    font->Glyphs.resize(in.m_glyphs.size());
+    for (size_t g = 0; g < in.m_glyphs.size(); ++g)
+    {
+      GlyphRecord const& glyph_in = in.m_glyphs[g];
+      ImFontGlyph& glyph = font->Glyphs[g];
+      glyph.Colored = glyph_in.m_colored;
+      glyph.Visible = glyph_in.m_visible;
+      glyph.Codepoint = glyph_in.m_codepoint;
+      glyph.AdvanceX = glyph_in.m_advance_x;
+      glyph.X0 = glyph_in.m_x0; glyph.Y0 = glyph_in.m_y0; glyph.X1 = glyph_in.m_x1; glyph.Y1 = glyph_in.m_y1;
+      glyph.U0 = glyph_in.m_u0; glyph.V0 = glyph_in.m_v0; glyph.U1 = glyph_in.m_u1; glyph.V1 = glyph_in.m_v1;
+    }
+    font->FallbackChar = static_cast<ImWchar>(in.m_fallback_char);
+    font->EllipsisChar = static_cast<ImWchar>(in.m_ellipsis_char);
+    font->BuildLookupTable();
+  }
+
+  atlas->TexWidth = record.m_tex_width;
+  atlas->TexHeight = record.m_tex_height;
+  atlas->TexUvScale = ImVec2(1.0f / atlas->TexWidth, 1.0f / atlas->TexHeight);
+  atlas->TexUvWhitePixel = ImVec2(record.m_white_pixel_u, record.m_white_pixel_v);
+  for (int i = 0; i < IM_ARRAYSIZE(atlas->TexUvLines); ++i)
+    atlas->TexUvLines[i] = ImVec4(record.m_uv_lines[4 * i], record.m_uv_lines[4 * i + 1], record.m_uv_lines[4 * i + 2], record.m_uv_lines[4 * i + 3]);
+  // ImGui frees this with MemFree (unless ownership is taken over).
+  atlas->TexPixelsAlpha8 = static_cast<unsigned char*>(IM_ALLOC(record.m_pixels.size()));
+  std::memcpy(atlas->TexPixelsAlpha8, record.m_pixels.data(), record.m_pixels.size());
+  atlas->TexReady = true;
+
+  return true;
+}
+
+void ImGuiFontAtlasCache::store(ImFontAtlas const* atlas, size_t key) const
+{
+  DoutEntering(dc::vulkan, "ImGuiFontAtlasCache::store(" << atlas << ", " << key << ")");
+
+  // Only store built atlases.
+  ASSERT(atlas->IsBuilt() && atlas->TexPixelsAlpha8);
+
+  AtlasRecord record;
+  record.m_key = key;
+  record.m_tex_width = atlas->TexWidth;
+  record.m_tex_height = atlas->TexHeight;
+  record.m_white_pixel_u = atlas->TexUvWhitePixel.x;
+  record.m_white_pixel_v = atlas->TexUvWhitePixel.y;
+  for (ImVec4 const& uv : atlas->TexUvLines)
+    record.m_uv_lines.insert(record.m_uv_lines.end(), { uv.x, uv.y, uv.z, uv.w });
+  record.m_pack_id_mouse_cursors = atlas->PackIdMouseCursors;
+  record.m_pack_id_lines = atlas->PackIdLines;
+  for (ImFontAtlasCustomRect const& rect : atlas->CustomRects)
+    record.m_custom_rects.push_back({ rect.Width, rect.Height, rect.X, rect.Y, rect.GlyphID, rect.GlyphAdvanceX,
+        rect.GlyphOffset.x, rect.GlyphOffset.y, font_index(atlas, rect.Font) });
+  for (ImFont const* font : atlas->Fonts)
+  {
+    FontRecord& out = record.m_fonts.emplace_back();
+    out.m_font_size = font->FontSize;
+    out.m_ascent = font->Ascent;
+    out.m_descent = font->Descent;
+    out.m_fallback_char = font->FallbackChar;
+    out.m_ellipsis_char = font->EllipsisChar;
+    out.m_glyphs.reserve(font->Glyphs.Size);
+    for (ImFontGlyph const& glyph : font->Glyphs)
+      out.m_glyphs.push_back({ glyph.Codepoint, glyph.Colored, glyph.Visible, glyph.AdvanceX,
+          glyph.X0, glyph.Y0, glyph.X1, glyph.Y1, glyph.U0, glyph.V0, glyph.U1, glyph.V1 });
+  }
+  record.m_pixels.assign(atlas->TexPixelsAlpha8, atlas->TexPixelsAlpha8 + static_cast<size_t>(atlas->TexWidth) * atlas->TexHeight);
+
+  // Write to a temporary file first, so that a crash can't leave a truncated cache behind.
+  // The name is unique per process and per call, so that windows (or applications) that store
+  // the same cache concurrently don't write to the same file; the last rename wins.
+  static std::atomic<unsigned> s_tmp_counter{0};
+  std::filesystem::path tmp_filename = m_filename;
+  tmp_filename += ".tmp." + std::to_string(::getpid()) + "." + std::to_string(s_tmp_counter.fetch_add(1, std::memory_order::relaxed));
+  std::error_code ec;
+  {
+    std::ofstream file(tmp_filename, std::ios::binary | std::ios::trunc);
+    if (!file)
+    {
+      Dout(dc::warning, "Could not open " << tmp_filename << " for writing.");
+      return;
+    }
+    try
+    {
+      {
+        boost::archive::binary_oarchive oa(file);
+        oa & record;
+      }
+      file.close();
+    }
+    catch (boost::archive::archive_exception const& error)
+    {
+      Dout(dc::warning, "Caught boost::archive::archive_exception \"" << error.what() << "\" while trying to write " << tmp_filename << ". Ignoring it.");
+      file.setstate(std::ios::failbit);
+    }
+    // A short write (disk full, quota) leaves a truncated file: don't let it replace a good cache.
+    if (!file)
+    {
+      Dout(dc::warning, "Could not write " << tmp_filename << ".");
+      file.close();
+      std::filesystem::remove(tmp_filename, ec);
+      return;
+    }
+  }
+  std::filesystem::rename(tmp_filename, m_filename, ec);
+  if (ec)
+  {
+    Dout(dc::warning, "Could not rename " << tmp_filename << " to " << m_filename << ": " << ec.message());
+    std::filesystem::remove(tmp_filename, ec);
+  }
+}
+
+} // namespace vulkan
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+
+struct ImFontAtlas;
+
+namespace vulkan {
+
+// ImGuiFontAtlasCache
+//
+// Stores the result of building an ImGui font atlas on disk: the alpha8 pixels, the glyph tables
+// of every font and the atlas data that ImGui needs for drawing (white pixel, line textures and
+// custom rectangles). Loading that is much cheaper than rasterizing the fonts again.
+//
+// An entry is only used if its key matches; the key is a hash of everything that determines the
+// result of ImFontAtlas::Build: the font data, sizes, oversampling, glyph ranges, build flags and
+// the ImGui version. A single file is used: a miss simply overwrites it.
+//
+// The fonts must have been added (AddFont*) but not built yet when calling key() and load().
+//
+class ImGuiFontAtlasCache
+{
+ private:
+  std::filesystem::path m_filename;
+
+ public:
+  ImGuiFontAtlasCache(std::filesystem::path filename) : m_filename(std::move(filename)) { }
+
+  // Return the key of the atlas that would be built from the fonts that were added to atlas.
+  static size_t key(ImFontAtlas const* atlas);
+
+  // Turn atlas into a built atlas from the cache. Returns false, leaving atlas unchanged, if there is no valid entry for key.
+  bool load(ImFontAtlas* atlas, size_t key) const;
+
+  // Store the (built) atlas under key. Failure to write the file is not an error.
+  void store(ImFontAtlas const* atlas, size_t key) const;
+};
+
+} // namespace vulkan
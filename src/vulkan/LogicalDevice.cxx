@@ -8,12 +8,15 @@
 #include "pipeline/partitions/PartitionTask.h"
 #include "queues/QueueFamilyProperties.h"
 #include "queues/QueueReply.h"
+#include "queues/AsyncUploadScheduler.h"
 #include "infos/DeviceCreateInfo.h"
 #include "vk_utils/find_missing_names.h"
 #include "vk_utils/get_binary_file_contents.h"
 #include "utils/is_power_of_two.h"
 #include "utils/MultiLoop.h"
 #include <boost/lexical_cast.hpp>
+#include <algorithm>
+#include <cstring>
 #ifdef CWDEBUG
 #include "debug/vulkan_print_on.h"
 #include "debug/DebugSetName.h"
@@ -341,6 +344,64 @@ bool LogicalDevice::verify_presentation_support(vulkan::PresentationSurface cons
   return presentation_support;
 }
 
+bool LogicalDevice::supports_dynamic_state(vk::DynamicState dynamic_state) const
+{
+  switch (dynamic_state)
+  {
+    // Vulkan 1.0.
+    case vk::DynamicState::eViewport:
+    case vk::DynamicState::eScissor:
+    case vk::DynamicState::eLineWidth:
+    case vk::DynamicState::eDepthBias:
+    case vk::DynamicState::eBlendConstants:
+    case vk::DynamicState::eDepthBounds:
+    case vk::DynamicState::eStencilCompareMask:
+    case vk::DynamicState::eStencilWriteMask:
+    case vk::DynamicState::eStencilReference:
+    // VK_EXT_extended_dynamic_state, core since vulkan 1.3.
+    case vk::DynamicState::eCullMode:
+    case vk::DynamicState::eFrontFace:
+    case vk::DynamicState::ePrimitiveTopology:
+    case vk::DynamicState::eViewportWithCount:
+    case vk::DynamicState::eScissorWithCount:
+    case vk::DynamicState::eVertexInputBindingStride:
+    case vk::DynamicState::eDepthTestEnable:
+    case vk::DynamicState::eDepthWriteEnable:
+    case vk::DynamicState::eDepthCompareOp:
+    case vk::DynamicState::eDepthBoundsTestEnable:
+    case vk::DynamicState::eStencilTestEnable:
+    case vk::DynamicState::eStencilOp:
+    // VK_EXT_extended_dynamic_state2, core since vulkan 1.3 (without eLogicOpEXT and ePatchControlPointsEXT).
+    case vk::DynamicState::eRasterizerDiscardEnable:
+    case vk::DynamicState::eDepthBiasEnable:
+    case vk::DynamicState::ePrimitiveRestartEnable:
+      return true;
+#ifdef VK_EXT_extended_dynamic_state3
+    // VK_EXT_extended_dynamic_state3 (optional).
+    case vk::DynamicState::eDepthClampEnableEXT:
+      return m_supports_dynamic_depth_clamp_enable;
+    case vk::DynamicState::ePolygonModeEXT:
+      return m_supports_dynamic_polygon_mode;
+    case vk::DynamicState::eLogicOpEnableEXT:
+      return m_supports_dynamic_logic_op_enable;
+    case vk::DynamicState::eColorBlendEnableEXT:
+      return m_supports_dynamic_color_blend_enable;
+    case vk::DynamicState::eColorBlendEquationEXT:
+      return m_supports_dynamic_color_blend_equation;
+    case vk::DynamicState::eColorWriteMaskEXT:
+      return m_supports_dynamic_color_write_mask;
+#endif
+    default:
+      // Not supported (or not enabled by LogicalDevice::prepare).
+      return false;
+  }
+}
+
+bool LogicalDevice::supports_dynamic_states(std::vector<vk::DynamicState> const& dynamic_states) const
+{
+  return std::ranges::all_of(dynamic_states, [this](vk::DynamicState dynamic_state){ return supports_dynamic_state(dynamic_state); });
+}
+
 void LogicalDevice::prepare(
     vk::Instance vh_instance,
     DispatchLoader& dispatch_loader,
@@ -480,6 +541,21 @@ void LogicalDevice::prepare(
   if (!m_vh_physical_device)
     THROW_ALERT("Could not find a physical device (GPU) that supports vulkan with the following requirements: [CREATE_INFO]", AIArgs("[CREATE_INFO]", device_create_info));
 
+  // Blits (used to generate mip levels while uploading) require a queue with graphics capability,
+  // binding the pages of sparse images (see VirtualTexture) a queue with sparse binding capability.
+  for (QueueReply const& reply : m_queue_replies)
+    if ((reply.get_request_cookies() & m_transfer_request_cookie) && (reply.requested_queue_flags() & QueueFlagBits::eTransfer))
+    {
+      QueueFlags const transfer_queue_flags = m_queue_families[reply.get_queue_family()].get_queue_flags();
+      m_transfer_queue_family = static_cast<uint32_t>(reply.get_queue_family().get_value());
+      m_transfer_queue_supports_graphics = static_cast<bool>(transfer_queue_flags & QueueFlagBits::eGraphics);
+      m_transfer_queue_supports_sparse_binding = static_cast<bool>(transfer_queue_flags & QueueFlagBits::eSparseBinding);
+      break;
+    }
+  Dout(dc::vulkan, "m_transfer_queue_family = " << m_transfer_queue_family <<
+      "; m_transfer_queue_supports_graphics = " << m_transfer_queue_supports_graphics <<
+      "; m_transfer_queue_supports_sparse_binding = " << m_transfer_queue_supports_sparse_binding);
+
   // Check for optional features.
   Dout(dc::vulkan, "Physical Device Properties:");
   {
@@ -497,6 +573,9 @@ void LogicalDevice::prepare(
     m_non_coherent_atom_size    = properties.limits.nonCoherentAtomSize;
     m_max_sampler_anisotropy    = properties.limits.maxSamplerAnisotropy;
     m_max_bound_descriptor_sets = properties.limits.maxBoundDescriptorSets;
+    m_max_push_constants_size   = properties.limits.maxPushConstantsSize;
+    m_timestamp_period          = properties.limits.timestampPeriod;
+    m_supports_timestamps       = properties.limits.timestampComputeAndGraphics;
     m_set_limits = {
       .maxPerStageDescriptorSamplers = properties.limits.maxPerStageDescriptorSamplers,
       .maxPerStageDescriptorUniformBuffers = properties.limits.maxPerStageDescriptorUniformBuffers,
@@ -518,6 +597,8 @@ void LogicalDevice::prepare(
     Dout(dc::vulkan, "m_non_coherent_atom_size = " << m_non_coherent_atom_size);
     Dout(dc::vulkan, "m_max_sampler_anisotropy = " << m_max_sampler_anisotropy);
     Dout(dc::vulkan, "m_max_bound_descriptor_sets = " << m_max_bound_descriptor_sets);
+    Dout(dc::vulkan, "m_max_push_constants_size = " << m_max_push_constants_size);
+    Dout(dc::vulkan, "m_timestamp_period = " << m_timestamp_period << "; m_supports_timestamps = " << m_supports_timestamps);
     Dout(dc::vulkan, "m_set_limits = " << m_set_limits);
   }
   Dout(dc::vulkan, "Physical Device Memory Properties:");
@@ -529,7 +610,39 @@ void LogicalDevice::prepare(
     Dout(dc::vulkan, memory_properties);
     m_memory_type_count = memory_properties.memoryTypeCount;
     m_memory_heap_count = memory_properties.memoryHeapCount;
+    for (uint32_t heap = 0; heap < m_memory_heap_count; ++heap)
+      if ((memory_properties.memoryHeaps[heap].flags & vk::MemoryHeapFlagBits::eDeviceLocal))
+        m_device_local_heap_mask |= 1U << heap;
+  }
+#ifdef VK_EXT_extended_dynamic_state3
+  // Optional extension: VK_EXT_extended_dynamic_state3 allows (part of) the rasterization and color blend state to be dynamic.
+  // The dynamic state of VK_EXT_extended_dynamic_state and VK_EXT_extended_dynamic_state2 is core since vulkan 1.3.
+  vk::PhysicalDeviceExtendedDynamicState3FeaturesEXT extended_dynamic_state3_features;
+  bool const has_extended_dynamic_state3_extension = std::ranges::any_of(m_vh_physical_device.enumerateDeviceExtensionProperties(),
+      [](vk::ExtensionProperties const& extension_properties){
+        return std::strcmp(extension_properties.extensionName, VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME) == 0;
+      });
+  if (has_extended_dynamic_state3_extension)
+  {
+    // Link it after features13; getFeatures2 will fill in what is supported and that is then also what gets enabled.
+    ASSERT(!features13.pNext);
+    features13.setPNext(&extended_dynamic_state3_features);
+  }
+#endif
+#ifdef VK_EXT_mesh_shader
+  // Optional extension: VK_EXT_mesh_shader allows drawing meshlets (see meshlet/MeshletShaders.h).
+  vk::PhysicalDeviceMeshShaderFeaturesEXT mesh_shader_features;
+  bool const has_mesh_shader_extension = std::ranges::any_of(m_vh_physical_device.enumerateDeviceExtensionProperties(),
+      [](vk::ExtensionProperties const& extension_properties){
+        return std::strcmp(extension_properties.extensionName, VK_EXT_MESH_SHADER_EXTENSION_NAME) == 0;
+      });
+  if (has_mesh_shader_extension)
+  {
+    // Insert it directly after features13.
+    mesh_shader_features.setPNext(features13.pNext);
+    features13.setPNext(&mesh_shader_features);
   }
+#endif
   Dout(dc::vulkan, "Physical Device Features:");
   {
 #ifdef CWDEBUG
@@ -537,9 +650,36 @@ void LogicalDevice::prepare(
 #endif
     m_vh_physical_device.getFeatures2(&features2);
     m_supports_sampler_anisotropy = features10.samplerAnisotropy;
+    m_supports_sparse_residency = features10.sparseBinding && features10.sparseResidencyImage2D && m_transfer_queue_supports_sparse_binding;
     m_supports_separate_depth_stencil_layouts = features12.separateDepthStencilLayouts;
     m_supports_sampled_image_update_after_bind = features12.descriptorBindingSampledImageUpdateAfterBind;
+    m_supports_buffer_device_address = features12.bufferDeviceAddress;
+    m_supports_draw_indirect_count = features12.drawIndirectCount;
     m_supports_cache_control = features13.pipelineCreationCacheControl;
+#ifdef VK_EXT_extended_dynamic_state3
+    if (has_extended_dynamic_state3_extension)
+    {
+      m_supports_dynamic_depth_clamp_enable = extended_dynamic_state3_features.extendedDynamicState3DepthClampEnable;
+      m_supports_dynamic_polygon_mode = extended_dynamic_state3_features.extendedDynamicState3PolygonMode;
+      m_supports_dynamic_logic_op_enable = extended_dynamic_state3_features.extendedDynamicState3LogicOpEnable;
+      m_supports_dynamic_color_blend_enable = extended_dynamic_state3_features.extendedDynamicState3ColorBlendEnable;
+      m_supports_dynamic_color_blend_equation = extended_dynamic_state3_features.extendedDynamicState3ColorBlendEquation;
+      m_supports_dynamic_color_write_mask = extended_dynamic_state3_features.extendedDynamicState3ColorWriteMask;
+      device_create_info.addDeviceExtentions({ VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME });
+    }
+#endif
+#ifdef VK_EXT_mesh_shader
+    if (has_mesh_shader_extension)
+    {
+      // These require features (multiview, fragment shading rate, pipeline statistics queries) that we don't enable.
+      mesh_shader_features.multiviewMeshShader = VK_FALSE;
+      mesh_shader_features.primitiveFragmentShadingRateMeshShader = VK_FALSE;
+      mesh_shader_features.meshShaderQueries = VK_FALSE;
+      m_supports_mesh_shader = mesh_shader_features.meshShader && mesh_shader_features.taskShader;
+      // The features struct is part of the device create info chain, so the extension must be enabled too.
+      device_create_info.addDeviceExtentions({ VK_EXT_MESH_SHADER_EXTENSION_NAME });
+    }
+#endif
     Dout(dc::vulkan, features2);
   }
 #ifdef CWDEBUG
@@ -606,6 +746,8 @@ void LogicalDevice::prepare(
     .vkGetDeviceProcAddr = vkGetDeviceProcAddr
   };
   VmaAllocatorCreateInfo vma_allocator_create_info{
+    // Buffers with vk::BufferUsageFlagBits::eShaderDeviceAddress need memory allocated with VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT.
+    .flags = m_supports_buffer_device_address ? VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT : VmaAllocatorCreateFlags{},
     .physicalDevice = m_vh_physical_device,
     .device = *m_device,
     .pVulkanFunctions = &vma_vulkan_functions,
@@ -672,9 +814,16 @@ void LogicalDevice::prepare(
   }
 }
 
-Queue LogicalDevice::acquire_queue(QueueRequestKey queue_request_key) const
+bool LogicalDevice::supports_blit_mip_generation(vk::Format format) const
 {
-  DoutEntering(dc::vulkan, "LogicalDevice::acquire_queue(" << queue_request_key << ")");
+  vk::FormatFeatureFlags const required = vk::FormatFeatureFlagBits::eBlitSrc | vk::FormatFeatureFlagBits::eBlitDst |
+      vk::FormatFeatureFlagBits::eSampledImageFilterLinear;
+  return (m_vh_physical_device.getFormatProperties(format).optimalTilingFeatures & required) == required;
+}
+
+Queue LogicalDevice::acquire_queue(QueueRequestKey queue_request_key, bool shared) const
+{
+  DoutEntering(dc::vulkan, "LogicalDevice::acquire_queue(" << queue_request_key << ", " << std::boolalpha << shared << ")");
   // cookie is a bit mask and must represent a single window.
   ASSERT(utils::is_power_of_two(queue_request_key.request_cookie()));
 
@@ -751,7 +900,7 @@ Queue LogicalDevice::acquire_queue(QueueRequestKey queue_request_key) const
   }
 
   // Reserve a queue index from the pool of total queues.
-  int next_queue_index = m_queue_replies[queue_request_index].acquire_queue();
+  int next_queue_index = shared ? m_queue_replies[queue_request_index].acquire_shared_queue() : m_queue_replies[queue_request_index].acquire_queue();
   if (next_queue_index == -1)
     throw vulkan::OutOfQueues_Exception(queue_request_key.queue_flags(), m_queue_replies[queue_request_index].number_of_queues());
 
@@ -761,6 +910,17 @@ Queue LogicalDevice::acquire_queue(QueueRequestKey queue_request_key) const
   return { m_device->getQueue(queue_family_properties_index.get_value(), next_queue_index), queue_family_properties_index };
 }
 
+SubmitCoalescer* LogicalDevice::submit_coalescer(vk::Queue vh_queue) const
+{
+  DoutEntering(dc::vulkan, "LogicalDevice::submit_coalescer(" << vh_queue << ")");
+  submit_coalescers_t::wat submit_coalescers_w(m_submit_coalescers);
+  auto iter = std::ranges::find_if(*submit_coalescers_w, [vh_queue](auto const& submit_coalescer){ return submit_coalescer->vh_queue() == vh_queue; });
+  if (iter != submit_coalescers_w->end())
+    return iter->get();
+  submit_coalescers_w->push_back(std::make_unique<SubmitCoalescer>(vh_queue));
+  return submit_coalescers_w->back().get();
+}
+
 vk::UniqueRenderPass LogicalDevice::create_render_pass(
     rendergraph::RenderPass const& render_graph_pass
     COMMA_CWDEBUG_ONLY(Ambifix const& debug_name)) const
@@ -1134,6 +1294,17 @@ vk::UniquePipeline LogicalDevice::create_graphics_pipeline(
   return pipeline;
 }
 
+vk::UniquePipeline LogicalDevice::create_compute_pipeline(
+    vk::PipelineCache vh_pipeline_cache,
+    vk::ComputePipelineCreateInfo const& compute_pipeline_create_info
+    COMMA_CWDEBUG_ONLY(Ambifix const& debug_name)) const
+{
+  DoutEntering(dc::vulkan, "LogicalDevice::create_compute_pipeline(" << vh_pipeline_cache << ", {layout:" << compute_pipeline_create_info.layout << "})");
+  vk::UniquePipeline pipeline = m_device->createComputePipelineUnique(vh_pipeline_cache, compute_pipeline_create_info).value;
+  DebugSetName(pipeline, debug_name, this);
+  return pipeline;
+}
+
 Swapchain::images_type LogicalDevice::get_swapchain_images(
     task::SynchronousWindow const* owning_window,
     vk::SwapchainKHR vh_swapchain
@@ -1164,6 +1335,21 @@ Swapchain::images_type LogicalDevice::get_swapchain_images(
   return swapchain_images;
 }
 
+memory::HeapBudget LogicalDevice::device_local_memory_budget() const
+{
+  // Without VK_EXT_memory_budget VMA estimates the budget as 80% of the heap size, and only counts its own allocations as usage.
+  std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets;
+  m_vh_allocator.get_heap_budgets(budgets.data());
+  memory::HeapBudget result;
+  for (uint32_t heap = 0; heap < m_memory_heap_count; ++heap)
+    if ((m_device_local_heap_mask & (1U << heap)))
+    {
+      result.m_usage += budgets[heap].usage;
+      result.m_budget += budgets[heap].budget;
+    }
+  return result;
+}
+
 vk::Buffer LogicalDevice::create_buffer(utils::Badge<memory::Buffer>, vk::BufferCreateInfo const& buffer_create_info,
     VmaAllocationCreateInfo const& vma_allocation_create_info, VmaAllocation* vh_allocation, VmaAllocationInfo* allocation_info
     COMMA_CWDEBUG_ONLY(Ambifix const& allocation_name)) const
@@ -1401,6 +1587,12 @@ vk::PipelineLayout LogicalDevice::realize_pipeline_layout(
   // What do you think you are doing?
   ASSERT(set_index_hint_map_out.empty());
 #endif
+  // The push constant struct(s) used by the shaders of this pipeline must fit in the push constant memory of the device.
+  for (vk::PushConstantRange const& push_constant_range : sorted_push_constant_ranges)
+    if (push_constant_range.offset + push_constant_range.size > m_max_push_constants_size)
+      THROW_ALERT("The push constant range [RANGE] exceeds the maxPushConstantsSize ([MAX] bytes) of this device.",
+          AIArgs("[RANGE]", vk::to_string(push_constant_range.stageFlags) + " [" + std::to_string(push_constant_range.offset) + ", " +
+            std::to_string(push_constant_range.offset + push_constant_range.size) + ">")("[MAX]", m_max_push_constants_size));
   // So we can continue from the top when two threads try to convert the read-lock to a write-lock at the same time.
   for (;;)
   {
@@ -1468,9 +1660,21 @@ vk::PipelineLayout LogicalDevice::realize_pipeline_layout(
   }
 }
 
-LogicalDevice::LogicalDevice() : m_semaphore_watcher(statefultask::create<task::AsyncSemaphoreWatcher>(CWDEBUG_ONLY(true)))
+LogicalDevice::LogicalDevice() : m_semaphore_watcher(statefultask::create<task::AsyncSemaphoreWatcher>(CWDEBUG_ONLY(true))),
+  m_upload_scheduler(statefultask::create<task::AsyncUploadScheduler>(CWDEBUG_ONLY(false)))
 {
   m_semaphore_watcher->run(Application::instance().high_priority_queue());
+  m_upload_scheduler->run(Application::instance().high_priority_queue(), [this](bool CWDEBUG_ONLY(success)){
+    Dout(dc::vulkan, "AsyncUploadScheduler finished" << (success ? "" : " (aborted)") << ".");
+    m_upload_scheduler_finished.open();
+  });
+}
+
+void LogicalDevice::terminate_upload_scheduler()
+{
+  DoutEntering(dc::vulkan, "LogicalDevice::terminate_upload_scheduler()");
+  m_upload_scheduler->terminate();
+  m_upload_scheduler_finished.wait();
 }
 
 LogicalDevice::~LogicalDevice()
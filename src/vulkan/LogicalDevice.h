@@ -13,6 +13,7 @@
 #include "queues/Queue.h"
 #include "queues/QueueRequestKey.h"
 #include "queues/QueueReply.h"
+#include "queues/SubmitCoalescer.h"
 #include "memory/Allocator.h"
 #include "descriptor/SetLimits.h"
 #include "descriptor/LayoutBindingCompare.h"
@@ -29,6 +30,7 @@
 #include "threadsafe/AIReadWriteMutex.h"
 #include "utils/Badge.h"
 #include "utils/PairCompare.h"
+#include "utils/threading/Gate.h"
 #include <boost/intrusive_ptr.hpp>
 #include <boost/uuid/uuid.hpp>
 #include <vk_mem_alloc.h>
@@ -48,6 +50,7 @@
 namespace task {
 class SynchronousWindow;
 class AsyncSemaphoreWatcher;
+class AsyncUploadScheduler;
 } // namespace task
 
 namespace vulkan {
@@ -70,6 +73,8 @@ class RenderPass;
 namespace memory {
 class Buffer;
 class Image;
+class DeviceImagePoolBackend;
+class DeviceSparseMipMemoryBackend;
 } // namespace memory
 
 // The collection of queue family properties for a given physical device.
@@ -113,17 +118,39 @@ class LogicalDevice
   vk::DeviceSize m_non_coherent_atom_size;              // Allocated non-coherent memory must be a multiple of this value in size.
   float m_max_sampler_anisotropy;                       // GraphicsSettingsPOD::maxAnisotropy must be less than or equal this value.
   uint32_t m_max_bound_descriptor_sets;                 // Each pipeline object can use up to m_max_bound_descriptor_sets descriptor sets.
+  uint32_t m_max_push_constants_size;                   // The push constant ranges of a pipeline layout must lie within [0, m_max_push_constants_size>.
+  float m_timestamp_period;                             // The number of nanoseconds per timestamp tick.
   descriptor::SetLimits m_set_limits;
 
   uint32_t m_memory_type_count;                         // The number of memory types of this GPU.
   uint32_t m_memory_heap_count;                         // The number of heaps of this GPU.
+  uint32_t m_device_local_heap_mask = {};               // Bit mask of the heaps that have vk::MemoryHeapFlagBits::eDeviceLocal.
   bool m_supports_separate_depth_stencil_layouts;       // Set if the physical device supports vk::PhysicalDeviceSeparateDepthStencilLayoutsFeatures.
   bool m_supports_sampler_anisotropy = {};
   bool m_supports_cache_control = {};
   bool m_supports_sampled_image_update_after_bind = {}; // Set if the physical device supports vk::DescriptorBindingFlagBits::eUpdateAfterBind for samplers / sampled images.
+  // Set if the corresponding VK_EXT_extended_dynamic_state3 state is supported (and enabled) as dynamic state.
+  bool m_supports_dynamic_depth_clamp_enable = {};
+  bool m_supports_dynamic_polygon_mode = {};
+  bool m_supports_dynamic_logic_op_enable = {};
+  bool m_supports_dynamic_color_blend_enable = {};
+  bool m_supports_dynamic_color_blend_equation = {};
+  bool m_supports_dynamic_color_write_mask = {};
+  bool m_supports_mesh_shader = {};                     // Set if VK_EXT_mesh_shader is supported (and enabled), with task shaders.
+  bool m_supports_buffer_device_address = {};           // Set if buffers can be created with vk::BufferUsageFlagBits::eShaderDeviceAddress.
+  bool m_supports_draw_indirect_count = {};             // Set if the draw count of indirect draws can be read from a buffer (drawIndexedIndirectCount etc).
+  bool m_supports_timestamps = {};                      // Set if timestamps are supported on all graphics and compute queues.
+  uint32_t m_transfer_queue_family = {};                // The queue family used for eTransfer requests.
+  bool m_transfer_queue_supports_graphics = {};         // Set if the queue family used for eTransfer requests supports graphics (required for vkCmdBlitImage).
+  bool m_transfer_queue_supports_sparse_binding = {};   // Set if the queue family used for eTransfer requests supports sparse binding (vkQueueBindSparse).
+  bool m_supports_sparse_residency = {};                // Set if 2D images can be partially resident, with their pages bound on the transfer queue.
   memory::Allocator m_vh_allocator;                     // Handle to VMA allocator object.
   QueueRequestKey::request_cookie_type m_transfer_request_cookie = {};  // The cookie that was used to request eTransfer queues (set in LogicalDevice::prepare).
   boost::intrusive_ptr<task::AsyncSemaphoreWatcher> m_semaphore_watcher;// Asynchronous task that polls timeline semaphores.
+  boost::intrusive_ptr<task::AsyncUploadScheduler> m_upload_scheduler;  // Asynchronous task that admits uploads to the GPU within a per-frame budget.
+  utils::threading::Gate m_upload_scheduler_finished;   // Opened when m_upload_scheduler finished.
+  using submit_coalescers_t = aithreadsafe::Wrapper<std::vector<std::unique_ptr<SubmitCoalescer>>, aithreadsafe::policy::Primitive<std::mutex>>;
+  mutable submit_coalescers_t m_submit_coalescers;      // One SubmitCoalescer per shared queue (see acquire_queue).
 
   using descriptor_pool_t = vk_utils::WriteLockOnly<vk::UniqueDescriptorPool>;
   // Using "threadsafe-"const for member functions that access this. Since the 'const' then only
@@ -167,10 +194,26 @@ class LogicalDevice
   bool supports_sampler_anisotropy() const { return m_supports_sampler_anisotropy; }
   bool supports_cache_control() const { return m_supports_cache_control; }
   bool supports_sampled_image_update_after_bind() const { return m_supports_sampled_image_update_after_bind; }
+  // Return true if dynamic_state may be added to the dynamic state of a pipeline created by this device.
+  bool supports_dynamic_state(vk::DynamicState dynamic_state) const;
+  // Return true if all of dynamic_states are supported.
+  bool supports_dynamic_states(std::vector<vk::DynamicState> const& dynamic_states) const;
+  bool supports_mesh_shader() const { return m_supports_mesh_shader; }
+  bool supports_buffer_device_address() const { return m_supports_buffer_device_address; }
+  bool supports_draw_indirect_count() const { return m_supports_draw_indirect_count; }
   vk::DeviceSize non_coherent_atom_size() const { return m_non_coherent_atom_size; }
   float max_sampler_anisotropy() const { return m_max_sampler_anisotropy; }
   uint32_t max_bound_descriptor_sets() const { return m_max_bound_descriptor_sets; }
+  uint32_t max_push_constants_size() const { return m_max_push_constants_size; }
+  bool supports_timestamps() const { return m_supports_timestamps; }
+  float timestamp_period() const { return m_timestamp_period; }
   bool has_explicit_transfer_support() const { return m_queue_families.has_explicit_transfer_support(); }
+  uint32_t transfer_queue_family() const { return m_transfer_queue_family; }
+  bool transfer_queue_supports_graphics() const { return m_transfer_queue_supports_graphics; }
+  bool supports_sparse_residency() const { return m_supports_sparse_residency; }
+  // Return true if the mip levels of an optimal tiling image of format can be generated with linear blits.
+  // Blits require a graphics capable queue: see transfer_queue_supports_graphics.
+  bool supports_blit_mip_generation(vk::Format format) const;
   QueueRequestKey::request_cookie_type transfer_request_cookie() const { return m_transfer_request_cookie; }
 
   void print_on(std::ostream& os) const { char const* prefix = ""; os << '{'; print_members(os, prefix); os << '}'; }
@@ -211,7 +254,12 @@ class LogicalDevice
   }
 
   // Return the (next) queue for queue_request_key as passed to Application::create_root_window).
-  Queue acquire_queue(QueueRequestKey queue_request_key) const;
+  // If shared is true then every call for the same request returns the same queue; such a queue
+  // may only be used through the SubmitCoalescer returned by submit_coalescer.
+  Queue acquire_queue(QueueRequestKey queue_request_key, bool shared = false) const;
+
+  // Return the SubmitCoalescer for vh_queue, creating it if it doesn't exist yet.
+  SubmitCoalescer* submit_coalescer(vk::Queue vh_queue) const;
 
   // Wait the completion of outstanding queue operations for all queues of this logical device.
   // This is a blocking call, only intended for program termination.
@@ -226,7 +274,7 @@ class LogicalDevice
   }
   vk::Result wait_semaphores(vk::SemaphoreWaitInfo const& semaphore_wait_info, uint64_t timeout) const
   {
-    DoutEntering(dc::vulkan, "LogicalDevice::wait_semaphores(" << semaphore_wait_info << ", " << timeout << ")");
+    DoutEntering(dc::vkframe, "LogicalDevice::wait_semaphores(" << semaphore_wait_info << ", " << timeout << ")");
     return m_device->waitSemaphores(semaphore_wait_info, timeout);
   }
   uint64_t get_semaphore_counter_value(vk::Semaphore vh_timeline_semaphore) const
@@ -238,8 +286,20 @@ class LogicalDevice
   }
   [[gnu::always_inline]] inline void add_timeline_semaphore_poll(TimelineSemaphore const* timeline_semaphore, uint64_t signal_value, AIStatefulTask* task, AIStatefulTask::condition_type condition) const;
   [[gnu::always_inline]] inline void remove_timeline_semaphore_poll(TimelineSemaphore const* timeline_semaphore) const;
+  // The scheduler that CopyDataToGPU tasks must pass through before they may start their upload.
+  task::AsyncUploadScheduler& upload_scheduler() const { return *m_upload_scheduler; }
+  // Stop the upload scheduler and wait until it finished. Called by Application::run after the device became idle.
+  void terminate_upload_scheduler();
   inline vk::UniqueSemaphore create_semaphore(CWDEBUG_ONLY(Ambifix const& debug_name)) const;
   inline vk::UniqueFence create_fence(bool signaled COMMA_CWDEBUG_ONLY(bool debug_output, Ambifix const& debug_name)) const;
+  inline vk::UniqueQueryPool create_timestamp_query_pool(uint32_t query_count COMMA_CWDEBUG_ONLY(Ambifix const& debug_name)) const;
+  // Read query_count 64-bit timestamps starting at first_query, without waiting. Returns false if not all of them are available.
+  bool get_timestamps(vk::QueryPool vh_query_pool, uint32_t first_query, uint32_t query_count, uint64_t* timestamps_out) const
+  {
+    vk::Result res = m_device->getQueryPoolResults(vh_query_pool, first_query, query_count,
+        query_count * sizeof(uint64_t), timestamps_out, sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+    return res == vk::Result::eSuccess;
+  }
   vk::Result wait_for_fences(vk::ArrayProxy<vk::Fence const> const& fences, vk::Bool32 wait_all, uint64_t timeout) const
   {
     DoutEntering(dc::vkframe, "LogicalDevice::wait_for_fences(" << fences << ", " << wait_all << ", " << timeout << ")");
@@ -303,6 +363,8 @@ class LogicalDevice
       COMMA_CWDEBUG_ONLY(Ambifix const& debug_name)) const;
   vk::UniquePipeline create_graphics_pipeline(vk::PipelineCache vh_pipeline_cache, vk::GraphicsPipelineCreateInfo const& graphics_pipeline_create_info
       COMMA_CWDEBUG_ONLY(Ambifix const& debug_name)) const;
+  vk::UniquePipeline create_compute_pipeline(vk::PipelineCache vh_pipeline_cache, vk::ComputePipelineCreateInfo const& compute_pipeline_create_info
+      COMMA_CWDEBUG_ONLY(Ambifix const& debug_name)) const;
   Swapchain::images_type get_swapchain_images(task::SynchronousWindow const* owning_window, vk::SwapchainKHR vh_swapchain
       COMMA_CWDEBUG_ONLY(Ambifix const& ambifix)) const;
 
@@ -347,6 +409,13 @@ class LogicalDevice
     m_vh_allocator.flush_allocations(allocation_count, vh_allocations, offsets, sizes);
   }
 
+  // Make writes of the device to mapped memory visible to the host (only needed for memory that isn't host coherent).
+  void invalidate_mapped_allocation(VmaAllocation vh_allocation, vk::DeviceSize offset, vk::DeviceSize size) const
+  {
+    DoutEntering(dc::vulkan|dc::vkframe, "invalidate_mapped_allocation(" << vh_allocation << ", " << offset << ", " << size << ")");
+    m_vh_allocator.invalidate_allocation(vh_allocation, offset, size);
+  }
+
   void unmap_memory(VmaAllocation vh_allocation) const
   {
     DoutEntering(dc::vulkan|dc::vkframe, "unmap_memory(" << vh_allocation << ")");
@@ -360,12 +429,13 @@ class LogicalDevice
     Dout(dc::finish, memory_property_flags_out << "})");
   }
 
-#ifdef CWDEBUG
   VmaAllocationInfo get_allocation_info(VmaAllocation vh_allocation) const
   {
     return m_vh_allocator.get_allocation_info(vh_allocation);
   }
-#endif
+
+  // The sum of the budgets and usage of all device local heaps (see memory::TextureResidency::texture_budget).
+  memory::HeapBudget device_local_memory_budget() const;
 
   // Called by memory::Image::Image.
   vk::Image create_image(utils::Badge<memory::Image>, vk::ImageCreateInfo const& image_create_info,
@@ -384,6 +454,39 @@ class LogicalDevice
     m_vh_allocator.destroy_image(vh_image, vh_allocation);
   }
 
+  // Called by memory::DeviceImagePoolBackend and memory::Image (sparse images): images and memory that are created and bound separately.
+  vk::Image create_unbound_image(utils::Badge<memory::DeviceImagePoolBackend, memory::Image>, vk::ImageCreateInfo const& image_create_info) const
+  {
+    DoutEntering(dc::vulkan, "LogicalDevice::create_unbound_image(" << image_create_info << ")");
+    return m_device->createImage(image_create_info);
+  }
+
+  void destroy_unbound_image(utils::Badge<memory::DeviceImagePoolBackend, memory::Image>, vk::Image vh_image) const
+  {
+    DoutEntering(dc::vulkan, "LogicalDevice::destroy_unbound_image(" << vh_image << ")");
+    m_device->destroyImage(vh_image);
+  }
+
+  VmaAllocation allocate_memory(utils::Badge<memory::DeviceImagePoolBackend, memory::DeviceSparseMipMemoryBackend>, vk::MemoryRequirements const& memory_requirements,
+      VmaAllocationCreateInfo const& vma_allocation_create_info COMMA_CWDEBUG_ONLY(Ambifix const& allocation_name)) const
+  {
+    DoutEntering(dc::vulkan, "LogicalDevice::allocate_memory(" << print_using(memory_requirements, memory_requirements_printer()) << ", " << debug::set_device(this) << vma_allocation_create_info << ")");
+    return m_vh_allocator.allocate_memory(memory_requirements, vma_allocation_create_info, nullptr
+        COMMA_CWDEBUG_ONLY(allocation_name));
+  }
+
+  void bind_image_memory(utils::Badge<memory::DeviceImagePoolBackend>, vk::Image vh_image, VmaAllocation vh_allocation) const
+  {
+    DoutEntering(dc::vulkan, "LogicalDevice::bind_image_memory(" << vh_image << ", " << vh_allocation << ")");
+    m_vh_allocator.bind_image_memory(vh_allocation, vh_image);
+  }
+
+  void free_memory(utils::Badge<memory::DeviceImagePoolBackend, memory::DeviceSparseMipMemoryBackend>, VmaAllocation vh_allocation) const
+  {
+    DoutEntering(dc::vulkan, "LogicalDevice::free_memory(" << vh_allocation << ")");
+    m_vh_allocator.free_memory(vh_allocation);
+  }
+
   // End of API for access to m_vh_allocator.
   //---------------------------------------------------------------------------
 
@@ -412,11 +515,23 @@ class LogicalDevice
     DoutEntering(dc::vulkan, "LogicalDevice::get_buffer_memory_requirements(" << vh_buffer << ")");
     return m_device->getBufferMemoryRequirements(vh_buffer);
   }
+  vk::DeviceAddress get_buffer_address(vk::Buffer vh_buffer) const
+  {
+    DoutEntering(dc::vulkan, "LogicalDevice::get_buffer_address(" << vh_buffer << ")");
+    // The buffer must have been created with vk::BufferUsageFlagBits::eShaderDeviceAddress.
+    ASSERT(m_supports_buffer_device_address);
+    return m_device->getBufferAddress({ .buffer = vh_buffer });
+  }
   vk::MemoryRequirements get_image_memory_requirements(vk::Image vh_image) const
   {
     DoutEntering(dc::vulkan, "LogicalDevice::get_image_memory_requirements(" << vh_image << ")");
     return m_device->getImageMemoryRequirements(vh_image);
   }
+  std::vector<vk::SparseImageMemoryRequirements> get_image_sparse_memory_requirements(vk::Image vh_image) const
+  {
+    DoutEntering(dc::vulkan, "LogicalDevice::get_image_sparse_memory_requirements(" << vh_image << ")");
+    return m_device->getImageSparseMemoryRequirements(vh_image);
+  }
   descriptor_pool_t& get_descriptor_pool() /*threadsafe-*/ const
   {
     return m_descriptor_pool;
@@ -550,6 +665,13 @@ vk::UniqueFence LogicalDevice::create_fence(bool signaled COMMA_CWDEBUG_ONLY(boo
   return fence;
 }
 
+vk::UniqueQueryPool LogicalDevice::create_timestamp_query_pool(uint32_t query_count COMMA_CWDEBUG_ONLY(Ambifix const& debug_name)) const
+{
+  vk::UniqueQueryPool query_pool = m_device->createQueryPoolUnique({ .queryType = vk::QueryType::eTimestamp, .queryCount = query_count });
+  DebugSetName(query_pool, debug_name, this);
+  return query_pool;
+}
+
 vk::UniqueCommandPool LogicalDevice::create_command_pool(uint32_t queue_family_index, vk::CommandPoolCreateFlags flags COMMA_CWDEBUG_ONLY(Ambifix const& debug_name)) const
 {
   vk::UniqueCommandPool command_pool = m_device->createCommandPoolUnique({ .flags = flags, .queueFamilyIndex = queue_family_index });
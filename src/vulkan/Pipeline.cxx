@@ -8,7 +8,8 @@ void Pipeline::print_on(std::ostream& os) const
 {
   os << '{';
   os << "m_vh_layout:" << m_vh_layout <<
-      ", m_handle:" << m_handle;
+      ", m_handle:" << m_handle <<
+      ", m_push_constant_ranges:" << m_push_constant_ranges;
   os << '}';
 }
 #endif
@@ -28,13 +28,15 @@ class Pipeline
   vk::PipelineLayout m_vh_layout;       // Vulkan handle to the pipeline layout.
   pipeline::Handle m_handle;            // Handle to the pipeline.
   descriptor_set_per_set_index_per_frame_resource_t m_descriptor_set_per_set_index_per_frame_resource;
+  std::vector<vk::PushConstantRange> m_push_constant_ranges;    // The (packed) push constant ranges that m_vh_layout was created with.
 
  public:
   Pipeline() = default;
   Pipeline(Pipeline&&) = default;
-  Pipeline(vk::PipelineLayout vh_layout, pipeline::Handle handle, descriptor_set_per_set_index_t const& descriptor_sets, FrameResourceIndex const max_number_of_frame_resources
+  Pipeline(vk::PipelineLayout vh_layout, pipeline::Handle handle, descriptor_set_per_set_index_t const& descriptor_sets, FrameResourceIndex const max_number_of_frame_resources,
+      std::vector<vk::PushConstantRange> const& push_constant_ranges
       COMMA_CWDEBUG_ONLY(LogicalDevice const* logical_device)) :
-    m_vh_layout(vh_layout), m_handle(handle)
+    m_vh_layout(vh_layout), m_handle(handle), m_push_constant_ranges(push_constant_ranges)
   {
     size_t const number_of_frame_resources = max_number_of_frame_resources.get_value();
     descriptor::SetIndex const number_of_set_indexes{descriptor_sets.size()};
@@ -71,6 +73,7 @@ class Pipeline
   vk::PipelineLayout layout() const { return m_vh_layout; }
   pipeline::Handle const& handle() const { return m_handle; }
   std::vector<vk::DescriptorSet> const& vhv_descriptor_sets(FrameResourceIndex frame_index) const { return m_descriptor_set_per_set_index_per_frame_resource[frame_index]; }
+  std::vector<vk::PushConstantRange> const& push_constant_ranges() const { return m_push_constant_ranges; }
 
 #ifdef CWDEBUG
   void print_on(std::ostream& os) const;
@@ -0,0 +1,156 @@
+#include "sys.h"
+#include "Presenter.h"
+#include "SynchronousWindow.h"
+#include "LogicalDevice.h"
+#include "debug.h"
+
+namespace task {
+
+char const* AsyncPresenter::condition_str_impl(condition_type condition) const
+{
+  switch (condition)
+  {
+    AI_CASE_RETURN(have_request);
+  }
+  return direct_base_type::condition_str_impl(condition);
+}
+
+char const* AsyncPresenter::state_str_impl(state_type run_state) const
+{
+  switch (run_state)
+  {
+    AI_CASE_RETURN(AsyncPresenter_wait);
+    AI_CASE_RETURN(AsyncPresenter_done);
+  }
+  AI_NEVER_REACHED
+}
+
+char const* AsyncPresenter::task_name_impl() const
+{
+  return "AsyncPresenter";
+}
+
+void AsyncPresenter::initialize_impl()
+{
+  set_state(AsyncPresenter_wait);
+}
+
+void AsyncPresenter::present_and_acquire(vk::SwapchainKHR vh_swapchain, bool present, vulkan::SwapchainIndex swapchain_index,
+    vk::Semaphore vh_rendering_finished_semaphore, vk::Semaphore vh_acquire_semaphore)
+{
+  {
+    state_t::wat state_w(m_state);
+    if (!present && (state_w->m_request || state_w->m_busy || state_w->m_acquired))
+      return;
+    // The render loop can only hand over a frame after it took the previously acquired image.
+    ASSERT(!state_w->m_request && !state_w->m_acquired);
+    state_w->m_request = Request{ vh_swapchain, present, swapchain_index, vh_rendering_finished_semaphore, vh_acquire_semaphore };
+  }
+  signal(have_request);
+}
+
+std::optional<AsyncPresenter::Acquired> AsyncPresenter::take_acquired()
+{
+  state_t::wat state_w(m_state);
+  std::optional<Acquired> acquired;
+  acquired.swap(state_w->m_acquired);
+  return acquired;
+}
+
+vk::Result AsyncPresenter::take_present_result()
+{
+  state_t::wat state_w(m_state);
+  return std::exchange(state_w->m_present_result, vk::Result::eSuccess);
+}
+
+void AsyncPresenter::drain()
+{
+  DoutEntering(dc::vkframe, "AsyncPresenter::drain()");
+  // This is only called when the swapchain is recreated or the window stops rendering; at most one present and acquire have to finish.
+  std::unique_lock<std::mutex> idle_lock(m_idle_mutex);
+  m_idle_condition.wait(idle_lock, [this]{
+    state_t::crat state_r(m_state);
+    return !state_r->m_request && !state_r->m_busy;
+  });
+}
+
+void AsyncPresenter::process(Request const& request)
+{
+  vk::Result present_result = vk::Result::eSuccess;
+  if (request.m_present)
+  {
+    uint32_t const swapchain_image_index = request.m_swapchain_index.get_value();
+    vk::PresentInfoKHR present_info{
+      .waitSemaphoreCount = 1,
+      .pWaitSemaphores = &request.m_vh_rendering_finished_semaphore,
+      .swapchainCount = 1,
+      .pSwapchains = &request.m_vh_swapchain,
+      .pImageIndices = &swapchain_image_index
+    };
+    std::lock_guard<std::mutex> lock(m_queue_mutex);
+    ZoneScopedN("presentKHR");
+    present_result = m_vh_presentation_queue.presentKHR(&present_info);
+  }
+
+  Acquired acquired{ vk::Result::eErrorOutOfDateKHR, {}, request.m_vh_acquire_semaphore };
+  // Don't try to acquire an image of a swapchain that has to be recreated anyway.
+  if (present_result == vk::Result::eSuccess || present_result == vk::Result::eSuboptimalKHR)
+  {
+    ZoneScopedN("acquire_next_image");
+    acquired.m_result = m_logical_device->acquire_next_image(request.m_vh_swapchain, 1000000000, request.m_vh_acquire_semaphore, vk::Fence(),
+        acquired.m_swapchain_index);
+  }
+
+  state_t::wat state_w(m_state);
+  if (request.m_present)
+  {
+    ++state_w->m_number_of_presents;
+    if (state_w->m_present_result == vk::Result::eSuccess)
+      state_w->m_present_result = present_result;
+  }
+  state_w->m_acquired = acquired;
+}
+
+void AsyncPresenter::multiplex_impl(state_type run_state)
+{
+  switch (run_state)
+  {
+    case AsyncPresenter_wait:
+    {
+      if (m_terminate)
+      {
+        set_state(AsyncPresenter_done);
+        break;
+      }
+      Request request;
+      {
+        state_t::wat state_w(m_state);
+        if (!state_w->m_request)
+        {
+          wait(have_request);
+          break;
+        }
+        request = *state_w->m_request;
+        state_w->m_request.reset();
+        state_w->m_busy = true;
+      }
+      process(request);
+      state_t::wat(m_state)->m_busy = false;
+      // Taking the lock makes sure that drain() either sees m_busy reset, or is waiting for the notification.
+      {
+        std::lock_guard<std::mutex> idle_lock(m_idle_mutex);
+      }
+      m_idle_condition.notify_all();
+      // Wake up the render loop if it is waiting for this image.
+      m_owning_window->swapchain_image_acquired_signal({});
+      // Check for another request.
+      yield();
+      break;
+    }
+    case AsyncPresenter_done:
+      finish();
+      break;
+  }
+}
+
+} // namespace task
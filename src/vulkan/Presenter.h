@@ -0,0 +1,141 @@
+#pragma once
+
+#include "AsyncTask.h"
+#include "SwapchainIndex.h"
+#include "threadsafe/aithreadsafe.h"
+#include <vulkan/vulkan.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include "debug.h"
+
+namespace task {
+class SynchronousWindow;
+} // namespace task
+
+namespace vulkan {
+class LogicalDevice;
+} // namespace vulkan
+
+namespace task {
+
+// AsyncPresenter
+//
+// Presents the frames of one window and acquires the next swapchain image ahead of time, so that
+// a blocking vkQueuePresentKHR or vkAcquireNextImageKHR (for example, with FIFO present mode) doesn't block
+// the render loop: recording frame N + 1 overlaps with presenting frame N.
+//
+// The render loop hands over each frame with present_and_acquire (see SynchronousWindow::finish_frame)
+// and takes the acquired image with take_acquired (see SynchronousWindow::acquire_image). When no image
+// is available yet, the render loop waits for the swapchain_image_acquired condition, which this task
+// signals after each acquire. As a result all access to the swapchain happens on this task while it is
+// in use; the render loop must call drain() before it recreates the swapchain or stops rendering.
+//
+// The handoff queue holds at most one request: the render loop can't hand over frame N + 1 before
+// it took the image of frame N + 1, which is acquired after presenting frame N.
+//
+// The presentation queue might also be the graphics queue; the render loop must lock queue_mutex()
+// while it submits to the graphics queue (vulkan requires external synchronization of queue access).
+//
+// Presenting blocks a thread of the queue that this task runs on.
+//
+class AsyncPresenter : public vulkan::AsyncTask
+{
+ public:
+  static constexpr condition_type have_request = 1;
+
+  // The result of acquiring a swapchain image.
+  struct Acquired
+  {
+    vk::Result m_result;                        // If not eSuccess or eSuboptimalKHR then m_vh_acquire_semaphore will not be signaled.
+    vulkan::SwapchainIndex m_swapchain_index;
+    vk::Semaphore m_vh_acquire_semaphore;       // The semaphore that is signaled when the image can be used.
+  };
+
+ private:
+  struct Request
+  {
+    vk::SwapchainKHR m_vh_swapchain;
+    bool m_present;                             // Set if m_swapchain_index must be presented first.
+    vulkan::SwapchainIndex m_swapchain_index;
+    vk::Semaphore m_vh_rendering_finished_semaphore;
+    vk::Semaphore m_vh_acquire_semaphore;       // The semaphore to acquire the next image with.
+  };
+
+  struct State
+  {
+    std::optional<Request> m_request;           // The handoff queue.
+    bool m_busy = false;                        // Set while a request is being processed.
+    std::optional<Acquired> m_acquired;         // The image that was acquired ahead of time.
+    vk::Result m_present_result = vk::Result::eSuccess;       // The first not-eSuccess result of presenting since the last call to take_present_result.
+    uint64_t m_number_of_presents = 0;
+  };
+  using state_t = aithreadsafe::Wrapper<State, aithreadsafe::policy::Primitive<std::mutex>>;
+
+  SynchronousWindow* m_owning_window;
+  vulkan::LogicalDevice const* m_logical_device;
+  vk::Queue m_vh_presentation_queue;
+  state_t m_state;
+  std::mutex m_idle_mutex;                      // Locked by process() after it cleared m_busy, before notifying m_idle_condition.
+  std::condition_variable m_idle_condition;     // Notified when a request was processed (see drain()).
+  std::mutex m_queue_mutex;
+  std::atomic_bool m_terminate{false};
+
+ protected:
+  using direct_base_type = vulkan::AsyncTask;
+
+  // The different states of the task.
+  enum AsyncPresenter_state_type {
+    AsyncPresenter_wait = direct_base_type::state_end,
+    AsyncPresenter_done
+  };
+
+ public:
+  static state_type constexpr state_end = AsyncPresenter_done + 1;
+
+  AsyncPresenter(SynchronousWindow* owning_window, vulkan::LogicalDevice const* logical_device, vk::Queue vh_presentation_queue
+      COMMA_CWDEBUG_ONLY(bool debug = false)) :
+    direct_base_type(CWDEBUG_ONLY(debug)), m_owning_window(owning_window), m_logical_device(logical_device), m_vh_presentation_queue(vh_presentation_queue) { }
+
+  // Called by the render loop. Present swapchain_index (after rendering_finished is signaled) and then acquire
+  // the next image with acquire_semaphore. If present is false, only acquire an image.
+  // Does nothing if an image was acquired already, or is being acquired, and nothing has to be presented.
+  void present_and_acquire(vk::SwapchainKHR vh_swapchain, bool present, vulkan::SwapchainIndex swapchain_index,
+      vk::Semaphore vh_rendering_finished_semaphore, vk::Semaphore vh_acquire_semaphore);
+
+  // Called by the render loop. Returns true if take_acquired() will return an image (or the error that prevented acquiring one).
+  bool has_acquired() const { return state_t::crat(m_state)->m_acquired.has_value(); }
+
+  // Called by the render loop. Returns the image that was acquired ahead of time, if any.
+  std::optional<Acquired> take_acquired();
+
+  // Called by the render loop. Returns (and resets) the result of presenting the frames that were handed over.
+  vk::Result take_present_result();
+
+  // Called by the render loop. Block until the last request was processed.
+  void drain();
+
+  // Called by the render loop, after drain(), when it stops rendering. The task finishes and no longer accesses the window.
+  void terminate() { m_terminate = true; signal(have_request); }
+
+  // Lock this while using the presentation queue (which might be the graphics queue) from another thread.
+  std::mutex& queue_mutex() { return m_queue_mutex; }
+
+  uint64_t number_of_presents() const { return state_t::crat(m_state)->m_number_of_presents; }
+
+ protected:
+  ~AsyncPresenter() override = default;
+
+  // Implementation of virtual functions of AIStatefulTask.
+  char const* condition_str_impl(condition_type condition) const override;
+  char const* state_str_impl(state_type run_state) const override;
+  char const* task_name_impl() const override;
+  void initialize_impl() override;
+  void multiplex_impl(state_type run_state) override;
+
+ private:
+  void process(Request const& request);
+};
+
+} // namespace task
@@ -3,6 +3,7 @@
 #include "SynchronousWindow.h"
 #include "LogicalDevice.h"
 #include "FrameResourcesData.h"
+#include <algorithm>
 
 namespace vulkan {
 
@@ -96,4 +97,12 @@ void RenderPass::update_render_area(vk::Rect2D render_area)
     .setRenderArea(render_area);
 }
 
+bool RenderPass::uses_swapchain_attachment() const
+{
+  auto const& attachment_nodes = known_attachments();
+  // The swapchain attachment is the only attachment without render graph attachment index.
+  return std::any_of(attachment_nodes.begin(), attachment_nodes.end(),
+      [](rendergraph::AttachmentNode const& node){ return node.attachment()->render_graph_attachment_index().undefined(); });
+}
+
 } // namespace vulkan
@@ -64,6 +64,9 @@ class RenderPass : public rendergraph::RenderPass
     return m_begin_info_chain.get<vk::RenderPassBeginInfo>();
   }
 
+  // Return true if one of the attachments of this render pass is the swapchain image.
+  bool uses_swapchain_attachment() const;
+
  private:
   // Return a vector with clear values for this RenderPass that
   // can be used for vk::RenderPassBeginInfo::pClearValues.
@@ -0,0 +1,351 @@
+#include "sys.h"
+#include "ShaderWatcher.h"
+#include "SynchronousWindow.h"
+#include "SynchronousTask.h"
+#include "Application.h"
+#include "shader_builder/ShaderInfo.h"
+#include "shader_builder/SPIRVCache.h"
+#include "vk_utils/get_binary_file_contents.h"
+#include "utils/AIAlert.h"
+#include <boost/container_hash/hash.hpp>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include "debug.h"
+#ifdef CWDEBUG
+#include "debug/debug_ostream_operators.h"
+#endif
+
+namespace task {
+
+namespace synchronous {
+
+// Task used to recreate pipeline factories from the render loop of their window.
+class RecreatePipelines final : public SynchronousTask
+{
+ private:
+  std::vector<SynchronousWindow::PipelineFactoryIndex> m_factory_indices;       // The factories that used a shader that changed.
+
+ protected:
+  using direct_base_type = SynchronousTask;
+
+  // The different states of the stateful task.
+  enum recreate_pipelines_state_type {
+    RecreatePipelines_start = direct_base_type::state_end
+  };
+
+ public:
+  // One beyond the largest state of this task.
+  static constexpr state_type state_end = RecreatePipelines_start + 1;
+
+  RecreatePipelines(SynchronousWindow* owning_window, std::vector<SynchronousWindow::PipelineFactoryIndex>&& factory_indices COMMA_CWDEBUG_ONLY(bool debug)) :
+    direct_base_type(owning_window COMMA_CWDEBUG_ONLY(debug)), m_factory_indices(std::move(factory_indices))
+  {
+    DoutEntering(dc::vulkan, "RecreatePipelines::RecreatePipelines(" << owning_window << ", " << m_factory_indices << ") [" << this << "]");
+  }
+
+ protected:
+  // Call finish() (or abort()), not delete.
+  ~RecreatePipelines() override
+  {
+    DoutEntering(dc::vulkan, "RecreatePipelines::~RecreatePipelines() [" << this << "]");
+  }
+
+  char const* state_str_impl(state_type run_state) const override
+  {
+    switch (run_state)
+    {
+      AI_CASE_RETURN(RecreatePipelines_start);
+    }
+    AI_NEVER_REACHED
+  }
+
+  char const* task_name_impl() const override
+  {
+    return "RecreatePipelines";
+  }
+
+  void multiplex_impl(state_type run_state) override
+  {
+    switch (run_state)
+    {
+      case RecreatePipelines_start:
+        owning_window()->recreate_pipeline_factories({}, m_factory_indices);
+        finish();
+        break;
+    }
+  }
+};
+
+} // namespace synchronous
+
+ShaderWatcher::ShaderWatcher(CWDEBUG_ONLY(bool debug)) : direct_base_type(CWDEBUG_ONLY(debug)), m_inotify_fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+{
+  DoutEntering(dc::vulkan, "ShaderWatcher::ShaderWatcher() [" << this << "]");
+  if (m_inotify_fd == -1)
+    THROW_ALERT("inotify_init1 failed: [ERROR]", AIArgs("[ERROR]", std::strerror(errno)));
+}
+
+ShaderWatcher::~ShaderWatcher()
+{
+  DoutEntering(dc::vulkan, "ShaderWatcher::~ShaderWatcher() [" << this << "]");
+  close(m_inotify_fd);
+}
+
+char const* ShaderWatcher::condition_str_impl(condition_type condition) const
+{
+  switch (condition)
+  {
+    AI_CASE_RETURN(poll_timer);
+  }
+  return direct_base_type::condition_str_impl(condition);
+}
+
+char const* ShaderWatcher::state_str_impl(state_type run_state) const
+{
+  switch (run_state)
+  {
+    AI_CASE_RETURN(ShaderWatcher_start);
+    AI_CASE_RETURN(ShaderWatcher_poll);
+    AI_CASE_RETURN(ShaderWatcher_done);
+  }
+  AI_NEVER_REACHED
+}
+
+char const* ShaderWatcher::task_name_impl() const
+{
+  return "ShaderWatcher";
+}
+
+void ShaderWatcher::add_source(std::filesystem::path const& source_filename, ShaderIndex shader_index)
+{
+  DoutEntering(dc::vulkan, "ShaderWatcher::add_source(" << source_filename << ", " << shader_index << ")");
+  std::error_code ec;
+  std::filesystem::path const path = std::filesystem::weakly_canonical(source_filename, ec);
+  if (ec)
+  {
+    Dout(dc::warning, "Can not watch " << source_filename << ": " << ec.message());
+    return;
+  }
+  std::filesystem::path const directory = path.parent_path();
+
+  watch_data_t::wat watch_data_w(m_watch_data);
+  // Adding a watch for the same directory twice returns the same watch descriptor.
+  int wd = inotify_add_watch(m_inotify_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+  if (wd == -1)
+  {
+    Dout(dc::warning, "inotify_add_watch(" << directory << ") failed: " << std::strerror(errno));
+    return;
+  }
+  watch_data_w->m_watched_directories[wd] = directory;
+  std::vector<ShaderIndex>& shader_indices = watch_data_w->m_source_to_shaders[path];
+  if (std::find(shader_indices.begin(), shader_indices.end(), shader_index) == shader_indices.end())
+    shader_indices.push_back(shader_index);
+}
+
+void ShaderWatcher::add_dependent(ShaderIndex shader_index, SynchronousWindow* window, PipelineFactoryIndex factory_index)
+{
+  watch_data_t::wat watch_data_w(m_watch_data);
+  watch_data_w->m_dependents[shader_index].emplace(window, factory_index);
+}
+
+void ShaderWatcher::remove_window(SynchronousWindow const* window)
+{
+  DoutEntering(dc::vulkan, "ShaderWatcher::remove_window(" << window << ")");
+  watch_data_t::wat watch_data_w(m_watch_data);
+  for (auto& shader_dependents : watch_data_w->m_dependents)
+    std::erase_if(shader_dependents.second, [window](auto const& window_factory_pair){ return window_factory_pair.first == window; });
+}
+
+//static
+size_t ShaderWatcher::compiled_spirv_key(vulkan::shader_builder::ShaderInfo const& shader_info, std::string_view glsl_source_code)
+{
+  size_t key = static_cast<size_t>(shader_info.stage());
+  boost::hash_combine(key, shader_info.compiler_options().hash());
+  boost::hash_combine(key, boost::hash<std::string_view>{}(glsl_source_code));
+  return key;
+}
+
+bool ShaderWatcher::find_compiled_spirv(vulkan::shader_builder::ShaderInfo const& shader_info, std::string_view glsl_source_code, std::vector<uint32_t>& spirv_code_out) const
+{
+  size_t const key = compiled_spirv_key(shader_info, glsl_source_code);
+  compiled_spirv_t::wat compiled_spirv_w(m_compiled_spirv);
+  auto iter = compiled_spirv_w->m_map.find(key);
+  if (iter == compiled_spirv_w->m_map.end() || iter->second.m_glsl_source_code != glsl_source_code)
+    return false;
+  iter->second.m_last_used = ++compiled_spirv_w->m_use_count;
+  spirv_code_out = iter->second.m_spirv_code;
+  Dout(dc::vulkan, "Using previously compiled SPIR-V code for shader \"" << shader_info.name() << "\".");
+  return true;
+}
+
+void ShaderWatcher::store_compiled_spirv(vulkan::shader_builder::ShaderInfo const& shader_info, std::string_view glsl_source_code, std::vector<uint32_t> const& spirv_code)
+{
+  size_t const key = compiled_spirv_key(shader_info, glsl_source_code);
+  compiled_spirv_t::wat compiled_spirv_w(m_compiled_spirv);
+  auto& map = compiled_spirv_w->m_map;
+  if (map.size() >= max_compiled_spirv && !map.contains(key))
+  {
+    // Forget the least recently used shader.
+    auto lru = std::min_element(map.begin(), map.end(),
+        [](auto const& lhs, auto const& rhs){ return lhs.second.m_last_used < rhs.second.m_last_used; });
+    map.erase(lru);
+  }
+  map[key] = { std::string{glsl_source_code}, spirv_code, ++compiled_spirv_w->m_use_count };
+}
+
+std::set<std::filesystem::path> ShaderWatcher::read_events()
+{
+  std::set<std::filesystem::path> changed_files;
+  alignas(inotify_event) char buf[4096];
+  for (;;)
+  {
+    ssize_t len = read(m_inotify_fd, buf, sizeof(buf));
+    if (len == -1)
+    {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN)
+        Dout(dc::warning, "read(inotify_fd) failed: " << std::strerror(errno));
+      break;
+    }
+    watch_data_t::rat watch_data_r(m_watch_data);
+    for (char const* ptr = buf; ptr < buf + len;)
+    {
+      inotify_event const* event = reinterpret_cast<inotify_event const*>(ptr);
+      ptr += sizeof(inotify_event) + event->len;
+      if (event->len == 0)
+        continue;
+      auto directory = watch_data_r->m_watched_directories.find(event->wd);
+      if (directory == watch_data_r->m_watched_directories.end())
+        continue;
+      std::filesystem::path path = directory->second / event->name;
+      // Ignore other files in the same directory.
+      if (watch_data_r->m_source_to_shaders.contains(path))
+        changed_files.insert(std::move(path));
+    }
+  }
+  return changed_files;
+}
+
+void ShaderWatcher::handle_changes(std::set<std::filesystem::path> const& changed_files)
+{
+  DoutEntering(dc::vulkan, "ShaderWatcher::handle_changes(" << changed_files << ")");
+  vulkan::Application& application = vulkan::Application::instance();
+  std::map<SynchronousWindow*, std::set<PipelineFactoryIndex>> affected;
+
+  for (std::filesystem::path const& path : changed_files)
+  {
+    std::vector<ShaderIndex> shader_indices;
+    {
+      watch_data_t::rat watch_data_r(m_watch_data);
+      shader_indices = watch_data_r->m_source_to_shaders.at(path);
+    }
+
+    std::string source;
+    try
+    {
+      std::vector<std::byte> const file_data = vk_utils::get_binary_file_contents(path, application.file_reader());
+      source.assign(reinterpret_cast<char const*>(file_data.data()), file_data.size());
+    }
+    catch (AIAlert::Error const& error)
+    {
+      // Perhaps the file is being replaced; we'll get another event when it is written.
+      Dout(dc::warning, error);
+      continue;
+    }
+
+    for (ShaderIndex shader_index : shader_indices)
+    {
+      vulkan::shader_builder::ShaderInfo const& current_shader_info = application.get_shader_info(shader_index);
+      vulkan::shader_builder::ShaderInfo reloaded_shader_info(current_shader_info);
+      reloaded_shader_info.load(std::string_view{source});
+      if (reloaded_shader_info.glsl_template_code() == current_shader_info.glsl_template_code())
+        continue;       // Saved without changes.
+
+      // Compile shaders that do not need preprocessing right away, so that errors don't end up in the pipeline factories.
+      if (reloaded_shader_info.glsl_template_code().starts_with("#version"))
+      {
+        try
+        {
+          vulkan::shader_builder::SPIRVCache spirv_cache;
+          spirv_cache.compile(reloaded_shader_info.glsl_template_code(), m_compiler, reloaded_shader_info);
+        }
+        catch (AIAlert::Error const& error)
+        {
+          Dout(dc::warning, "Not reloading shader \"" << current_shader_info.name() << "\" from " << path << ": " << error);
+          continue;
+        }
+      }
+
+      Dout(dc::notice, "Reloading shader \"" << current_shader_info.name() << "\" (" << shader_index << ") from " << path << ".");
+      application.reload_shader({}, shader_index, std::move(reloaded_shader_info));
+
+      watch_data_t::wat watch_data_w(m_watch_data);
+      auto dependents = watch_data_w->m_dependents.find(shader_index);
+      if (dependents == watch_data_w->m_dependents.end())
+        continue;
+      for (auto const& window_factory_pair : dependents->second)
+        affected[window_factory_pair.first].insert(window_factory_pair.second);
+      // The recreated factories will register themselves again.
+      watch_data_w->m_dependents.erase(dependents);
+    }
+  }
+
+  // Hold the lock on m_watch_data so that none of the windows can be removed in the meantime.
+  watch_data_t::wat watch_data_w(m_watch_data);
+  for (auto& window_factories_pair : affected)
+  {
+    SynchronousWindow* window = window_factories_pair.first;
+    std::vector<PipelineFactoryIndex> factory_indices(window_factories_pair.second.begin(), window_factories_pair.second.end());
+    Dout(dc::notice, "Recreating " << factory_indices.size() << " pipeline factories of window " << window << ".");
+    statefultask::create<synchronous::RecreatePipelines>(window, std::move(factory_indices) COMMA_CWDEBUG_ONLY(mSMDebug))->run();
+  }
+}
+
+void ShaderWatcher::stop_timer()
+{
+  if (!m_poll_rate_limiter.stop())
+  {
+    // We could not stop the timer from firing. Wait until it returned from expire().
+    m_poll_rate_limiter.wait_for_possible_expire_to_finish();
+  }
+}
+
+void ShaderWatcher::multiplex_impl(state_type run_state)
+{
+  switch (run_state)
+  {
+    case ShaderWatcher_start:
+      set_state(ShaderWatcher_poll);
+      [[fallthrough]];
+    case ShaderWatcher_poll:
+    {
+      if (m_terminate)
+      {
+        set_state(ShaderWatcher_done);
+        break;
+      }
+      std::set<std::filesystem::path> changed_files = read_events();
+      if (!changed_files.empty())
+        handle_changes(changed_files);
+      m_poll_rate_limiter.start(m_poll_rate_interval);
+      wait(poll_timer);
+      break;
+    }
+    case ShaderWatcher_done:
+      stop_timer();
+      finish();
+      break;
+  }
+}
+
+void ShaderWatcher::abort_impl()
+{
+  DoutEntering(dc::vulkan, "ShaderWatcher::abort_impl()");
+  stop_timer();
+}
+
+} // namespace task
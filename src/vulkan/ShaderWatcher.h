@@ -0,0 +1,154 @@
+#pragma once
+
+#include "AsyncTask.h"
+#include "pipeline/Handle.h"
+#include "shader_builder/ShaderIndex.h"
+#include "shader_builder/ShaderCompiler.h"
+#include "threadpool/Timer.h"
+#include "threadsafe/aithreadsafe.h"
+#include <atomic>
+#include <filesystem>
+#include <unordered_map>
+#include <map>
+#include <set>
+#include <vector>
+#include <string>
+
+namespace vulkan::shader_builder {
+class ShaderInfo;
+} // namespace vulkan::shader_builder
+
+namespace task {
+
+class SynchronousWindow;
+
+// ShaderWatcher
+//
+// Watches the source files of the shader templates that were loaded with
+// ShaderInfo::load(std::filesystem::path) and registered with Application::register_shaders,
+// when shader hot-reload is enabled (see Application::use_shader_hot_reload).
+//
+// Dependencies are tracked at two levels:
+//
+//   source file --> the ShaderIndex's that were loaded from it                 (add_source, called by Application::register_shaders)
+//   ShaderIndex --> the (window, pipeline factory) pairs that compiled it      (add_dependent, called by CharacteristicRange::build_shader)
+//
+// The directories that contain the source files are watched with inotify (editors often
+// replace a file by renaming a temporary file, which would lose a watch on the file itself).
+// The inotify file descriptor is polled a few times per second; all changes that are
+// seen in a single poll are handled as one batch.
+//
+// For each changed source file the ShaderInfo of every ShaderIndex loaded from it is
+// reloaded (see Application::reload_shader). Shaders that do not need preprocessing
+// (that start with "#version") are compiled immediately, on the thread pool thread that
+// runs this task; if that fails the old shader is kept and the error is printed.
+// Then each window that uses one of the changed shaders is told to recreate the affected
+// pipeline factories, from its render loop (hence between two frames).
+//
+// While hot-reload is enabled, SPIRVCache::compile also stores all compiled SPIR-V code
+// here, keyed by stage, compiler options and the (preprocessed) source code, so that
+// regenerating a pipeline factory only recompiles the shaders that actually changed.
+// At most max_compiled_spirv results are kept; the least recently used one is dropped first.
+//
+// The task runs until terminate() is called (by Application::~Application).
+//
+class ShaderWatcher : public vulkan::AsyncTask
+{
+ public:
+  using ShaderIndex = vulkan::shader_builder::ShaderIndex;
+  using PipelineFactoryIndex = vulkan::pipeline::Handle::PipelineFactoryIndex;
+
+  static constexpr condition_type poll_timer = 1;
+
+  // The maximum number of compiled shaders that are remembered.
+  static constexpr size_t max_compiled_spirv = 256;
+
+ private:
+  struct WatchData
+  {
+    std::map<int, std::filesystem::path> m_watched_directories;                         // inotify watch descriptor --> watched directory.
+    std::map<std::filesystem::path, std::vector<ShaderIndex>> m_source_to_shaders;      // Source file --> the shaders that were loaded from it.
+    std::map<ShaderIndex, std::set<std::pair<SynchronousWindow*, PipelineFactoryIndex>>> m_dependents;  // Shader --> the pipeline factories that compiled it.
+  };
+  using watch_data_t = aithreadsafe::Wrapper<WatchData, aithreadsafe::policy::Primitive<std::mutex>>;
+
+  struct CompiledSPIRV
+  {
+    std::string m_glsl_source_code;                     // The source code that was compiled (to protect against hash collisions).
+    std::vector<uint32_t> m_spirv_code;                 // The result.
+    uint64_t m_last_used;                               // The value of m_use_count when this was last stored or found.
+  };
+  struct CompiledSPIRVContainer
+  {
+    std::unordered_map<size_t, CompiledSPIRV> m_map;
+    uint64_t m_use_count{0};
+  };
+  using compiled_spirv_container_t = CompiledSPIRVContainer;
+  using compiled_spirv_t = aithreadsafe::Wrapper<compiled_spirv_container_t, aithreadsafe::policy::Primitive<std::mutex>>;
+
+  int m_inotify_fd;                                     // The inotify instance (non-blocking).
+  watch_data_t m_watch_data;
+  mutable compiled_spirv_t m_compiled_spirv;            // Mutable because find_compiled_spirv updates m_last_used.
+  std::atomic_bool m_terminate{false};
+  vulkan::shader_builder::ShaderCompiler m_compiler;    // Used to validate reloaded shaders that do not need preprocessing.
+
+  threadpool::Timer::Interval m_poll_rate_interval{threadpool::Interval<250, std::chrono::milliseconds>{}};    // The time between two polls.
+  threadpool::Timer m_poll_rate_limiter{[this](){ signal(poll_timer); }};
+
+ protected:
+  using direct_base_type = vulkan::AsyncTask;
+
+  // The different states of the task.
+  enum ShaderWatcher_state_type {
+    ShaderWatcher_start = direct_base_type::state_end,
+    ShaderWatcher_poll,
+    ShaderWatcher_done
+  };
+
+ public:
+  static state_type constexpr state_end = ShaderWatcher_done + 1;
+
+  ShaderWatcher(CWDEBUG_ONLY(bool debug = false));
+
+  // Stop watching and finish the task.
+  void terminate() { m_terminate = true; signal(poll_timer); }
+
+  // Watch source_filename; shader_index was loaded from it.
+  void add_source(std::filesystem::path const& source_filename, ShaderIndex shader_index);
+
+  // Register that the pipeline factory factory_index of window compiled the shader shader_index.
+  void add_dependent(ShaderIndex shader_index, SynchronousWindow* window, PipelineFactoryIndex factory_index);
+
+  // Forget all dependents of window (called when the window is removed from the Application).
+  void remove_window(SynchronousWindow const* window);
+
+  // Look up previously compiled SPIR-V code. Returns true if found, in which case spirv_code_out is set.
+  bool find_compiled_spirv(vulkan::shader_builder::ShaderInfo const& shader_info, std::string_view glsl_source_code, std::vector<uint32_t>& spirv_code_out) const;
+
+  // Store the result of a compilation.
+  void store_compiled_spirv(vulkan::shader_builder::ShaderInfo const& shader_info, std::string_view glsl_source_code, std::vector<uint32_t> const& spirv_code);
+
+ protected:
+  ~ShaderWatcher() override;
+
+  // Implementation of virtual functions of AIStatefulTask.
+  char const* condition_str_impl(condition_type condition) const override;
+  char const* state_str_impl(state_type run_state) const override;
+  char const* task_name_impl() const override;
+  void multiplex_impl(state_type run_state) override;
+  void abort_impl() override;
+
+ private:
+  // Read all pending inotify events and return the (canonical) paths of the files that were written.
+  std::set<std::filesystem::path> read_events();
+
+  // Reload the shaders that were loaded from the files in changed_files and notify the affected windows.
+  void handle_changes(std::set<std::filesystem::path> const& changed_files);
+
+  // Stop the poll timer (if possible).
+  void stop_timer();
+
+  static size_t compiled_spirv_key(vulkan::shader_builder::ShaderInfo const& shader_info, std::string_view glsl_source_code);
+};
+
+} // namespace task
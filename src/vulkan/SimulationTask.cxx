@@ -0,0 +1,96 @@
+#include "sys.h"
+#include "SimulationTask.h"
+#include "debug.h"
+
+namespace task {
+
+char const* SimulationTask::condition_str_impl(condition_type condition) const
+{
+  switch (condition)
+  {
+    AI_CASE_RETURN(tick_timer);
+  }
+  return direct_base_type::condition_str_impl(condition);
+}
+
+char const* SimulationTask::state_str_impl(state_type run_state) const
+{
+  switch (run_state)
+  {
+    AI_CASE_RETURN(SimulationTask_start);
+    AI_CASE_RETURN(SimulationTask_tick);
+    AI_CASE_RETURN(SimulationTask_done);
+  }
+  AI_NEVER_REACHED
+}
+
+char const* SimulationTask::task_name_impl() const
+{
+  return "SimulationTask";
+}
+
+void SimulationTask::stop_timer()
+{
+  if (!m_tick_timer.stop())
+  {
+    // We could not stop the timer from firing. Wait until it returned from expire().
+    m_tick_timer.wait_for_possible_expire_to_finish();
+  }
+}
+
+void SimulationTask::multiplex_impl(state_type run_state)
+{
+  switch (run_state)
+  {
+    case SimulationTask_start:
+      m_simulation_time = clock_type::now();
+      set_state(SimulationTask_tick);
+      [[fallthrough]];
+    case SimulationTask_tick:
+    {
+      if (m_terminate)
+      {
+        set_state(SimulationTask_done);
+        break;
+      }
+      // Start the timer first, so that the time spent in tick() doesn't add to the interval.
+      m_tick_timer.start(m_tick_interval);
+      clock_type::time_point const now = clock_type::now();
+      auto const tick_duration = std::chrono::duration_cast<clock_type::duration>(m_tick_duration);
+      int ticks = 0;
+      // Never simulate ahead of the wall clock.
+      while (m_simulation_time + tick_duration <= now)
+      {
+        if (ticks == max_ticks_per_run())
+        {
+          // We can't keep up; drop the remaining time.
+          uint64_t const behind = (now - m_simulation_time) / tick_duration;
+          Dout(dc::warning, "SimulationTask: dropping " << behind << " ticks.");
+          m_dropped_ticks += behind;
+          m_simulation_time += behind * tick_duration;
+          break;
+        }
+        tick();
+        m_simulation_time += tick_duration;
+        ++m_tick_count;
+        ++ticks;
+      }
+      if (ticks > 0)
+        publish();
+      wait(tick_timer);
+      break;
+    }
+    case SimulationTask_done:
+      stop_timer();
+      finish();
+      break;
+  }
+}
+
+void SimulationTask::abort_impl()
+{
+  DoutEntering(dc::vulkan, "SimulationTask::abort_impl()");
+  stop_timer();
+}
+
+} // namespace task
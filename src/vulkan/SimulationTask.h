@@ -0,0 +1,178 @@
+#pragma once
+
+#include "AsyncTask.h"
+#include "TripleBuffer.h"
+#include "threadpool/Timer.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <concepts>
+
+namespace task {
+
+// SimulationTask
+//
+// Runs the simulation (the application state that changes over time) at a fixed tick rate,
+// independent of the frame rate of the windows that render it.
+//
+// The task runs on the thread pool (pass Application::medium_priority_queue() to run()) and is woken up
+// by a timer every tick interval. Each time it runs it executes as many fixed-size ticks as needed to catch
+// up with the wall clock, so that the simulated time never gets ahead of the real time and a late wake-up
+// (a busy thread pool) doesn't slow down the simulation; if it falls behind more than max_ticks_per_run()
+// ticks then the remaining time is dropped instead of trying to catch up (the simulation is too heavy).
+//
+// Because the tick size is fixed the simulation is deterministic and independent of the frame rate and
+// present mode; slow frames don't slow down the simulation and heavy ticks never stall the recording
+// of command buffers. The state is handed over to the render loop(s) through a TripleBuffer, see Simulation.
+//
+// The task runs until terminate() is called.
+//
+class SimulationTask : public vulkan::AsyncTask
+{
+ public:
+  using clock_type = std::chrono::steady_clock;
+  using duration_type = std::chrono::duration<double>;
+
+  static constexpr condition_type tick_timer = 1;
+
+ private:
+  threadpool::Timer::Interval m_tick_interval;          // The wake-up interval of the task (the tick rate).
+  threadpool::Timer m_tick_timer{[this](){ signal(tick_timer); }};
+  std::atomic_bool m_terminate{false};
+
+ protected:
+  duration_type const m_tick_duration;                  // The simulated time of one tick.
+  clock_type::time_point m_simulation_time;             // The (wall clock) time that the current state belongs to.
+  uint64_t m_tick_count = 0;                            // The number of ticks since the start.
+  uint64_t m_dropped_ticks = 0;                         // The number of ticks that were skipped because the simulation was too slow.
+
+ protected:
+  using direct_base_type = vulkan::AsyncTask;
+
+  // The different states of the task.
+  enum SimulationTask_state_type {
+    SimulationTask_start = direct_base_type::state_end,
+    SimulationTask_tick,
+    SimulationTask_done
+  };
+
+ public:
+  static state_type constexpr state_end = SimulationTask_done + 1;
+
+  // Run the simulation with a tick every `count` times `Unit`; for example threadpool::Interval<10, std::chrono::milliseconds>{}.
+  template<int count, typename Unit>
+  SimulationTask(threadpool::Interval<count, Unit> tick_interval COMMA_CWDEBUG_ONLY(bool debug = false)) :
+    direct_base_type(CWDEBUG_ONLY(debug)), m_tick_interval(tick_interval), m_tick_duration(Unit{count}) { }
+
+  // Stop the simulation and finish the task.
+  void terminate() { m_terminate = true; signal(tick_timer); }
+
+  // Accessors.
+  duration_type tick_duration() const { return m_tick_duration; }
+  uint64_t dropped_ticks() const { return m_dropped_ticks; }
+
+ protected:
+  ~SimulationTask() override = default;
+
+  // Advance the simulation by one tick (m_tick_duration). Called on the thread pool.
+  virtual void tick() = 0;
+
+  // Make the result of the last tick available to the render loop(s). Called after one or more calls to tick().
+  virtual void publish() = 0;
+
+  // The maximum number of ticks that are executed in one run before the simulation drops time.
+  virtual int max_ticks_per_run() const { return 8; }
+
+  // Implementation of virtual functions of AIStatefulTask.
+  char const* condition_str_impl(condition_type condition) const override;
+  char const* state_str_impl(state_type run_state) const override;
+  char const* task_name_impl() const override;
+  void multiplex_impl(state_type run_state) override;
+  void abort_impl() override;
+
+ private:
+  void stop_timer();
+};
+
+// The objects that are passed from the simulation to the render loop: the two last states, so that
+// the render loop can interpolate between them.
+template<typename State>
+struct SimulationSnapshot
+{
+  State m_previous;                                     // The state at m_time - tick_duration().
+  State m_current;                                      // The state at m_time.
+  SimulationTask::clock_type::time_point m_time;        // The time that m_current belongs to.
+  uint64_t m_tick = 0;                                  // The tick that produced m_current (zero: there is no snapshot yet).
+};
+
+template<typename State>
+concept ConceptInterpolatableState = std::copyable<State> && requires(State const& a, State const& b, float alpha)
+{
+  { State::interpolate(a, b, alpha) } -> std::convertible_to<State>;
+};
+
+// Simulation
+//
+// A SimulationTask for a given State type. Derive from this class and override
+//
+//   void update(State& state, double dt)
+//
+// to advance state by dt seconds. State must be copyable and provide
+//
+//   static State interpolate(State const& from, State const& to, float alpha);
+//
+// The render loop of one window (the single consumer of the triple buffer) calls interpolated(now)
+// once per frame; this returns the state at `now - tick_duration()`, interpolated between the
+// two last ticks. Rendering one tick behind makes the motion smooth regardless of the phase
+// between the frames and the ticks.
+//
+template<ConceptInterpolatableState State>
+class Simulation : public SimulationTask
+{
+ private:
+  State m_state;                                        // Only accessed by the simulation.
+  State m_previous_state;
+  vulkan::TripleBuffer<SimulationSnapshot<State>> m_snapshots;
+
+ public:
+  template<int count, typename Unit>
+  Simulation(threadpool::Interval<count, Unit> tick_interval, State const& initial_state COMMA_CWDEBUG_ONLY(bool debug = false)) :
+    SimulationTask(tick_interval COMMA_CWDEBUG_ONLY(debug)), m_state(initial_state), m_previous_state(initial_state),
+    m_snapshots(SimulationSnapshot<State>{ initial_state, initial_state, {}, 0 }) { }
+
+  // Called by the render loop: the state at now - tick_duration().
+  // Returns false (and doesn't change state_out) if the first tick didn't happen yet.
+  bool interpolated(clock_type::time_point now, State& state_out)
+  {
+    m_snapshots.update();
+    SimulationSnapshot<State> const& snapshot = m_snapshots.read_buffer();
+    if (snapshot.m_tick == 0)
+      return false;
+    float const alpha = std::clamp(static_cast<float>(duration_type{now - snapshot.m_time} / m_tick_duration), 0.0f, 1.0f);
+    state_out = State::interpolate(snapshot.m_previous, snapshot.m_current, alpha);
+    return true;
+  }
+
+ protected:
+  // Advance state by dt seconds.
+  virtual void update(State& state, double dt) = 0;
+
+ private:
+  void tick() override
+  {
+    m_previous_state = m_state;
+    update(m_state, m_tick_duration.count());
+  }
+
+  void publish() override
+  {
+    SimulationSnapshot<State>& snapshot = m_snapshots.write_buffer();
+    snapshot.m_previous = m_previous_state;
+    snapshot.m_current = m_state;
+    snapshot.m_time = m_simulation_time;
+    snapshot.m_tick = m_tick_count;
+    m_snapshots.publish();
+  }
+};
+
+} // namespace task
@@ -26,6 +26,7 @@ void SpecialCircumstances::set_mapped() const
     return;
   m_map_flags.fetch_or(OR_UNMAPPED_to_MAPPED, std::memory_order::relaxed);
   m_flags.fetch_or(map_changed_bit, std::memory_order::release);              // Make m_map_flags available.
+  wake_up_if_idle();
 }
 
 void SpecialCircumstances::set_unmapped() const
@@ -34,6 +35,7 @@ void SpecialCircumstances::set_unmapped() const
     return;
   m_map_flags.fetch_and(AND_MAPPED_to_UNMAPPED, std::memory_order::relaxed);
   m_flags.fetch_or(map_changed_bit, std::memory_order::release);              // Make m_map_flags available.
+  wake_up_if_idle();
 }
 
 #ifdef CWDEBUG
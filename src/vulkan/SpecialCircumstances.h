@@ -20,6 +20,20 @@ class Swapchain;
 //
 // The exception here are have_no_swapchain_bit and minimized_bit: also can_render_again() is only
 // called synchronously; hence that can_render() returns False or True, not a fuzzy boolean.
+//
+// Idle mode: when nothing visible can change (the window is minimized, fully occluded or static)
+// the render loop doesn't run at all, not even on a timer; it parks on a condition (enter_idle).
+// Every asynchronous change (setting one of the bits above, input, invalidation) then calls
+// wake_up_if_idle, which signals the render loop exactly once.
+//
+//    Other thread                        Render loop
+//    <Set flag>                          <m_idle = true>
+//    [fence]                             [fence]
+//    <m_idle.exchange(false)>            <Read flags>
+//      true: wake_up_render_loop()         changed: m_idle.exchange(false) ? don't park : park (a signal is on its way)
+//                                          unchanged: park
+//
+// Because of the two fences at least one of the two threads sees the store of the other.
 class SpecialCircumstances
 {
  protected:
@@ -92,6 +106,9 @@ class SpecialCircumstances
   friend class AsyncAccessSpecialCircumstances;
   mutable std::atomic_int m_flags;              // Bit mask of the above bits.
   mutable std::atomic_int m_map_flags{handled_MAPPED};
+  mutable std::atomic_bool m_idle{false};       // Set while the render loop is parked (see enter_idle).
+  mutable std::atomic_bool m_occluded{false};   // Set while the window is fully obscured by other windows.
+  mutable std::atomic_bool m_invalidated{false};        // Set when the contents of the window must be redrawn (input events, explicit invalidation).
 
   bool is_mapped() const { return (m_map_flags.load(std::memory_order::relaxed) & MAPPED_bit); }
 
@@ -107,6 +124,7 @@ class SpecialCircumstances
   static bool can_render(int flags) { return !(flags & (have_no_swapchain_bit|minimized_bit)); }// true = fuzzy::WasTrue, false = fuzzy::False.
   static bool have_synchronous_task(int flags) { return flags & have_synchronous_task_bit; }    // true = fuzzy::True, false = fuzzy::WasFalse.
   static bool map_changed(int flags) { return flags & map_changed_bit; }                        // true = fuzzy::True, false = fuzzy::WasFalse.
+  static bool is_minimized(int flags) { return flags & minimized_bit; }                         // Not fuzzy (only changed synchronously).
 
   // Accessor. The result must be passed to one of the above decoders.
   int atomic_flags() const { return m_flags.load(std::memory_order::acquire); }
@@ -123,10 +141,10 @@ class SpecialCircumstances
   // Control the extent_changed_bit.
   void reset_extent_changed() const { m_flags.fetch_and(~extent_changed_bit, std::memory_order::relaxed); }
   // Called when vk::Result::eErrorOutOfDateKHR happens in SynchronousWindow::acquire_image or SynchronousWindow::finish_frame.
-  void set_extent_changed() const { m_flags.fetch_or(extent_changed_bit, std::memory_order::relaxed); }
+  void set_extent_changed() const { m_flags.fetch_or(extent_changed_bit, std::memory_order::relaxed); wake_up_if_idle(); }
 
   // Control the must_close_bit bit.
-  void set_must_close() const { m_flags.fetch_or(must_close_bit, std::memory_order::relaxed); }
+  void set_must_close() const { m_flags.fetch_or(must_close_bit, std::memory_order::relaxed); wake_up_if_idle(); }
 
   // Called when the swapchain is being (re)created. Called from Swapchain::prepare and Swapchain::recreate.
   void no_swapchain() const { m_flags.fetch_or(have_no_swapchain_bit, std::memory_order::relaxed); }
@@ -138,7 +156,7 @@ class SpecialCircumstances
   void set_have_synchronous_task(utils::Badge<
       task::SynchronousTask,    // When running a SynchronousTask (calling SynchronousTask::run).
       SynchronousEngine         // When active tasks remained after the mainloop returned.
-      >) const { m_flags.fetch_or(have_synchronous_task_bit, std::memory_order::relaxed); }
+      >) const { m_flags.fetch_or(have_synchronous_task_bit, std::memory_order::relaxed); wake_up_if_idle(); }
 
   // Control the map_changed_bit.
   // Called when the window was just minimized.
@@ -152,6 +170,44 @@ class SpecialCircumstances
   // minimized_bit doesn't really have to be atomic therefore, but for not it seems handy.
   void set_minimized() const { m_flags.fetch_or(minimized_bit, std::memory_order::relaxed); }
   void set_unminimized() const { m_flags.fetch_and(~minimized_bit, std::memory_order::relaxed); }
+
+  // Occlusion: set asynchronously when the window becomes fully obscured, or visible again.
+  void set_occluded(bool occluded) const { m_occluded.store(occluded, std::memory_order::relaxed); wake_up_if_idle(); }
+  bool is_occluded() const { return m_occluded.load(std::memory_order::relaxed); }
+
+  // Invalidation: set asynchronously when the window must be redrawn, reset synchronously by the render loop.
+  void set_invalidated() const { m_invalidated.store(true, std::memory_order::relaxed); wake_up_if_idle(); }
+  // Returns true if the window was invalidated since the last call.
+  bool reset_invalidated() const { return m_invalidated.load(std::memory_order::relaxed) && m_invalidated.exchange(false, std::memory_order::relaxed); }
+
+  // Idle mode.
+  //
+  // Wake up the render loop if it is parked. Called after every asynchronous change.
+  void wake_up_if_idle() const
+  {
+    std::atomic_thread_fence(std::memory_order::seq_cst);
+    if (m_idle.load(std::memory_order::relaxed) && m_idle.exchange(false, std::memory_order::relaxed))
+      wake_up_render_loop();
+  }
+  // Called synchronously by the render loop when it wants to park, passing the flags and occlusion state that it just handled.
+  // Returns true if the render loop must wait until wake_up_render_loop() is called, and false when
+  // something changed in the meantime (then it must continue instead). An invalidation only counts
+  // as a change when wake_up_on_invalidation is set (that is, when the window parks because it is static).
+  bool enter_idle(int flags, bool occluded, bool wake_up_on_invalidation) const
+  {
+    m_idle.store(true, std::memory_order::relaxed);
+    std::atomic_thread_fence(std::memory_order::seq_cst);
+    bool const changed = m_flags.load(std::memory_order::relaxed) != flags ||
+        m_occluded.load(std::memory_order::relaxed) != occluded ||
+        (wake_up_on_invalidation && m_invalidated.load(std::memory_order::relaxed));
+    // If m_idle was already reset then wake_up_render_loop() is (being) called: wait for that.
+    return !changed || !m_idle.exchange(false, std::memory_order::relaxed);
+  }
+  // Called at the start of the render loop (it might have been woken up by something else).
+  void leave_idle() const { m_idle.store(false, std::memory_order::relaxed); }
+
+  // Signal the parked render loop. Called (once) by wake_up_if_idle.
+  virtual void wake_up_render_loop() const = 0;
 };
 
 } // namespace vulkan
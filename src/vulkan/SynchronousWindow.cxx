@@ -4,6 +4,9 @@
 #include "LogicalDevice.h"
 #include "Application.h"
 #include "FrameResourcesData.h"
+#include "memory/DeviceImagePoolBackend.h"
+#include "memory/DeviceSparseMipMemoryBackend.h"
+#include "TextureRegistry.h"
 #include "Exceptions.h"
 #include "SynchronousTask.h"
 #include "pipeline/Handle.h"
@@ -27,6 +30,7 @@
 #include "tracy/CwTracy.h"
 #include <vulkan/vk_format_utils.h>
 #include <algorithm>
+#include <array>
 #include "debug.h"
 
 #if defined(CWDEBUG) && !defined(DOXYGEN)
@@ -70,6 +74,17 @@ SynchronousWindow::~SynchronousWindow()
 {
   DoutEntering(dc::statefultask(mSMDebug), "task::SynchronousWindow::~SynchronousWindow() [" << (void*)this << "]");
   m_frame_rate_limiter.stop();
+  // The render loop might have been waiting for frame_resources_available when the task was aborted.
+  if (m_frame_semaphore)
+    m_frame_semaphore->remove_poll();
+  if (m_registered_with_submit_coalescer)
+    m_submit_coalescer->unregister_window(this);
+  // The present task has a pointer to this window.
+  if (m_presenter)
+  {
+    m_presenter->drain();
+    m_presenter->terminate();
+  }
   if (m_parent_window_task)
     m_parent_window_task->remove_child_window_task(this);
 }
@@ -126,6 +141,9 @@ char const* SynchronousWindow::condition_str_impl(condition_type condition) cons
     AI_CASE_RETURN(imgui_font_texture_ready);
     AI_CASE_RETURN(parent_window_created);
     AI_CASE_RETURN(condition_pipeline_available);
+    AI_CASE_RETURN(frame_resources_available);
+    AI_CASE_RETURN(render_loop_wake_up);
+    AI_CASE_RETURN(swapchain_image_acquired);
   }
   return direct_base_type::condition_str_impl(condition);
 }
@@ -321,6 +339,8 @@ void SynchronousWindow::multiplex_impl(state_type run_state)
       [[fallthrough]];
     case SynchronousWindow_render_loop:
     {
+      // We might have been woken up by something other than wake_up_render_loop().
+      leave_idle();
       if (m_use_imgui)
       {
         // Set a thread-local global variable that imgui uses to access its context.
@@ -337,11 +357,56 @@ void SynchronousWindow::multiplex_impl(state_type run_state)
           try
           {
             ZoneScopedNC("SynchronousWindow_render_loop / no special circumstances", 0xf5d193) // Tracy
+            // Don't run at all while nothing visible can change: park the render loop until something happens.
+            if (bool const occluded = is_occluded(); AI_UNLIKELY(occluded || is_static()))
+            {
+              // Don't let the other windows wait for our frames.
+              if (m_registered_with_submit_coalescer)
+              {
+                m_submit_coalescer->unregister_window(this);
+                m_registered_with_submit_coalescer = false;
+              }
+              // An invalidation only wakes up a static window: an occluded window remains idle until it is visible again.
+              if (enter_idle(special_circumstances, occluded, !occluded))
+              {
+                wait(render_loop_wake_up);
+                return;
+              }
+              special_circumstances = atomic_flags();
+              continue;
+            }
+            if (m_submit_coalescer && !m_registered_with_submit_coalescer)
+            {
+              m_submit_coalescer->register_window(this);
+              m_registered_with_submit_coalescer = true;
+            }
+            // Don't block the thread waiting for the GPU when the next frame resources are still in use:
+            // let the semaphore watcher of the logical device wake us up when they are available.
+            if (uint64_t const completed_value = next_frame_resources_completed_value();
+                AI_UNLIKELY(m_frame_semaphore->get_counter_value() < completed_value))
+            {
+              // The frame that we are waiting for might still be waiting for the other windows.
+              if (m_submit_coalescer)
+                m_submit_coalescer->flush_if_pending(this);
+              m_logical_device->add_timeline_semaphore_poll(m_frame_semaphore.get(), completed_value, this, frame_resources_available);
+              wait(frame_resources_available);
+              return;
+            }
+            // Likewise, don't block on acquiring the next swapchain image: the present task does that (see use_present_task).
+            if (m_presenter && AI_UNLIKELY(!m_presenter->has_acquired()))
+            {
+              // Only requests an image if none is being acquired already (as part of presenting the previous frame).
+              m_presenter->present_and_acquire(*m_swapchain, false, {}, {}, m_swapchain.vh_acquire_semaphore());
+              wait(swapchain_image_acquired);
+              return;
+            }
             // Render the next frame.
             m_frame_rate_limiter.start(m_frame_rate_interval);
             m_imgui_timer.update();   // Keep track of FPS and stuff.
             consume_input_events();
             render_frame();
+            if (m_frames_to_render > 0)
+              --m_frames_to_render;
             m_delay_by_completed_draw_frames.step({});
             yield(m_application->m_medium_priority_queue);
             wait(frame_timer);
@@ -398,6 +463,19 @@ void SynchronousWindow::multiplex_impl(state_type run_state)
         }
         if (!can_render(special_circumstances))
         {
+          // Don't let the other windows wait for our frames.
+          if (m_registered_with_submit_coalescer)
+          {
+            m_submit_coalescer->unregister_window(this);
+            m_registered_with_submit_coalescer = false;
+          }
+          // A minimized window has nothing to do until it is unminimized (or closed, etc): park the render loop.
+          if (is_minimized(special_circumstances))
+          {
+            if (enter_idle(special_circumstances, is_occluded(), false))
+              wait(render_loop_wake_up);
+            return;
+          }
           // We can't render, drop frame rate to 7.8 FPS (because slow_down already uses 128 ms anyway).
           static threadpool::Timer::Interval s_no_render_frame_rate_interval{threadpool::Interval<128, std::chrono::milliseconds>()};
           m_frame_rate_limiter.start(s_no_render_frame_rate_interval);
@@ -417,6 +495,8 @@ void SynchronousWindow::multiplex_impl(state_type run_state)
         }
         if (!need_draw_frame)
           return;
+        // A static window must be redrawn too.
+        set_invalidated();
       }
       set_state(SynchronousWindow_close);
       [[fallthrough]];
@@ -424,7 +504,15 @@ void SynchronousWindow::multiplex_impl(state_type run_state)
     case SynchronousWindow_close:
       // Turn on debug output again.
       Debug(mSMDebug = mVWDebug);
-      wait_for_all_fences();
+      if (m_registered_with_submit_coalescer)
+      {
+        m_submit_coalescer->unregister_window(this);
+        m_registered_with_submit_coalescer = false;
+      }
+      drain_presenter();
+      if (m_presenter)
+        m_presenter->terminate();
+      wait_for_all_frames_completed();
       finish();
       break;
   }
@@ -435,17 +523,43 @@ void SynchronousWindow::acquire_queues()
   DoutEntering(dc::vulkan, "SynchronousWindow::acquire_queues()");
   using vulkan::QueueFlagBits;
 
-  vulkan::Queue vh_graphics_queue = logical_device()->acquire_queue({QueueFlagBits::eGraphics|QueueFlagBits::ePresentation, m_request_cookie});
+  // Windows that coalesce their submits share a single queue.
+  bool const shared = coalesce_submits();
+  vulkan::Queue vh_graphics_queue = logical_device()->acquire_queue({QueueFlagBits::eGraphics|QueueFlagBits::ePresentation, m_request_cookie}, shared);
   vulkan::Queue vh_presentation_queue;
 
   if (!vh_graphics_queue)
   {
     // The combination of eGraphics|ePresentation failed. We have to try separately.
+    if (shared)
+      Dout(dc::warning, "Can not coalesce submits: there is no queue that supports both graphics and presentation.");
     vh_graphics_queue = logical_device()->acquire_queue({QueueFlagBits::eGraphics, m_request_cookie});
     vh_presentation_queue = logical_device()->acquire_queue({QueueFlagBits::ePresentation, m_request_cookie});
   }
   else
+  {
     vh_presentation_queue = vh_graphics_queue;
+    if (shared)
+      m_submit_coalescer = logical_device()->submit_coalescer(vh_graphics_queue);
+  }
+
+  if (!m_submit_coalescer && use_present_task())
+  {
+    m_presenter = statefultask::create<AsyncPresenter>(this, logical_device(), vh_presentation_queue COMMA_CWDEBUG_ONLY(mSMDebug));
+    m_presenter->run(m_application->m_medium_priority_queue);
+  }
+
+  if (!m_submit_coalescer && use_async_compute())
+  {
+    try
+    {
+      m_async_compute_queue = logical_device()->acquire_queue({QueueFlagBits::eCompute, m_request_cookie});
+    }
+    catch (vulkan::OutOfQueues_Exception const& error)
+    {
+      Dout(dc::warning, error.what() << " All render passes run on the graphics queue.");
+    }
+  }
 
   m_presentation_surface.set_queues(vh_graphics_queue, vh_presentation_queue
 #ifdef TRACY_ENABLE
@@ -457,8 +571,27 @@ void SynchronousWindow::acquire_queues()
 void SynchronousWindow::prepare_swapchain()
 {
   DoutEntering(dc::vulkan, "SynchronousWindow::prepare_swapchain()");
-  m_swapchain.prepare(this, vk::ImageUsageFlagBits::eColorAttachment, vk::PresentModeKHR::eFifo
+  vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eColorAttachment;
+  vulkan::DynamicResolution::Settings dynamic_resolution_settings;
+  if (use_dynamic_resolution(dynamic_resolution_settings))
+  {
+    m_dynamic_resolution = std::make_unique<vulkan::DynamicResolution>(dynamic_resolution_settings);
+    // The scene is blitted into the swapchain images (see upscale_scene).
+    usage |= vk::ImageUsageFlagBits::eTransferDst;
+  }
+  bool const frame_capture = use_frame_capture();
+  if (frame_capture)
+    usage |= vk::ImageUsageFlagBits::eTransferSrc;
+  m_swapchain.prepare(this, usage, vk::PresentModeKHR::eFifo
       COMMA_CWDEBUG_ONLY(debug_name_prefix("m_swapchain")));
+  if (frame_capture)
+  {
+    // Unsupported usage flags are silently dropped by Swapchain::prepare.
+    if (m_swapchain.image_kind()->usage & vk::ImageUsageFlagBits::eTransferSrc)
+      m_frame_capture.create(this, m_logical_device COMMA_CWDEBUG_ONLY(debug_name_prefix("m_frame_capture")));
+    else
+      Dout(dc::warning, "The swapchain images of this surface can't be copied from: frame capture is disabled.");
+  }
 }
 
 void SynchronousWindow::create_swapchain_images()
@@ -609,19 +742,107 @@ void SynchronousWindow::consume_input_events()
   //FIXME: handle delta_x, delta_y for the application here.
 }
 
-void SynchronousWindow::wait_for_all_fences() const
+void SynchronousWindow::invalidate(vk::Rect2D const& region) const
 {
-  std::vector<vk::Fence> all_fences;
-  for (auto&& resources : m_frame_resources_list)
-    all_fences.push_back(*resources->m_command_buffers_completed);
+  {
+    dirty_region_t::wat dirty_region_w(m_dirty_region);
+    if (dirty_region_w->extent.width == 0)
+      *dirty_region_w = region;
+    else
+    {
+      // The bounding box of both regions.
+      int32_t const x0 = std::min(dirty_region_w->offset.x, region.offset.x);
+      int32_t const y0 = std::min(dirty_region_w->offset.y, region.offset.y);
+      int64_t const x1 = std::max(int64_t{dirty_region_w->offset.x} + dirty_region_w->extent.width, int64_t{region.offset.x} + region.extent.width);
+      int64_t const y1 = std::max(int64_t{dirty_region_w->offset.y} + dirty_region_w->extent.height, int64_t{region.offset.y} + region.extent.height);
+      *dirty_region_w = vk::Rect2D{ { x0, y0 }, { static_cast<uint32_t>(std::min<int64_t>(x1 - x0, 0x7fffffff)), static_cast<uint32_t>(std::min<int64_t>(y1 - y0, 0x7fffffff)) } };
+    }
+  }
+  set_invalidated();
+}
 
-  vk::Result res;
+bool SynchronousWindow::is_static()
+{
+  if (!idle_when_static())
+  {
+    m_current_dirty_region = vk::Rect2D{ {}, m_swapchain.extent() };
+    return false;
+  }
+  if (reset_invalidated())
+  {
+    // Take the regions that were invalidated; if none were specified (input, invalidate() without region) redraw everything.
+    dirty_region_t::wat dirty_region_w(m_dirty_region);
+    vk::Extent2D const& extent = m_swapchain.extent();
+    if (dirty_region_w->extent.width == 0)
+      m_current_dirty_region = vk::Rect2D{ {}, extent };
+    else
+    {
+      // Clamp to the window.
+      int32_t const x0 = std::clamp(dirty_region_w->offset.x, 0, static_cast<int32_t>(extent.width));
+      int32_t const y0 = std::clamp(dirty_region_w->offset.y, 0, static_cast<int32_t>(extent.height));
+      uint32_t const width = std::min(dirty_region_w->extent.width, extent.width - x0);
+      uint32_t const height = std::min(dirty_region_w->extent.height, extent.height - y0);
+      m_current_dirty_region = vk::Rect2D{ { x0, y0 }, { width, height } };
+    }
+    *dirty_region_w = vk::Rect2D{};
+    m_frames_to_render = s_frames_per_invalidation;
+  }
+  return m_frames_to_render == 0;
+}
+
+void SynchronousWindow::wake_up_render_loop() const
+{
+  DoutEntering(dc::vkframe, "SynchronousWindow::wake_up_render_loop() [" << this << "]");
+  // Called from other threads; signal() is thread-safe.
+  const_cast<SynchronousWindow*>(this)->signal(render_loop_wake_up);
+}
+
+void SynchronousWindow::drain_presenter()
+{
+  if (!m_presenter)
+    return;
+  m_presenter->drain();
+  std::optional<AsyncPresenter::Acquired> acquired = m_presenter->take_acquired();
+  if (!acquired || (acquired->m_result != vk::Result::eSuccess && acquired->m_result != vk::Result::eSuboptimalKHR))
+    return;
+  // An image was acquired that won't be used: its acquire semaphore will be signaled. Wait for that on the queue,
+  // and let that signal the frame semaphore, so that wait_for_all_frames_completed() also waits until the acquire
+  // semaphore can be reused.
+  Dout(dc::vkframe, "Releasing swapchain image " << acquired->m_swapchain_index << " that was acquired ahead of time.");
+  vk::PipelineStageFlags const wait_dst_stage_mask = vk::PipelineStageFlagBits::eAllCommands;
+  uint64_t const frame_value = *m_frame_semaphore->get_next_value_ptr();
+  vk::TimelineSemaphoreSubmitInfo timeline_semaphore_info{
+    .signalSemaphoreValueCount = 1,
+    .pSignalSemaphoreValues = &frame_value
+  };
+  vk::SubmitInfo submit_info{
+    .pNext = &timeline_semaphore_info,
+    .waitSemaphoreCount = 1,
+    .pWaitSemaphores = &acquired->m_vh_acquire_semaphore,
+    .pWaitDstStageMask = &wait_dst_stage_mask,
+    .signalSemaphoreCount = 1,
+    .pSignalSemaphores = m_frame_semaphore->vh_semaphore_ptr()
+  };
+  std::lock_guard<std::mutex> queue_lock(m_presenter->queue_mutex());
+  presentation_surface().vh_graphics_queue().submit({ submit_info });
+}
+
+void SynchronousWindow::wait_for_all_frames_completed() const
+{
+  // Nothing was submitted yet if create_frame_resources wasn't called.
+  if (!m_frame_semaphore)
+    return;
+  // Make sure that the last frame was submitted.
+  if (m_submit_coalescer)
+    m_submit_coalescer->flush_if_pending(this);
+
+  bool success;
   {
-    CwZoneScopedN("wait for all_fences", max_number_of_frame_resources(), m_current_frame.m_resource_index);
-    res = m_logical_device->wait_for_fences(all_fences, VK_TRUE, 1000000000);
+    CwZoneScopedN("wait for all frames", max_number_of_frame_resources(), m_current_frame.m_resource_index);
+    success = m_frame_semaphore->wait_for(m_frame_semaphore->signal_value(), 1000000000);
   }
-  if (res != vk::Result::eSuccess)
-    THROW_FALERTC(res, "wait_for_fences");
+  if (!success)
+    THROW_ALERT("Waiting for frame [FRAME] to complete took too long!", AIArgs("[FRAME]", m_frame_semaphore->signal_value()));
 }
 
 vk::Extent2D SynchronousWindow::get_extent() const
@@ -648,13 +869,18 @@ void SynchronousWindow::handle_window_size_changed()
   // No reason to call wait_idle: handle_window_size_changed is called from the render loop.
   // Besides, we can't call wait_idle because another window can still be using queues on the logical device.
   on_window_size_changed_pre();
-  // We must wait here until all fences are signaled.
-  wait_for_all_fences();
+  // The present task may not use the swapchain while it is being recreated.
+  drain_presenter();
+  // We must wait here until all submitted frames completed.
+  wait_for_all_frames_completed();
   // Now it is safe to recreate the swapchain.
   vk::Extent2D extent = get_extent();
   m_swapchain.recreate(this, extent
       COMMA_CWDEBUG_ONLY(debug_name_prefix("m_swapchain")));
   uint32_t const layers = m_swapchain.image_kind()->array_layers;
+  // The measured frame times of the old extent are no longer representative.
+  if (m_dynamic_resolution)
+    m_dynamic_resolution->reset();
   recreate_framebuffers(extent, layers);
   if (m_use_imgui)
     m_imgui.on_window_size_changed(extent);
@@ -664,16 +890,163 @@ void SynchronousWindow::handle_window_size_changed()
 
 void SynchronousWindow::prepare_begin_info_chains()
 {
-  // Run over all render passes.
+  // Run over all render passes (compute passes don't have a vk::RenderPass).
   for (auto render_pass : m_render_passes)
-    render_pass->prepare_begin_info_chain();
+    if (!render_pass->is_compute_pass())
+      render_pass->prepare_begin_info_chain();
 }
 
 void SynchronousWindow::recreate_framebuffers(vk::Extent2D extent, uint32_t layers)
 {
-  // Run over all render passes.
+  // Run over all render passes (compute passes don't have a framebuffer).
+  for (auto render_pass : m_render_passes)
+    if (!render_pass->is_compute_pass())
+      render_pass->create_imageless_framebuffer(extent, layers);
+  // Creating the framebuffers resets the render area of all render passes to extent.
+  update_scene_extent(extent);
+}
+
+void SynchronousWindow::update_scene_extent(vk::Extent2D extent)
+{
+  if (!m_dynamic_resolution)
+  {
+    m_scene_extent = extent;
+    return;
+  }
+  m_scene_extent = vk::Extent2D{ m_dynamic_resolution->scaled(extent.width), m_dynamic_resolution->scaled(extent.height) };
+  Dout(dc::vulkan, "Scene extent: " << m_scene_extent << " (scale " << m_dynamic_resolution->scale() << ")");
+  // The attachments of the scene keep the full extent; just render into the top-left part of them.
   for (auto render_pass : m_render_passes)
-    render_pass->create_imageless_framebuffer(extent, layers);
+    if (render_pass != &imgui_pass && !render_pass->is_compute_pass() && !render_pass->uses_swapchain_attachment())
+      render_pass->update_render_area({{}, m_scene_extent});
+}
+
+void SynchronousWindow::update_dynamic_resolution()
+{
+  // The frame resources that are about to be reused completed, so their timestamps are available.
+  float const gpu_frame_time_ms = m_gpu_frame_timer.get_frame_time_ms(m_current_frame.m_resource_index);
+  if (m_dynamic_resolution->update(m_frame_cpu_time_ms, gpu_frame_time_ms))
+    update_scene_extent(m_swapchain.extent());
+}
+
+void SynchronousWindow::begin_gpu_frame_timer(vk::CommandBuffer vh_command_buffer)
+{
+  if (m_gpu_frame_timer.is_created())
+    m_gpu_frame_timer.write_begin_timestamp(vh_command_buffer, m_current_frame.m_resource_index);
+}
+
+void SynchronousWindow::end_gpu_frame_timer(vk::CommandBuffer vh_command_buffer)
+{
+  if (m_gpu_frame_timer.is_created())
+    m_gpu_frame_timer.write_end_timestamp(vh_command_buffer, m_current_frame.m_resource_index);
+}
+
+void SynchronousWindow::capture_frame(std::filesystem::path path, vulkan::FrameCapture::Encoding encoding)
+{
+  if (!m_frame_capture.is_created())
+  {
+    Dout(dc::warning, "SynchronousWindow::capture_frame(" << path << "): frame capture is not enabled (see use_frame_capture).");
+    return;
+  }
+  m_frame_capture.request(std::move(path), encoding);
+  // Make sure that a frame is rendered, even if the window is idle.
+  invalidate();
+}
+
+void SynchronousWindow::set_continuous_capture(std::filesystem::path directory, vulkan::FrameCapture::Encoding encoding)
+{
+  if (!m_frame_capture.is_created())
+  {
+    Dout(dc::warning, "SynchronousWindow::set_continuous_capture(" << directory << "): frame capture is not enabled (see use_frame_capture).");
+    return;
+  }
+  m_frame_capture.set_continuous(std::move(directory), encoding);
+  invalidate();
+}
+
+void SynchronousWindow::record_frame_capture(vk::CommandBuffer vh_command_buffer)
+{
+  if (m_frame_capture.is_created())
+    m_frame_capture.record(vh_command_buffer, m_swapchain.images()[m_swapchain.current_index()], m_swapchain.extent(), m_swapchain.image_kind()->format);
+}
+
+void SynchronousWindow::upscale_scene(vk::CommandBuffer vh_command_buffer, Attachment const& scene)
+{
+  DoutEntering(dc::vkframe, "SynchronousWindow::upscale_scene(" << vh_command_buffer << ", " << scene.name() << ")");
+  // The swapchain images only have eTransferDst usage when use_dynamic_resolution() returned true.
+  ASSERT(m_dynamic_resolution);
+  // The scene must be blitted from.
+  ASSERT(scene.image_kind()->usage & vk::ImageUsageFlagBits::eTransferSrc);
+
+  vk::Image const vh_scene_image = m_current_frame.m_frame_resources->m_attachments[scene].m_vh_image;
+  vk::Image const vh_swapchain_image = m_swapchain.images()[m_swapchain.current_index()];
+  vk::ImageSubresourceRange const& subresource_range = vulkan::Swapchain::s_default_subresource_range;
+
+  // The scene was left in eColorAttachmentOptimal by the last render pass that stored it.
+  std::array<vk::ImageMemoryBarrier, 2> const to_transfer_barriers = {
+    vk::ImageMemoryBarrier{
+      .srcAccessMask = vk::AccessFlagBits::eColorAttachmentWrite,
+      .dstAccessMask = vk::AccessFlagBits::eTransferRead,
+      .oldLayout = vk::ImageLayout::eColorAttachmentOptimal,
+      .newLayout = vk::ImageLayout::eTransferSrcOptimal,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .image = vh_scene_image,
+      .subresourceRange = subresource_range
+    },
+    // The whole swapchain image is overwritten, so its old contents can be discarded.
+    // Chains with the wait on the image available semaphore, which happens at stage eColorAttachmentOutput.
+    vk::ImageMemoryBarrier{
+      .srcAccessMask = vk::AccessFlagBits::eNoneKHR,
+      .dstAccessMask = vk::AccessFlagBits::eTransferWrite,
+      .oldLayout = vk::ImageLayout::eUndefined,
+      .newLayout = vk::ImageLayout::eTransferDstOptimal,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .image = vh_swapchain_image,
+      .subresourceRange = subresource_range
+    }
+  };
+  vh_command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eTransfer,
+      {}, {}, {}, to_transfer_barriers);
+
+  vk::Extent2D const swapchain_extent = m_swapchain.extent();
+  vk::ImageSubresourceLayers const subresource_layers{ .aspectMask = vk::ImageAspectFlagBits::eColor, .mipLevel = 0, .baseArrayLayer = 0, .layerCount = 1 };
+  vk::ImageBlit const region{
+    .srcSubresource = subresource_layers,
+    .srcOffsets = std::array<vk::Offset3D, 2>{ vk::Offset3D{}, vk::Offset3D{ static_cast<int32_t>(m_scene_extent.width), static_cast<int32_t>(m_scene_extent.height), 1 } },
+    .dstSubresource = subresource_layers,
+    .dstOffsets = std::array<vk::Offset3D, 2>{ vk::Offset3D{}, vk::Offset3D{ static_cast<int32_t>(swapchain_extent.width), static_cast<int32_t>(swapchain_extent.height), 1 } }
+  };
+  vh_command_buffer.blitImage(vh_scene_image, vk::ImageLayout::eTransferSrcOptimal, vh_swapchain_image, vk::ImageLayout::eTransferDstOptimal,
+      region, vk::Filter::eLinear);
+
+  // Return the scene to its attachment layout (in case the next frame loads it), and make the swapchain image
+  // ready for presentation, or for a following render pass that loads it (e.g. the imgui_pass).
+  std::array<vk::ImageMemoryBarrier, 2> const after_transfer_barriers = {
+    vk::ImageMemoryBarrier{
+      .srcAccessMask = vk::AccessFlagBits::eNoneKHR,
+      .dstAccessMask = vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite,
+      .oldLayout = vk::ImageLayout::eTransferSrcOptimal,
+      .newLayout = vk::ImageLayout::eColorAttachmentOptimal,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .image = vh_scene_image,
+      .subresourceRange = subresource_range
+    },
+    vk::ImageMemoryBarrier{
+      .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+      .dstAccessMask = vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite,
+      .oldLayout = vk::ImageLayout::eTransferDstOptimal,
+      .newLayout = vk::ImageLayout::ePresentSrcKHR,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .image = vh_swapchain_image,
+      .subresourceRange = subresource_range
+    }
+  };
+  vh_command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eColorAttachmentOutput,
+      {}, {}, {}, after_transfer_barriers);
 }
 
 bool SynchronousWindow::handle_map_changed(int map_flags)
@@ -743,7 +1116,16 @@ void SynchronousWindow::set_image_memory_barrier(
       .signalSemaphoreCount = 0,
       .pSignalSemaphores = nullptr
     };
-    m_presentation_surface.vh_graphics_queue().submit({ submit_info }, *fence);
+    // The queue might be shared with other windows.
+    if (m_submit_coalescer)
+      m_submit_coalescer->submit({ submit_info }, *fence);
+    else
+    {
+      std::unique_lock<std::mutex> queue_lock;
+      if (m_presenter)
+        queue_lock = std::unique_lock<std::mutex>(m_presenter->queue_mutex());
+      m_presentation_surface.vh_graphics_queue().submit({ submit_info }, *fence);
+    }
 
     int count = 10;
     vk::Result res;
@@ -781,6 +1163,30 @@ void SynchronousWindow::start_frame()
 
   m_current_frame.m_resource_index = (m_current_frame.m_resource_index + 1) % m_current_frame.m_resource_count;
   m_current_frame.m_frame_resources = m_frame_resources_list[m_current_frame.m_resource_index].get();
+  // The render loop only calls render_frame() once these frame resources are no longer in use.
+  ASSERT(m_frame_semaphore->get_counter_value() >= m_current_frame.m_frame_resources->m_command_buffers_completed_value);
+  // Therefore also the copies of captured frames up till and including that frame completed.
+  if (m_frame_capture.is_created())
+    m_frame_capture.poll(m_current_frame.m_frame_resources->m_command_buffers_completed_value);
+  // Likewise, images released to the pool before that frame may be reused. Images that are released from now on
+  // might still be used by the frame that is about to be recorded: the next value of the frame semaphore.
+  m_image_pool->retire(m_current_frame.m_frame_resources->m_command_buffers_completed_value);
+  m_image_pool->begin_frame(m_frame_semaphore->signal_value() + 1);
+  // The same holds for textures that lost their last handle.
+  m_texture_registry->retire(m_current_frame.m_frame_resources->m_command_buffers_completed_value);
+  m_texture_registry->begin_frame(m_frame_semaphore->signal_value() + 1);
+  // And for the memory of evicted mip levels.
+  if (m_sparse_mip_memory)
+  {
+    m_sparse_mip_memory->retire(m_current_frame.m_frame_resources->m_command_buffers_completed_value);
+    m_sparse_mip_memory->begin_frame(m_frame_semaphore->signal_value() + 1);
+  }
+  m_last_frame_start = m_frame_cpu_start;
+  m_frame_cpu_start = std::chrono::steady_clock::now();
+  if (m_last_frame_start != std::chrono::steady_clock::time_point{})
+    m_frame_interval_histogram.add(std::chrono::duration<float, std::milli>(m_frame_cpu_start - m_last_frame_start).count());
+  if (m_dynamic_resolution)
+    update_dynamic_resolution();
 
   if (m_use_imgui)
   {
@@ -789,17 +1195,26 @@ void SynchronousWindow::start_frame()
   }
 }
 
+uint64_t SynchronousWindow::next_frame_resources_completed_value() const
+{
+  vulkan::FrameResourceIndex const next_resource_index = (m_current_frame.m_resource_index + 1) % m_current_frame.m_resource_count;
+  return m_frame_resources_list[next_resource_index]->m_command_buffers_completed_value;
+}
+
 void SynchronousWindow::wait_command_buffer_completed()
 {
   CwZoneScopedN("m_command_buffers_completed", max_number_of_frame_resources(), m_current_frame.m_resource_index);
+  uint64_t const completed_value = m_current_frame.m_frame_resources->m_command_buffers_completed_value;
+  if (m_submit_coalescer)
+    m_submit_coalescer->flush_if_pending(this);
 #if defined(CWDEBUG) && defined(NON_FATAL_LONG_FENCE_DELAY)
   // You might want to use this if a time out happens while debugging (for example stepping through code with a debugger).
-  while (m_logical_device->wait_for_fences({ *m_current_frame.m_frame_resources->m_command_buffers_completed }, VK_FALSE, 1000000000) != vk::Result::eSuccess)
-    Dout(dc::warning, "WAITING FOR A FENCE TOOK TOO LONG!");
+  while (!m_frame_semaphore->wait_for(completed_value, 1000000000))
+    Dout(dc::warning, "WAITING FOR THE FRAME SEMAPHORE TOOK TOO LONG!");
 #else
   // Normally, this is an error.
-  if (m_logical_device->wait_for_fences({ *m_current_frame.m_frame_resources->m_command_buffers_completed }, VK_FALSE, 1000000000) != vk::Result::eSuccess)
-    throw std::runtime_error("Waiting for a fence takes too long!");
+  if (!m_frame_semaphore->wait_for(completed_value, 1000000000))
+    throw std::runtime_error("Waiting for the frame semaphore takes too long!");
 #endif
 }
 
@@ -812,19 +1227,41 @@ void SynchronousWindow::finish_frame()
   vk::Result result = vk::Result::eSuccess;
   vk::SwapchainKHR vh_swapchain = *m_swapchain;
   uint32_t const swapchain_image_index = m_swapchain.current_index().get_value();
-  vk::PresentInfoKHR present_info{
-    .waitSemaphoreCount = 1,
-    .pWaitSemaphores = m_swapchain.vhp_current_rendering_finished_semaphore(),
-    .swapchainCount = 1,
-    .pSwapchains = &vh_swapchain,
-    .pImageIndices = &swapchain_image_index
-  };
 
+  auto const finish_frame_start = std::chrono::steady_clock::now();
   vk::Result res;
+  if (m_submit_coalescer)
+  {
+    // Hand the frame over; it is submitted and presented together with the frames of the other windows.
+    m_coalesced_frame.m_vh_swapchain = vh_swapchain;
+    m_coalesced_frame.m_swapchain_image_index = swapchain_image_index;
+    m_coalesced_frame.m_present_result = &m_coalesced_present_result;
+    m_submit_coalescer->add(m_coalesced_frame);
+    // Handle the result of presenting the previous frame (or this one, if it was presented already).
+    res = m_coalesced_present_result.exchange(vk::Result::eSuccess, std::memory_order_relaxed);
+  }
+  else if (m_presenter)
   {
+    // Hand the frame over to the present task, which then acquires the next image.
+    m_presenter->present_and_acquire(vh_swapchain, true, m_swapchain.current_index(),
+        *m_swapchain.vhp_current_rendering_finished_semaphore(), m_swapchain.vh_acquire_semaphore());
+    // Handle the result of presenting the previous frame(s).
+    res = m_presenter->take_present_result();
+  }
+  else
+  {
+    vk::PresentInfoKHR present_info{
+      .waitSemaphoreCount = 1,
+      .pWaitSemaphores = m_swapchain.vhp_current_rendering_finished_semaphore(),
+      .swapchainCount = 1,
+      .pSwapchains = &vh_swapchain,
+      .pImageIndices = &swapchain_image_index
+    };
+
     CwZoneScopedN("presentKHR", max_number_of_swapchain_images(), m_swapchain.current_index());
     res = m_presentation_surface.vh_presentation_queue().presentKHR(&present_info);
   }
+  m_swapchain_wait_histogram.add(m_acquire_image_ms + std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - finish_frame_start).count());
 #ifdef TRACY_ENABLE
   if (res == vk::Result::eSuccess || res == vk::Result::eSuboptimalKHR)
   {
@@ -862,17 +1299,33 @@ void SynchronousWindow::finish_frame()
 void SynchronousWindow::acquire_image()
 {
   DoutEntering(dc::vkframe, "SynchronousWindow::acquire_image() [" << this << "]");
+  // The previous frame must have been presented before we acquire the next image (this also prevents
+  // that the coalescer uses the swapchain from another thread while we are acquiring an image).
+  if (m_submit_coalescer)
+    m_submit_coalescer->flush_if_pending(this);
   {
     ZoneScopedN("acquire_image");
+    auto const acquire_image_start = std::chrono::steady_clock::now();
 
     // Acquire swapchain image.
     vulkan::SwapchainIndex new_swapchain_index;
-    vk::Result res = m_logical_device->acquire_next_image(
-        *m_swapchain,
-        1000000000,
-        m_swapchain.vh_acquire_semaphore(),
-        vk::Fence(),
-        new_swapchain_index);
+    vk::Result res;
+    if (m_presenter)
+    {
+      // The image was acquired ahead of time by the present task (the render loop waited for that).
+      std::optional<AsyncPresenter::Acquired> acquired = m_presenter->take_acquired();
+      ASSERT(acquired && acquired->m_vh_acquire_semaphore == m_swapchain.vh_acquire_semaphore());
+      res = acquired->m_result;
+      new_swapchain_index = acquired->m_swapchain_index;
+    }
+    else
+      res = m_logical_device->acquire_next_image(
+          *m_swapchain,
+          1000000000,
+          m_swapchain.vh_acquire_semaphore(),
+          vk::Fence(),
+          new_swapchain_index);
+    m_acquire_image_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - acquire_image_start).count();
     switch (res)
     {
       case vk::Result::eSuccess:
@@ -966,6 +1419,14 @@ void SynchronousWindow::on_window_size_changed_post()
   };
 #endif
 
+  // All frames completed: release the old attachments to the pool and mark them as retired, so that their
+  // memory can be bound to the new attachments (if it is of the same size class).
+  for (std::unique_ptr<vulkan::FrameResourcesData> const& frame_resources_data : m_frame_resources_list)
+    for (Attachment const* attachment : m_attachments)
+      if (!attachment->index().undefined())
+        frame_resources_data->m_attachments[*attachment] = vulkan::Attachment{};
+  m_image_pool->retire(m_frame_semaphore->signal_value());
+
 #ifdef CWDEBUG
   vulkan::FrameResourceIndex frame_resource_index{0};
 #endif
@@ -983,7 +1444,8 @@ void SynchronousWindow::on_window_size_changed_post()
           swapchain().extent(),
           attachment->image_view_kind(),
           0,
-          vk::MemoryPropertyFlagBits::eDeviceLocal
+          vk::MemoryPropertyFlagBits::eDeviceLocal,
+          m_image_pool.get()
           COMMA_CWDEBUG_ONLY(debug_name_prefix("m_frame_resources_list[" + to_string(frame_resource_index) +
               "]->m_attachments[" + to_string(attachment->index()) + "]")));
     }
@@ -1039,6 +1501,36 @@ void SynchronousWindow::create_frame_resources()
   auto overlapping_descriptor_sets = allocate_descriptor_sets();
 #endif
 
+  // Create the timeline semaphore that is signaled when the command buffers of a frame completed.
+  m_frame_semaphore = std::make_unique<vulkan::TimelineSemaphore>(m_logical_device, 0 COMMA_CWDEBUG_ONLY(debug_name_prefix("m_frame_semaphore")));
+
+  // The batches of the render graph on different queues synchronize with a timeline semaphore per queue (see submit_render_graph).
+  vulkan::rendergraph::QueueSchedule const& queue_schedule = m_render_graph.queue_schedule();
+  if (queue_schedule.uses_async_compute())
+    for (size_t queue = 0; queue < vulkan::rendergraph::number_of_queue_types; ++queue)
+    {
+      vulkan::rendergraph::QueueType const queue_type = static_cast<vulkan::rendergraph::QueueType>(queue);
+      m_schedule_batches[queue] = queue_schedule.batches(queue_type);
+      m_schedule_semaphores[queue] = std::make_unique<vulkan::TimelineSemaphore>(m_logical_device, 0
+          COMMA_CWDEBUG_ONLY(debug_name_prefix(std::string("m_schedule_semaphores[") + vulkan::rendergraph::to_string(queue_type) + "]")));
+    }
+
+  // The attachments are recreated every time the window is resized; recycle their images and memory.
+  m_image_pool = std::make_unique<vulkan::memory::ImagePool>(std::make_unique<vulkan::memory::DeviceImagePoolBackend>(m_logical_device));
+  m_texture_registry = std::make_unique<vulkan::TextureRegistry>();
+  if (m_logical_device->supports_sparse_residency())
+    m_sparse_mip_memory = std::make_unique<vulkan::memory::SparseMipMemory>(
+        std::make_unique<vulkan::memory::DeviceSparseMipMemoryBackend>(m_logical_device, this));
+
+  // The dynamic resolution is driven by the measured GPU frame time.
+  if (m_dynamic_resolution)
+  {
+    if (m_logical_device->supports_timestamps())
+      m_gpu_frame_timer.create(m_logical_device, number_of_frame_resources COMMA_CWDEBUG_ONLY(debug_name_prefix("m_gpu_frame_timer")));
+    else
+      Dout(dc::warning, "The device doesn't support timestamps on graphics queues: the scene is rendered at a fixed scale of " << m_dynamic_resolution->scale() << ".");
+  }
+
   Dout(dc::vulkan, "Creating " << number_of_frame_resources.get_value() << " frame resources.");
   m_frame_resources_list.resize(number_of_frame_resources.get_value());
   for (vulkan::FrameResourceIndex i = m_frame_resources_list.ibegin(); i != m_frame_resources_list.iend(); ++i)
@@ -1057,13 +1549,28 @@ void SynchronousWindow::create_frame_resources()
     // A handle alias for the newly created frame resources object.
     auto& frame_resources = m_frame_resources_list[i];
 
-    // Create the 'command_buffers_completed' fence (using bufferS, even though we only have a single command buffer right now).
-    frame_resources->m_command_buffers_completed = m_logical_device->create_fence(true COMMA_CWDEBUG_ONLY(true, "->m_command_buffers_completed" + ambifix));
-
     // Create the command buffer.
     frame_resources->m_command_buffer = frame_resources->m_command_pool.allocate_buffer(
         CWDEBUG_ONLY("->m_command_buffer" + ambifix));
 
+    // Create the command buffers of the batches of the queue schedule (see submit_render_graph).
+    if (queue_schedule.uses_async_compute())
+    {
+      using vulkan::rendergraph::QueueType;
+      frame_resources->m_compute_command_pool = std::make_unique<vulkan::FrameResourcesData::command_pool_type>(
+          m_logical_device, m_async_compute_queue.queue_family() COMMA_CWDEBUG_ONLY("->m_compute_command_pool" + ambifix));
+      auto& graphics_command_buffers = frame_resources->m_batch_command_buffers[static_cast<size_t>(QueueType::graphics)];
+      auto& compute_command_buffers = frame_resources->m_batch_command_buffers[static_cast<size_t>(QueueType::async_compute)];
+      // The last graphics batch uses m_command_buffer.
+      graphics_command_buffers.resize(m_schedule_batches[static_cast<size_t>(QueueType::graphics)].size() - 1);
+      compute_command_buffers.resize(m_schedule_batches[static_cast<size_t>(QueueType::async_compute)].size());
+      if (!graphics_command_buffers.empty())
+        frame_resources->m_command_pool.allocate_buffers(graphics_command_buffers
+            COMMA_CWDEBUG_ONLY("->m_batch_command_buffers[graphics]" + ambifix));
+      frame_resources->m_compute_command_pool->allocate_buffers(compute_command_buffers
+          COMMA_CWDEBUG_ONLY("->m_batch_command_buffers[async_compute]" + ambifix));
+    }
+
 #if 0 // FIXME: See FIXME above.
     // Move the overlapping descriptor set into m_frame_resources_list.
     frame_resources->m_overlapping_descriptor_set = std::move(overlapping_descriptor_sets[i]);
@@ -1098,19 +1605,58 @@ void SynchronousWindow::submit(vulkan::handle::CommandBuffer command_buffer)
   CwZoneNamedN(__submit2, "submit", true, max_number_of_swapchain_images(), m_swapchain.current_index());
 #endif
 
+  std::chrono::duration<float, std::milli> const frame_cpu_time = std::chrono::steady_clock::now() - m_frame_cpu_start;
+  m_frame_cpu_time_ms = frame_cpu_time.count();
+
+  if (m_submit_coalescer)
+  {
+    // Submitted by the SubmitCoalescer, together with the frames of the other windows that share the queue (see finish_frame).
+    m_coalesced_frame = vulkan::CoalescedFrame{
+      .m_window = this,
+      .m_vh_command_buffer = command_buffer,
+      .m_vh_image_available_semaphore = *swapchain().vhp_current_image_available_semaphore(),
+      .m_vh_rendering_finished_semaphore = *swapchain().vhp_current_rendering_finished_semaphore(),
+      .m_vh_frame_semaphore = *m_frame_semaphore->vh_semaphore_ptr(),
+      .m_frame_value = *m_frame_semaphore->get_next_value_ptr()
+    };
+    m_current_frame.m_frame_resources->m_command_buffers_completed_value = m_coalesced_frame.m_frame_value;
+    if (m_frame_capture.is_created())
+      m_frame_capture.submitted(m_coalesced_frame.m_frame_value);
+    return;
+  }
+
+  // Signal the binary rendering_finished semaphore (for presentKHR) and the frame timeline semaphore (for reuse of the frame resources).
+  std::array<vk::Semaphore, 2> const signal_semaphores = { *swapchain().vhp_current_rendering_finished_semaphore(), *m_frame_semaphore->vh_semaphore_ptr() };
+  uint64_t const frame_value = *m_frame_semaphore->get_next_value_ptr();
+  std::array<uint64_t, 2> const signal_values = { 0, frame_value };       // The value for a binary semaphore is ignored.
+  vk::TimelineSemaphoreSubmitInfo timeline_semaphore_info{
+    .signalSemaphoreValueCount = static_cast<uint32_t>(signal_values.size()),
+    .pSignalSemaphoreValues = signal_values.data()
+  };
+
   vk::PipelineStageFlags wait_dst_stage_mask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
   vk::SubmitInfo submit_info{
+    .pNext = &timeline_semaphore_info,
     .waitSemaphoreCount = 1,
     .pWaitSemaphores = swapchain().vhp_current_image_available_semaphore(),
     .pWaitDstStageMask = &wait_dst_stage_mask,
     .commandBufferCount = 1,
     .pCommandBuffers = command_buffer.get_array(),
-    .signalSemaphoreCount = 1,
-    .pSignalSemaphores = swapchain().vhp_current_rendering_finished_semaphore()
+    .signalSemaphoreCount = static_cast<uint32_t>(signal_semaphores.size()),
+    .pSignalSemaphores = signal_semaphores.data()
   };
 
-  Dout(dc::vkframe, "Submitting command buffer: submit({" << submit_info << "}, " << *m_current_frame.m_frame_resources->m_command_buffers_completed << ")");
-  presentation_surface().vh_graphics_queue().submit({ submit_info }, *m_current_frame.m_frame_resources->m_command_buffers_completed);
+  Dout(dc::vkframe, "Submitting command buffer: submit({" << submit_info << "}) signaling frame " << frame_value);
+  {
+    // The present task might be using the same queue.
+    std::unique_lock<std::mutex> queue_lock;
+    if (m_presenter)
+      queue_lock = std::unique_lock<std::mutex>(m_presenter->queue_mutex());
+    presentation_surface().vh_graphics_queue().submit({ submit_info });
+  }
+  m_current_frame.m_frame_resources->m_command_buffers_completed_value = frame_value;
+  if (m_frame_capture.is_created())
+    m_frame_capture.submitted(frame_value);
 
 #ifdef TRACY_ENABLE
   std::string message("Submitted CB ");
@@ -1119,6 +1665,221 @@ void SynchronousWindow::submit(vulkan::handle::CommandBuffer command_buffer)
 #endif
 }
 
+void SynchronousWindow::submit_render_graph()
+{
+  DoutEntering(dc::vkframe, "SynchronousWindow::submit_render_graph() [" << this << "]");
+  using vulkan::rendergraph::QueueSchedule;
+  using vulkan::rendergraph::QueueType;
+  using vulkan::rendergraph::number_of_queue_types;
+
+  QueueSchedule const& queue_schedule = m_render_graph.queue_schedule();
+  std::vector<vulkan::rendergraph::RenderPass*> const& submission_order = m_render_graph.submission_order();
+  vulkan::FrameResourcesData* frame_resources = m_current_frame.m_frame_resources;
+
+  wait_command_buffer_completed();
+
+  if (!queue_schedule.uses_async_compute())
+  {
+    // Everything runs on the graphics queue, in submission order, without any synchronization: use a single command buffer.
+    vulkan::handle::CommandBuffer command_buffer = frame_resources->m_command_buffer;
+    command_buffer->begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+    begin_gpu_frame_timer(command_buffer);
+    for (QueueSchedule::Step const& step : queue_schedule.steps(QueueType::graphics))
+      submission_order[step.m_node]->record(command_buffer);
+    end_gpu_frame_timer(command_buffer);
+    command_buffer->end();
+    submit(command_buffer);
+    return;
+  }
+
+  // The image of each attachment that changes queue family ownership is released at the end of the node that
+  // accessed it last on the old queue and acquired at the start of the next node that accesses it, on the other queue.
+  // Neither changes the layout: that is the final layout of the attachment in the releasing node.
+  bool const separate_depth_stencil_layouts = m_logical_device->supports_separate_depth_stencil_layouts();
+  auto record_ownership_transfers = [&](vulkan::handle::CommandBuffer command_buffer, size_t node, bool acquire){
+    std::vector<vk::ImageMemoryBarrier> barriers;
+    for (QueueSchedule::OwnershipTransfer const& transfer : queue_schedule.ownership_transfers())
+    {
+      if ((acquire ? transfer.m_acquire_node : transfer.m_release_node) != node)
+        continue;
+      vulkan::rendergraph::Attachment const* attachment = m_render_graph.resource(transfer.m_resource);
+      // A vertex of the render graph only orders the nodes (by means of the timeline semaphores); buffers that are
+      // shared between a compute pass and a graphics pass must be created with vk::SharingMode::eConcurrent.
+      if (!attachment)
+        continue;
+      vulkan::rendergraph::AttachmentIndex const attachment_index = attachment->render_graph_attachment_index();
+      // The swapchain image is only accessed by graphics passes.
+      ASSERT(!attachment_index.undefined());
+      vk::ImageLayout const layout = submission_order[transfer.m_release_node]->get_final_layout(attachment, separate_depth_stencil_layouts);
+      barriers.push_back({
+        .srcAccessMask = acquire ? vk::AccessFlags{} : vk::AccessFlagBits::eMemoryWrite,
+        .dstAccessMask = acquire ? vk::AccessFlagBits::eMemoryRead | vk::AccessFlagBits::eMemoryWrite : vk::AccessFlags{},
+        .oldLayout = layout,
+        .newLayout = layout,
+        .srcQueueFamilyIndex = transfer.m_src_queue_family,
+        .dstQueueFamilyIndex = transfer.m_dst_queue_family,
+        .image = frame_resources->m_attachments[attachment_index].m_vh_image,
+        .subresourceRange = attachment->image_view_kind()->subresource_range
+      });
+    }
+    if (barriers.empty())
+      return;
+    if (acquire)
+      command_buffer->pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eAllCommands, {}, {}, {}, barriers);
+    else
+      command_buffer->pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eBottomOfPipe, {}, {}, {}, barriers);
+  };
+
+  // Record every batch of the schedule into its own command buffer.
+  std::array<std::vector<vk::CommandBuffer>, number_of_queue_types> vh_command_buffers;
+  for (size_t queue = 0; queue < number_of_queue_types; ++queue)
+  {
+    auto const& steps = queue_schedule.steps(static_cast<QueueType>(queue));
+    auto const& batches = m_schedule_batches[queue];
+    for (size_t b = 0; b < batches.size(); ++b)
+    {
+      bool const first_graphics_batch = queue == static_cast<size_t>(QueueType::graphics) && b == 0;
+      bool const last_graphics_batch = queue == static_cast<size_t>(QueueType::graphics) && b == batches.size() - 1;
+      vulkan::handle::CommandBuffer command_buffer =
+        last_graphics_batch ? frame_resources->m_command_buffer : frame_resources->m_batch_command_buffers[queue][b];
+      command_buffer->begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+      if (first_graphics_batch)
+        begin_gpu_frame_timer(command_buffer);
+      for (size_t s = batches[b].m_first_step; s < batches[b].m_end_step; ++s)
+      {
+        size_t const node = steps[s].m_node;
+        record_ownership_transfers(command_buffer, node, true);
+        submission_order[node]->record(command_buffer);
+        record_ownership_transfers(command_buffer, node, false);
+      }
+      if (last_graphics_batch)
+        end_gpu_frame_timer(command_buffer);
+      command_buffer->end();
+      vh_command_buffers[queue].push_back(command_buffer);
+    }
+  }
+
+  std::chrono::duration<float, std::milli> const frame_cpu_time = std::chrono::steady_clock::now() - m_frame_cpu_start;
+  m_frame_cpu_time_ms = frame_cpu_time.count();
+
+  // Each batch waits for the value of the other queue that its first step needs and signals the value of its last step.
+  // The values of the schedule are relative to the start of the frame.
+  std::array<std::vector<vk::SubmitInfo>, number_of_queue_types> submit_infos;
+  std::array<std::vector<vk::TimelineSemaphoreSubmitInfo>, number_of_queue_types> timeline_semaphore_infos;
+  std::array<std::vector<std::array<vk::Semaphore, 4>>, number_of_queue_types> semaphores;     // Waits, then signals.
+  std::array<std::vector<std::array<uint64_t, 4>>, number_of_queue_types> values;
+  std::array<std::vector<std::array<vk::PipelineStageFlags, 2>>, number_of_queue_types> wait_dst_stage_masks;
+  for (size_t queue = 0; queue < number_of_queue_types; ++queue)
+  {
+    size_t const number_of_batches = m_schedule_batches[queue].size();
+    // Reserve room for the extra submit that signals the frame semaphore (see below); the pointers into these vectors must stay valid.
+    submit_infos[queue].reserve(number_of_batches + 1);
+    timeline_semaphore_infos[queue].reserve(number_of_batches + 1);
+    semaphores[queue].resize(number_of_batches + 1);
+    values[queue].resize(number_of_batches + 1);
+    wait_dst_stage_masks[queue].resize(number_of_batches + 1);
+  }
+  vk::Semaphore const vh_image_available_semaphore = *swapchain().vhp_current_image_available_semaphore();
+  vk::Semaphore const vh_rendering_finished_semaphore = *swapchain().vhp_current_rendering_finished_semaphore();
+  for (size_t queue = 0; queue < number_of_queue_types; ++queue)
+  {
+    auto const& steps = queue_schedule.steps(static_cast<QueueType>(queue));
+    auto const& batches = m_schedule_batches[queue];
+    for (size_t b = 0; b < batches.size(); ++b)
+    {
+      bool const last_graphics_batch = queue == static_cast<size_t>(QueueType::graphics) && b == batches.size() - 1;
+      auto& batch_semaphores = semaphores[queue][b];
+      auto& batch_values = values[queue][b];
+      auto& batch_wait_dst_stage_masks = wait_dst_stage_masks[queue][b];
+      uint32_t wait_count = 0;
+      // The swapchain image is written by the last graphics batch only.
+      if (last_graphics_batch)
+      {
+        batch_semaphores[wait_count] = vh_image_available_semaphore;
+        batch_values[wait_count] = 0;                   // The value for a binary semaphore is ignored.
+        batch_wait_dst_stage_masks[wait_count++] = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+      }
+      if (auto const& wait = steps[batches[b].m_first_step].m_wait)
+      {
+        size_t const other_queue = static_cast<size_t>(wait->m_queue);
+        batch_semaphores[wait_count] = *m_schedule_semaphores[other_queue]->vh_semaphore_ptr();
+        batch_values[wait_count] = m_schedule_base_values[other_queue] + wait->m_value;
+        batch_wait_dst_stage_masks[wait_count++] = vk::PipelineStageFlagBits::eAllCommands;
+      }
+      uint32_t signal_count = 0;
+      batch_semaphores[wait_count + signal_count] = *m_schedule_semaphores[queue]->vh_semaphore_ptr();
+      batch_values[wait_count + signal_count++] = m_schedule_base_values[queue] + batches[b].m_end_step;
+      if (last_graphics_batch)
+      {
+        batch_semaphores[wait_count + signal_count] = vh_rendering_finished_semaphore;
+        batch_values[wait_count + signal_count++] = 0;
+      }
+      timeline_semaphore_infos[queue].push_back({
+        .waitSemaphoreValueCount = wait_count,
+        .pWaitSemaphoreValues = batch_values.data(),
+        .signalSemaphoreValueCount = signal_count,
+        .pSignalSemaphoreValues = batch_values.data() + wait_count
+      });
+      submit_infos[queue].push_back({
+        .pNext = &timeline_semaphore_infos[queue].back(),
+        .waitSemaphoreCount = wait_count,
+        .pWaitSemaphores = batch_semaphores.data(),
+        .pWaitDstStageMask = batch_wait_dst_stage_masks.data(),
+        .commandBufferCount = 1,
+        .pCommandBuffers = &vh_command_buffers[queue][b],
+        .signalSemaphoreCount = signal_count,
+        .pSignalSemaphores = batch_semaphores.data() + wait_count
+      });
+    }
+  }
+
+  // The frame resources may only be reused once both queues finished: the frame semaphore is signaled by an
+  // extra submit on the graphics queue (after all of its batches) that waits for the last batch of the async-compute queue.
+  size_t const graphics = static_cast<size_t>(QueueType::graphics);
+  size_t const async_compute = static_cast<size_t>(QueueType::async_compute);
+  uint64_t const frame_value = *m_frame_semaphore->get_next_value_ptr();
+  {
+    auto& final_semaphores = semaphores[graphics].back();
+    auto& final_values = values[graphics].back();
+    final_semaphores[0] = *m_schedule_semaphores[async_compute]->vh_semaphore_ptr();
+    final_semaphores[1] = *m_frame_semaphore->vh_semaphore_ptr();
+    final_values[0] = m_schedule_base_values[async_compute] + queue_schedule.steps(QueueType::async_compute).size();
+    final_values[1] = frame_value;
+    wait_dst_stage_masks[graphics].back()[0] = vk::PipelineStageFlagBits::eAllCommands;
+    timeline_semaphore_infos[graphics].push_back({
+      .waitSemaphoreValueCount = 1,
+      .pWaitSemaphoreValues = &final_values[0],
+      .signalSemaphoreValueCount = 1,
+      .pSignalSemaphoreValues = &final_values[1]
+    });
+    submit_infos[graphics].push_back({
+      .pNext = &timeline_semaphore_infos[graphics].back(),
+      .waitSemaphoreCount = 1,
+      .pWaitSemaphores = &final_semaphores[0],
+      .pWaitDstStageMask = wait_dst_stage_masks[graphics].back().data(),
+      .signalSemaphoreCount = 1,
+      .pSignalSemaphores = &final_semaphores[1]
+    });
+  }
+
+  // Timeline semaphores may be waited for before the signal is submitted, so the order of both submits doesn't matter.
+  Dout(dc::vkframe, "Submitting " << submit_infos[async_compute].size() << " async-compute and " << submit_infos[graphics].size() <<
+      " graphics batches, signaling frame " << frame_value);
+  static_cast<vk::Queue>(m_async_compute_queue).submit(submit_infos[async_compute]);
+  {
+    // The present task might be using the same queue.
+    std::unique_lock<std::mutex> queue_lock;
+    if (m_presenter)
+      queue_lock = std::unique_lock<std::mutex>(m_presenter->queue_mutex());
+    presentation_surface().vh_graphics_queue().submit(submit_infos[graphics]);
+  }
+  for (size_t queue = 0; queue < number_of_queue_types; ++queue)
+    m_schedule_base_values[queue] += queue_schedule.steps(static_cast<QueueType>(queue)).size();
+  frame_resources->m_command_buffers_completed_value = frame_value;
+  if (m_frame_capture.is_created())
+    m_frame_capture.submitted(frame_value);
+}
+
 void SynchronousWindow::copy_graphics_settings()
 {
   DoutEntering(dc::vulkan, "SynchronousWindow::copy_graphics_settings() [" << this << "]");
@@ -1171,10 +1932,38 @@ void SynchronousWindow::add_synchronous_task(std::function<void(SynchronousWindo
 
 vulkan::pipeline::FactoryHandle SynchronousWindow::create_pipeline_factory(vulkan::Pipeline& pipeline_out, vk::RenderPass vh_render_pass COMMA_CWDEBUG_ONLY(bool debug))
 {
+  // Reuse the index of a factory that already finished and generated pipelines for the same pipeline_out (this happens when pipelines are recreated).
+  auto index = m_pipeline_factories.iend();
+  for (auto i = m_pipeline_out_per_factory.ibegin(); i != m_pipeline_out_per_factory.iend(); ++i)
+    if (m_pipeline_out_per_factory[i] == &pipeline_out && !m_pipeline_factories[i])
+    {
+      index = i;
+      break;
+    }
+  if (index != m_pipeline_factories.iend() && m_factories_to_recreate &&
+      std::find(m_factories_to_recreate->begin(), m_factories_to_recreate->end(), index) == m_factories_to_recreate->end())
+  {
+    // This factory doesn't use any of the shaders that changed: keep its pipelines and return an inert handle.
+    Dout(dc::vulkan, "Not recreating pipeline factory " << index << ".");
+    m_number_of_skipped_characteristics[index] = 0;
+    return index;
+  }
   auto factory = statefultask::create<PipelineFactory>(this, pipeline_out, vh_render_pass COMMA_CWDEBUG_ONLY(debug));
-  auto const index = m_pipeline_factories.iend();
-  m_pipeline_factories.push_back(std::move(factory));           // Now m_pipeline_factories[index] == factory.
-  m_pipelines.emplace_back();
+  if (index == m_pipeline_factories.iend())
+  {
+    m_pipeline_factories.push_back(std::move(factory));         // Now m_pipeline_factories[index] == factory.
+    m_pipelines.emplace_back();
+    m_pipeline_out_per_factory.push_back(&pipeline_out);
+    m_pipeline_tables.push_back(std::make_unique<vulkan::pipeline::PipelineTable>());
+    m_characteristic_ids_per_factory.emplace_back();
+    m_number_of_skipped_characteristics.push_back(0);
+  }
+  else
+  {
+    m_pipeline_factories[index] = std::move(factory);
+    m_characteristic_ids_per_factory[index].clear();
+  }
+  m_pipeline_factories[index]->set_pipeline_table(m_pipeline_tables[index].get());
   m_application->run_pipeline_factory(m_pipeline_factories[index], this, index);
   m_pipeline_factories[index]->set_index(index);
   return index;
@@ -1187,6 +1976,12 @@ void SynchronousWindow::have_new_pipeline(vulkan::Pipeline&& pipeline_handle_and
   auto& factory_pipelines = m_pipelines[pipeline_handle.m_pipeline_factory_index];
   if (factory_pipelines.iend() <= pipeline_handle.m_pipeline_index)
     factory_pipelines.resize(pipeline_handle.m_pipeline_index.get_value() + 1);
+  else if (factory_pipelines[pipeline_handle.m_pipeline_index])
+  {
+    // This pipeline is being replaced (see recreate_graphics_pipelines); it might still be in use by frames in flight.
+    m_delay_by_completed_draw_frames.add({}, std::move(factory_pipelines[pipeline_handle.m_pipeline_index]), max_number_of_frame_resources().get_value() + 1);
+  }
+  m_pipeline_tables[pipeline_handle.m_pipeline_factory_index]->store({}, pipeline_handle.m_pipeline_index, *pipeline);
   factory_pipelines[pipeline_handle.m_pipeline_index] = std::move(pipeline);
   m_pipeline_factories[pipeline_handle.m_pipeline_factory_index]->set_pipeline(std::move(pipeline_handle_and_layout));
 }
@@ -1204,6 +1999,35 @@ void SynchronousWindow::pipeline_factory_done(utils::Badge<synchronous::MoveNewP
   m_application->pipeline_factory_done(this, std::move(pipeline_cache));
 }
 
+void SynchronousWindow::recreate_pipeline_factories(utils::Badge<synchronous::RecreatePipelines>, std::vector<PipelineFactoryIndex> const& factory_indices)
+{
+  DoutEntering(dc::notice, "SynchronousWindow::recreate_pipeline_factories(" << factory_indices << ")");
+  recreate_graphics_pipelines(factory_indices);
+}
+
+void SynchronousWindow::added_characteristic(utils::Badge<vulkan::pipeline::FactoryHandle>, vulkan::pipeline::FactoryCharacteristicId const& id) const
+{
+  m_characteristic_ids_per_factory[id.factory_index()].push_back(id);
+}
+
+vulkan::pipeline::FactoryCharacteristicId SynchronousWindow::skipped_characteristic(utils::Badge<vulkan::pipeline::FactoryHandle>, PipelineFactoryIndex factory_index) const
+{
+  std::vector<vulkan::pipeline::FactoryCharacteristicId> const& ids = m_characteristic_ids_per_factory[factory_index];
+  size_t const n = m_number_of_skipped_characteristics[factory_index]++;
+  // create_graphics_pipelines must add the same characteristics to a factory every time it is called.
+  ASSERT(n < ids.size());
+  return ids[n];
+}
+
+//virtual
+void SynchronousWindow::recreate_graphics_pipelines(std::vector<PipelineFactoryIndex> const& factory_indices)
+{
+  // Let create_pipeline_factory skip the factories that are not in factory_indices.
+  m_factories_to_recreate = &factory_indices;
+  create_graphics_pipelines();
+  m_factories_to_recreate = nullptr;
+}
+
 #ifdef CWDEBUG
 vulkan::AmbifixOwner SynchronousWindow::debug_name_prefix(std::string prefix) const
 {
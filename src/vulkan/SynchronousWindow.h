@@ -2,10 +2,16 @@
 #define VULKAN_SYNCHRONOUS_WINDOW_H
 
 #include "SemaphoreWatcher.h"
+#include "TimelineSemaphore.h"
 #include "SynchronousTask.h"
 #include "PresentationSurface.h"
 #include "Swapchain.h"
 #include "CurrentFrameData.h"
+#include "DynamicResolution.h"
+#include "FrameCapture.h"
+#include "FrameTimeHistogram.h"
+#include "GpuFrameTimer.h"
+#include "Presenter.h"
 #include "OperatingSystem.h"
 #include "SynchronousEngine.h"
 #include "Concepts.h"
@@ -17,8 +23,11 @@
 #include "Pipeline.h"
 #include "ImGui.h"
 #include "descriptor/ArrayElementRange.h"
+#include "pipeline/FactoryCharacteristicId.h"
 #include "pipeline/Handle.h"
+#include "pipeline/PipelineTable.h"
 #include "queues/QueueReply.h"
+#include "queues/SubmitCoalescer.h"
 #include "rendergraph/RenderGraph.h"
 #include "rendergraph/Attachment.h"
 #include "shader_builder/SPIRVCache.h"
@@ -35,7 +44,9 @@
 #include "utils/UniqueID.h"
 #include "FrameResourceIndex.h"
 #include <vulkan/vulkan.hpp>
+#include <array>
 #include <memory>
+#include <chrono>
 #ifdef CWDEBUG
 #include "cwds/tracked_intrusive_ptr.h"
 #endif
@@ -54,6 +65,7 @@ class SynchronousTask;
 class SynchronousWindow;
 namespace synchronous {
 class MoveNewPipelines;
+class RecreatePipelines;
 } // namespace synchronous
 } // namespace task
 
@@ -63,6 +75,7 @@ class LogicalDevice;
 class Ambifix;
 class AmbifixOwner;
 class Swapchain;
+class TextureRegistry;
 class WindowEvents;
 
 namespace shader_builder {
@@ -75,13 +88,20 @@ namespace pipeline {
 class FactoryHandle;
 } // namespace pipeline
 
+namespace memory {
+class ImagePool;
+class SparseMipMemory;
+} // namespace memory
+
 namespace detail {
 
-class DelaySemaphoreDestruction
+// Keeps vulkan objects alive until the frames that might still be using them completed.
+class DelayDestruction
 {
  private:
   int pos = 0;
   std::array<std::vector<vk::UniqueSemaphore>, 16> m_queue;
+  std::array<std::vector<vk::UniquePipeline>, 16> m_pipeline_queue;
 
  public:
   void add(utils::Badge<Swapchain>, vk::UniqueSemaphore&& semaphore, int delay)
@@ -89,11 +109,20 @@ class DelaySemaphoreDestruction
     m_queue[(pos + delay) % m_queue.size()].emplace_back(std::move(semaphore));
   }
 
+  void add(utils::Badge<task::SynchronousWindow>, vk::UniquePipeline&& pipeline, int delay)
+  {
+    // The delay must be less than the size of the queue.
+    ASSERT(delay < m_pipeline_queue.size());
+    m_pipeline_queue[(pos + delay) % m_pipeline_queue.size()].emplace_back(std::move(pipeline));
+  }
+
   void step(utils::Badge<task::SynchronousWindow>)
   {
     pos = (pos + 1) % m_queue.size();
     if (!m_queue[pos].empty())
       m_queue[pos].clear();
+    if (!m_pipeline_queue[pos].empty())
+      m_pipeline_queue[pos].clear();
   }
 };
 
@@ -133,8 +162,11 @@ class SynchronousWindow : public AIStatefulTask, protected vulkan::SynchronousEn
   static constexpr condition_type imgui_font_texture_ready       = 0x10;
   static constexpr condition_type parent_window_created          = 0x20;
   static constexpr condition_type condition_pipeline_available   = 0x40;
+  static constexpr condition_type frame_resources_available      = 0x80;
+  static constexpr condition_type render_loop_wake_up            = 0x100;
+  static constexpr condition_type swapchain_image_acquired       = 0x200;
  protected:
-  static constexpr condition_type free_condition                 = 0x80; // Used in derived class.
+  static constexpr condition_type free_condition                 = 0x400; // Used in derived class.
 
  protected:
   // Constructor
@@ -214,7 +246,7 @@ class SynchronousWindow : public AIStatefulTask, protected vulkan::SynchronousEn
   utils::UniqueIDContext<AttachmentIndex> attachment_index_context;     // Provides an unique index for registered attachments (through register_attachment).
 
   // Accessed by Swapchain.
-  vulkan::detail::DelaySemaphoreDestruction m_delay_by_completed_draw_frames;
+  vulkan::detail::DelayDestruction m_delay_by_completed_draw_frames;
 
   statefultask::TaskEvent m_logical_device_index_available_event;       // Triggered when m_logical_device_index is set.
 
@@ -250,8 +282,60 @@ class SynchronousWindow : public AIStatefulTask, protected vulkan::SynchronousEn
 #endif
 
  protected:
+  // Gives the mip levels of sparse textures of this window their own memory, which is unbound and freed once the frames that used it retired.
+  // Declared before the other members that might own textures, so that it is destroyed after them.
+  std::unique_ptr<vulkan::memory::SparseMipMemory> m_sparse_mip_memory;        // Created by create_frame_resources, if the logical device supports sparse residency.
+  // Recycles the images (and memory) of the attachments that are recreated when the window is resized.
+  // Driven by the frame timeline (see start_frame). Declared before m_frame_resources_list so that it is destroyed after the attachments.
+  std::unique_ptr<vulkan::memory::ImagePool> m_image_pool;             // Created by create_frame_resources.
+  // Shares the textures with identical contents of this window, and delays their destruction until the frames that used them retired.
+  std::unique_ptr<vulkan::TextureRegistry> m_texture_registry;         // Created by create_frame_resources.
   utils::Vector<std::unique_ptr<vulkan::FrameResourcesData>, vulkan::FrameResourceIndex> m_frame_resources_list;        // Vector with frame resources.
   vulkan::CurrentFrameData m_current_frame = { nullptr, vulkan::FrameResourceIndex{0}, vulkan::FrameResourceIndex{0} };
+  // Timeline semaphore that is signaled by every frame submit; its value is the number of the last completed frame.
+  // Each FrameResourcesData stores the value that it has to wait for before it may be reused.
+  std::unique_ptr<vulkan::TimelineSemaphore> m_frame_semaphore;         // Created by create_frame_resources.
+
+ private:
+  // Only used when coalesce_submits() returns true (and the queue supports both graphics and presentation).
+  vulkan::SubmitCoalescer* m_submit_coalescer = nullptr;                // The coalescer of the (shared) queue of this window.
+  bool m_registered_with_submit_coalescer = false;                      // Set while this window contributes a frame to every batch.
+  vulkan::CoalescedFrame m_coalesced_frame;                             // Filled in by submit() and finish_frame().
+  std::atomic<vk::Result> m_coalesced_present_result{vk::Result::eSuccess};     // The result of presenting the last frame of this window.
+
+  // Only used when use_present_task() returns true (and submits are not coalesced).
+  boost::intrusive_ptr<AsyncPresenter> m_presenter;                     // Presents our frames and acquires the next swapchain image ahead of time.
+
+  // Only used when use_async_compute() returns true (and submits are not coalesced).
+  vulkan::Queue m_async_compute_queue;                                  // The queue that compute passes of the render graph can run on (acquired by acquire_queues).
+  // Only used when the queue schedule of the render graph uses the async-compute queue (see submit_render_graph); indexed by QueueType.
+  std::array<std::vector<vulkan::rendergraph::QueueSchedule::Batch>, vulkan::rendergraph::number_of_queue_types> m_schedule_batches;
+  std::array<std::unique_ptr<vulkan::TimelineSemaphore>, vulkan::rendergraph::number_of_queue_types> m_schedule_semaphores;    // Signaled at the end of each batch.
+  std::array<uint64_t, vulkan::rendergraph::number_of_queue_types> m_schedule_base_values = {};   // The values of m_schedule_semaphores at the start of the current frame.
+
+  // Frame time statistics.
+  vulkan::FrameTimeHistogram m_frame_interval_histogram;                // The time between the start of two consecutive frames.
+  vulkan::FrameTimeHistogram m_swapchain_wait_histogram;                // The time that the render loop spent in acquire_image() and finish_frame().
+  std::chrono::steady_clock::time_point m_last_frame_start;             // The previous value of m_frame_cpu_start.
+  float m_acquire_image_ms = 0.0f;                                      // The time spent in acquire_image() this frame.
+
+  // Only used when use_dynamic_resolution() returns true.
+  std::unique_ptr<vulkan::DynamicResolution> m_dynamic_resolution;      // Created by prepare_swapchain.
+  vulkan::GpuFrameTimer m_gpu_frame_timer;                              // Created by create_frame_resources, if the device supports timestamps.
+  vk::Extent2D m_scene_extent;                                          // The render area of the scene render passes (see update_scene_extent).
+  std::chrono::steady_clock::time_point m_frame_cpu_start;              // Set by start_frame.
+  float m_frame_cpu_time_ms = -1.0f;                                    // The CPU time from start_frame() till submit() of the last frame.
+
+  // Only used when use_frame_capture() returns true.
+  vulkan::FrameCapture m_frame_capture;                                 // Created by prepare_swapchain.
+
+  // Idle mode (see idle_when_static).
+  static constexpr int s_frames_per_invalidation = 3;                   // ImGui needs a few frames to settle after input.
+  static constexpr vk::Rect2D s_whole_window{ { 0, 0 }, { 0x7fffffff, 0x7fffffff } };  // Clamped to the window by is_static().
+  int m_frames_to_render = 0;                                           // The number of frames to render before a static window becomes idle.
+  using dirty_region_t = aithreadsafe::Wrapper<vk::Rect2D, aithreadsafe::policy::Primitive<std::mutex>>;
+  mutable dirty_region_t m_dirty_region;                                // The union of the regions passed to invalidate(region) since the last frame.
+  vk::Rect2D m_current_dirty_region;                                    // The region that must be redrawn by the current frame.
 
   // Initialized by create_imgui. Deinitialized by destruction.
   vk_utils::TimerData m_imgui_timer;
@@ -397,6 +481,12 @@ class SynchronousWindow : public AIStatefulTask, protected vulkan::SynchronousEn
     return m_presentation_surface;
   }
 
+  // The async-compute queue, if any (see use_async_compute).
+  vulkan::Queue const& async_compute_queue() const
+  {
+    return m_async_compute_queue;
+  }
+
   vulkan::LogicalDevice* get_logical_device() const;
 
   // Return a cached value of get_logical_device().
@@ -412,7 +502,35 @@ class SynchronousWindow : public AIStatefulTask, protected vulkan::SynchronousEn
   void no_swapchain(utils::Badge<vulkan::Swapchain>) const { vulkan::SynchronousEngine::no_swapchain(); }
   void have_swapchain(utils::Badge<vulkan::Swapchain>) const { vulkan::SynchronousEngine::have_swapchain(); }
 
-  void wait_for_all_fences() const;
+  // The pool that the attachments are acquired from; may also be passed as MemoryCreateInfo::image_pool for other
+  // images that are recreated with the window (their last use is stamped with the frame timeline).
+  vulkan::memory::ImagePool* image_pool() const { return m_image_pool.get(); }
+
+  // The registry to acquire textures from that are drawn by this window (see TextureRegistry).
+  vulkan::TextureRegistry& texture_registry() const { return *m_texture_registry; }
+
+  // The object to pass as MemoryCreateInfo::sparse_mip_memory for textures whose evicted mip levels must free their
+  // memory (see Texture::evict), or nullptr if the logical device doesn't support sparse residency.
+  vulkan::memory::SparseMipMemory* sparse_mip_memory() const { return m_sparse_mip_memory.get(); }
+
+  // Block until all submitted frames completed.
+  void wait_for_all_frames_completed() const;
+  // Block until the present task is idle, and make sure that an image that it acquired ahead of time doesn't
+  // leave a pending signal on the acquire semaphore. Call before wait_for_all_frames_completed().
+  void drain_presenter();
+
+  // Thread-safe. Request a redraw of (region of) this window. This wakes up the render loop if it is idle.
+  // Only needed for windows that return true from idle_when_static(): other windows are redrawn every frame anyway.
+  void invalidate() const { invalidate(s_whole_window); }
+  void invalidate(vk::Rect2D const& region) const;
+
+  // Thread-safe. Write the next frame that is rendered to path (see vulkan::FrameCapture).
+  // Only has effect when use_frame_capture() returns true.
+  void capture_frame(std::filesystem::path path, vulkan::FrameCapture::Encoding encoding = vulkan::FrameCapture::Encoding::png);
+  // Thread-safe. Write every frame to directory (as frame_000000.png etc), until this is called with an empty path.
+  void set_continuous_capture(std::filesystem::path directory, vulkan::FrameCapture::Encoding encoding = vulkan::FrameCapture::Encoding::png);
+  // The number of captured and dropped frames.
+  vulkan::FrameCapture const& frame_capture() const { return m_frame_capture; }
 
   // Call this from the render loop every time that extent_changed(atomic_flags()) returns true.
   // Call only synchronously.
@@ -447,23 +565,53 @@ class SynchronousWindow : public AIStatefulTask, protected vulkan::SynchronousEn
  protected:
   utils::Vector<boost::intrusive_ptr<task::PipelineFactory>> m_pipeline_factories;
   utils::Vector<utils::Vector<vk::UniquePipeline, vulkan::pipeline::Index>, PipelineFactoryIndex> m_pipelines;
+  utils::Vector<vulkan::Pipeline*, PipelineFactoryIndex> m_pipeline_out_per_factory;      // The pipeline_out that was passed to create_pipeline_factory.
+  utils::Vector<std::unique_ptr<vulkan::pipeline::PipelineTable>, PipelineFactoryIndex> m_pipeline_tables;  // The generated pipelines per factory, by characteristic values.
+  // The ids returned by add_characteristic, per factory; returned again for factories that are skipped by recreate_graphics_pipelines.
+  mutable utils::Vector<std::vector<vulkan::pipeline::FactoryCharacteristicId>, PipelineFactoryIndex> m_characteristic_ids_per_factory;
+  mutable utils::Vector<size_t, PipelineFactoryIndex> m_number_of_skipped_characteristics;    // The number of add_characteristic calls since a factory was skipped.
+  std::vector<PipelineFactoryIndex> const* m_factories_to_recreate{};   // Only non-null while recreate_graphics_pipelines() calls create_graphics_pipelines().
 //  std::map<vulkan::FlatPipelineLayout, vk::UniquePipelineLayout> m_pipeline_layouts;
 
   // Called from create_graphics_pipelines of derived class.
+  // Pass a null vh_render_pass for a factory whose characteristics only add a compute shader (it then creates compute pipelines).
   vulkan::pipeline::FactoryHandle create_pipeline_factory(vulkan::Pipeline& pipeline_out, vk::RenderPass vh_render_pass COMMA_CWDEBUG_ONLY(bool debug));
 
   // Return the vulkan handle of this pipeline.
   vk::Pipeline vh_graphics_pipeline(vulkan::pipeline::Handle pipeline_handle) const;
 
  public:
+  // Return the flat table with the pipelines of factory factory_index (see PipelineTable).
+  // Must be called from the render loop; the returned reference remains valid until the window is destroyed.
+  vulkan::pipeline::PipelineTable const& pipeline_table(PipelineFactoryIndex factory_index) const { return *m_pipeline_tables[factory_index]; }
+
+  // Return the SubmitCoalescer used by this window, or nullptr if it submits and presents by itself.
+  vulkan::SubmitCoalescer const* submit_coalescer() const { return m_submit_coalescer; }
+
+  // Called by AsyncPresenter after it acquired a swapchain image.
+  void swapchain_image_acquired_signal(utils::Badge<AsyncPresenter>) { signal(swapchain_image_acquired); }
+
+  // Must be called from the render loop.
+  vulkan::FrameTimeHistogram const& frame_interval_histogram() const { return m_frame_interval_histogram; }
+  vulkan::FrameTimeHistogram const& swapchain_wait_histogram() const { return m_swapchain_wait_histogram; }
+  void reset_frame_time_histograms() { m_frame_interval_histogram.reset(); m_swapchain_wait_histogram.reset(); }
+  bool has_present_task() const { return m_presenter; }
+
   void have_new_pipeline(vulkan::Pipeline&& pipeline_handle_and_layout, vk::UniquePipeline&& pipeline);
 
   // Called by state MoveNewPipelines_done.
   void pipeline_factory_done(utils::Badge<synchronous::MoveNewPipelines>, PipelineFactoryIndex index);
 
+  // Called by ShaderWatcher (from the render loop) when a shader used by the factories in factory_indices changed.
+  void recreate_pipeline_factories(utils::Badge<synchronous::RecreatePipelines>, std::vector<PipelineFactoryIndex> const& factory_indices);
+
   // Called by vulkan::pipeline::FactoryHandle::generate.
   inline task::PipelineFactory* pipeline_factory(PipelineFactoryIndex factory_index) const;
 
+  // Called by vulkan::pipeline::FactoryHandle::add_characteristic.
+  void added_characteristic(utils::Badge<vulkan::pipeline::FactoryHandle>, vulkan::pipeline::FactoryCharacteristicId const& id) const;
+  vulkan::pipeline::FactoryCharacteristicId skipped_characteristic(utils::Badge<vulkan::pipeline::FactoryHandle>, PipelineFactoryIndex factory_index) const;
+
  private:
   // SynchronousWindow_acquire_queues:
   void acquire_queues();
@@ -483,11 +631,21 @@ class SynchronousWindow : public AIStatefulTask, protected vulkan::SynchronousEn
 
   // SynchronousWindow_render_loop:
   void consume_input_events();
+  // Returns true if this window doesn't need to render a frame (it is static and wasn't invalidated).
+  bool is_static();
+  // Implementation of SpecialCircumstances::wake_up_render_loop.
+  void wake_up_render_loop() const override;
+  // Returns the value that m_frame_semaphore must reach before start_frame() may reuse the next frame resources.
+  uint64_t next_frame_resources_completed_value() const;
   virtual void draw_imgui() { }
   virtual void render_frame() = 0;
 
   // Called by create_imageless_framebuffers and handle_window_size_changed.
   void recreate_framebuffers(vk::Extent2D extent, uint32_t layers);
+  // Called by recreate_framebuffers and start_frame: set m_scene_extent and the render area of the scene render passes.
+  void update_scene_extent(vk::Extent2D extent);
+  // Called by start_frame.
+  void update_dynamic_resolution();
   // Called by create_imageless_framebuffers.
   void prepare_begin_info_chains();
 
@@ -495,11 +653,61 @@ class SynchronousWindow : public AIStatefulTask, protected vulkan::SynchronousEn
 
   // Called by initialize_impl():
   virtual threadpool::Timer::Interval get_frame_rate_interval() const;
+  // Called by the render loop: return true if the window only needs to be redrawn after input, a resize, a map change,
+  // a synchronous task or an explicit invalidate(); the render loop is idle (uses no CPU) the rest of the time.
+  // Useful for static windows, like ImGui-only dialogs. Windows that animate something must not return true,
+  // or call invalidate() for as long as the animation runs.
+  virtual bool idle_when_static() const { return false; }
+  // Called by acquire_queues(): return true to share the graphics/presentation queue with other windows
+  // that do the same, and submit and present the frames of all those windows in batches (see SubmitCoalescer).
+  virtual bool coalesce_submits() const { return false; }
+  // Called by acquire_queues(): return true to present frames, and acquire the next swapchain image, on a separate
+  // task (see AsyncPresenter), so that a blocking present (for example with FIFO present mode) overlaps with
+  // recording the next frame. Ignored when the submits are coalesced (the SubmitCoalescer presents the frames then).
+  virtual bool use_present_task() const { return false; }
+  // Called by acquire_queues(): return true to acquire a queue for the compute passes of the render graph (see
+  // rendergraph::RenderPass::set_preferred_queue); the LogicalDevice must request one with QueueFlagBits::eCompute
+  // and the cookie of this window. If one is available, compute passes that can overlap with graphics work run on
+  // it (see rendergraph::QueueSchedule); that requires the frame to be submitted with submit_render_graph().
+  // Ignored when the submits are coalesced.
+  virtual bool use_async_compute() const { return false; }
+  // Called by prepare_swapchain(): return true (optionally after changing settings) to render the scene
+  // into an offscreen target at a resolution that is adjusted every frame to the measured GPU and CPU
+  // frame times (see vulkan::DynamicResolution). For example,
+  //
+  //   m_render_graph = scene_pass[~depth]->stores(~scene);
+  //   m_render_graph += imgui_pass[+output]->stores(output);       // Optional; must load the upscaled scene.
+  //
+  // The ImageKind of scene must have eTransferSrc usage and an initial_layout of eColorAttachmentOptimal:
+  // scene is stored but not presented, so its last render pass leaves it in that layout (upscale_scene
+  // returns it there too) and the first render pass that uses it must start from the same layout.
+  //
+  // and in render_frame, call begin_gpu_frame_timer / end_gpu_frame_timer at the start and end of the
+  // command buffer, use scene_extent() for the viewport and scissor of the scene passes and call
+  // upscale_scene(command_buffer, scene) after the last scene pass (and before the imgui_pass).
+  //
+  // The scene attachments are not reallocated when the scale changes: they keep the swapchain extent
+  // and only the render area of the render passes that don't use the swapchain attachment is changed.
+  virtual bool use_dynamic_resolution(vulkan::DynamicResolution::Settings& UNUSED_ARG(settings)) const { return false; }
+  // Called by prepare_swapchain(): return true to be able to capture frames (see capture_frame); this adds
+  // eTransferSrc usage to the swapchain images. Call record_frame_capture(command_buffer) at the end of
+  // render_frame, after the last render pass.
+  virtual bool use_frame_capture() const { return false; }
   // Called by handle_window_size_changed():
   virtual void on_window_size_changed_pre();
   // Called by create_frame_resources() and handle_window_size_changed():
   virtual void on_window_size_changed_post();
 
+ protected:
+  // Called by recreate_pipeline_factories() (shader hot-reload, see Application::use_shader_hot_reload).
+  // The default calls create_graphics_pipelines() again, during which create_pipeline_factory only
+  // creates the factories in factory_indices: the handles of the other factories are inert (their
+  // add_characteristic returns the same FactoryCharacteristicId as before and generate does nothing)
+  // and they keep their pipelines. A factory that is created for the same vulkan::Pipeline object as a
+  // factory that already finished reuses its PipelineFactoryIndex and the pipelines that it replaces
+  // are destroyed once no frame in flight can use them anymore. An override may call this default.
+  virtual void recreate_graphics_pipelines(std::vector<PipelineFactoryIndex> const& factory_indices);
+
  public:
   // Called by create_frame_resources() (and PresentationSurface::set_queues when TRACY_ENABLE).
   virtual vulkan::FrameResourceIndex max_number_of_frame_resources() const;
@@ -513,11 +721,35 @@ class SynchronousWindow : public AIStatefulTask, protected vulkan::SynchronousEn
 
  protected:
   void start_frame();
+  // Block until the command buffers of the current frame resources completed (normally returns immediately,
+  // because the render loop doesn't start a frame before its frame resources are available).
   void wait_command_buffer_completed();
   void submit(vulkan::handle::CommandBuffer command_buffer);
+  // Record the render passes of m_render_graph, using their record functions (see rendergraph::RenderPass::set_record_function),
+  // and submit them according to its queue schedule. Use this instead of recording frame_resources->m_command_buffer and calling
+  // submit(); it also writes the GPU frame timer timestamps.
+  void submit_render_graph();
   void finish_frame();
   void acquire_image();
 
+  // The part of the window that the current frame must redraw: the union of the regions passed to
+  // invalidate(region) or the whole window. The contents of a swapchain image are undefined after
+  // acquire_image() however, so only a window that keeps its previous contents can use this.
+  vk::Rect2D const& dirty_region() const { return m_current_dirty_region; }
+
+  // Dynamic resolution (see use_dynamic_resolution).
+  // The extent that the scene render passes render into (equal to swapchain().extent() without dynamic resolution).
+  vk::Extent2D scene_extent() const { return m_scene_extent; }
+  // Write the timestamps that measure the GPU time of this frame (does nothing if there is no GPU frame timer).
+  void begin_gpu_frame_timer(vk::CommandBuffer vh_command_buffer);
+  void end_gpu_frame_timer(vk::CommandBuffer vh_command_buffer);
+  // Blit the scene_extent() part of scene to the whole swapchain image, which is left in layout ePresentSrcKHR.
+  void upscale_scene(vk::CommandBuffer vh_command_buffer, Attachment const& scene);
+
+  // Frame capture (see use_frame_capture).
+  // Copy the swapchain image to a readback buffer if this frame must be captured; does nothing otherwise.
+  void record_frame_capture(vk::CommandBuffer vh_command_buffer);
+
  public:
 #ifdef CWDEBUG
   vulkan::AmbifixOwner debug_name_prefix(std::string prefix) const;
@@ -2,12 +2,36 @@
 #include "Texture.h"
 #include "SynchronousWindow.h"
 #include "queues/CopyDataToImage.h"
+#include "queues/ProgressiveTextureUpload.h"
+#include "queues/SparseBind.h"
+#include "vk_utils/MipChain.h"
 
 namespace vulkan {
 
 //static
 ImageViewKind const Texture::s_default_image_view_kind{default_image_kind, {}};
 
+namespace {
+
+// Create the task that uploads level 0 of texture from eUndefined to eShaderReadOnlyOptimal.
+boost::intrusive_ptr<task::CopyDataToImage> create_upload_task(Texture const& texture, vk::Extent2D extent,
+    ImageViewKind const& image_view_kind, task::SynchronousWindow const* resource_owner, std::unique_ptr<vulkan::DataFeeder> texture_data_feeder)
+{
+  size_t const data_size = size_t{extent.width} * extent.height * vk_utils::format_texel_size(image_view_kind.image_kind()->format);
+
+  auto copy_data_to_image = statefultask::create<task::CopyDataToImage>(texture.m_logical_device, data_size,
+            texture.m_vh_image, extent, vk_defaults::ImageSubresourceRange{},
+            vk::ImageLayout::eUndefined, vk::AccessFlags(0), vk::PipelineStageFlagBits::eTopOfPipe,
+            vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eShaderRead, vk::PipelineStageFlagBits::eFragmentShader
+            COMMA_CWDEBUG_ONLY(true));
+
+  copy_data_to_image->set_resource_owner(resource_owner);       // Wait for this task to finish before destroying the owning window, because the window owns this texture.
+  copy_data_to_image->set_data_feeder(std::move(texture_data_feeder));
+  return copy_data_to_image;
+}
+
+} // namespace
+
 void Texture::upload(vk::Extent2D extent, vulkan::ImageViewKind const& image_view_kind,
     task::SynchronousWindow const* resource_owner,      // The window that determines the life-time of this texture.
     std::unique_ptr<vulkan::DataFeeder> texture_data_feeder,
@@ -18,19 +42,237 @@ void Texture::upload(vk::Extent2D extent, vulkan::ImageViewKind const& image_vie
   // Use the same image_view_kind that was used to create the Texture.
   ASSERT(image_view_kind == *debug_image_view_kind);
 
-  size_t const data_size = extent.width * extent.height * vk_utils::format_component_count(image_view_kind.image_kind()->format);
+  auto copy_data_to_image = create_upload_task(*this, extent, image_view_kind, resource_owner, std::move(texture_data_feeder));
+  copy_data_to_image->run(vulkan::Application::instance().low_priority_queue(), parent, texture_ready, AIStatefulTask::signal_parent);
+}
 
+void Texture::upload(vk::Extent2D extent, vulkan::ImageViewKind const& image_view_kind,
+    task::SynchronousWindow const* resource_owner,
+    std::unique_ptr<vulkan::DataFeeder> texture_data_feeder,
+    std::function<void(bool success)> uploaded)
+{
+  DoutEntering(dc::vulkan, "Texture::upload(" << extent << ", " << image_view_kind << ", " << resource_owner << ", " << texture_data_feeder << ", uploaded)");
+
+  // Use the same image_view_kind that was used to create the Texture.
+  ASSERT(image_view_kind == *debug_image_view_kind);
+
+  auto copy_data_to_image = create_upload_task(*this, extent, image_view_kind, resource_owner, std::move(texture_data_feeder));
+  copy_data_to_image->run(vulkan::Application::instance().low_priority_queue(), std::move(uploaded));
+}
+
+void Texture::upload_with_mipmaps(vk::Extent2D extent, vulkan::ImageViewKind const& image_view_kind,
+    task::SynchronousWindow const* resource_owner,
+    std::unique_ptr<vulkan::DataFeeder> level0_data_feeder,
+    AIStatefulTask* parent, AIStatefulTask::condition_type texture_ready)
+{
+  DoutEntering(dc::vulkan, "Texture::upload_with_mipmaps(" << extent << ", " << image_view_kind << ", " << resource_owner << ", " <<
+      level0_data_feeder << ", " << parent << ", " << texture_ready << ")");
+
+  // Use the same image_view_kind that was used to create the Texture.
+  ASSERT(image_view_kind == *debug_image_view_kind);
+
+  ImageKind const& image_kind = image_view_kind.image_kind();
+  uint32_t const level_count = image_kind->mip_levels;
+  uint32_t const texel_size = vk_utils::format_texel_size(image_kind->format);
+  bool const generate_on_gpu = level_count > 1 && m_logical_device->supports_blit_mip_generation(image_kind->format) &&
+    (image_kind->usage & vk::ImageUsageFlagBits::eTransferSrc);
+  // Blits require a graphics capable queue; if the transfer queue isn't one, they are recorded on the graphics queue of resource_owner.
+  bool const generate_on_graphics_queue = generate_on_gpu && !m_logical_device->transfer_queue_supports_graphics();
+  Dout(dc::vulkan, "Generating " << level_count << " mip levels on the " <<
+      (generate_on_graphics_queue ? "graphics queue" : generate_on_gpu ? "transfer queue" : "CPU") << ".");
+
+  // Without GPU generation, all levels are uploaded at once.
+  uint32_t const uploaded_levels = generate_on_gpu ? 1 : level_count;
+  size_t data_size = 0;
+  for (uint32_t level = 0; level < uploaded_levels; ++level)
+  {
+    vk::Extent2D const level_extent = vk_utils::mip_level_extent(extent, level);
+    data_size += level_extent.width * level_extent.height * texel_size;
+  }
+
+  // When the blits are recorded on the graphics queue, level 0 stays in eTransferDstOptimal while its ownership is transferred.
+  vk::ImageLayout const new_image_layout = generate_on_graphics_queue ? vk::ImageLayout::eTransferDstOptimal : vk::ImageLayout::eShaderReadOnlyOptimal;
+  vk::AccessFlags const new_image_access = generate_on_graphics_queue ? vk::AccessFlags(0) : vk::AccessFlags{vk::AccessFlagBits::eShaderRead};
+  vk::PipelineStageFlags const consuming_stages = generate_on_graphics_queue ?
+      vk::PipelineStageFlags{vk::PipelineStageFlagBits::eBottomOfPipe} : vk::PipelineStageFlags{vk::PipelineStageFlagBits::eFragmentShader};
   auto copy_data_to_image = statefultask::create<task::CopyDataToImage>(m_logical_device, data_size,
-            m_vh_image, extent, vk_defaults::ImageSubresourceRange{},
+            m_vh_image, extent, vk_defaults::ImageSubresourceRange{vk::ImageAspectFlagBits::eColor, 0, uploaded_levels},
             vk::ImageLayout::eUndefined, vk::AccessFlags(0), vk::PipelineStageFlagBits::eTopOfPipe,
-            vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eShaderRead, vk::PipelineStageFlagBits::eFragmentShader
+            new_image_layout, new_image_access, consuming_stages
             COMMA_CWDEBUG_ONLY(true));
 
-  copy_data_to_image->set_resource_owner(resource_owner);       // Wait for this task to finish before destroying the owning window, because the window owns this texture.
-  copy_data_to_image->set_data_feeder(std::move(texture_data_feeder));
+  copy_data_to_image->set_resource_owner(resource_owner);
+  if (generate_on_graphics_queue)
+  {
+    m_mip_generation = {
+      .m_extent = extent,
+      .m_levels = vk_defaults::ImageSubresourceRange{vk::ImageAspectFlagBits::eColor, 0, level_count},
+      .m_src_queue_family = m_logical_device->transfer_queue_family(),
+      .m_dst_queue_family = static_cast<uint32_t>(resource_owner->presentation_surface().graphics_queue().queue_family().get_value())
+    };
+    copy_data_to_image->set_release_ownership(m_mip_generation.m_src_queue_family, m_mip_generation.m_dst_queue_family);
+    copy_data_to_image->set_data_feeder(std::move(level0_data_feeder));
+    // Signal the parent only after record_mip_generation may be called.
+    copy_data_to_image->run(vulkan::Application::instance().low_priority_queue(), [this, parent, texture_ready](bool success){
+      if (success)
+        m_mip_generation_pending.store(true, std::memory_order::release);
+      parent->signal(texture_ready);
+    });
+    return;
+  }
+  if (generate_on_gpu)
+  {
+    copy_data_to_image->set_generate_mip_levels(level_count);
+    copy_data_to_image->set_data_feeder(std::move(level0_data_feeder));
+  }
+  else if (level_count > 1)
+  {
+    // MipChainDataFeeder averages bytes: each component must be a single byte that can be averaged.
+    ASSERT(vk_utils::format_is_8bit_unorm_or_srgb(image_kind->format));
+    copy_data_to_image->set_data_feeder(std::make_unique<vk_utils::MipChainDataFeeder>(std::move(level0_data_feeder), extent, texel_size, level_count));
+  }
+  else
+    copy_data_to_image->set_data_feeder(std::move(level0_data_feeder));
   copy_data_to_image->run(vulkan::Application::instance().low_priority_queue(), parent, texture_ready, AIStatefulTask::signal_parent);
 }
 
+bool Texture::record_mip_generation(vk::CommandBuffer command_buffer)
+{
+  if (!m_mip_generation_pending.exchange(false, std::memory_order::acquire))
+    return false;
+
+  DoutEntering(dc::vkframe, "Texture::record_mip_generation(" << command_buffer << ") [" << this << "]");
+
+  // Acquire level 0 (still in eTransferDstOptimal) from the transfer queue family; the other levels have no contents yet.
+  vk::ImageSubresourceRange level0 = m_mip_generation.m_levels;
+  level0.levelCount = 1;
+  vk::ImageSubresourceRange other_levels = m_mip_generation.m_levels;
+  other_levels.baseMipLevel = 1;
+  other_levels.levelCount = m_mip_generation.m_levels.levelCount - 1;
+  std::array<vk::ImageMemoryBarrier, 2> const acquire_barriers = {
+    vk::ImageMemoryBarrier{
+      .srcAccessMask = vk::AccessFlags(0),
+      .dstAccessMask = vk::AccessFlagBits::eTransferRead,
+      .oldLayout = vk::ImageLayout::eTransferDstOptimal,
+      .newLayout = vk::ImageLayout::eTransferDstOptimal,
+      .srcQueueFamilyIndex = m_mip_generation.m_src_queue_family,
+      .dstQueueFamilyIndex = m_mip_generation.m_dst_queue_family,
+      .image = m_vh_image,
+      .subresourceRange = level0
+    },
+    vk::ImageMemoryBarrier{
+      .srcAccessMask = vk::AccessFlags(0),
+      .dstAccessMask = vk::AccessFlagBits::eTransferWrite,
+      .oldLayout = vk::ImageLayout::eUndefined,
+      .newLayout = vk::ImageLayout::eTransferDstOptimal,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .image = m_vh_image,
+      .subresourceRange = other_levels
+    }
+  };
+  command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, {}, {}, acquire_barriers);
+
+  task::CopyDataToImage::record_mip_blits(command_buffer, m_vh_image, m_mip_generation.m_levels, m_mip_generation.m_extent,
+      vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eShaderRead, vk::PipelineStageFlagBits::eFragmentShader);
+  return true;
+}
+
+void Texture::upload_progressive(vk::Extent2D extent, vulkan::ImageViewKind const& image_view_kind,
+    task::SynchronousWindow const* resource_owner,
+    std::vector<std::unique_ptr<DataFeeder>> level_feeders,
+    AIStatefulTask* parent, AIStatefulTask::condition_type texture_ready,
+    std::function<void(uint32_t base_mip_level)> level_ready)
+{
+  DoutEntering(dc::vulkan, "Texture::upload_progressive(" << extent << ", " << image_view_kind << ", " << resource_owner << ", " <<
+      level_feeders.size() << " levels, " << parent << ", " << texture_ready << ")");
+
+  // Use the same image_view_kind that was used to create the Texture.
+  ASSERT(image_view_kind == *debug_image_view_kind);
+  // There must be a feeder for every mip level of the image.
+  ASSERT(level_feeders.size() == image_view_kind.image_kind()->mip_levels);
+
+  // Nothing may be sampled until the coarsest level landed.
+  m_base_mip_level.store(level_feeders.size(), std::memory_order::relaxed);
+
+  uint32_t const texel_size = vk_utils::format_texel_size(image_view_kind.image_kind()->format);
+  auto progressive_texture_upload = statefultask::create<task::ProgressiveTextureUpload>(this, extent, texel_size,
+      resource_owner, std::move(level_feeders), std::move(level_ready) COMMA_CWDEBUG_ONLY(true));
+  progressive_texture_upload->run(vulkan::Application::instance().low_priority_queue(), parent, texture_ready, AIStatefulTask::signal_parent);
+}
+
+void Texture::stream_in(uint32_t first_level, vk::Extent2D extent, vulkan::ImageViewKind const& image_view_kind,
+    task::SynchronousWindow const* resource_owner,
+    std::vector<std::unique_ptr<DataFeeder>> level_feeders,
+    std::function<void(bool success)> uploaded,
+    std::function<void(uint32_t base_mip_level)> level_ready,
+    memory::SparseMipMemory::released_callback_type released)
+{
+  uint32_t const resident_level = m_base_mip_level.load(std::memory_order::acquire);
+  DoutEntering(dc::vulkan, "Texture::stream_in(" << first_level << ", " << extent << ", " << image_view_kind << ", " << resource_owner << ", " <<
+      level_feeders.size() << " levels, uploaded) [resident level: " << resident_level << "]");
+
+  // Use the same image_view_kind that was used to create the Texture.
+  ASSERT(image_view_kind == *debug_image_view_kind);
+  // There must be an element for every mip level of the image, and something to upload.
+  ASSERT(level_feeders.size() == image_view_kind.image_kind()->mip_levels && first_level < resident_level);
+
+  uint32_t const texel_size = vk_utils::format_texel_size(image_view_kind.image_kind()->format);
+  auto progressive_texture_upload = statefultask::create<task::ProgressiveTextureUpload>(this, extent, texel_size,
+      resource_owner, first_level, resident_level, std::move(level_feeders), std::move(level_ready) COMMA_CWDEBUG_ONLY(true));
+  if (!m_sparse_mip_memory)
+  {
+    progressive_texture_upload->run(vulkan::Application::instance().low_priority_queue(), std::move(uploaded));
+    return;
+  }
+
+  // Forget the levels that were loaded (they aren't considered resident) and release their memory again.
+  auto failed = [this, first_level, resident_level, uploaded = std::move(uploaded), released = std::move(released)](bool success){
+    if (!success)
+    {
+      m_base_mip_level.store(resident_level, std::memory_order::release);
+      m_sparse_mip_memory->release(m_vh_image, first_level, resident_level, released);
+    }
+    uploaded(success);
+  };
+
+  // Allocate the memory of the levels; it must be bound before they are uploaded.
+  std::vector<memory::SparseMipMemory::Binding> bindings = m_sparse_mip_memory->commit(m_vh_image, first_level, resident_level);
+  if (bindings.empty())
+  {
+    // All memory was reclaimed (it was still bound).
+    progressive_texture_upload->run(vulkan::Application::instance().low_priority_queue(), std::move(failed));
+    return;
+  }
+  auto sparse_bind = statefultask::create<task::SparseBind>(m_logical_device, std::move(bindings) COMMA_CWDEBUG_ONLY(true));
+  sparse_bind->set_resource_owner(resource_owner);
+  sparse_bind->run(vulkan::Application::instance().low_priority_queue(),
+      [progressive_texture_upload, failed = std::move(failed)](bool success) mutable {
+        if (success)
+          progressive_texture_upload->run(vulkan::Application::instance().low_priority_queue(), std::move(failed));
+        else
+          failed(false);
+      });
+}
+
+void Texture::evict(uint32_t resident_level, memory::SparseMipMemory::released_callback_type released)
+{
+  uint32_t const base_mip_level = m_base_mip_level.load(std::memory_order::relaxed);
+  // Levels can only be evicted when no upload is in flight.
+  ASSERT(resident_level >= base_mip_level);
+  m_base_mip_level.store(resident_level, std::memory_order::release);
+  // The memory is unbound once the frames that might still sample these levels retired.
+  if (m_sparse_mip_memory && base_mip_level < resident_level)
+    m_sparse_mip_memory->release(m_vh_image, base_mip_level, resident_level, std::move(released));
+}
+
+std::vector<vk::DeviceSize> Texture::residency_level_sizes(uint32_t mip_levels) const
+{
+  if (!m_sparse_mip_memory)
+    return std::vector<vk::DeviceSize>(mip_levels, 0);
+  return m_sparse_mip_memory->residency_level_sizes(m_vh_image);
+}
+
 void Texture::update_descriptor_array(task::SynchronousWindow const* owning_window, descriptor::FrameResourceCapableDescriptorSet const& descriptor_set, uint32_t binding, descriptor::ArrayElementRange array_elements) const
 {
   DoutEntering(dc::shaderresource, "Texture::update_descriptor_array(" << owning_window << ", " << descriptor_set << ", " << binding << ", " << array_elements << ")");
@@ -2,8 +2,17 @@
 
 #include "memory/Image.h"
 #include "memory/DataFeeder.h"
+#include "memory/SparseMipMemory.h"
 #include "descriptor/SetKeyContext.h"
 #include "descriptor/ArrayElementRange.h"
+#include "utils/Badge.h"
+#include <atomic>
+#include <functional>
+#include <vector>
+
+namespace task {
+class ProgressiveTextureUpload;
+} // namespace task
 
 namespace vulkan {
 
@@ -20,6 +29,17 @@ class Texture : public memory::Image
  private:
   vk::UniqueImageView   m_image_view;
   vk::UniqueSampler     m_sampler;
+  std::atomic<uint32_t> m_base_mip_level{0};    // The finest mip level that contains valid data (see upload_progressive).
+  // Set by upload_with_mipmaps when the mip levels are generated on the graphics queue (see record_mip_generation).
+  struct MipGeneration
+  {
+    vk::Extent2D m_extent;                      // The extent of level 0.
+    vk::ImageSubresourceRange m_levels;         // All levels; level 0 was uploaded.
+    uint32_t m_src_queue_family;                // The (transfer) queue family that released level 0.
+    uint32_t m_dst_queue_family;                // The graphics queue family that acquires it.
+  };
+  MipGeneration m_mip_generation;
+  std::atomic<bool> m_mip_generation_pending{false};    // Set once level 0 was released by the transfer queue.
 #if CW_DEBUG
   vulkan::ImageViewKind const* debug_image_view_kind;
 #endif
@@ -126,12 +146,17 @@ class Texture : public memory::Image
   // Class is move-only.
   // Note: do NOT move the Ambifix!
   // That is only initialized in-place with the constructor that takes just the Ambifix.
-  Texture(Texture&& rhs) : Image(std::move(rhs)), m_image_view(std::move(rhs.m_image_view)), m_sampler(std::move(rhs.m_sampler)), debug_image_view_kind(rhs.debug_image_view_kind) { }
+  Texture(Texture&& rhs) : Image(std::move(rhs)), m_image_view(std::move(rhs.m_image_view)), m_sampler(std::move(rhs.m_sampler)),
+    m_base_mip_level(rhs.m_base_mip_level.load(std::memory_order::relaxed)), m_mip_generation(rhs.m_mip_generation),
+    m_mip_generation_pending(rhs.m_mip_generation_pending.load(std::memory_order::relaxed)), debug_image_view_kind(rhs.debug_image_view_kind) { }
   Texture& operator=(Texture&& rhs)
   {
     this->memory::Image::operator=(std::move(rhs));
     m_image_view = std::move(rhs.m_image_view);
     m_sampler = std::move(rhs.m_sampler);
+    m_base_mip_level.store(rhs.m_base_mip_level.load(std::memory_order::relaxed), std::memory_order::relaxed);
+    m_mip_generation = rhs.m_mip_generation;
+    m_mip_generation_pending.store(rhs.m_mip_generation_pending.load(std::memory_order::relaxed), std::memory_order::relaxed);
 #if CW_DEBUG
     debug_image_view_kind = rhs.debug_image_view_kind;
 #endif
@@ -145,6 +170,12 @@ class Texture : public memory::Image
       std::unique_ptr<DataFeeder> texture_data_feeder,
       AIStatefulTask* parent, AIStatefulTask::condition_type texture_ready);
 
+  // Same, but call uploaded (from the thread pool) once the upload finished, instead of signalling a parent task.
+  void upload(vk::Extent2D extent, vulkan::ImageViewKind const& image_view_kind,
+      task::SynchronousWindow const* resource_owner,
+      std::unique_ptr<DataFeeder> texture_data_feeder,
+      std::function<void(bool success)> uploaded);
+
   // Same, but use s_default_image_view_kind.
   void upload(vk::Extent2D extent,
       task::SynchronousWindow const* resource_owner,
@@ -154,6 +185,75 @@ class Texture : public memory::Image
     upload(extent, s_default_image_view_kind, resource_owner, std::move(texture_data_feeder), parent, texture_ready);
   }
 
+  // Upload mip level 0 and generate the other mip levels of image_view_kind's image kind from it.
+  //
+  // The levels are generated on the GPU with a chain of linear blits if the format supports that
+  // (see LogicalDevice::supports_blit_mip_generation); that requires eTransferSrc usage. Blits need a graphics
+  // capable queue: if the transfer queue is one, they are recorded as part of the upload. Otherwise level 0 is
+  // released to the graphics queue family of resource_owner and the blits must be recorded on its graphics
+  // queue by calling record_mip_generation every frame, before the texture is sampled.
+  // If the format doesn't support linear blits, the levels are generated on the CPU by the thread that fills
+  // the staging buffer.
+  void upload_with_mipmaps(vk::Extent2D extent, vulkan::ImageViewKind const& image_view_kind,
+      task::SynchronousWindow const* resource_owner,
+      std::unique_ptr<DataFeeder> level0_data_feeder,
+      AIStatefulTask* parent, AIStatefulTask::condition_type texture_ready);
+
+  // If upload_with_mipmaps left the generation of the mip levels to the graphics queue and the upload of level 0
+  // finished, record the acquisition of level 0 followed by the blits into command_buffer and return true.
+  // command_buffer must be a command buffer of the graphics queue of the resource owner, outside a render pass.
+  bool record_mip_generation(vk::CommandBuffer command_buffer);
+
+  // Upload the mip levels of the texture coarse to fine; level_feeders[level] provides the pixels of mip level `level`
+  // (see vk_utils::MipChain). The image_view_kind must have a full mip chain (levels) and the sampler a maxLod
+  // that allows sampling them (VK_LOD_CLAMP_NONE).
+  //
+  // The texture can be drawn as soon as level_ready was called for the first time, provided that the shader
+  // doesn't sample finer than min_lod(). For example:
+  //
+  //   textureLod(s, uv, max(textureQueryLod(s, uv).x, min_lod))
+  //
+  // level_ready is called with the new base mip level (from the thread pool) every time a finer level
+  // became available; parent is signalled with texture_ready once all levels landed.
+  void upload_progressive(vk::Extent2D extent, vulkan::ImageViewKind const& image_view_kind,
+      task::SynchronousWindow const* resource_owner,
+      std::vector<std::unique_ptr<DataFeeder>> level_feeders,
+      AIStatefulTask* parent, AIStatefulTask::condition_type texture_ready,
+      std::function<void(uint32_t base_mip_level)> level_ready = {});
+
+  // Upload levels [first_level, resident_level) coarse to fine, where resident_level is the current base mip level;
+  // level_feeders[level] provides the pixels of mip level `level` (elements outside that range are not used).
+  // Used to load the levels that memory::TextureResidency requests (StreamIn). The same requirements as for
+  // upload_progressive apply. uploaded is called (from the thread pool) once all levels landed or an upload failed.
+  //
+  // If the texture was created with MemoryCreateInfo::sparse_mip_memory, the memory of the levels is allocated
+  // and bound first. If the load fails, the base mip level is reset to resident_level and that memory is released
+  // again, like evict does: released is then called with the size of the memory once it was freed.
+  void stream_in(uint32_t first_level, vk::Extent2D extent, vulkan::ImageViewKind const& image_view_kind,
+      task::SynchronousWindow const* resource_owner,
+      std::vector<std::unique_ptr<DataFeeder>> level_feeders,
+      std::function<void(bool success)> uploaded,
+      std::function<void(uint32_t base_mip_level)> level_ready = {},
+      memory::SparseMipMemory::released_callback_type released = {});
+
+  // Stop sampling the levels finer than resident_level (see memory::TextureResidency's evict callback).
+  // The contents of those levels are considered lost. If the texture was created with MemoryCreateInfo::sparse_mip_memory,
+  // their memory is freed once the frames that might sample them retired; released is then called with its size
+  // (see memory::TextureResidency::released). Otherwise the memory of the image is not released.
+  void evict(uint32_t resident_level, memory::SparseMipMemory::released_callback_type released = {});
+
+  // The sizes of the mip levels to register with memory::TextureResidency::add. For a texture that was created with
+  // MemoryCreateInfo::sparse_mip_memory those are the sizes of the memory of each level. Otherwise the image was allocated
+  // as a whole, and evicting levels doesn't free anything: all sizes are zero and the memory of the image counts as heap
+  // usage outside the budget of the textures (see memory::TextureResidency::texture_budget).
+  std::vector<vk::DeviceSize> residency_level_sizes(uint32_t mip_levels) const;
+
+  // Called by ProgressiveTextureUpload when all levels from base_mip_level up to the coarsest level landed.
+  void set_base_mip_level(utils::Badge<task::ProgressiveTextureUpload>, uint32_t base_mip_level)
+  {
+    m_base_mip_level.store(base_mip_level, std::memory_order::release);
+  }
+
   void release_GPU_resources()
   {
     m_sampler.reset();
@@ -169,6 +269,8 @@ class Texture : public memory::Image
   }
   vk::ImageView image_view() const { return *m_image_view; }
   vk::Sampler sampler() const { return *m_sampler; }
+  // Thread-safe. The lowest LOD that may be sampled: zero once the texture is fully uploaded.
+  float min_lod() const { return m_base_mip_level.load(std::memory_order::acquire); }
 
 #ifdef CWDEBUG
   void print_on(std::ostream& os) const;
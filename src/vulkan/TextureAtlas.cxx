@@ -0,0 +1,129 @@
+#include "sys.h"
+#include "TextureAtlas.h"
+#include <bit>
+#include <cstring>
+#include "debug.h"
+
+namespace vulkan {
+
+namespace {
+constexpr uint32_t texel_size = 4;      // R8G8B8A8.
+} // namespace
+
+TextureAtlas::TextureAtlas(
+    LogicalDevice const* logical_device,
+    vk::Extent2D layer_extent,
+    uint32_t max_layers,
+    uint32_t padding,
+    FrameResourceIndex number_of_frame_resources,
+    SamplerKind const& sampler_kind,
+    GraphicsSettingsPOD const& graphics_settings
+    COMMA_CWDEBUG_ONLY(Ambifix const& ambifix)) :
+  m_image_kind({
+    .format = vk::Format::eR8G8B8A8Unorm,
+    .array_layers = max_layers,
+    .usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled
+  }),
+  m_image_view_kind(m_image_kind, {
+    .view_type = vk::ImageViewType::e2DArray,
+    .subresource_range = vk_defaults::ImageSubresourceRange{vk::ImageAspectFlagBits::eColor, 0, 1, 0, max_layers}
+  }),
+  m_packer(layer_extent, max_layers, padding, texel_size),
+  m_texture(logical_device, layer_extent, m_image_view_kind, sampler_kind, graphics_settings,
+      { .properties = vk::MemoryPropertyFlagBits::eDeviceLocal }
+      COMMA_CWDEBUG_ONLY(ambifix)),
+  m_staging_buffers(number_of_frame_resources.get_value())
+  COMMA_CWDEBUG_ONLY(m_ambifix(ambifix))
+{
+  DoutEntering(dc::vulkan, "TextureAtlas::TextureAtlas(" << logical_device << ", " << layer_extent << ", " << max_layers << ", " <<
+      padding << ", " << number_of_frame_resources << ", sampler_kind, graphics_settings) [" << this << "]");
+}
+
+bool TextureAtlas::record_flush(vk::CommandBuffer command_buffer, FrameResourceIndex frame_resource_index)
+{
+  std::vector<vk_utils::AtlasPacker::Region> const regions = m_packer.take_dirty_regions();
+  if (regions.empty())
+    return false;
+
+  DoutEntering(dc::vkframe, "TextureAtlas::record_flush(" << command_buffer << ", " << frame_resource_index << ") [" << this << "]");
+
+  // A copy command per region, all reading from the staging buffer of this frame resource.
+  std::vector<vk::BufferImageCopy> copy_regions;
+  copy_regions.reserve(regions.size());
+  vk::DeviceSize size = 0;
+  for (vk_utils::AtlasPacker::Region const& region : regions)
+  {
+    copy_regions.push_back({
+      .bufferOffset = size,
+      .bufferRowLength = 0,
+      .bufferImageHeight = 0,
+      .imageSubresource = vk::ImageSubresourceLayers{
+        .aspectMask = vk::ImageAspectFlagBits::eColor,
+        .mipLevel = 0,
+        .baseArrayLayer = region.m_layer,
+        .layerCount = 1
+      },
+      .imageOffset = vk::Offset3D{ region.m_rect.offset.x, region.m_rect.offset.y, 0 },
+      .imageExtent = vk::Extent3D{ region.m_rect.extent.width, region.m_rect.extent.height, 1 }
+    });
+    size += vk::DeviceSize{region.m_rect.extent.width} * region.m_rect.extent.height * texel_size;
+  }
+  Dout(dc::vkframe, "Uploading " << regions.size() << " regions (" << size << " bytes).");
+
+  // The previous command buffer of this frame resource completed, so its staging buffer may be overwritten (or replaced).
+  memory::StagingBuffer& staging_buffer = m_staging_buffers[frame_resource_index];
+  if (!staging_buffer.m_vh_buffer || staging_buffer.m_size < size)
+    staging_buffer = memory::StagingBuffer(m_texture.m_logical_device, std::bit_ceil(size)
+        COMMA_CWDEBUG_ONLY(".m_staging_buffers[" + to_string(frame_resource_index) + "]" + m_ambifix));
+  std::byte* dst = static_cast<std::byte*>(staging_buffer.m_pointer);
+  for (size_t i = 0; i < regions.size(); ++i)
+  {
+    std::vector<std::byte> const region_pixels = m_packer.region_pixels(regions[i]);
+    std::memcpy(dst + copy_regions[i].bufferOffset, region_pixels.data(), region_pixels.size());
+  }
+  m_texture.m_logical_device->flush_mapped_allocation(staging_buffer.m_vh_allocation, 0, size);
+
+  // The first upload gives all layers a defined layout; the regions that are not uploaded are not sampled yet.
+  // Afterwards, wait until the fragment shaders of all previously submitted frames stopped sampling the texels
+  // that are about to be overwritten (for example by images that were moved there by a repack).
+  uint32_t const max_layers = m_packer.max_layers();
+  vk::ImageSubresourceRange const all_layers = vk_defaults::ImageSubresourceRange{vk::ImageAspectFlagBits::eColor, 0, 1, 0, max_layers};
+  vk::ImageMemoryBarrier const pre_transfer_image_memory_barrier{
+    .srcAccessMask = m_layout_defined ? vk::AccessFlags{vk::AccessFlagBits::eShaderRead} : vk::AccessFlags(0),
+    .dstAccessMask = vk::AccessFlagBits::eTransferWrite,
+    .oldLayout = m_layout_defined ? vk::ImageLayout::eShaderReadOnlyOptimal : vk::ImageLayout::eUndefined,
+    .newLayout = vk::ImageLayout::eTransferDstOptimal,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .image = m_texture.m_vh_image,
+    .subresourceRange = all_layers
+  };
+  vk::PipelineStageFlags const generating_stages = m_layout_defined ?
+      vk::PipelineStageFlags{vk::PipelineStageFlagBits::eFragmentShader} : vk::PipelineStageFlags{vk::PipelineStageFlagBits::eTopOfPipe};
+  command_buffer.pipelineBarrier(generating_stages, vk::PipelineStageFlagBits::eTransfer, {}, {}, {}, { pre_transfer_image_memory_barrier });
+  m_layout_defined = true;
+
+  command_buffer.copyBufferToImage(staging_buffer.m_vh_buffer, m_texture.m_vh_image, vk::ImageLayout::eTransferDstOptimal, copy_regions);
+
+  vk::ImageMemoryBarrier const post_transfer_image_memory_barrier{
+    .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+    .dstAccessMask = vk::AccessFlagBits::eShaderRead,
+    .oldLayout = vk::ImageLayout::eTransferDstOptimal,
+    .newLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .image = m_texture.m_vh_image,
+    .subresourceRange = all_layers
+  };
+  command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader, {}, {}, {}, { post_transfer_image_memory_barrier });
+  return true;
+}
+
+void TextureAtlas::release_GPU_resources()
+{
+  for (memory::StagingBuffer& staging_buffer : m_staging_buffers)
+    staging_buffer = memory::StagingBuffer{};
+  m_texture.release_GPU_resources();
+}
+
+} // namespace vulkan
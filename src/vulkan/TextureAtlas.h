@@ -0,0 +1,88 @@
+#pragma once
+
+#include "Texture.h"
+#include "FrameResourceIndex.h"
+#include "memory/StagingBuffer.h"
+#include "vk_utils/AtlasPacker.h"
+#include "utils/Vector.h"
+
+namespace vulkan {
+
+// TextureAtlas
+//
+// Many small images (icons, glyphs, sprites) packed into the layers of one R8G8B8A8 array texture,
+// so that they can be drawn with a single descriptor. Images are added and removed at run time;
+// record_flush() uploads only the regions that changed since the previous flush.
+//
+// Shaders sample the atlas with a sampler2DArray at vec3(uv, layer), using the rectangle returned
+// by uv(). Each image has a gutter of `padding` texels that repeats its edge, so linear filtering
+// doesn't bleed between neighbours (use a padding of at least 1 for bilinear filtering).
+//
+// When removed images leave too much unused space, insert() repacks the atlas; that moves images.
+// Therefore callers must fetch uv() again for all their images whenever generation() changed.
+//
+// The upload is recorded in the command buffer of the frame that draws with the atlas, in front of
+// the first draw that samples it, so that it runs on the same queue as those draws. The barrier in
+// front of the copy waits for the fragment shaders of all frames that were submitted before, hence
+// texels that are overwritten by a repack (or update) are only overwritten once the frames that
+// sampled them with the old UVs finished, and the frame itself sees the new texels. Call
+// record_flush() every frame in which images were inserted, updated or erased, before drawing
+// with the new UVs.
+//
+// This class is not thread-safe: all member functions must be called from the render loop of the
+// window that draws with the atlas.
+//
+class TextureAtlas
+{
+ public:
+  using id_type = vk_utils::AtlasPacker::id_type;
+  using UVRect = vk_utils::AtlasPacker::UVRect;
+
+ private:
+  ImageKind const m_image_kind;
+  ImageViewKind const m_image_view_kind;        // Must be initialized before m_texture, and outlive it.
+  vk_utils::AtlasPacker m_packer;
+  Texture m_texture;
+  bool m_layout_defined = false;                // Set after the first upload transitioned all layers to eShaderReadOnlyOptimal.
+  utils::Vector<memory::StagingBuffer, FrameResourceIndex> m_staging_buffers;   // One per frame resource; grown when needed.
+#ifdef CWDEBUG
+  Ambifix m_ambifix;                            // Used for the debug names of the staging buffers.
+#endif
+
+ public:
+  // An atlas of max_layers layers of layer_extent texels, drawn by a window with number_of_frame_resources frame resources.
+  TextureAtlas(
+      LogicalDevice const* logical_device,
+      vk::Extent2D layer_extent,
+      uint32_t max_layers,
+      uint32_t padding,
+      FrameResourceIndex number_of_frame_resources,
+      SamplerKind const& sampler_kind,
+      GraphicsSettingsPOD const& graphics_settings
+      COMMA_CWDEBUG_ONLY(Ambifix const& ambifix));
+
+  // Add an image of extent with pixels in R8G8B8A8 (tightly packed rows). Returns nullopt if the atlas is full.
+  std::optional<id_type> insert(vk::Extent2D extent, std::span<std::byte const> pixels) { return m_packer.insert(extent, pixels); }
+  // Replace the pixels of image id.
+  void update(id_type id, std::span<std::byte const> pixels) { m_packer.update(id, pixels); }
+  // Remove image id.
+  void erase(id_type id) { m_packer.erase(id); }
+
+  UVRect uv(id_type id) const { return m_packer.uv(id); }
+  uint64_t generation() const { return m_packer.generation(); }
+  vk_utils::AtlasPacker::Stats stats() const { return m_packer.stats(); }
+
+  // Record the upload of the dirty regions of all layers, in a single copy command, into command_buffer:
+  // the command buffer of frame resource frame_resource_index, outside a render pass. The staging buffer
+  // of that frame resource is reused, which is safe because its previous command buffer completed.
+  // Returns false if there was nothing to upload.
+  bool record_flush(vk::CommandBuffer command_buffer, FrameResourceIndex frame_resource_index);
+
+  void release_GPU_resources();
+
+  // Accessors.
+  Texture const& texture() const { return m_texture; }
+  ImageViewKind const& image_view_kind() const { return m_image_view_kind; }
+};
+
+} // namespace vulkan
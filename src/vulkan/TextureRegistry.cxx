@@ -0,0 +1,177 @@
+#include "sys.h"
+#include "TextureRegistry.h"
+#include "SamplerKind.h"
+#include "Application.h"
+#include "vk_utils/ContentHash.h"
+#include "vk_utils/ImageData.h"
+#include "vk_utils/MipChain.h"
+#include "vk_utils/format.h"
+#include "vk_utils/get_binary_file_contents.h"
+#include "utils/AIAlert.h"
+#include <boost/container_hash/hash.hpp>
+#include <vector>
+#include "debug.h"
+
+namespace vulkan {
+
+namespace {
+
+// Used to keep the keys of image files and of pixels apart.
+enum ContentType : uint32_t {
+  pixels_content,
+  image_file_content
+};
+
+// The upload writes to the image of texture: keep it alive until the upload finished, even if all handles are destroyed before that.
+TextureRegistry::ready_callback_type keep_alive_until_uploaded(std::shared_ptr<Texture> texture, TextureRegistry::ready_callback_type uploaded)
+{
+  return [texture = std::move(texture), uploaded = std::move(uploaded)](bool success) mutable {
+    uploaded(success);
+    // This might be the last handle; its destruction is delayed by the registry until the current frame retired.
+    texture.reset();
+  };
+}
+
+} // namespace
+
+//static
+uint64_t TextureRegistry::kind_hash(ImageViewKind const& image_view_kind, SamplerKind const& sampler_kind, GraphicsSettingsPOD const& graphics_settings)
+{
+  size_t hash = 0;
+
+  ImageKind const& image_kind = image_view_kind.image_kind();
+  boost::hash_combine(hash, static_cast<VkImageCreateFlags>(image_kind->flags));
+  boost::hash_combine(hash, static_cast<uint32_t>(image_kind->image_type));
+  boost::hash_combine(hash, static_cast<uint32_t>(image_kind->format));
+  boost::hash_combine(hash, image_kind->mip_levels);
+  boost::hash_combine(hash, image_kind->array_layers);
+  boost::hash_combine(hash, static_cast<uint32_t>(image_kind->samples));
+  boost::hash_combine(hash, static_cast<uint32_t>(image_kind->tiling));
+  boost::hash_combine(hash, static_cast<VkImageUsageFlags>(image_kind->usage));
+
+  vk::ImageViewCreateInfo const view = image_view_kind({});
+  boost::hash_combine(hash, static_cast<VkImageViewCreateFlags>(view.flags));
+  boost::hash_combine(hash, static_cast<uint32_t>(view.viewType));
+  boost::hash_combine(hash, static_cast<uint32_t>(view.format));
+  boost::hash_combine(hash, static_cast<uint32_t>(view.components.r));
+  boost::hash_combine(hash, static_cast<uint32_t>(view.components.g));
+  boost::hash_combine(hash, static_cast<uint32_t>(view.components.b));
+  boost::hash_combine(hash, static_cast<uint32_t>(view.components.a));
+  boost::hash_combine(hash, static_cast<VkImageAspectFlags>(view.subresourceRange.aspectMask));
+  boost::hash_combine(hash, view.subresourceRange.baseMipLevel);
+  boost::hash_combine(hash, view.subresourceRange.levelCount);
+  boost::hash_combine(hash, view.subresourceRange.baseArrayLayer);
+  boost::hash_combine(hash, view.subresourceRange.layerCount);
+
+  vk::SamplerCreateInfo const sampler = sampler_kind(graphics_settings);
+  boost::hash_combine(hash, static_cast<VkSamplerCreateFlags>(sampler.flags));
+  boost::hash_combine(hash, static_cast<uint32_t>(sampler.magFilter));
+  boost::hash_combine(hash, static_cast<uint32_t>(sampler.minFilter));
+  boost::hash_combine(hash, static_cast<uint32_t>(sampler.mipmapMode));
+  boost::hash_combine(hash, static_cast<uint32_t>(sampler.addressModeU));
+  boost::hash_combine(hash, static_cast<uint32_t>(sampler.addressModeV));
+  boost::hash_combine(hash, static_cast<uint32_t>(sampler.addressModeW));
+  boost::hash_combine(hash, sampler.mipLodBias);
+  boost::hash_combine(hash, sampler.anisotropyEnable);
+  boost::hash_combine(hash, sampler.maxAnisotropy);
+  boost::hash_combine(hash, sampler.compareEnable);
+  boost::hash_combine(hash, static_cast<uint32_t>(sampler.compareOp));
+  boost::hash_combine(hash, sampler.minLod);
+  boost::hash_combine(hash, sampler.maxLod);
+  boost::hash_combine(hash, static_cast<uint32_t>(sampler.borderColor));
+  boost::hash_combine(hash, sampler.unnormalizedCoordinates);
+
+  return hash;
+}
+
+TextureRegistry::handle_type TextureRegistry::acquire(
+    LogicalDevice const* logical_device,
+    vk::Extent2D extent,
+    std::span<std::byte const> pixels,
+    ImageViewKind const& image_view_kind,
+    SamplerKind const& sampler_kind,
+    GraphicsSettingsPOD const& graphics_settings,
+    task::SynchronousWindow const* resource_owner,
+    ready_callback_type ready
+    COMMA_CWDEBUG_ONLY(Ambifix const& ambifix))
+{
+  DoutEntering(dc::vulkan, "TextureRegistry::acquire(" << logical_device << ", " << extent << ", <" << pixels.size() << " bytes>, " <<
+      image_view_kind << ", sampler_kind, graphics_settings, " << resource_owner << ", ready)");
+  ASSERT(pixels.size() == size_t{extent.width} * extent.height * vk_utils::format_texel_size(image_view_kind.image_kind()->format));
+
+  size_t kind = kind_hash(image_view_kind, sampler_kind, graphics_settings);
+  boost::hash_combine(kind, pixels_content);
+  boost::hash_combine(kind, extent.width);
+  boost::hash_combine(kind, extent.height);
+
+  return m_registry.acquire({ vk_utils::content_hash(pixels), pixels.size(), kind },
+      [&](ready_callback_type uploaded) -> vk_utils::ContentRegistry<Texture>::Created {
+        std::shared_ptr<Texture> texture = m_registry.make(logical_device, extent, image_view_kind, sampler_kind, graphics_settings,
+            Texture::MemoryCreateInfo{ .properties = vk::MemoryPropertyFlagBits::eDeviceLocal }
+            COMMA_CWDEBUG_ONLY(ambifix));
+        texture->upload(extent, image_view_kind, resource_owner,
+            std::make_unique<vk_utils::MipLevelDataFeeder>(std::vector<std::byte>(pixels.begin(), pixels.end())),
+            keep_alive_until_uploaded(texture, std::move(uploaded)));
+        return { std::move(texture), pixels.size() };
+      },
+      std::move(ready));
+}
+
+TextureRegistry::handle_type TextureRegistry::acquire_image_file(
+    LogicalDevice const* logical_device,
+    std::span<std::byte const> file_data,
+    ImageViewKind const& image_view_kind,
+    SamplerKind const& sampler_kind,
+    GraphicsSettingsPOD const& graphics_settings,
+    task::SynchronousWindow const* resource_owner,
+    ready_callback_type ready
+    COMMA_CWDEBUG_ONLY(Ambifix const& ambifix))
+{
+  DoutEntering(dc::vulkan, "TextureRegistry::acquire_image_file(" << logical_device << ", <" << file_data.size() << " bytes>, " <<
+      image_view_kind << ", sampler_kind, graphics_settings, " << resource_owner << ", ready)");
+
+  size_t kind = kind_hash(image_view_kind, sampler_kind, graphics_settings);
+  boost::hash_combine(kind, image_file_content);
+
+  // Only decode the file if its contents weren't seen before.
+  return m_registry.acquire({ vk_utils::content_hash(file_data), file_data.size(), kind },
+      [&](ready_callback_type uploaded) -> vk_utils::ContentRegistry<Texture>::Created {
+        // stb_image decodes to 8 bits per component.
+        ASSERT(vk_utils::format_is_8bit_unorm_or_srgb(image_view_kind.image_kind()->format));
+        int const components = vk_utils::format_component_count(image_view_kind.image_kind()->format);
+        vk_utils::stbi::ImageData image_data(file_data, components);
+        vk::Extent2D const extent = image_data.extent();
+        uint64_t const bytes = image_data.size();
+        std::shared_ptr<Texture> texture = m_registry.make(logical_device, extent, image_view_kind, sampler_kind, graphics_settings,
+            Texture::MemoryCreateInfo{ .properties = vk::MemoryPropertyFlagBits::eDeviceLocal }
+            COMMA_CWDEBUG_ONLY(ambifix));
+        texture->upload(extent, image_view_kind, resource_owner,
+            std::make_unique<vk_utils::stbi::ImageDataFeeder>(std::move(image_data)), keep_alive_until_uploaded(texture, std::move(uploaded)));
+        return { std::move(texture), bytes };
+      },
+      std::move(ready));
+}
+
+TextureRegistry::handle_type TextureRegistry::acquire_image_file(
+    LogicalDevice const* logical_device,
+    std::filesystem::path const& filename,
+    ImageViewKind const& image_view_kind,
+    SamplerKind const& sampler_kind,
+    GraphicsSettingsPOD const& graphics_settings,
+    task::SynchronousWindow const* resource_owner,
+    ready_callback_type ready
+    COMMA_CWDEBUG_ONLY(Ambifix const& ambifix))
+{
+  std::vector<std::byte> const file_data = vk_utils::get_binary_file_contents(filename, Application::instance().file_reader());
+  try
+  {
+    return acquire_image_file(logical_device, file_data, image_view_kind, sampler_kind, graphics_settings, resource_owner, std::move(ready)
+        COMMA_CWDEBUG_ONLY(ambifix));
+  }
+  catch (AIAlert::Error const& error)
+  {
+    THROW_ALERT("Could not get image data for file \"[FILENAME]\"", AIArgs("[FILENAME]", filename), error);
+  }
+}
+
+} // namespace vulkan
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "Texture.h"
+#include "vk_utils/ContentRegistry.h"
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <span>
+
+namespace vulkan {
+
+// TextureRegistry
+//
+// Shares textures with identical contents: loading the same image file (or the same pixels) twice
+// returns the same Texture, so that duplicates are created, uploaded and bound to descriptors only once.
+//
+// Textures are identified by a hash of their contents together with everything else that makes a
+// Texture: the image kind (format, mip levels, usage, ...), the image view kind, the sampler (as
+// created with the graphics settings) and, for pixels, the extent. Image files are identified by a
+// hash of the file contents, which avoids decoding files that were loaded before; use acquire() with
+// the decoded pixels to also share images that are stored in different files or file formats.
+//
+// The returned handles are reference counted. When the last handle of a texture is destroyed, the
+// frames that are in flight might still sample it; therefore the texture is destroyed once the frame
+// during which that happened retired (see begin_frame() and retire(), which SynchronousWindow calls
+// for its texture_registry()). An upload keeps its texture alive until it finished. The
+// image_view_kind and sampler_kind that a texture was created with must outlive it, and the registry
+// must outlive the uploads it started.
+//
+class TextureRegistry
+{
+ public:
+  using handle_type = std::shared_ptr<Texture const>;
+  using ready_callback_type = std::function<void(bool success)>;
+  using Stats = vk_utils::ContentRegistry<Texture>::Stats;
+  using frame_type = vk_utils::ContentRegistry<Texture>::frame_type;
+
+ private:
+  vk_utils::ContentRegistry<Texture> m_registry;
+
+ public:
+  // Return the texture with pixels (rows without padding, in the format of image_view_kind) of extent.
+  // Calls ready (from the thread pool, or right away) once the texture was uploaded.
+  handle_type acquire(
+      LogicalDevice const* logical_device,
+      vk::Extent2D extent,
+      std::span<std::byte const> pixels,
+      ImageViewKind const& image_view_kind,
+      SamplerKind const& sampler_kind,
+      GraphicsSettingsPOD const& graphics_settings,
+      task::SynchronousWindow const* resource_owner,
+      ready_callback_type ready
+      COMMA_CWDEBUG_ONLY(Ambifix const& ambifix));
+
+  // Same, but for the contents of an image file (decoded with stb_image to the format of image_view_kind, which must be 8 bits per component).
+  handle_type acquire_image_file(
+      LogicalDevice const* logical_device,
+      std::span<std::byte const> file_data,
+      ImageViewKind const& image_view_kind,
+      SamplerKind const& sampler_kind,
+      GraphicsSettingsPOD const& graphics_settings,
+      task::SynchronousWindow const* resource_owner,
+      ready_callback_type ready
+      COMMA_CWDEBUG_ONLY(Ambifix const& ambifix));
+
+  // Same, reading the file first.
+  handle_type acquire_image_file(
+      LogicalDevice const* logical_device,
+      std::filesystem::path const& filename,
+      ImageViewKind const& image_view_kind,
+      SamplerKind const& sampler_kind,
+      GraphicsSettingsPOD const& graphics_settings,
+      task::SynchronousWindow const* resource_owner,
+      ready_callback_type ready
+      COMMA_CWDEBUG_ONLY(Ambifix const& ambifix));
+
+  // Textures that lose their last handle from now on might be used by frame (frame numbers must increase).
+  void begin_frame(frame_type frame) { m_registry.begin_frame(frame); }
+  // Every frame up to and including completed_frame finished on the GPU: destroy the textures that were waiting for that.
+  void retire(frame_type completed_frame) { m_registry.retire(completed_frame); }
+
+  // Thread-safe. The number of textures and bytes that were shared instead of uploaded again, etc.
+  Stats stats() const { return m_registry.stats(); }
+
+  // The hash of everything but the contents that determines a texture.
+  static uint64_t kind_hash(ImageViewKind const& image_view_kind, SamplerKind const& sampler_kind, GraphicsSettingsPOD const& graphics_settings);
+};
+
+} // namespace vulkan
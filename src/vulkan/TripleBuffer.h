@@ -0,0 +1,67 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <concepts>
+#include <cstdint>
+
+namespace vulkan {
+
+// TripleBuffer
+//
+// Lock-free exchange of the latest value of type T between a single producer thread and a single consumer thread.
+//
+// The producer writes to a back buffer that only it can access (write_buffer()) and then publishes it with publish().
+// The consumer calls update() to take the latest published value (if any) and then reads it with read_buffer()
+// until the next call to update(); that buffer can't be touched by the producer. Neither side ever waits:
+// values that are published faster than they are consumed are simply skipped.
+//
+// The three buffers rotate between the roles "back" (producer), "middle" (last published) and "front" (consumer);
+// m_middle holds the index of the middle buffer plus a bit that is set when it contains a value that the
+// consumer didn't see yet.
+//
+template<typename T>
+class TripleBuffer
+{
+  static constexpr uint8_t index_mask = 0x3;
+  static constexpr uint8_t fresh_bit = 0x4;
+
+ private:
+  std::array<T, 3> m_buffers;
+  uint8_t m_back = 0;                           // Only accessed by the producer.
+  std::atomic<uint8_t> m_middle{1};             // Index of the middle buffer, possibly with fresh_bit set.
+  uint8_t m_front = 2;                          // Only accessed by the consumer.
+
+ public:
+  // All buffers value-initialized.
+  TripleBuffer() requires std::default_initializable<T> : m_buffers{} { }
+  // All buffers a copy of initial_value; read_buffer() returns it until the first value was taken.
+  explicit TripleBuffer(T const& initial_value) requires std::copy_constructible<T> : m_buffers{ initial_value, initial_value, initial_value } { }
+
+  // Producer side.
+  T& write_buffer() { return m_buffers[m_back]; }
+
+  // Producer side. Make the contents of write_buffer() available to the consumer.
+  // After this call write_buffer() refers to a different buffer, with unspecified (old) contents.
+  void publish()
+  {
+    // Release: the writes to the back buffer must be visible to the consumer that takes it.
+    m_back = m_middle.exchange(m_back | fresh_bit, std::memory_order::acq_rel) & index_mask;
+  }
+
+  // Consumer side. Take the latest published value, if there is one that wasn't taken yet.
+  // Returns true if read_buffer() changed.
+  bool update()
+  {
+    if (!(m_middle.load(std::memory_order::relaxed) & fresh_bit))
+      return false;
+    // Acquire: see the writes of the producer to the buffer that we take.
+    m_front = m_middle.exchange(m_front, std::memory_order::acq_rel) & index_mask;
+    return true;
+  }
+
+  // Consumer side. The value that was taken by the last successful update().
+  T const& read_buffer() const { return m_buffers[m_front]; }
+};
+
+} // namespace vulkan
@@ -0,0 +1,523 @@
+#include "sys.h"
+#include "VirtualTexture.h"
+#include "Application.h"
+#include "memory/DeviceSparseMipMemoryBackend.h"
+#include "meshlet/MeshletShaders.h"
+#include "queues/SparseBind.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <numeric>
+#include "debug.h"
+
+namespace vulkan {
+
+namespace {
+constexpr uint32_t texel_size = 4;      // R8G8B8A8.
+
+// The indirection texture has a texel per page on every level of the page table. Vulkan rounds the extent
+// of mip levels down, while the page table rounds up; therefore the indirection texture is rounded up to
+// a power of two, which has the same number of levels and on every level at least as many texels as the
+// page table has pages.
+vk::Extent2D indirection_extent(vk::Extent2D extent)
+{
+  return { std::bit_ceil(extent.width), std::bit_ceil(extent.height) };
+}
+
+uint32_t indirection_levels(vk::Extent2D extent)
+{
+  return std::bit_width(std::bit_ceil(std::max(extent.width, extent.height)));
+}
+
+// Return the extent of the sparse blocks of images of image_kind, or {0, 0} if those can't be sparse resident.
+vk::Extent2D sparse_granularity(LogicalDevice const* logical_device, ImageKind const& image_kind)
+{
+  if (!logical_device->supports_sparse_residency())
+    return {};
+  std::vector<vk::SparseImageFormatProperties> const properties = logical_device->vh_physical_device().getSparseImageFormatProperties(
+      image_kind->format, image_kind->image_type, image_kind->samples, image_kind->usage, image_kind->tiling);
+  if (properties.empty())
+    return {};
+  return { properties[0].imageGranularity.width, properties[0].imageGranularity.height };
+}
+
+// Slots must start at, and cover, whole sparse blocks: round slot_size up to a multiple of the block width and height.
+uint32_t rounded_slot_stride(uint32_t slot_size, vk::Extent2D granularity)
+{
+  if (granularity.width == 0)
+    return slot_size;
+  uint32_t const block = std::lcm(granularity.width, granularity.height);
+  return (slot_size + block - 1) / block * block;
+}
+
+} // namespace
+
+VirtualTexture::VirtualTexture(
+    LogicalDevice const* logical_device,
+    task::SynchronousWindow const* resource_owner,
+    vk::Extent2D extent,
+    uint32_t page_size,
+    uint32_t border,
+    vk::Extent2D slots,
+    FrameResourceIndex number_of_frame_resources,
+    uint32_t feedback_entries,
+    SamplerKind const& sampler_kind,
+    GraphicsSettingsPOD const& graphics_settings,
+    page_request_callback_type page_request,
+    page_evicted_callback_type page_evicted
+    COMMA_CWDEBUG_ONLY(Ambifix const& ambifix)) :
+  m_page_size(page_size),
+  m_border(border),
+  m_slots(slots),
+  m_physical_image_kind({
+    .format = vk::Format::eR8G8B8A8Unorm,
+    .usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled
+  }),
+  m_physical_image_view_kind(m_physical_image_kind, {}),
+  m_sparse_granularity(sparse_granularity(logical_device, m_physical_image_kind)),
+  m_slot_stride(rounded_slot_stride(slot_size(), m_sparse_granularity)),
+  m_physical_texture(logical_device, vk::Extent2D{ slots.width * m_slot_stride, slots.height * m_slot_stride },
+      m_physical_image_view_kind, sampler_kind, graphics_settings,
+      { .properties = vk::MemoryPropertyFlagBits::eDeviceLocal, .sparse_residency = is_sparse() }
+      COMMA_CWDEBUG_ONLY(".m_physical_texture" + ambifix)),
+  m_indirection_image_kind({
+    .format = vk::Format::eR8G8B8A8Unorm,
+    .mip_levels = indirection_levels(extent),
+    .usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled
+  }),
+  m_indirection_image_view_kind(m_indirection_image_kind, {
+    .subresource_range = vk_defaults::ImageSubresourceRange{vk::ImageAspectFlagBits::eColor, 0, indirection_levels(extent), 0, 1}
+  }),
+  m_indirection_extent(indirection_extent(extent)),
+  // The indirection texture is read with texelFetch, which ignores the filtering of the sampler.
+  m_indirection_texture(logical_device, m_indirection_extent, m_indirection_image_view_kind, sampler_kind, graphics_settings,
+      { .properties = vk::MemoryPropertyFlagBits::eDeviceLocal }
+      COMMA_CWDEBUG_ONLY(".m_indirection_texture" + ambifix)),
+  m_page_request(std::move(page_request)),
+  m_page_evicted(std::move(page_evicted)),
+  m_page_table(extent, slots.width * slots.height,
+      [this](Load const& load){
+        if (is_sparse())
+          bind_slot(load);
+        else
+          m_page_request(load);
+      },
+      // The slot stays in quarantine in the page table until no frame can sample it anymore.
+      [this](PageId page, memory::VirtualTexturePageTable::slot_type slot){
+        Dout(dc::vkframe, "Evicted virtual texture page " << page << " from slot " << slot << ".");
+        if (is_sparse())
+        {
+          // Its memory stays bound until that is the case too (see unbind_released_slots).
+          sparse_slots_t::wat sparse_slots_w(m_sparse_slots);
+          SparseSlot& sparse_slot = (*sparse_slots_w)[slot];
+          if (sparse_slot.m_vh_allocation)
+          {
+            sparse_slot.m_releasing = true;
+            sparse_slot.m_released_frame = m_frame;
+          }
+        }
+        if (m_page_evicted)
+          m_page_evicted(page);
+      }),
+  m_frame_resource_frames(number_of_frame_resources.get_value()),
+  m_staging_buffers(number_of_frame_resources.get_value()),
+  m_feedback_buffers(number_of_frame_resources.get_value()),
+  m_feedback_addresses(number_of_frame_resources.get_value()),
+  m_feedback_entries(feedback_entries),
+  m_resource_owner(resource_owner)
+  COMMA_CWDEBUG_ONLY(m_ambifix(ambifix))
+{
+  DoutEntering(dc::vulkan, "VirtualTexture::VirtualTexture(" << logical_device << ", " << resource_owner << ", " << extent << ", " << page_size << ", " << border << ", " <<
+      slots << ", " << number_of_frame_resources << ", " << feedback_entries << ", sampler_kind, graphics_settings, page_request, page_evicted) [" <<
+      this << "]");
+  // The slot coordinates are stored in eight bits each.
+  ASSERT(slots.width <= 256 && slots.height <= 256);
+  ASSERT(m_page_table.level_count() == m_indirection_image_kind->mip_levels);
+  ASSERT(feedback_entries > 0);
+
+  if (is_sparse())
+  {
+    Dout(dc::vulkan, "The physical texture is sparse, with blocks of " << m_sparse_granularity << " texels and a slot stride of " << m_slot_stride << ".");
+    m_sparse_backend = std::make_unique<memory::DeviceSparseMipMemoryBackend>(logical_device, resource_owner);
+    std::vector<vk::SparseImageMemoryRequirements> const sparse_memory_requirements =
+      logical_device->get_image_sparse_memory_requirements(m_physical_texture.m_vh_image);
+    // A sparse resident color image has exactly one element: that of the color aspect. Its only level is a
+    // multiple of the block size, so it isn't part of a mip tail.
+    ASSERT(sparse_memory_requirements.size() == 1 && sparse_memory_requirements[0].imageMipTailFirstLod >= 1);
+    // Each slot is bound to its own allocation, of one page of memory per block.
+    m_slot_memory_requirements = logical_device->get_image_memory_requirements(m_physical_texture.m_vh_image);
+    m_slot_memory_requirements.size =
+      vk::DeviceSize{m_slot_stride / m_sparse_granularity.width} * (m_slot_stride / m_sparse_granularity.height) * m_slot_memory_requirements.alignment;
+    sparse_slots_t::wat(m_sparse_slots)->resize(slots.width * slots.height);
+  }
+
+  // Use cached memory: the host reads every value. The shaders write it through its device address (see VirtualTextureShaders.h).
+  bool const use_device_address = logical_device->supports_buffer_device_address();
+  for (FrameResourceIndex i = m_feedback_buffers.ibegin(); i != m_feedback_buffers.iend(); ++i)
+  {
+    m_feedback_buffers[i] = memory::StagingBuffer(logical_device, vk::DeviceSize{feedback_entries} * sizeof(uint32_t)
+        COMMA_CWDEBUG_ONLY(".m_feedback_buffers[" + to_string(i) + "]" + ambifix),
+        { .usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst |
+              (use_device_address ? vk::BufferUsageFlags{vk::BufferUsageFlagBits::eShaderDeviceAddress} : vk::BufferUsageFlags{}),
+          .properties = vk::MemoryPropertyFlagBits::eHostVisible,
+          .vma_allocation_create_flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT });
+    if (use_device_address)
+      m_feedback_addresses[i] = logical_device->get_buffer_address(m_feedback_buffers[i].m_vh_buffer);
+  }
+}
+
+VirtualTexture::~VirtualTexture()
+{
+  DoutEntering(dc::vulkan, "VirtualTexture::~VirtualTexture() [" << this << "]");
+  free_slot_memory();
+}
+
+void VirtualTexture::upload_page(Load const& load, std::vector<std::byte> pixels)
+{
+  ASSERT(pixels.size() == size_t{slot_size()} * slot_size() * texel_size);
+  pending_pages_t::wat pending_pages_w(m_pending_pages);
+  pending_pages_w->push_back({ load, std::move(pixels) });
+}
+
+void VirtualTexture::record_update(vk::CommandBuffer command_buffer, FrameResourceIndex frame_resource_index)
+{
+  DoutEntering(dc::vkframe, "VirtualTexture::record_update(" << command_buffer << ", " << frame_resource_index << ") [" << this << "]");
+  LogicalDevice const* logical_device = m_physical_texture.m_logical_device;
+
+  // The previous command buffer of this frame resource completed, and therefore so did every frame before it.
+  // That frame wrote the feedback buffer of this frame resource, and its slots are no longer sampled.
+  frame_type const completed_frame = m_frame_resource_frames[frame_resource_index];
+  memory::StagingBuffer const& feedback_buffer = m_feedback_buffers[frame_resource_index];
+  if (completed_frame > 0)
+  {
+    // This frees the slots of the pages that were evicted by the update() of completed_frame or before.
+    m_page_table.retire(completed_frame);
+    logical_device->invalidate_mapped_allocation(feedback_buffer.m_vh_allocation, 0, VK_WHOLE_SIZE);
+    m_page_table.process_feedback(completed_frame, { static_cast<uint32_t const*>(feedback_buffer.m_pointer), m_feedback_entries });
+  }
+  frame_type const frame = ++m_frame;
+  m_frame_resource_frames[frame_resource_index] = frame;
+
+  // This maps the pages that were copied by the previous frames, evicts pages and calls m_page_request for new pages.
+  m_page_table.update(frame);
+  // The memory of the slots that were freed above, and that didn't receive a new page, is no longer needed.
+  if (is_sparse() && completed_frame > 0)
+    unbind_released_slots(completed_frame);
+
+  std::vector<memory::VirtualTexturePageTable::IndirectionUpdate> const updates = m_page_table.take_indirection_updates();
+  std::vector<PendingPage> pages;
+  {
+    pending_pages_t::wat pending_pages_w(m_pending_pages);
+    pages.swap(*pending_pages_w);
+  }
+
+  // A copy command per changed rectangle of the indirection texture and per page, all reading from the staging buffer of
+  // this frame resource: first the indirection texels, then the page texels.
+  uint32_t const slot_size = this->slot_size();
+  vk::DeviceSize size = 0;
+  std::vector<vk::BufferImageCopy> indirection_regions;
+  indirection_regions.reserve(updates.size());
+  for (memory::VirtualTexturePageTable::IndirectionUpdate const& update : updates)
+  {
+    indirection_regions.push_back({
+      .bufferOffset = size,
+      .bufferRowLength = 0,
+      .bufferImageHeight = 0,
+      .imageSubresource = vk::ImageSubresourceLayers{
+        .aspectMask = vk::ImageAspectFlagBits::eColor,
+        .mipLevel = update.m_level,
+        .baseArrayLayer = 0,
+        .layerCount = 1
+      },
+      .imageOffset = vk::Offset3D{ update.m_rect.offset.x, update.m_rect.offset.y, 0 },
+      .imageExtent = vk::Extent3D{ update.m_rect.extent.width, update.m_rect.extent.height, 1 }
+    });
+    size += vk::DeviceSize{update.m_entries.size()} * texel_size;
+  }
+  std::vector<vk::BufferImageCopy> page_regions;
+  page_regions.reserve(pages.size());
+  for (PendingPage const& page : pages)
+  {
+    uint32_t const slot_x = page.m_load.m_slot % m_slots.width;
+    uint32_t const slot_y = page.m_load.m_slot / m_slots.width;
+    page_regions.push_back({
+      .bufferOffset = size,
+      .bufferRowLength = 0,
+      .bufferImageHeight = 0,
+      .imageSubresource = vk::ImageSubresourceLayers{
+        .aspectMask = vk::ImageAspectFlagBits::eColor,
+        .mipLevel = 0,
+        .baseArrayLayer = 0,
+        .layerCount = 1
+      },
+      .imageOffset = vk::Offset3D{ static_cast<int32_t>(slot_x * m_slot_stride), static_cast<int32_t>(slot_y * m_slot_stride), 0 },
+      .imageExtent = vk::Extent3D{ slot_size, slot_size, 1 }
+    });
+    size += page.m_pixels.size();
+  }
+
+  if (size > 0)
+  {
+    Dout(dc::vkframe, "Uploading " << updates.size() << " indirection regions and " << pages.size() << " pages (" << size << " bytes).");
+
+    // The previous command buffer of this frame resource completed, so its staging buffer may be overwritten (or replaced).
+    memory::StagingBuffer& staging_buffer = m_staging_buffers[frame_resource_index];
+    if (!staging_buffer.m_vh_buffer || staging_buffer.m_size < size)
+      staging_buffer = memory::StagingBuffer(logical_device, std::bit_ceil(size)
+          COMMA_CWDEBUG_ONLY(".m_staging_buffers[" + to_string(frame_resource_index) + "]" + m_ambifix));
+    std::byte* dst = static_cast<std::byte*>(staging_buffer.m_pointer);
+    for (memory::VirtualTexturePageTable::IndirectionUpdate const& update : updates)
+      for (memory::VirtualTexturePageTable::Entry const& entry : update.m_entries)
+      {
+        bool const resident = entry.m_slot != memory::VirtualTexturePageTable::no_slot;
+        *dst++ = static_cast<std::byte>(resident ? entry.m_slot % m_slots.width : 0);
+        *dst++ = static_cast<std::byte>(resident ? entry.m_slot / m_slots.width : 0);
+        *dst++ = static_cast<std::byte>(resident ? entry.m_level : 0);
+        *dst++ = static_cast<std::byte>(resident ? 1 : 0);
+      }
+    for (PendingPage const& page : pages)
+    {
+      std::memcpy(dst, page.m_pixels.data(), page.m_pixels.size());
+      dst += page.m_pixels.size();
+    }
+    logical_device->flush_mapped_allocation(staging_buffer.m_vh_allocation, 0, size);
+
+    // The first upload of each image gives it a defined layout; the parts that are not uploaded are not sampled yet.
+    // Afterwards, wait until the fragment shaders of all previously submitted frames stopped sampling the image.
+    // The slots that are overwritten aren't sampled by those frames anyway (they left quarantine), but the
+    // layout transition affects the whole image.
+    std::vector<vk::ImageMemoryBarrier> pre_transfer_image_memory_barriers;
+    std::vector<vk::ImageMemoryBarrier> post_transfer_image_memory_barriers;
+    auto add_barriers = [&](Texture const& texture, uint32_t level_count, bool& layout_defined){
+      vk::ImageSubresourceRange const all_levels = vk_defaults::ImageSubresourceRange{vk::ImageAspectFlagBits::eColor, 0, level_count, 0, 1};
+      pre_transfer_image_memory_barriers.push_back({
+        .srcAccessMask = layout_defined ? vk::AccessFlags{vk::AccessFlagBits::eShaderRead} : vk::AccessFlags(0),
+        .dstAccessMask = vk::AccessFlagBits::eTransferWrite,
+        .oldLayout = layout_defined ? vk::ImageLayout::eShaderReadOnlyOptimal : vk::ImageLayout::eUndefined,
+        .newLayout = vk::ImageLayout::eTransferDstOptimal,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = texture.m_vh_image,
+        .subresourceRange = all_levels
+      });
+      post_transfer_image_memory_barriers.push_back({
+        .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+        .dstAccessMask = vk::AccessFlagBits::eShaderRead,
+        .oldLayout = vk::ImageLayout::eTransferDstOptimal,
+        .newLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = texture.m_vh_image,
+        .subresourceRange = all_levels
+      });
+      layout_defined = true;
+    };
+    if (!indirection_regions.empty())
+      add_barriers(m_indirection_texture, m_indirection_image_kind->mip_levels, m_indirection_layout_defined);
+    if (!page_regions.empty())
+      add_barriers(m_physical_texture, 1, m_physical_layout_defined);
+    command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eFragmentShader, vk::PipelineStageFlagBits::eTransfer,
+        {}, {}, {}, pre_transfer_image_memory_barriers);
+
+    // The indirection entries that stop referring to evicted slots are written before any slot is overwritten.
+    if (!indirection_regions.empty())
+      command_buffer.copyBufferToImage(staging_buffer.m_vh_buffer, m_indirection_texture.m_vh_image, vk::ImageLayout::eTransferDstOptimal,
+          indirection_regions);
+    if (!page_regions.empty())
+      command_buffer.copyBufferToImage(staging_buffer.m_vh_buffer, m_physical_texture.m_vh_image, vk::ImageLayout::eTransferDstOptimal,
+          page_regions);
+
+    command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader,
+        {}, {}, {}, post_transfer_image_memory_barriers);
+
+    // The pages are mapped by the next update(), in the indirection upload of a later frame on the same queue.
+    for (PendingPage const& page : pages)
+      m_page_table.loaded(page.m_load.m_page);
+  }
+
+  // Clear the feedback of this frame. The frame that wrote it before completed, and the host read it above.
+  command_buffer.fillBuffer(feedback_buffer.m_vh_buffer, 0, VK_WHOLE_SIZE, memory::VirtualTexturePageTable::no_feedback);
+  vk::BufferMemoryBarrier const feedback_barrier{
+    .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+    .dstAccessMask = vk::AccessFlagBits::eShaderWrite,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .buffer = feedback_buffer.m_vh_buffer,
+    .offset = 0,
+    .size = VK_WHOLE_SIZE
+  };
+  command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader,
+      {}, {}, feedback_barrier, {});
+}
+
+void VirtualTexture::record_feedback_barrier(vk::CommandBuffer command_buffer, FrameResourceIndex frame_resource_index) const
+{
+  // Read by the record_update() that reuses this frame resource, after the frame semaphore reached the value of this frame.
+  vk::BufferMemoryBarrier const to_host_barrier{
+    .srcAccessMask = vk::AccessFlagBits::eShaderWrite,
+    .dstAccessMask = vk::AccessFlagBits::eHostRead,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .buffer = m_feedback_buffers[frame_resource_index].m_vh_buffer,
+    .offset = 0,
+    .size = VK_WHOLE_SIZE
+  };
+  command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eFragmentShader, vk::PipelineStageFlagBits::eHost, {}, {}, to_host_barrier, {});
+}
+
+void VirtualTexture::release_GPU_resources()
+{
+  for (memory::StagingBuffer& staging_buffer : m_staging_buffers)
+    staging_buffer = memory::StagingBuffer{};
+  for (memory::StagingBuffer& feedback_buffer : m_feedback_buffers)
+    feedback_buffer = memory::StagingBuffer{};
+  m_physical_texture.release_GPU_resources();
+  m_indirection_texture.release_GPU_resources();
+  free_slot_memory();
+}
+
+VirtualTextureFeedback VirtualTexture::push_constant(FrameResourceIndex frame_resource_index, vk::Extent2D framebuffer_extent) const
+{
+  vk::Extent2D const page_extent = m_page_table.level_extent(0);
+  return {
+    .m_feedback_buffer = meshlet::to_uvec2(m_feedback_addresses[frame_resource_index]),
+    .m_page_extent = { page_extent.width, page_extent.height },
+    .m_physical_extent = { m_slots.width * m_slot_stride, m_slots.height * m_slot_stride },
+    .m_slot_stride = { m_slot_stride, m_slot_stride },
+    .m_page_size = m_page_size,
+    .m_border = m_border,
+    .m_level_count = m_page_table.level_count(),
+    .m_entry_count = m_feedback_entries,
+    .m_tile_columns = (framebuffer_extent.width + virtual_texture_feedback_tile_size - 1) / virtual_texture_feedback_tile_size,
+    .m_frame = static_cast<uint32_t>(m_frame)
+  };
+}
+
+vk::DeviceSize VirtualTexture::sparse_bytes() const
+{
+  sparse_slots_t::crat sparse_slots_r(m_sparse_slots);
+  auto const bound_slots = std::count_if(sparse_slots_r->begin(), sparse_slots_r->end(),
+      [](SparseSlot const& slot){ return slot.m_vh_allocation != VK_NULL_HANDLE; });
+  return static_cast<vk::DeviceSize>(bound_slots) * m_slot_memory_requirements.size;
+}
+
+memory::SparseMipMemory::Binding VirtualTexture::slot_binding(memory::VirtualTexturePageTable::slot_type slot, VmaAllocation vh_allocation) const
+{
+  vk::Offset2D const offset{ static_cast<int32_t>(slot % m_slots.width * m_slot_stride), static_cast<int32_t>(slot / m_slots.width * m_slot_stride) };
+  return { m_physical_texture.m_vh_image, false, 0, { m_slot_stride, m_slot_stride }, 0, m_slot_memory_requirements.size, vh_allocation, offset };
+}
+
+void VirtualTexture::bind_slot(Load const& load)
+{
+  DoutEntering(dc::vkframe, "VirtualTexture::bind_slot({" << load.m_page << ", " << load.m_slot << "}) [" << this << "]");
+  bool still_bound;
+  {
+    sparse_slots_t::wat sparse_slots_w(m_sparse_slots);
+    SparseSlot& slot = (*sparse_slots_w)[load.m_slot];
+    if (slot.m_unbinding)
+    {
+      // The sparse bindings must be made in order: bind new memory once the old memory was unbound.
+      slot.m_deferred_load = load;
+      return;
+    }
+    // The slot still has memory if its previous page was evicted recently, or if its last load failed.
+    still_bound = slot.m_vh_allocation != VK_NULL_HANDLE;
+    slot.m_releasing = false;
+  }
+  if (still_bound)
+  {
+    m_page_request(load);
+    return;
+  }
+
+  VmaAllocation vh_allocation;
+  try
+  {
+    vh_allocation = m_sparse_backend->allocate_memory(m_slot_memory_requirements);
+  }
+  catch (AIAlert::Error const& error)
+  {
+    Dout(dc::warning, error << "; can't load virtual texture page " << load.m_page << ".");
+    page_failed(load);
+    return;
+  }
+  sparse_slots_t::wat(m_sparse_slots)->at(load.m_slot).m_vh_allocation = vh_allocation;
+
+  auto sparse_bind = statefultask::create<task::SparseBind>(m_physical_texture.m_logical_device,
+      std::vector<memory::SparseMipMemory::Binding>{ slot_binding(load.m_slot, vh_allocation) } COMMA_CWDEBUG_ONLY(false));
+  sparse_bind->set_resource_owner(m_resource_owner);
+  sparse_bind->run(Application::instance().low_priority_queue(), [this, load](bool success){
+    if (success)
+    {
+      m_page_request(load);
+      return;
+    }
+    Dout(dc::warning, "Binding memory to slot " << load.m_slot << " of the virtual texture failed.");
+    VmaAllocation vh_allocation;
+    {
+      sparse_slots_t::wat sparse_slots_w(m_sparse_slots);
+      vh_allocation = (*sparse_slots_w)[load.m_slot].m_vh_allocation;
+      (*sparse_slots_w)[load.m_slot].m_vh_allocation = VK_NULL_HANDLE;
+    }
+    // Like the memory freed by DeviceSparseMipMemoryBackend::unbind: it isn't accessed.
+    m_sparse_backend->free_memory(vh_allocation);
+    page_failed(load);
+  });
+}
+
+void VirtualTexture::unbind_released_slots(frame_type completed_frame)
+{
+  std::vector<memory::SparseMipMemory::Binding> bindings;
+  std::vector<VmaAllocation> allocations;
+  std::vector<memory::VirtualTexturePageTable::slot_type> slots;
+  {
+    sparse_slots_t::wat sparse_slots_w(m_sparse_slots);
+    for (memory::VirtualTexturePageTable::slot_type slot = 0; slot < sparse_slots_w->size(); ++slot)
+    {
+      SparseSlot& sparse_slot = (*sparse_slots_w)[slot];
+      if (!sparse_slot.m_releasing || sparse_slot.m_released_frame > completed_frame)
+        continue;
+      bindings.push_back(slot_binding(slot, VK_NULL_HANDLE));
+      allocations.push_back(sparse_slot.m_vh_allocation);
+      slots.push_back(slot);
+      sparse_slot.m_vh_allocation = VK_NULL_HANDLE;
+      sparse_slot.m_releasing = false;
+      sparse_slot.m_unbinding = true;
+    }
+  }
+  if (bindings.empty())
+    return;
+
+  Dout(dc::vkframe, "Unbinding the memory of " << bindings.size() << " virtual texture slots.");
+  m_sparse_backend->unbind(std::move(bindings), [this, allocations = std::move(allocations), slots = std::move(slots)](){
+    for (VmaAllocation vh_allocation : allocations)
+      m_sparse_backend->free_memory(vh_allocation);
+    std::vector<Load> deferred_loads;
+    {
+      sparse_slots_t::wat sparse_slots_w(m_sparse_slots);
+      for (memory::VirtualTexturePageTable::slot_type slot : slots)
+      {
+        SparseSlot& sparse_slot = (*sparse_slots_w)[slot];
+        sparse_slot.m_unbinding = false;
+        if (sparse_slot.m_deferred_load)
+          deferred_loads.push_back(*sparse_slot.m_deferred_load);
+        sparse_slot.m_deferred_load.reset();
+      }
+    }
+    for (Load const& load : deferred_loads)
+      bind_slot(load);
+  });
+}
+
+void VirtualTexture::free_slot_memory()
+{
+  sparse_slots_t::wat sparse_slots_w(m_sparse_slots);
+  for (SparseSlot& slot : *sparse_slots_w)
+  {
+    if (slot.m_vh_allocation)
+      m_sparse_backend->free_memory(slot.m_vh_allocation);
+    slot = {};
+  }
+}
+
+} // namespace vulkan
@@ -0,0 +1,205 @@
+#pragma once
+
+#include "Texture.h"
+#include "FrameResourceIndex.h"
+#include "VirtualTextureShaders.h"
+#include "memory/StagingBuffer.h"
+#include "memory/SparseMipMemory.h"
+#include "memory/VirtualTexturePageTable.h"
+#include "threadsafe/aithreadsafe.h"
+#include "utils/Vector.h"
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace task {
+class SynchronousWindow;
+} // namespace task
+
+namespace vulkan {
+
+// VirtualTexture
+//
+// A texture that is much larger than what fits in device memory, of which only the pages that are
+// actually sampled are resident (see memory::VirtualTexturePageTable for which pages that are).
+//
+// The resident pages are stored in the slots of the physical texture, a grid of slots of
+// page_size + 2 * border texels (R8G8B8A8), slot_stride() texels apart; the border repeats the texels of
+// the neighbouring pages, so that the page can be sampled with linear or anisotropic filtering. The
+// indirection texture (R8G8B8A8, one mip level per page table level and one texel per page) contains the
+// page table: the slot (r, g) and level (b) of the finest resident ancestor of each page, and a = 1 if
+// any is resident (as unsigned normalized values: multiply by 255). A fragment shader that samples
+// virtual uv at level L (with page_extent the extent in pages of level 0) does:
+//
+//   uvec4 entry = uvec4(texelFetch(indirection, ivec2(uv * page_extent) >> L, L) * 255.0 + 0.5);
+//   vec2 in_page = fract(uv * page_extent / float(1 << entry.b));
+//   vec2 texel = vec2(entry.rg * slot_stride) + border + in_page * page_size;
+//   color = textureGrad(physical, texel / physical_extent, ...);
+//
+// and writes VirtualTexturePageTable::encode({L, page}) for some of its fragments (for example one
+// per 8x8 pixel tile) to feedback_buffer() of the current frame resource, a storage buffer of
+// feedback_entries uint32_t values. virtual_texture_frag_glsl (see VirtualTextureShaders.h) is such
+// a fragment shader; this class owns the feedback buffers, clears them and reads them back.
+//
+// Pages are requested with the page_request callback, which must eventually call upload_page() or
+// page_failed() for it (from any thread). Every frame, record_update() is called with the command
+// buffer of that frame, outside a render pass and before the first draw that samples the virtual
+// texture, and record_feedback_barrier() after the last draw that writes feedback. record_update()
+// - reads back the feedback of the previous frame that used the same frame resources, which completed;
+// - records the copy of the parts of the indirection texture that changed, followed by the copy of
+//   the pages that arrived into their slots, from a single staging buffer;
+// - clears the feedback buffer of this frame.
+//
+// Everything runs on the queue of the frames that sample the texture. The slot of an evicted page is
+// quarantined by the page table until the frame that uploaded the indirection entries that no longer
+// refer to it completed, so a slot is only overwritten once no frame in flight can sample it for the
+// old page. A page is mapped (in the indirection texture) by the record_update() after the one that
+// copied its texels; the barrier behind that copy makes them visible to all later frames.
+//
+// On devices with sparse residency (LogicalDevice::supports_sparse_residency) the physical texture
+// is a sparse image, of which only the slots that contain a page have memory. The slots are then
+// slot_size() rounded up to the sparse block size apart (choose page_size + 2 * border a multiple of
+// that, typically 128, to waste nothing). The memory of a slot is allocated and bound (task::SparseBind)
+// before page_request is called for a page that is loaded into it; the page_request callback is then
+// called from the task that made the binding. The memory of the slot of an evicted page is unbound and
+// freed once the frame that evicted it completed, unless another page was loaded into it before that.
+// The indirection texture is used either way.
+//
+// Except for process_feedback(), upload_page() and page_failed(), the member functions must be called
+// from the render loop of the window that draws with the texture.
+//
+class VirtualTexture
+{
+ public:
+  using PageId = memory::VirtualTexturePageTable::PageId;
+  using Load = memory::VirtualTexturePageTable::Load;
+  using frame_type = memory::VirtualTexturePageTable::frame_type;
+  // Called (from record_update(), or once the memory of its slot is bound) for each page that must be loaded.
+  using page_request_callback_type = std::function<void(Load const& load)>;
+  // Called (from record_update()) for each page that was evicted, so that the source of the pages can drop what it cached for it.
+  using page_evicted_callback_type = std::function<void(PageId page)>;
+
+ private:
+  struct PendingPage
+  {
+    Load m_load;
+    std::vector<std::byte> m_pixels;
+  };
+
+  // The memory of a slot of the sparse physical texture.
+  struct SparseSlot
+  {
+    VmaAllocation m_vh_allocation{};            // The memory that is bound to the slot, or VK_NULL_HANDLE.
+    bool m_releasing = false;                   // Set if the page in the slot was evicted, but the memory is still bound.
+    frame_type m_released_frame = 0;            // The frame during which that page was evicted (if m_releasing is set).
+    bool m_unbinding = false;                   // Set while the memory of the slot is being unbound.
+    std::optional<Load> m_deferred_load;        // A load into this slot that waits for that unbind to finish.
+  };
+
+  uint32_t const m_page_size;
+  uint32_t const m_border;
+  vk::Extent2D const m_slots;                   // The number of slots in each direction of the physical texture.
+  ImageKind const m_physical_image_kind;
+  ImageViewKind const m_physical_image_view_kind;
+  vk::Extent2D const m_sparse_granularity;      // The extent of the sparse blocks of the physical texture, or {0, 0} if it isn't sparse.
+  uint32_t const m_slot_stride;                 // The distance between the slots of the physical texture, in texels.
+  Texture m_physical_texture;
+  ImageKind const m_indirection_image_kind;
+  ImageViewKind const m_indirection_image_view_kind;
+  vk::Extent2D const m_indirection_extent;
+  Texture m_indirection_texture;
+  page_request_callback_type m_page_request;
+  page_evicted_callback_type m_page_evicted;
+  memory::VirtualTexturePageTable m_page_table;
+
+  using pending_pages_t = aithreadsafe::Wrapper<std::vector<PendingPage>, aithreadsafe::policy::Primitive<std::mutex>>;
+  pending_pages_t m_pending_pages;              // Pages passed to upload_page() that weren't uploaded yet.
+  bool m_physical_layout_defined = false;
+  bool m_indirection_layout_defined = false;
+  frame_type m_frame = 0;                       // The number of calls to record_update().
+  utils::Vector<frame_type, FrameResourceIndex> m_frame_resource_frames;                // The frame last recorded with each frame resource, or zero.
+  utils::Vector<memory::StagingBuffer, FrameResourceIndex> m_staging_buffers;           // One per frame resource; grown when needed.
+  utils::Vector<memory::StagingBuffer, FrameResourceIndex> m_feedback_buffers;          // One per frame resource; host-visible storage buffers.
+  utils::Vector<vk::DeviceAddress, FrameResourceIndex> m_feedback_addresses;            // Their device addresses, if supported.
+  uint32_t const m_feedback_entries;
+
+  // Only used if the physical texture is sparse.
+  task::SynchronousWindow const* m_resource_owner;                                      // The window that waits for the sparse bindings.
+  std::unique_ptr<memory::SparseMipMemory::Backend> m_sparse_backend;                   // Allocates, frees and unbinds the memory of the slots.
+  vk::MemoryRequirements m_slot_memory_requirements;                                    // The requirements of the memory of one slot.
+  using sparse_slots_t = aithreadsafe::Wrapper<std::vector<SparseSlot>, aithreadsafe::policy::Primitive<std::mutex>>;
+  sparse_slots_t m_sparse_slots;                                                        // One per slot.
+#ifdef CWDEBUG
+  Ambifix m_ambifix;                            // Used for the debug names of the staging buffers.
+#endif
+
+ public:
+  // A virtual texture of extent pages of page_size texels at level 0, with slots.width * slots.height page slots,
+  // drawn by resource_owner with number_of_frame_resources frame resources that writes feedback_entries feedback values per frame.
+  VirtualTexture(
+      LogicalDevice const* logical_device,
+      task::SynchronousWindow const* resource_owner,
+      vk::Extent2D extent,
+      uint32_t page_size,
+      uint32_t border,
+      vk::Extent2D slots,
+      FrameResourceIndex number_of_frame_resources,
+      uint32_t feedback_entries,
+      SamplerKind const& sampler_kind,
+      GraphicsSettingsPOD const& graphics_settings,
+      page_request_callback_type page_request,
+      page_evicted_callback_type page_evicted
+      COMMA_CWDEBUG_ONLY(Ambifix const& ambifix));
+  ~VirtualTexture();
+
+  // Thread-safe. Feedback of frame that was read back by other means than feedback_buffer() (see above).
+  void process_feedback(frame_type frame, std::span<uint32_t const> feedback)
+  {
+    m_page_table.process_feedback(frame, feedback);
+  }
+
+  // Thread-safe. The texels of load.m_page: (page_size + 2 * border)^2 texels in R8G8B8A8, including the border.
+  void upload_page(Load const& load, std::vector<std::byte> pixels);
+  // Thread-safe. The texels of load.m_page could not be loaded.
+  void page_failed(Load const& load) { m_page_table.loaded(load.m_page, false); }
+
+  // Read back the feedback of the previous frame of frame resource frame_resource_index, request pages and record
+  // the upload of whatever changed into command_buffer: the command buffer of that frame resource (see above).
+  void record_update(vk::CommandBuffer command_buffer, FrameResourceIndex frame_resource_index);
+  // Record the barrier that makes the feedback written by the fragment shaders of this frame available to the host.
+  void record_feedback_barrier(vk::CommandBuffer command_buffer, FrameResourceIndex frame_resource_index) const;
+
+  void release_GPU_resources();
+
+  // Return the push constant of virtual_texture_frag_glsl for the frame that record_update() was last called for, with
+  // frame_resource_index, drawn into a framebuffer of framebuffer_extent. Requires LogicalDevice::supports_buffer_device_address.
+  VirtualTextureFeedback push_constant(FrameResourceIndex frame_resource_index, vk::Extent2D framebuffer_extent) const;
+
+  // Accessors.
+  Texture const& physical_texture() const { return m_physical_texture; }
+  Texture const& indirection_texture() const { return m_indirection_texture; }
+  vk::Buffer feedback_buffer(FrameResourceIndex frame_resource_index) const { return m_feedback_buffers[frame_resource_index].m_vh_buffer; }
+  uint32_t feedback_entries() const { return m_feedback_entries; }
+  memory::VirtualTexturePageTable const& page_table() const { return m_page_table; }
+  uint32_t slot_size() const { return m_page_size + 2 * m_border; }
+  uint32_t slot_stride() const { return m_slot_stride; }
+  bool is_sparse() const { return m_sparse_granularity.width > 0; }
+  // The size of the memory that is bound to the slots of the physical texture (if it is sparse).
+  vk::DeviceSize sparse_bytes() const;
+
+ private:
+  // Return the binding of the region of slot in the physical texture to vh_allocation.
+  memory::SparseMipMemory::Binding slot_binding(memory::VirtualTexturePageTable::slot_type slot, VmaAllocation vh_allocation) const;
+  // Load callback of the page table if the physical texture is sparse: bind memory to the slot of load, then request the page.
+  void bind_slot(Load const& load);
+  // Unbind the memory of the slots of pages that were evicted during completed_frame or before, and weren't reused.
+  void unbind_released_slots(frame_type completed_frame);
+  // Free the memory of all slots. The GPU must be done with the physical texture.
+  void free_slot_memory();
+};
+
+} // namespace vulkan
@@ -0,0 +1,65 @@
+#include "sys.h"
+#include "VirtualTextureShaders.h"
+
+namespace vulkan {
+
+static_assert(virtual_texture_feedback_tile_size == 8, "Update the constants in the shader below.");
+
+// This is a template: the push constant block VirtualTextureFeedback and the samplers are declared by ShaderInputData::preprocess2.
+// The indirection texture is R8G8B8A8Unorm (the shader builder only declares float samplers), hence the * 255.
+std::string_view const virtual_texture_frag_glsl = R"glsl(
+#extension GL_EXT_buffer_reference : require
+#extension GL_EXT_buffer_reference_uvec2 : require
+
+layout(location = 0) in vec2 v_virtual_uv;
+layout(location = 0) out vec4 outColor;
+
+layout(buffer_reference, std430, buffer_reference_align = 4) writeonly buffer Feedback { uint values[]; };
+
+// See VirtualTexturePageTable::encode.
+uint encode(uint level, uvec2 page)
+{
+  return level << 28 | page.y << 14 | page.x;
+}
+
+void main()
+{
+  vec2 page_extent = vec2(VirtualTextureFeedback::m_page_extent);
+  float page_size = float(VirtualTextureFeedback::m_page_size);
+
+  // The level of detail, using the texels of level 0 of the virtual texture.
+  vec2 texel = v_virtual_uv * page_extent * page_size;
+  vec2 dx = dFdx(texel);
+  vec2 dy = dFdy(texel);
+  float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1.0));
+  uint level = min(uint(lod), VirtualTextureFeedback::m_level_count - 1u);
+  uvec2 page = min(uvec2(v_virtual_uv * page_extent), VirtualTextureFeedback::m_page_extent - 1u) >> level;
+
+  // The finest resident ancestor of page: slot (r, g), level b; a is 1 if there is one.
+  uvec4 entry = uvec4(texelFetch(CombinedImageSampler::indirection_texture, ivec2(page), int(level)) * 255.0 + 0.5);
+  if (entry.a == 0u)
+    outColor = vec4(0.0, 0.0, 0.0, 1.0);
+  else
+  {
+    float scale = float(1u << entry.b);
+    vec2 in_page = fract(v_virtual_uv * page_extent / scale);
+    vec2 physical_extent = vec2(VirtualTextureFeedback::m_physical_extent);
+    vec2 physical = vec2(entry.rg * VirtualTextureFeedback::m_slot_stride) + float(VirtualTextureFeedback::m_border) + in_page * page_size;
+    outColor = textureGrad(CombinedImageSampler::physical_texture, physical / physical_extent,
+        dx / (scale * physical_extent), dy / (scale * physical_extent));
+  }
+
+  // One fragment per 8x8 tile writes feedback; which one cycles over the frames.
+  uvec2 pixel = uvec2(gl_FragCoord.xy);
+  uint frame = VirtualTextureFeedback::m_frame;
+  if ((pixel & 7u) == uvec2(frame & 7u, (frame >> 3) & 7u))
+  {
+    uvec2 tile = pixel >> 3;
+    uint index = tile.y * VirtualTextureFeedback::m_tile_columns + tile.x;
+    if (index < VirtualTextureFeedback::m_entry_count)
+      Feedback(VirtualTextureFeedback::m_feedback_buffer).values[index] = encode(level, page);
+  }
+}
+)glsl";
+
+} // namespace vulkan
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "shader_builder/ShaderVariableLayouts.h"
+#include <string_view>
+
+namespace vulkan {
+
+// The fragment shader that samples a VirtualTexture and writes its feedback.
+//
+// It is a shader template (without #version line). The texture coordinates (uv in [0, 1] over the
+// whole virtual texture) are its input at location 0; the sampled color is its output at location 0.
+// The characteristic of the pipeline must add two combined image samplers, with the glsl id postfixes
+// "physical_texture" and "indirection_texture" (bound to VirtualTexture::physical_texture() and
+// VirtualTexture::indirection_texture()), and the push constant VirtualTextureFeedback (see
+// VirtualTexture::push_constant). The feedback is written through the device address of the feedback
+// buffer, which requires LogicalDevice::supports_buffer_device_address, and compiling for Vulkan 1.2 or
+// later (ShaderCompilerOptions::set_target_env(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_2)).
+//
+// The level of detail is that of the texels of level 0 of the virtual texture (as if it were one huge
+// mip mapped texture). The texels are looked up in the finest resident ancestor of the page of that
+// level (see the description of VirtualTexture). One fragment per 8x8 pixel tile, a different one each
+// frame, writes memory::VirtualTexturePageTable::encode of the wanted page to entry tile.y * m_tile_columns
+// + tile.x of the feedback buffer; the framebuffer must therefore not have more than feedback_entries()
+// tiles.
+//
+// Note that shader variables are found by a plain text search: the name of a member may not be the
+// beginning of the name of another member.
+//
+static constexpr uint32_t virtual_texture_feedback_tile_size = 8;
+
+// The push constant of the virtual texture fragment shader, used as VirtualTextureFeedback::m_page_extent etc. in the shader template.
+struct VirtualTextureFeedback
+{
+  glsl::uvec2 m_feedback_buffer;                        // The device address (see meshlet::to_uvec2) of the feedback buffer of this frame.
+  glsl::uvec2 m_page_extent;                            // The extent of level 0 of the virtual texture, in pages.
+  glsl::uvec2 m_physical_extent;                        // The extent of the physical texture, in texels.
+  glsl::uvec2 m_slot_stride;                            // The distance between the slots of the physical texture, in texels.
+  glsl::Uint m_page_size;
+  glsl::Uint m_border;
+  glsl::Uint m_level_count;                             // The number of levels of the page table.
+  glsl::Uint m_entry_count;                             // The number of uint values in the feedback buffer.
+  glsl::Uint m_tile_columns;                            // The number of tiles in a row of the framebuffer.
+  glsl::Uint m_frame;                                   // Selects the fragment of each tile that writes feedback.
+};
+
+extern std::string_view const virtual_texture_frag_glsl;
+
+} // namespace vulkan
+
+LAYOUT_DECLARATION(vulkan::VirtualTextureFeedback, push_constant_std430)
+{
+  static constexpr auto struct_layout = make_struct_layout(
+    LAYOUT(uvec2, m_feedback_buffer),
+    LAYOUT(uvec2, m_page_extent),
+    LAYOUT(uvec2, m_physical_extent),
+    LAYOUT(uvec2, m_slot_stride),
+    LAYOUT(Uint, m_page_size),
+    LAYOUT(Uint, m_border),
+    LAYOUT(Uint, m_level_count),
+    LAYOUT(Uint, m_entry_count),
+    LAYOUT(Uint, m_tile_columns),
+    LAYOUT(Uint, m_frame)
+  );
+};
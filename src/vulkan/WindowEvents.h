@@ -31,6 +31,8 @@ class AsyncAccessSpecialCircumstances
   void set_must_close() const            { m_special_circumstances->set_must_close(); }
   void set_mapped() const                { m_special_circumstances->set_mapped(); }
   void set_unmapped() const              { m_special_circumstances->set_unmapped(); }
+  void set_occluded(bool occluded) const { m_special_circumstances->set_occluded(occluded); }
+  void set_invalidated() const           { m_special_circumstances->set_invalidated(); }
 
  public:
   // Called one time, immediately after (default) construction.
@@ -84,13 +86,18 @@ class WindowEvents : public linuxviewer::OS::Window, public AsyncAccessSpecialCi
     if (minimized)
       set_unmapped();
     else
+    {
+      // X11 reports the visibility of a window again after it is mapped; until then assume that it is visible.
+      on_visibility_changed(false);
       set_mapped();
+    }
   }
 
   void on_mouse_move(int16_t x, int16_t y, uint16_t CWDEBUG_ONLY(converted_modifiers)) override final
   {
     DoutEntering(dc::xcbmotion, "vulkan::WindowEvents::on_mouse_move(" << x << ", " << y << ", " << vulkan::ModifierMask{converted_modifiers} << ")");
     MovedMousePosition::wat(m_mouse_position)->set(x, y);
+    set_invalidated();
   }
 
   void on_key_event(int16_t x, int16_t y, uint16_t converted_modifiers, bool pressed, uint32_t keysym) override final
@@ -109,6 +116,8 @@ class WindowEvents : public linuxviewer::OS::Window, public AsyncAccessSpecialCi
       };
       if (!m_input_event_buffer->push(&event))
         Dout(dc::warning, "Dumping input event because queue is full!");
+      // Wake up the render loop if it is idle.
+      set_invalidated();
     }
   }
 
@@ -141,6 +150,7 @@ class WindowEvents : public linuxviewer::OS::Window, public AsyncAccessSpecialCi
           wheel_offset_w->accumulate_x(1.f);
           break;
       }
+      set_invalidated();
       return;
     }
 
@@ -159,6 +169,8 @@ class WindowEvents : public linuxviewer::OS::Window, public AsyncAccessSpecialCi
       };
       if (!m_input_event_buffer->push(&event))
         Dout(dc::warning, "Dumping input event because queue is full!");
+      // Wake up the render loop if it is idle.
+      set_invalidated();
     }
   }
 
@@ -179,6 +191,8 @@ class WindowEvents : public linuxviewer::OS::Window, public AsyncAccessSpecialCi
       };
       if (!m_input_event_buffer->push(&event))
         Dout(dc::warning, "Dumping input event because queue is full!");
+      // Wake up the render loop if it is idle.
+      set_invalidated();
     }
   }
 
@@ -186,6 +200,10 @@ class WindowEvents : public linuxviewer::OS::Window, public AsyncAccessSpecialCi
   {
     DoutEntering(dc::notice, "vulkan::WindowEvents::on_focus_changed(" << std::boolalpha << in_focus << ")");
 
+    // A window that receives the focus is normally raised by the window manager: don't let it stay parked as occluded.
+    if (in_focus)
+      on_visibility_changed(false);
+
     // Queue event.
     if (m_input_event_buffer)
     {
@@ -195,6 +213,8 @@ class WindowEvents : public linuxviewer::OS::Window, public AsyncAccessSpecialCi
       };
       if (!m_input_event_buffer->push(&event))
         Dout(dc::warning, "Dumping input event because queue is full!");
+      // Wake up the render loop if it is idle.
+      set_invalidated();
     }
   }
 
@@ -224,6 +244,19 @@ class WindowEvents : public linuxviewer::OS::Window, public AsyncAccessSpecialCi
     // Unlock m_extent.
   }
 
+  // Called when the window became fully obscured by other windows (occluded is true), or (partially) visible again.
+  // The render loop of an occluded window is idle.
+  //
+  // The XCB event loop (in the xcb-task submodule) doesn't dispatch VisibilityNotify events to WindowBase, so
+  // only a platform layer that does can report occlusion. Here the window is made visible again when it is
+  // mapped (MapNotify, see on_map_changed) or receives the focus (see on_focus_changed), so that a missed
+  // VisibilityNotify can't leave it parked.
+  void on_visibility_changed(bool occluded) const
+  {
+    DoutEntering(dc::notice, "WindowEvents::on_visibility_changed(" << std::boolalpha << occluded << ")");
+    set_occluded(occluded);
+  }
+
   // Called from SynchronousWindow::change_number_of_swapchain_images to trigger recreation of the swapchain.
   void recreate_swapchain(utils::Badge<task::SynchronousWindow>) const
   {
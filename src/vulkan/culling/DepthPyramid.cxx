@@ -0,0 +1,60 @@
+#include "sys.h"
+#include "DepthPyramid.h"
+#include <algorithm>
+#include <bit>
+
+namespace vulkan::culling {
+
+//static
+uint32_t DepthPyramid::level_count(uint32_t width, uint32_t height)
+{
+  ASSERT(width > 0 && height > 0);
+  // Halving (rounding up) m until it is 1 takes bit_width(m - 1) steps.
+  return std::bit_width(std::max(width, height) - 1) + 1;
+}
+
+void DepthPyramid::build(uint32_t width, uint32_t height, std::span<float const> depth)
+{
+  ASSERT(depth.size() == static_cast<size_t>(width) * height);
+  uint32_t const count = level_count(width, height);
+  m_levels.resize(count);
+  m_levels[0] = { width, height, { depth.begin(), depth.end() } };
+  for (uint32_t n = 1; n < count; ++n)
+  {
+    Level const& source = m_levels[n - 1];
+    Level& destination = m_levels[n];
+    destination.m_width = (source.m_width + 1) / 2;
+    destination.m_height = (source.m_height + 1) / 2;
+    destination.m_depth.resize(static_cast<size_t>(destination.m_width) * destination.m_height);
+    // The same as the depth pyramid compute shader: take the maximum of the 2x2 source texels, clamped to the source.
+    for (uint32_t y = 0; y < destination.m_height; ++y)
+    {
+      uint32_t const sy0 = 2 * y;
+      uint32_t const sy1 = std::min(sy0 + 1, source.m_height - 1);
+      for (uint32_t x = 0; x < destination.m_width; ++x)
+      {
+        uint32_t const sx0 = 2 * x;
+        uint32_t const sx1 = std::min(sx0 + 1, source.m_width - 1);
+        destination.m_depth[y * destination.m_width + x] =
+          std::max({ source.at(sx0, sy0), source.at(sx1, sy0), source.at(sx0, sy1), source.at(sx1, sy1) });
+      }
+    }
+  }
+}
+
+float DepthPyramid::max_depth(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1) const
+{
+  ASSERT(!m_levels.empty() && x0 <= x1 && y0 <= y1 && x1 < width() && y1 < height());
+  // Find the smallest level at which the rectangle covers at most two texels in each direction.
+  uint32_t n = 0;
+  while ((x1 >> n) - (x0 >> n) > 1 || (y1 >> n) - (y0 >> n) > 1)
+    ++n;
+  Level const& level = m_levels[n];
+  float depth = 0.0f;
+  for (uint32_t y = y0 >> n; y <= (y1 >> n); ++y)
+    for (uint32_t x = x0 >> n; x <= (x1 >> n); ++x)
+      depth = std::max(depth, level.at(x, y));
+  return depth;
+}
+
+} // namespace vulkan::culling
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "debug.h"
+
+namespace vulkan::culling {
+
+// DepthPyramid
+//
+// A hierarchical-Z buffer: a mip chain of a depth buffer where each texel holds the largest (farthest)
+// depth of the texels that it covers. This is the CPU reference of the image that the depth pyramid
+// compute shader builds (see OcclusionShaders.h); both use exactly the same reduction.
+//
+// Level 0 has the size of the depth buffer and is a copy of it. Level n + 1 is (w + 1) / 2 by (h + 1) / 2
+// when level n is w by h: texel (x, y) of level n covers the depth buffer pixels
+// [x << n, (x + 1) << n) x [y << n, (y + 1) << n), clipped to the depth buffer. The last level is 1x1.
+//
+// The depth buffer must use the conventional depth range (0 is near, 1 is far; vk::CompareOp::eLessOrEqual).
+//
+class DepthPyramid
+{
+ public:
+  struct Level
+  {
+    uint32_t m_width;
+    uint32_t m_height;
+    std::vector<float> m_depth;         // Row-major.
+
+    float at(uint32_t x, uint32_t y) const { return m_depth[y * m_width + x]; }
+  };
+
+ private:
+  std::vector<Level> m_levels;
+
+ public:
+  // The number of mip levels of the depth pyramid of a width x height depth buffer.
+  static uint32_t level_count(uint32_t width, uint32_t height);
+
+  // Build the pyramid of the row-major width x height depth buffer depth.
+  void build(uint32_t width, uint32_t height, std::span<float const> depth);
+
+  // Returns the largest depth of the depth buffer pixels in the (inclusive) rectangle [x0, x1] x [y0, y1],
+  // rounded up to the texels of the smallest level at which the rectangle covers at most 2x2 texels.
+  // The result is therefore never less than the exact maximum.
+  float max_depth(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1) const;
+
+  // Accessors.
+  uint32_t width() const { return m_levels.empty() ? 0 : m_levels[0].m_width; }
+  uint32_t height() const { return m_levels.empty() ? 0 : m_levels[0].m_height; }
+  size_t levels() const { return m_levels.size(); }
+  Level const& level(size_t n) const { return m_levels[n]; }
+};
+
+} // namespace vulkan::culling
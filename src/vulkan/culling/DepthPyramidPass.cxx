@@ -0,0 +1,159 @@
+#include "sys.h"
+#include "DepthPyramidPass.h"
+#include "DepthPyramid.h"
+#include "LogicalDevice.h"
+#include "Pipeline.h"
+#include "meshlet/MeshletShaders.h"
+#include "debug.h"
+
+namespace vulkan::culling {
+
+namespace {
+
+// The number of texels in all levels of the depth pyramid of an extent.
+vk::DeviceSize pyramid_texel_count(vk::Extent2D extent)
+{
+  vk::DeviceSize texel_count = 0;
+  for (uint32_t level = 0; level < DepthPyramid::level_count(extent.width, extent.height); ++level)
+  {
+    texel_count += vk::DeviceSize{extent.width} * extent.height;
+    extent = vk::Extent2D{ (extent.width + 1) / 2, (extent.height + 1) / 2 };
+  }
+  return texel_count;
+}
+
+} // namespace
+
+void DepthPyramidPass::create_buffers(LogicalDevice const* logical_device, vk::Extent2D max_extent COMMA_CWDEBUG_ONLY(Ambifix const& ambifix))
+{
+  DoutEntering(dc::vulkan, "DepthPyramidPass::create_buffers(" << logical_device << ", " << max_extent << ")");
+
+  m_logical_device = logical_device;
+  m_max_extent = max_extent;
+  m_extent = vk::Extent2D{};
+  m_level_count = 0;
+
+  // Two eD16Unorm texels per word; the size of the buffer is a multiple of four.
+  vk::DeviceSize const depth_size = (vk::DeviceSize{max_extent.width} * max_extent.height * sizeof(uint16_t) + 3) & ~vk::DeviceSize{3};
+  m_depth = memory::Buffer{logical_device, depth_size,
+      { .usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress | vk::BufferUsageFlagBits::eTransferDst,
+        .properties = vk::MemoryPropertyFlagBits::eDeviceLocal }
+      COMMA_CWDEBUG_ONLY(".m_depth" + ambifix)};
+  m_pyramid = memory::Buffer{logical_device, pyramid_texel_count(max_extent) * sizeof(float),
+      { .usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+        .properties = vk::MemoryPropertyFlagBits::eDeviceLocal }
+      COMMA_CWDEBUG_ONLY(".m_pyramid" + ambifix)};
+  m_depth_address = logical_device->get_buffer_address(m_depth.m_vh_buffer);
+  m_pyramid_address = logical_device->get_buffer_address(m_pyramid.m_vh_buffer);
+}
+
+void DepthPyramidPass::record(vk::CommandBuffer command_buffer, Pipeline const& pipeline, vk::Pipeline vh_pipeline,
+    vk::Image vh_depth_image, vk::ImageLayout depth_layout, vk::Extent2D extent)
+{
+  DoutEntering(dc::vkframe, "DepthPyramidPass::record(" << command_buffer << ", pipeline, " << vh_pipeline << ", " << vh_depth_image << ", " << depth_layout << ", " << extent << ")");
+  // Call create_buffers first, with an extent that is at least as large.
+  ASSERT(is_created() && extent.width <= m_max_extent.width && extent.height <= m_max_extent.height);
+
+  m_extent = extent;
+  m_level_count = DepthPyramid::level_count(extent.width, extent.height);
+
+  vk::ImageSubresourceRange const depth_subresource_range{
+    .aspectMask = vk::ImageAspectFlagBits::eDepth,
+    .baseMipLevel = 0,
+    .levelCount = 1,
+    .baseArrayLayer = 0,
+    .layerCount = 1
+  };
+
+  // Wait for the render pass to finish writing the depth attachment, and for the shaders of the previous frame to finish reading the buffers.
+  vk::ImageMemoryBarrier const to_transfer_barrier{
+    .srcAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+    .dstAccessMask = vk::AccessFlagBits::eTransferRead,
+    .oldLayout = depth_layout,
+    .newLayout = vk::ImageLayout::eTransferSrcOptimal,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .image = vh_depth_image,
+    .subresourceRange = depth_subresource_range
+  };
+  vk::MemoryBarrier const buffers_to_transfer_barrier{
+    .srcAccessMask = vk::AccessFlagBits::eShaderRead,
+    .dstAccessMask = vk::AccessFlagBits::eTransferWrite
+  };
+  command_buffer.pipelineBarrier(
+      vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests | vk::PipelineStageFlagBits::eComputeShader,
+      vk::PipelineStageFlagBits::eTransfer, {}, { buffers_to_transfer_barrier }, {}, { to_transfer_barrier });
+
+  vk::BufferImageCopy const region{
+    .bufferOffset = 0,
+    .bufferRowLength = 0,                       // Tightly packed.
+    .bufferImageHeight = 0,
+    .imageSubresource = { .aspectMask = vk::ImageAspectFlagBits::eDepth, .mipLevel = 0, .baseArrayLayer = 0, .layerCount = 1 },
+    .imageOffset = {},
+    .imageExtent = { extent.width, extent.height, 1 }
+  };
+  command_buffer.copyImageToBuffer(vh_depth_image, vk::ImageLayout::eTransferSrcOptimal, m_depth.m_vh_buffer, { region });
+
+  // Return the depth attachment to its layout and make the copy available to the shader.
+  vk::ImageMemoryBarrier const from_transfer_barrier{
+    .srcAccessMask = vk::AccessFlags{},
+    .dstAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+    .oldLayout = vk::ImageLayout::eTransferSrcOptimal,
+    .newLayout = depth_layout,
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .image = vh_depth_image,
+    .subresourceRange = depth_subresource_range
+  };
+  vk::MemoryBarrier const copy_to_compute_barrier{
+    .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
+    .dstAccessMask = vk::AccessFlagBits::eShaderRead
+  };
+  command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+      vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests,
+      {}, { copy_to_compute_barrier }, {}, { from_transfer_barrier });
+
+  command_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, vh_pipeline);
+  // Push constants are undefined after binding a pipeline with a different layout.
+  m_push_constant_updater.invalidate();
+  vk::Extent2D source_extent = extent;
+  vk::Extent2D destination_extent = extent;
+  vk::DeviceAddress input = m_depth_address;
+  vk::DeviceAddress output = m_pyramid_address;
+  for (uint32_t level = 0; level < m_level_count; ++level)
+  {
+    if (level > 0)
+    {
+      // Each level reads the one that the previous dispatch wrote.
+      vk::MemoryBarrier const level_barrier{
+        .srcAccessMask = vk::AccessFlagBits::eShaderWrite,
+        .dstAccessMask = vk::AccessFlagBits::eShaderRead
+      };
+      command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader,
+          {}, { level_barrier }, {}, {});
+      input = output;
+      output += vk::DeviceSize{destination_extent.width} * destination_extent.height * sizeof(float);
+      source_extent = destination_extent;
+      destination_extent = vk::Extent2D{ (source_extent.width + 1) / 2, (source_extent.height + 1) / 2 };
+    }
+    m_push_constant_updater.set<&DepthPyramidLevel::m_input>(meshlet::to_uvec2(input));
+    m_push_constant_updater.set<&DepthPyramidLevel::m_output>(meshlet::to_uvec2(output));
+    m_push_constant_updater.set<&DepthPyramidLevel::m_source_extent>(glsl::uvec2{source_extent.width, source_extent.height});
+    m_push_constant_updater.set<&DepthPyramidLevel::m_destination_extent>(glsl::uvec2{destination_extent.width, destination_extent.height});
+    m_push_constant_updater.set<&DepthPyramidLevel::m_unorm16_source>(static_cast<glsl::Uint>(level == 0 ? 1 : 0));
+    m_push_constant_updater.flush(command_buffer, pipeline);
+    command_buffer.dispatch(
+        (destination_extent.width + depth_pyramid_workgroup_size - 1) / depth_pyramid_workgroup_size,
+        (destination_extent.height + depth_pyramid_workgroup_size - 1) / depth_pyramid_workgroup_size, 1);
+  }
+
+  // Make the pyramid available to the occlusion culling pass.
+  vk::MemoryBarrier const pyramid_barrier{
+    .srcAccessMask = vk::AccessFlagBits::eShaderWrite,
+    .dstAccessMask = vk::AccessFlagBits::eShaderRead
+  };
+  command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader,
+      {}, { pyramid_barrier }, {}, {});
+}
+
+} // namespace vulkan::culling
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "OcclusionShaders.h"
+#include "memory/Buffer.h"
+#include "pipeline/PushConstantUpdater.h"
+#include <vulkan/vulkan.hpp>
+
+namespace vulkan {
+class LogicalDevice;
+class Pipeline;
+} // namespace vulkan
+
+namespace vulkan::culling {
+
+// DepthPyramidPass
+//
+// Records the depth pyramid step of two-phase occlusion culling (see OcclusionShaders.h): the depth
+// attachment that was stored by the render pass before it is copied to a buffer, which is then reduced
+// into the depth pyramid buffer with one dispatch of depth_pyramid_glsl per level.
+//
+// Usage:
+//
+//   create_buffers()   from SynchronousWindow::on_window_size_changed_post (all frames completed),
+//   record()           every frame, outside a render pass, after the depth attachment was written.
+//
+// The compute pipeline is created by the window: register depth_pyramid_glsl and create a pipeline
+// factory with a characteristic that adds that shader and add_push_constant<DepthPyramidLevel>().
+//
+// The depth attachment must have format eD16Unorm and vk::ImageUsageFlagBits::eTransferSrc. The buffers
+// are shared by all frame resources: record() waits (with a pipeline barrier) until the work of previous
+// frames that used them finished, which requires all of that to be submitted to the same queue.
+//
+class DepthPyramidPass
+{
+ private:
+  LogicalDevice const* m_logical_device{};
+  memory::Buffer m_depth;                                               // A tightly packed copy of the depth attachment.
+  memory::Buffer m_pyramid;                                             // All levels of the depth pyramid.
+  vk::DeviceAddress m_depth_address{};
+  vk::DeviceAddress m_pyramid_address{};
+  vk::Extent2D m_max_extent;                                            // The largest extent that the buffers have room for.
+  vk::Extent2D m_extent;                                                // The extent of level 0 of the last recorded pyramid.
+  uint32_t m_level_count{};
+  pipeline::PushConstantUpdater<DepthPyramidLevel> m_push_constant_updater;
+
+ public:
+  // (Re)create the buffers for a depth attachment of at most max_extent.
+  void create_buffers(LogicalDevice const* logical_device, vk::Extent2D max_extent COMMA_CWDEBUG_ONLY(Ambifix const& ambifix));
+
+  // Record the reduction of the extent part of the depth attachment vh_depth_image, that is in layout depth_layout,
+  // into all levels of the pyramid, using the compute pipeline vh_pipeline (of pipeline). The depth attachment is
+  // returned to depth_layout; the pyramid can be read by compute shaders that are recorded after this.
+  void record(vk::CommandBuffer command_buffer, Pipeline const& pipeline, vk::Pipeline vh_pipeline,
+      vk::Image vh_depth_image, vk::ImageLayout depth_layout, vk::Extent2D extent);
+
+  bool is_created() const { return m_pyramid.m_vh_buffer; }
+
+  // Accessors.
+  vk::DeviceAddress pyramid_address() const { return m_pyramid_address; }
+  vk::Extent2D extent() const { return m_extent; }
+  uint32_t level_count() const { return m_level_count; }
+};
+
+} // namespace vulkan::culling
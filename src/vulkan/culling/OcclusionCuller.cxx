@@ -0,0 +1,79 @@
+#include "sys.h"
+#include "OcclusionCuller.h"
+#include <algorithm>
+#include <cmath>
+
+namespace vulkan::culling {
+
+bool is_outside(glsl::vec3 const& center, float radius, std::array<glsl::vec4, 6> const& frustum_planes)
+{
+  for (glsl::vec4 const& plane : frustum_planes)
+    if (plane.head<3>().dot(center) + plane[3] < -radius)
+      return true;
+  return false;
+}
+
+bool is_occluded(glsl::vec3 const& center, float radius, glsl::mat4 const& view_projection, DepthPyramid const& depth_pyramid)
+{
+  // Project the corners of the cube around the sphere; their bounding rectangle contains the projection of the sphere
+  // and their nearest depth is the nearest depth of the sphere (depth only depends on the distance along the view axis).
+  float min_x = 1.0f, min_y = 1.0f, max_x = -1.0f, max_y = -1.0f, min_z = 1.0f;
+  for (int corner = 0; corner < 8; ++corner)
+  {
+    glsl::vec4 const position(
+        center.x() + ((corner & 1) ? radius : -radius),
+        center.y() + ((corner & 2) ? radius : -radius),
+        center.z() + ((corner & 4) ? radius : -radius), 1.0f);
+    glsl::vec4 const clip = view_projection * position;
+    // The sphere intersects the near plane (or is behind the camera).
+    if (clip.w() <= 0.0f || clip.z() < 0.0f)
+      return false;
+    float const x = clip.x() / clip.w();
+    float const y = clip.y() / clip.w();
+    min_x = std::min(min_x, x);
+    max_x = std::max(max_x, x);
+    min_y = std::min(min_y, y);
+    max_y = std::max(max_y, y);
+    min_z = std::min(min_z, clip.z() / clip.w());
+  }
+  // Outside the screen; leave that to the frustum test.
+  if (max_x < -1.0f || min_x > 1.0f || max_y < -1.0f || min_y > 1.0f)
+    return false;
+
+  // Convert to (inclusive) pixel coordinates of the depth buffer.
+  float const width = depth_pyramid.width();
+  float const height = depth_pyramid.height();
+  uint32_t const x0 = std::clamp((min_x * 0.5f + 0.5f) * width, 0.0f, width - 1.0f);
+  uint32_t const x1 = std::clamp((max_x * 0.5f + 0.5f) * width, 0.0f, width - 1.0f);
+  uint32_t const y0 = std::clamp((min_y * 0.5f + 0.5f) * height, 0.0f, height - 1.0f);
+  uint32_t const y1 = std::clamp((max_y * 0.5f + 0.5f) * height, 0.0f, height - 1.0f);
+
+  return min_z > depth_pyramid.max_depth(x0, y0, x1, y1);
+}
+
+void OcclusionCuller::early_pass(std::span<CullObject const> objects, std::array<glsl::vec4, 6> const& frustum_planes,
+    std::vector<DrawIndexedIndirectCommand>& draws_out) const
+{
+  ASSERT(objects.size() == m_visibility.size());
+  for (size_t i = 0; i < objects.size(); ++i)
+    if (m_visibility[i] && !is_outside(objects[i].center(), objects[i].m_radius, frustum_planes))
+      draws_out.push_back(draw_command(objects[i]));
+}
+
+void OcclusionCuller::late_pass(std::span<CullObject const> objects, glsl::mat4 const& view_projection, std::array<glsl::vec4, 6> const& frustum_planes,
+    DepthPyramid const& depth_pyramid, std::vector<DrawIndexedIndirectCommand>& draws_out)
+{
+  ASSERT(objects.size() == m_visibility.size());
+  for (size_t i = 0; i < objects.size(); ++i)
+  {
+    CullObject const& object = objects[i];
+    bool const visible = !is_outside(object.center(), object.m_radius, frustum_planes) &&
+      !is_occluded(object.center(), object.m_radius, view_projection, depth_pyramid);
+    // Objects that were visible in the previous frame were already drawn by the early pass.
+    if (visible && !m_visibility[i])
+      draws_out.push_back(draw_command(object));
+    m_visibility[i] = visible ? 1 : 0;
+  }
+}
+
+} // namespace vulkan::culling
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "DepthPyramid.h"
+#include "math/glsl.h"
+#include <array>
+#include <span>
+#include <vector>
+
+namespace vulkan::culling {
+
+// An object that is subject to culling: its bounding sphere and the indexed draw that renders it.
+//
+// The layout of this struct is the same as the std430 layout of the CullObject struct in
+// the occlusion culling compute shader (see OcclusionShaders.h).
+//
+struct CullObject
+{
+  std::array<float, 3> m_center;        // Bounding sphere, in the space that view_projection transforms from.
+  float m_radius;
+  uint32_t m_index_count;
+  uint32_t m_first_index;
+  int32_t m_vertex_offset;
+  uint32_t m_first_instance;            // Passed on to the draw, so that the shader can find the object data.
+
+  glsl::vec3 center() const { return { m_center[0], m_center[1], m_center[2] }; }
+};
+
+static_assert(sizeof(CullObject) == 32, "CullObject must have the std430 layout of the shader struct.");
+
+// The same layout as VkDrawIndexedIndirectCommand.
+struct DrawIndexedIndirectCommand
+{
+  uint32_t m_index_count;
+  uint32_t m_instance_count;
+  uint32_t m_first_index;
+  int32_t m_vertex_offset;
+  uint32_t m_first_instance;
+};
+
+static_assert(sizeof(DrawIndexedIndirectCommand) == 20, "DrawIndexedIndirectCommand must have the layout of VkDrawIndexedIndirectCommand.");
+
+// Returns true when the bounding sphere (center, radius) is completely behind the depth in depth_pyramid,
+// which must have been built from a depth buffer that was rendered with view_projection.
+// Spheres that intersect the near plane, or that are outside the screen, are never occluded.
+bool is_occluded(glsl::vec3 const& center, float radius, glsl::mat4 const& view_projection, DepthPyramid const& depth_pyramid);
+
+// Returns true when the bounding sphere (center, radius) is completely outside one of the frustum planes
+// (see meshlet::frustum_planes).
+bool is_outside(glsl::vec3 const& center, float radius, std::array<glsl::vec4, 6> const& frustum_planes);
+
+// OcclusionCuller
+//
+// The CPU reference of two-phase hierarchical-Z occlusion culling, as done by the occlusion culling
+// compute shader (see OcclusionShaders.h):
+//
+// 1. early_pass: draw the objects that were visible in the previous frame (and are inside the frustum).
+// 2. Build the depth pyramid from the depth buffer that this produced.
+// 3. late_pass: test all objects inside the frustum against that depth pyramid; draw those that are
+//    visible now but weren't drawn by the early pass, and remember which objects are visible for
+//    the next frame.
+//
+// Because the depth pyramid is built from the current frame, the late pass catches the objects that
+// the previous frame's visibility wrongly culled (for example, objects that became visible because
+// the camera or an occluder moved): every object that is visible in the final image is drawn.
+//
+class OcclusionCuller
+{
+ private:
+  std::vector<uint32_t> m_visibility;   // One flag per object: 1 if the object was visible in the last frame (a uint, like the shader).
+
+ public:
+  // Set the number of objects. New objects are considered invisible: they are drawn by the late pass.
+  void resize(size_t object_count) { m_visibility.resize(object_count, 0); }
+
+  // Append the draws of the early pass to draws_out.
+  void early_pass(std::span<CullObject const> objects, std::array<glsl::vec4, 6> const& frustum_planes,
+      std::vector<DrawIndexedIndirectCommand>& draws_out) const;
+
+  // Append the draws of the late pass to draws_out and update the visibility.
+  void late_pass(std::span<CullObject const> objects, glsl::mat4 const& view_projection, std::array<glsl::vec4, 6> const& frustum_planes,
+      DepthPyramid const& depth_pyramid, std::vector<DrawIndexedIndirectCommand>& draws_out);
+
+  // Accessor.
+  bool was_visible(size_t object_index) const { return m_visibility[object_index]; }
+
+ private:
+  static DrawIndexedIndirectCommand draw_command(CullObject const& object)
+  {
+    return { object.m_index_count, 1, object.m_first_index, object.m_vertex_offset, object.m_first_instance };
+  }
+};
+
+} // namespace vulkan::culling
@@ -0,0 +1,164 @@
+#include "sys.h"
+#include "OcclusionShaders.h"
+
+namespace vulkan::culling {
+
+static_assert(depth_pyramid_workgroup_size == 8 && occlusion_cull_workgroup_size == 64, "Update the constants in the shaders below.");
+
+// These are templates: the push constant blocks DepthPyramidLevel and OcclusionCull are declared by ShaderInputData::preprocess2.
+std::string_view const depth_pyramid_glsl = R"glsl(
+#extension GL_EXT_buffer_reference : require
+#extension GL_EXT_buffer_reference_uvec2 : require
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(buffer_reference, std430, buffer_reference_align = 4) readonly buffer Unorm16Level { uint words[]; };
+layout(buffer_reference, std430, buffer_reference_align = 4) readonly buffer SourceLevel { float depth[]; };
+layout(buffer_reference, std430, buffer_reference_align = 4) writeonly buffer DestinationLevel { float depth[]; };
+
+float source_depth(ivec2 position)
+{
+  uint i = uint(position.y) * DepthPyramidLevel::m_source_extent.x + uint(position.x);
+  if (DepthPyramidLevel::m_unorm16_source == 0)
+    return SourceLevel(DepthPyramidLevel::m_input).depth[i];
+  // Two tightly packed 16-bit texels per word.
+  uint word = Unorm16Level(DepthPyramidLevel::m_input).words[i >> 1];
+  return float((word >> ((i & 1u) * 16u)) & 0xffffu) / 65535.0;
+}
+
+void main()
+{
+  uvec2 position = gl_GlobalInvocationID.xy;
+  uvec2 source_extent = DepthPyramidLevel::m_source_extent;
+  uvec2 destination_extent = DepthPyramidLevel::m_destination_extent;
+  if (any(greaterThanEqual(position, destination_extent)))
+    return;
+  float depth;
+  if (source_extent == destination_extent)
+    depth = source_depth(ivec2(position));
+  else
+  {
+    // The maximum of the 2x2 source texels, clamped to the source.
+    ivec2 s0 = ivec2(2 * position);
+    ivec2 s1 = min(s0 + 1, ivec2(source_extent) - 1);
+    depth = max(max(source_depth(s0), source_depth(ivec2(s1.x, s0.y))),
+                max(source_depth(ivec2(s0.x, s1.y)), source_depth(s1)));
+  }
+  DestinationLevel(DepthPyramidLevel::m_output).depth[position.y * destination_extent.x + position.x] = depth;
+}
+)glsl";
+
+std::string_view const occlusion_cull_glsl = R"glsl(
+#extension GL_EXT_buffer_reference : require
+#extension GL_EXT_buffer_reference_uvec2 : require
+
+layout(local_size_x = 64) in;
+
+struct CullObject
+{
+  vec4 sphere;                  // center, radius
+  uint index_count;
+  uint first_index;
+  int vertex_offset;
+  uint first_instance;
+};
+
+struct DrawIndexedIndirectCommand
+{
+  uint index_count;
+  uint instance_count;
+  uint first_index;
+  int vertex_offset;
+  uint first_instance;
+};
+
+layout(buffer_reference, std430, buffer_reference_align = 16) readonly buffer Objects { CullObject objects[]; };
+layout(buffer_reference, std430, buffer_reference_align = 4) buffer Visibility { uint visibility[]; };
+layout(buffer_reference, std430, buffer_reference_align = 4) writeonly buffer Draws { DrawIndexedIndirectCommand draws[]; };
+layout(buffer_reference, std430, buffer_reference_align = 4) buffer DrawCount { uint draw_count; };
+layout(buffer_reference, std430, buffer_reference_align = 4) readonly buffer DepthPyramid { float depth[]; };
+layout(buffer_reference, std430, buffer_reference_align = 16) readonly buffer OcclusionCullCamera
+{
+  mat4 view_projection;
+  vec4 frustum_planes[6];
+};
+
+bool is_outside(vec4 sphere, OcclusionCullCamera camera)
+{
+  for (int i = 0; i < 6; ++i)
+    if (dot(camera.frustum_planes[i].xyz, sphere.xyz) + camera.frustum_planes[i].w < -sphere.w)
+      return true;
+  return false;
+}
+
+bool is_occluded(vec4 sphere, OcclusionCullCamera camera)
+{
+  vec2 min_xy = vec2(1.0);
+  vec2 max_xy = vec2(-1.0);
+  float min_z = 1.0;
+  for (int corner = 0; corner < 8; ++corner)
+  {
+    vec3 offset = vec3((corner & 1) != 0 ? sphere.w : -sphere.w,
+                       (corner & 2) != 0 ? sphere.w : -sphere.w,
+                       (corner & 4) != 0 ? sphere.w : -sphere.w);
+    vec4 clip = camera.view_projection * vec4(sphere.xyz + offset, 1.0);
+    if (clip.w <= 0.0 || clip.z < 0.0)
+      return false;
+    min_xy = min(min_xy, clip.xy / clip.w);
+    max_xy = max(max_xy, clip.xy / clip.w);
+    min_z = min(min_z, clip.z / clip.w);
+  }
+  if (any(lessThan(max_xy, vec2(-1.0))) || any(greaterThan(min_xy, vec2(1.0))))
+    return false;
+
+  uvec2 level_extent = OcclusionCull::m_depth_extent;
+  vec2 extent = vec2(level_extent);
+  uvec2 p0 = uvec2(clamp((min_xy * 0.5 + 0.5) * extent, vec2(0.0), extent - 1.0));
+  uvec2 p1 = uvec2(clamp((max_xy * 0.5 + 0.5) * extent, vec2(0.0), extent - 1.0));
+  // Find the smallest level at which the rectangle covers at most 2x2 texels, and where that level starts.
+  uint n = 0;
+  uint level_offset = 0;
+  while (n + 1 < OcclusionCull::m_pyramid_level_count && any(greaterThan((p1 >> n) - (p0 >> n), uvec2(1))))
+  {
+    level_offset += level_extent.x * level_extent.y;
+    level_extent = (level_extent + 1) / 2;
+    ++n;
+  }
+  DepthPyramid depth_pyramid = DepthPyramid(OcclusionCull::m_depth_pyramid);
+  float depth = 0.0;
+  for (uint y = p0.y >> n; y <= (p1.y >> n); ++y)
+    for (uint x = p0.x >> n; x <= (p1.x >> n); ++x)
+      depth = max(depth, depth_pyramid.depth[level_offset + y * level_extent.x + x]);
+  return min_z > depth;
+}
+
+void main()
+{
+  uint i = gl_GlobalInvocationID.x;
+  if (i >= OcclusionCull::m_object_count)
+    return;
+  OcclusionCullCamera camera = OcclusionCullCamera(OcclusionCull::m_camera);
+  Visibility visibility = Visibility(OcclusionCull::m_visibility);
+  CullObject object = Objects(OcclusionCull::m_objects).objects[i];
+  bool visible = !is_outside(object.sphere, camera);
+  if (OcclusionCull::m_late_pass == 0)
+  {
+    // Draw what was visible in the previous frame.
+    if (!visible || visibility.visibility[i] == 0)
+      return;
+  }
+  else
+  {
+    visible = visible && !is_occluded(object.sphere, camera);
+    bool drawn_by_early_pass = visibility.visibility[i] != 0;
+    visibility.visibility[i] = visible ? 1 : 0;
+    if (!visible || drawn_by_early_pass)
+      return;
+  }
+  uint draw_index = atomicAdd(DrawCount(OcclusionCull::m_draw_count).draw_count, 1);
+  Draws(OcclusionCull::m_draws).draws[draw_index] =
+    DrawIndexedIndirectCommand(object.index_count, 1u, object.first_index, object.vertex_offset, object.first_instance);
+}
+)glsl";
+
+} // namespace vulkan::culling
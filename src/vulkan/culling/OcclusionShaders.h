@@ -0,0 +1,126 @@
+#pragma once
+
+#include "OcclusionCuller.h"
+#include "shader_builder/ShaderVariableLayouts.h"
+#include <string_view>
+
+namespace vulkan::culling {
+
+// GLSL compute shaders for two-phase hierarchical-Z occlusion culling (see OcclusionCuller).
+//
+// Both are shader templates (without #version line) that are compiled by a pipeline factory (the factory
+// creates a compute pipeline for a characteristic that only adds a compute shader). Like the meshlet shaders
+// (see meshlet/MeshletShaders.h) they have no descriptors: the only shader input is a push constant, that
+// the characteristic must register with add_push_constant, containing the device addresses (see
+// meshlet::to_uvec2) of buffers that were created with vk::BufferUsageFlagBits::eShaderDeviceAddress.
+//
+// A frame then looks like this:
+//
+//   1. Occlusion culling, early pass (m_late_pass = 0): writes the draws of the objects that were visible last frame.
+//   2. Render pass: draw those with drawIndexedIndirectCount (or drawMeshTasksIndirectCountEXT, see below).
+//      The depth attachment must be stored (not discarded) and have vk::ImageUsageFlagBits::eTransferSrc.
+//   3. Depth pyramid: DepthPyramidPass copies the depth attachment to a buffer and reduces it, one dispatch per level.
+//   4. Occlusion culling, late pass (m_late_pass = 1): writes the draws of the objects that became visible,
+//      and the visibility for the next frame.
+//   5. Render pass: draw those on top of the result of 2 (load, don't clear, the attachments).
+//
+// Each step reads what the previous step wrote, so each needs a pipeline barrier (compute shader write to
+// draw indirect read, depth attachment write to transfer read, transfer write to compute shader read and
+// compute shader write to compute shader read). Zero the draw count (fillBuffer) before each culling pass.
+//
+// Depth pyramid
+//
+// The depth pyramid is a buffer with the levels of a DepthPyramid one after another, each a row-major
+// array of float: level n + 1 is (w + 1) / 2 by (h + 1) / 2 when level n is w by h. The shader is
+// dispatched once per level, in workgroups of depth_pyramid_workgroup_size squared, with the push constant
+// DepthPyramidLevel. The source of level 0 is a copy of a eD16Unorm depth attachment (copyImageToBuffer,
+// tightly packed); level 0 is then the same size as the source. The reduction is the same as DepthPyramid::build.
+//
+static constexpr uint32_t depth_pyramid_workgroup_size = 8;
+
+// The push constant of the depth pyramid shader, used as DepthPyramidLevel::m_input etc. in the shader template.
+struct DepthPyramidLevel
+{
+  glsl::uvec2 m_input;                                  // The source level, or the copy of the depth attachment.
+  glsl::uvec2 m_output;                                 // The level that is written.
+  glsl::uvec2 m_source_extent;
+  glsl::uvec2 m_destination_extent;                     // Equal to m_source_extent for level 0.
+  glsl::Uint m_unorm16_source;                          // 1 if m_input is the copy of the depth attachment, 0 if it is a level of floats.
+};
+
+// Occlusion culling
+//
+// Runs one invocation per object, in workgroups of occlusion_cull_workgroup_size, with the push constant
+// OcclusionCull, whose device addresses point to:
+//
+//   m_objects:       CullObject[].
+//   m_visibility:    uint[]: the visibility of each object (zero initialize).
+//   m_draws:         DrawIndexedIndirectCommand[] (the indirect draw buffer, room for all objects).
+//   m_draw_count:    uint: the draw count (the count buffer of drawIndexedIndirectCount).
+//   m_camera:        OcclusionCullCamera.
+//   m_depth_pyramid: the depth pyramid of m_depth_extent, with m_pyramid_level_count levels (see above).
+//
+// The tests are the same as is_outside and is_occluded.
+//
+// Note that shader variables are found by a plain text search: the name of a member may not be the
+// beginning of the name of another member.
+//
+// The draws can also be used with drawMeshTasksIndirectCountEXT and a stride of sizeof(DrawIndexedIndirectCommand):
+// m_index_count, m_instance_count and m_first_index are then read as the number of task shader workgroups in x, y
+// and z. Such objects must therefore have m_first_index set to 1.
+//
+static constexpr uint32_t occlusion_cull_workgroup_size = 64;
+
+// The layout of m_camera (std430). This is a prefix of meshlet::MeshletCamera, so the same buffer can be used.
+struct OcclusionCullCamera
+{
+  glsl::mat4 m_view_projection;                         // The same as was used to render the depth buffer of the depth pyramid.
+  std::array<glsl::vec4, 6> m_frustum_planes;           // See meshlet::frustum_planes(m_view_projection).
+};
+
+// The push constant of the occlusion culling shader, used as OcclusionCull::m_objects etc. in the shader template.
+struct OcclusionCull
+{
+  glsl::uvec2 m_objects;
+  glsl::uvec2 m_visibility;
+  glsl::uvec2 m_draws;
+  glsl::uvec2 m_draw_count;
+  glsl::uvec2 m_camera;
+  glsl::uvec2 m_depth_pyramid;
+  glsl::uvec2 m_depth_extent;                           // The extent of level 0 of the depth pyramid.
+  glsl::Uint m_pyramid_level_count;
+  glsl::Uint m_object_count;
+  glsl::Uint m_late_pass;                               // 0 for the early pass, 1 for the late pass.
+};
+
+extern std::string_view const depth_pyramid_glsl;
+extern std::string_view const occlusion_cull_glsl;
+
+} // namespace vulkan::culling
+
+LAYOUT_DECLARATION(vulkan::culling::DepthPyramidLevel, push_constant_std430)
+{
+  static constexpr auto struct_layout = make_struct_layout(
+    LAYOUT(uvec2, m_input),
+    LAYOUT(uvec2, m_output),
+    LAYOUT(uvec2, m_source_extent),
+    LAYOUT(uvec2, m_destination_extent),
+    LAYOUT(Uint, m_unorm16_source)
+  );
+};
+
+LAYOUT_DECLARATION(vulkan::culling::OcclusionCull, push_constant_std430)
+{
+  static constexpr auto struct_layout = make_struct_layout(
+    LAYOUT(uvec2, m_objects),
+    LAYOUT(uvec2, m_visibility),
+    LAYOUT(uvec2, m_draws),
+    LAYOUT(uvec2, m_draw_count),
+    LAYOUT(uvec2, m_camera),
+    LAYOUT(uvec2, m_depth_pyramid),
+    LAYOUT(uvec2, m_depth_extent),
+    LAYOUT(Uint, m_pyramid_level_count),
+    LAYOUT(Uint, m_object_count),
+    LAYOUT(Uint, m_late_pass)
+  );
+};
@@ -75,6 +75,7 @@ class CombinedImageSamplerUpdater : public vk_utils::TaskToTaskDeque<AIStatefulT
   std::unique_ptr<detail::CombinedImageSamplerShaderResourceMember> m_member;   // A CombinedImageSamplerUpdater only has a single "member".
   std::atomic<vk::DescriptorBindingFlags> m_binding_flags{};                    // Optional binding flags to use for this descriptor.
   std::atomic<int32_t> m_descriptor_array_size{1};                              // Array size or one if this is not an array, negative when unbounded.
+  std::atomic<vk::ImageViewType> m_image_view_type{vk::ImageViewType::e2D};     // The view type of the textures; determines the sampler type in the shader.
   using factory_characteristic_key_to_descriptor_t = std::vector<std::pair<pipeline::FactoryCharacteristicKey, pipeline::FactoryCharacteristicData>>;
   factory_characteristic_key_to_descriptor_t m_factory_characteristic_key_to_descriptor;        // The descriptor set / bindings associated with this CombinedImageSamplerUpdater.
   using factory_characteristic_key_to_texture_t = std::vector<std::pair<pipeline::FactoryCharacteristicKey, Texture const*>>;
@@ -119,11 +120,20 @@ class CombinedImageSamplerUpdater : public vk_utils::TaskToTaskDeque<AIStatefulT
     ASSERT(prev_descriptor_array_size == 1 || prev_descriptor_array_size == size);
   }
 
+  void set_image_view_type(vk::ImageViewType image_view_type)
+  {
+    DoutEntering(dc::vulkan, "CombinedImageSamplerUpdater::set_image_view_type(" << vk::to_string(image_view_type) << ") [" << this << "]");
+    // Only 2D and 2D array textures are supported.
+    ASSERT(image_view_type == vk::ImageViewType::e2D || image_view_type == vk::ImageViewType::e2DArray);
+    m_image_view_type.store(image_view_type, std::memory_order::relaxed);
+  }
+
   CombinedImageSamplerUpdater& operator=(CombinedImageSamplerUpdater&& rhs)
   {
     this->ShaderResourceBase::operator=(std::move(rhs));
     m_member = std::move(rhs.m_member);
     m_descriptor_array_size.store(rhs.m_descriptor_array_size.load(std::memory_order::relaxed), std::memory_order::relaxed);
+    m_image_view_type.store(rhs.m_image_view_type.load(std::memory_order::relaxed), std::memory_order::relaxed);
     return *this;
   }
 
@@ -147,6 +157,7 @@ class CombinedImageSamplerUpdater : public vk_utils::TaskToTaskDeque<AIStatefulT
 
   vk::DescriptorBindingFlags binding_flags() const override final { return m_binding_flags; }
   int32_t descriptor_array_size() const override final { return m_descriptor_array_size; }
+  vk::ImageViewType image_view_type() const override final { return m_image_view_type; }
 
  protected:
   ~CombinedImageSamplerUpdater() override;
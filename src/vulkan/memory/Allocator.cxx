@@ -50,4 +50,27 @@ vk::Image Allocator::create_image(
   return vh_image;
 }
 
+VmaAllocation Allocator::allocate_memory(
+    vk::MemoryRequirements const& memory_requirements,
+    VmaAllocationCreateInfo const& vma_allocation_create_info,
+    VmaAllocationInfo* allocation_info
+    COMMA_CWDEBUG_ONLY(Ambifix const& allocation_name)) const
+{
+  VmaAllocation vh_allocation;
+  vk::Result res = static_cast<vk::Result>(
+      vmaAllocateMemory(m_handle, &static_cast<VkMemoryRequirements const&>(memory_requirements), &vma_allocation_create_info, &vh_allocation, allocation_info)
+      );
+  if (res != vk::Result::eSuccess)
+    THROW_ALERTC(res, "vmaAllocateMemory");
+  Debug(vmaSetAllocationName(m_handle, vh_allocation, allocation_name.object_name().c_str()));
+  return vh_allocation;
+}
+
+void Allocator::bind_image_memory(VmaAllocation vh_allocation, vk::Image vh_image) const
+{
+  vk::Result res = static_cast<vk::Result>(vmaBindImageMemory(m_handle, vh_allocation, vh_image));
+  if (res != vk::Result::eSuccess)
+    THROW_ALERTC(res, "vmaBindImageMemory");
+}
+
 } // namespace vulkan::memory
@@ -13,6 +13,13 @@ class Ambifix;
 
 namespace memory {
 
+// The budget and usage of a set of memory heaps, as reported by VMA (see LogicalDevice::device_local_memory_budget).
+struct HeapBudget
+{
+  vk::DeviceSize m_usage = 0;           // The memory that is currently allocated from these heaps by this process.
+  vk::DeviceSize m_budget = 0;          // The memory that this process can allocate from these heaps without problems.
+};
+
 class Allocator
 {
   VmaAllocator m_handle{};
@@ -59,6 +66,20 @@ class Allocator
     vmaDestroyImage(m_handle, vh_image, vh_allocation);
   }
 
+  // Allocate memory for memory_requirements that is bound to a resource later (see bind_image_memory).
+  VmaAllocation allocate_memory(
+      vk::MemoryRequirements const& memory_requirements,
+      VmaAllocationCreateInfo const& vma_allocation_create_info,
+      VmaAllocationInfo* allocation_info
+      COMMA_CWDEBUG_ONLY(Ambifix const& allocation_name)) const;
+
+  void bind_image_memory(VmaAllocation vh_allocation, vk::Image vh_image) const;
+
+  void free_memory(VmaAllocation vh_allocation) const
+  {
+    vmaFreeMemory(m_handle, vh_allocation);
+  }
+
   VmaAllocationInfo get_allocation_info(VmaAllocation vh_allocation) const
   {
     VmaAllocationInfo alloc_info;
@@ -83,6 +104,11 @@ class Allocator
     vmaFlushAllocations(m_handle, allocation_count, vh_allocations, offsets, sizes);
   }
 
+  void invalidate_allocation(VmaAllocation vh_allocation, vk::DeviceSize offset, vk::DeviceSize size) const
+  {
+    vmaInvalidateAllocation(m_handle, vh_allocation, offset, size);
+  }
+
   void unmap_memory(VmaAllocation vh_allocation) const
   {
     vmaUnmapMemory(m_handle, vh_allocation);
@@ -94,6 +120,12 @@ class Allocator
     vmaGetAllocationMemoryProperties(m_handle, vh_allocation, &memory_property_flags);
     memory_property_flags_out = vk::MemoryPropertyFlags{memory_property_flags};
   }
+
+  // budgets_out must point to an array of (at least) the number of memory heaps.
+  void get_heap_budgets(VmaBudget* budgets_out) const
+  {
+    vmaGetHeapBudgets(m_handle, budgets_out);
+  }
 };
 
 } // namespace memory
@@ -0,0 +1,58 @@
+#include "sys.h"
+#include "DeviceImagePoolBackend.h"
+#include "LogicalDevice.h"
+#ifdef CWDEBUG
+#include "debug/DebugSetName.h"
+#endif
+
+namespace vulkan::memory {
+
+vk::Image DeviceImagePoolBackend::create_image(vk::ImageCreateInfo const& image_create_info, ImagePool::Requirements& requirements_out)
+{
+  vk::Image vh_image = m_logical_device->create_unbound_image({}, image_create_info);
+  vk::MemoryRequirements const memory_requirements = m_logical_device->get_image_memory_requirements(vh_image);
+  requirements_out = { memory_requirements.size, memory_requirements.alignment, memory_requirements.memoryTypeBits };
+  return vh_image;
+}
+
+void DeviceImagePoolBackend::destroy_image(vk::Image vh_image)
+{
+  m_logical_device->destroy_unbound_image({}, vh_image);
+}
+
+VmaAllocation DeviceImagePoolBackend::allocate_memory(ImagePool::Requirements const& requirements, ImagePool::MemoryKey const& memory_key, uint32_t& memory_type_out)
+{
+  VmaAllocationCreateInfo vma_allocation_create_info{
+    .flags = memory_key.m_flags,
+    .usage = memory_key.m_usage
+  };
+  // VMA only selects a memory type for the VMA_MEMORY_USAGE_AUTO* usages when it knows the resource,
+  // which isn't the case here (the memory might be bound to a different image later): translate those
+  // to the memory properties that VMA would pick for an image.
+  if (memory_key.m_usage == VMA_MEMORY_USAGE_AUTO || memory_key.m_usage == VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE ||
+      memory_key.m_usage == VMA_MEMORY_USAGE_AUTO_PREFER_HOST)
+  {
+    vma_allocation_create_info.usage = VMA_MEMORY_USAGE_UNKNOWN;
+    if ((memory_key.m_flags & (VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT)))
+      vma_allocation_create_info.requiredFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    if (memory_key.m_usage != VMA_MEMORY_USAGE_AUTO_PREFER_HOST)
+      vma_allocation_create_info.preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+  }
+  vk::MemoryRequirements const memory_requirements{ requirements.m_size, requirements.m_alignment, requirements.m_memory_type_bits };
+  VmaAllocation vh_allocation = m_logical_device->allocate_memory({}, memory_requirements, vma_allocation_create_info
+      COMMA_CWDEBUG_ONLY(Ambifix{"ImagePool memory"}));
+  memory_type_out = m_logical_device->get_allocation_info(vh_allocation).memoryType;
+  return vh_allocation;
+}
+
+void DeviceImagePoolBackend::bind_image_memory(vk::Image vh_image, VmaAllocation vh_allocation)
+{
+  m_logical_device->bind_image_memory({}, vh_image, vh_allocation);
+}
+
+void DeviceImagePoolBackend::free_memory(VmaAllocation vh_allocation)
+{
+  m_logical_device->free_memory({}, vh_allocation);
+}
+
+} // namespace vulkan::memory
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "ImagePool.h"
+
+namespace vulkan {
+class LogicalDevice;
+
+namespace memory {
+
+// The ImagePool::Backend that creates images and allocates memory on a logical device.
+class DeviceImagePoolBackend final : public ImagePool::Backend
+{
+ private:
+  LogicalDevice const* m_logical_device;
+
+ public:
+  DeviceImagePoolBackend(LogicalDevice const* logical_device) : m_logical_device(logical_device) { }
+
+  vk::Image create_image(vk::ImageCreateInfo const& image_create_info, ImagePool::Requirements& requirements_out) override;
+  void destroy_image(vk::Image vh_image) override;
+  VmaAllocation allocate_memory(ImagePool::Requirements const& requirements, ImagePool::MemoryKey const& memory_key, uint32_t& memory_type_out) override;
+  void bind_image_memory(vk::Image vh_image, VmaAllocation vh_allocation) override;
+  void free_memory(VmaAllocation vh_allocation) override;
+};
+
+} // namespace memory
+} // namespace vulkan
@@ -0,0 +1,37 @@
+#include "sys.h"
+#include "DeviceSparseMipMemoryBackend.h"
+#include "LogicalDevice.h"
+#include "Application.h"
+#include "queues/SparseBind.h"
+#include "debug.h"
+
+namespace vulkan::memory {
+
+VmaAllocation DeviceSparseMipMemoryBackend::allocate_memory(vk::MemoryRequirements const& requirements)
+{
+  // Like DeviceImagePoolBackend: VMA doesn't know the resource, so the memory properties must be given explicitly.
+  VmaAllocationCreateInfo vma_allocation_create_info{
+    .usage = VMA_MEMORY_USAGE_UNKNOWN,
+    .preferredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+  };
+  return m_logical_device->allocate_memory({}, requirements, vma_allocation_create_info
+      COMMA_CWDEBUG_ONLY(Ambifix{"SparseMipMemory memory"}));
+}
+
+void DeviceSparseMipMemoryBackend::free_memory(VmaAllocation vh_allocation)
+{
+  m_logical_device->free_memory({}, vh_allocation);
+}
+
+void DeviceSparseMipMemoryBackend::unbind(std::vector<SparseMipMemory::Binding> bindings, std::function<void()> done)
+{
+  auto sparse_bind = statefultask::create<task::SparseBind>(m_logical_device, std::move(bindings) COMMA_CWDEBUG_ONLY(false));
+  sparse_bind->set_resource_owner(m_resource_owner);
+  // If the unbind failed then the memory is freed while still bound; that is allowed as long as it isn't accessed anymore.
+  sparse_bind->run(Application::instance().low_priority_queue(), [done = std::move(done)](bool CWDEBUG_ONLY(success)){
+    Dout(dc::warning(!success), "Unbinding sparse memory failed.");
+    done();
+  });
+}
+
+} // namespace vulkan::memory
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "SparseMipMemory.h"
+
+namespace task {
+class SynchronousWindow;
+} // namespace task
+
+namespace vulkan {
+class LogicalDevice;
+
+namespace memory {
+
+// The SparseMipMemory::Backend that allocates device memory and unbinds it on the transfer queue of a logical device.
+class DeviceSparseMipMemoryBackend final : public SparseMipMemory::Backend
+{
+ private:
+  LogicalDevice const* m_logical_device;
+  task::SynchronousWindow const* m_resource_owner;              // The window that owns the SparseMipMemory (it waits for the unbinds).
+
+ public:
+  DeviceSparseMipMemoryBackend(LogicalDevice const* logical_device, task::SynchronousWindow const* resource_owner) :
+    m_logical_device(logical_device), m_resource_owner(resource_owner) { }
+
+  VmaAllocation allocate_memory(vk::MemoryRequirements const& requirements) override;
+  void free_memory(VmaAllocation vh_allocation) override;
+  void unbind(std::vector<SparseMipMemory::Binding> bindings, std::function<void()> done) override;
+};
+
+} // namespace memory
+} // namespace vulkan
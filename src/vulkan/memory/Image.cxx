@@ -2,6 +2,7 @@
 #include "Image.h"
 #include "ImageKind.h"
 #include "LogicalDevice.h"
+#include "SparseMipMemory.h"
 
 namespace vulkan::memory {
 
@@ -12,20 +13,64 @@ Image::Image(
     MemoryCreateInfo memory_create_info
     COMMA_CWDEBUG_ONLY(Ambifix const& ambifix)) : m_logical_device(logical_device)
 {
-  VmaAllocationCreateInfo vma_allocation_create_info{
-    .flags = memory_create_info.vma_allocation_create_flags,
-    .usage = memory_create_info.vma_memory_usage
-  };
+  // An image can't be both pooled and sparse.
+  ASSERT(!memory_create_info.image_pool || (!memory_create_info.sparse_mip_memory && !memory_create_info.sparse_residency));
+  if (memory_create_info.image_pool)
+  {
+    ImagePool::Acquired acquired = memory_create_info.image_pool->acquire(image_view_kind.image_kind()(extent),
+        { memory_create_info.vma_memory_usage, memory_create_info.vma_allocation_create_flags });
+    m_vh_image = acquired.m_vh_image;
+    m_vh_allocation = acquired.m_vh_allocation;
+    m_image_pool = memory_create_info.image_pool;
+    if (memory_create_info.allocation_info_out)
+      *memory_create_info.allocation_info_out = logical_device->get_allocation_info(m_vh_allocation);
+  }
+  else if (memory_create_info.sparse_mip_memory)
+  {
+    // Create the image without memory; SparseMipMemory::commit allocates the memory of each mip level when it is loaded.
+    vk::ImageCreateInfo image_create_info = image_view_kind.image_kind()(extent);
+    image_create_info.flags |= vk::ImageCreateFlagBits::eSparseBinding | vk::ImageCreateFlagBits::eSparseResidency;
+    m_vh_image = logical_device->create_unbound_image({}, image_create_info);
+    m_sparse_mip_memory = memory_create_info.sparse_mip_memory;
+    vk::MemoryRequirements const memory_requirements = logical_device->get_image_memory_requirements(m_vh_image);
+    std::vector<vk::SparseImageMemoryRequirements> const sparse_memory_requirements = logical_device->get_image_sparse_memory_requirements(m_vh_image);
+    // A sparse resident color image has exactly one element: that of the color aspect.
+    ASSERT(sparse_memory_requirements.size() == 1);
+    vk::SparseImageMemoryRequirements const& color_requirements = sparse_memory_requirements[0];
+    vk::Extent3D const& granularity = color_requirements.formatProperties.imageGranularity;
+    m_sparse_mip_memory->add(m_vh_image, SparseMipMemory::layout(extent, image_create_info.mipLevels, { granularity.width, granularity.height },
+        memory_requirements, color_requirements.imageMipTailFirstLod, color_requirements.imageMipTailSize, color_requirements.imageMipTailOffset));
+  }
+  else if (memory_create_info.sparse_residency)
+  {
+    // Create the image without memory; the owner binds memory to the parts of it that it uses (see VirtualTexture).
+    vk::ImageCreateInfo image_create_info = image_view_kind.image_kind()(extent);
+    image_create_info.flags |= vk::ImageCreateFlagBits::eSparseBinding | vk::ImageCreateFlagBits::eSparseResidency;
+    m_vh_image = logical_device->create_unbound_image({}, image_create_info);
+    m_sparse_residency = true;
+  }
+  else
+  {
+    VmaAllocationCreateInfo vma_allocation_create_info{
+      .flags = memory_create_info.vma_allocation_create_flags,
+      .usage = memory_create_info.vma_memory_usage
+    };
 
-  m_vh_image = logical_device->create_image({}, image_view_kind.image_kind()(extent), vma_allocation_create_info, &m_vh_allocation, memory_create_info.allocation_info_out
-      COMMA_CWDEBUG_ONLY(".m_vh_allocation" + ambifix));
+    m_vh_image = logical_device->create_image({}, image_view_kind.image_kind()(extent), vma_allocation_create_info, &m_vh_allocation, memory_create_info.allocation_info_out
+        COMMA_CWDEBUG_ONLY(".m_vh_allocation" + ambifix));
+  }
   DebugSetName(m_vh_image, ambifix.object_name(".m_vh_image"), logical_device);
 
 #ifdef CWDEBUG
-  vk::MemoryRequirements image_memory_requirements = logical_device->get_image_memory_requirements(m_vh_image);
-  Dout(dc::vulkan, "Allocated image " << m_vh_image << " with memory requirements: " <<
-      print_using(image_memory_requirements, logical_device->memory_requirements_printer()) <<
-      " and allocation info: " << logical_device->get_allocation_info(m_vh_allocation));
+  if (m_sparse_mip_memory || m_sparse_residency)
+    Dout(dc::vulkan, "Created sparse image " << m_vh_image << ".");
+  else
+  {
+    vk::MemoryRequirements image_memory_requirements = logical_device->get_image_memory_requirements(m_vh_image);
+    Dout(dc::vulkan, "Allocated image " << m_vh_image << " with memory requirements: " <<
+        print_using(image_memory_requirements, logical_device->memory_requirements_printer()) <<
+        " and allocation info: " << logical_device->get_allocation_info(m_vh_allocation));
+  }
 #endif
 }
 
@@ -34,7 +79,10 @@ void Image::print_on(std::ostream& os) const
 {
   os << "{logical_device:" << m_logical_device <<
       ", vh_image:" << m_vh_image <<
-      ", vh_allocation:" << m_vh_allocation << '}';
+      ", vh_allocation:" << m_vh_allocation <<
+      ", image_pool:" << m_image_pool <<
+      ", sparse_mip_memory:" << m_sparse_mip_memory <<
+      ", sparse_residency:" << m_sparse_residency << '}';
 }
 #endif
 
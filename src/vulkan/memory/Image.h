@@ -8,6 +8,8 @@ class LogicalDevice;
 class ImageViewKind;
 
 namespace memory {
+class ImagePool;
+class SparseMipMemory;
 
 struct ImageMemoryCreateInfoDefaults
 {
@@ -15,6 +17,9 @@ struct ImageMemoryCreateInfoDefaults
   VmaAllocationCreateFlags    vma_allocation_create_flags{};
   VmaMemoryUsage              vma_memory_usage{VMA_MEMORY_USAGE_AUTO};
   VmaAllocationInfo*          allocation_info_out{};
+  ImagePool*                  image_pool{};             // If set, the image is acquired from and released to this pool.
+  SparseMipMemory*            sparse_mip_memory{};      // If set, the image is sparse resident and the memory of its mip levels is managed by this object.
+  bool                        sparse_residency{};       // If set (and sparse_mip_memory isn't), the image is sparse resident and its owner binds its memory.
 };
 
 // Vulkan Image's parameters container class.
@@ -23,6 +28,9 @@ struct Image
   LogicalDevice const* m_logical_device{};              // The associated logical device; only valid when m_vh_image is non-null.
   vk::Image m_vh_image;                                 // Vulkan handle to the underlying image, or VK_NULL_HANDLE when no image is represented.
   VmaAllocation m_vh_allocation{};                      // The memory allocation used for the image; only valid when m_vh_image is non-null.
+  ImagePool* m_image_pool{};                            // The pool that the image was acquired from, or nullptr.
+  SparseMipMemory* m_sparse_mip_memory{};               // The object that manages the memory of this sparse image, or nullptr.
+  bool m_sparse_residency{};                            // Set if this is a sparse image whose memory is bound by its owner.
 
   using MemoryCreateInfo = ImageMemoryCreateInfoDefaults;
 
@@ -35,7 +43,8 @@ struct Image
     MemoryCreateInfo memory_create_info
     COMMA_CWDEBUG_ONLY(Ambifix const& ambifix));
 
-  Image(Image&& rhs) : m_logical_device(rhs.m_logical_device), m_vh_image(rhs.m_vh_image), m_vh_allocation(rhs.m_vh_allocation)
+  Image(Image&& rhs) : m_logical_device(rhs.m_logical_device), m_vh_image(rhs.m_vh_image), m_vh_allocation(rhs.m_vh_allocation), m_image_pool(rhs.m_image_pool),
+    m_sparse_mip_memory(rhs.m_sparse_mip_memory), m_sparse_residency(rhs.m_sparse_residency)
   {
     rhs.m_vh_image = VK_NULL_HANDLE;
   }
@@ -51,6 +60,9 @@ struct Image
     m_logical_device = rhs.m_logical_device;
     m_vh_image = rhs.m_vh_image;
     m_vh_allocation = rhs.m_vh_allocation;
+    m_image_pool = rhs.m_image_pool;
+    m_sparse_mip_memory = rhs.m_sparse_mip_memory;
+    m_sparse_residency = rhs.m_sparse_residency;
     rhs.m_vh_image = VK_NULL_HANDLE;
     return *this;
   }
@@ -75,6 +87,8 @@ struct Image
 #ifndef VULKAN_LOGICAL_DEVICE_H
 #include "LogicalDevice.h"
 #endif
+#include "ImagePool.h"
+#include "SparseMipMemory.h"
 
 #ifndef VULKAN_MEMORY_IMAGE_H_definitions
 #define VULKAN_MEMORY_IMAGE_H_definitions
@@ -101,7 +115,19 @@ void Image::unmap_memory()
 void Image::destroy()
 {
   if (m_vh_image)
-    m_logical_device->destroy_image({}, m_vh_image, m_vh_allocation);
+  {
+    if (m_image_pool)
+      m_image_pool->release(m_vh_image, m_vh_allocation);
+    else if (m_sparse_mip_memory)
+    {
+      m_sparse_mip_memory->remove(m_vh_image);
+      m_logical_device->destroy_unbound_image({}, m_vh_image);
+    }
+    else if (m_sparse_residency)
+      m_logical_device->destroy_unbound_image({}, m_vh_image);       // The owner freed the memory.
+    else
+      m_logical_device->destroy_image({}, m_vh_image, m_vh_allocation);
+  }
   m_vh_image = VK_NULL_HANDLE;
 }
 
@@ -0,0 +1,257 @@
+#include "sys.h"
+#include "ImagePool.h"
+#include <algorithm>
+#include <bit>
+#include <iostream>
+#include <optional>
+#include "debug.h"
+
+namespace vulkan::memory {
+
+ImagePool::ImageKey::ImageKey(vk::ImageCreateInfo const& image_create_info, MemoryKey const& memory_key) :
+  m_flags(static_cast<uint32_t>(image_create_info.flags)),
+  m_image_type(static_cast<uint32_t>(image_create_info.imageType)),
+  m_format(static_cast<uint32_t>(image_create_info.format)),
+  m_width(image_create_info.extent.width),
+  m_height(image_create_info.extent.height),
+  m_depth(image_create_info.extent.depth),
+  m_mip_levels(image_create_info.mipLevels),
+  m_array_layers(image_create_info.arrayLayers),
+  m_samples(static_cast<uint32_t>(image_create_info.samples)),
+  m_tiling(static_cast<uint32_t>(image_create_info.tiling)),
+  m_usage(static_cast<uint32_t>(image_create_info.usage)),
+  m_memory_key(memory_key)
+{
+  // Those are not part of the key.
+  ASSERT(!image_create_info.pNext && image_create_info.sharingMode == vk::SharingMode::eExclusive);
+}
+
+ImagePool::ImagePool(std::unique_ptr<Backend> backend, Policy const& policy) : m_backend(std::move(backend)), m_policy(policy)
+{
+  DoutEntering(dc::vulkan, "ImagePool::ImagePool(<backend>, {" << policy.m_max_idle_frames << ", " << policy.m_max_pooled_bytes << "})");
+}
+
+ImagePool::~ImagePool()
+{
+  DoutEntering(dc::vulkan, "ImagePool::~ImagePool()");
+  std::vector<PooledImage> pooled;
+  {
+    state_t::wat state_w(m_state);
+    // Release all images before destroying the pool.
+    ASSERT(state_w->m_live.empty());
+    pooled.assign(std::make_move_iterator(state_w->m_pooled.begin()), std::make_move_iterator(state_w->m_pooled.end()));
+    state_w->m_pooled.clear();
+  }
+  destroy(pooled);
+}
+
+//static
+vk::DeviceSize ImagePool::size_class(vk::DeviceSize size)
+{
+  if (size <= 8 * s_min_size_class)
+    return std::max(s_min_size_class, (size + s_min_size_class - 1) / s_min_size_class * s_min_size_class);
+  // Round up to a multiple of an eighth of the largest power of two that is less than size.
+  vk::DeviceSize const step = vk::DeviceSize{1} << (std::bit_width(size - 1) - 4);
+  return (size + step - 1) & ~(step - 1);
+}
+
+template<typename F>
+auto ImagePool::backend_call(F&& f)
+{
+  struct Account
+  {
+    ImagePool* m_pool;
+    std::chrono::steady_clock::time_point m_start;
+    ~Account()
+    {
+      m_pool->m_backend_calls.fetch_add(1, std::memory_order_relaxed);
+      m_pool->m_backend_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count(),
+          std::memory_order_relaxed);
+    }
+  } account{this, std::chrono::steady_clock::now()};
+  return f();
+}
+
+void ImagePool::begin_frame(frame_type frame)
+{
+  state_t::wat state_w(m_state);
+  ASSERT(frame >= state_w->m_current_frame);
+  state_w->m_current_frame = frame;
+}
+
+void ImagePool::retire(frame_type completed_frame)
+{
+  std::vector<PooledImage> trimmed;
+  {
+    state_t::wat state_w(m_state);
+    state_w->m_retired_end = std::max(state_w->m_retired_end, completed_frame + 1);
+    collect_trimmed(*state_w, trimmed);
+  }
+  destroy(trimmed);
+}
+
+ImagePool::Acquired ImagePool::acquire(vk::ImageCreateInfo const& image_create_info, MemoryKey const& memory_key)
+{
+  ImageKey const key(image_create_info, memory_key);
+
+  // Because m_pooled is ordered by m_last_use, the retired images are at the front.
+  {
+    state_t::wat state_w(m_state);
+    ++state_w->m_stats.m_acquires;
+    for (auto pooled_image = state_w->m_pooled.begin(); pooled_image != state_w->m_pooled.end() && retired(*state_w, *pooled_image); ++pooled_image)
+    {
+      if (!(pooled_image->m_key == key))
+        continue;
+      Acquired const result{ pooled_image->m_vh_image, pooled_image->m_memory.m_vh_allocation };
+      state_w->m_live.emplace(static_cast<VkImage>(result.m_vh_image), LiveImage{ key, pooled_image->m_memory });
+      state_w->m_stats.m_pooled_bytes -= pooled_image->m_memory.m_size;
+      state_w->m_pooled.erase(pooled_image);
+      ++state_w->m_stats.m_image_reuses;
+      return result;
+    }
+  }
+
+  // There is no image to reuse; create one.
+  Requirements requirements;
+  vk::Image const vh_image = backend_call([&](){ return m_backend->create_image(image_create_info, requirements); });
+  vk::DeviceSize const size = size_class(requirements.m_size);
+
+  // Look for memory of a retired image that can be used instead.
+  std::optional<PooledImage> donor;
+  {
+    state_t::wat state_w(m_state);
+    ++state_w->m_stats.m_images_created;
+    for (auto pooled_image = state_w->m_pooled.begin(); pooled_image != state_w->m_pooled.end() && retired(*state_w, *pooled_image); ++pooled_image)
+    {
+      Memory const& memory = pooled_image->m_memory;
+      if (memory.m_memory_key == memory_key && memory.m_size == size &&
+          (requirements.m_memory_type_bits & (uint32_t{1} << memory.m_memory_type)) &&
+          memory.m_alignment % requirements.m_alignment == 0)
+      {
+        donor = std::move(*pooled_image);
+        state_w->m_stats.m_pooled_bytes -= memory.m_size;
+        state_w->m_pooled.erase(pooled_image);
+        break;
+      }
+    }
+  }
+
+  Memory memory{};
+  bool allocated = false;
+  try
+  {
+    if (donor)
+    {
+      backend_call([&](){ m_backend->destroy_image(donor->m_vh_image); });
+      memory = donor->m_memory;
+      allocated = true;
+    }
+    else
+    {
+      Requirements const class_requirements{ size, requirements.m_alignment, requirements.m_memory_type_bits };
+      uint32_t memory_type;
+      VmaAllocation const vh_allocation = backend_call([&](){ return m_backend->allocate_memory(class_requirements, memory_key, memory_type); });
+      memory = { vh_allocation, memory_key, size, requirements.m_alignment, memory_type };
+      allocated = true;
+    }
+    backend_call([&](){ m_backend->bind_image_memory(vh_image, memory.m_vh_allocation); });
+  }
+  catch (...)
+  {
+    backend_call([&](){ m_backend->destroy_image(vh_image); });
+    if (allocated)
+      backend_call([&](){ m_backend->free_memory(memory.m_vh_allocation); });
+    state_t::wat state_w(m_state);
+    ++state_w->m_stats.m_images_destroyed;
+    if (allocated)
+    {
+      ++state_w->m_stats.m_frees;
+      if (donor)
+        ++state_w->m_stats.m_images_destroyed;
+      else
+        ++state_w->m_stats.m_allocations;
+    }
+    throw;
+  }
+
+  state_t::wat state_w(m_state);
+  if (donor)
+  {
+    ++state_w->m_stats.m_images_destroyed;
+    ++state_w->m_stats.m_memory_reuses;
+  }
+  else
+    ++state_w->m_stats.m_allocations;
+  state_w->m_live.emplace(static_cast<VkImage>(vh_image), LiveImage{ key, memory });
+  return { vh_image, memory.m_vh_allocation };
+}
+
+void ImagePool::release(vk::Image vh_image, VmaAllocation vh_allocation)
+{
+  std::vector<PooledImage> trimmed;
+  {
+    state_t::wat state_w(m_state);
+    auto live_image = state_w->m_live.find(static_cast<VkImage>(vh_image));
+    // Only release images that were returned by acquire(), and only once.
+    ASSERT(live_image != state_w->m_live.end() && live_image->second.m_memory.m_vh_allocation == vh_allocation);
+    state_w->m_pooled.push_back({ vh_image, live_image->second.m_key, live_image->second.m_memory, state_w->m_current_frame });
+    state_w->m_stats.m_pooled_bytes += live_image->second.m_memory.m_size;
+    state_w->m_live.erase(live_image);
+    collect_trimmed(*state_w, trimmed);
+  }
+  destroy(trimmed);
+}
+
+void ImagePool::collect_trimmed(State& state, std::vector<PooledImage>& trimmed) const
+{
+  while (!state.m_pooled.empty() && retired(state, state.m_pooled.front()))
+  {
+    PooledImage& oldest = state.m_pooled.front();
+    bool const idle = state.m_current_frame - oldest.m_last_use > m_policy.m_max_idle_frames;
+    if (!idle && state.m_stats.m_pooled_bytes <= m_policy.m_max_pooled_bytes)
+      break;
+    state.m_stats.m_pooled_bytes -= oldest.m_memory.m_size;
+    trimmed.push_back(std::move(oldest));
+    state.m_pooled.pop_front();
+  }
+}
+
+void ImagePool::destroy(std::vector<PooledImage>& trimmed)
+{
+  if (trimmed.empty())
+    return;
+  Dout(dc::vulkan, "ImagePool: destroying " << trimmed.size() << " pooled images.");
+  for (PooledImage const& pooled_image : trimmed)
+  {
+    backend_call([&](){ m_backend->destroy_image(pooled_image.m_vh_image); });
+    backend_call([&](){ m_backend->free_memory(pooled_image.m_memory.m_vh_allocation); });
+  }
+  state_t::wat state_w(m_state);
+  state_w->m_stats.m_images_destroyed += trimmed.size();
+  state_w->m_stats.m_frees += trimmed.size();
+  trimmed.clear();
+}
+
+ImagePool::Stats ImagePool::stats() const
+{
+  Stats stats;
+  {
+    state_t::crat state_r(m_state);
+    stats = state_r->m_stats;
+    stats.m_pooled_images = state_r->m_pooled.size();
+  }
+  stats.m_backend_calls = m_backend_calls.load(std::memory_order_relaxed);
+  stats.m_backend_time = std::chrono::nanoseconds(m_backend_ns.load(std::memory_order_relaxed));
+  return stats;
+}
+
+void ImagePool::Stats::print_on(std::ostream& os) const
+{
+  constexpr double MiB = 1024.0 * 1024.0;
+  os << "acquires: " << m_acquires << " (" << m_image_reuses << " reused an image, " << m_memory_reuses << " reused memory), images created: " <<
+    m_images_created << ", destroyed: " << m_images_destroyed << ", allocations: " << m_allocations << ", frees: " << m_frees << "\n";
+  os << "  backend calls: " << m_backend_calls << " (" << (m_backend_time.count() * 1000.0) << " ms), pooled: " << m_pooled_images <<
+    " images (" << (m_pooled_bytes / MiB) << " MiB)\n";
+}
+
+} // namespace vulkan::memory
@@ -0,0 +1,217 @@
+#pragma once
+
+#include "threadsafe/aithreadsafe.h"
+#include <vk_mem_alloc.h>
+#include <vulkan/vulkan.hpp>
+#include <atomic>
+#include <chrono>
+#include <compare>
+#include <cstdint>
+#include <iosfwd>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace vulkan::memory {
+
+// ImagePool
+//
+// Recycles images, and the memory bound to them, that are created and destroyed often: render
+// targets that are recreated when a window is resized, transient attachments, streamed textures, etc.
+//
+// An image that is released is not destroyed but kept, together with its memory, until the last
+// frame that might use it retired on the GPU. After that acquire() hands it out again for an image
+// with the same create info (the ImageKind and extent) and memory usage. If there is no such image,
+// a new image is created and bound to the memory of a retired image that is no longer needed (the
+// least recently released one), provided that memory has the same size class, memory usage and a
+// compatible memory type and alignment; only if that fails new memory is allocated. Memory is always
+// allocated with a size that is rounded up to its size class (see size_class), so that images with
+// slightly different extents can share it.
+//
+// Pooled images that were not reused for m_max_idle_frames frames are destroyed and their memory
+// freed, and so are the least recently released retired images when more than m_max_pooled_bytes
+// are pooled.
+//
+// The images that acquire() returns are in an undefined layout (the contents of a recycled image are
+// whatever it was last used for): transition them from vk::ImageLayout::eUndefined.
+//
+// The render loop calls begin_frame() at the start of every frame and retire() once a frame finished
+// on the GPU. acquire() and release() may be called from any thread.
+//
+// All Vulkan (and VMA) calls go through a Backend (see DeviceImagePoolBackend), which must be
+// thread-safe.
+//
+class ImagePool
+{
+ public:
+  using frame_type = uint64_t;
+
+  // The memory usage of an image, as passed to VMA.
+  struct MemoryKey
+  {
+    VmaMemoryUsage m_usage = VMA_MEMORY_USAGE_AUTO;
+    VmaAllocationCreateFlags m_flags = 0;
+
+    auto operator<=>(MemoryKey const&) const = default;
+  };
+
+  struct Requirements
+  {
+    vk::DeviceSize m_size;
+    vk::DeviceSize m_alignment;
+    uint32_t m_memory_type_bits;
+  };
+
+  class Backend
+  {
+   public:
+    virtual ~Backend() = default;
+
+    // Create an image without memory bound to it and return its memory requirements in requirements_out.
+    virtual vk::Image create_image(vk::ImageCreateInfo const& image_create_info, Requirements& requirements_out) = 0;
+    virtual void destroy_image(vk::Image vh_image) = 0;
+    // Allocate memory for requirements (of which m_size is already rounded up to its size class). Returns the used memory type in memory_type_out.
+    virtual VmaAllocation allocate_memory(Requirements const& requirements, MemoryKey const& memory_key, uint32_t& memory_type_out) = 0;
+    virtual void bind_image_memory(vk::Image vh_image, VmaAllocation vh_allocation) = 0;
+    virtual void free_memory(VmaAllocation vh_allocation) = 0;
+  };
+
+  struct Policy
+  {
+    frame_type m_max_idle_frames = 300;                 // Pooled images that were not reused for this many frames are destroyed.
+    vk::DeviceSize m_max_pooled_bytes = vk::DeviceSize{256} << 20;      // The maximum size of the memory of all pooled images.
+  };
+
+  struct Stats
+  {
+    uint64_t m_acquires = 0;                    // The number of calls to acquire().
+    uint64_t m_image_reuses = 0;                // The number of those that returned a pooled image.
+    uint64_t m_memory_reuses = 0;               // The number of those that created a new image but bound it to pooled memory.
+    uint64_t m_images_created = 0;
+    uint64_t m_images_destroyed = 0;
+    uint64_t m_allocations = 0;                 // The number of memory allocations.
+    uint64_t m_frees = 0;                       // The number of freed memory allocations.
+    uint64_t m_backend_calls = 0;               // The total number of Backend calls.
+    std::chrono::duration<double> m_backend_time{};     // The total time spent in those calls.
+    size_t m_pooled_images = 0;                 // The number of images that are currently pooled.
+    vk::DeviceSize m_pooled_bytes = 0;          // The size of their memory.
+
+    void print_on(std::ostream& os) const;
+  };
+
+  // An image and the memory that it is bound to.
+  struct Acquired
+  {
+    vk::Image m_vh_image;
+    VmaAllocation m_vh_allocation;
+  };
+
+  // The granularity of all size classes.
+  static constexpr vk::DeviceSize s_min_size_class = 4096;
+
+ private:
+  // Everything of an image create info that determines whether an image can be reused.
+  struct ImageKey
+  {
+    uint32_t m_flags;
+    uint32_t m_image_type;
+    uint32_t m_format;
+    uint32_t m_width;
+    uint32_t m_height;
+    uint32_t m_depth;
+    uint32_t m_mip_levels;
+    uint32_t m_array_layers;
+    uint32_t m_samples;
+    uint32_t m_tiling;
+    uint32_t m_usage;
+    MemoryKey m_memory_key;
+
+    ImageKey(vk::ImageCreateInfo const& image_create_info, MemoryKey const& memory_key);
+    auto operator<=>(ImageKey const&) const = default;
+  };
+
+  struct Memory
+  {
+    VmaAllocation m_vh_allocation;
+    MemoryKey m_memory_key;
+    vk::DeviceSize m_size;                      // The size class that was allocated.
+    vk::DeviceSize m_alignment;                 // The alignment that was requested.
+    uint32_t m_memory_type;
+  };
+
+  struct PooledImage
+  {
+    vk::Image m_vh_image;
+    ImageKey m_key;
+    Memory m_memory;
+    frame_type m_last_use;                      // The frame during which the image was released.
+  };
+
+  struct LiveImage
+  {
+    ImageKey m_key;
+    Memory m_memory;
+  };
+
+  struct State
+  {
+    std::list<PooledImage> m_pooled;            // In the order in which they were released (so m_last_use is non-decreasing).
+    std::unordered_map<VkImage, LiveImage> m_live;      // Images that were returned by acquire() and not released yet.
+    frame_type m_current_frame = 0;
+    frame_type m_retired_end = 0;               // Every frame before this one retired.
+    Stats m_stats;                              // Except m_backend_calls and m_backend_time.
+  };
+  using state_t = aithreadsafe::Wrapper<State, aithreadsafe::policy::Primitive<std::mutex>>;
+
+  std::unique_ptr<Backend> m_backend;
+  Policy const m_policy;
+  state_t m_state;
+  std::atomic<uint64_t> m_backend_calls = 0;
+  std::atomic<int64_t> m_backend_ns = 0;        // The time spent in Backend calls, in nanoseconds.
+
+ public:
+  ImagePool(std::unique_ptr<Backend> backend, Policy const& policy);
+  ImagePool(std::unique_ptr<Backend> backend) : ImagePool(std::move(backend), Policy{}) { }
+  // Destroys all pooled images. All acquired images must have been released, and the GPU must be done with them.
+  ~ImagePool();
+
+  ImagePool(ImagePool const&) = delete;
+  ImagePool& operator=(ImagePool const&) = delete;
+
+  // Return size rounded up to its size class: a multiple of s_min_size_class and, above 8 times that,
+  // one of eight sizes per power of two (so that at most 12.5% is wasted).
+  static vk::DeviceSize size_class(vk::DeviceSize size);
+
+  // Images that are released from now on might be used by frame (frame numbers must increase).
+  void begin_frame(frame_type frame);
+  // Every frame up to and including completed_frame finished on the GPU. Trims the pool.
+  void retire(frame_type completed_frame);
+
+  // Return an image created with image_create_info (which may not have a pNext chain or concurrent sharing mode),
+  // bound to memory with memory_key. Throws if a Backend call throws.
+  Acquired acquire(vk::ImageCreateInfo const& image_create_info, MemoryKey const& memory_key);
+  // Return an image, that was returned by acquire(), to the pool.
+  void release(vk::Image vh_image, VmaAllocation vh_allocation);
+
+  // Return a copy of the statistics.
+  Stats stats() const;
+
+ private:
+  // Call f (which calls m_backend), keeping track of the number of calls and the time spent.
+  template<typename F>
+  auto backend_call(F&& f);
+
+  // Move the retired images that must be trimmed from state to trimmed.
+  void collect_trimmed(State& state, std::vector<PooledImage>& trimmed) const;
+  // Destroy trimmed images and free their memory.
+  void destroy(std::vector<PooledImage>& trimmed);
+  // Whether a pooled image is no longer used by the GPU.
+  static bool retired(State const& state, PooledImage const& pooled_image)
+  {
+    return pooled_image.m_last_use < state.m_retired_end;
+  }
+};
+
+} // namespace vulkan::memory
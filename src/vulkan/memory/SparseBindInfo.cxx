@@ -0,0 +1,47 @@
+#include "sys.h"
+#include "SparseBindInfo.h"
+#include "LogicalDevice.h"
+#include "debug.h"
+
+namespace vulkan::memory {
+
+SparseBindInfo::SparseBindInfo(LogicalDevice const* logical_device, std::vector<SparseMipMemory::Binding> const& bindings)
+{
+  // Reserve, so that the bind infos can point into the bind arrays while those are filled.
+  m_image_binds.reserve(bindings.size());
+  m_opaque_binds.reserve(bindings.size());
+  for (SparseMipMemory::Binding const& binding : bindings)
+  {
+    vk::DeviceMemory vh_memory;
+    vk::DeviceSize memory_offset = 0;
+    if (binding.m_vh_allocation)
+    {
+      VmaAllocationInfo const allocation_info = logical_device->get_allocation_info(binding.m_vh_allocation);
+      vh_memory = allocation_info.deviceMemory;
+      memory_offset = allocation_info.offset;
+    }
+    if (binding.m_tail)
+    {
+      m_opaque_binds.push_back({
+        .resourceOffset = binding.m_offset,
+        .size = binding.m_size,
+        .memory = vh_memory,
+        .memoryOffset = memory_offset
+      });
+      m_opaque_bind_infos.push_back({ .image = binding.m_vh_image, .bindCount = 1, .pBinds = &m_opaque_binds.back() });
+    }
+    else
+    {
+      m_image_binds.push_back({
+        .subresource = { .aspectMask = vk::ImageAspectFlagBits::eColor, .mipLevel = binding.m_level, .arrayLayer = 0 },
+        .offset = { binding.m_region_offset.x, binding.m_region_offset.y, 0 },
+        .extent = { binding.m_extent.width, binding.m_extent.height, 1 },
+        .memory = vh_memory,
+        .memoryOffset = memory_offset
+      });
+      m_image_bind_infos.push_back({ .image = binding.m_vh_image, .bindCount = 1, .pBinds = &m_image_binds.back() });
+    }
+  }
+}
+
+} // namespace vulkan::memory
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "SparseMipMemory.h"
+#include <vulkan/vulkan.hpp>
+#include <vector>
+
+namespace vulkan {
+class LogicalDevice;
+
+namespace memory {
+
+// The vk::BindSparseInfo that makes (or undoes) the bindings of a SparseMipMemory, and the arrays that it points to.
+class SparseBindInfo
+{
+ private:
+  std::vector<vk::SparseImageMemoryBind> m_image_binds;
+  std::vector<vk::SparseMemoryBind> m_opaque_binds;
+  std::vector<vk::SparseImageMemoryBindInfo> m_image_bind_infos;
+  std::vector<vk::SparseImageOpaqueMemoryBindInfo> m_opaque_bind_infos;
+
+ public:
+  SparseBindInfo(LogicalDevice const* logical_device, std::vector<SparseMipMemory::Binding> const& bindings);
+
+  SparseBindInfo(SparseBindInfo const&) = delete;
+
+  bool empty() const { return m_image_binds.empty() && m_opaque_binds.empty(); }
+
+  // The bind info, without semaphores (see Queue::bind_sparse). Only valid as long as this object exists.
+  vk::BindSparseInfo bind_sparse_info() const
+  {
+    return {
+      .imageOpaqueBindCount = static_cast<uint32_t>(m_opaque_bind_infos.size()),
+      .pImageOpaqueBinds = m_opaque_bind_infos.data(),
+      .imageBindCount = static_cast<uint32_t>(m_image_bind_infos.size()),
+      .pImageBinds = m_image_bind_infos.data()
+    };
+  }
+};
+
+} // namespace memory
+} // namespace vulkan
@@ -0,0 +1,275 @@
+#include "sys.h"
+#include "SparseMipMemory.h"
+#include <iostream>
+#include "debug.h"
+
+namespace vulkan::memory {
+
+std::vector<vk::DeviceSize> SparseMipMemory::Layout::residency_level_sizes() const
+{
+  std::vector<vk::DeviceSize> sizes(m_level_sizes);
+  sizes.resize(m_number_of_levels, 0);
+  if (has_tail())
+    sizes.back() = m_tail_size;
+  return sizes;
+}
+
+//static
+SparseMipMemory::Layout SparseMipMemory::layout(vk::Extent2D extent, uint32_t number_of_levels, vk::Extent2D granularity,
+    vk::MemoryRequirements const& requirements, uint32_t tail_level, vk::DeviceSize tail_size, vk::DeviceSize tail_offset)
+{
+  ASSERT(number_of_levels > 0 && granularity.width > 0 && granularity.height > 0);
+  tail_level = std::min(tail_level, number_of_levels);
+  Layout layout{ extent, number_of_levels, {}, tail_level < number_of_levels ? tail_size : 0, tail_offset, requirements };
+  for (uint32_t level = 0; level < tail_level; ++level)
+  {
+    uint32_t const width = std::max(1U, extent.width >> level);
+    uint32_t const height = std::max(1U, extent.height >> level);
+    vk::DeviceSize const pages = vk::DeviceSize{(width + granularity.width - 1) / granularity.width} * ((height + granularity.height - 1) / granularity.height);
+    layout.m_level_sizes.push_back(pages * requirements.alignment);
+  }
+  return layout;
+}
+
+SparseMipMemory::Binding SparseMipMemory::SparseImage::binding(vk::Image vh_image, uint32_t slot, VmaAllocation vh_allocation) const
+{
+  if (slot == m_layout.tail_level())
+    return { vh_image, true, slot, {}, m_layout.m_tail_offset, m_layout.m_tail_size, vh_allocation, {} };
+  vk::Extent2D const extent{ std::max(1U, m_layout.m_extent.width >> slot), std::max(1U, m_layout.m_extent.height >> slot) };
+  return { vh_image, false, slot, extent, 0, m_layout.m_level_sizes[slot], vh_allocation, {} };
+}
+
+SparseMipMemory::~SparseMipMemory()
+{
+  DoutEntering(dc::vulkan, "SparseMipMemory::~SparseMipMemory()");
+  state_t::crat state_r(m_state);
+  // Remove all images before destroying this object, and wait until the GPU is idle.
+  ASSERT(state_r->m_images.empty() && state_r->m_unbinds_in_flight == 0);
+}
+
+void SparseMipMemory::begin_frame(frame_type frame)
+{
+  state_t::wat state_w(m_state);
+  ASSERT(frame >= state_w->m_current_frame);
+  state_w->m_current_frame = frame;
+}
+
+void SparseMipMemory::retire(frame_type completed_frame)
+{
+  std::vector<Binding> bindings;
+  std::vector<Released> freed;
+  {
+    state_t::wat state_w(m_state);
+    State& state = *state_w;
+    state.m_retired_end = std::max(state.m_retired_end, completed_frame + 1);
+    if (state.m_releasing_slots == 0)
+      return;
+    for (auto& [vh_image, sparse_image] : state.m_images)
+      for (uint32_t slot = 0; slot < sparse_image.m_slots.size(); ++slot)
+      {
+        Slot& s = sparse_image.m_slots[slot];
+        if (!s.m_releasing || s.m_released_frame >= state.m_retired_end)
+          continue;
+        bindings.push_back(sparse_image.binding(vh_image, slot, VK_NULL_HANDLE));
+        freed.push_back({ std::move(s.m_released), bindings.back().m_size });
+        // The allocation is freed once it is unbound; remember it in the binding for now.
+        bindings.back().m_vh_allocation = s.m_vh_allocation;
+        s = {};
+        --state.m_releasing_slots;
+      }
+    if (bindings.empty())
+      return;
+    ++state.m_unbinds_in_flight;
+    ++state.m_stats.m_unbinds;
+  }
+
+  std::vector<VmaAllocation> allocations;
+  for (Binding& binding : bindings)
+  {
+    allocations.push_back(binding.m_vh_allocation);
+    binding.m_vh_allocation = VK_NULL_HANDLE;
+  }
+  Dout(dc::vulkan, "SparseMipMemory: unbinding " << bindings.size() << " allocations.");
+  m_backend->unbind(std::move(bindings), [this, allocations = std::move(allocations), freed = std::move(freed)]() mutable {
+    for (VmaAllocation vh_allocation : allocations)
+      m_backend->free_memory(vh_allocation);
+    {
+      state_t::wat state_w(m_state);
+      for (Released const& released : freed)
+      {
+        state_w->m_stats.m_allocated_bytes -= released.m_bytes;
+        state_w->m_stats.m_releasing_bytes -= released.m_bytes;
+      }
+      state_w->m_stats.m_frees += allocations.size();
+      --state_w->m_unbinds_in_flight;
+    }
+    call_released(freed);
+  });
+}
+
+void SparseMipMemory::add(vk::Image vh_image, Layout layout)
+{
+  DoutEntering(dc::vulkan, "SparseMipMemory::add(" << vh_image << ", " << layout.m_number_of_levels << " levels, tail at level " << layout.tail_level() << ")");
+  ASSERT(layout.m_number_of_levels > 0 && layout.m_number_of_levels <= 32);
+  SparseImage sparse_image{ std::move(layout) };
+  sparse_image.m_slots.resize(sparse_image.m_layout.tail_level() + (sparse_image.m_layout.has_tail() ? 1 : 0));
+  state_t::wat state_w(m_state);
+  [[maybe_unused]] bool const inserted = state_w->m_images.emplace(static_cast<VkImage>(vh_image), std::move(sparse_image)).second;
+  ASSERT(inserted);
+}
+
+void SparseMipMemory::remove(vk::Image vh_image)
+{
+  DoutEntering(dc::vulkan, "SparseMipMemory::remove(" << vh_image << ")");
+  std::vector<VmaAllocation> allocations;
+  std::vector<Released> freed;
+  vk::DeviceSize freed_bytes = 0;
+  {
+    state_t::wat state_w(m_state);
+    State& state = *state_w;
+    auto sparse_image = state.m_images.find(static_cast<VkImage>(vh_image));
+    ASSERT(sparse_image != state.m_images.end());
+    for (uint32_t slot = 0; slot < sparse_image->second.m_slots.size(); ++slot)
+    {
+      Slot& s = sparse_image->second.m_slots[slot];
+      if (!s.m_vh_allocation)
+        continue;
+      vk::DeviceSize const size = sparse_image->second.slot_size(slot);
+      allocations.push_back(s.m_vh_allocation);
+      freed_bytes += size;
+      if (s.m_releasing)
+      {
+        state.m_stats.m_releasing_bytes -= size;
+        --state.m_releasing_slots;
+        freed.push_back({ std::move(s.m_released), size });
+      }
+    }
+    state.m_images.erase(sparse_image);
+    state.m_stats.m_allocated_bytes -= freed_bytes;
+    state.m_stats.m_frees += allocations.size();
+  }
+  for (VmaAllocation vh_allocation : allocations)
+    m_backend->free_memory(vh_allocation);
+  call_released(freed);
+}
+
+std::vector<SparseMipMemory::Binding> SparseMipMemory::commit(vk::Image vh_image, uint32_t first_level, uint32_t last_level)
+{
+  DoutEntering(dc::vulkan, "SparseMipMemory::commit(" << vh_image << ", " << first_level << ", " << last_level << ")");
+  std::vector<Binding> bindings;
+  std::vector<Released> reclaimed;
+  {
+    state_t::wat state_w(m_state);
+    State& state = *state_w;
+    auto iter = state.m_images.find(static_cast<VkImage>(vh_image));
+    ASSERT(iter != state.m_images.end());
+    SparseImage& sparse_image = iter->second;
+    ASSERT(first_level < last_level && last_level <= sparse_image.m_layout.m_number_of_levels);
+    uint32_t const first_slot = sparse_image.slot(first_level);
+    uint32_t const last_slot = sparse_image.slot(last_level - 1);
+
+    // Allocate the missing memory first, so that nothing changes if that fails. The lock is kept, so that
+    // retire() can't unbind the released memory of this range in the meantime.
+    try
+    {
+      for (uint32_t slot = first_slot; slot <= last_slot; ++slot)
+        if (!sparse_image.m_slots[slot].m_vh_allocation)
+        {
+          vk::MemoryRequirements requirements = sparse_image.m_layout.m_requirements;
+          requirements.size = sparse_image.slot_size(slot);
+          bindings.push_back(sparse_image.binding(vh_image, slot, m_backend->allocate_memory(requirements)));
+        }
+    }
+    catch (...)
+    {
+      for (Binding const& binding : bindings)
+        m_backend->free_memory(binding.m_vh_allocation);
+      throw;
+    }
+
+    for (Binding const& binding : bindings)
+    {
+      sparse_image.m_slots[binding.m_tail ? sparse_image.m_layout.tail_level() : binding.m_level].m_vh_allocation = binding.m_vh_allocation;
+      state.m_stats.m_allocated_bytes += binding.m_size;
+      ++state.m_stats.m_allocations;
+    }
+    // Memory that was released, but is still bound, is reused.
+    for (uint32_t slot = first_slot; slot <= last_slot; ++slot)
+    {
+      Slot& s = sparse_image.m_slots[slot];
+      if (!s.m_releasing)
+        continue;
+      vk::DeviceSize const size = sparse_image.slot_size(slot);
+      reclaimed.push_back({ std::move(s.m_released), size });
+      s.m_released = {};
+      s.m_releasing = false;
+      --state.m_releasing_slots;
+      state.m_stats.m_releasing_bytes -= size;
+      ++state.m_stats.m_reclaims;
+    }
+    sparse_image.m_committed_levels |= static_cast<uint32_t>(((uint64_t{1} << (last_level - first_level)) - 1) << first_level);
+  }
+  call_released(reclaimed);
+  return bindings;
+}
+
+void SparseMipMemory::release(vk::Image vh_image, uint32_t first_level, uint32_t last_level, released_callback_type released)
+{
+  DoutEntering(dc::vulkan, "SparseMipMemory::release(" << vh_image << ", " << first_level << ", " << last_level << ")");
+  state_t::wat state_w(m_state);
+  State& state = *state_w;
+  auto iter = state.m_images.find(static_cast<VkImage>(vh_image));
+  ASSERT(iter != state.m_images.end());
+  SparseImage& sparse_image = iter->second;
+  Layout const& layout = sparse_image.m_layout;
+  ASSERT(first_level < last_level && last_level <= layout.m_number_of_levels);
+  sparse_image.m_committed_levels &= ~static_cast<uint32_t>(((uint64_t{1} << (last_level - first_level)) - 1) << first_level);
+
+  auto release_slot = [&](uint32_t slot){
+    Slot& s = sparse_image.m_slots[slot];
+    if (!s.m_vh_allocation || s.m_releasing)
+      return;
+    s.m_releasing = true;
+    s.m_released_frame = state.m_current_frame;
+    s.m_released = released;
+    ++state.m_releasing_slots;
+    state.m_stats.m_releasing_bytes += sparse_image.slot_size(slot);
+  };
+  for (uint32_t level = first_level; level < std::min(last_level, layout.tail_level()); ++level)
+    release_slot(level);
+  // The mip tail is released once none of its levels is committed.
+  uint32_t const tail_levels = static_cast<uint32_t>(((uint64_t{1} << (layout.m_number_of_levels - layout.tail_level())) - 1) << layout.tail_level());
+  if (layout.has_tail() && last_level > layout.tail_level() && !(sparse_image.m_committed_levels & tail_levels))
+    release_slot(layout.tail_level());
+}
+
+std::vector<vk::DeviceSize> SparseMipMemory::residency_level_sizes(vk::Image vh_image) const
+{
+  state_t::crat state_r(m_state);
+  auto iter = state_r->m_images.find(static_cast<VkImage>(vh_image));
+  ASSERT(iter != state_r->m_images.end());
+  return iter->second.m_layout.residency_level_sizes();
+}
+
+SparseMipMemory::Stats SparseMipMemory::stats() const
+{
+  state_t::crat state_r(m_state);
+  return state_r->m_stats;
+}
+
+//static
+void SparseMipMemory::call_released(std::vector<Released>& released)
+{
+  for (Released const& r : released)
+    if (r.m_released)
+      r.m_released(r.m_bytes);
+}
+
+void SparseMipMemory::Stats::print_on(std::ostream& os) const
+{
+  constexpr double MiB = 1024.0 * 1024.0;
+  os << "allocated: " << (m_allocated_bytes / MiB) << " MiB (of which " << (m_releasing_bytes / MiB) << " MiB released), allocations: " <<
+    m_allocations << ", frees: " << m_frees << ", reclaims: " << m_reclaims << ", unbinds: " << m_unbinds << "\n";
+}
+
+} // namespace vulkan::memory
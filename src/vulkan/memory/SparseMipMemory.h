@@ -0,0 +1,185 @@
+#pragma once
+
+#include "threadsafe/aithreadsafe.h"
+#include <vk_mem_alloc.h>
+#include <vulkan/vulkan.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace vulkan::memory {
+
+// SparseMipMemory
+//
+// Gives every mip level of sparse resident images its own memory allocation, so that evicting mip
+// levels (see memory::TextureResidency and Texture::evict) really frees device memory.
+//
+// An image is registered with add(), passing its Layout: the size of the memory of each mip level,
+// rounded up to whole sparse pages, and the size of the mip tail (the coarsest levels that share one
+// allocation). commit() allocates the memory of a range of levels and returns the Bindings that must
+// be made (see task::SparseBind) before those levels are written. release() marks the memory of a
+// range of levels as no longer needed; the mip tail is released once none of its levels is committed
+// anymore. memory::Image does the add() (see MemoryCreateInfo::sparse_mip_memory) and Texture the rest.
+//
+// Released memory might still be sampled by frames that are in flight, so it is kept, and stays
+// bound, until the frame during which it was released retired on the GPU. It is then unbound on the
+// sparse binding queue (Backend::unbind) and freed once that finished. The released callback that was
+// passed to release() is called with the size of the memory once it is freed, or once the memory is
+// committed again before that (it is then reused as-is).
+//
+// The render loop calls begin_frame() at the start of every frame and retire() once a frame finished
+// on the GPU. The other member functions may be called from any thread, but commit() and release() of
+// the same image may not be called concurrently.
+//
+class SparseMipMemory
+{
+ public:
+  using frame_type = uint64_t;
+  using released_callback_type = std::function<void(vk::DeviceSize bytes)>;
+
+  // How the mip levels of an image map to memory.
+  struct Layout
+  {
+    vk::Extent2D m_extent;                      // The extent of mip level 0.
+    uint32_t m_number_of_levels;
+    std::vector<vk::DeviceSize> m_level_sizes;  // The memory size of each level before the mip tail, finest first.
+    vk::DeviceSize m_tail_size;                 // The memory size of the mip tail, or zero if there is none.
+    vk::DeviceSize m_tail_offset;               // The offset of the mip tail in the opaque memory of the image.
+    vk::MemoryRequirements m_requirements;      // The alignment (the page size) and memory types of all allocations (size is unused).
+
+    // The first level of the mip tail, or m_number_of_levels if there is none.
+    uint32_t tail_level() const { return m_level_sizes.size(); }
+    bool has_tail() const { return tail_level() < m_number_of_levels; }
+
+    // The size of each mip level as seen by memory::TextureResidency::add: the mip tail is counted as
+    // part of the coarsest level, which is always the last level to be evicted.
+    std::vector<vk::DeviceSize> residency_level_sizes() const;
+  };
+
+  // Return the layout of an image of extent with number_of_levels levels, of which every page of
+  // requirements.alignment bytes covers granularity texels and that has a mip tail of tail_size bytes
+  // at tail_offset, starting at level tail_level (see vk::SparseImageMemoryRequirements).
+  static Layout layout(vk::Extent2D extent, uint32_t number_of_levels, vk::Extent2D granularity, vk::MemoryRequirements const& requirements,
+      uint32_t tail_level, vk::DeviceSize tail_size, vk::DeviceSize tail_offset);
+
+  // The memory of one mip level, or of the whole mip tail, of an image.
+  // Also used by VirtualTexture to bind a region of a level (SparseMipMemory always binds whole levels).
+  struct Binding
+  {
+    vk::Image m_vh_image;
+    bool m_tail;                                // Set if this is the mip tail.
+    uint32_t m_level;                           // The mip level (if m_tail is not set).
+    vk::Extent2D m_extent;                      // The extent of that mip level, or of the bound region of it (if m_tail is not set).
+    vk::DeviceSize m_offset;                    // The offset of the mip tail in the opaque memory of the image (if m_tail is set).
+    vk::DeviceSize m_size;                      // The size of the memory.
+    VmaAllocation m_vh_allocation;              // The memory to bind, or VK_NULL_HANDLE to unbind.
+    vk::Offset2D m_region_offset{};             // The offset of the region of m_extent texels in that mip level (if m_tail is not set).
+  };
+
+  class Backend
+  {
+   public:
+    virtual ~Backend() = default;
+
+    virtual VmaAllocation allocate_memory(vk::MemoryRequirements const& requirements) = 0;
+    virtual void free_memory(VmaAllocation vh_allocation) = 0;
+    // Make bindings (which all unbind memory) on the sparse binding queue; call done, from any thread, once the GPU executed them.
+    virtual void unbind(std::vector<Binding> bindings, std::function<void()> done) = 0;
+  };
+
+  struct Stats
+  {
+    vk::DeviceSize m_allocated_bytes = 0;       // The size of all memory that is allocated.
+    vk::DeviceSize m_releasing_bytes = 0;       // The part of that which was released, but not freed yet.
+    uint64_t m_allocations = 0;                 // The total number of memory allocations.
+    uint64_t m_frees = 0;                       // The total number of freed memory allocations.
+    uint64_t m_reclaims = 0;                    // The number of released allocations that were committed again before being freed.
+    uint64_t m_unbinds = 0;                     // The number of calls to Backend::unbind.
+
+    void print_on(std::ostream& os) const;
+  };
+
+ private:
+  // The memory of one mip level, or of the mip tail.
+  struct Slot
+  {
+    VmaAllocation m_vh_allocation{};            // VK_NULL_HANDLE if no memory is allocated.
+    bool m_releasing = false;                   // Set if the memory was released, but is still bound.
+    frame_type m_released_frame = 0;            // The frame during which it was released (if m_releasing is set).
+    released_callback_type m_released;          // The callback passed to release() (if m_releasing is set).
+  };
+
+  struct SparseImage
+  {
+    Layout m_layout;
+    std::vector<Slot> m_slots;                  // One per level before the mip tail, plus one for the mip tail (if any).
+    uint32_t m_committed_levels = 0;            // Bit mask of the levels that are committed.
+
+    uint32_t slot(uint32_t level) const { return std::min(level, m_layout.tail_level()); }
+    vk::DeviceSize slot_size(uint32_t slot) const { return slot < m_layout.tail_level() ? m_layout.m_level_sizes[slot] : m_layout.m_tail_size; }
+    // Return the binding of slot to vh_allocation.
+    Binding binding(vk::Image vh_image, uint32_t slot, VmaAllocation vh_allocation) const;
+  };
+
+  // Memory that was freed, or reclaimed: call m_released with m_bytes.
+  struct Released
+  {
+    released_callback_type m_released;
+    vk::DeviceSize m_bytes;
+  };
+
+  struct State
+  {
+    std::unordered_map<VkImage, SparseImage> m_images;
+    size_t m_releasing_slots = 0;               // The number of slots with m_releasing set.
+    size_t m_unbinds_in_flight = 0;             // The number of calls to Backend::unbind whose done wasn't called yet.
+    frame_type m_current_frame = 0;
+    frame_type m_retired_end = 0;               // Every frame before this one retired.
+    Stats m_stats;
+  };
+  using state_t = aithreadsafe::Wrapper<State, aithreadsafe::policy::Primitive<std::mutex>>;
+
+  std::unique_ptr<Backend> m_backend;
+  state_t m_state;
+
+ public:
+  SparseMipMemory(std::unique_ptr<Backend> backend) : m_backend(std::move(backend)) { }
+  // All images must have been removed, and all unbinds finished.
+  ~SparseMipMemory();
+
+  SparseMipMemory(SparseMipMemory const&) = delete;
+  SparseMipMemory& operator=(SparseMipMemory const&) = delete;
+
+  // Memory that is released from now on might be used by frame (frame numbers must increase).
+  void begin_frame(frame_type frame);
+  // Every frame up to and including completed_frame finished on the GPU. Unbinds the memory that was released before.
+  void retire(frame_type completed_frame);
+
+  // Register vh_image, of which nothing is committed.
+  void add(vk::Image vh_image, Layout layout);
+  // Free all memory of vh_image, which is about to be destroyed. The GPU must be done with it.
+  void remove(vk::Image vh_image);
+
+  // Allocate the memory of levels [first_level, last_level) of vh_image that have none and return the bindings
+  // that must be made before those levels are used. Throws if a Backend call throws (nothing is committed then).
+  std::vector<Binding> commit(vk::Image vh_image, uint32_t first_level, uint32_t last_level);
+  // Release the memory of levels [first_level, last_level) of vh_image. Calls released once it was freed (or reclaimed).
+  void release(vk::Image vh_image, uint32_t first_level, uint32_t last_level, released_callback_type released = {});
+
+  // Return Layout::residency_level_sizes of vh_image.
+  std::vector<vk::DeviceSize> residency_level_sizes(vk::Image vh_image) const;
+
+  // Return a copy of the statistics.
+  Stats stats() const;
+
+ private:
+  // Call the callbacks of released memory.
+  static void call_released(std::vector<Released>& released);
+};
+
+} // namespace vulkan::memory
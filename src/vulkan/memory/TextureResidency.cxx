@@ -0,0 +1,399 @@
+#include "sys.h"
+#include "TextureResidency.h"
+#include <algorithm>
+#include <iostream>
+#include <optional>
+#include <queue>
+#include "debug.h"
+
+namespace vulkan::memory {
+
+vk::DeviceSize TextureResidency::TextureState::bytes(uint32_t first, uint32_t last) const
+{
+  vk::DeviceSize sum = 0;
+  for (uint32_t level = first; level < last; ++level)
+    sum += m_level_sizes[level];
+  return sum;
+}
+
+//static
+std::vector<vk::DeviceSize> TextureResidency::mip_level_sizes(vk::Extent2D extent, vk::DeviceSize bytes_per_texel)
+{
+  std::vector<vk::DeviceSize> sizes;
+  for (;;)
+  {
+    sizes.push_back(vk::DeviceSize{extent.width} * extent.height * bytes_per_texel);
+    if (extent.width == 1 && extent.height == 1)
+      break;
+    extent.width = std::max(1U, extent.width / 2);
+    extent.height = std::max(1U, extent.height / 2);
+  }
+  return sizes;
+}
+
+//static
+vk::DeviceSize TextureResidency::texture_budget(vk::DeviceSize heap_budget, vk::DeviceSize heap_usage, vk::DeviceSize resident_bytes, double headroom)
+{
+  vk::DeviceSize const other_usage = heap_usage > resident_bytes ? heap_usage - resident_bytes : 0;
+  vk::DeviceSize const reserved = other_usage + static_cast<vk::DeviceSize>(headroom * heap_budget);
+  return heap_budget > reserved ? heap_budget - reserved : 0;
+}
+
+void TextureResidency::set_budget(vk::DeviceSize budget)
+{
+  state_t::wat state_w(m_state);
+  state_w->m_stats.m_budget = budget;
+}
+
+TextureResidency::texture_id_type TextureResidency::add(std::vector<vk::DeviceSize> level_sizes)
+{
+  // Also print the size of the finest level, to make it easier to find back the texture.
+  DoutEntering(dc::vulkan, "TextureResidency::add(" << level_sizes.size() << " levels, " << (level_sizes.empty() ? 0 : level_sizes[0]) << " bytes)");
+  ASSERT(!level_sizes.empty() && level_sizes.size() <= max_levels);
+  TextureState texture;
+  texture.m_level_sizes = std::move(level_sizes);
+  uint32_t const number_of_levels = texture.number_of_levels();
+  // The mip tail is at least the coarsest level.
+  texture.m_tail_level = number_of_levels - 1;
+  vk::DeviceSize tail_bytes = texture.m_level_sizes[texture.m_tail_level];
+  while (texture.m_tail_level > 0 && tail_bytes + texture.m_level_sizes[texture.m_tail_level - 1] <= s_mip_tail_bytes)
+    tail_bytes += texture.m_level_sizes[--texture.m_tail_level];
+  texture.m_resident_level = texture.m_loading_level = texture.m_desired_level = number_of_levels;
+
+  state_t::wat state_w(m_state);
+  ++state_w->m_stats.m_textures;
+  if (state_w->m_free_ids.empty())
+  {
+    state_w->m_textures.push_back(std::move(texture));
+    return state_w->m_textures.size() - 1;
+  }
+  texture_id_type const id = state_w->m_free_ids.back();
+  state_w->m_free_ids.pop_back();
+  state_w->m_textures[id] = std::move(texture);
+  return id;
+}
+
+void TextureResidency::remove(texture_id_type id)
+{
+  DoutEntering(dc::vulkan, "TextureResidency::remove(" << id << ")");
+  state_t::wat state_w(m_state);
+  State& state = *state_w;
+  ASSERT(id < state.m_textures.size() && !state.m_textures[id].m_level_sizes.empty() && !state.m_textures[id].m_removed);
+  TextureState& texture = state.m_textures[id];
+  uint32_t const number_of_levels = texture.number_of_levels();
+  state.m_stats.m_resident_bytes -= texture.bytes(texture.m_resident_level, number_of_levels);
+  if (texture.m_resident_level < number_of_levels)
+    --state.m_stats.m_resident_textures;
+  --state.m_stats.m_textures;
+  if (texture.is_loading())
+  {
+    // The reserved bytes are released, and the id is reused, when the load finished.
+    texture.m_removed = true;
+    return;
+  }
+  texture.m_level_sizes.clear();
+  state.m_free_ids.push_back(id);
+}
+
+void TextureResidency::use(texture_id_type id, frame_type frame, uint32_t desired_level, float priority)
+{
+  state_t::wat state_w(m_state);
+  ASSERT(id < state_w->m_textures.size() && !state_w->m_textures[id].m_level_sizes.empty());
+  TextureState& texture = state_w->m_textures[id];
+  texture.m_desired_level = std::min(desired_level, texture.number_of_levels() - 1);
+  texture.m_priority = priority;
+  texture.m_last_used = frame;
+  texture.m_used = true;
+}
+
+void TextureResidency::loaded(texture_id_type id, uint32_t level, bool success)
+{
+  state_t::wat state_w(m_state);
+  state_w->m_loaded.push_back({ id, level, success });
+}
+
+void TextureResidency::released(vk::DeviceSize bytes)
+{
+  state_t::wat state_w(m_state);
+  ASSERT(m_deferred_release && bytes <= state_w->m_stats.m_releasing_bytes);
+  state_w->m_stats.m_releasing_bytes -= bytes;
+}
+
+//static
+void TextureResidency::evict(State& state, texture_id_type id, bool deferred_release, std::vector<std::pair<texture_id_type, uint32_t>>& evicted)
+{
+  TextureState& texture = state.m_textures[id];
+  ASSERT(!texture.is_loading() && texture.m_resident_level < texture.number_of_levels());
+  uint32_t const new_resident_level = texture.level_after_eviction();
+  vk::DeviceSize const bytes = texture.bytes(texture.m_resident_level, new_resident_level);
+  for (uint32_t level = texture.m_resident_level; level < new_resident_level; ++level)
+    texture.m_evicted_levels |= 1U << level;
+  state.m_stats.m_resident_bytes -= bytes;
+  if (deferred_release)
+    state.m_stats.m_releasing_bytes += bytes;
+  ++state.m_stats.m_evictions;
+  state.m_stats.m_evicted_bytes += bytes;
+  if (new_resident_level == texture.number_of_levels())
+    --state.m_stats.m_resident_textures;
+  texture.m_resident_level = texture.m_loading_level = new_resident_level;
+  evicted.emplace_back(id, new_resident_level);
+}
+
+namespace {
+
+// The value of the finest resident level of a texture, used to decide what to evict first.
+struct Victim
+{
+  enum Category {
+    excess,             // The level is finer than desired, or the texture isn't used.
+    needed,             // The level is needed to draw the texture.
+    tail                // The mip tail of a texture that is used this frame.
+  };
+
+  Category m_category;
+  double m_key1;        // excess: the last used frame; otherwise the priority.
+  double m_key2;        // excess: the priority; otherwise the last used frame.
+  uint32_t m_id;
+
+  friend bool operator==(Victim const& lhs, Victim const& rhs)
+  {
+    return lhs.m_category == rhs.m_category && lhs.m_key1 == rhs.m_key1 && lhs.m_key2 == rhs.m_key2 && lhs.m_id == rhs.m_id;
+  }
+
+  // Used as comparator of a std::priority_queue; the least valuable victim is on top.
+  friend bool operator>(Victim const& lhs, Victim const& rhs)
+  {
+    if (lhs.m_category != rhs.m_category)
+      return lhs.m_category > rhs.m_category;
+    if (lhs.m_key1 != rhs.m_key1)
+      return lhs.m_key1 > rhs.m_key1;
+    return lhs.m_key2 > rhs.m_key2;
+  }
+};
+
+} // namespace
+
+void TextureResidency::update(frame_type frame)
+{
+  DoutEntering(dc::vulkan|dc::vkframe, "TextureResidency::update(" << frame << ")");
+  std::vector<StreamIn> stream_ins;
+  std::vector<std::pair<texture_id_type, uint32_t>> evicted;
+  {
+    state_t::wat state_w(m_state);
+    State& state = *state_w;
+    Stats& stats = state.m_stats;
+    state.m_frame = frame;
+
+    // Process the loads that finished.
+    for (Loaded const& loaded : state.m_loaded)
+    {
+      TextureState& texture = state.m_textures[loaded.m_id];
+      ASSERT(texture.is_loading() && texture.m_loading_level == loaded.m_level);
+      vk::DeviceSize const bytes = texture.bytes(loaded.m_level, texture.m_resident_level);
+      stats.m_loading_bytes -= bytes;
+      --state.m_loads_in_flight;
+      if (texture.m_removed)
+      {
+        texture = {};
+        state.m_free_ids.push_back(loaded.m_id);
+        continue;
+      }
+      if (!loaded.m_success)
+      {
+        // Nothing changed; the levels are requested again when they are still wanted.
+        texture.m_loading_level = texture.m_resident_level;
+        if (m_deferred_release)
+          stats.m_releasing_bytes += bytes;
+        ++stats.m_failed_loads;
+        continue;
+      }
+      if (texture.m_resident_level == texture.number_of_levels())
+        ++stats.m_resident_textures;
+      texture.m_resident_level = loaded.m_level;
+      stats.m_resident_bytes += bytes;
+    }
+    state.m_loaded.clear();
+
+    // Returns the victim for texture id, if any.
+    auto victim = [&](texture_id_type id) -> std::optional<Victim> {
+      TextureState const& texture = state.m_textures[id];
+      if (texture.m_level_sizes.empty() || texture.m_removed || texture.is_loading() || texture.m_resident_level == texture.number_of_levels())
+        return std::nullopt;
+      bool const used_this_frame = texture.m_used && texture.m_last_used == frame;
+      if (texture.m_resident_level < texture.wanted_level(frame))
+        return Victim{ Victim::excess, static_cast<double>(texture.m_last_used), texture.m_priority, id };
+      return Victim{ used_this_frame && texture.m_resident_level >= texture.m_tail_level ? Victim::tail : Victim::needed,
+        texture.m_priority, static_cast<double>(texture.m_last_used), id };
+    };
+
+    // The victims are only collected when something needs to be evicted.
+    std::priority_queue<Victim, std::vector<Victim>, std::greater<Victim>> victims;
+    bool victims_collected = false;
+    auto collect_victims = [&](){
+      if (victims_collected)
+        return;
+      for (texture_id_type id = 0; id < state.m_textures.size(); ++id)
+        if (auto v = victim(id))
+          victims.push(*v);
+      victims_collected = true;
+    };
+    // Evict the least valuable level for which may_evict returns true; returns false if there is none.
+    auto evict_one = [&](auto const& may_evict) -> bool {
+      collect_victims();
+      while (!victims.empty())
+      {
+        Victim const top = victims.top();
+        // Entries are not removed from the queue when their texture changes; check that this one is still up to date.
+        std::optional<Victim> const current = victim(top.m_id);
+        if (!current || !(*current == top))
+        {
+          victims.pop();
+          if (current)
+            victims.push(*current);
+          continue;
+        }
+        if (!may_evict(top))
+          return false;
+        victims.pop();
+        evict(state, top.m_id, m_deferred_release, evicted);
+        if (auto next = victim(top.m_id))
+          victims.push(*next);
+        return true;
+      }
+      return false;
+    };
+
+    // Restore the budget, if it was lowered. Bytes that are releasing already can't be evicted again.
+    while (stats.m_resident_bytes + stats.m_loading_bytes > stats.m_budget && evict_one([](Victim const&){ return true; }))
+      ;
+
+    // Collect the textures that need a finer level, highest priority first.
+    std::vector<texture_id_type> wanted;
+    for (texture_id_type id = 0; id < state.m_textures.size(); ++id)
+    {
+      TextureState const& texture = state.m_textures[id];
+      if (!texture.m_level_sizes.empty() && !texture.m_removed && !texture.is_loading() &&
+          texture.m_resident_level > texture.wanted_level(frame) &&
+          // A mip tail is loaded as a whole.
+          !(texture.m_resident_level == texture.m_tail_level && texture.m_desired_level >= texture.m_tail_level))
+        wanted.push_back(id);
+    }
+    // Mip tails first: every texture that is drawn should have something resident before any texture gets more detail.
+    std::sort(wanted.begin(), wanted.end(), [&](texture_id_type lhs, texture_id_type rhs){
+      TextureState const& lhs_texture = state.m_textures[lhs];
+      TextureState const& rhs_texture = state.m_textures[rhs];
+      bool const lhs_tail = lhs_texture.m_resident_level == lhs_texture.number_of_levels();
+      bool const rhs_tail = rhs_texture.m_resident_level == rhs_texture.number_of_levels();
+      if (lhs_tail != rhs_tail)
+        return lhs_tail;
+      return lhs_texture.m_priority > rhs_texture.m_priority;
+    });
+
+    // The bytes of the loads that wait until evicted memory is released (deferred_release only).
+    vk::DeviceSize waiting_bytes = 0;
+    for (texture_id_type id : wanted)
+    {
+      if (state.m_loads_in_flight >= m_max_loads_in_flight)
+        break;
+      TextureState& texture = state.m_textures[id];
+      uint32_t const number_of_levels = texture.number_of_levels();
+      bool const nothing_resident = texture.m_resident_level == number_of_levels;
+      uint32_t const level = nothing_resident ? texture.m_tail_level : texture.m_resident_level - 1;
+      vk::DeviceSize const bytes = texture.bytes(level, texture.m_resident_level);
+      auto free_bytes = [&](vk::DeviceSize used) -> vk::DeviceSize {
+        used += waiting_bytes;
+        return used < stats.m_budget ? stats.m_budget - used : 0;
+      };
+      // The room that is left now, and the room that is left once the memory of evicted levels was released.
+      auto free_now = [&](){ return free_bytes(state.used_bytes()); };
+      auto free_eventually = [&](){ return free_bytes(stats.m_resident_bytes + stats.m_loading_bytes); };
+
+      if (free_now() < bytes)
+      {
+        if (free_eventually() < bytes)
+        {
+          // Only evict if that makes enough room: count the bytes that may be evicted for this load first.
+          vk::DeviceSize evictable = 0;
+          for (TextureState const& other : state.m_textures)
+          {
+            if (other.m_level_sizes.empty() || other.m_removed || other.is_loading() || &other == &texture)
+              continue;
+            uint32_t const other_levels = other.number_of_levels();
+            uint32_t const wanted_level = other.wanted_level(frame);
+            uint32_t const keep_level = nothing_resident || other.m_priority < texture.m_priority ?
+                // The mip tail of a texture that is used this frame is kept.
+                (wanted_level < other_levels ? other.m_tail_level : other_levels) :
+                // Only levels finer than needed can be evicted.
+                wanted_level;
+            if (other.m_resident_level < keep_level)
+              evictable += other.bytes(other.m_resident_level, keep_level);
+          }
+          if (free_eventually() + evictable < bytes)
+          {
+            ++stats.m_starved_loads;
+            continue;
+          }
+          float const priority = texture.m_priority;
+          while (free_eventually() < bytes && evict_one([&](Victim const& v){
+                return v.m_category == Victim::excess || (v.m_category == Victim::needed && (nothing_resident || v.m_key1 < priority)); }))
+            ;
+        }
+        if (free_now() < bytes)
+        {
+          ++stats.m_starved_loads;
+          // The texture itself was never a victim, so the evictions made enough room; but be robust against rounding in the
+          // priority comparison.
+          if (free_eventually() < bytes)
+            continue;
+          // With deferred_release the load is requested by a later update, once the evicted memory was released.
+          // Don't let loads of a lower priority take that room in the meantime.
+          waiting_bytes += bytes;
+          continue;
+        }
+      }
+
+      // Request the load.
+      texture.m_loading_level = level;
+      ++state.m_loads_in_flight;
+      stats.m_loading_bytes += bytes;
+      ++stats.m_loads;
+      stats.m_loaded_bytes += bytes;
+      for (uint32_t l = level; l < texture.m_resident_level; ++l)
+        if ((texture.m_evicted_levels & (1U << l)))
+          stats.m_reloaded_bytes += texture.m_level_sizes[l];
+      texture.m_evicted_levels &= ~static_cast<uint32_t>(((uint64_t{1} << (texture.m_resident_level - level)) - 1) << level);
+      stream_ins.push_back({ id, level, texture.m_resident_level - level, bytes,
+          nothing_resident ? UploadPriority::visible_now : UploadPriority::prefetch });
+    }
+  }
+
+  // Call the callbacks. This is done without holding the lock, because they might call loaded() (or any other member function).
+  for (auto [id, resident_level] : evicted)
+    m_evict(id, resident_level);
+  for (StreamIn const& stream_in : stream_ins)
+    m_stream_in(stream_in);
+}
+
+uint32_t TextureResidency::resident_level(texture_id_type id) const
+{
+  state_t::crat state_r(m_state);
+  ASSERT(id < state_r->m_textures.size());
+  return state_r->m_textures[id].m_resident_level;
+}
+
+TextureResidency::Stats TextureResidency::stats() const
+{
+  state_t::crat state_r(m_state);
+  return state_r->m_stats;
+}
+
+void TextureResidency::Stats::print_on(std::ostream& os) const
+{
+  constexpr double MiB = 1024.0 * 1024.0;
+  os << "textures: " << m_resident_textures << " of " << m_textures << " resident, " << (m_resident_bytes / MiB) << " MiB resident + " <<
+    (m_loading_bytes / MiB) << " MiB loading + " << (m_releasing_bytes / MiB) << " MiB releasing of a budget of " << (m_budget / MiB) << " MiB\n";
+  os << "  loads: " << m_loads << " (" << (m_loaded_bytes / MiB) << " MiB, of which " << (m_reloaded_bytes / MiB) << " MiB reloaded), evictions: " <<
+    m_evictions << " (" << (m_evicted_bytes / MiB) << " MiB), starved loads: " << m_starved_loads << ", failed loads: " << m_failed_loads << "\n";
+}
+
+} // namespace vulkan::memory
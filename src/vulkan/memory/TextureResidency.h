@@ -0,0 +1,183 @@
+#pragma once
+
+#include "queues/UploadScheduler.h"
+#include "threadsafe/aithreadsafe.h"
+#include <vulkan/vulkan.hpp>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <mutex>
+#include <vector>
+
+namespace vulkan::memory {
+
+// TextureResidency
+//
+// Decides which textures, and which mip levels of them, are resident in device memory while keeping
+// the total size under a budget.
+//
+// Every texture is registered with add(), passing the sizes of its mip levels (see mip_level_sizes).
+// Textures are always resident from some level down to the coarsest level: the resident level is the
+// finest mip level that is resident, or number_of_levels if nothing is resident. The coarsest levels
+// that together are at most s_mip_tail_bytes (the mip tail) are loaded and evicted as a whole.
+//
+// Each frame the render loop calls use() for every texture that it draws, passing the finest mip level
+// that it would sample and a screen-space priority (for example, the projected area), and then update().
+// update() then
+// - requests loads (via the stream_in callback) for textures that are used but whose resident level is
+//   coarser than desired: first the mip tails of textures of which nothing is resident, then one level at
+//   a time, highest priority first; at most m_max_loads_in_flight at once;
+// - makes room for those loads by evicting the finest resident level of the least valuable textures
+//   (via the evict callback), in this order:
+//     1. levels that are finer than desired, and textures that are not used (least recently used first);
+//     2. levels that are needed by textures with a lower priority than the texture that is being loaded
+//        (any priority when loading a mip tail).
+//   The mip tail of a texture that was used this frame is never evicted to make room for another load;
+// - evicts until the budget holds again if the budget was lowered (see set_budget).
+//
+// The bytes of a load are reserved when it is requested, so that resident plus loading bytes never
+// exceed the budget (except temporarily after lowering the budget). Call loaded() once a load finished;
+// that may be done from any thread. A load that failed is passed to loaded() too (with success false): its
+// bytes are released and the levels are requested again by a later update().
+//
+// If the memory of evicted levels is only freed some time after the evict callback (see SparseMipMemory),
+// construct the manager with deferred_release set: the bytes of evicted levels, and of failed loads, then
+// keep counting against the budget (as releasing bytes) until released() is called for them.
+//
+class TextureResidency
+{
+ public:
+  using texture_id_type = uint32_t;
+  using frame_type = uint64_t;
+
+  static constexpr uint32_t max_levels = 32;
+  static constexpr vk::DeviceSize s_mip_tail_bytes = 64 * 1024;
+
+  // Passed to the stream_in callback: load levels [m_level, m_level + m_count) of texture m_id.
+  struct StreamIn
+  {
+    texture_id_type m_id;
+    uint32_t m_level;                           // The new resident level, once the load finished.
+    uint32_t m_count;                           // The number of levels to load.
+    vk::DeviceSize m_bytes;                     // The total size of those levels.
+    UploadPriority m_priority;                  // visible_now if nothing of the texture is resident yet, prefetch otherwise.
+  };
+
+  using stream_in_callback_type = std::function<void(StreamIn const&)>;
+  // Called with the new resident level after the finer levels were evicted (number_of_levels if nothing is resident anymore).
+  using evict_callback_type = std::function<void(texture_id_type id, uint32_t resident_level)>;
+
+  struct Stats
+  {
+    vk::DeviceSize m_budget = 0;
+    vk::DeviceSize m_resident_bytes = 0;        // The total size of all resident levels.
+    vk::DeviceSize m_loading_bytes = 0;         // The total size of the loads that are in flight.
+    vk::DeviceSize m_releasing_bytes = 0;       // The total size of evicted levels whose memory wasn't released yet (deferred_release only).
+    size_t m_textures = 0;                      // The number of registered textures.
+    size_t m_resident_textures = 0;             // The number of textures of which at least the mip tail is resident.
+    uint64_t m_loads = 0;                       // The total number of loads that were requested.
+    uint64_t m_loaded_bytes = 0;                // The total size of those loads.
+    uint64_t m_reloaded_bytes = 0;              // The part of m_loaded_bytes of levels that were evicted before (the churn).
+    uint64_t m_evictions = 0;                   // The total number of evicted levels (a mip tail counts as one).
+    uint64_t m_evicted_bytes = 0;               // The total size of those levels.
+    uint64_t m_starved_loads = 0;               // The number of times that a load could not be requested because there was no room.
+    uint64_t m_failed_loads = 0;                // The number of loads that were passed to loaded() with success false.
+
+    void print_on(std::ostream& os) const;
+  };
+
+ private:
+  struct TextureState
+  {
+    std::vector<vk::DeviceSize> m_level_sizes;  // The size of each mip level, finest first.
+    uint32_t m_tail_level;                      // The finest level of the mip tail.
+    uint32_t m_resident_level;                  // The finest resident level; number_of_levels() if nothing is resident.
+    uint32_t m_loading_level;                   // The level that is being loaded, or m_resident_level if no load is in flight.
+    uint32_t m_desired_level;                   // The level passed to the last call of use().
+    uint32_t m_evicted_levels = 0;              // Bit mask of the levels that were evicted and not reloaded since.
+    frame_type m_last_used = 0;
+    float m_priority = 0.0f;                    // The priority passed to the last call of use().
+    bool m_used = false;                        // Set if use() was called at least once.
+    bool m_removed = false;                     // Set if remove() was called while a load was in flight.
+
+    uint32_t number_of_levels() const { return m_level_sizes.size(); }
+    bool is_loading() const { return m_loading_level != m_resident_level; }
+    // The bytes of levels [first, last).
+    vk::DeviceSize bytes(uint32_t first, uint32_t last) const;
+    // The level that must be resident: the desired level if the texture was used this frame, otherwise nothing.
+    uint32_t wanted_level(frame_type frame) const { return m_used && m_last_used == frame ? m_desired_level : number_of_levels(); }
+    // The resident level after evicting the finest resident level (the whole mip tail if only that is resident).
+    uint32_t level_after_eviction() const { return m_resident_level >= m_tail_level ? number_of_levels() : m_resident_level + 1; }
+  };
+
+  struct Loaded
+  {
+    texture_id_type m_id;
+    uint32_t m_level;
+    bool m_success;
+  };
+
+  struct State
+  {
+    std::vector<TextureState> m_textures;
+    std::vector<texture_id_type> m_free_ids;
+    std::vector<Loaded> m_loaded;               // Loads that finished, processed by the next update().
+    size_t m_loads_in_flight = 0;
+    frame_type m_frame = 0;
+    Stats m_stats;
+
+    // The bytes that count against the budget.
+    vk::DeviceSize used_bytes() const { return m_stats.m_resident_bytes + m_stats.m_loading_bytes + m_stats.m_releasing_bytes; }
+  };
+
+  using state_t = aithreadsafe::Wrapper<State, aithreadsafe::policy::Primitive<std::mutex>>;
+  mutable state_t m_state;
+
+  stream_in_callback_type m_stream_in;
+  evict_callback_type m_evict;
+  size_t m_max_loads_in_flight;
+  bool m_deferred_release;
+
+ public:
+  TextureResidency(stream_in_callback_type stream_in, evict_callback_type evict, size_t max_loads_in_flight = 64, bool deferred_release = false) :
+    m_stream_in(std::move(stream_in)), m_evict(std::move(evict)), m_max_loads_in_flight(max_loads_in_flight), m_deferred_release(deferred_release) { }
+
+  // The sizes of the mip levels of a texture with a full mip chain, with bytes_per_texel bytes per texel.
+  static std::vector<vk::DeviceSize> mip_level_sizes(vk::Extent2D extent, vk::DeviceSize bytes_per_texel);
+
+  // The part of the device local heap budget that can be used by the textures of this manager: whatever
+  // isn't used by other allocations, minus a fraction headroom of the budget. heap_budget and heap_usage are
+  // the values of LogicalDevice::device_local_memory_budget(); heap_usage includes resident_bytes, the size of
+  // the textures of this manager (with deferred_release, that includes the loading and releasing bytes).
+  static vk::DeviceSize texture_budget(vk::DeviceSize heap_budget, vk::DeviceSize heap_usage, vk::DeviceSize resident_bytes, double headroom = 0.1);
+
+  // Thread-safe. Change the budget; the next update() evicts as much as needed.
+  void set_budget(vk::DeviceSize budget);
+
+  // Thread-safe. Register a texture of which nothing is resident.
+  texture_id_type add(std::vector<vk::DeviceSize> level_sizes);
+  // Thread-safe. Forget about texture id. The caller is responsible for releasing its memory; no callbacks are called.
+  void remove(texture_id_type id);
+
+  // Thread-safe. Texture id is drawn in frame, sampling at most mip level desired_level.
+  void use(texture_id_type id, frame_type frame, uint32_t desired_level, float priority);
+
+  // Thread-safe. The load that was requested with StreamIn::m_level == level finished (or failed, if success is false).
+  void loaded(texture_id_type id, uint32_t level, bool success = true);
+
+  // Thread-safe. The memory of bytes of evicted levels, or of failed loads, was released (deferred_release only).
+  void released(vk::DeviceSize bytes);
+
+  // Process finished loads, evict and request new loads. Calls the callbacks (without holding a lock).
+  void update(frame_type frame);
+
+  // Thread-safe accessors.
+  uint32_t resident_level(texture_id_type id) const;
+  Stats stats() const;
+
+ private:
+  // Evict the finest resident level of texture id.
+  static void evict(State& state, texture_id_type id, bool deferred_release, std::vector<std::pair<texture_id_type, uint32_t>>& evicted);
+};
+
+} // namespace vulkan::memory
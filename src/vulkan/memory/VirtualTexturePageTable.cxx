@@ -0,0 +1,425 @@
+#include "sys.h"
+#include "VirtualTexturePageTable.h"
+#include <algorithm>
+#include <iostream>
+#include "debug.h"
+
+namespace vulkan::memory {
+
+void VirtualTexturePageTable::PageId::print_on(std::ostream& os) const
+{
+  os << "{level:" << m_level << ", x:" << m_x << ", y:" << m_y << '}';
+}
+
+void VirtualTexturePageTable::Level::mark_dirty(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1)
+{
+  if (m_dirty_x0 >= m_dirty_x1)
+  {
+    m_dirty_x0 = x0;
+    m_dirty_y0 = y0;
+    m_dirty_x1 = x1;
+    m_dirty_y1 = y1;
+    return;
+  }
+  m_dirty_x0 = std::min(m_dirty_x0, x0);
+  m_dirty_y0 = std::min(m_dirty_y0, y0);
+  m_dirty_x1 = std::max(m_dirty_x1, x1);
+  m_dirty_y1 = std::max(m_dirty_y1, y1);
+}
+
+VirtualTexturePageTable::VirtualTexturePageTable(vk::Extent2D extent, uint32_t number_of_slots,
+    load_callback_type load, evict_callback_type evict, size_t max_loads_in_flight) :
+  m_load(std::move(load)), m_evict(std::move(evict)), m_max_loads_in_flight(max_loads_in_flight)
+{
+  DoutEntering(dc::vulkan, "VirtualTexturePageTable::VirtualTexturePageTable(" << extent << ", " << number_of_slots << ", load, evict, " <<
+      max_loads_in_flight << ") [" << this << "]");
+  ASSERT(extent.width > 0 && extent.height > 0 && extent.width <= max_pages_per_axis && extent.height <= max_pages_per_axis);
+
+  state_t::wat state_w(m_state);
+  State& state = *state_w;
+  for (;;)
+  {
+    Level level;
+    level.m_extent = extent;
+    state.m_levels.push_back(std::move(level));
+    if (extent.width == 1 && extent.height == 1)
+      break;
+    extent.width = (extent.width + 1) / 2;
+    extent.height = (extent.height + 1) / 2;
+  }
+  m_level_count = state.m_levels.size();
+  ASSERT(m_level_count <= max_levels);
+  for (Level& level : state.m_levels)
+  {
+    size_t const number_of_pages = size_t{level.m_extent.width} * level.m_extent.height;
+    level.m_pages.resize(number_of_pages);
+    level.m_entries.assign(number_of_pages, Entry{ no_slot, m_level_count });
+    // The first indirection update initializes the whole table.
+    level.mark_dirty(0, 0, level.m_extent.width, level.m_extent.height);
+  }
+
+  // The pages of the coarsest level are loaded first, and stay resident.
+  uint32_t const coarsest_level = m_level_count - 1;
+  Level& coarsest = state.m_levels[coarsest_level];
+  ASSERT(number_of_slots > coarsest.m_pages.size());
+  for (uint32_t y = 0; y < coarsest.m_extent.height; ++y)
+    for (uint32_t x = 0; x < coarsest.m_extent.width; ++x)
+    {
+      coarsest.m_pages[coarsest.index(x, y)].m_requested = true;
+      state.m_requests.push_back({ coarsest_level, x, y });
+    }
+
+  state.m_slots.resize(number_of_slots);
+  // Hand out the lowest slots first.
+  for (slot_type slot = number_of_slots; slot > 0; --slot)
+    state.m_free_slots.push_back(slot - 1);
+  state.m_stats.m_slots = number_of_slots;
+}
+
+bool VirtualTexturePageTable::is_valid(PageId page) const
+{
+  if (page.m_level >= m_level_count)
+    return false;
+  // The extent of each level is a function of m_level_count and the extent of level 0 only, which never change.
+  state_t::crat state_r(m_state);
+  vk::Extent2D const extent = state_r->m_levels[page.m_level].m_extent;
+  return page.m_x < extent.width && page.m_y < extent.height;
+}
+
+//static
+void VirtualTexturePageTable::use(State& state, PageId page)
+{
+  uint32_t const level_count = state.m_levels.size();
+  for (;;)
+  {
+    Level& level = state.m_levels[page.m_level];
+    PageState& page_state = level.m_pages[level.index(page.m_x, page.m_y)];
+    // If the page was already used in this frame, then so were its ancestors.
+    if (page_state.m_used && page_state.m_last_used == state.m_frame)
+      break;
+    page_state.m_used = true;
+    page_state.m_last_used = state.m_frame;
+    if (page_state.is_resident())
+    {
+      Slot& slot = state.m_slots[page_state.m_slot];
+      if (slot.m_in_lru)
+        state.m_lru.splice(state.m_lru.end(), state.m_lru, slot.m_lru);
+    }
+    else if (!page_state.m_loading && !page_state.m_requested)
+    {
+      page_state.m_requested = true;
+      state.m_requests.push_back(page);
+    }
+    if (page.m_level + 1 == level_count)
+      break;
+    page = page.parent();
+  }
+}
+
+void VirtualTexturePageTable::process_feedback(frame_type frame, std::span<uint32_t const> feedback)
+{
+  state_t::wat state_w(m_state);
+  State& state = *state_w;
+  // Feedback of an older frame doesn't make pages less recently used.
+  state.m_frame = std::max(state.m_frame, frame);
+  for (uint32_t value : feedback)
+  {
+    if (value == no_feedback)
+      continue;
+    ++state.m_stats.m_feedback_entries;
+    PageId const page = decode(value);
+    if (page.m_level >= m_level_count ||
+        page.m_x >= state.m_levels[page.m_level].m_extent.width || page.m_y >= state.m_levels[page.m_level].m_extent.height)
+    {
+      ++state.m_stats.m_invalid_feedback;
+      continue;
+    }
+    use(state, page);
+  }
+}
+
+void VirtualTexturePageTable::use(PageId page, frame_type frame)
+{
+  ASSERT(is_valid(page));
+  state_t::wat state_w(m_state);
+  state_w->m_frame = std::max(state_w->m_frame, frame);
+  use(*state_w, page);
+}
+
+void VirtualTexturePageTable::loaded(PageId page, bool success)
+{
+  state_t::wat state_w(m_state);
+  state_w->m_loaded.emplace_back(page, success);
+}
+
+//static
+void VirtualTexturePageTable::map(State& state, PageId page, slot_type slot)
+{
+  // Every page in the subtree of page whose finest resident ancestor is coarser than page now resolves to page.
+  Entry const mapped{ slot, page.m_level };
+  for (uint32_t l = page.m_level + 1; l-- > 0;)
+  {
+    Level& level = state.m_levels[l];
+    uint32_t const shift = page.m_level - l;
+    uint32_t const x0 = page.m_x << shift;
+    uint32_t const y0 = page.m_y << shift;
+    uint32_t const x1 = std::min(x0 + (1U << shift), level.m_extent.width);
+    uint32_t const y1 = std::min(y0 + (1U << shift), level.m_extent.height);
+    bool changed = false;
+    for (uint32_t y = y0; y < y1; ++y)
+      for (uint32_t x = x0; x < x1; ++x)
+      {
+        Entry& entry = level.m_entries[level.index(x, y)];
+        if (entry.m_level > page.m_level)
+        {
+          entry = mapped;
+          changed = true;
+        }
+      }
+    // If nothing changed on this level, then all finer pages of the subtree resolve to a finer page already.
+    if (!changed)
+      break;
+    level.mark_dirty(x0, y0, x1, y1);
+  }
+}
+
+//static
+void VirtualTexturePageTable::unmap(State& state, PageId page, slot_type slot)
+{
+  // Every page that resolved to page now resolves to whatever the parent of page resolves to.
+  uint32_t const level_count = state.m_levels.size();
+  Entry const mapped{ slot, page.m_level };
+  Entry replacement{ no_slot, level_count };
+  if (page.m_level + 1 < level_count)
+  {
+    PageId const parent = page.parent();
+    Level const& parent_level = state.m_levels[parent.m_level];
+    replacement = parent_level.m_entries[parent_level.index(parent.m_x, parent.m_y)];
+  }
+  for (uint32_t l = page.m_level + 1; l-- > 0;)
+  {
+    Level& level = state.m_levels[l];
+    uint32_t const shift = page.m_level - l;
+    uint32_t const x0 = page.m_x << shift;
+    uint32_t const y0 = page.m_y << shift;
+    uint32_t const x1 = std::min(x0 + (1U << shift), level.m_extent.width);
+    uint32_t const y1 = std::min(y0 + (1U << shift), level.m_extent.height);
+    bool changed = false;
+    for (uint32_t y = y0; y < y1; ++y)
+      for (uint32_t x = x0; x < x1; ++x)
+      {
+        Entry& entry = level.m_entries[level.index(x, y)];
+        if (entry == mapped)
+        {
+          entry = replacement;
+          changed = true;
+        }
+      }
+    if (!changed)
+      break;
+    level.mark_dirty(x0, y0, x1, y1);
+  }
+}
+
+void VirtualTexturePageTable::retire(frame_type frame)
+{
+  state_t::wat state_w(m_state);
+  State& state = *state_w;
+  while (!state.m_quarantine.empty() && state.m_quarantine.front().first <= frame)
+  {
+    state.m_free_slots.push_back(state.m_quarantine.front().second);
+    state.m_quarantine.pop_front();
+    --state.m_stats.m_quarantined_slots;
+  }
+}
+
+void VirtualTexturePageTable::update(frame_type frame)
+{
+  DoutEntering(dc::vulkan|dc::vkframe, "VirtualTexturePageTable::update(" << frame << ") [" << this << "]");
+  std::vector<Load> loads;
+  std::vector<std::pair<PageId, slot_type>> evicted;
+  {
+    state_t::wat state_w(m_state);
+    State& state = *state_w;
+    Stats& stats = state.m_stats;
+    uint32_t const coarsest_level = m_level_count - 1;
+
+    auto page_state = [&](PageId page) -> PageState& {
+      Level& level = state.m_levels[page.m_level];
+      return level.m_pages[level.index(page.m_x, page.m_y)];
+    };
+
+    // Process the loads that finished.
+    for (auto [page, success] : state.m_loaded)
+    {
+      PageState& loaded_page = page_state(page);
+      ASSERT(loaded_page.m_loading);
+      loaded_page.m_loading = false;
+      --stats.m_loading_pages;
+      if (!success)
+      {
+        Dout(dc::warning, "Failed to load virtual texture page " << page << ".");
+        ++stats.m_failed_loads;
+        state.m_free_slots.push_back(loaded_page.m_slot);
+        loaded_page.m_slot = no_slot;
+        // The pages of the coarsest level are retried; other pages are requested again by the feedback.
+        if (page.m_level == coarsest_level)
+        {
+          loaded_page.m_requested = true;
+          state.m_requests.push_back(page);
+        }
+        continue;
+      }
+      ++stats.m_resident_pages;
+      if (page.m_level != coarsest_level)
+      {
+        Slot& slot = state.m_slots[loaded_page.m_slot];
+        slot.m_lru = state.m_lru.insert(state.m_lru.end(), loaded_page.m_slot);
+        slot.m_in_lru = true;
+      }
+      map(state, page, loaded_page.m_slot);
+    }
+    state.m_loaded.clear();
+
+    // Coarse pages first: they are the fallback of all finer pages.
+    std::vector<PageId> requests;
+    requests.swap(state.m_requests);
+    std::stable_sort(requests.begin(), requests.end(), [](PageId const& lhs, PageId const& rhs){ return lhs.m_level > rhs.m_level; });
+
+    ASSERT(state.m_quarantine.empty() || state.m_quarantine.back().first <= frame);
+    // The number of quarantined slots that no request is waiting for yet.
+    size_t unclaimed_quarantined_slots = state.m_quarantine.size();
+
+    for (PageId const& page : requests)
+    {
+      PageState& requested_page = page_state(page);
+      requested_page.m_requested = false;
+      bool const in_use = requested_page.m_used && requested_page.m_last_used == state.m_frame;
+      // Requests that were kept from before the most recent feedback are superseded by it.
+      if (!in_use && page.m_level != coarsest_level)
+        continue;
+      slot_type slot = no_slot;
+      if (stats.m_loading_pages < m_max_loads_in_flight)
+      {
+        bool waiting = false;
+        if (!state.m_free_slots.empty())
+        {
+          slot = state.m_free_slots.back();
+          state.m_free_slots.pop_back();
+        }
+        else if (unclaimed_quarantined_slots > 0)
+        {
+          // Wait for a slot that will be free soon, instead of evicting yet another page.
+          --unclaimed_quarantined_slots;
+          waiting = true;
+        }
+        else if (!state.m_lru.empty())
+        {
+          slot_type const victim = state.m_lru.front();
+          Slot& victim_slot = state.m_slots[victim];
+          PageState& victim_page = page_state(victim_slot.m_page);
+          // Pages that are in use must stay; since the list is ordered, so must all other pages in the list.
+          if (!(victim_page.m_used && victim_page.m_last_used == state.m_frame))
+          {
+            state.m_lru.pop_front();
+            victim_slot.m_in_lru = false;
+            unmap(state, victim_slot.m_page, victim);
+            victim_page.m_slot = no_slot;
+            --stats.m_resident_pages;
+            ++stats.m_evictions;
+            evicted.emplace_back(victim_slot.m_page, victim);
+            // Frames before frame might still sample the slot through the old indirection entries.
+            state.m_quarantine.emplace_back(frame, victim);
+            ++stats.m_quarantined_slots;
+            waiting = true;
+          }
+        }
+        if (slot == no_slot && !waiting)
+          ++stats.m_starved_loads;
+      }
+      if (slot == no_slot)
+      {
+        // Keep the request until the next feedback tells whether the page is still needed, or a quarantined slot is free.
+        requested_page.m_requested = true;
+        state.m_requests.push_back(page);
+        continue;
+      }
+
+      // Request the load.
+      requested_page.m_slot = slot;
+      requested_page.m_loading = true;
+      state.m_slots[slot].m_page = page;
+      ++stats.m_loading_pages;
+      ++stats.m_loads;
+      loads.push_back({ page, slot });
+    }
+  }
+
+  // Call the callbacks. This is done without holding the lock, because they might call loaded() (or any other member function).
+  for (auto [page, slot] : evicted)
+    m_evict(page, slot);
+  for (Load const& load : loads)
+    m_load(load);
+}
+
+std::vector<VirtualTexturePageTable::IndirectionUpdate> VirtualTexturePageTable::take_indirection_updates()
+{
+  std::vector<IndirectionUpdate> updates;
+  state_t::wat state_w(m_state);
+  for (uint32_t l = 0; l < m_level_count; ++l)
+  {
+    Level& level = state_w->m_levels[l];
+    if (level.m_dirty_x0 >= level.m_dirty_x1)
+      continue;
+    IndirectionUpdate update{ l, vk::Rect2D{
+        vk::Offset2D{ static_cast<int32_t>(level.m_dirty_x0), static_cast<int32_t>(level.m_dirty_y0) },
+        vk::Extent2D{ level.m_dirty_x1 - level.m_dirty_x0, level.m_dirty_y1 - level.m_dirty_y0 } }, {} };
+    update.m_entries.reserve(size_t{update.m_rect.extent.width} * update.m_rect.extent.height);
+    for (uint32_t y = level.m_dirty_y0; y < level.m_dirty_y1; ++y)
+    {
+      auto const row = level.m_entries.begin() + level.index(level.m_dirty_x0, y);
+      update.m_entries.insert(update.m_entries.end(), row, row + update.m_rect.extent.width);
+    }
+    updates.push_back(std::move(update));
+    level.m_dirty_x0 = level.m_dirty_x1 = 0;
+  }
+  return updates;
+}
+
+void VirtualTexturePageTable::mark_all_dirty()
+{
+  state_t::wat state_w(m_state);
+  for (Level& level : state_w->m_levels)
+    level.mark_dirty(0, 0, level.m_extent.width, level.m_extent.height);
+}
+
+vk::Extent2D VirtualTexturePageTable::level_extent(uint32_t level) const
+{
+  ASSERT(level < m_level_count);
+  state_t::crat state_r(m_state);
+  return state_r->m_levels[level].m_extent;
+}
+
+VirtualTexturePageTable::Entry VirtualTexturePageTable::entry(PageId page) const
+{
+  ASSERT(is_valid(page));
+  state_t::crat state_r(m_state);
+  Level const& level = state_r->m_levels[page.m_level];
+  return level.m_entries[level.index(page.m_x, page.m_y)];
+}
+
+VirtualTexturePageTable::Stats VirtualTexturePageTable::stats() const
+{
+  state_t::crat state_r(m_state);
+  return state_r->m_stats;
+}
+
+void VirtualTexturePageTable::Stats::print_on(std::ostream& os) const
+{
+  os << "pages: " << m_resident_pages << " resident + " << m_loading_pages << " loading in " << m_slots << " slots (" <<
+    m_quarantined_slots << " quarantined)\n";
+  os << "  feedback entries: " << m_feedback_entries << " (" << m_invalid_feedback << " invalid), loads: " << m_loads << " (" <<
+    m_failed_loads << " failed), evictions: " << m_evictions << ", starved loads: " << m_starved_loads << "\n";
+}
+
+} // namespace vulkan::memory
@@ -0,0 +1,215 @@
+#pragma once
+
+#include "threadsafe/aithreadsafe.h"
+#include <vulkan/vulkan.hpp>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iosfwd>
+#include <list>
+#include <mutex>
+#include <span>
+#include <vector>
+
+namespace vulkan::memory {
+
+// VirtualTexturePageTable
+//
+// Decides which pages of a virtual texture are resident in a fixed number of physical page slots.
+//
+// A virtual texture is divided into square pages; level 0 consists of extent pages, and each coarser
+// level has half the number of pages in each direction (rounded up), down to a level of a single page.
+// The page (l, x, y) covers the pages (l-1, 2x..2x+1, 2y..2y+1) of the next finer level.
+//
+// Each frame the renderer writes the pages that it would sample into a feedback buffer (see encode()),
+// and passes its contents to process_feedback(). Every requested page, and all of its coarser
+// ancestors, are marked as used in that frame. Then update()
+// - requests loads (via the load callback) of the requested pages that are not resident, coarsest
+//   level first, at most m_max_loads_in_flight at once;
+// - finds a slot for each load: a free slot, or else it evicts the least recently used page (calling
+//   the evict callback). Pages that were used in the most recent frame that feedback was processed
+//   for are never evicted; if no slot is available the load is counted as starved.
+//   The pages of the coarsest level are loaded first and never evicted, so that every page always
+//   has a resident ancestor once those are loaded.
+//
+// The slot of an evicted page is not reused right away: frames that were recorded before the eviction
+// was uploaded to the indirection texture might still sample it. update() is passed the frame whose
+// command buffer uploads the resulting indirection updates, and the slots that it evicted stay in
+// quarantine until retire() is called with that frame (or a later one); the requests that wait for
+// them are kept until then.
+//
+// Call loaded() once a load finished; that may be done from any thread. The page is mapped by the next update().
+//
+// The page table contains, for every page of every level, the entry of its finest resident ancestor
+// (which might be the page itself): the slot and the level of that page. This is what is uploaded to
+// the indirection texture; take_indirection_updates() returns the parts that changed.
+//
+class VirtualTexturePageTable
+{
+ public:
+  using frame_type = uint64_t;
+  using slot_type = uint32_t;
+
+  static constexpr slot_type no_slot = 0xffffffff;
+  static constexpr uint32_t max_levels = 15;
+  static constexpr uint32_t max_pages_per_axis = 1 << 14;
+  static constexpr uint32_t no_feedback = 0xffffffff;       // The value that the feedback buffer must be cleared with.
+
+  struct PageId
+  {
+    uint32_t m_level;
+    uint32_t m_x;
+    uint32_t m_y;
+
+    PageId parent() const { return { m_level + 1, m_x >> 1, m_y >> 1 }; }
+
+    friend bool operator==(PageId const& lhs, PageId const& rhs) = default;
+    void print_on(std::ostream& os) const;
+  };
+
+  // The value that the feedback pass writes for page: four bits level, and fourteen bits y and x.
+  static uint32_t encode(PageId page) { return page.m_level << 28 | page.m_y << 14 | page.m_x; }
+  static PageId decode(uint32_t feedback) { return { feedback >> 28, feedback & 0x3fff, (feedback >> 14) & 0x3fff }; }
+
+  // An entry of the page table.
+  struct Entry
+  {
+    slot_type m_slot;                           // The slot that contains the page, or no_slot if nothing is resident.
+    uint32_t m_level;                           // The level of that page, or level_count() if nothing is resident.
+
+    friend bool operator==(Entry const& lhs, Entry const& rhs) = default;
+  };
+
+  // A rectangle of the page table of level m_level that changed, with its new entries (row by row).
+  struct IndirectionUpdate
+  {
+    uint32_t m_level;
+    vk::Rect2D m_rect;
+    std::vector<Entry> m_entries;
+  };
+
+  // Passed to the load callback: load the texels of m_page into slot m_slot.
+  struct Load
+  {
+    PageId m_page;
+    slot_type m_slot;
+  };
+
+  using load_callback_type = std::function<void(Load const&)>;
+  // Called after page was removed from the page table; slot is reused for a different page once it left quarantine.
+  using evict_callback_type = std::function<void(PageId page, slot_type slot)>;
+
+  struct Stats
+  {
+    size_t m_slots = 0;
+    size_t m_resident_pages = 0;
+    size_t m_loading_pages = 0;
+    size_t m_quarantined_slots = 0;             // Slots of evicted pages that wait for retire().
+    uint64_t m_feedback_entries = 0;            // The total number of feedback values processed.
+    uint64_t m_invalid_feedback = 0;            // The part of those that didn't encode a page of this texture.
+    uint64_t m_loads = 0;                       // The total number of loads that were requested.
+    uint64_t m_failed_loads = 0;
+    uint64_t m_evictions = 0;
+    uint64_t m_starved_loads = 0;               // The number of times that no slot could be found for a requested page.
+
+    void print_on(std::ostream& os) const;
+  };
+
+ private:
+  struct PageState
+  {
+    slot_type m_slot = no_slot;                 // The slot that is (being) loaded with this page.
+    frame_type m_last_used = 0;
+    bool m_used = false;                        // Set if the page was used at least once.
+    bool m_loading = false;                     // Set while a load is in flight.
+    bool m_requested = false;                   // Set while the page is in State::m_requests.
+
+    bool is_resident() const { return m_slot != no_slot && !m_loading; }
+  };
+
+  struct Level
+  {
+    vk::Extent2D m_extent;                      // In pages.
+    std::vector<PageState> m_pages;
+    std::vector<Entry> m_entries;
+    // The rectangle [m_dirty_x0, m_dirty_x1) x [m_dirty_y0, m_dirty_y1) of m_entries that changed since the last take_indirection_updates().
+    uint32_t m_dirty_x0 = 0;
+    uint32_t m_dirty_y0 = 0;
+    uint32_t m_dirty_x1 = 0;
+    uint32_t m_dirty_y1 = 0;
+
+    size_t index(uint32_t x, uint32_t y) const { return size_t{y} * m_extent.width + x; }
+    void mark_dirty(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1);
+  };
+
+  struct Slot
+  {
+    PageId m_page;
+    std::list<slot_type>::iterator m_lru;       // Only valid if m_in_lru.
+    bool m_in_lru = false;                      // Resident pages of the coarsest level are not in the LRU list.
+  };
+
+  struct State
+  {
+    std::vector<Level> m_levels;
+    std::vector<Slot> m_slots;
+    std::vector<slot_type> m_free_slots;
+    std::deque<std::pair<frame_type, slot_type>> m_quarantine;  // Evicted slots and the frame that must retire before they are free, oldest first.
+    std::list<slot_type> m_lru;                 // The slots of the evictable resident pages, least recently used first.
+    std::vector<PageId> m_requests;             // Pages that were used since the last update() and are not resident.
+    std::vector<std::pair<PageId, bool>> m_loaded;      // Loads that finished, processed by the next update().
+    frame_type m_frame = 0;
+    Stats m_stats;
+  };
+
+  using state_t = aithreadsafe::Wrapper<State, aithreadsafe::policy::Primitive<std::mutex>>;
+  mutable state_t m_state;
+
+  uint32_t m_level_count;
+  load_callback_type m_load;
+  evict_callback_type m_evict;
+  size_t m_max_loads_in_flight;
+
+ public:
+  // A virtual texture of extent pages at level 0, with number_of_slots physical page slots.
+  // number_of_slots must be larger than the number of pages of the coarsest level.
+  VirtualTexturePageTable(vk::Extent2D extent, uint32_t number_of_slots, load_callback_type load, evict_callback_type evict,
+      size_t max_loads_in_flight = 32);
+
+  // Thread-safe. Mark the pages encoded in feedback (see encode()) as used in frame. Values that don't encode a valid page are ignored.
+  void process_feedback(frame_type frame, std::span<uint32_t const> feedback);
+  // Thread-safe. Mark page as used in frame.
+  void use(PageId page, frame_type frame);
+
+  // Thread-safe. The load of page finished (or failed, if success is false).
+  void loaded(PageId page, bool success = true);
+
+  // Process finished loads, evict and request new loads. Calls the callbacks (without holding a lock).
+  // frame is the frame whose command buffer uploads the indirection updates that result from this call;
+  // it may not be less than the frame passed to the previous call.
+  void update(frame_type frame);
+
+  // Thread-safe. All frames up till and including frame finished: the slots that were evicted by update(frame) are free again.
+  void retire(frame_type frame);
+
+  // Thread-safe. Returns the rectangles of the page table that changed since the previous call.
+  std::vector<IndirectionUpdate> take_indirection_updates();
+  // Thread-safe. Make the next take_indirection_updates() return the whole page table (for example, because the previous updates were lost).
+  void mark_all_dirty();
+
+  // Thread-safe accessors.
+  uint32_t level_count() const { return m_level_count; }
+  vk::Extent2D level_extent(uint32_t level) const;
+  Entry entry(PageId page) const;
+  Stats stats() const;
+
+ private:
+  bool is_valid(PageId page) const;
+  // Mark page, and its ancestors, as used in the current frame.
+  static void use(State& state, PageId page);
+  // Update the page table after page was loaded into slot, or before it is removed from slot.
+  static void map(State& state, PageId page, slot_type slot);
+  static void unmap(State& state, PageId page, slot_type slot);
+};
+
+} // namespace vulkan::memory
@@ -0,0 +1,210 @@
+#include "sys.h"
+#include "Meshlet.h"
+#include "utils/AIAlert.h"
+#include <algorithm>
+#include <istream>
+#include <ostream>
+#include <cstring>
+#include <cmath>
+#include <bit>
+
+namespace vulkan::meshlet {
+
+bool Meshlet::is_backfacing(glsl::vec3 const& camera_position) const
+{
+  if (m_cone_cutoff >= 1.0f)
+    return false;
+  // All triangles face away from the camera if the direction from the camera to any point of the
+  // bounding sphere makes an angle of less than 90 degrees minus the half-angle of the cone with its axis.
+  glsl::vec3 const view = center() - camera_position;
+  return view.dot(cone_axis()) >= m_cone_cutoff * view.norm() + m_radius;
+}
+
+bool Meshlet::is_outside(std::array<glsl::vec4, 6> const& frustum_planes) const
+{
+  glsl::vec3 const c = center();
+  for (glsl::vec4 const& plane : frustum_planes)
+    if (plane.head<3>().dot(c) + plane[3] < -m_radius)
+      return true;
+  return false;
+}
+
+std::array<glsl::vec4, 6> frustum_planes(glsl::mat4 const& view_projection)
+{
+  glsl::vec4 const row0 = view_projection.row(0).transpose();
+  glsl::vec4 const row1 = view_projection.row(1).transpose();
+  glsl::vec4 const row2 = view_projection.row(2).transpose();
+  glsl::vec4 const row3 = view_projection.row(3).transpose();
+  std::array<glsl::vec4, 6> planes = { row3 + row0, row3 - row0, row3 + row1, row3 - row1, row2, row3 - row2 };
+  for (glsl::vec4& plane : planes)
+    plane /= plane.head<3>().norm();
+  return planes;
+}
+
+namespace {
+
+// Binary format.
+constexpr uint32_t meshlet_file_magic = 0x4c4d564c;    // "LVML" as little endian.
+constexpr uint32_t meshlet_file_version = 1;
+
+struct FileHeader
+{
+  uint32_t m_magic;
+  uint32_t m_version;
+  uint32_t m_meshlet_count;
+  uint32_t m_vertex_index_count;
+  uint32_t m_primitive_index_count;
+};
+
+// A Meshlet with its cone quantized to snorm bytes: 36 instead of 48 bytes.
+struct PackedMeshlet
+{
+  uint32_t m_vertex_offset;
+  uint32_t m_triangle_offset;
+  uint32_t m_vertex_count;
+  uint32_t m_triangle_count;
+  float m_center[3];
+  float m_radius;
+  int8_t m_cone_axis[3];
+  int8_t m_cone_cutoff;
+};
+
+static_assert(sizeof(FileHeader) == 20 && sizeof(PackedMeshlet) == 36, "Unexpected padding in the meshlet file format.");
+static_assert(std::endian::native == std::endian::little, "The meshlet file format is little endian.");
+
+int8_t quantize_snorm8(float value)
+{
+  return static_cast<int8_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 127.0f));
+}
+
+PackedMeshlet pack(Meshlet const& meshlet)
+{
+  PackedMeshlet packed{meshlet.m_vertex_offset, meshlet.m_triangle_offset, meshlet.m_vertex_count, meshlet.m_triangle_count,
+    { meshlet.m_center[0], meshlet.m_center[1], meshlet.m_center[2] }, meshlet.m_radius, {}, 127};
+  for (int k = 0; k < 3; ++k)
+    packed.m_cone_axis[k] = quantize_snorm8(meshlet.m_cone_axis[k]);
+  if (meshlet.m_cone_cutoff < 1.0f)
+  {
+    // The quantized axis deviates from the real axis by some angle; widen the cone by that angle
+    // and round the cutoff up, so that the quantized cone never rejects more than the real one.
+    glsl::vec3 const quantized_axis = glsl::vec3(packed.m_cone_axis[0], packed.m_cone_axis[1], packed.m_cone_axis[2]).normalized();
+    float const axis_error = std::acos(std::clamp(quantized_axis.dot(meshlet.cone_axis()), -1.0f, 1.0f));
+    float const half_angle = std::asin(std::clamp(meshlet.m_cone_cutoff, -1.0f, 1.0f));
+    float const cutoff = half_angle + axis_error >= static_cast<float>(M_PI_2) ? 1.0f : std::sin(half_angle + axis_error);
+    packed.m_cone_cutoff = static_cast<int8_t>(std::min(127.0f, std::ceil(cutoff * 127.0f)));
+  }
+  return packed;
+}
+
+Meshlet unpack(PackedMeshlet const& packed)
+{
+  Meshlet meshlet{packed.m_vertex_offset, packed.m_triangle_offset, packed.m_vertex_count, packed.m_triangle_count,
+    { packed.m_center[0], packed.m_center[1], packed.m_center[2] }, packed.m_radius, { 0.0f, 0.0f, 1.0f }, 1.0f};
+  glsl::vec3 const axis(packed.m_cone_axis[0], packed.m_cone_axis[1], packed.m_cone_axis[2]);
+  if (axis.squaredNorm() > 0.0f)
+  {
+    glsl::vec3 const normalized_axis = axis.normalized();
+    meshlet.m_cone_axis = { normalized_axis[0], normalized_axis[1], normalized_axis[2] };
+  }
+  if (packed.m_cone_cutoff < 127)
+    meshlet.m_cone_cutoff = packed.m_cone_cutoff / 127.0f;
+  return meshlet;
+}
+
+template<typename T>
+void read_bytes(std::istream& is, T* data, size_t count)
+{
+  if (!is.read(reinterpret_cast<char*>(data), count * sizeof(T)))
+    THROW_ALERT("Unexpected end of meshlet data.");
+}
+
+} // namespace
+
+size_t MeshletMesh::serialized_size() const
+{
+  return sizeof(FileHeader) + m_meshlets.size() * sizeof(PackedMeshlet) +
+    m_vertex_indices.size() * sizeof(uint32_t) + m_primitive_indices.size();
+}
+
+void MeshletMesh::write_to(std::ostream& os) const
+{
+  DoutEntering(dc::vulkan, "MeshletMesh::write_to(os) [" << this << "]");
+  FileHeader const header{meshlet_file_magic, meshlet_file_version, static_cast<uint32_t>(m_meshlets.size()),
+    static_cast<uint32_t>(m_vertex_indices.size()), static_cast<uint32_t>(m_primitive_indices.size())};
+  os.write(reinterpret_cast<char const*>(&header), sizeof(header));
+  std::vector<PackedMeshlet> packed_meshlets;
+  packed_meshlets.reserve(m_meshlets.size());
+  for (Meshlet const& meshlet : m_meshlets)
+    packed_meshlets.push_back(pack(meshlet));
+  os.write(reinterpret_cast<char const*>(packed_meshlets.data()), packed_meshlets.size() * sizeof(PackedMeshlet));
+  os.write(reinterpret_cast<char const*>(m_vertex_indices.data()), m_vertex_indices.size() * sizeof(uint32_t));
+  os.write(reinterpret_cast<char const*>(m_primitive_indices.data()), m_primitive_indices.size());
+}
+
+void MeshletMesh::read_from(std::istream& is)
+{
+  DoutEntering(dc::vulkan, "MeshletMesh::read_from(is) [" << this << "]");
+  FileHeader header;
+  read_bytes(is, &header, 1);
+  if (header.m_magic != meshlet_file_magic)
+    THROW_ALERT("Not a meshlet file (wrong magic).");
+  if (header.m_version != meshlet_file_version)
+    THROW_ALERT("Unsupported meshlet file version [VERSION].", AIArgs("[VERSION]", header.m_version));
+  if (header.m_primitive_index_count % 3 != 0)
+    THROW_ALERT("Corrupt meshlet file: the number of primitive indices ([COUNT]) is not a multiple of three.", AIArgs("[COUNT]", header.m_primitive_index_count));
+
+  std::vector<PackedMeshlet> packed_meshlets(header.m_meshlet_count);
+  read_bytes(is, packed_meshlets.data(), packed_meshlets.size());
+  std::vector<uint32_t> vertex_indices(header.m_vertex_index_count);
+  read_bytes(is, vertex_indices.data(), vertex_indices.size());
+  std::vector<uint8_t> primitive_indices(header.m_primitive_index_count);
+  read_bytes(is, primitive_indices.data(), primitive_indices.size());
+
+  std::vector<Meshlet> meshlets;
+  meshlets.reserve(packed_meshlets.size());
+  for (PackedMeshlet const& packed : packed_meshlets)
+  {
+    if (static_cast<uint64_t>(packed.m_vertex_offset) + packed.m_vertex_count > vertex_indices.size() ||
+        3 * (static_cast<uint64_t>(packed.m_triangle_offset) + packed.m_triangle_count) > primitive_indices.size())
+      THROW_ALERT("Corrupt meshlet file: meshlet out of range.");
+    meshlets.push_back(unpack(packed));
+  }
+
+  m_meshlets = std::move(meshlets);
+  m_vertex_indices = std::move(vertex_indices);
+  m_primitive_indices = std::move(primitive_indices);
+}
+
+std::vector<uint8_t> MeshletMesh::padded_primitive_indices() const
+{
+  std::vector<uint8_t> padded(m_primitive_indices);
+  padded.resize((padded.size() + 3) & ~size_t{3}, 0);
+  return padded;
+}
+
+#ifdef CWDEBUG
+void Meshlet::print_on(std::ostream& os) const
+{
+  os << '{';
+  os << "m_vertex_offset:" << m_vertex_offset <<
+      ", m_triangle_offset:" << m_triangle_offset <<
+      ", m_vertex_count:" << m_vertex_count <<
+      ", m_triangle_count:" << m_triangle_count <<
+      ", m_center:(" << m_center[0] << ", " << m_center[1] << ", " << m_center[2] << ")" <<
+      ", m_radius:" << m_radius <<
+      ", m_cone_axis:(" << m_cone_axis[0] << ", " << m_cone_axis[1] << ", " << m_cone_axis[2] << ")" <<
+      ", m_cone_cutoff:" << m_cone_cutoff;
+  os << '}';
+}
+
+void MeshletMesh::print_on(std::ostream& os) const
+{
+  os << '{';
+  os << "m_meshlets.size():" << m_meshlets.size() <<
+      ", m_vertex_indices.size():" << m_vertex_indices.size() <<
+      ", m_primitive_indices.size():" << m_primitive_indices.size();
+  os << '}';
+}
+#endif
+
+} // namespace vulkan::meshlet
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "math/glsl.h"
+#include <Eigen/Geometry>
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <iosfwd>
+#include "debug.h"
+
+namespace vulkan::meshlet {
+
+// Meshlet
+//
+// A cluster of at most MeshletBuilder::max_vertices vertices and MeshletBuilder::max_triangles
+// triangles of an indexed mesh, with the bounds needed to reject it as a whole.
+//
+// The layout of this struct is the same as the std430 layout of the Meshlet struct in
+// the meshlet task and mesh shaders (see MeshletShaders.h), so that MeshletMesh::m_meshlets
+// can be copied into a storage buffer as is.
+//
+struct Meshlet
+{
+  uint32_t m_vertex_offset;             // Offset into MeshletMesh::m_vertex_indices.
+  uint32_t m_triangle_offset;           // Offset into MeshletMesh::m_primitive_indices, in triangles (the byte offset is three times that).
+  uint32_t m_vertex_count;
+  uint32_t m_triangle_count;
+  std::array<float, 3> m_center;        // Bounding sphere.
+  float m_radius;
+  std::array<float, 3> m_cone_axis;     // Normal cone: the (normalized) average normal of the triangles.
+  float m_cone_cutoff;                  // sin of the half-angle of the normal cone; 1 if the meshlet can not be rejected by its normal cone.
+
+  glsl::vec3 center() const { return { m_center[0], m_center[1], m_center[2] }; }
+  glsl::vec3 cone_axis() const { return { m_cone_axis[0], m_cone_axis[1], m_cone_axis[2] }; }
+
+  // Returns true when, seen from camera_position, all triangles of this meshlet are back-facing.
+  bool is_backfacing(glsl::vec3 const& camera_position) const;
+
+  // Returns true when the bounding sphere is completely outside of one of the planes.
+  // Each plane is (a, b, c, d) with (a, b, c) pointing inwards: a point p is inside when dot(p, (a, b, c)) + d >= 0.
+  bool is_outside(std::array<glsl::vec4, 6> const& frustum_planes) const;
+
+#ifdef CWDEBUG
+  void print_on(std::ostream& os) const;
+#endif
+};
+
+static_assert(sizeof(Meshlet) == 48, "Meshlet must have the std430 layout of the shader struct.");
+
+// MeshletMesh
+//
+// The result of MeshletBuilder::build.
+//
+// Triangle t of meshlet m uses the three vertices
+//
+//   m_vertex_indices[m.m_vertex_offset + m_primitive_indices[3 * (m.m_triangle_offset + t) + k]]      for k = 0, 1, 2.
+//
+// In other words, m_primitive_indices contains indices relative to the meshlet (which fit in a byte)
+// and m_vertex_indices maps those to the vertices of the original mesh.
+//
+struct MeshletMesh
+{
+  std::vector<Meshlet> m_meshlets;
+  std::vector<uint32_t> m_vertex_indices;
+  std::vector<uint8_t> m_primitive_indices;
+
+  // Write the meshlets to os in a compact binary format, or read them back.
+  //
+  // The format is: a header (magic, version and the sizes of the three vectors), followed by the meshlets
+  // with their cone quantized to four signed bytes, the vertex indices and the primitive indices
+  // (all little endian). Throws an AIAlert::Error if the input is not a valid meshlet file.
+  void write_to(std::ostream& os) const;
+  void read_from(std::istream& is);
+
+  // The number of bytes that write_to writes.
+  size_t serialized_size() const;
+
+  // The primitive indices padded with zeroes to a multiple of four bytes (for upload to a uint[] storage buffer).
+  std::vector<uint8_t> padded_primitive_indices() const;
+
+#ifdef CWDEBUG
+  void print_on(std::ostream& os) const;
+#endif
+};
+
+// Extract the six frustum planes (left, right, bottom, top, near, far) from a view-projection matrix,
+// for vulkan clip space (0 <= z <= w). The planes are normalized and point inwards (see Meshlet::is_outside).
+std::array<glsl::vec4, 6> frustum_planes(glsl::mat4 const& view_projection);
+
+} // namespace vulkan::meshlet
@@ -0,0 +1,137 @@
+#include "sys.h"
+#include "MeshletBuilder.h"
+#include <algorithm>
+#include <cmath>
+#include "debug.h"
+
+namespace vulkan::meshlet {
+
+MeshletMesh MeshletBuilder::build(std::span<glsl::vec3 const> positions, std::span<uint32_t const> indices) const
+{
+  DoutEntering(dc::vulkan, "MeshletBuilder::build(" << positions.size() << " positions, " << indices.size() << " indices) [" << this << "]");
+
+  // The index buffer must contain whole triangles.
+  ASSERT(indices.size() % 3 == 0);
+
+  MeshletMesh meshlet_mesh;
+  // The index of each vertex of positions in the current meshlet, or -1 if it isn't part of it.
+  std::vector<int> local_index(positions.size(), -1);
+  Meshlet current{};
+
+  auto finish_meshlet = [&](){
+    if (current.m_triangle_count == 0)
+      return;
+    for (uint32_t v = 0; v < current.m_vertex_count; ++v)
+      local_index[meshlet_mesh.m_vertex_indices[current.m_vertex_offset + v]] = -1;
+    compute_bounds(current, meshlet_mesh, positions);
+    meshlet_mesh.m_meshlets.push_back(current);
+    current = Meshlet{};
+    current.m_vertex_offset = static_cast<uint32_t>(meshlet_mesh.m_vertex_indices.size());
+    current.m_triangle_offset = static_cast<uint32_t>(meshlet_mesh.m_primitive_indices.size() / 3);
+  };
+
+  for (size_t t = 0; t < indices.size(); t += 3)
+  {
+    std::array<uint32_t, 3> const triangle = { indices[t], indices[t + 1], indices[t + 2] };
+    // Index out of range.
+    ASSERT(triangle[0] < positions.size() && triangle[1] < positions.size() && triangle[2] < positions.size());
+    // Skip degenerate triangles; they wouldn't be rasterized anyway.
+    if (triangle[0] == triangle[1] || triangle[1] == triangle[2] || triangle[0] == triangle[2])
+      continue;
+    uint32_t new_vertices = 0;
+    for (uint32_t vertex : triangle)
+      new_vertices += local_index[vertex] == -1;
+    if (current.m_vertex_count + new_vertices > m_max_vertices || current.m_triangle_count == m_max_triangles)
+      finish_meshlet();
+    for (uint32_t vertex : triangle)
+    {
+      if (local_index[vertex] == -1)
+      {
+        local_index[vertex] = current.m_vertex_count++;
+        meshlet_mesh.m_vertex_indices.push_back(vertex);
+      }
+      meshlet_mesh.m_primitive_indices.push_back(static_cast<uint8_t>(local_index[vertex]));
+    }
+    ++current.m_triangle_count;
+  }
+  finish_meshlet();
+
+  Dout(dc::vulkan, "Built " << meshlet_mesh.m_meshlets.size() << " meshlets with " << meshlet_mesh.m_vertex_indices.size() <<
+      " vertices (" << positions.size() << " unique) and " << meshlet_mesh.m_primitive_indices.size() / 3 << " triangles.");
+  return meshlet_mesh;
+}
+
+//static
+void MeshletBuilder::compute_bounds(Meshlet& meshlet, MeshletMesh const& meshlet_mesh, std::span<glsl::vec3 const> positions)
+{
+  // A meshlet is never empty.
+  ASSERT(meshlet.m_vertex_count > 0 && meshlet.m_triangle_count > 0);
+
+  auto position = [&](uint32_t local_vertex) -> glsl::vec3 const& {
+    return positions[meshlet_mesh.m_vertex_indices[meshlet.m_vertex_offset + local_vertex]];
+  };
+
+  // Bounding sphere (Ritter): start with the sphere through two points that are far apart and grow it to include all points.
+  glsl::vec3 const& p0 = position(0);
+  uint32_t x = 0;
+  for (uint32_t v = 1; v < meshlet.m_vertex_count; ++v)
+    if ((position(v) - p0).squaredNorm() > (position(x) - p0).squaredNorm())
+      x = v;
+  uint32_t y = x;
+  for (uint32_t v = 0; v < meshlet.m_vertex_count; ++v)
+    if ((position(v) - position(x)).squaredNorm() > (position(y) - position(x)).squaredNorm())
+      y = v;
+  glsl::vec3 center = 0.5f * (position(x) + position(y));
+  float radius = 0.5f * (position(y) - position(x)).norm();
+  for (uint32_t v = 0; v < meshlet.m_vertex_count; ++v)
+  {
+    float const distance = (position(v) - center).norm();
+    if (distance > radius)
+    {
+      // Move the center towards the point, just enough to include it (and the old sphere).
+      float const new_radius = 0.5f * (radius + distance);
+      center += (distance - new_radius) / distance * (position(v) - center);
+      radius = new_radius;
+    }
+  }
+
+  // Normal cone: the axis is the average of the normals of all (non-degenerate) triangles.
+  std::vector<glsl::vec3> normals;
+  normals.reserve(meshlet.m_triangle_count);
+  glsl::vec3 axis = glsl::vec3::Zero();
+  for (uint32_t t = 0; t < meshlet.m_triangle_count; ++t)
+  {
+    uint8_t const* primitive = &meshlet_mesh.m_primitive_indices[3 * (meshlet.m_triangle_offset + t)];
+    glsl::vec3 const normal = (position(primitive[1]) - position(primitive[0])).cross(position(primitive[2]) - position(primitive[0]));
+    float const length = normal.norm();
+    if (length == 0.0f)
+      continue;
+    normals.push_back(normal / length);
+    axis += normals.back();
+  }
+  float cutoff = 1.0f;
+  float const axis_length = axis.norm();
+  if (axis_length > 0.0f)
+  {
+    axis /= axis_length;
+    float min_dot = 1.0f;
+    for (glsl::vec3 const& normal : normals)
+      min_dot = std::min(min_dot, normal.dot(axis));
+    // If the normals span more than a hemisphere then there is always a triangle that faces the camera.
+    if (min_dot > 0.0f)
+    {
+      // The half-angle of the normal cone is acos(min_dot). All triangles are back-facing when the view
+      // direction is within 90 degrees minus that angle of the axis: cos(90 - acos(min_dot)) = sin(acos(min_dot)).
+      cutoff = std::sqrt(1.0f - min_dot * min_dot);
+    }
+  }
+  else
+    axis = glsl::vec3(0.0f, 0.0f, 1.0f);
+
+  meshlet.m_center = { center[0], center[1], center[2] };
+  meshlet.m_radius = radius;
+  meshlet.m_cone_axis = { axis[0], axis[1], axis[2] };
+  meshlet.m_cone_cutoff = cutoff;
+}
+
+} // namespace vulkan::meshlet
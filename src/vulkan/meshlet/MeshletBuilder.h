@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Meshlet.h"
+#include <span>
+
+namespace vulkan::meshlet {
+
+// MeshletBuilder
+//
+// Splits an indexed triangle list into meshlets of at most max_vertices vertices and
+// max_triangles triangles, and calculates the bounding sphere and normal cone of each.
+//
+// The builder only uses the CPU; it can be used offline (write the result with
+// MeshletMesh::write_to) or at run time.
+//
+// Usage:
+//
+//   vulkan::meshlet::MeshletBuilder builder;                    // Defaults that suit most mesh shader implementations.
+//   vulkan::meshlet::MeshletMesh meshlet_mesh = builder.build(positions, indices);
+//
+// Triangle normals (used for the normal cone) follow the counter-clockwise winding order.
+//
+// Triangles are added in order; a new meshlet is started when the next triangle would
+// exceed either limit. Index buffers that were optimized for vertex cache locality
+// therefore give the best results (the fewest duplicated vertices).
+//
+class MeshletBuilder
+{
+ public:
+  // The defaults recommended for VK_EXT_mesh_shader by the major vendors.
+  static constexpr uint32_t default_max_vertices = 64;
+  static constexpr uint32_t default_max_triangles = 124;
+  // Primitive indices are stored in a byte.
+  static constexpr uint32_t max_max_vertices = 256;
+
+ private:
+  uint32_t m_max_vertices;
+  uint32_t m_max_triangles;
+
+ public:
+  MeshletBuilder(uint32_t max_vertices = default_max_vertices, uint32_t max_triangles = default_max_triangles) :
+    m_max_vertices(max_vertices), m_max_triangles(max_triangles)
+  {
+    // A meshlet must be able to contain at least one triangle.
+    ASSERT(3 <= max_vertices && max_vertices <= max_max_vertices && 1 <= max_triangles);
+  }
+
+  // Accessors.
+  uint32_t max_vertices() const { return m_max_vertices; }
+  uint32_t max_triangles() const { return m_max_triangles; }
+
+  // Build the meshlets of the triangle list indices (three indices per triangle) into positions.
+  MeshletMesh build(std::span<glsl::vec3 const> positions, std::span<uint32_t const> indices) const;
+
+  // Calculate the bounding sphere and normal cone of meshlet, whose offsets and counts must already be set.
+  static void compute_bounds(Meshlet& meshlet, MeshletMesh const& meshlet_mesh, std::span<glsl::vec3 const> positions);
+};
+
+} // namespace vulkan::meshlet
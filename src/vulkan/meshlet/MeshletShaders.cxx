@@ -0,0 +1,145 @@
+#include "sys.h"
+#include "MeshletShaders.h"
+#include "MeshletBuilder.h"
+
+namespace vulkan::meshlet {
+
+static_assert(task_workgroup_size == 32 && MeshletBuilder::default_max_vertices == 64 && MeshletBuilder::default_max_triangles == 124,
+    "Update the constants in the shaders below.");
+
+// These are templates: the push constant block MeshletDraw is declared by ShaderInputData::preprocess2.
+std::string_view const meshlet_task_glsl = R"glsl(
+#extension GL_EXT_mesh_shader : require
+#extension GL_EXT_buffer_reference : require
+#extension GL_EXT_buffer_reference_uvec2 : require
+
+layout(local_size_x = 32) in;
+
+struct Meshlet
+{
+  uint vertex_offset;
+  uint triangle_offset;
+  uint vertex_count;
+  uint triangle_count;
+  vec4 sphere;                  // center, radius
+  vec4 cone;                    // axis, cutoff
+};
+
+layout(buffer_reference, std430, buffer_reference_align = 16) readonly buffer Meshlets { Meshlet meshlets[]; };
+layout(buffer_reference, std430, buffer_reference_align = 16) readonly buffer MeshletCamera
+{
+  mat4 view_projection;
+  vec4 frustum_planes[6];
+  vec4 camera_position;
+};
+
+struct TaskPayload
+{
+  uint meshlet_indices[32];
+};
+taskPayloadSharedEXT TaskPayload payload;
+
+shared uint visible_count;
+
+bool is_visible(Meshlet meshlet, MeshletCamera camera)
+{
+  vec3 center = meshlet.sphere.xyz;
+  float radius = meshlet.sphere.w;
+  for (int i = 0; i < 6; ++i)
+    if (dot(camera.frustum_planes[i].xyz, center) + camera.frustum_planes[i].w < -radius)
+      return false;
+  if (meshlet.cone.w < 1.0)
+  {
+    vec3 view = center - camera.camera_position.xyz;
+    if (dot(view, meshlet.cone.xyz) >= meshlet.cone.w * length(view) + radius)
+      return false;
+  }
+  return true;
+}
+
+void main()
+{
+  if (gl_LocalInvocationIndex == 0)
+    visible_count = 0;
+  barrier();
+  uint meshlet_index = gl_GlobalInvocationID.x;
+  Meshlets meshlets = Meshlets(MeshletDraw::m_meshlets);
+  MeshletCamera camera = MeshletCamera(MeshletDraw::m_camera);
+  if (meshlet_index < MeshletDraw::m_meshlet_count && is_visible(meshlets.meshlets[meshlet_index], camera))
+    payload.meshlet_indices[atomicAdd(visible_count, 1)] = meshlet_index;
+  barrier();
+  EmitMeshTasksEXT(visible_count, 1, 1);
+}
+)glsl";
+
+std::string_view const meshlet_mesh_glsl = R"glsl(
+#extension GL_EXT_mesh_shader : require
+#extension GL_EXT_buffer_reference : require
+#extension GL_EXT_buffer_reference_uvec2 : require
+
+layout(local_size_x = 32) in;
+layout(triangles, max_vertices = 64, max_primitives = 124) out;
+
+struct Meshlet
+{
+  uint vertex_offset;
+  uint triangle_offset;
+  uint vertex_count;
+  uint triangle_count;
+  vec4 sphere;
+  vec4 cone;
+};
+
+struct MeshletVertex
+{
+  vec4 position;
+  vec4 normal;
+};
+
+layout(buffer_reference, std430, buffer_reference_align = 16) readonly buffer Meshlets { Meshlet meshlets[]; };
+layout(buffer_reference, std430, buffer_reference_align = 4) readonly buffer VertexIndices { uint vertex_indices[]; };
+layout(buffer_reference, std430, buffer_reference_align = 4) readonly buffer PrimitiveIndices { uint primitive_indices[]; };    // Four bytes per uint.
+layout(buffer_reference, std430, buffer_reference_align = 16) readonly buffer Vertices { MeshletVertex vertices[]; };
+layout(buffer_reference, std430, buffer_reference_align = 16) readonly buffer MeshletCamera
+{
+  mat4 view_projection;
+  vec4 frustum_planes[6];
+  vec4 camera_position;
+};
+
+struct TaskPayload
+{
+  uint meshlet_indices[32];
+};
+taskPayloadSharedEXT TaskPayload payload;
+
+layout(location = 0) out vec3 v_normal[];
+
+uint primitive_index(PrimitiveIndices primitive_indices, uint i)
+{
+  return (primitive_indices.primitive_indices[i >> 2] >> ((i & 3) * 8)) & 0xff;
+}
+
+void main()
+{
+  VertexIndices vertex_indices = VertexIndices(MeshletDraw::m_vertex_indices);
+  PrimitiveIndices primitive_indices = PrimitiveIndices(MeshletDraw::m_primitive_indices);
+  Vertices vertices = Vertices(MeshletDraw::m_vertices);
+  MeshletCamera camera = MeshletCamera(MeshletDraw::m_camera);
+  Meshlet meshlet = Meshlets(MeshletDraw::m_meshlets).meshlets[payload.meshlet_indices[gl_WorkGroupID.x]];
+  SetMeshOutputsEXT(meshlet.vertex_count, meshlet.triangle_count);
+  for (uint v = gl_LocalInvocationIndex; v < meshlet.vertex_count; v += 32)
+  {
+    MeshletVertex vertex = vertices.vertices[vertex_indices.vertex_indices[meshlet.vertex_offset + v]];
+    gl_MeshVerticesEXT[v].gl_Position = camera.view_projection * vec4(vertex.position.xyz, 1.0);
+    v_normal[v] = vertex.normal.xyz;
+  }
+  for (uint t = gl_LocalInvocationIndex; t < meshlet.triangle_count; t += 32)
+  {
+    uint i = 3 * (meshlet.triangle_offset + t);
+    gl_PrimitiveTriangleIndicesEXT[t] = uvec3(primitive_index(primitive_indices, i), primitive_index(primitive_indices, i + 1), primitive_index(primitive_indices, i + 2));
+  }
+}
+)glsl";
+
+} // namespace vulkan::meshlet
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "Meshlet.h"
+#include "shader_builder/ShaderVariableLayouts.h"
+#include <vulkan/vulkan.hpp>
+#include <string_view>
+
+namespace vulkan::meshlet {
+
+// GLSL for drawing a MeshletMesh with VK_EXT_mesh_shader (see LogicalDevice::supports_mesh_shader).
+//
+// The task shader runs one invocation per meshlet (in workgroups of task_workgroup_size) and
+// rejects meshlets whose bounding sphere is outside the view frustum or whose normal cone
+// faces away from the camera (the same tests as Meshlet::is_outside and Meshlet::is_backfacing);
+// it then launches one mesh shader workgroup per remaining meshlet.
+//
+// The shaders are templates (they do not start with "#version"): the only shader input is the
+// push constant MeshletDraw, which the characteristic must register with add_push_constant<MeshletDraw>().
+// It contains the device addresses (see to_uvec2) of five buffers, that must be created with
+// vk::BufferUsageFlagBits::eShaderDeviceAddress (see LogicalDevice::supports_buffer_device_address):
+//
+//   m_meshlets:           Meshlet[] (MeshletMesh::m_meshlets).
+//   m_vertex_indices:     uint[] (MeshletMesh::m_vertex_indices).
+//   m_primitive_indices:  uint[] (MeshletMesh::padded_primitive_indices()).
+//   m_vertices:           MeshletVertex[].
+//   m_camera:             MeshletCamera.
+//
+// Record the draw with
+//
+//   command_buffer->drawMeshTasksEXT((meshlet_count + task_workgroup_size - 1) / task_workgroup_size, 1, 1);
+//
+// The mesh shader writes the normal to location 0; a fragment shader must be provided by the user.
+// GL_EXT_mesh_shader requires a SPIR-V 1.4 target, for example
+// ShaderCompilerOptions::set_target_env(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_3).
+//
+static constexpr uint32_t task_workgroup_size = 32;
+
+// The layout of m_vertices (std430).
+struct MeshletVertex
+{
+  glsl::vec4 m_position;                // w is ignored.
+  glsl::vec4 m_normal;                  // w is ignored.
+};
+
+// The layout of m_camera (std430).
+struct MeshletCamera
+{
+  glsl::mat4 m_view_projection;
+  std::array<glsl::vec4, 6> m_frustum_planes;   // See frustum_planes(m_view_projection).
+  glsl::vec4 m_camera_position;                 // w is ignored.
+};
+
+// Convert a buffer device address to the uvec2 that the shaders expect (GL_EXT_buffer_reference_uvec2).
+inline glsl::uvec2 to_uvec2(vk::DeviceAddress address)
+{
+  return { static_cast<uint32_t>(address), static_cast<uint32_t>(address >> 32) };
+}
+
+// The push constant of the meshlet shaders, used as MeshletDraw::m_meshlets etc. in the shader templates.
+struct MeshletDraw
+{
+  glsl::uvec2 m_meshlets;
+  glsl::uvec2 m_vertex_indices;
+  glsl::uvec2 m_primitive_indices;
+  glsl::uvec2 m_vertices;
+  glsl::uvec2 m_camera;
+  glsl::Uint m_meshlet_count;
+};
+
+extern std::string_view const meshlet_task_glsl;
+extern std::string_view const meshlet_mesh_glsl;
+
+} // namespace vulkan::meshlet
+
+LAYOUT_DECLARATION(vulkan::meshlet::MeshletDraw, push_constant_std430)
+{
+  static constexpr auto struct_layout = make_struct_layout(
+    LAYOUT(uvec2, m_meshlets),
+    LAYOUT(uvec2, m_vertex_indices),
+    LAYOUT(uvec2, m_primitive_indices),
+    LAYOUT(uvec2, m_vertices),
+    LAYOUT(uvec2, m_camera),
+    LAYOUT(Uint, m_meshlet_count)
+  );
+};
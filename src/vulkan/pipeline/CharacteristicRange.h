@@ -42,6 +42,7 @@ class CharacteristicRange : public AIStatefulTask
   index_type const m_begin;
   index_type const m_end;
   index_type m_fill_index{-1};
+  std::vector<vk::DynamicState> m_dynamic_state_alternative;   // The pipeline state that the values of this range differ in (see set_dynamic_state_alternative).
 #ifdef CWDEBUG
   state_type m_expected_state{direct_base_type::state_end};
 #endif
@@ -104,8 +105,22 @@ class CharacteristicRange : public AIStatefulTask
     *pipeline_index |= Index{static_cast<unsigned int>(index - m_begin) << range_shift};
   }
 
+  // Declare that the pipelines generated for the different values of this range only differ in
+  // the given fixed-function state (for example vk::DynamicState::eCullMode when fill sets
+  // m_flat_create_info->m_rasterization_state_create_info.cullMode depending on fill_index()).
+  //
+  // If the logical device supports all of dynamic_states (see LogicalDevice::supports_dynamic_states)
+  // then the PipelineFactory removes this range from the cartesian product of all characteristic
+  // ranges: only pipelines for ibegin() are generated, with dynamic_states added to their dynamic
+  // state, and the user must set that state while recording the command buffer.
+  // Otherwise a pipeline is generated for every value in the range, as usual.
+  //
+  // Must be called before this characteristic finished initializing (for example from its constructor).
+  void set_dynamic_state_alternative(std::vector<vk::DynamicState> dynamic_states) { m_dynamic_state_alternative = std::move(dynamic_states); }
+
   // Accessor.
   task::PipelineFactory* owning_factory(utils::Badge<ShaderInputData>) const { return m_owning_factory; }
+  std::vector<vk::DynamicState> const& dynamic_state_alternative() const { return m_dynamic_state_alternative; }
   CharacteristicRangeIndex characteristic_range_index() const { return m_characteristic_range_index; }
   index_type fill_index() const { return m_fill_index; }
 
@@ -319,6 +334,7 @@ void CharacteristicRange::build_shader(task::SynchronousWindow const* owning_win
   m_owning_factory->shader_input_data({}).build_shader({},
       owning_window, shader_index, compiler, spirv_cache, set_index_hint_map
       COMMA_CWDEBUG_ONLY(ambifix));
+  m_owning_factory->uses_shader({}, shader_index);
 }
 
 void CharacteristicRange::build_shader(task::SynchronousWindow const* owning_window,
@@ -329,6 +345,7 @@ void CharacteristicRange::build_shader(task::SynchronousWindow const* owning_win
   m_owning_factory->shader_input_data({}).build_shader({},
       owning_window, shader_index, compiler, set_index_hint_map
       COMMA_CWDEBUG_ONLY(ambifix));
+  m_owning_factory->uses_shader({}, shader_index);
 }
 
 auto CharacteristicRange::push_constant_ranges() const
@@ -7,7 +7,9 @@ namespace vulkan::pipeline {
 void FactoryHandle::generate(task::SynchronousWindow const* owning_window)
 {
   DoutEntering(dc::vulkan, "pipeline::FactoryHandle::generate(" << owning_window << ")");
-  owning_window->pipeline_factory(m_factory_index)->generate();
+  // The factory is null if it was not recreated (see SynchronousWindow::recreate_graphics_pipelines).
+  if (task::PipelineFactory* pipeline_factory = owning_window->pipeline_factory(m_factory_index))
+    pipeline_factory->generate();
 }
 
 } // namespace vulkan::pipeline
@@ -63,9 +63,16 @@ FactoryCharacteristicId FactoryHandle::add_characteristic(task::SynchronousWindo
       ::NAMESPACE_DEBUG::type_name_of<CHARACTERISTIC>() <<
       ((LibcwDoutStream << ... << (std::string(", ") + ::NAMESPACE_DEBUG::type_name_of<ARGS>())), ">(") <<
       owning_window << ", " << join(", ", args...) << ")");
-  CHARACTERISTIC* ptr = new CHARACTERISTIC(owning_window, std::forward<ARGS>(args)...);
   task::PipelineFactory* pipeline_factory = owning_window->pipeline_factory(m_factory_index);
-  return pipeline_factory->add_characteristic(ptr);
+  if (!pipeline_factory)
+  {
+    // This factory was not recreated (see SynchronousWindow::recreate_graphics_pipelines).
+    return owning_window->skipped_characteristic({}, m_factory_index);
+  }
+  CHARACTERISTIC* ptr = new CHARACTERISTIC(owning_window, std::forward<ARGS>(args)...);
+  FactoryCharacteristicId id = pipeline_factory->add_characteristic(ptr);
+  owning_window->added_characteristic({}, id);
+  return id;
 }
 
 } // namespace vulkan::pipeline
@@ -2,11 +2,17 @@
 #include "PipelineFactory.h"
 #include "PipelineCache.h"
 #include "Handle.h"
+#include "PipelineTable.h"
 #include "SynchronousWindow.h"
 #include "SynchronousTask.h"
+#include "ShaderWatcher.h"
 #include "vk_utils/TaskToTaskDeque.h"
 #include "threadsafe/aithreadsafe.h"
 #include "utils/at_scope_end.h"
+#include <algorithm>
+#ifdef CWDEBUG
+#include "debug/debug_ostream_operators.h"
+#endif
 
 namespace task {
 
@@ -260,6 +266,40 @@ void PipelineFactory::multiplex_impl(state_type run_state)
       }
       case PipelineFactory_characteristics_initialized:
       {
+        // Determine the range of each loop. A characteristic range that only differs in state that
+        // the logical device supports as dynamic state is collapsed into its first value.
+        m_range_end.resize(m_characteristics.size());
+        m_collapsed_dynamic_states.clear();
+        m_number_of_pipelines = 1;
+        m_number_of_pipelines_without_dynamic_state = 1;
+        for (auto i = m_characteristics.ibegin(); i != m_characteristics.iend(); ++i)
+        {
+          vulkan::pipeline::CharacteristicRange const& characteristic_range = *m_characteristics[i];
+          std::vector<vk::DynamicState> const& dynamic_state_alternative = characteristic_range.dynamic_state_alternative();
+          m_range_end[i] = characteristic_range.iend();
+          m_number_of_pipelines_without_dynamic_state *= characteristic_range.iend() - characteristic_range.ibegin();
+          if (!dynamic_state_alternative.empty() && m_owning_window->logical_device()->supports_dynamic_states(dynamic_state_alternative))
+          {
+            m_range_end[i] = characteristic_range.ibegin() + 1;
+            for (vk::DynamicState dynamic_state : dynamic_state_alternative)
+              if (std::find(m_collapsed_dynamic_states.begin(), m_collapsed_dynamic_states.end(), dynamic_state) == m_collapsed_dynamic_states.end())
+                m_collapsed_dynamic_states.push_back(dynamic_state);
+          }
+          m_number_of_pipelines *= m_range_end[i] - characteristic_range.ibegin();
+        }
+        // Publish the layout of the flat pipeline table.
+        {
+          std::vector<vulkan::pipeline::PipelineTable::Range> ranges;
+          for (auto i = m_characteristics.ibegin(); i != m_characteristics.iend(); ++i)
+            ranges.push_back({m_characteristics[i]->ibegin(), m_characteristics[i]->iend(),
+                m_range_end[i] != m_characteristics[i]->iend(), m_range_shift[i]});
+          m_pipeline_table->initialize({}, ranges);
+        }
+        // FlatCreateInfo::merge asserts that every added vector is non-empty.
+        if (!m_collapsed_dynamic_states.empty())
+          m_flat_create_info.add(&m_collapsed_dynamic_states);
+        Dout(dc::notice, "PipelineFactory [" << this << "] generates " << m_number_of_pipelines << " pipeline(s) (" <<
+            m_number_of_pipelines_without_dynamic_state << " without dynamic state alternatives); dynamic state: " << m_collapsed_dynamic_states);
         // Start as many for loops as there are characteristics.
         m_range_counters.initialize(m_characteristics.size(), (*m_characteristics.begin())->ibegin());
         // Enter the multi-loop.
@@ -276,9 +316,9 @@ void PipelineFactory::multiplex_impl(state_type run_state)
         // We are now at the top of the for loop.
         //
         // This multiplex_impl function mimics the usual MultiLoop magic:
-        //   while (m_range_counters() < m_characteristics[vulkan::pipeline::CharacteristicRangeIndex{*m_range_counters}]->iend())
+        //   while (m_range_counters() < m_range_end[vulkan::pipeline::CharacteristicRangeIndex{*m_range_counters}])
         //   {
-        if (!(m_range_counters() < m_characteristics[vulkan::pipeline::CharacteristicRangeIndex{*m_range_counters}]->iend()))
+        if (!(m_range_counters() < m_range_end[vulkan::pipeline::CharacteristicRangeIndex{*m_range_counters}]))
         {
           // We did not enter the while loop body.
           run_state = PipelineFactory_bottom_multiloop_for_loop;
@@ -321,13 +361,11 @@ void PipelineFactory::multiplex_impl(state_type run_state)
         //-----------------------------------------------------------------
         // Begin pipeline layout creation
 
-        {
-          std::vector<vk::PushConstantRange> const sorted_push_constant_ranges = m_flat_create_info.get_sorted_push_constant_ranges();
+        m_sorted_push_constant_ranges = m_flat_create_info.get_sorted_push_constant_ranges();
 
-          // Realize (create or get from cache) the pipeline layout and return a suitable SetIndexHintMap.
-          m_vh_pipeline_layout = m_owning_window->logical_device()->realize_pipeline_layout(
-              m_flat_create_info.get_realized_descriptor_set_layouts(), m_set_index_hint_map, sorted_push_constant_ranges);
-        }
+        // Realize (create or get from cache) the pipeline layout and return a suitable SetIndexHintMap.
+        m_vh_pipeline_layout = m_owning_window->logical_device()->realize_pipeline_layout(
+            m_flat_create_info.get_realized_descriptor_set_layouts(), m_set_index_hint_map, m_sorted_push_constant_ranges);
 
         // Now that we have initialized m_set_index_hint_map, run the code that needs it.
         m_number_of_running_characteristic_tasks = m_characteristics.size();
@@ -395,27 +433,35 @@ void PipelineFactory::multiplex_impl(state_type run_state)
             .pDynamicStates = dynamic_state.data()
           };
 
-          vk::GraphicsPipelineCreateInfo pipeline_create_info{
-            .stageCount = static_cast<uint32_t>(pipeline_shader_stage_create_infos.size()),
-            .pStages = pipeline_shader_stage_create_infos.data(),
-            .pVertexInputState = &pipeline_vertex_input_state_create_info,
-            .pInputAssemblyState = &m_flat_create_info.m_pipeline_input_assembly_state_create_info,
-            .pTessellationState = nullptr,
-            .pViewportState = &m_flat_create_info.m_viewport_state_create_info,
-            .pRasterizationState = &m_flat_create_info.m_rasterization_state_create_info,
-            .pMultisampleState = &m_flat_create_info.m_multisample_state_create_info,
-            .pDepthStencilState = &m_flat_create_info.m_depth_stencil_state_create_info,
-            .pColorBlendState = &m_flat_create_info.m_color_blend_state_create_info,
-            .pDynamicState = &pipeline_dynamic_state_create_info,
-            .layout = m_vh_pipeline_layout,
-            .renderPass = m_vh_render_pass,
-            .subpass = 0,
-            .basePipelineHandle = vk::Pipeline{},
-            .basePipelineIndex = -1
-          };
+          // If the viewport and/or scissor count is dynamic then the corresponding count in the create info must be zero.
+          vk::PipelineViewportStateCreateInfo viewport_state_create_info = m_flat_create_info.m_viewport_state_create_info;
+          if (std::find(dynamic_state.begin(), dynamic_state.end(), vk::DynamicState::eViewportWithCount) != dynamic_state.end())
+            viewport_state_create_info.setViewports({});
+          if (std::find(dynamic_state.begin(), dynamic_state.end(), vk::DynamicState::eScissorWithCount) != dynamic_state.end())
+            viewport_state_create_info.setScissors({});
+
+          // A pipeline with a single compute shader stage is a compute pipeline; it has no fixed function state (and no render pass).
+          bool const is_compute_pipeline = pipeline_shader_stage_create_infos.size() == 1 &&
+              pipeline_shader_stage_create_infos[0].stage == vk::ShaderStageFlagBits::eCompute;
+          // A pipeline with a mesh shader has no vertex input and input assembly state (see meshlet/MeshletShaders.h).
+          bool const uses_mesh_shader = std::ranges::any_of(pipeline_shader_stage_create_infos,
+              [](vk::PipelineShaderStageCreateInfo const& stage_create_info){ return stage_create_info.stage == vk::ShaderStageFlagBits::eMeshEXT; });
+          if (uses_mesh_shader && !m_owning_window->logical_device()->supports_mesh_shader())
+          {
+            // Check LogicalDevice::supports_mesh_shader before adding a characteristic with a mesh shader.
+            Dout(dc::warning, "PipelineFactory [" << this << "]: can not create a pipeline with a mesh shader: VK_EXT_mesh_shader is not supported.");
+            abort();
+            return;
+          }
+          // Mesh shaders can not be combined with vertex input.
+          ASSERT(!uses_mesh_shader || (vertex_input_binding_descriptions.empty() && vertex_input_attribute_descriptions.empty()));
+          // Compute shaders can not be combined with vertex input or any other stage.
+          ASSERT(!is_compute_pipeline || (vertex_input_binding_descriptions.empty() && vertex_input_attribute_descriptions.empty()));
+          ASSERT(is_compute_pipeline || std::ranges::none_of(pipeline_shader_stage_create_infos,
+              [](vk::PipelineShaderStageCreateInfo const& stage_create_info){ return stage_create_info.stage == vk::ShaderStageFlagBits::eCompute; }));
 
 #ifdef CWDEBUG
-          Dout(dc::vulkan|continued_cf, "PipelineFactory [" << this << "] creating graphics pipeline with range values: ");
+          Dout(dc::vulkan|continued_cf, "PipelineFactory [" << this << "] creating " << (is_compute_pipeline ? "compute" : "graphics") << " pipeline with range values: ");
           char const* prefix = "";
           for (int i = 0; i < m_characteristics.size(); ++i)
           {
@@ -425,13 +471,49 @@ void PipelineFactory::multiplex_impl(state_type run_state)
           Dout(dc::finish, " --> pipeline::Index " << *pipeline_index_t::rat{m_pipeline_index});
 #endif
 
-          // Create and then store the graphics pipeline.
-          vk::UniquePipeline pipeline = m_owning_window->logical_device()->create_graphics_pipeline(m_pipeline_cache_task->vh_pipeline_cache(), pipeline_create_info
-              COMMA_CWDEBUG_ONLY(m_owning_window->debug_name_prefix("pipeline")));
+          vk::UniquePipeline pipeline;
+          if (is_compute_pipeline)
+          {
+            vk::ComputePipelineCreateInfo pipeline_create_info{
+              .stage = pipeline_shader_stage_create_infos[0],
+              .layout = m_vh_pipeline_layout,
+              .basePipelineHandle = vk::Pipeline{},
+              .basePipelineIndex = -1
+            };
+
+            // Create the compute pipeline.
+            pipeline = m_owning_window->logical_device()->create_compute_pipeline(m_pipeline_cache_task->vh_pipeline_cache(), pipeline_create_info
+                COMMA_CWDEBUG_ONLY(m_owning_window->debug_name_prefix("pipeline")));
+          }
+          else
+          {
+            vk::GraphicsPipelineCreateInfo pipeline_create_info{
+              .stageCount = static_cast<uint32_t>(pipeline_shader_stage_create_infos.size()),
+              .pStages = pipeline_shader_stage_create_infos.data(),
+              .pVertexInputState = uses_mesh_shader ? nullptr : &pipeline_vertex_input_state_create_info,
+              .pInputAssemblyState = uses_mesh_shader ? nullptr : &m_flat_create_info.m_pipeline_input_assembly_state_create_info,
+              .pTessellationState = nullptr,
+              .pViewportState = &viewport_state_create_info,
+              .pRasterizationState = &m_flat_create_info.m_rasterization_state_create_info,
+              .pMultisampleState = &m_flat_create_info.m_multisample_state_create_info,
+              .pDepthStencilState = &m_flat_create_info.m_depth_stencil_state_create_info,
+              .pColorBlendState = &m_flat_create_info.m_color_blend_state_create_info,
+              .pDynamicState = &pipeline_dynamic_state_create_info,
+              .layout = m_vh_pipeline_layout,
+              .renderPass = m_vh_render_pass,
+              .subpass = 0,
+              .basePipelineHandle = vk::Pipeline{},
+              .basePipelineIndex = -1
+            };
+
+            // Create the graphics pipeline.
+            pipeline = m_owning_window->logical_device()->create_graphics_pipeline(m_pipeline_cache_task->vh_pipeline_cache(), pipeline_create_info
+                COMMA_CWDEBUG_ONLY(m_owning_window->debug_name_prefix("pipeline")));
+          }
 
           // Inform the SynchronousWindow.
-          m_move_new_pipelines_synchronously->have_new_datum({vulkan::Pipeline{m_vh_pipeline_layout, {m_pipeline_factory_index, *pipeline_index_t::rat{m_pipeline_index}}, m_shader_input_data.descriptor_set_per_set_index(), m_owning_window->max_number_of_frame_resources()
-              COMMA_CWDEBUG_ONLY(m_owning_window->logical_device())}, std::move(pipeline)});
+          m_move_new_pipelines_synchronously->have_new_datum({vulkan::Pipeline{m_vh_pipeline_layout, {m_pipeline_factory_index, *pipeline_index_t::rat{m_pipeline_index}}, m_shader_input_data.descriptor_set_per_set_index(), m_owning_window->max_number_of_frame_resources(),
+              m_sorted_push_constant_ranges COMMA_CWDEBUG_ONLY(m_owning_window->logical_device())}, std::move(pipeline)});
         }
 
         //
@@ -447,7 +529,7 @@ multiloop_magic_footer:
           return;     // Yield and then continue here --------.
         }                                               //    |
       case PipelineFactory_bottom_multiloop_while_loop: // <--'
-        if (m_range_counters() < m_characteristics[vulkan::pipeline::CharacteristicRangeIndex{*m_range_counters}]->iend())
+        if (m_range_counters() < m_range_end[vulkan::pipeline::CharacteristicRangeIndex{*m_range_counters}])
         {
           run_state = PipelineFactory_top_multiloop_while_loop;
           set_state(PipelineFactory_top_multiloop_while_loop);
@@ -471,6 +553,12 @@ multiloop_magic_footer:
   }
 }
 
+void PipelineFactory::uses_shader(utils::Badge<vulkan::pipeline::CharacteristicRange>, vulkan::shader_builder::ShaderIndex shader_index)
+{
+  if (ShaderWatcher* shader_watcher = vulkan::Application::instance().shader_watcher())
+    shader_watcher->add_dependent(shader_index, m_owning_window, m_pipeline_factory_index);
+}
+
 void PipelineFactory::finish_impl()
 {
   // The characteristic range tasks never stopped running. We must kill them.
@@ -17,6 +17,7 @@ class LogicalDevice;
 
 namespace vulkan::pipeline {
 class FactoryCharacteristicId;
+class PipelineTable;
 } // namespace vulkan::pipeline
 
 namespace task {
@@ -50,6 +51,8 @@ class PipelineFactory : public AIStatefulTask
   characteristics_container_t m_characteristics;
   // Index into SynchronousWindow::m_pipeline_factories, pointing to ourselves.
   PipelineFactoryIndex m_pipeline_factory_index;
+  // The table (owned by m_owning_window) in which the generated pipelines are published.
+  vulkan::pipeline::PipelineTable* m_pipeline_table{};
 
   // run
   // initialize_impl.
@@ -64,6 +67,11 @@ class PipelineFactory : public AIStatefulTask
   utils::Vector<unsigned int, vulkan::pipeline::CharacteristicRangeIndex> m_range_shift;
   MultiLoop m_range_counters;
   int m_start_of_next_loop;
+  // State PipelineFactory_characteristics_initialized.
+  utils::Vector<int, vulkan::pipeline::CharacteristicRangeIndex> m_range_end;  // One past the last value of each loop (ibegin() + 1 for ranges that were collapsed into dynamic state).
+  std::vector<vk::DynamicState> m_collapsed_dynamic_states;                   // The dynamic state that replaces the collapsed characteristic ranges.
+  size_t m_number_of_pipelines;                                               // The number of pipelines that this factory generates.
+  size_t m_number_of_pipelines_without_dynamic_state;                          // The number of pipelines that would be generated without collapsing.
   std::atomic<size_t> m_number_of_running_characteristic_tasks;
   // State PipelineFactory_top_multiloop_while_loop
   vulkan::descriptor::SetIndexHintMap m_set_index_hint_map;
@@ -73,6 +81,8 @@ class PipelineFactory : public AIStatefulTask
   pipeline_index_t m_pipeline_index;
   // Layout of the current pipeline that is being created inside the MultiLoop.
   vk::PipelineLayout m_vh_pipeline_layout;
+  // The (packed) push constant ranges that m_vh_pipeline_layout was created with.
+  std::vector<vk::PushConstantRange> m_sorted_push_constant_ranges;
   // Set to true when calling ShaderInputData::update_missing_descriptor_sets while already having the set_layout_binding lock for the current pipeline/set_index/first_shader_resource.
   bool m_have_lock;
 
@@ -120,10 +130,15 @@ class PipelineFactory : public AIStatefulTask
   vulkan::pipeline::FactoryCharacteristicId add_characteristic(boost::intrusive_ptr<vulkan::pipeline::CharacteristicRange> characteristic_range);
   void generate() { signal(fully_initialized); }
   void set_index(PipelineFactoryIndex pipeline_factory_index) { m_pipeline_factory_index = pipeline_factory_index; }
+  void set_pipeline_table(vulkan::pipeline::PipelineTable* pipeline_table) { m_pipeline_table = pipeline_table; }
   void set_pipeline(vulkan::Pipeline&& pipeline) { m_pipeline_out = std::move(pipeline); }
   characteristics_container_t const& characteristics() const { return m_characteristics; }
   PipelineFactoryIndex pipeline_factory_index() const { return m_pipeline_factory_index; }
 
+  // Statistics, valid once all characteristics are initialized.
+  size_t number_of_pipelines() const { return m_number_of_pipelines; }
+  size_t number_of_pipelines_without_dynamic_state() const { return m_number_of_pipelines_without_dynamic_state; }
+
   // Called from CharacteristicRange::multiplex_impl.
   void characteristic_range_initialized();
   void characteristic_range_filled(vulkan::pipeline::CharacteristicRangeIndex index);
@@ -134,6 +149,9 @@ class PipelineFactory : public AIStatefulTask
   vulkan::pipeline::ShaderInputData const& shader_input_data(utils::Badge<vulkan::pipeline::CharacteristicRange>) const { return m_shader_input_data; }
   vulkan::pipeline::ShaderInputData& shader_input_data(utils::Badge<vulkan::pipeline::CharacteristicRange>) { return m_shader_input_data; }
 
+  // Called by CharacteristicRange::build_shader. Registers that this factory depends on shader_index (for shader hot-reload).
+  void uses_shader(utils::Badge<vulkan::pipeline::CharacteristicRange>, vulkan::shader_builder::ShaderIndex shader_index);
+
   // Called by SynchronousWindow::pipeline_factory_done to rescue the cache, immediately before deleting this task.
   inline boost::intrusive_ptr<PipelineCache> detach_pipeline_cache_task();
 };
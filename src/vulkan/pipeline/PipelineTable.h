@@ -0,0 +1,235 @@
+#pragma once
+
+#include "Handle.h"
+#include "utils/Badge.h"
+#include <vulkan/vulkan.hpp>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <span>
+#include <bit>
+#include "debug.h"
+
+namespace task {
+class PipelineFactory;
+class SynchronousWindow;
+} // namespace task
+
+namespace vulkan::pipeline {
+
+// PipelineTable
+//
+// A dense table with one slot for every pipeline that a PipelineFactory generates,
+// indexed by the values of its characteristic ranges.
+//
+// The slot of a pipeline is the mixed-radix number whose digits are the offsets of
+// the characteristic values into their ranges (in the order that the characteristics
+// were added to the factory):
+//
+//   slot = (value0 - begin0) * stride0 + (value1 - begin1) * stride1 + ...
+//
+// with stride0 = 1 and strideN = strideN-1 * (endN-1 - beginN-1). Unlike pipeline::Index,
+// which reserves a power of two for each range, this has no holes: the table contains
+// exactly PipelineFactory::number_of_pipelines() slots. A characteristic range that was
+// collapsed into dynamic state (see CharacteristicRange::set_dynamic_state_alternative)
+// has a stride of zero: every value of such a range maps to the slot of its ibegin().
+//
+// Usage (from the render loop, after create_pipeline_factory returned factory):
+//
+//   vulkan::pipeline::PipelineTable const& table = pipeline_table(factory.factory_index());
+//   ...
+//   vk::Pipeline vh_pipeline = table.lookup(cull_mode, topology);       // One value per characteristic.
+//   if (!vh_pipeline)
+//     return;                                                           // Still pending.
+//   command_buffer->bindPipeline(vk::PipelineBindPoint::eGraphics, vh_pipeline);
+//
+// Reading is lock-free and may happen while the factory is still generating pipelines
+// (from any thread that has a reference to the table): a slot is pending until the
+// SynchronousWindow received its pipeline (see SynchronousWindow::have_new_pipeline).
+// The whole table is pending until the factory finished initializing its characteristics.
+// When a factory is recreated (for example after a shader was reloaded) the table keeps
+// returning the old pipelines until they are replaced.
+//
+class PipelineTable
+{
+ public:
+  using index_type = int;               // The same as CharacteristicRange::index_type.
+
+  // The description of one characteristic range, passed to initialize.
+  struct Range
+  {
+    index_type m_begin;                 // CharacteristicRange::ibegin().
+    index_type m_end;                   // CharacteristicRange::iend().
+    bool m_collapsed;                   // Set if the range was collapsed into dynamic state.
+    unsigned int m_shift;               // The range_shift of this range in pipeline::Index.
+  };
+
+ private:
+  struct Radix
+  {
+    index_type m_begin;
+    index_type m_end;
+    size_t m_stride;                    // Zero if the range was collapsed.
+    unsigned int m_shift;
+    unsigned int m_mask;                // Mask of the range_width() bits at m_shift in pipeline::Index.
+
+    friend bool operator==(Radix const&, Radix const&) = default;
+  };
+
+  std::vector<Radix> m_radices;                         // One per characteristic range.
+  size_t m_number_of_slots{0};
+  size_t m_number_of_pipelines_without_dynamic_state{0};  // The number of slots there would be if no range was collapsed.
+  std::unique_ptr<std::atomic<VkPipeline>[]> m_slots;   // VK_NULL_HANDLE while pending.
+  std::atomic<bool> m_initialized{false};               // Set (with release semantics) after m_radices and m_slots were initialized.
+
+  std::vector<Radix> calculate_radices(std::vector<Range> const& ranges) const
+  {
+    std::vector<Radix> radices;
+    radices.reserve(ranges.size());
+    size_t stride = 1;
+    for (Range const& range : ranges)
+    {
+      // end is not included in the range. It must always be larger than begin.
+      ASSERT(range.m_end > range.m_begin);
+      unsigned int range_width = std::bit_width(static_cast<unsigned int>(range.m_end - range.m_begin - 1));
+      radices.push_back({range.m_begin, range.m_end, range.m_collapsed ? 0 : stride, range.m_shift, (1U << range_width) - 1});
+      if (!range.m_collapsed)
+        stride *= range.m_end - range.m_begin;
+    }
+    return radices;
+  }
+
+  size_t slot_of(size_t slot, size_t) const { return slot; }
+
+  template<typename... Values>
+  size_t slot_of(size_t slot, size_t radix, index_type value, Values... values) const
+  {
+    Radix const& r = m_radices[radix];
+    // Out of range.
+    ASSERT(r.m_begin <= value && value < r.m_end);
+    return slot_of(slot + static_cast<size_t>(value - r.m_begin) * r.m_stride, radix + 1, values...);
+  }
+
+ public:
+  PipelineTable() = default;
+  PipelineTable(PipelineTable const&) = delete;
+
+  // Called by the PipelineFactory once all characteristics are initialized, before any
+  // pipeline is generated. Calling it again with the same ranges (by a recreated factory)
+  // keeps the current pipelines.
+  void initialize(utils::Badge<task::PipelineFactory>, std::vector<Range> const& ranges) { initialize(ranges); }
+
+  // Called by SynchronousWindow::have_new_pipeline.
+  void store(utils::Badge<task::SynchronousWindow>, Index pipeline_index, vk::Pipeline vh_pipeline) { store(pipeline_index, vh_pipeline); }
+
+  // Only defined by tests, which use it to call the private initialize and store.
+  struct TestAccess;
+
+ private:
+  void initialize(std::vector<Range> const& ranges)
+  {
+    std::vector<Radix> radices = calculate_radices(ranges);
+    if (m_initialized.load(std::memory_order_acquire))
+    {
+      // Recreating a pipeline factory with different characteristic ranges is not supported.
+      ASSERT(radices == m_radices);
+      return;
+    }
+    size_t number_of_slots = 1;
+    size_t number_of_pipelines_without_dynamic_state = 1;
+    for (Range const& range : ranges)
+    {
+      if (!range.m_collapsed)
+        number_of_slots *= range.m_end - range.m_begin;
+      number_of_pipelines_without_dynamic_state *= range.m_end - range.m_begin;
+    }
+    m_radices = std::move(radices);
+    m_number_of_slots = number_of_slots;
+    m_number_of_pipelines_without_dynamic_state = number_of_pipelines_without_dynamic_state;
+    m_slots = std::make_unique<std::atomic<VkPipeline>[]>(number_of_slots);
+    for (size_t s = 0; s < number_of_slots; ++s)
+      m_slots[s].store(VK_NULL_HANDLE, std::memory_order_relaxed);
+    m_initialized.store(true, std::memory_order_release);
+  }
+
+  void store(Index pipeline_index, vk::Pipeline vh_pipeline)
+  {
+    // The factory must initialize the table before generating pipelines.
+    ASSERT(m_initialized.load(std::memory_order_relaxed));
+    m_slots[slot(pipeline_index)].store(static_cast<VkPipeline>(vh_pipeline), std::memory_order_release);
+  }
+
+ public:
+
+  // Returns true once the factory initialized the table (before that every slot is pending).
+  bool initialized() const { return m_initialized.load(std::memory_order_acquire); }
+
+  // The number of slots. Only valid when initialized() returned true.
+  size_t size() const { return m_number_of_slots; }
+  // The number of pipelines that would have been generated if no range was collapsed into dynamic state. Only valid when initialized() returned true.
+  size_t number_of_pipelines_without_dynamic_state() const { return m_number_of_pipelines_without_dynamic_state; }
+
+  // Returns true if the characteristic range with index radix (in the order that they were added to the factory)
+  // was collapsed into dynamic state; its state must then be set while recording the command buffer. Only valid when initialized() returned true.
+  bool collapsed(size_t radix) const { return m_radices[radix].m_stride == 0; }
+
+  // Convert a (bit-packed) pipeline::Index to its slot. Only valid when initialized() returned true.
+  size_t slot(Index pipeline_index) const
+  {
+    size_t packed = pipeline_index.get_value();
+    size_t slot = 0;
+    for (Radix const& r : m_radices)
+      slot += ((packed >> r.m_shift) & r.m_mask) * r.m_stride;
+    return slot;
+  }
+
+  // Return the slot of the pipeline with the given characteristic values, one per characteristic
+  // range in the order that they were added to the factory. Only valid when initialized() returned true.
+  template<typename... Values>
+  size_t slot(index_type value, Values... values) const
+  {
+    // Pass exactly one value per characteristic range.
+    ASSERT(1 + sizeof...(Values) == m_radices.size());
+    return slot_of(0, 0, value, values...);
+  }
+
+  size_t slot(std::span<index_type const> values) const
+  {
+    // Pass exactly one value per characteristic range.
+    ASSERT(values.size() == m_radices.size());
+    size_t slot = 0;
+    for (size_t radix = 0; radix < values.size(); ++radix)
+    {
+      Radix const& r = m_radices[radix];
+      // Out of range.
+      ASSERT(r.m_begin <= values[radix] && values[radix] < r.m_end);
+      slot += static_cast<size_t>(values[radix] - r.m_begin) * r.m_stride;
+    }
+    return slot;
+  }
+
+  // Return the pipeline in slot, or VK_NULL_HANDLE if it is still pending.
+  vk::Pipeline operator[](size_t slot) const
+  {
+    // Out of range.
+    ASSERT(slot < m_number_of_slots);
+    return m_slots[slot].load(std::memory_order_acquire);
+  }
+
+  // Return the pipeline for the given characteristic values, or VK_NULL_HANDLE if it is still pending.
+  template<typename... Values>
+  vk::Pipeline lookup(Values... values) const
+  {
+    if (!initialized())
+      return {};
+    return (*this)[slot(values...)];
+  }
+
+  template<typename... Values>
+  bool is_pending(Values... values) const
+  {
+    return !lookup(values...);
+  }
+};
+
+} // namespace vulkan::pipeline
@@ -0,0 +1,86 @@
+#include "sys.h"
+#include "PushConstantRanges.h"
+#include <algorithm>
+#ifdef CWDEBUG
+#include "debug/debug_ostream_operators.h"
+#include "vk_utils/print_flags.h"
+#endif
+
+namespace vulkan::pipeline {
+
+void PushConstantRanges::insert(vk::PushConstantRange const& push_constant_range)
+{
+  vk::ShaderStageFlagBits const shader_stage = static_cast<vk::ShaderStageFlagBits>(static_cast<vk::ShaderStageFlags::MaskType>(push_constant_range.stageFlags));
+  // Only pass ranges for a single stage.
+  ASSERT(vk::ShaderStageFlags{shader_stage} == push_constant_range.stageFlags);
+  // Push constant offsets and sizes must be a multiple of four.
+  ASSERT(push_constant_range.offset % 4 == 0 && push_constant_range.size % 4 == 0 && push_constant_range.size > 0);
+  // The range of a stage only grows while more push constants are found in its shader; replace the old one.
+  m_per_stage_range.insert_or_assign(shader_stage, push_constant_range);
+}
+
+std::vector<vk::PushConstantRange> PushConstantRanges::packed() const
+{
+  DoutEntering(dc::vulkan, "PushConstantRanges::packed() [" << this << "]");
+
+  // Collect all begin and end offsets of the per stage ranges.
+  std::vector<uint32_t> boundaries;
+  boundaries.reserve(2 * m_per_stage_range.size());
+  for (auto const& stage_range_pair : m_per_stage_range)
+  {
+    vk::PushConstantRange const& range = stage_range_pair.second;
+    boundaries.push_back(range.offset);
+    boundaries.push_back(range.offset + range.size);
+  }
+  std::sort(boundaries.begin(), boundaries.end());
+  boundaries.erase(std::unique(boundaries.begin(), boundaries.end()), boundaries.end());
+
+  // Every pair of consecutive boundaries defines an interval that is used by a fixed set of stages.
+  // Adjacent intervals that are used by the same set of stages are merged into a single range.
+  std::vector<vk::PushConstantRange> result;
+  for (size_t i = 1; i < boundaries.size(); ++i)
+  {
+    uint32_t const begin = boundaries[i - 1];
+    uint32_t const end = boundaries[i];
+    vk::ShaderStageFlags stage_flags;
+    for (auto const& stage_range_pair : m_per_stage_range)
+    {
+      vk::PushConstantRange const& range = stage_range_pair.second;
+      if (range.offset <= begin && end <= range.offset + range.size)
+        stage_flags |= stage_range_pair.first;
+    }
+    if (!stage_flags)                   // A gap that is not used by any stage.
+      continue;
+    if (!result.empty() && result.back().stageFlags == stage_flags && result.back().offset + result.back().size == begin)
+      result.back().size += end - begin;
+    else
+      result.push_back({ .stageFlags = stage_flags, .offset = begin, .size = end - begin });
+  }
+
+  Dout(dc::vulkan, "Returning " << result);
+  return result;
+}
+
+uint32_t PushConstantRanges::end_offset() const
+{
+  uint32_t end = 0;
+  for (auto const& stage_range_pair : m_per_stage_range)
+    end = std::max(end, stage_range_pair.second.offset + stage_range_pair.second.size);
+  return end;
+}
+
+#ifdef CWDEBUG
+void PushConstantRanges::print_on(std::ostream& os) const
+{
+  os << "{m_per_stage_range:{";
+  char const* prefix = "";
+  for (auto const& stage_range_pair : m_per_stage_range)
+  {
+    os << prefix << '{' << stage_range_pair.first << ", " << stage_range_pair.second << '}';
+    prefix = ", ";
+  }
+  os << "}}";
+}
+#endif
+
+} // namespace vulkan::pipeline
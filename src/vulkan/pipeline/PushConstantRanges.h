@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <vector>
+#include <map>
+#include <iosfwd>
+#include "debug.h"
+
+namespace vulkan::pipeline {
+
+// PushConstantRanges
+//
+// Collects the push constant range that is used by each shader stage
+// (as generated by PushConstantDeclarationContext::glsl_id_full_is_used_in)
+// and turns those into the smallest list of non-overlapping ranges
+// that can be passed to vk::PipelineLayoutCreateInfo.
+//
+// For example, if the vertex shader uses bytes [8, 20> and the fragment
+// shader uses bytes [4, 16> of the push constant struct, then packed() returns:
+//
+//   { offset: 4,  size: 4, stageFlags: eFragment }
+//   { offset: 8,  size: 8, stageFlags: eVertex|eFragment }
+//   { offset: 16, size: 4, stageFlags: eVertex }
+//
+// Each byte is covered by at most one range and the stageFlags of that range
+// are exactly the stages that use the byte. As a result every pushConstants
+// call that falls inside a single packed range is valid with the stageFlags
+// of that range, which is what pipeline::PushConstantUpdater relies on.
+//
+class PushConstantRanges
+{
+ private:
+  std::map<vk::ShaderStageFlagBits, vk::PushConstantRange> m_per_stage_range;   // The range of bytes used by each stage.
+
+ public:
+  // Set (or replace) the range used by the single shader stage in push_constant_range.stageFlags.
+  void insert(vk::PushConstantRange const& push_constant_range);
+
+  // Return the packed (non-overlapping, sorted by offset) push constant ranges.
+  std::vector<vk::PushConstantRange> packed() const;
+
+  // Return one beyond the largest byte offset used by any stage.
+  uint32_t end_offset() const;
+
+  bool empty() const { return m_per_stage_range.empty(); }
+
+#ifdef CWDEBUG
+  void print_on(std::ostream& os) const;
+#endif
+};
+
+} // namespace vulkan::pipeline
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "Pipeline.h"
+#include "shader_builder/ShaderVariableLayouts.h"
+#include <vulkan/vulkan.hpp>
+#include <bitset>
+#include <cstring>
+#include "debug.h"
+
+namespace vulkan::pipeline {
+
+// PushConstantUpdater
+//
+// Keeps a host copy of a push constant struct ENTRY and writes the bytes that changed
+// since the last flush to a command buffer, using the smallest possible number of
+// pushConstants calls.
+//
+// Usage:
+//
+//   vulkan::pipeline::PushConstantUpdater<PushConstant> m_push_constant_updater;
+//
+//   // After command_buffer->begin(...): push constant values are undefined at the start of a command buffer.
+//   m_push_constant_updater.invalidate();
+//   ...
+//   command_buffer->bindPipeline(vk::PipelineBindPoint::eGraphics, vh_graphics_pipeline(m_graphics_pipeline.handle()));
+//   m_push_constant_updater.set<&PushConstant::aspect_scale>(scaling_factor);
+//   m_push_constant_updater.flush(command_buffer, m_graphics_pipeline);
+//
+// flush uses the (packed) push constant ranges of the pipeline, see PushConstantRanges:
+// a run of dirty bytes is split at the boundaries of those ranges and written with
+// the stageFlags of the range it falls in. Bytes that are not used by any shader stage
+// of the pipeline are never written. When flush is called for a pipeline with a
+// different layout than the previous call then all bytes are considered dirty.
+//
+template<typename ENTRY>
+requires (std::same_as<typename shader_builder::ShaderVariableLayouts<ENTRY>::tag_type, glsl::push_constant_std430>)
+class PushConstantUpdater
+{
+ private:
+  static_assert(sizeof(ENTRY) % 4 == 0, "The size of a push constant struct must be a multiple of four.");
+  static constexpr size_t s_number_of_words = sizeof(ENTRY) / 4;        // Push constants are updated in multiples of four bytes.
+
+  ENTRY m_data{};                                               // Host copy of the push constant values.
+  std::bitset<s_number_of_words> m_dirty;                       // Set bits correspond to four byte words that must still be written.
+  vk::PipelineLayout m_vh_last_layout;                          // The layout used by the last call to flush.
+#ifdef CWDEBUG
+  int m_number_of_push_constants_calls{0};                      // Total number of pushConstants calls, for statistics.
+#endif
+
+  void mark_dirty(uint32_t offset, uint32_t size)
+  {
+    for (uint32_t word = offset / 4; word < (offset + size + 3) / 4; ++word)
+      m_dirty.set(word);
+  }
+
+ public:
+  PushConstantUpdater() { m_dirty.set(); }
+
+  // Set a member of ENTRY. The bytes of the member are only marked dirty when the value changed.
+  template<auto member, typename T>
+  void set(T const& value)
+  {
+    auto& dest = m_data.*member;
+    static_assert(sizeof(dest) == sizeof(T), "Type mismatch between member and value.");
+    if (std::memcmp(&dest, &value, sizeof(T)) == 0)
+      return;
+    std::memcpy(&dest, &value, sizeof(T));
+    uint32_t const offset = reinterpret_cast<char const*>(&dest) - reinterpret_cast<char const*>(&m_data);
+    mark_dirty(offset, sizeof(T));
+  }
+
+  // Replace all values at once; only the words that actually changed are marked dirty.
+  void set(ENTRY const& data)
+  {
+    char const* src = reinterpret_cast<char const*>(&data);
+    char* dest = reinterpret_cast<char*>(&m_data);
+    for (uint32_t offset = 0; offset < sizeof(ENTRY); offset += 4)
+    {
+      if (std::memcmp(dest + offset, src + offset, 4) != 0)
+      {
+        std::memcpy(dest + offset, src + offset, 4);
+        m_dirty.set(offset / 4);
+      }
+    }
+  }
+
+  // Accessor.
+  ENTRY const& data() const { return m_data; }
+
+  // Mark everything dirty; call this after beginning a new command buffer.
+  void invalidate() { m_dirty.set(); m_vh_last_layout = vk::PipelineLayout{}; }
+
+  // Write all dirty bytes that are used by pipeline to command_buffer.
+  void flush(vk::CommandBuffer command_buffer, Pipeline const& pipeline)
+  {
+    if (pipeline.layout() != m_vh_last_layout)
+    {
+      // Binding a pipeline with a layout that is not compatible for push constants disturbs all push constant values.
+      m_dirty.set();
+      m_vh_last_layout = pipeline.layout();
+    }
+    if (m_dirty.none())
+      return;
+    char const* data = reinterpret_cast<char const*>(&m_data);
+    // The ranges are sorted by offset and do not overlap.
+    for (vk::PushConstantRange const& range : pipeline.push_constant_ranges())
+    {
+      // The push constant ranges were generated from ENTRY.
+      ASSERT(range.offset + range.size <= s_number_of_words * 4);
+      uint32_t const end_word = (range.offset + range.size) / 4;
+      uint32_t word = range.offset / 4;
+      while (word < end_word)
+      {
+        // Find the next run of dirty words inside this range.
+        while (word < end_word && !m_dirty.test(word))
+          ++word;
+        uint32_t const begin_word = word;
+        while (word < end_word && m_dirty.test(word))
+          ++word;
+        if (begin_word == word)
+          break;
+        uint32_t const offset = begin_word * 4;
+        uint32_t const size = (word - begin_word) * 4;
+        command_buffer.pushConstants(pipeline.layout(), range.stageFlags, offset, size, data + offset);
+        Debug(++m_number_of_push_constants_calls);
+      }
+    }
+    // Anything that isn't covered by a range isn't used by the shaders of this pipeline.
+    m_dirty.reset();
+  }
+
+#ifdef CWDEBUG
+  int number_of_push_constants_calls() const { return m_number_of_push_constants_calls; }
+#endif
+};
+
+} // namespace vulkan::pipeline
@@ -684,15 +684,29 @@ std::string_view ShaderInputData::preprocess2(
     }
   }
 
+  // #extension directives at the top of the template code must precede the generated declarations.
+  size_t directives_end = 0;
+  for (;;)
+  {
+    size_t const line_begin = source.find_first_not_of(" \t\n", directives_end);
+    if (line_begin == std::string_view::npos || !source.substr(line_begin).starts_with("#extension"))
+      break;
+    size_t const line_end = source.find('\n', line_begin);
+    directives_end = line_end == std::string_view::npos ? source.length() : line_end + 1;
+  }
+  // The directives may not contain shader variables.
+  ASSERT(positions.empty() || positions.begin()->first >= directives_end);
+
   static constexpr char const* version_header = "#version 450\n\n";
   size_t final_source_code_size = std::strlen(version_header) + declarations.length() + source.length() + id_to_name_growth;
 
   glsl_source_code_buffer.reserve(utils::malloc_size(final_source_code_size + 1) - 1);
   glsl_source_code_buffer = version_header;
+  glsl_source_code_buffer += source.substr(0, directives_end);
   glsl_source_code_buffer += declarations.content();
 
   // Next copy alternating, the characters in between the strings and the replacements of the substrings.
-  size_t start = 0;
+  size_t start = directives_end;
   for (auto&& p : positions)
   {
     // Copy the characters leading up to the string at position p.
@@ -1,7 +1,7 @@
 #ifndef VULKAN_PIPELINE_SHADER_INPUT_DATA_H
 #define VULKAN_PIPELINE_SHADER_INPUT_DATA_H
 
-#include "PushConstantRangeCompare.h"
+#include "PushConstantRanges.h"
 #include "descriptor/SetLayout.h"
 #include "descriptor/SetKeyToShaderResourceDeclaration.h"
 #include "descriptor/SetKeyPreference.h"
@@ -92,7 +92,7 @@ class ShaderInputData
   using glsl_id_full_to_push_constant_container_t = std::map<std::string, shader_builder::PushConstant, std::less<>>;
   glsl_id_full_to_push_constant_container_t m_glsl_id_full_to_push_constant;                    // Map PushConstant::m_glsl_id_full to the PushConstant object that contains it.
 
-  std::set<vk::PushConstantRange, PushConstantRangeCompare> m_push_constant_ranges;
+  PushConstantRanges m_push_constant_ranges;                                                    // The push constant range used by each shader stage.
   //---------------------------------------------------------------------------
 
   //---------------------------------------------------------------------------
@@ -314,17 +314,16 @@ class ShaderInputData
       utils::Badge<shader_builder::ShaderResourceDeclarationContext>);
 
   // Called from PushConstantDeclarationContext::glsl_id_full_is_used_in.
+  // Replaces the range previously added for the same shader stage, if any.
   void insert(vk::PushConstantRange const& push_constant_range)
   {
-    auto range = m_push_constant_ranges.equal_range(push_constant_range);
-    m_push_constant_ranges.erase(range.first, range.second);
     m_push_constant_ranges.insert(push_constant_range);
   }
 
-  // Access what calls to the above insert constructed.
+  // Access what calls to the above insert constructed: the packed, non-overlapping ranges sorted by offset.
   std::vector<vk::PushConstantRange> push_constant_ranges(utils::Badge<CharacteristicRange>) const
   {
-    return { m_push_constant_ranges.begin(), m_push_constant_ranges.end() };
+    return m_push_constant_ranges.packed();
   }
 
   //---------------------------------------------------------------------------
@@ -0,0 +1,78 @@
+#include "sys.h"
+#include "AsyncUploadScheduler.h"
+#include "debug.h"
+
+namespace task {
+
+char const* AsyncUploadScheduler::condition_str_impl(condition_type condition) const
+{
+  switch (condition)
+  {
+    AI_CASE_RETURN(have_uploads);
+    AI_CASE_RETURN(frame_timer);
+  }
+  return direct_base_type::condition_str_impl(condition);
+}
+
+char const* AsyncUploadScheduler::state_str_impl(state_type run_state) const
+{
+  switch (run_state)
+  {
+    AI_CASE_RETURN(AsyncUploadScheduler_dispatch);
+    AI_CASE_RETURN(AsyncUploadScheduler_done);
+  }
+  AI_NEVER_REACHED
+}
+
+char const* AsyncUploadScheduler::task_name_impl() const
+{
+  return "AsyncUploadScheduler";
+}
+
+void AsyncUploadScheduler::initialize_impl()
+{
+  set_state(AsyncUploadScheduler_dispatch);
+}
+
+void AsyncUploadScheduler::stop_timer()
+{
+  if (!m_frame_timer.stop())
+  {
+    // We could not stop the timer from firing. Wait until it returned from expire().
+    m_frame_timer.wait_for_possible_expire_to_finish();
+  }
+}
+
+void AsyncUploadScheduler::multiplex_impl(state_type run_state)
+{
+  switch (run_state)
+  {
+    case AsyncUploadScheduler_dispatch:
+      // The timer is only started when we wait for it, so it isn't running when we get here.
+      if (!m_terminate)
+      {
+        if (m_scheduler.dispatch())
+        {
+          // Continue with the next frame budget.
+          m_frame_timer.start(m_frame_interval);
+          wait(frame_timer);
+        }
+        else
+          wait(have_uploads);
+        break;
+      }
+      set_state(AsyncUploadScheduler_done);
+      [[fallthrough]];
+    case AsyncUploadScheduler_done:
+      finish();
+      break;
+  }
+}
+
+void AsyncUploadScheduler::abort_impl()
+{
+  DoutEntering(dc::vulkan, "AsyncUploadScheduler::abort_impl()");
+  stop_timer();
+}
+
+} // namespace task
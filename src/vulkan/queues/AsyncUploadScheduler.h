@@ -0,0 +1,82 @@
+#pragma once
+
+#include "AsyncTask.h"
+#include "UploadScheduler.h"
+#include "threadpool/Timer.h"
+#include <atomic>
+
+namespace task {
+
+// AsyncUploadScheduler
+//
+// Drives a vulkan::UploadScheduler: calls dispatch() once per frame period for as long as there are uploads
+// queued, and sleeps (without a running timer) when there are none. The timer is started after dispatch(),
+// only when there are uploads left; the time spent in dispatch() doesn't matter because the budget is a rate. An upload that is enqueued while the task
+// sleeps is dispatched immediately; the budget of the scheduler is a rate, so that doesn't increase the number
+// of bytes that can be admitted per frame.
+//
+// Each LogicalDevice has one, see LogicalDevice::upload_scheduler(). The task runs until terminate() is called
+// (by LogicalDevice::terminate_upload_scheduler, from Application::run).
+//
+class AsyncUploadScheduler : public vulkan::AsyncTask
+{
+ public:
+  static constexpr condition_type have_uploads = 1;
+  static constexpr condition_type frame_timer = 2;
+
+ private:
+  vulkan::UploadScheduler m_scheduler;
+  threadpool::Timer::Interval m_frame_interval{threadpool::Interval<16, std::chrono::milliseconds>{}};  // Should correspond with UploadBudget::m_frame_period.
+  threadpool::Timer m_frame_timer{[this](){ signal(frame_timer); }};
+  std::atomic_bool m_terminate{false};
+
+ protected:
+  using direct_base_type = vulkan::AsyncTask;
+
+  // The different states of the task.
+  enum AsyncUploadScheduler_state_type {
+    AsyncUploadScheduler_dispatch = direct_base_type::state_end,
+    AsyncUploadScheduler_done
+  };
+
+ public:
+  static state_type constexpr state_end = AsyncUploadScheduler_done + 1;
+
+  AsyncUploadScheduler(CWDEBUG_ONLY(bool debug = false)) : direct_base_type(CWDEBUG_ONLY(debug)) { }
+
+  // Thread-safe. Change the budget per frame.
+  void set_budget(vulkan::UploadBudget const& budget) { m_scheduler.set_budget(budget); }
+
+  // Thread-safe. Queue an upload of size bytes; admit is called with the batch number once it may start.
+  void enqueue(size_t size, vulkan::UploadPriority priority, vulkan::UploadScheduler::admit_callback_type admit)
+  {
+    m_scheduler.enqueue(size, priority, std::move(admit));
+    signal(have_uploads);
+  }
+
+  // Thread-safe. Called when an upload that was admitted as part of batch finished.
+  void completed(uint64_t batch) { m_scheduler.completed(batch); }
+
+  // Thread-safe. Stop the task; uploads that are still queued are never admitted.
+  void terminate() { m_terminate = true; signal(have_uploads); }
+
+  // Thread-safe. Statistics: per priority class the queue depth and the latency between enqueue and admission.
+  vulkan::UploadScheduler::Stats stats() const { return m_scheduler.stats(); }
+  size_t queue_depth() const { return m_scheduler.queue_depth(); }
+
+ protected:
+  ~AsyncUploadScheduler() override = default;
+
+  // Implementation of virtual functions of AIStatefulTask.
+  char const* condition_str_impl(condition_type condition) const override;
+  char const* state_str_impl(state_type run_state) const override;
+  char const* task_name_impl() const override;
+  void initialize_impl() override;
+  void multiplex_impl(state_type run_state) override;
+  void abort_impl() override;
+
+ private:
+  void stop_timer();
+};
+
+} // namespace task
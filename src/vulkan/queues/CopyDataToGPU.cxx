@@ -1,6 +1,7 @@
 #include "sys.h"
 #include "CopyDataToGPU.h"
 #include "SynchronousWindow.h"
+#include "AsyncUploadScheduler.h"
 #include "memory/StagingBuffer.h"
 
 namespace task {
@@ -10,11 +11,21 @@ CopyDataToGPU::~CopyDataToGPU()
   DoutEntering(dc::vulkan, "CopyDataToGPU::~CopyDataToGPU() [" << this << "]");
 }
 
+char const* CopyDataToGPU::condition_str_impl(condition_type condition) const
+{
+  switch (condition)
+  {
+    AI_CASE_RETURN(upload_admitted);
+  }
+  return direct_base_type::condition_str_impl(condition);
+}
+
 char const* CopyDataToGPU::state_str_impl(state_type run_state) const
 {
   switch(run_state)
   {
     AI_CASE_RETURN(CopyDataToGPU_start);
+    AI_CASE_RETURN(CopyDataToGPU_admitted);
     AI_CASE_RETURN(CopyDataToGPU_write);
     AI_CASE_RETURN(CopyDataToGPU_flush);
     AI_CASE_RETURN(CopyDataToGPU_done);
@@ -54,7 +65,21 @@ void CopyDataToGPU::multiplex_impl(state_type run_state)
   {
     case CopyDataToGPU_start:
     {
-      ZoneScopedN("CopyDataToGPU_start");
+      // Wait until the upload scheduler admits us. Uploads that are admitted together end up in the same
+      // batch of submits of the ImmediateSubmitQueue.
+      vulkan::LogicalDevice const* logical_device = m_submit_request.logical_device();
+      set_state(CopyDataToGPU_admitted);
+      logical_device->upload_scheduler().enqueue(m_data_size, m_upload_priority,
+          [self = boost::intrusive_ptr<CopyDataToGPU>(this)](uint64_t batch){
+            self->m_upload_batch = batch;
+            self->signal(upload_admitted);
+          });
+      wait(upload_admitted);
+      return;
+    }
+    case CopyDataToGPU_admitted:
+    {
+      ZoneScopedN("CopyDataToGPU_admitted");
       vulkan::LogicalDevice const* logical_device = m_submit_request.logical_device();
       // Create staging buffer and map its memory to copy data from the CPU.
       m_staging_buffer = vulkan::memory::StagingBuffer(logical_device, m_data_size
@@ -97,6 +122,7 @@ void CopyDataToGPU::multiplex_impl(state_type run_state)
     case CopyDataToGPU_done:
     {
       ZoneScopedN("CopyDataToGPU_done");
+      m_submit_request.logical_device()->upload_scheduler().completed(m_upload_batch);
       finish();
       return;
     }
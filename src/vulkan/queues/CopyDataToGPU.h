@@ -1,6 +1,7 @@
 #pragma once
 
 #include "ImmediateSubmit.h"
+#include "UploadScheduler.h"
 #include "memory/StagingBuffer.h"
 #include "memory/DataFeeder.h"
 #include "statefultask/RunningTasksTracker.h"
@@ -10,12 +11,17 @@ namespace task {
 
 class CopyDataToGPU : public ImmediateSubmit
 {
+ public:
+  static constexpr condition_type upload_admitted = 2;
+
  protected:
   std::unique_ptr<vulkan::DataFeeder> m_data_feeder;
   vulkan::memory::StagingBuffer m_staging_buffer;
   uint32_t m_data_size;
   SynchronousWindow const* m_resource_owner;                    // If any resources that this task uses are part of a window, then this should be set.
   statefultask::RunningTasksTracker::index_type m_index;        // Our index, if added to m_resource_owner.
+  vulkan::UploadPriority m_upload_priority;                     // The priority class used for the upload scheduler of the logical device.
+  uint64_t m_upload_batch;                                      // The batch number that the upload scheduler admitted us with.
 
  protected:
   using direct_base_type = ImmediateSubmit;
@@ -23,6 +29,7 @@ class CopyDataToGPU : public ImmediateSubmit
   // The different states of this task.
   enum CopyDataToGPU_state_type {
     CopyDataToGPU_start = direct_base_type::state_end,
+    CopyDataToGPU_admitted,
     CopyDataToGPU_write,
     CopyDataToGPU_flush,
     CopyDataToGPU_done
@@ -35,7 +42,8 @@ class CopyDataToGPU : public ImmediateSubmit
   CopyDataToGPU(vulkan::LogicalDevice const* logical_device, uint32_t data_size
       COMMA_CWDEBUG_ONLY(bool debug)) :
     ImmediateSubmit({logical_device, this}, CopyDataToGPU_done COMMA_CWDEBUG_ONLY(debug)),
-    m_data_size(data_size), m_resource_owner(nullptr), m_index(statefultask::RunningTasksTracker::s_aborted)
+    m_data_size(data_size), m_resource_owner(nullptr), m_index(statefultask::RunningTasksTracker::s_aborted),
+    m_upload_priority(vulkan::UploadPriority::visible_now), m_upload_batch(0)
   {
     DoutEntering(dc::vulkan, "CopyDataToGPU(" << logical_device << ", " << data_size << ")");
   }
@@ -45,6 +53,12 @@ class CopyDataToGPU : public ImmediateSubmit
     m_resource_owner = resource_owner;
   }
 
+  // The default is visible_now: the data is needed by the frame that is being rendered.
+  void set_upload_priority(vulkan::UploadPriority upload_priority)
+  {
+    m_upload_priority = upload_priority;
+  }
+
   void set_data_feeder(std::unique_ptr<vulkan::DataFeeder> data_feeder)
   {
     m_data_feeder = std::move(data_feeder);
@@ -58,6 +72,7 @@ class CopyDataToGPU : public ImmediateSubmit
 
   void initialize_impl() override;
   void finish_impl() override;
+  char const* condition_str_impl(condition_type condition) const override;
   char const* state_str_impl(state_type run_state) const override;
   void multiplex_impl(state_type run_state) override;
 };
@@ -1,5 +1,6 @@
 #include "sys.h"
 #include "CopyDataToImage.h"
+#include <algorithm>
 
 namespace task {
 
@@ -17,16 +18,30 @@ void CopyDataToImage::record_command_buffer(vulkan::handle::CommandBuffer comman
     .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
     .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
     .image = m_vh_target_image,
-    .subresourceRange = m_image_subresource_range
+    .subresourceRange = m_barrier_subresource_range
   };
   command_buffer->pipelineBarrier(m_generating_stages, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(0), {}, {}, { pre_transfer_image_memory_barrier });
 
+  // The staging buffer contains the mip levels of the range tightly packed, finest level first; m_extent is the extent of the first level.
+  auto level_extent = [this](uint32_t i) -> vk::Extent2D {
+    uint32_t const shift = i - m_image_subresource_range.baseMipLevel;
+    return { std::max(1U, m_extent.width >> shift), std::max(1U, m_extent.height >> shift) };
+  };
+  vk::DeviceSize texels = 0;
+  for (uint32_t i = m_image_subresource_range.baseMipLevel; i < m_image_subresource_range.baseMipLevel + m_image_subresource_range.levelCount; ++i)
+    texels += vk::DeviceSize{level_extent(i).width} * level_extent(i).height;
+  // Only uncompressed formats are supported.
+  ASSERT(m_data_size % (texels * m_image_subresource_range.layerCount) == 0);
+  vk::DeviceSize const texel_size = m_data_size / (texels * m_image_subresource_range.layerCount);
+
   std::vector<vk::BufferImageCopy> buffer_image_copy;
   buffer_image_copy.reserve(m_image_subresource_range.levelCount);
+  vk::DeviceSize buffer_offset = 0;
   for (uint32_t i = m_image_subresource_range.baseMipLevel; i < m_image_subresource_range.baseMipLevel + m_image_subresource_range.levelCount; ++i)
   {
+    vk::Extent2D const extent = level_extent(i);
     buffer_image_copy.emplace_back(vk::BufferImageCopy{
-      .bufferOffset = 0,
+      .bufferOffset = buffer_offset,
       .bufferRowLength = 0,
       .bufferImageHeight = 0,
       .imageSubresource = vk::ImageSubresourceLayers{
@@ -37,23 +52,108 @@ void CopyDataToImage::record_command_buffer(vulkan::handle::CommandBuffer comman
       },
       .imageOffset = vk::Offset3D{},
       .imageExtent = vk::Extent3D{
-        .width = m_extent.width,
-        .height = m_extent.height,
+        .width = extent.width,
+        .height = extent.height,
         .depth = 1
       }
     });
+    buffer_offset += texel_size * extent.width * extent.height * m_image_subresource_range.layerCount;
   }
   command_buffer->copyBufferToImage(m_staging_buffer.m_vh_buffer, m_vh_target_image, vk::ImageLayout::eTransferDstOptimal, buffer_image_copy);
 
+  if (m_generated_level_count > 1)
+    record_mip_generation(command_buffer);
+  else
+    record_post_transfer_barrier(command_buffer);
+}
+
+void CopyDataToImage::record_mip_generation(vulkan::handle::CommandBuffer command_buffer)
+{
+  DoutEntering(dc::vulkan, "CopyDataToImage::record_mip_generation(" << command_buffer << ") [" << m_generated_level_count << " levels]");
+  record_mip_blits(command_buffer, m_vh_target_image, m_barrier_subresource_range, m_extent, m_new_image_layout, m_new_image_access, m_consuming_stages);
+  command_buffer->end();
+}
+
+//static
+void CopyDataToImage::record_mip_blits(vk::CommandBuffer command_buffer, vk::Image vh_image, vk::ImageSubresourceRange const& levels,
+    vk::Extent2D extent, vk::ImageLayout new_image_layout, vk::AccessFlags new_image_access, vk::PipelineStageFlags consuming_stages)
+{
+  // All levels are in eTransferDstOptimal. Each level is turned into eTransferSrcOptimal after it was written,
+  // so that the next level can be blitted from it.
+  ASSERT(levels.baseMipLevel == 0);
+  uint32_t const level_count = levels.levelCount;
+  vk::ImageMemoryBarrier barrier{
+    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .image = vh_image,
+    .subresourceRange = levels
+  };
+  barrier.subresourceRange.levelCount = 1;
+
+  int32_t width = extent.width;
+  int32_t height = extent.height;
+  for (uint32_t level = 1; level < level_count; ++level)
+  {
+    barrier.subresourceRange.baseMipLevel = level - 1;
+    barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+    barrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
+    barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+    barrier.newLayout = vk::ImageLayout::eTransferSrcOptimal;
+    command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(0), {}, {}, { barrier });
+
+    int32_t const next_width = std::max(1, width / 2);
+    int32_t const next_height = std::max(1, height / 2);
+    vk::ImageBlit const blit{
+      .srcSubresource = vk::ImageSubresourceLayers{
+        .aspectMask = levels.aspectMask,
+        .mipLevel = level - 1,
+        .baseArrayLayer = levels.baseArrayLayer,
+        .layerCount = levels.layerCount
+      },
+      .srcOffsets = std::array<vk::Offset3D, 2>{ vk::Offset3D{ 0, 0, 0 }, vk::Offset3D{ width, height, 1 } },
+      .dstSubresource = vk::ImageSubresourceLayers{
+        .aspectMask = levels.aspectMask,
+        .mipLevel = level,
+        .baseArrayLayer = levels.baseArrayLayer,
+        .layerCount = levels.layerCount
+      },
+      .dstOffsets = std::array<vk::Offset3D, 2>{ vk::Offset3D{ 0, 0, 0 }, vk::Offset3D{ next_width, next_height, 1 } }
+    };
+    command_buffer.blitImage(vh_image, vk::ImageLayout::eTransferSrcOptimal, vh_image, vk::ImageLayout::eTransferDstOptimal,
+        { blit }, vk::Filter::eLinear);
+    width = next_width;
+    height = next_height;
+  }
+
+  // Transition all levels to the new layout: all but the last one are in eTransferSrcOptimal now.
+  vk::ImageMemoryBarrier source_levels_barrier = barrier;
+  source_levels_barrier.subresourceRange.baseMipLevel = 0;
+  source_levels_barrier.subresourceRange.levelCount = level_count - 1;
+  source_levels_barrier.srcAccessMask = vk::AccessFlagBits::eTransferRead;
+  source_levels_barrier.dstAccessMask = new_image_access;
+  source_levels_barrier.oldLayout = vk::ImageLayout::eTransferSrcOptimal;
+  source_levels_barrier.newLayout = new_image_layout;
+  vk::ImageMemoryBarrier last_level_barrier = barrier;
+  last_level_barrier.subresourceRange.baseMipLevel = level_count - 1;
+  last_level_barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+  last_level_barrier.dstAccessMask = new_image_access;
+  last_level_barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+  last_level_barrier.newLayout = new_image_layout;
+  command_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, consuming_stages, vk::DependencyFlags(0), {}, {},
+      { source_levels_barrier, last_level_barrier });
+}
+
+void CopyDataToImage::record_post_transfer_barrier(vulkan::handle::CommandBuffer command_buffer)
+{
   vk::ImageMemoryBarrier post_transfer_image_memory_barrier{
     .srcAccessMask = vk::AccessFlagBits::eTransferWrite,
     .dstAccessMask = m_new_image_access,
     .oldLayout = vk::ImageLayout::eTransferDstOptimal,
     .newLayout = m_new_image_layout,
-    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+    .srcQueueFamilyIndex = m_release_src_queue_family,
+    .dstQueueFamilyIndex = m_release_dst_queue_family,
     .image = m_vh_target_image,
-    .subresourceRange = m_image_subresource_range
+    .subresourceRange = m_barrier_subresource_range
   };
   command_buffer->pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, m_consuming_stages, vk::DependencyFlags(0), {}, {}, { post_transfer_image_memory_barrier });
   command_buffer->end();
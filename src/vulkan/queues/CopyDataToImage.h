@@ -11,12 +11,16 @@ class CopyDataToImage final : public CopyDataToGPU
   vk::Image m_vh_target_image;
   vk::Extent2D m_extent;
   vk_defaults::ImageSubresourceRange const m_image_subresource_range;
+  vk::ImageSubresourceRange m_barrier_subresource_range;        // The range that is transitioned; by default m_image_subresource_range.
   vk::ImageLayout m_current_image_layout;
   vk::AccessFlags m_current_image_access;
   vk::PipelineStageFlags m_generating_stages;
   vk::ImageLayout m_new_image_layout;
   vk::AccessFlags m_new_image_access;
   vk::PipelineStageFlags m_consuming_stages;
+  uint32_t m_generated_level_count = 0;                         // If non-zero, the total number of mip levels after generating them from level 0.
+  uint32_t m_release_src_queue_family = VK_QUEUE_FAMILY_IGNORED;        // If not ignored, the final barrier releases the image from this queue family...
+  uint32_t m_release_dst_queue_family = VK_QUEUE_FAMILY_IGNORED;        // ...to this one.
 
  public:
   // Construct a CopyDataToImage object.
@@ -27,6 +31,7 @@ class CopyDataToImage final : public CopyDataToGPU
       COMMA_CWDEBUG_ONLY(bool debug)) :
     CopyDataToGPU(logical_device, data_size COMMA_CWDEBUG_ONLY(debug)),
     m_vh_target_image(vh_target_image), m_extent(extent), m_image_subresource_range(image_subresource_range),
+    m_barrier_subresource_range(image_subresource_range),
     m_current_image_layout(current_image_layout), m_current_image_access(current_image_access), m_generating_stages(generating_stages),
     m_new_image_layout(new_image_layout), m_new_image_access(new_image_access), m_consuming_stages(consuming_stages)
   {
@@ -35,8 +40,45 @@ class CopyDataToImage final : public CopyDataToGPU
         generating_stages << ", " << new_image_layout << ", " << new_image_access << ", " << consuming_stages << ")");
   }
 
+  // Transition barrier_subresource_range (which must contain the range that is copied to) instead of just the copied range.
+  // This is used to give mip levels that are uploaded later a defined layout (see ProgressiveTextureUpload).
+  void set_barrier_subresource_range(vk::ImageSubresourceRange const& barrier_subresource_range)
+  {
+    m_barrier_subresource_range = barrier_subresource_range;
+  }
+
+  // Only upload mip level 0 and generate levels [1, level_count) from it with a chain of linear blits.
+  // All levels of the copied layers are transitioned. The image must have been created with eTransferSrc usage,
+  // and LogicalDevice::supports_blit_mip_generation must return true for its format.
+  void set_generate_mip_levels(uint32_t level_count)
+  {
+    // Only the first level may be uploaded.
+    ASSERT(m_image_subresource_range.baseMipLevel == 0 && m_image_subresource_range.levelCount == 1);
+    m_generated_level_count = level_count;
+    m_barrier_subresource_range.baseMipLevel = 0;
+    m_barrier_subresource_range.levelCount = level_count;
+  }
+
+  // Make the final barrier release ownership of the barrier subresource range from src_queue_family (the queue family of
+  // the transfer queue) to dst_queue_family. The new layout must then be the layout that the acquiring barrier, recorded
+  // on a queue of dst_queue_family, transitions from. Not compatible with set_generate_mip_levels.
+  void set_release_ownership(uint32_t src_queue_family, uint32_t dst_queue_family)
+  {
+    ASSERT(m_generated_level_count == 0);
+    m_release_src_queue_family = src_queue_family;
+    m_release_dst_queue_family = dst_queue_family;
+  }
+
+  // Record the generation of levels [1, levels.levelCount) of vh_image from level 0 with a chain of linear blits.
+  // All levels must be in eTransferDstOptimal, with the contents of level 0 available to transfer reads; afterwards
+  // they are all in new_image_layout. command_buffer must belong to a queue with graphics capability.
+  static void record_mip_blits(vk::CommandBuffer command_buffer, vk::Image vh_image, vk::ImageSubresourceRange const& levels,
+      vk::Extent2D extent, vk::ImageLayout new_image_layout, vk::AccessFlags new_image_access, vk::PipelineStageFlags consuming_stages);
+
  private:
   void record_command_buffer(vulkan::handle::CommandBuffer command_buffer) override;
+  void record_post_transfer_barrier(vulkan::handle::CommandBuffer command_buffer);
+  void record_mip_generation(vulkan::handle::CommandBuffer command_buffer);
 };
 
 } // namespace task
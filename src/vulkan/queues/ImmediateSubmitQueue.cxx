@@ -1,6 +1,7 @@
 #include "sys.h"
 #include "ImmediateSubmitQueue.h"
 #include "CommandBufferFactory.h"
+#include "memory/SparseBindInfo.h"
 #include "utils/AIAlert.h"
 
 namespace task {
@@ -128,7 +129,26 @@ void ImmediateSubmitQueue::multiplex_impl(state_type run_state)
           // now simply iterate over the elements, starting with first_submit_request
           // without having the deque locked: producer threads can add new elements
           // in the meantime without invalidating submit_request.
+          //
+          // Make the sparse memory bindings of these requests first; their command buffers wait for that.
+          std::vector<vulkan::memory::SparseMipMemory::Binding> sparse_bindings;
           container_type::const_iterator submit_request = first_submit_request;
+          for (size_t i = 0;;)
+          {
+            sparse_bindings.insert(sparse_bindings.end(), submit_request->sparse_bindings().begin(), submit_request->sparse_bindings().end());
+            // Like below, do not move submit_request past the last request that will be submitted.
+            if (++i == acquired)
+              break;
+            ++submit_request;
+          }
+          uint64_t wait_value = 0;
+          if (!sparse_bindings.empty())
+          {
+            vulkan::memory::SparseBindInfo const sparse_bind_info(first_submit_request->logical_device(), sparse_bindings);
+            wait_value = m_queue.bind_sparse(sparse_bind_info.bind_sparse_info(), m_semaphore);
+          }
+
+          submit_request = first_submit_request;
           int count = 0;
           for (;;)
           {
@@ -148,7 +168,7 @@ void ImmediateSubmitQueue::multiplex_impl(state_type run_state)
           m_pending_requests += acquired;
 
           // Submit recorded commands.
-          m_queue.submit(command_buffers.data()->get_array(), acquired, m_semaphore);
+          m_queue.submit(command_buffers.data()->get_array(), acquired, m_semaphore, wait_value);
 
           // Wake me up when you're done.
           m_semaphore.add_poll(this, need_action);
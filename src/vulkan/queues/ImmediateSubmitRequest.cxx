@@ -19,7 +19,8 @@ void ImmediateSubmitRequest::print_on(std::ostream& os) const
 {
   os << "{m_logical_device:" << m_logical_device <<
     ", m_queue_request_key:" << m_queue_request_key <<
-    ", m_record_function:" << (m_record_function ? "<set>" : "nullptr") << '}';
+    ", m_record_function:" << (m_record_function ? "<set>" : "nullptr") <<
+    ", m_sparse_bindings: " << m_sparse_bindings.size() << " bindings}";
 }
 #endif
 
@@ -3,7 +3,9 @@
 #include "LogicalDevice.h"
 #include "CommandBuffer.h"
 #include "QueueRequestKey.h"
+#include "memory/SparseMipMemory.h"
 #include <functional>
+#include <vector>
 
 namespace task {
 class ImmediateSubmit;
@@ -24,6 +26,7 @@ class ImmediateSubmitRequest
   task::ImmediateSubmit* m_immediate_submit;            // The ImmediateSubmit task that issued this request.
   QueueRequestKey m_queue_request_key;                  // Key that uniquely maps to a queue (request/reply) to use.
   record_function_type m_record_function;               // Callback function that will record the command buffer.
+  std::vector<memory::SparseMipMemory::Binding> m_sparse_bindings;      // Sparse memory bindings that are made before the command buffer executes.
   // Filled in after submitting.
   mutable handle::CommandBuffer m_command_buffer{};     // Acquired command buffer that was recorded into (if any).
   mutable uint64_t m_signal_value;                      // Signal value used with the timeline semaphore when this command buffer was submitted.
@@ -40,6 +43,7 @@ class ImmediateSubmitRequest
     m_logical_device = orig.m_logical_device;
     m_queue_request_key = orig.m_queue_request_key;
     m_record_function = std::move(orig.m_record_function);
+    m_sparse_bindings = std::move(orig.m_sparse_bindings);
     return *this;
   }
 
@@ -47,6 +51,8 @@ class ImmediateSubmitRequest
   void set_logical_device(vulkan::LogicalDevice const* logical_device) { m_logical_device = logical_device; }
   void set_queue_request_key(vulkan::QueueRequestKey queue_request_key) { m_queue_request_key = queue_request_key; }
   void set_record_function(record_function_type&& record_function) { m_record_function = std::move(record_function); }
+  // The queue must support sparse binding (see LogicalDevice::supports_sparse_residency).
+  void set_sparse_bindings(std::vector<memory::SparseMipMemory::Binding>&& sparse_bindings) { m_sparse_bindings = std::move(sparse_bindings); }
   // Called by ImmediateSubmitQueue_need_action.
   void set_command_buffer_and_signal_value(handle::CommandBuffer command_buffer, uint64_t signal_value) const { m_command_buffer = command_buffer; m_signal_value = signal_value; }
 
@@ -60,6 +66,11 @@ class ImmediateSubmitRequest
     return m_queue_request_key;
   }
 
+  std::vector<memory::SparseMipMemory::Binding> const& sparse_bindings() const
+  {
+    return m_sparse_bindings;
+  }
+
   void record_commands(handle::CommandBuffer command_buffer) const
   {
     m_record_function(command_buffer);
@@ -0,0 +1,142 @@
+#include "sys.h"
+#include "ProgressiveTextureUpload.h"
+#include "CopyDataToImage.h"
+#include "Texture.h"
+#include "Application.h"
+#include "vk_utils/MipChain.h"
+#include "debug.h"
+
+namespace task {
+
+char const* ProgressiveTextureUpload::condition_str_impl(condition_type condition) const
+{
+  switch (condition)
+  {
+    AI_CASE_RETURN(level_uploaded);
+  }
+  return direct_base_type::condition_str_impl(condition);
+}
+
+char const* ProgressiveTextureUpload::state_str_impl(state_type run_state) const
+{
+  switch (run_state)
+  {
+    AI_CASE_RETURN(ProgressiveTextureUpload_start);
+    AI_CASE_RETURN(ProgressiveTextureUpload_coarsest_uploaded);
+    AI_CASE_RETURN(ProgressiveTextureUpload_wait);
+    AI_CASE_RETURN(ProgressiveTextureUpload_done);
+  }
+  AI_NEVER_REACHED
+}
+
+char const* ProgressiveTextureUpload::task_name_impl() const
+{
+  return "ProgressiveTextureUpload";
+}
+
+void ProgressiveTextureUpload::initialize_impl()
+{
+  // There must be a full mip chain (or at least one level), and no more levels than fit in m_uploaded_levels.
+  ASSERT(!m_level_feeders.empty() && m_level_feeders.size() <= 32);
+  // There must be something to upload.
+  ASSERT(m_first_level < m_base_mip_level && m_base_mip_level <= m_level_feeders.size());
+  set_state(ProgressiveTextureUpload_start);
+}
+
+void ProgressiveTextureUpload::upload_level(uint32_t level, bool coarsest)
+{
+  DoutEntering(dc::vulkan, "ProgressiveTextureUpload::upload_level(" << level << ", " << coarsest << ") [" << this << "]");
+  vk::Extent2D const extent = vk_utils::mip_level_extent(m_extent, level);
+  uint32_t const data_size = m_texel_size * extent.width * extent.height;
+
+  // Levels that are uploaded after the coarsest one contain garbage until then; there is no need to preserve that.
+  auto copy_data_to_image = statefultask::create<task::CopyDataToImage>(m_texture->m_logical_device, data_size,
+            m_texture->m_vh_image, extent, vk_defaults::ImageSubresourceRange{vk::ImageAspectFlagBits::eColor, level, 1},
+            vk::ImageLayout::eUndefined, vk::AccessFlags(0), vk::PipelineStageFlagBits::eTopOfPipe,
+            vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eShaderRead, vk::PipelineStageFlagBits::eFragmentShader
+            COMMA_CWDEBUG_ONLY(mSMDebug));
+
+  if (coarsest)
+  {
+    // Give all levels a defined layout, so that the texture can be sampled (with min_lod) from now on.
+    copy_data_to_image->set_barrier_subresource_range(vk_defaults::ImageSubresourceRange{vk::ImageAspectFlagBits::eColor, 0, static_cast<uint32_t>(m_level_feeders.size())});
+  }
+  copy_data_to_image->set_resource_owner(m_resource_owner);
+  copy_data_to_image->set_data_feeder(std::move(m_level_feeders[level]));
+  // The first pixel is needed now; the finer levels just improve the quality.
+  copy_data_to_image->set_upload_priority(coarsest ? vulkan::UploadPriority::visible_now : vulkan::UploadPriority::prefetch);
+  m_started_levels |= 1U << level;
+  copy_data_to_image->run(vulkan::Application::instance().low_priority_queue(), [this, level](bool success){
+    if (success)
+      m_uploaded_levels.fetch_or(1U << level, std::memory_order::release);
+    m_finished_levels.fetch_or(1U << level, std::memory_order::release);
+    signal(level_uploaded);
+  });
+}
+
+bool ProgressiveTextureUpload::update_base_mip_level()
+{
+  uint32_t const uploaded_levels = m_uploaded_levels.load(std::memory_order::acquire);
+  uint32_t base_mip_level = m_base_mip_level;
+  while (base_mip_level > 0 && (uploaded_levels & (1U << (base_mip_level - 1))))
+    --base_mip_level;
+  if (base_mip_level == m_base_mip_level)
+    return false;
+  m_base_mip_level = base_mip_level;
+  Dout(dc::vulkan, "ProgressiveTextureUpload: base mip level of " << m_texture << " is now " << base_mip_level << ".");
+  m_texture->set_base_mip_level({}, base_mip_level);
+  if (m_level_ready)
+    m_level_ready(base_mip_level);
+  return true;
+}
+
+void ProgressiveTextureUpload::multiplex_impl(state_type run_state)
+{
+  switch (run_state)
+  {
+    case ProgressiveTextureUpload_start:
+      if (m_base_mip_level < m_level_feeders.size())
+      {
+        // The coarser levels are resident already; they can be sampled, so the other levels have a defined layout.
+        set_state(ProgressiveTextureUpload_coarsest_uploaded);
+        break;
+      }
+      upload_level(m_level_feeders.size() - 1, true);
+      set_state(ProgressiveTextureUpload_coarsest_uploaded);
+      wait(level_uploaded);
+      break;
+    case ProgressiveTextureUpload_coarsest_uploaded:
+      if (m_started_levels && !update_base_mip_level())
+      {
+        // The upload of the coarsest level failed.
+        abort();
+        break;
+      }
+      // Queue all finer levels at once, coarse to fine.
+      for (uint32_t level = m_base_mip_level; level > m_first_level;)
+        upload_level(--level, false);
+      set_state(ProgressiveTextureUpload_wait);
+      [[fallthrough]];
+    case ProgressiveTextureUpload_wait:
+      update_base_mip_level();
+      // Don't finish before all uploads called back: they use this task.
+      if (m_finished_levels.load(std::memory_order::acquire) != m_started_levels)
+      {
+        wait(level_uploaded);
+        break;
+      }
+      if (m_base_mip_level > m_first_level)
+      {
+        // One of the uploads failed.
+        abort();
+        break;
+      }
+      set_state(ProgressiveTextureUpload_done);
+      [[fallthrough]];
+    case ProgressiveTextureUpload_done:
+      finish();
+      break;
+  }
+}
+
+} // namespace task
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "AsyncTask.h"
+#include "memory/DataFeeder.h"
+#include <vulkan/vulkan.hpp>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace vulkan {
+class Texture;
+} // namespace vulkan
+
+namespace task {
+
+class SynchronousWindow;
+
+// ProgressiveTextureUpload
+//
+// Uploads the mip levels of a Texture coarse to fine, so that the texture can be drawn as soon as its
+// coarsest level arrived (see Texture::upload_progressive).
+//
+// The coarsest level is uploaded first, by itself; that upload also transitions all other levels to
+// eShaderReadOnlyOptimal so that the whole image view has a defined layout from then on. All finer levels
+// are then uploaded at once (they are admitted coarse to fine by the upload scheduler), each one transitioning
+// only its own level. Whenever a level and all coarser levels landed, the base mip level of the texture is
+// lowered (Texture::min_lod) and the level_ready callback is called with the new base mip level.
+//
+// Shaders must not sample finer than min_lod(): those levels contain garbage until they are uploaded.
+//
+// Instead of the whole chain, a range of levels [first_level, resident_level) can be uploaded, where
+// resident_level is the current base mip level of the texture (see Texture::stream_in, used with
+// memory::TextureResidency). If something is resident already, the coarsest level of the range is not
+// uploaded by itself and the layouts of the other levels are left alone.
+//
+class ProgressiveTextureUpload : public vulkan::AsyncTask
+{
+ public:
+  static constexpr condition_type level_uploaded = 1;
+
+  using level_ready_callback_type = std::function<void(uint32_t base_mip_level)>;
+
+ private:
+  vulkan::Texture* m_texture;
+  vk::Extent2D m_extent;                                        // The extent of mip level 0.
+  uint32_t m_texel_size;                                        // The size of one texel in bytes.
+  SynchronousWindow const* m_resource_owner;
+  std::vector<std::unique_ptr<vulkan::DataFeeder>> m_level_feeders;     // The pixels of each mip level, finest first.
+  level_ready_callback_type m_level_ready;
+  uint32_t m_first_level;                                       // The finest level to upload.
+  uint32_t m_base_mip_level;                                    // All levels from this one up to the coarsest level landed.
+  uint32_t m_started_levels = 0;                                // Bit mask of the levels whose upload was started.
+  std::atomic<uint32_t> m_uploaded_levels{0};                   // Bit mask of the levels that landed.
+  std::atomic<uint32_t> m_finished_levels{0};                   // Bit mask of the levels whose upload finished (successful or not).
+
+ protected:
+  using direct_base_type = vulkan::AsyncTask;
+
+  // The different states of the task.
+  enum ProgressiveTextureUpload_state_type {
+    ProgressiveTextureUpload_start = direct_base_type::state_end,
+    ProgressiveTextureUpload_coarsest_uploaded,
+    ProgressiveTextureUpload_wait,
+    ProgressiveTextureUpload_done
+  };
+
+ public:
+  static state_type constexpr state_end = ProgressiveTextureUpload_done + 1;
+
+  // Upload all levels; level_feeders has an element for every mip level.
+  ProgressiveTextureUpload(vulkan::Texture* texture, vk::Extent2D extent, uint32_t texel_size, SynchronousWindow const* resource_owner,
+      std::vector<std::unique_ptr<vulkan::DataFeeder>> level_feeders, level_ready_callback_type level_ready COMMA_CWDEBUG_ONLY(bool debug = false)) :
+    ProgressiveTextureUpload(texture, extent, texel_size, resource_owner, 0, level_feeders.size(), std::move(level_feeders), std::move(level_ready)
+        COMMA_CWDEBUG_ONLY(debug)) { }
+
+  // Upload levels [first_level, resident_level); level_feeders has an element for every mip level, but only those of that range are used.
+  ProgressiveTextureUpload(vulkan::Texture* texture, vk::Extent2D extent, uint32_t texel_size, SynchronousWindow const* resource_owner,
+      uint32_t first_level, uint32_t resident_level,
+      std::vector<std::unique_ptr<vulkan::DataFeeder>> level_feeders, level_ready_callback_type level_ready COMMA_CWDEBUG_ONLY(bool debug = false)) :
+    direct_base_type(CWDEBUG_ONLY(debug)), m_texture(texture), m_extent(extent), m_texel_size(texel_size), m_resource_owner(resource_owner),
+    m_level_feeders(std::move(level_feeders)), m_level_ready(std::move(level_ready)), m_first_level(first_level), m_base_mip_level(resident_level)
+  {
+    DoutEntering(dc::statefultask(mSMDebug), "ProgressiveTextureUpload(" << texture << ", " << extent << ", " << texel_size <<
+        ", " << resource_owner << ", " << first_level << ", " << resident_level << ", " << m_level_feeders.size() << " levels) [" << this << "]");
+  }
+
+ protected:
+  ~ProgressiveTextureUpload() override = default;
+
+  // Implementation of virtual functions of AIStatefulTask.
+  char const* condition_str_impl(condition_type condition) const override;
+  char const* state_str_impl(state_type run_state) const override;
+  char const* task_name_impl() const override;
+  void initialize_impl() override;
+  void multiplex_impl(state_type run_state) override;
+
+ private:
+  // Start the upload of mip level `level`.
+  void upload_level(uint32_t level, bool coarsest);
+  // Lower m_base_mip_level as far as the uploaded levels allow. Returns true if it changed.
+  bool update_base_mip_level();
+};
+
+} // namespace task
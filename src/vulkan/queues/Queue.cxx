@@ -19,9 +19,12 @@ void Queue::print_on(std::ostream& os) const
 }
 #endif
 
-void Queue::submit(vk::CommandBuffer const* vh_command_buffer_ptrs, uint32_t count, TimelineSemaphore& timeline_semaphore)
+void Queue::submit(vk::CommandBuffer const* vh_command_buffer_ptrs, uint32_t count, TimelineSemaphore& timeline_semaphore, uint64_t wait_value)
 {
+  vk::PipelineStageFlags const wait_dst_stage_mask = vk::PipelineStageFlagBits::eAllCommands;
   vk::TimelineSemaphoreSubmitInfo timeline_semaphore_info{
+    .waitSemaphoreValueCount = wait_value ? 1U : 0U,
+    .pWaitSemaphoreValues = &wait_value,
     .signalSemaphoreValueCount = 1,
     .pSignalSemaphoreValues = timeline_semaphore.get_next_value_ptr()   // Returns a reference; is not thread-safe.
                                                                         // No other thread may call get_next_value() until after submit() below returned.
@@ -29,9 +32,9 @@ void Queue::submit(vk::CommandBuffer const* vh_command_buffer_ptrs, uint32_t cou
 
   vk::SubmitInfo submit_info{
     .pNext = &timeline_semaphore_info,
-    .waitSemaphoreCount = 0,
-    .pWaitSemaphores = nullptr,
-    .pWaitDstStageMask = nullptr,
+    .waitSemaphoreCount = wait_value ? 1U : 0U,
+    .pWaitSemaphores = timeline_semaphore.vh_semaphore_ptr(),
+    .pWaitDstStageMask = &wait_dst_stage_mask,
     .commandBufferCount = count,
     .pCommandBuffers = vh_command_buffer_ptrs,
     .signalSemaphoreCount = 1,
@@ -43,4 +46,28 @@ void Queue::submit(vk::CommandBuffer const* vh_command_buffer_ptrs, uint32_t cou
     THROW_ALERTC(res, "Queue::submit");
 }
 
+uint64_t Queue::bind_sparse(vk::BindSparseInfo bind_sparse_info, TimelineSemaphore& timeline_semaphore)
+{
+  // Binding operations are not ordered with other work on the queue: wait for everything that was submitted before
+  // (for example, the unbinding of memory that is bound again now).
+  uint64_t const wait_value = timeline_semaphore.signal_value();
+  vk::TimelineSemaphoreSubmitInfo timeline_semaphore_info{
+    .waitSemaphoreValueCount = 1,
+    .pWaitSemaphoreValues = &wait_value,
+    .signalSemaphoreValueCount = 1,
+    .pSignalSemaphoreValues = timeline_semaphore.get_next_value_ptr()
+  };
+  ASSERT(!bind_sparse_info.pNext && bind_sparse_info.waitSemaphoreCount == 0 && bind_sparse_info.signalSemaphoreCount == 0);
+  bind_sparse_info.pNext = &timeline_semaphore_info;
+  bind_sparse_info.waitSemaphoreCount = 1;
+  bind_sparse_info.pWaitSemaphores = timeline_semaphore.vh_semaphore_ptr();
+  bind_sparse_info.signalSemaphoreCount = 1;
+  bind_sparse_info.pSignalSemaphores = timeline_semaphore.vh_semaphore_ptr();
+
+  vk::Result res = m_vh_queue.bindSparse(1, &bind_sparse_info, nullptr);
+  if (res != vk::Result::eSuccess)
+    THROW_ALERTC(res, "Queue::bind_sparse");
+  return timeline_semaphore.signal_value();
+}
+
 } // namespace vulkan
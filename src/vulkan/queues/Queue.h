@@ -25,7 +25,14 @@ class Queue
   QueueFamilyPropertiesIndex queue_family() const { return m_queue_family; }
   operator bool() const { return !m_queue_family.undefined(); }
 
-  void submit(vk::CommandBuffer const* vh_command_buffer_ptrs, uint32_t count, TimelineSemaphore& timeline_semaphore);
+  // Submit count command buffers that signal the next value of timeline_semaphore once they finished.
+  // If wait_value is non-zero, they wait until timeline_semaphore reached that value first.
+  void submit(vk::CommandBuffer const* vh_command_buffer_ptrs, uint32_t count, TimelineSemaphore& timeline_semaphore, uint64_t wait_value = 0);
+
+  // Make the sparse memory bindings of bind_sparse_info (which may not have semaphores) once everything that was
+  // submitted with timeline_semaphore before finished, and signal the next value of timeline_semaphore afterwards.
+  // Returns that value. The queue family must support sparse binding.
+  uint64_t bind_sparse(vk::BindSparseInfo bind_sparse_info, TimelineSemaphore& timeline_semaphore);
 
 #ifdef CWDEBUG
   void print_on(std::ostream& os) const;
@@ -24,6 +24,7 @@ class QueueReply
   mutable std::atomic<uint32_t> m_acquired;     // The number of queues of this pool that were already acquired (with LogicalDevice::acquire_queue).
                                                 // Hence 0 <= m_acquired <= m_number_of_queues.
   QueueRequest::cookies_type m_request_cookies; // A bit mask with the request cookies for which this reply may be used.
+  mutable std::atomic<int> m_shared_queue_index{-1};    // The queue returned by acquire_shared_queue, or -1 if none was acquired yet.
 
  public:
   QueueReply() = default; // QueueRequest
@@ -42,6 +43,8 @@ class QueueReply
     ASSERT(rhs.m_acquired.load() == 0);
     m_acquired = 0;
     m_request_cookies= rhs.m_request_cookies;
+    ASSERT(rhs.m_shared_queue_index.load() == -1);
+    m_shared_queue_index = -1;
     return *this;
   }
 
@@ -93,6 +96,25 @@ class QueueReply
     return m_start_index + next_queue_index;
   }
 
+  // Should ONLY be called by LogicalDevice::acquire_queue.
+  // Returns the same queue index for every call, acquiring it upon the first call.
+  // Returns -1 if there was no free queue left for that.
+  int acquire_shared_queue() const
+  {
+    int shared_queue_index = m_shared_queue_index.load(std::memory_order_acquire);
+    while (shared_queue_index == -1)
+    {
+      int const next_queue_index = acquire_queue();
+      if (next_queue_index == -1)
+        return -1;
+      // If another thread beat us to it then the queue that we just acquired is wasted:
+      // queues are counted, so it can't be released out of order. This can only happen during initialization.
+      if (m_shared_queue_index.compare_exchange_strong(shared_queue_index, next_queue_index, std::memory_order_acq_rel))
+        return next_queue_index;
+    }
+    return shared_queue_index;
+  }
+
   void release_queue() const
   {
     int old_acquired = m_acquired.fetch_sub(1);
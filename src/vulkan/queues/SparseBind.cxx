@@ -0,0 +1,55 @@
+#include "sys.h"
+#include "SparseBind.h"
+#include "SynchronousWindow.h"
+#include "debug.h"
+
+namespace task {
+
+SparseBind::SparseBind(vulkan::LogicalDevice const* logical_device, std::vector<vulkan::memory::SparseMipMemory::Binding> bindings
+    COMMA_CWDEBUG_ONLY(bool debug)) :
+  ImmediateSubmit({logical_device, this}, ImmediateSubmit_done COMMA_CWDEBUG_ONLY(debug))
+{
+  DoutEntering(dc::vulkan, "SparseBind(" << logical_device << ", " << bindings.size() << " bindings) [" << this << "]");
+  // The bindings are made by the queue before the command buffer executes; that has nothing to do.
+  m_submit_request.set_sparse_bindings(std::move(bindings));
+  set_record_function([](vulkan::handle::CommandBuffer command_buffer){
+    command_buffer->begin({ .flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+    command_buffer->end();
+  });
+}
+
+SparseBind::~SparseBind()
+{
+  DoutEntering(dc::statefultask(mSMDebug), "SparseBind::~SparseBind() [" << this << "]");
+}
+
+char const* SparseBind::task_name_impl() const
+{
+  return "SparseBind";
+}
+
+void SparseBind::initialize_impl()
+{
+  set_state(ImmediateSubmit_start);
+  if (m_resource_owner)
+  {
+    try
+    {
+      // Like CopyDataToGPU: the window must wait for this task before it is destructed.
+      const_cast<SynchronousWindow*>(m_resource_owner)->m_task_counter_gate.increment();
+    }
+    catch (std::exception const&)
+    {
+      m_resource_owner = nullptr;       // Stop finish_impl from calling decrement().
+      abort();
+    }
+  }
+}
+
+void SparseBind::finish_impl()
+{
+  if (m_resource_owner)
+    const_cast<SynchronousWindow*>(m_resource_owner)->m_task_counter_gate.decrement();
+}
+
+} // namespace task
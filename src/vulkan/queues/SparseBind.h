@@ -0,0 +1,39 @@
+#pragma once
+
+#include "ImmediateSubmit.h"
+#include "memory/SparseMipMemory.h"
+#include <vector>
+
+namespace task {
+
+class SynchronousWindow;
+
+// SparseBind
+//
+// Makes (or undoes) the bindings of a memory::SparseMipMemory on the transfer queue, which must support
+// sparse binding (see LogicalDevice::supports_sparse_residency). The task finishes once the GPU executed them.
+// Work that is submitted to the same queue after that can use the bound memory.
+//
+class SparseBind final : public ImmediateSubmit
+{
+ private:
+  SynchronousWindow const* m_resource_owner{};                  // If the bound memory belongs to a window, then this should be set.
+
+ public:
+  SparseBind(vulkan::LogicalDevice const* logical_device, std::vector<vulkan::memory::SparseMipMemory::Binding> bindings
+      COMMA_CWDEBUG_ONLY(bool debug = false));
+
+  void set_resource_owner(SynchronousWindow const* resource_owner)
+  {
+    m_resource_owner = resource_owner;
+  }
+
+ protected:
+  ~SparseBind() override;
+
+  char const* task_name_impl() const override;
+  void initialize_impl() override;
+  void finish_impl() override;
+};
+
+} // namespace task
@@ -0,0 +1,135 @@
+#include "sys.h"
+#include "SubmitCoalescer.h"
+#include <algorithm>
+#include <array>
+#ifdef CWDEBUG
+#include "debug/debug_ostream_operators.h"
+#endif
+
+namespace vulkan {
+
+void SubmitCoalescer::register_window(task::SynchronousWindow const* window)
+{
+  DoutEntering(dc::vulkan, "SubmitCoalescer::register_window(" << window << ") [" << this << "]");
+  batch_t::wat(m_batch)->m_number_of_windows += 1;
+}
+
+void SubmitCoalescer::unregister_window(task::SynchronousWindow const* window)
+{
+  DoutEntering(dc::vulkan, "SubmitCoalescer::unregister_window(" << window << ") [" << this << "]");
+  batch_t::wat batch_w(m_batch);
+  // Calling unregister_window more often than register_window!
+  ASSERT(batch_w->m_number_of_windows > 0);
+  batch_w->m_number_of_windows -= 1;
+  if (std::ranges::any_of(batch_w->m_frames, [window](CoalescedFrame const& frame){ return frame.m_window == window; }))
+    flush(batch_w);
+}
+
+void SubmitCoalescer::add(CoalescedFrame const& frame)
+{
+  DoutEntering(dc::vkframe, "SubmitCoalescer::add({window:" << frame.m_window << ", frame_value:" << frame.m_frame_value << "}) [" << this << "]");
+  batch_t::wat batch_w(m_batch);
+  // A window must call flush_if_pending before it adds its next frame (that is done by acquire_image).
+  ASSERT(std::ranges::none_of(batch_w->m_frames, [&](CoalescedFrame const& pending){ return pending.m_window == frame.m_window; }));
+  batch_w->m_frames.push_back(frame);
+  if (batch_w->m_frames.size() >= static_cast<size_t>(batch_w->m_number_of_windows))
+    flush(batch_w);
+}
+
+void SubmitCoalescer::flush_if_pending(task::SynchronousWindow const* window)
+{
+  batch_t::wat batch_w(m_batch);
+  if (std::ranges::any_of(batch_w->m_frames, [window](CoalescedFrame const& frame){ return frame.m_window == window; }))
+    flush(batch_w);
+}
+
+void SubmitCoalescer::submit(vk::ArrayProxy<vk::SubmitInfo const> const& submit_infos, vk::Fence vh_fence)
+{
+  batch_t::wat batch_w(m_batch);
+  m_vh_queue.submit(submit_infos, vh_fence);
+}
+
+void SubmitCoalescer::flush(batch_t::wat const& batch_w)
+{
+  std::vector<CoalescedFrame>& frames = batch_w->m_frames;
+  size_t const number_of_frames = frames.size();
+  if (number_of_frames == 0)
+    return;
+
+  DoutEntering(dc::vkframe, "SubmitCoalescer::flush() with " << number_of_frames << " frame(s) [" << this << "]");
+
+  // One vk::SubmitInfo per frame (each has its own semaphores), but a single vkQueueSubmit.
+  static constexpr vk::PipelineStageFlags wait_dst_stage_mask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+  std::vector<std::array<vk::Semaphore, 2>> signal_semaphores(number_of_frames);
+  std::vector<std::array<uint64_t, 2>> signal_values(number_of_frames);
+  std::vector<vk::TimelineSemaphoreSubmitInfo> timeline_semaphore_infos(number_of_frames);
+  std::vector<vk::SubmitInfo> submit_infos(number_of_frames);
+  // And a single vkQueuePresentKHR.
+  std::vector<vk::Semaphore> present_wait_semaphores(number_of_frames);
+  std::vector<vk::SwapchainKHR> swapchains(number_of_frames);
+  std::vector<uint32_t> image_indices(number_of_frames);
+  std::vector<vk::Result> present_results(number_of_frames, vk::Result::eSuccess);
+
+  for (size_t i = 0; i < number_of_frames; ++i)
+  {
+    CoalescedFrame const& frame = frames[i];
+    signal_semaphores[i] = { frame.m_vh_rendering_finished_semaphore, frame.m_vh_frame_semaphore };
+    signal_values[i] = { 0, frame.m_frame_value };      // The value for a binary semaphore is ignored.
+    timeline_semaphore_infos[i] = vk::TimelineSemaphoreSubmitInfo{
+      .signalSemaphoreValueCount = static_cast<uint32_t>(signal_values[i].size()),
+      .pSignalSemaphoreValues = signal_values[i].data()
+    };
+    submit_infos[i] = vk::SubmitInfo{
+      .pNext = &timeline_semaphore_infos[i],
+      .waitSemaphoreCount = 1,
+      .pWaitSemaphores = &frame.m_vh_image_available_semaphore,
+      .pWaitDstStageMask = &wait_dst_stage_mask,
+      .commandBufferCount = 1,
+      .pCommandBuffers = &frame.m_vh_command_buffer,
+      .signalSemaphoreCount = static_cast<uint32_t>(signal_semaphores[i].size()),
+      .pSignalSemaphores = signal_semaphores[i].data()
+    };
+    present_wait_semaphores[i] = frame.m_vh_rendering_finished_semaphore;
+    swapchains[i] = frame.m_vh_swapchain;
+    image_indices[i] = frame.m_swapchain_image_index;
+  }
+
+  m_vh_queue.submit(submit_infos);
+
+  vk::PresentInfoKHR present_info{
+    .waitSemaphoreCount = static_cast<uint32_t>(number_of_frames),
+    .pWaitSemaphores = present_wait_semaphores.data(),
+    .swapchainCount = static_cast<uint32_t>(number_of_frames),
+    .pSwapchains = swapchains.data(),
+    .pImageIndices = image_indices.data(),
+    .pResults = present_results.data()
+  };
+  // The per-swapchain results are written to present_results; res is the "worst" of them.
+  vk::Result const res = m_vh_queue.presentKHR(&present_info);
+  if (res != vk::Result::eSuccess && res != vk::Result::eSuboptimalKHR && res != vk::Result::eErrorOutOfDateKHR)
+    Dout(dc::warning, "SubmitCoalescer::flush: presentKHR returned " << res);
+
+  // Each window handles the result of presenting its own swapchain.
+  for (size_t i = 0; i < number_of_frames; ++i)
+    frames[i].m_present_result->store(present_results[i], std::memory_order_relaxed);
+
+  batch_w->m_statistics.m_number_of_submits += 1;
+  batch_w->m_statistics.m_number_of_frames += number_of_frames;
+  frames.clear();
+}
+
+#ifdef CWDEBUG
+void SubmitCoalescer::print_on(std::ostream& os) const
+{
+  batch_t::crat batch_r(m_batch);
+  os << '{';
+  os << "m_vh_queue:" << m_vh_queue <<
+      ", pending frames:" << batch_r->m_frames.size() <<
+      ", m_number_of_windows:" << batch_r->m_number_of_windows <<
+      ", m_number_of_submits:" << batch_r->m_statistics.m_number_of_submits <<
+      ", m_number_of_frames:" << batch_r->m_statistics.m_number_of_frames;
+  os << '}';
+}
+#endif
+
+} // namespace vulkan
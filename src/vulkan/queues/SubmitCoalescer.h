@@ -0,0 +1,95 @@
+#pragma once
+
+#include "threadsafe/aithreadsafe.h"
+#include <vulkan/vulkan.hpp>
+#include <atomic>
+#include <vector>
+#include <mutex>
+#include "debug.h"
+
+namespace task {
+class SynchronousWindow;
+} // namespace task
+
+namespace vulkan {
+
+// A frame of a window that was recorded and is ready to be submitted and presented.
+struct CoalescedFrame
+{
+  task::SynchronousWindow const* m_window;              // The window that rendered this frame.
+  vk::CommandBuffer m_vh_command_buffer;
+  vk::Semaphore m_vh_image_available_semaphore;         // Waited for (at eColorAttachmentOutput) before the command buffer may write the swapchain image.
+  vk::Semaphore m_vh_rendering_finished_semaphore;      // Signaled by the submit, waited for by the present.
+  vk::Semaphore m_vh_frame_semaphore;                   // The timeline semaphore of the window (SynchronousWindow::m_frame_semaphore).
+  uint64_t m_frame_value;                               // The value that m_vh_frame_semaphore is signaled with.
+  vk::SwapchainKHR m_vh_swapchain;
+  uint32_t m_swapchain_image_index;
+  std::atomic<vk::Result>* m_present_result;            // Where to store the result of presenting this frame.
+};
+
+// SubmitCoalescer
+//
+// Gathers the frames of all windows that share one queue (for both graphics and presentation)
+// and submits them with a single vkQueueSubmit and presents them with a single vkQueuePresentKHR
+// (with one swapchain per window).
+//
+// A batch is flushed as soon as every registered window added a frame to it. Because windows
+// don't run in lock-step, a window also flushes the batch before it needs its own pending frame
+// to be submitted or presented (see flush_if_pending): before acquiring the next swapchain image,
+// before waiting for its frame semaphore and when it stops rendering.
+//
+// Because all windows that use a SubmitCoalescer share the queue, every access to that queue
+// must go through it (see submit) in order to provide the external synchronization that vulkan requires.
+//
+class SubmitCoalescer
+{
+ public:
+  struct Statistics
+  {
+    uint64_t m_number_of_submits = 0;                   // The number of calls to vkQueueSubmit (and vkQueuePresentKHR) done by flush.
+    uint64_t m_number_of_frames = 0;                    // The total number of frames that were submitted.
+  };
+
+ private:
+  struct Batch
+  {
+    std::vector<CoalescedFrame> m_frames;               // The frames that were added since the last flush.
+    int m_number_of_windows = 0;                        // The number of registered windows.
+    Statistics m_statistics;
+  };
+  using batch_t = aithreadsafe::Wrapper<Batch, aithreadsafe::policy::Primitive<std::mutex>>;
+
+  vk::Queue const m_vh_queue;                           // The shared queue.
+  batch_t m_batch;
+
+  // Submit and present all frames in batch_w.
+  void flush(batch_t::wat const& batch_w);
+
+ public:
+  SubmitCoalescer(vk::Queue vh_queue) : m_vh_queue(vh_queue) { }
+
+  // Accessor.
+  vk::Queue vh_queue() const { return m_vh_queue; }
+
+  // Add or remove a window that contributes frames to each batch.
+  // unregister_window flushes any pending frames.
+  void register_window(task::SynchronousWindow const* window);
+  void unregister_window(task::SynchronousWindow const* window);
+
+  // Add a frame; flushes the batch when it contains a frame from every registered window.
+  void add(CoalescedFrame const& frame);
+
+  // Flush the batch if it contains a frame of window.
+  void flush_if_pending(task::SynchronousWindow const* window);
+
+  // Submit directly (not coalesced) to the shared queue.
+  void submit(vk::ArrayProxy<vk::SubmitInfo const> const& submit_infos, vk::Fence vh_fence);
+
+  Statistics statistics() const { return batch_t::crat(m_batch)->m_statistics; }
+
+#ifdef CWDEBUG
+  void print_on(std::ostream& os) const;
+#endif
+};
+
+} // namespace vulkan
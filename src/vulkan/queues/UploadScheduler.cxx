@@ -0,0 +1,184 @@
+#include "sys.h"
+#include "UploadScheduler.h"
+#include <algorithm>
+#include <iostream>
+#include "debug.h"
+
+namespace vulkan {
+
+char const* to_string(UploadPriority priority)
+{
+  switch (priority)
+  {
+    case UploadPriority::visible_now:
+      return "visible_now";
+    case UploadPriority::prefetch:
+      return "prefetch";
+    case UploadPriority::background:
+      return "background";
+  }
+  AI_NEVER_REACHED
+}
+
+namespace {
+
+// Batches smaller than this are not used to measure the throughput: their duration is dominated by the submit latency.
+constexpr size_t min_measured_bytes = 1024 * 1024;
+// Never let a (low) measured throughput reduce the frame budget below this.
+constexpr size_t min_frame_budget = 256 * 1024;
+
+} // namespace
+
+void UploadScheduler::set_budget(UploadBudget const& budget)
+{
+  state_t::wat state_w(m_state);
+  state_w->m_budget = budget;
+}
+
+//static
+size_t UploadScheduler::frame_budget(State const& state)
+{
+  size_t const bytes_per_frame = state.m_budget.m_bytes_per_frame;
+  if (state.m_stats.m_throughput <= 0.0)
+    return bytes_per_frame;
+  size_t const time_limited = state.m_stats.m_throughput * std::chrono::duration_cast<duration_type>(state.m_budget.m_time_per_frame).count();
+  return std::min(bytes_per_frame, std::max(time_limited, std::min(bytes_per_frame, min_frame_budget)));
+}
+
+void UploadScheduler::enqueue(size_t size, UploadPriority priority, admit_callback_type admit, clock_type::time_point now)
+{
+  state_t::wat state_w(m_state);
+  state_w->m_queues[static_cast<size_t>(priority)].push_back({ size, priority, now, std::move(admit) });
+  ClassStats& class_stats = state_w->m_stats.m_classes[static_cast<size_t>(priority)];
+  ++class_stats.m_queued;
+  class_stats.m_queued_bytes += size;
+}
+
+bool UploadScheduler::dispatch(clock_type::time_point now)
+{
+  std::vector<Admitted> admitted;
+  bool uploads_left;
+  {
+    state_t::wat state_w(m_state);
+    State& state = *state_w;
+
+    // Refill the bucket.
+    size_t const budget = frame_budget(state);
+    double const refill = state.m_last_dispatch ?
+        budget * (std::chrono::duration_cast<duration_type>(now - *state.m_last_dispatch) / state.m_budget.m_frame_period) : budget;
+    state.m_tokens = std::min<double>(budget, state.m_tokens + refill);
+    double const background_budget = budget * state.m_budget.m_background_share;
+    state.m_background_tokens = std::min(background_budget, state.m_background_tokens + refill * state.m_budget.m_background_share);
+    state.m_last_dispatch = now;
+    state.m_stats.m_frame_budget = budget;
+
+    // Promote background uploads that waited too long.
+    auto& background = state.m_queues[static_cast<size_t>(UploadPriority::background)];
+    auto& prefetch = state.m_queues[static_cast<size_t>(UploadPriority::prefetch)];
+    while (!background.empty() && now - background.front().m_enqueued >= state.m_budget.m_max_background_wait)
+    {
+      prefetch.push_back(std::move(background.front()));
+      background.pop_front();
+    }
+
+    // Give up on measuring a batch that doesn't complete (for example because an upload was aborted).
+    if (state.m_measured_batch && now - state.m_measured_batch->m_dispatched > s_measurement_timeout)
+      state.m_measured_batch.reset();
+
+    uint64_t const batch = state.m_next_batch;
+    size_t batch_bytes = 0;
+    // Admit uploads from the queue of priority while admissible() returns true; from_reserve is true when using the background reserve.
+    auto admit_from = [&](UploadPriority priority, bool from_reserve, auto admissible){
+      auto& queue = state.m_queues[static_cast<size_t>(priority)];
+      while (!queue.empty() && admitted.size() < static_cast<size_t>(state.m_budget.m_max_uploads_per_frame) && admissible())
+      {
+        Upload& upload = queue.front();
+        state.m_tokens -= upload.m_size;
+        if (from_reserve)
+          state.m_background_tokens -= upload.m_size;
+        batch_bytes += upload.m_size;
+        // Account the upload to the class that it was enqueued with.
+        ClassStats& class_stats = state.m_stats.m_classes[static_cast<size_t>(upload.m_priority)];
+        --class_stats.m_queued;
+        class_stats.m_queued_bytes -= upload.m_size;
+        ++class_stats.m_admitted;
+        class_stats.m_admitted_bytes += upload.m_size;
+        duration_type const latency = now - upload.m_enqueued;
+        class_stats.m_total_latency += latency;
+        class_stats.m_max_latency = std::max(class_stats.m_max_latency, latency);
+        admitted.push_back({ batch, std::move(upload.m_admit) });
+        queue.pop_front();
+      }
+    };
+    admit_from(UploadPriority::visible_now, false, []{ return true; });
+    // First use the reserved share for background uploads, then the rest of the budget in priority order.
+    admit_from(UploadPriority::background, true, [&]{ return state.m_tokens > 0.0 && state.m_background_tokens > 0.0; });
+    admit_from(UploadPriority::prefetch, false, [&]{ return state.m_tokens > 0.0; });
+    admit_from(UploadPriority::background, false, [&]{ return state.m_tokens > 0.0; });
+
+    if (!admitted.empty())
+    {
+      ++state.m_next_batch;
+      ++state.m_stats.m_dispatches;
+      if (!state.m_measured_batch && batch_bytes >= min_measured_bytes)
+        state.m_measured_batch = MeasuredBatch{ .m_batch = batch, .m_dispatched = now, .m_outstanding = admitted.size(), .m_bytes = batch_bytes };
+      Dout(dc::vulkan, "UploadScheduler::dispatch: admitted " << admitted.size() << " uploads (" << batch_bytes << " bytes) as batch " << batch <<
+          "; budget left: " << state.m_tokens << " bytes.");
+    }
+
+    uploads_left = std::any_of(state.m_queues.begin(), state.m_queues.end(), [](auto const& queue){ return !queue.empty(); });
+  }
+
+  // Start the uploads. This is done without holding the lock, because the callbacks might call enqueue() or completed().
+  for (Admitted& upload : admitted)
+    upload.m_admit(upload.m_batch);
+
+  return uploads_left;
+}
+
+void UploadScheduler::completed(uint64_t batch, clock_type::time_point now)
+{
+  state_t::wat state_w(m_state);
+  State& state = *state_w;
+  if (!state.m_measured_batch || state.m_measured_batch->m_batch != batch || --state.m_measured_batch->m_outstanding > 0)
+    return;
+  // The whole batch completed: the transfer queue processed m_bytes in this time (including the time spent on writing
+  // the staging buffers and waiting for the queue, which makes this a conservative estimate).
+  duration_type const elapsed = now - state.m_measured_batch->m_dispatched;
+  if (elapsed.count() > 0.0)
+  {
+    double const sample = state.m_measured_batch->m_bytes / elapsed.count();
+    double& throughput = state.m_stats.m_throughput;
+    throughput = throughput > 0.0 ? (1.0 - s_throughput_smoothing) * throughput + s_throughput_smoothing * sample : sample;
+  }
+  state.m_measured_batch.reset();
+}
+
+UploadScheduler::Stats UploadScheduler::stats() const
+{
+  state_t::wat state_w(m_state);
+  return state_w->m_stats;
+}
+
+size_t UploadScheduler::queue_depth() const
+{
+  state_t::wat state_w(m_state);
+  size_t depth = 0;
+  for (auto const& queue : state_w->m_queues)
+    depth += queue.size();
+  return depth;
+}
+
+void UploadScheduler::Stats::print_on(std::ostream& os) const
+{
+  os << "dispatches: " << m_dispatches << ", throughput: " << (m_throughput / (1024 * 1024)) << " MiB/s, frame budget: " << m_frame_budget << " bytes\n";
+  for (size_t priority = 0; priority < number_of_upload_priorities; ++priority)
+  {
+    ClassStats const& class_stats = m_classes[priority];
+    os << "  " << to_string(static_cast<UploadPriority>(priority)) << ": queued " << class_stats.m_queued << " (" << class_stats.m_queued_bytes <<
+      " bytes), admitted " << class_stats.m_admitted << " (" << class_stats.m_admitted_bytes << " bytes), latency mean " <<
+      (class_stats.mean_latency().count() * 1000.0) << " ms, max " << (class_stats.m_max_latency.count() * 1000.0) << " ms\n";
+  }
+}
+
+} // namespace vulkan
@@ -0,0 +1,166 @@
+#pragma once
+
+#include "threadsafe/aithreadsafe.h"
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iosfwd>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace vulkan {
+
+// The priority classes of uploads to the GPU, from high to low.
+enum class UploadPriority
+{
+  visible_now,          // Needed by the frame that is being rendered (per-frame data, visible textures).
+  prefetch,             // Likely needed soon (for example, textures of objects that are about to become visible).
+  background            // Everything else (streaming, warming caches).
+};
+
+static constexpr size_t number_of_upload_priorities = 3;
+
+char const* to_string(UploadPriority priority);
+
+// The limits of UploadScheduler, per frame.
+struct UploadBudget
+{
+  using duration_type = std::chrono::microseconds;
+
+  size_t m_bytes_per_frame = 16 * 1024 * 1024;                  // The maximum number of bytes that is admitted per frame.
+  duration_type m_time_per_frame{2000};                         // The maximum estimated transfer time per frame (see UploadScheduler).
+  duration_type m_frame_period{16667};                          // The time that it takes to refill the budget (one frame).
+  int m_max_uploads_per_frame = 64;                             // The number of requests that ImmediateSubmitQueue submits at once.
+  duration_type m_max_background_wait{1000000};                 // Background uploads that wait this long are promoted to prefetch.
+  double m_background_share = 0.1;                              // The part of the frame budget that is reserved for background uploads.
+};
+
+// UploadScheduler
+//
+// Sits between the tasks that copy data to the GPU (CopyDataToGPU and derived classes) and the transfer queue,
+// so that a burst of (for example) texture loads doesn't compete with latency-critical per-frame uploads.
+//
+// Uploads are queued per priority class with enqueue(); dispatch(), called by AsyncUploadScheduler every frame,
+// admits queued uploads (calls their admit callback) in priority order, first in first out per class, while the
+// budget allows it. All uploads that are admitted by one dispatch() are started together and therefore end up
+// in the same batch of submits of the ImmediateSubmitQueue.
+//
+// The budget is a token bucket of bytes that is refilled at a rate of one frame budget per m_frame_period,
+// so it doesn't matter how often dispatch() is called. The frame budget is the smaller of m_bytes_per_frame
+// and the number of bytes that can be transferred in m_time_per_frame, using a throughput that is measured
+// from the completion of previous batches (see completed()).
+//
+// - visible_now uploads are never held back by the budget (but they do use it up, so that the lower classes wait).
+// - prefetch and background uploads are only admitted while there is budget left. The last one admitted may overdraw
+//   the budget (otherwise an upload larger than the budget would never be admitted); the debt is paid off first.
+// - m_background_share of the frame budget is reserved for background uploads: they are refilled in a second bucket,
+//   and while that has tokens left background uploads are admitted before prefetch uploads. Hence a steady stream
+//   of prefetch uploads doesn't starve them.
+// - background uploads that waited longer than m_max_background_wait are promoted to prefetch.
+//
+// Note that visible_now uploads are never held back, so they can still starve both lower classes.
+//
+class UploadScheduler
+{
+ public:
+  using clock_type = std::chrono::steady_clock;
+  using duration_type = std::chrono::duration<double>;
+  using admit_callback_type = std::function<void(uint64_t batch)>;
+
+  // Statistics of one priority class.
+  struct ClassStats
+  {
+    size_t m_queued = 0;                                // The number of uploads that are currently queued.
+    size_t m_queued_bytes = 0;                          // The number of bytes of those uploads.
+    uint64_t m_admitted = 0;                            // The total number of uploads that were admitted.
+    uint64_t m_admitted_bytes = 0;                      // The total number of bytes of those uploads.
+    duration_type m_total_latency{};                    // The sum of the time between enqueue and admission of those uploads.
+    duration_type m_max_latency{};                      // The largest time between enqueue and admission.
+
+    duration_type mean_latency() const { return m_admitted ? m_total_latency / m_admitted : duration_type{}; }
+  };
+
+  struct Stats
+  {
+    std::array<ClassStats, number_of_upload_priorities> m_classes;
+    uint64_t m_dispatches = 0;                          // The number of calls to dispatch() that admitted at least one upload.
+    double m_throughput = 0.0;                          // The measured transfer throughput in bytes per second (zero if not known yet).
+    size_t m_frame_budget = 0;                          // The current budget in bytes per frame.
+
+    void print_on(std::ostream& os) const;
+  };
+
+ private:
+  struct Upload
+  {
+    size_t m_size;
+    UploadPriority m_priority;                          // The priority that the upload was enqueued with.
+    clock_type::time_point m_enqueued;
+    admit_callback_type m_admit;
+  };
+
+  struct Admitted
+  {
+    uint64_t m_batch;
+    admit_callback_type m_admit;
+  };
+
+  // The batch whose completion is used to measure the throughput.
+  struct MeasuredBatch
+  {
+    uint64_t m_batch;
+    clock_type::time_point m_dispatched;
+    size_t m_outstanding;                               // The number of uploads of the batch that didn't complete yet.
+    size_t m_bytes;                                     // The total size of the batch.
+  };
+
+  struct State
+  {
+    UploadBudget m_budget;
+    std::array<std::deque<Upload>, number_of_upload_priorities> m_queues;
+    double m_tokens = 0.0;                              // The remaining budget in bytes; negative when overdrawn.
+    double m_background_tokens = 0.0;                   // The remaining reserved background budget in bytes; negative when overdrawn.
+    std::optional<clock_type::time_point> m_last_dispatch;
+    uint64_t m_next_batch = 1;
+    std::optional<MeasuredBatch> m_measured_batch;
+    Stats m_stats;
+  };
+
+  using state_t = aithreadsafe::Wrapper<State, aithreadsafe::policy::Primitive<std::mutex>>;
+  mutable state_t m_state;
+
+  static constexpr double s_throughput_smoothing = 0.25;                // Weight of a new throughput measurement.
+  static constexpr duration_type s_measurement_timeout{1.0};            // Stop measuring a batch that takes longer than this.
+
+ public:
+  UploadScheduler() = default;
+  UploadScheduler(UploadBudget const& budget) { set_budget(budget); }
+
+  // Thread-safe. Change the budget.
+  void set_budget(UploadBudget const& budget);
+
+  // Thread-safe. Queue an upload of size bytes. The admit callback is called (from dispatch()) with the batch number
+  // once the upload may start; pass that number to completed() when the upload finished.
+  void enqueue(size_t size, UploadPriority priority, admit_callback_type admit, clock_type::time_point now = clock_type::now());
+
+  // Admit uploads as far as the budget allows. Calls the admit callbacks (without holding a lock).
+  // Returns true if there are still uploads queued.
+  bool dispatch(clock_type::time_point now = clock_type::now());
+
+  // Thread-safe. Called when an upload that was admitted as part of batch has finished.
+  void completed(uint64_t batch, clock_type::time_point now = clock_type::now());
+
+  // Thread-safe. A copy of the statistics.
+  Stats stats() const;
+
+  // Thread-safe. The number of uploads that are queued (not admitted yet).
+  size_t queue_depth() const;
+
+ private:
+  static size_t frame_budget(State const& state);
+};
+
+} // namespace vulkan
@@ -0,0 +1,265 @@
+#include "sys.h"
+#include "QueueSchedule.h"
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include "debug.h"
+
+namespace vulkan::rendergraph {
+
+char const* to_string(QueueType queue_type)
+{
+  switch (queue_type)
+  {
+    case QueueType::graphics:
+      return "graphics";
+    case QueueType::async_compute:
+      return "async_compute";
+  }
+  AI_NEVER_REACHED
+}
+
+void QueueSchedule::generate(std::vector<ScheduleNode> const& nodes, QueueFamilies const& queue_families)
+{
+  DoutEntering(dc::vulkan, "QueueSchedule::generate(" << nodes.size() << " nodes, {" << queue_families.m_graphics << ", " <<
+      (queue_families.m_async_compute ? std::to_string(*queue_families.m_async_compute) : std::string("none")) << "})");
+
+  for (auto& steps : m_queues)
+    steps.clear();
+  m_ownership_transfers.clear();
+
+  add_dependencies(nodes);
+  assign_queues(nodes, queue_families.m_async_compute.has_value());
+
+  // Each queue executes its nodes in the given order.
+  m_position.resize(nodes.size());
+  for (size_t node = 0; node < nodes.size(); ++node)
+  {
+    auto& steps = m_queues[static_cast<size_t>(m_assigned_queue[node])];
+    m_position[node] = steps.size();
+    steps.push_back({ .m_node = node, .m_wait = std::nullopt, .m_acquires = {}, .m_releases = {} });
+  }
+
+  if (uses_async_compute())
+  {
+    add_waits();
+    if (*queue_families.m_async_compute != queue_families.m_graphics)
+      add_ownership_transfers(nodes, queue_families);
+  }
+}
+
+void QueueSchedule::add_dependencies(std::vector<ScheduleNode> const& nodes)
+{
+  m_dependencies.clear();
+
+  struct Accesses
+  {
+    std::optional<size_t> m_last_writer;
+    std::vector<size_t> m_readers;              // The readers since the last write.
+  };
+  std::map<ResourceID, Accesses> accesses;
+
+  for (size_t node = 0; node < nodes.size(); ++node)
+  {
+    for (ResourceID resource : nodes[node].m_reads)
+    {
+      Accesses& resource_accesses = accesses[resource];
+      if (resource_accesses.m_last_writer && *resource_accesses.m_last_writer != node)
+        m_dependencies.emplace_back(*resource_accesses.m_last_writer, node);                  // Read-after-write.
+      resource_accesses.m_readers.push_back(node);
+    }
+    for (ResourceID resource : nodes[node].m_writes)
+    {
+      Accesses& resource_accesses = accesses[resource];
+      for (size_t reader : resource_accesses.m_readers)
+        if (reader != node)
+          m_dependencies.emplace_back(reader, node);                                           // Write-after-read.
+      if (resource_accesses.m_readers.empty() && resource_accesses.m_last_writer && *resource_accesses.m_last_writer != node)
+        m_dependencies.emplace_back(*resource_accesses.m_last_writer, node);                  // Write-after-write.
+      resource_accesses.m_last_writer = node;
+      resource_accesses.m_readers.clear();
+    }
+  }
+
+  std::sort(m_dependencies.begin(), m_dependencies.end());
+  m_dependencies.erase(std::unique(m_dependencies.begin(), m_dependencies.end()), m_dependencies.end());
+}
+
+void QueueSchedule::assign_queues(std::vector<ScheduleNode> const& nodes, bool have_async_compute)
+{
+  size_t const number_of_nodes = nodes.size();
+  m_assigned_queue.assign(number_of_nodes, QueueType::graphics);
+  if (!have_async_compute)
+    return;
+
+  // descendants[a][b] is true if there is a path from a to b.
+  // Dependencies always point forwards, so the transitive closure can be computed in a single backwards sweep.
+  std::vector<std::vector<bool>> descendants(number_of_nodes, std::vector<bool>(number_of_nodes, false));
+  std::vector<std::vector<size_t>> consumers(number_of_nodes);
+  for (auto [producer, consumer] : m_dependencies)
+    consumers[producer].push_back(consumer);
+  for (size_t node = number_of_nodes; node-- > 0;)
+    for (size_t consumer : consumers[node])
+    {
+      descendants[node][consumer] = true;
+      for (size_t n = consumer + 1; n < number_of_nodes; ++n)
+        if (descendants[consumer][n])
+          descendants[node][n] = true;
+    }
+
+  for (size_t node = 0; node < number_of_nodes; ++node)
+  {
+    if (nodes[node].m_preferred_queue != QueueType::async_compute)
+      continue;
+    // Is there any graphics work that this node could overlap with?
+    for (size_t other = 0; other < number_of_nodes; ++other)
+    {
+      if (other == node || nodes[other].m_preferred_queue != QueueType::graphics)
+        continue;
+      if (!descendants[node][other] && !descendants[other][node])
+      {
+        m_assigned_queue[node] = QueueType::async_compute;
+        break;
+      }
+    }
+    Dout(dc::vulkan, "Node \"" << nodes[node].m_name << "\" runs on the " << to_string(m_assigned_queue[node]) << " queue.");
+  }
+}
+
+void QueueSchedule::add_waits()
+{
+  // Collect, per consumer, the largest position + 1 of its producers on the other queue.
+  for (auto [producer, consumer] : m_dependencies)
+  {
+    if (m_assigned_queue[producer] == m_assigned_queue[consumer])
+      continue;                                 // Same queue: ordered by submission order.
+    Step& consumer_step = m_queues[static_cast<size_t>(m_assigned_queue[consumer])][m_position[consumer]];
+    uint64_t const value = m_position[producer] + 1;
+    if (!consumer_step.m_wait || consumer_step.m_wait->m_value < value)
+      consumer_step.m_wait = Wait{ .m_queue = m_assigned_queue[producer], .m_value = value };
+  }
+
+  // Remove waits that are already covered by an earlier wait on the same queue, and mark what must be signaled.
+  for (size_t queue = 0; queue < number_of_queue_types; ++queue)
+  {
+    uint64_t waited_for = 0;
+    for (Step& step : m_queues[queue])
+    {
+      if (!step.m_wait)
+        continue;
+      if (step.m_wait->m_value <= waited_for)
+      {
+        step.m_wait.reset();
+        continue;
+      }
+      waited_for = step.m_wait->m_value;
+      Step& producer_step = m_queues[static_cast<size_t>(step.m_wait->m_queue)][waited_for - 1];
+      producer_step.m_signal_value = waited_for;
+    }
+  }
+}
+
+void QueueSchedule::add_ownership_transfers(std::vector<ScheduleNode> const& nodes, QueueFamilies const& queue_families)
+{
+  auto queue_family = [&](QueueType queue){ return queue == QueueType::graphics ? queue_families.m_graphics : *queue_families.m_async_compute; };
+
+  struct Ownership
+  {
+    QueueType m_owner;
+    size_t m_last_access;                       // The last node of the owning queue that accessed the resource.
+  };
+  std::map<ResourceID, Ownership> ownership;
+
+  auto access = [&](ResourceID resource, size_t node){
+    QueueType const queue = m_assigned_queue[node];
+    auto iter = ownership.find(resource);
+    if (iter == ownership.end())
+    {
+      // The first access; the contents are undefined, so no transfer is needed.
+      ownership.emplace(resource, Ownership{ queue, node });
+      return;
+    }
+    Ownership& resource_ownership = iter->second;
+    if (resource_ownership.m_owner != queue)
+    {
+      size_t const release_node = resource_ownership.m_last_access;
+      Step& release_step = m_queues[static_cast<size_t>(resource_ownership.m_owner)][m_position[release_node]];
+      Step& acquire_step = m_queues[static_cast<size_t>(queue)][m_position[node]];
+      release_step.m_releases.push_back(resource);
+      acquire_step.m_acquires.push_back(resource);
+      m_ownership_transfers.push_back({
+          .m_resource = resource,
+          .m_src_queue_family = queue_family(resource_ownership.m_owner),
+          .m_dst_queue_family = queue_family(queue),
+          .m_release_node = release_node,
+          .m_acquire_node = node });
+      // The release must happen-before the acquire: that is guaranteed by the dependency between both nodes,
+      // but the wait for it might have been removed in favor of a wait for a later step. Make sure that
+      // the acquiring step waits for at least the releasing step.
+      uint64_t const value = m_position[release_node] + 1;
+      if (!acquire_step.m_wait || acquire_step.m_wait->m_value < value)
+      {
+        acquire_step.m_wait = Wait{ .m_queue = resource_ownership.m_owner, .m_value = value };
+        release_step.m_signal_value = value;
+      }
+      resource_ownership.m_owner = queue;
+    }
+    resource_ownership.m_last_access = node;
+  };
+
+  for (size_t node = 0; node < nodes.size(); ++node)
+  {
+    for (ResourceID resource : nodes[node].m_reads)
+      access(resource, node);
+    for (ResourceID resource : nodes[node].m_writes)
+      access(resource, node);
+  }
+}
+
+size_t QueueSchedule::number_of_waits() const
+{
+  size_t count = 0;
+  for (auto const& steps : m_queues)
+    count += std::count_if(steps.begin(), steps.end(), [](Step const& step){ return step.m_wait.has_value(); });
+  return count;
+}
+
+std::vector<QueueSchedule::Batch> QueueSchedule::batches(QueueType queue) const
+{
+  std::vector<Batch> result;
+  auto const& queue_steps = steps(queue);
+  for (size_t step = 0; step < queue_steps.size(); ++step)
+  {
+    // A step that waits starts a new batch, and so does the step after one that signals.
+    if (result.empty() || queue_steps[step].m_wait || queue_steps[step - 1].m_signal_value)
+      result.push_back({ .m_first_step = step, .m_end_step = step });
+    result.back().m_end_step = step + 1;
+  }
+  return result;
+}
+
+void QueueSchedule::print_on(std::ostream& os, std::vector<ScheduleNode> const& nodes) const
+{
+  for (size_t queue = 0; queue < number_of_queue_types; ++queue)
+  {
+    if (m_queues[queue].empty())
+      continue;
+    os << to_string(static_cast<QueueType>(queue)) << ":\n";
+    for (Step const& step : m_queues[queue])
+    {
+      os << "  ";
+      if (step.m_wait)
+        os << "wait(" << to_string(step.m_wait->m_queue) << " >= " << step.m_wait->m_value << ") ";
+      for (ResourceID resource : step.m_acquires)
+        os << "acquire(" << resource << ") ";
+      os << nodes[step.m_node].m_name;
+      for (ResourceID resource : step.m_releases)
+        os << " release(" << resource << ")";
+      if (step.m_signal_value)
+        os << " signal(" << step.m_signal_value << ")";
+      os << '\n';
+    }
+  }
+}
+
+} // namespace vulkan::rendergraph
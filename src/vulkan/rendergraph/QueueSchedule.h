@@ -0,0 +1,147 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <iosfwd>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace vulkan::rendergraph {
+
+// The type of queue that a node of the render graph prefers to run on.
+enum class QueueType
+{
+  graphics,
+  async_compute
+};
+
+static constexpr size_t number_of_queue_types = 2;
+
+// An opaque identifier of an image or buffer that is accessed by a node.
+using ResourceID = uint32_t;
+
+// ScheduleNode
+//
+// The input of QueueSchedule::generate: a unit of GPU work (a render pass or a compute dispatch)
+// together with the resources that it reads and writes.
+//
+struct ScheduleNode
+{
+  std::string m_name;
+  QueueType m_preferred_queue = QueueType::graphics;
+  std::vector<ResourceID> m_reads;
+  std::vector<ResourceID> m_writes;
+};
+
+// QueueSchedule
+//
+// Distributes the nodes of a frame over the graphics queue and, if available, an async-compute queue.
+//
+// The nodes must be passed in a valid submission order (the order in which they would be executed on a
+// single queue); dependencies are derived from the resource accesses in that order (read-after-write,
+// write-after-read and write-after-write).
+//
+// A node that prefers async compute is only moved to the async-compute queue if that can overlap with
+// graphics work: if every graphics node is either an ancestor or a descendant of it, then it would only
+// add a semaphore round trip and it stays on the graphics queue.
+//
+// Each queue signals its own timeline semaphore; the value signaled by a step is its (one-based) position
+// on that queue. A step that depends on a node on the other queue waits for the value of that node,
+// unless an earlier step on the same queue already waited for that value or a larger one.
+//
+// When the two queues belong to different queue families every resource is assumed to use
+// vk::SharingMode::eExclusive: ownership of a resource is transferred, with a release barrier at the end
+// of the last step of the old owner that accessed it and an acquire barrier at the start of the step
+// that accesses it next. This is done for every access (also writes), because a write does not
+// necessarily overwrite the whole resource. The first access of a resource doesn't need a transfer.
+//
+// Without an async-compute queue (for example lavapipe, that has a single queue) everything runs on the
+// graphics queue, in the given order, without any semaphores or ownership transfers.
+//
+// RenderGraph::generate uses this to schedule its render passes (see RenderGraph::queue_schedule), and
+// SynchronousWindow::submit_render_graph submits them accordingly: each batch (see batches()) as one
+// vk::SubmitInfo with its own command buffer.
+//
+class QueueSchedule
+{
+ public:
+  // The queue families of the available queues.
+  struct QueueFamilies
+  {
+    uint32_t m_graphics;                                // The queue family of the graphics queue.
+    std::optional<uint32_t> m_async_compute;            // The queue family of a separate compute queue, if one was acquired.
+  };
+
+  // Wait (on the queue of the step) until the timeline semaphore of m_queue reached m_value.
+  struct Wait
+  {
+    QueueType m_queue;
+    uint64_t m_value;
+  };
+
+  // A queue-family ownership transfer of m_resource from the queue of m_release_node to the queue of m_acquire_node.
+  struct OwnershipTransfer
+  {
+    ResourceID m_resource;
+    uint32_t m_src_queue_family;
+    uint32_t m_dst_queue_family;
+    size_t m_release_node;                              // Index into the input nodes.
+    size_t m_acquire_node;                              // Index into the input nodes.
+  };
+
+  // The submission of a single node.
+  struct Step
+  {
+    size_t m_node;                                      // Index into the input nodes.
+    std::optional<Wait> m_wait;                         // There is only one other queue, so at most one wait is needed.
+    std::vector<ResourceID> m_acquires;                 // Resources whose ownership must be acquired before executing the node.
+    std::vector<ResourceID> m_releases;                 // Resources whose ownership must be released after executing the node.
+    uint64_t m_signal_value = 0;                        // The value to signal on the timeline semaphore of this queue, or zero if nobody waits for it.
+  };
+
+  // Consecutive steps of one queue that can be submitted together: only the first step waits and only the last step signals.
+  struct Batch
+  {
+    size_t m_first_step;                                // Index into steps(queue).
+    size_t m_end_step;                                  // One past the last step of this batch.
+  };
+
+ private:
+  std::array<std::vector<Step>, number_of_queue_types> m_queues;        // The steps per queue, in submission order.
+  std::vector<QueueType> m_assigned_queue;                              // The queue that each node was assigned to.
+  std::vector<size_t> m_position;                                       // The index of the step of each node in its queue.
+  std::vector<OwnershipTransfer> m_ownership_transfers;
+  std::vector<std::pair<size_t, size_t>> m_dependencies;                // All (producer, consumer) pairs, with producer < consumer.
+
+ public:
+  // Compute the schedule of nodes.
+  void generate(std::vector<ScheduleNode> const& nodes, QueueFamilies const& queue_families);
+
+  // Accessors.
+  std::vector<Step> const& steps(QueueType queue) const { return m_queues[static_cast<size_t>(queue)]; }
+  QueueType assigned_queue(size_t node) const { return m_assigned_queue[node]; }
+  Step const& step_of(size_t node) const { return steps(m_assigned_queue[node])[m_position[node]]; }
+  std::vector<OwnershipTransfer> const& ownership_transfers() const { return m_ownership_transfers; }
+  std::vector<std::pair<size_t, size_t>> const& dependencies() const { return m_dependencies; }
+  bool uses_async_compute() const { return !steps(QueueType::async_compute).empty(); }
+
+  // The number of semaphore waits in the whole schedule.
+  size_t number_of_waits() const;
+
+  // Split the steps of queue into the least number of batches.
+  std::vector<Batch> batches(QueueType queue) const;
+
+ private:
+  void add_dependencies(std::vector<ScheduleNode> const& nodes);
+  void assign_queues(std::vector<ScheduleNode> const& nodes, bool have_async_compute);
+  void add_waits();
+  void add_ownership_transfers(std::vector<ScheduleNode> const& nodes, QueueFamilies const& queue_families);
+
+ public:
+  void print_on(std::ostream& os, std::vector<ScheduleNode> const& nodes) const;
+};
+
+char const* to_string(QueueType queue_type);
+
+} // namespace vulkan::rendergraph
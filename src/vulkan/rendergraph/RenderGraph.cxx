@@ -4,6 +4,7 @@
 #include "Attachment.h"
 #include "LogicalDevice.h"
 #include "SynchronousWindow.h"
+#include <algorithm>
 #include "debug.h"
 #ifdef CWDEBUG
 #include "debug_ostream_operators.h"
@@ -247,6 +248,17 @@ void RenderGraph::generate(task::SynchronousWindow* owning_window)
     }
   }
 
+  // Determine in which order, and on which queue, the render passes are submitted.
+  // Compute passes can only move to the async-compute queue if the window acquired one (see SynchronousWindow::use_async_compute).
+  QueueSchedule::QueueFamilies queue_families{ .m_graphics = 0, .m_async_compute = std::nullopt };
+  if (owning_window)
+  {
+    queue_families.m_graphics = static_cast<uint32_t>(owning_window->presentation_surface().graphics_queue().queue_family().get_value());
+    if (vulkan::Queue const& async_compute_queue = owning_window->async_compute_queue())
+      queue_families.m_async_compute = static_cast<uint32_t>(async_compute_queue.queue_family().get_value());
+  }
+  generate_queue_schedule(all_attachments, queue_families);
+
   // The test suite only generates the graph.
   if (!owning_window)
     return;
@@ -377,15 +389,83 @@ void RenderGraph::generate(task::SynchronousWindow* owning_window)
   boost::write_graphviz(file, g, boost::make_label_writer(get(&gv::VertexProperties::name, g)), gv::EdgeColorWriter(g));
 #endif
 
-  // Run over all render passes to create them.
+  // Create all render passes, in submission order. Compute passes don't have a vk::RenderPass.
+  for (RenderPass* render_pass : m_submission_order)
+    if (!render_pass->is_compute_pass())
+      render_pass->create(owning_window);
+
+  owning_window->detect_if_imgui_is_used();
+}
+
+void RenderGraph::generate_queue_schedule(std::set<Attachment const*, Attachment::CompareIDLessThan> const& all_attachments,
+    QueueSchedule::QueueFamilies const& queue_families)
+{
+  DoutEntering(dc::renderpass, "RenderGraph::generate_queue_schedule(all_attachments, {" << queue_families.m_graphics << ", ...})");
+
+  std::vector<RenderPass*> render_passes;
   for_each_render_pass(search_forwards,
-      [owning_window](RenderPass* render_pass, std::vector<RenderPass*>& UNUSED_ARG(path))
+      [&](RenderPass* render_pass, std::vector<RenderPass*>& UNUSED_ARG(path))
       {
-        render_pass->create(owning_window);
+        render_passes.push_back(render_pass);
         return false;
       });
 
-  owning_window->detect_if_imgui_is_used();
+  // Sort the render passes such that each render pass comes after all of its incoming vertices.
+  m_submission_order.clear();
+  std::set<RenderPass*> ordered;
+  while (m_submission_order.size() < render_passes.size())
+  {
+    [[maybe_unused]] size_t number_of_ordered_render_passes = m_submission_order.size();
+    for (RenderPass* render_pass : render_passes)
+      if (!ordered.contains(render_pass) &&
+          std::ranges::all_of(render_pass->incoming_vertices(), [&](RenderPass* preceding_render_pass){ return ordered.contains(preceding_render_pass); }))
+      {
+        ordered.insert(render_pass);
+        m_submission_order.push_back(render_pass);
+      }
+    // The render graph is a-cyclic, so every sweep must make progress.
+    ASSERT(m_submission_order.size() > number_of_ordered_render_passes);
+  }
+
+  // Give each attachment a ResourceID.
+  std::map<Attachment const*, ResourceID, Attachment::CompareIDLessThan> resource_ids;
+  m_resources.clear();
+  for (Attachment const* attachment : all_attachments)
+    if (resource_ids.try_emplace(attachment, resource_ids.size()).second)
+      m_resources.push_back(attachment);
+
+  // Every attachment that a render pass knows about is written to (see README); it is also read if it is loaded.
+  std::vector<ScheduleNode> nodes;
+  std::map<RenderPass const*, size_t> node_index;
+  for (RenderPass* render_pass : m_submission_order)
+  {
+    ScheduleNode node{ .m_name = render_pass->name(), .m_preferred_queue = render_pass->preferred_queue(), .m_reads = {}, .m_writes = {} };
+    for (AttachmentNode const& attachment_node : render_pass->known_attachments())
+    {
+      Attachment const* attachment = attachment_node.attachment();
+      ResourceID resource_id = resource_ids.at(attachment);
+      if (render_pass->is_load(attachment))
+        node.m_reads.push_back(resource_id);
+      node.m_writes.push_back(resource_id);
+    }
+    node_index[render_pass] = nodes.size();
+    nodes.push_back(std::move(node));
+  }
+
+  // Compute passes usually communicate through buffers, which are not part of the render graph: each vertex of the
+  // graph is therefore a dependency too. It is a resource without attachment (nullptr in m_resources) that is
+  // written by the preceding render pass and read by the subsequent one.
+  for (RenderPass* render_pass : m_submission_order)
+    for (RenderPass* preceding_render_pass : render_pass->incoming_vertices())
+    {
+      ResourceID const resource_id = m_resources.size();
+      m_resources.push_back(nullptr);
+      nodes[node_index.at(preceding_render_pass)].m_writes.push_back(resource_id);
+      nodes[node_index.at(render_pass)].m_reads.push_back(resource_id);
+    }
+
+  Dout(dc::renderpass, "Submission order: " << m_submission_order);
+  m_queue_schedule.generate(nodes, queue_families);
 }
 
 void RenderGraph::operator=(RenderPassStream& sink)
@@ -2,6 +2,7 @@
 
 #include "RenderPass.h"
 #include "ClearValue.h"
+#include "QueueSchedule.h"
 #include <map>
 
 namespace vulkan::rendergraph {
@@ -20,6 +21,9 @@ class RenderGraph
   mutable int m_traversal_id = {};                      // Unique ID to identify which RenderPass nodes have already visited.
                                                         // Incremented every call to for_each_render_pass.
   bool m_have_incoming_outgoing = false;                // Set to true after m_sources was fixed to point to real sources and all RenderPass nodes have correct m_outgoing_vertices.
+  std::vector<RenderPass*> m_submission_order;          // All render passes, in an order in which each render pass comes after its incoming vertices (set by generate()).
+  QueueSchedule m_queue_schedule;                       // The queue schedule of m_submission_order (set by generate()).
+  std::vector<Attachment const*> m_resources;           // The attachment of each ResourceID used in m_queue_schedule, or nullptr for a vertex of the graph (set by generate()).
 
  public:
   // Filled by SynchronousWindow.
@@ -34,6 +38,16 @@ class RenderGraph
   void for_each_render_pass_from(RenderPass* start, Direction direction, std::function<bool(RenderPass*, std::vector<RenderPass*>&)> lambda) const;
   void generate(task::SynchronousWindow* owning_window);
 
+  // Accessors (valid after generate()).
+  std::vector<RenderPass*> const& submission_order() const { return m_submission_order; }
+  QueueSchedule const& queue_schedule() const { return m_queue_schedule; }
+  // Returns nullptr if resource_id is a vertex between two render passes.
+  Attachment const* resource(ResourceID resource_id) const { return m_resources[resource_id]; }
+
+ private:
+  void generate_queue_schedule(std::set<Attachment const*, Attachment::CompareIDLessThan> const& all_attachments,
+      QueueSchedule::QueueFamilies const& queue_families);
+
 #ifdef CWDEBUG
   // Testsuite stuff.
   static void testsuite();
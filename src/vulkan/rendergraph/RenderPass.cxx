@@ -221,6 +221,10 @@ vk::ImageLayout RenderPass::get_initial_layout(Attachment const* attachment, boo
   if (!node->is_source())
     return get_optimal_layout(*node, supports_separate_depth_stencil_layouts);
   vk::ImageLayout initial_layout = attachment->image_kind()->initial_layout;
+  // The first render pass that uses the swapchain image loads it: it was written before the render graph
+  // (for example by SynchronousWindow::upscale_scene), which leaves it ready for presentation.
+  if (node->is_present() && node->is_load() && initial_layout == vk::ImageLayout::eUndefined)
+    return vk::ImageLayout::ePresentSrcKHR;
   vk::ImageLayout final_layout = attachment->get_final_layout();
   if (final_layout != vk::ImageLayout::eUndefined && attachment->image_kind()->initial_layout != final_layout)
     THROW_ALERT("The initial_layout of the ImageKind of attachment \"[ATTACHMENT]\" should be [FINALLAYOUT], but it is [INITIALLAYOUT].",
@@ -237,9 +241,9 @@ vk::ImageLayout RenderPass::get_final_layout(Attachment const* attachment, bool
     return get_optimal_layout(*node, supports_separate_depth_stencil_layouts);
   if (node->is_present())
     return vk::ImageLayout::ePresentSrcKHR;
-  DoutFatal(dc::core, "Couldn't figure out the final layout of \"" << attachment->name() << "\".");
-  ASSERT(false);
-  return vk::ImageLayout::eGeneral;
+  // A stored attachment that is not presented is used after the render graph (for example, it is blitted
+  // into the swapchain image by SynchronousWindow::upscale_scene); leave it in its optimal layout.
+  return get_optimal_layout(*node, supports_separate_depth_stencil_layouts);
 }
 
 void RenderPass::for_all_render_passes_until(
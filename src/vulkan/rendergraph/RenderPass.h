@@ -8,6 +8,8 @@
 #include "Attachment.h"
 #include "RenderPassSubpassData.h"
 #include "FrameResourceIndex.h"
+#include "QueueSchedule.h"
+#include "CommandBuffer.h"
 #include <string>
 #include <functional>
 #include <set>
@@ -35,12 +37,22 @@ class RenderGraph;
 //
 // A RenderPass is a unique object (within the construction of a given RenderGraph).
 //
+// A render pass that prefers the async-compute queue (see set_preferred_queue) is a compute pass:
+// it is a node of the render graph like any other, but no vk::RenderPass or framebuffer is created
+// for it. Its record function dispatches the work outside of a render pass instance and must leave
+// each of its attachments in the layout returned by get_final_layout.
+//
 class RenderPass
 {
   friend class RenderPassStream;                                        // The m_stream object is allowed to access all members of its owner.
 
+ public:
+  using record_function_type = std::function<void(vulkan::handle::CommandBuffer)>;
+
  private:
   std::string m_name;                                                   // Human readable name of this render pass.
+  QueueType m_preferred_queue = QueueType::graphics;                    // The queue that this node prefers to run on (see QueueSchedule).
+  record_function_type m_record_function;                               // Records the commands of this node (see SynchronousWindow::submit_render_graph).
   utils::Vector<AttachmentNode> m_known_attachments;                    // Vector with all known attachments of this render pass.
   pAttachmentsIndex m_next_index{0};                                    // The next attachment index to use for a new attachment node.
   std::vector<Attachment const*> m_remove_or_dontcare_attachments;      // Temporary storage for attachments listed with `[-attachment]`.
@@ -79,6 +91,11 @@ class RenderPass
   // Accessor of m_stream.
   RenderPassStream* operator->() { return &m_stream; }
 
+  // Must be called before RenderGraph::generate.
+  void set_preferred_queue(QueueType preferred_queue) { m_preferred_queue = preferred_queue; }
+  // Set the function that records the commands of this node; called every frame by SynchronousWindow::submit_render_graph.
+  void set_record_function(record_function_type record_function) { m_record_function = std::move(record_function); }
+
   // Graph generation.
   void add_incoming_vertex(RenderPass* node) { m_incoming_vertices.insert(node); }
   void add_outgoing_vertex(RenderPass* node) { m_outgoing_vertices.insert(node); }
@@ -122,6 +139,7 @@ class RenderPass
   bool is_store(Attachment const* attachment) const;
   bool has_incoming_vertices() const { return !m_incoming_vertices.empty(); }
   bool has_outgoing_vertices() const { return !m_outgoing_vertices.empty(); }
+  std::set<RenderPass*> const& incoming_vertices() const { return m_incoming_vertices; }
 
   // Search for Attachment by ID in a container with AttachmentNode's.
   template<typename AttachmentNodes>
@@ -144,6 +162,14 @@ class RenderPass
  public:
   void print_on(std::ostream& os) const;
   std::string const& name() const { return m_name; }
+  QueueType preferred_queue() const { return m_preferred_queue; }
+  bool is_compute_pass() const { return m_preferred_queue == QueueType::async_compute; }
+  void record(vulkan::handle::CommandBuffer command_buffer) const
+  {
+    // Call set_record_function for every render pass of a render graph that is submitted with submit_render_graph.
+    ASSERT(m_record_function);
+    m_record_function(command_buffer);
+  }
 
 #ifdef CWDEBUG
  public:
@@ -2,6 +2,8 @@
 #include "SPIRVCache.h"
 #include "LogicalDevice.h"
 #include "SynchronousWindow.h"
+#include "Application.h"
+#include "ShaderWatcher.h"
 #include "pipeline/ShaderInputData.h"
 #include "utils/AIAlert.h"
 #include "utils/at_scope_end.h"
@@ -72,7 +74,16 @@ void SPIRVCache::compile(std::string_view glsl_source_code, ShaderCompiler const
 
   // Call reset() before reusing a SPIRVCache.
   ASSERT(m_spirv_code.empty());
+
+  // When shader hot-reload is enabled, only compile what wasn't compiled before.
+  task::ShaderWatcher* shader_watcher = Application::instance().shader_watcher();
+  if (shader_watcher && shader_watcher->find_compiled_spirv(shader_info, glsl_source_code, m_spirv_code))
+    return;
+
   m_spirv_code = compiler.compile({}, shader_info, glsl_source_code);
+
+  if (shader_watcher)
+    shader_watcher->store_compiled_spirv(shader_info, glsl_source_code, m_spirv_code);
 }
 
 vk::UniqueShaderModule SPIRVCache::create_module(utils::Badge<vulkan::pipeline::ShaderInputData>, vulkan::LogicalDevice const* logical_device
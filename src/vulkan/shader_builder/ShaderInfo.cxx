@@ -1,7 +1,8 @@
 #include "sys.h"
 #include "ShaderInfo.h"
 #include "SynchronousWindow.h"
-#include <fstream>
+#include "Application.h"
+#include "vk_utils/get_binary_file_contents.h"
 
 namespace vulkan::shader_builder {
 
@@ -47,18 +48,9 @@ ShaderInfo& ShaderInfo::load(std::same_as<std::filesystem::path> auto const& fil
 {
   DoutEntering(dc::vulkan, "ShaderInfo::load(" << filename << ")");
 
-  std::ifstream ifs(filename, std::ios::ate);
-
-  if (ifs.fail())
-    THROW_ALERT("Could not open [FILENAME] file!", AIArgs("[FILENAME]", filename));
-
-  std::streampos const file_size = ifs.tellg();
-  m_glsl_template_code.resize(file_size);
-  ifs.seekg(0, std::ios::beg);
-  ifs.read(m_glsl_template_code.data(), file_size);
-
-  ASSERT(ifs.gcount() == file_size);
-  ASSERT(ifs.good());
+  std::vector<std::byte> const file_data = vk_utils::get_binary_file_contents(filename, Application::instance().file_reader());
+  m_glsl_template_code.assign(reinterpret_cast<char const*>(file_data.data()), file_data.size());
+  m_source_filename = filename;
 
   // Use constructor to set a name, or call set_name(name) before calling this function,
   // if you want to set your own name for this ShaderModule.
@@ -68,6 +60,9 @@ ShaderInfo& ShaderInfo::load(std::same_as<std::filesystem::path> auto const& fil
   return *this;
 }
 
+// Instantiate the only allowed type (the definition is not in the header).
+template ShaderInfo& ShaderInfo::load<std::filesystem::path>(std::filesystem::path const& filename);
+
 ShaderInfo& ShaderInfo::load(std::string_view source)
 {
   // Remove leading white space.
@@ -100,6 +95,7 @@ void ShaderInfo::reset()
 {
   m_name.clear();
   m_glsl_template_code.clear();
+  m_source_filename.clear();
   m_compiler_options = {};
 }
 
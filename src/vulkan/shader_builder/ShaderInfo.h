@@ -26,6 +26,7 @@ class ShaderInfo
                                                         // to reallocate) which requires (move) assignment to work.
   std::string m_name;                                   // Shader name, used for diagnostics.
   std::string m_glsl_template_code;                     // GLSL template source code; loaded with load().
+  std::filesystem::path m_source_filename;              // The file that m_glsl_template_code was loaded from, if any (used for hot-reloading).
   ShaderCompilerOptions m_compiler_options;             // Compile options to use.
 
  public:
@@ -80,6 +81,7 @@ class ShaderInfo
   vk::ShaderStageFlagBits stage() const { return m_stage; }
   std::string const& name() const { return m_name; }
   std::string_view glsl_template_code() const { return m_glsl_template_code; }
+  std::filesystem::path const& source_filename() const { return m_source_filename; }
   ShaderCompilerOptions const& compiler_options() const { return m_compiler_options; }
 
   // Called by ShaderCompiler.
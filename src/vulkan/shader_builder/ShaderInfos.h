@@ -13,6 +13,7 @@ struct UnlockedShaderInfos
 {
   utils::Deque<ShaderInfo, ShaderIndex> deque;          // All ShaderInfo objects. This must be a deque because it is grown after already handing out indices into it.
   std::map<std::size_t, ShaderIndex> hash_to_index;     // A map from ShaderInfo hash values to their index into list.
+  std::map<ShaderIndex, ShaderIndex> reloaded;          // A map from the index of a shader whose source was hot-reloaded to the index of its latest version.
 };
 
 using ShaderInfos = aithreadsafe::Wrapper<UnlockedShaderInfos, aithreadsafe::policy::Primitive<std::mutex>>;
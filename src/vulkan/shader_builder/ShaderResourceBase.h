@@ -211,6 +211,7 @@ class ShaderResourceBase
   virtual void prepare_shader_resource_declaration(descriptor::SetIndexHint set_index_hint, pipeline::ShaderInputData* shader_input_data) const = 0;
   virtual vk::DescriptorBindingFlags binding_flags() const { return {}; }
   virtual int32_t descriptor_array_size() const { return 1; }      // One means it's not an array. Negative means unbounded.
+  virtual vk::ImageViewType image_view_type() const { return vk::ImageViewType::e2D; }  // Only used for combined image samplers.
 
   //---------------------------------------------------------------------------
 
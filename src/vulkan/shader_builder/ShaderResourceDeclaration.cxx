@@ -21,6 +21,11 @@ int32_t ShaderResourceDeclaration::descriptor_array_size() const
   return m_shader_resource.descriptor_array_size();
 }
 
+vk::ImageViewType ShaderResourceDeclaration::image_view_type() const
+{
+  return m_shader_resource.image_view_type();
+}
+
 #ifdef CWDEBUG
 void ShaderResourceDeclaration::print_on(std::ostream& os) const
 {
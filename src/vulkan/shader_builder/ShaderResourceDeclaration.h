@@ -71,6 +71,7 @@ class ShaderResourceDeclaration
   vk::ShaderStageFlags stage_flags() const { return m_stage_flags; }
   vk::DescriptorBindingFlags binding_flags() const;
   int32_t descriptor_array_size() const;
+  vk::ImageViewType image_view_type() const;
 
 #ifdef CWDEBUG
  public:
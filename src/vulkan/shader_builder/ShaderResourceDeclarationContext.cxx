@@ -90,7 +90,8 @@ void ShaderResourceDeclarationContext::add_declarations_for_stage(DeclarationsSt
         ASSERT(variable.size() == 1);
         ShaderResourceVariable const& shader_variable = *variable.begin();
         // layout(set = 0, binding = 0) uniform sampler2D u_Texture_background;
-        oss << "layout(set = " << set_index.get_value() << ", binding = " << binding << ") uniform sampler2D " << shader_variable.name();
+        char const* sampler_type = shader_resource_declaration->image_view_type() == vk::ImageViewType::e2DArray ? "sampler2DArray" : "sampler2D";
+        oss << "layout(set = " << set_index.get_value() << ", binding = " << binding << ") uniform " << sampler_type << " " << shader_variable.name();
         int32_t descriptor_array_size = shader_resource_declaration->descriptor_array_size();
         if (descriptor_array_size > 1)
           oss << "[" << descriptor_array_size << "]";
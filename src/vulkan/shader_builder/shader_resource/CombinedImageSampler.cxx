@@ -25,6 +25,11 @@ void CombinedImageSampler::set_array_size(uint32_t array_size, ArrayType array_t
   m_descriptor_task->set_array_size(array_size, array_type);
 }
 
+void CombinedImageSampler::set_image_view_type(vk::ImageViewType image_view_type)
+{
+  m_descriptor_task->set_image_view_type(image_view_type);
+}
+
 #ifdef CWDEBUG
 void CombinedImageSampler::print_on(std::ostream& os) const
 {
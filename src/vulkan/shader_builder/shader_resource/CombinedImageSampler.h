@@ -24,6 +24,8 @@ class CombinedImageSampler
   void set_glsl_id_postfix(char const* glsl_id_full_postfix);
   void set_bindings_flags(vk::DescriptorBindingFlagBits binding_flags);
   void set_array_size(uint32_t array_size, ArrayType array_type = bounded_array);
+  // Declare the sampler as sampler2DArray instead of sampler2D; for textures with a vk::ImageViewType::e2DArray view.
+  void set_image_view_type(vk::ImageViewType image_view_type);
 
   void update_image_sampler_array(Texture const* texture, pipeline::FactoryCharacteristicId const& factory_characteristic_id, vk_utils::ConsecutiveRange subrange, descriptor::ArrayElementRange array_element_range)
   {
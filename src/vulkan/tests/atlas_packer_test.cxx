@@ -0,0 +1,292 @@
+#include "sys.h"
+#include "vk_utils/AtlasPacker.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+#include "check.h"
+#include "debug.h"
+
+using vk_utils::AtlasPacker;
+using vk_utils::SkylinePacker;
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+bool overlap(vk::Rect2D const& a, vk::Rect2D const& b)
+{
+  return a.offset.x < b.offset.x + static_cast<int32_t>(b.extent.width) && b.offset.x < a.offset.x + static_cast<int32_t>(a.extent.width) &&
+         a.offset.y < b.offset.y + static_cast<int32_t>(b.extent.height) && b.offset.y < a.offset.y + static_cast<int32_t>(a.extent.height);
+}
+
+// The pixels of image `seed`: every texel is different, so that misplaced pixels are detected.
+std::vector<std::byte> test_image(vk::Extent2D extent, uint32_t seed)
+{
+  std::vector<std::byte> pixels(size_t{extent.width} * extent.height * 4);
+  for (uint32_t y = 0; y < extent.height; ++y)
+    for (uint32_t x = 0; x < extent.width; ++x)
+    {
+      std::byte* texel = &pixels[(size_t{y} * extent.width + x) * 4];
+      texel[0] = static_cast<std::byte>(x);
+      texel[1] = static_cast<std::byte>(y);
+      texel[2] = static_cast<std::byte>(seed);
+      texel[3] = static_cast<std::byte>(seed >> 8);
+    }
+  return pixels;
+}
+
+// Pack rectangles into a bin until one doesn't fit; check that they don't overlap and stay inside.
+// Returns the occupancy.
+double fill(vk::Extent2D bin, uint32_t min_size, uint32_t max_size, unsigned seed, bool sorted, size_t& count, bool& valid)
+{
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<uint32_t> size(min_size, max_size);
+  std::vector<vk::Extent2D> extents(20000);
+  for (auto& extent : extents)
+    extent = { size(rng), size(rng) };
+  if (sorted)
+    std::sort(extents.begin(), extents.end(), [](vk::Extent2D a, vk::Extent2D b){ return a.height > b.height; });
+
+  SkylinePacker packer(bin);
+  std::vector<vk::Rect2D> rects;
+  valid = true;
+  for (vk::Extent2D extent : extents)
+  {
+    std::optional<vk::Offset2D> offset = packer.insert(extent);
+    if (!offset)
+      break;
+    vk::Rect2D const rect{ *offset, extent };
+    valid &= rect.offset.x >= 0 && rect.offset.y >= 0 &&
+        rect.offset.x + extent.width <= bin.width && rect.offset.y + extent.height <= bin.height;
+    for (vk::Rect2D const& other : rects)
+      valid &= !overlap(rect, other);
+    rects.push_back(rect);
+  }
+  count = rects.size();
+  return packer.occupancy();
+}
+
+void test_skyline()
+{
+  // Equal squares that tile the bin exactly.
+  {
+    SkylinePacker packer({ 256, 256 });
+    int packed = 0;
+    while (packer.insert({ 32, 32 }))
+      ++packed;
+    check(packed == 64 && packer.occupancy() == 1.0, "equal squares fill the bin completely");
+    packer.reset();
+    check(packer.used_area() == 0 && packer.insert({ 256, 256 }), "reset() empties the bin");
+  }
+
+  for (bool sorted : { false, true })
+  {
+    size_t count;
+    bool valid;
+    auto const start = clock_type::now();
+    double const occupancy = fill({ 1024, 1024 }, 8, 64, 1, sorted, count, valid);
+    std::chrono::duration<double> const time = clock_type::now() - start;
+    std::cout << "Skyline, " << (sorted ? "sorted by height" : "random order") << ": " << count << " rectangles of 8..64 texels in " <<
+      (time.count() * 1000.0) << " ms, occupancy " << (occupancy * 100.0) << "%." << std::endl;
+    check(valid, "packed rectangles don't overlap and stay inside the bin");
+    check(occupancy > (sorted ? 0.9 : 0.8), "the skyline packer fills most of the bin");
+  }
+
+  // Speed: icon-sized rectangles into a large bin.
+  {
+    std::mt19937 rng(2);
+    std::uniform_int_distribution<uint32_t> size(8, 48);
+    SkylinePacker packer({ 4096, 4096 });
+    size_t packed = 0;
+    auto const start = clock_type::now();
+    while (packer.insert({ size(rng), size(rng) }))
+      ++packed;
+    std::chrono::duration<double> const time = clock_type::now() - start;
+    std::cout << "Skyline: packed " << packed << " rectangles into 4096x4096 in " << (time.count() * 1000.0) << " ms (" <<
+      (packed / time.count() / 1e6) << " M/s), occupancy " << (packer.occupancy() * 100.0) << "%." << std::endl;
+  }
+}
+
+// Check that every image in the atlas has its pixels and gutter, and that no two images (with gutter) overlap.
+void verify(AtlasPacker const& atlas, std::map<AtlasPacker::id_type, std::pair<vk::Extent2D, uint32_t>> const& images, uint32_t padding, char const* what)
+{
+  bool pixels_ok = true;
+  bool disjoint = true;
+  vk::Extent2D const layer_extent = atlas.layer_extent();
+  std::vector<std::vector<vk::Rect2D>> padded_rects(atlas.layer_count());
+  for (auto const& [id, image] : images)
+  {
+    AtlasPacker::Placement const placement = atlas.placement(id);
+    vk::Rect2D const& rect = placement.m_rect;
+    pixels_ok &= rect.extent.width == image.first.width && rect.extent.height == image.first.height;
+    std::vector<std::byte> const expected = test_image(image.first, image.second);
+    std::vector<std::byte> const& layer = atlas.layer_pixels(placement.m_layer);
+    int32_t const p = padding;
+    for (int32_t y = -p; y < static_cast<int32_t>(rect.extent.height) + p; ++y)
+      for (int32_t x = -p; x < static_cast<int32_t>(rect.extent.width) + p; ++x)
+      {
+        int32_t const sx = std::clamp(x, 0, static_cast<int32_t>(rect.extent.width) - 1);
+        int32_t const sy = std::clamp(y, 0, static_cast<int32_t>(rect.extent.height) - 1);
+        size_t const offset = ((static_cast<size_t>(rect.offset.y + y)) * layer_extent.width + rect.offset.x + x) * 4;
+        pixels_ok &= std::memcmp(&layer[offset], &expected[(static_cast<size_t>(sy) * rect.extent.width + sx) * 4], 4) == 0;
+      }
+    vk::Rect2D const padded{ { rect.offset.x - p, rect.offset.y - p }, { rect.extent.width + 2 * padding, rect.extent.height + 2 * padding } };
+    for (vk::Rect2D const& other : padded_rects[placement.m_layer])
+      disjoint &= !overlap(padded, other);
+    padded_rects[placement.m_layer].push_back(padded);
+  }
+  check(pixels_ok, what);
+  check(disjoint, "images with their gutter don't overlap");
+}
+
+void test_atlas()
+{
+  constexpr uint32_t padding = 2;
+  AtlasPacker atlas({ 256, 256 }, 2, padding, 4);
+  std::map<AtlasPacker::id_type, std::pair<vk::Extent2D, uint32_t>> images;
+  uint32_t seed = 0;
+
+  auto insert = [&](vk::Extent2D extent) -> bool {
+    std::vector<std::byte> const pixels = test_image(extent, ++seed);
+    std::optional<AtlasPacker::id_type> id = atlas.insert(extent, pixels);
+    if (id)
+    {
+      check(!images.contains(*id), "insert() returns an id that is not in use");
+      images[*id] = { extent, seed };
+    }
+    return id.has_value();
+  };
+
+  check(insert({ 30, 20 }) && insert({ 1, 1 }) && insert({ 60, 7 }), "small images are inserted");
+  verify(atlas, images, padding, "images and their gutter are written to the layer");
+  check(!atlas.insert({ 253, 10 }, test_image({ 253, 10 }, 0)), "an image that doesn't fit with its gutter is refused");
+
+  // The UV rectangle covers the image.
+  {
+    AtlasPacker::id_type const id = images.begin()->first;
+    AtlasPacker::UVRect const uv = atlas.uv(id);
+    vk::Rect2D const rect = atlas.placement(id).m_rect;
+    check(uv.m_u0 * 256 == rect.offset.x && uv.m_v1 * 256 == rect.offset.y + static_cast<int32_t>(rect.extent.height), "uv() returns the rectangle of the image");
+  }
+
+  // The dirty regions cover everything that was written.
+  {
+    std::vector<AtlasPacker::Region> const regions = atlas.take_dirty_regions();
+    bool covered = true;
+    for (auto const& [id, image] : images)
+    {
+      vk::Rect2D const rect = atlas.placement(id).m_rect;
+      bool found = false;
+      for (AtlasPacker::Region const& region : regions)
+        found |= region.m_layer == atlas.placement(id).m_layer &&
+            region.m_rect.offset.x <= rect.offset.x - static_cast<int32_t>(padding) && region.m_rect.offset.y <= rect.offset.y - static_cast<int32_t>(padding) &&
+            region.m_rect.offset.x + region.m_rect.extent.width >= rect.offset.x + rect.extent.width + padding &&
+            region.m_rect.offset.y + region.m_rect.extent.height >= rect.offset.y + rect.extent.height + padding;
+      covered &= found;
+    }
+    check(covered, "the dirty regions cover all inserted images");
+    check(atlas.take_dirty_regions().empty(), "take_dirty_regions() clears the dirty regions");
+    std::vector<std::byte> const pixels = atlas.region_pixels(regions[0]);
+    check(pixels.size() == size_t{regions[0].m_rect.extent.width} * regions[0].m_rect.extent.height * 4 &&
+        std::memcmp(pixels.data(), &atlas.layer_pixels(regions[0].m_layer)[(static_cast<size_t>(regions[0].m_rect.offset.y) * 256 + regions[0].m_rect.offset.x) * 4], 4) == 0,
+        "region_pixels() returns the pixels of the region");
+  }
+
+  // Fill both layers, then remove every other image and insert more: that requires defragmentation.
+  while (insert({ 12 + seed % 20, 10 + seed % 13 }))
+    ;
+  check(atlas.layer_count() == 2, "a second layer is added when the first one is full");
+  verify(atlas, images, padding, "all images are intact when the atlas is full");
+  size_t const full_count = images.size();
+  bool odd = false;
+  for (auto it = images.begin(); it != images.end();)
+  {
+    if ((odd = !odd))
+    {
+      atlas.erase(it->first);
+      it = images.erase(it);
+    }
+    else
+      ++it;
+  }
+  uint64_t const generation = atlas.generation();
+  size_t reinserted = 0;
+  while (insert({ 12 + seed % 20, 10 + seed % 13 }))
+    ++reinserted;
+  AtlasPacker::Stats const stats = atlas.stats();
+  std::cout << "Atlas: "; stats.print_on(std::cout); std::cout << std::endl;
+  check(atlas.generation() > generation && stats.m_defragmentations > 0, "insert() defragments when the atlas is full of removed images");
+  check(reinserted > full_count / 3, "defragmentation reclaims the space of removed images");
+  verify(atlas, images, padding, "all images are intact after defragmentation");
+
+  // Update the pixels of an image.
+  {
+    auto& [id, image] = *images.begin();
+    image.second = 12345;
+    atlas.take_dirty_regions();
+    atlas.update(id, test_image(image.first, image.second));
+    check(atlas.take_dirty_regions().size() == 1, "update() marks the image dirty");
+    verify(atlas, images, padding, "update() replaces the pixels");
+  }
+}
+
+// Random insertions and removals of icon-sized images.
+void test_churn()
+{
+  constexpr uint32_t padding = 1;
+  AtlasPacker atlas({ 1024, 1024 }, 4, padding, 4);
+  std::map<AtlasPacker::id_type, std::pair<vk::Extent2D, uint32_t>> images;
+  std::mt19937 rng(3);
+  std::uniform_int_distribution<uint32_t> size(8, 64);
+  uint32_t seed = 0;
+  size_t refused = 0;
+  size_t dirty_regions = 0;
+  auto const start = clock_type::now();
+  for (int i = 0; i < 50000; ++i)
+  {
+    if (images.size() < 800 || rng() % 2)
+    {
+      vk::Extent2D const extent{ size(rng), size(rng) };
+      std::optional<AtlasPacker::id_type> id = atlas.insert(extent, test_image(extent, ++seed));
+      if (id)
+        images[*id] = { extent, seed };
+      else
+        ++refused;
+    }
+    else
+    {
+      auto it = images.begin();
+      std::advance(it, rng() % images.size());
+      atlas.erase(it->first);
+      images.erase(it);
+    }
+    if (i % 100 == 0)
+      dirty_regions += atlas.take_dirty_regions().size();
+  }
+  std::chrono::duration<double> const time = clock_type::now() - start;
+  AtlasPacker::Stats const stats = atlas.stats();
+  std::cout << "Churn: 50000 operations in " << (time.count() * 1000.0) << " ms, " << refused << " refused, " << dirty_regions <<
+    " dirty regions; "; stats.print_on(std::cout); std::cout << std::endl;
+  check(stats.m_images == images.size(), "the statistics count the images");
+  verify(atlas, images, padding, "all images are intact after churn");
+  check(atlas.defragment(), "defragmentation of a partially filled atlas succeeds");
+  verify(atlas, images, padding, "all images are intact after an explicit defragmentation");
+  check(atlas.stats().m_garbage_area == 0, "defragmentation reclaims all garbage");
+}
+
+} // namespace
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  test_skyline();
+  test_atlas();
+  test_churn();
+
+  return checks_result();
+}
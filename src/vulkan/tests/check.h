@@ -0,0 +1,34 @@
+#pragma once
+
+#include <iostream>
+
+// The check harness of the tests in this directory.
+//
+// Call check(condition, what) for everything that must hold, then end main() with
+//
+//   return checks_result();
+//
+// which prints "Success!" when all checks passed, or the number of failed checks otherwise,
+// and returns the exit code of the test.
+
+inline int failures = 0;
+
+inline void check(bool condition, char const* what)
+{
+  if (!condition)
+  {
+    std::cerr << "FAILED: " << what << std::endl;
+    ++failures;
+  }
+}
+
+inline int checks_result()
+{
+  if (failures)
+  {
+    std::cerr << failures << " check(s) failed." << std::endl;
+    return 1;
+  }
+  std::cout << "Success!" << std::endl;
+  return 0;
+}
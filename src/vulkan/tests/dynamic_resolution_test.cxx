@@ -0,0 +1,141 @@
+#include "sys.h"
+#include "DynamicResolution.h"
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <random>
+#include <iostream>
+#include <cmath>
+#include "check.h"
+#include "debug.h"
+
+using vulkan::DynamicResolution;
+
+namespace {
+
+// A synthetic frame: the GPU time is a fixed cost plus a cost proportional to the number of pixels (scale²),
+// with some noise. The CPU time doesn't depend on the scale.
+struct SyntheticLoad
+{
+  float m_fixed_gpu_ms;
+  float m_per_pixel_gpu_ms;             // The GPU time of the resolution dependent part at scale 1.
+  float m_cpu_ms;
+
+  float gpu_ms(float scale) const { return m_fixed_gpu_ms + m_per_pixel_gpu_ms * scale * scale; }
+};
+
+// Drives a DynamicResolution controller like the render loop does: the measurements of a frame
+// only become available after s_frames_in_flight frames.
+class Simulation
+{
+  static constexpr int s_frames_in_flight = 2;
+
+  DynamicResolution m_controller;
+  std::deque<std::pair<float, float>> m_in_flight;      // CPU and GPU time of the frames that didn't complete yet.
+  std::mt19937 m_rng{12345};
+  std::uniform_real_distribution<float> m_noise{-0.03f, 0.03f};
+  int m_frame = 0;
+  std::vector<int> m_change_frames;
+
+ public:
+  Simulation(DynamicResolution::Settings const& settings = {}) : m_controller(settings) { }
+
+  void run(SyntheticLoad const& load, int frames)
+  {
+    for (int i = 0; i < frames; ++i, ++m_frame)
+    {
+      float const scale = m_controller.scale();
+      m_in_flight.emplace_back(load.m_cpu_ms * (1.0f + m_noise(m_rng)), load.gpu_ms(scale) * (1.0f + m_noise(m_rng)));
+      if (m_in_flight.size() <= s_frames_in_flight)
+        continue;
+      auto [cpu_ms, gpu_ms] = m_in_flight.front();
+      m_in_flight.pop_front();
+      if (m_controller.update(cpu_ms, gpu_ms))
+        m_change_frames.push_back(m_frame);
+    }
+  }
+
+  // The number of scale changes during the last `frames` frames.
+  int changes_during_last(int frames) const
+  {
+    return std::count_if(m_change_frames.begin(), m_change_frames.end(), [&](int frame){ return frame >= m_frame - frames; });
+  }
+
+  DynamicResolution const& controller() const { return m_controller; }
+};
+
+} // namespace
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  DynamicResolution::Settings const settings;
+  float const aimed_gpu_ms = settings.headroom * settings.target_frame_time_ms;
+
+  // Converges to the scale where the GPU time is just below the aimed time, and then stays there.
+  {
+    SyntheticLoad const heavy{ .m_fixed_gpu_ms = 2.0f, .m_per_pixel_gpu_ms = 30.0f, .m_cpu_ms = 5.0f };
+    Simulation simulation(settings);
+    simulation.run(heavy, 200);
+    float const scale = simulation.controller().scale();
+    float const gpu_ms = heavy.gpu_ms(scale);
+    std::cout << "heavy load: scale " << scale << ", GPU " << gpu_ms << " ms (aim " << aimed_gpu_ms << " ms), " <<
+      simulation.controller().number_of_changes() << " changes." << std::endl;
+    check(gpu_ms <= aimed_gpu_ms * (1.0f + settings.deadband), "heavy load: GPU time converged to at most the aimed time");
+    check(gpu_ms >= aimed_gpu_ms * (1.0f - 2 * settings.deadband), "heavy load: GPU time converged close to the aimed time");
+    check(simulation.controller().number_of_changes() <= 10, "heavy load: converged in a few steps");
+    simulation.run(heavy, 1000);
+    check(simulation.changes_during_last(1000) == 0, "heavy load: stable after convergence");
+    check(simulation.controller().scale() == scale, "heavy load: scale unchanged after convergence");
+  }
+
+  // A light load stays at the maximum scale.
+  {
+    SyntheticLoad const light{ .m_fixed_gpu_ms = 1.0f, .m_per_pixel_gpu_ms = 5.0f, .m_cpu_ms = 3.0f };
+    Simulation simulation(settings);
+    simulation.run(light, 500);
+    check(simulation.controller().scale() == settings.max_scale, "light load: stays at max_scale");
+    check(simulation.controller().number_of_changes() == 0, "light load: never changes");
+  }
+
+  // An impossible load is clamped at the minimum scale.
+  {
+    SyntheticLoad const impossible{ .m_fixed_gpu_ms = 20.0f, .m_per_pixel_gpu_ms = 50.0f, .m_cpu_ms = 3.0f };
+    Simulation simulation(settings);
+    simulation.run(impossible, 500);
+    check(simulation.controller().scale() == settings.min_scale, "impossible load: clamped at min_scale");
+    check(simulation.changes_during_last(300) == 0, "impossible load: stable at min_scale");
+  }
+
+  // When CPU bound, lowering the resolution doesn't help and isn't done.
+  {
+    SyntheticLoad const cpu_bound{ .m_fixed_gpu_ms = 2.0f, .m_per_pixel_gpu_ms = 20.0f, .m_cpu_ms = 30.0f };
+    Simulation simulation(settings);
+    simulation.run(cpu_bound, 500);
+    check(simulation.controller().scale() == settings.max_scale, "CPU bound: scale isn't lowered");
+  }
+
+  // Follows a load that changes: heavier, then back to light.
+  {
+    SyntheticLoad const medium{ .m_fixed_gpu_ms = 2.0f, .m_per_pixel_gpu_ms = 16.0f, .m_cpu_ms = 5.0f };
+    SyntheticLoad const heavy{ .m_fixed_gpu_ms = 2.0f, .m_per_pixel_gpu_ms = 40.0f, .m_cpu_ms = 5.0f };
+    Simulation simulation(settings);
+    simulation.run(medium, 300);
+    float const medium_scale = simulation.controller().scale();
+    simulation.run(heavy, 300);
+    float const heavy_scale = simulation.controller().scale();
+    check(heavy_scale < medium_scale, "step: scale goes down when the load increases");
+    check(heavy.gpu_ms(heavy_scale) <= aimed_gpu_ms * (1.0f + settings.deadband), "step: GPU time back at the aimed time");
+    check(simulation.changes_during_last(150) == 0, "step: stable after the increase");
+    simulation.run(medium, 300);
+    float const recovered_scale = simulation.controller().scale();
+    std::cout << "step: scale " << medium_scale << " --> " << heavy_scale << " --> " << recovered_scale << std::endl;
+    // Coming from below the scale may settle one step lower than when coming from above (that is the hysteresis).
+    check(std::abs(recovered_scale - medium_scale) <= settings.scale_step, "step: scale recovers when the load decreases again");
+    check(medium.gpu_ms(recovered_scale) <= aimed_gpu_ms * (1.0f + settings.deadband), "step: GPU time at most the aimed time after recovery");
+    check(simulation.changes_during_last(150) == 0, "step: stable after the decrease");
+  }
+
+  return checks_result();
+}
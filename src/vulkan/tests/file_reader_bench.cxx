@@ -0,0 +1,206 @@
+#include "sys.h"
+#include "AsyncFileReader.h"
+#include "vk_utils/get_binary_file_contents.h"
+#include "threadpool/AIThreadPool.h"
+#include <sys/resource.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "debug.h"
+
+// Microbenchmark comparing ways to load many files:
+// - get_binary_file_contents without a file reader on thread pool workers (plain blocking reads);
+// - AsyncFileReader with io_uring;
+// - AsyncFileReader without io_uring (reading on the thread pool).
+//
+// Usage: file_reader_bench <directory>
+// All regular files below directory are read. Every file is read once before measuring, so the
+// results compare warm page cache reads unless the caches are dropped in between (as root:
+// echo 3 > /proc/sys/vm/drop_caches).
+//
+// Besides the throughput, the "busy thread time" is printed: the total time that threads were
+// blocked in file I/O calls. For get_binary_file_contents that is time that thread pool workers
+// can't run tasks; for AsyncFileReader with io_uring it is the time spent queuing the reads.
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+using vulkan::AsyncFileReader;
+
+struct Measurement
+{
+  std::chrono::duration<double> m_wall;
+  std::chrono::duration<double> m_busy;         // Thread time spent in I/O calls (zero if not measured).
+  std::chrono::duration<double> m_cpu;          // User plus system time of the process.
+};
+
+std::chrono::duration<double> cpu_time()
+{
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  auto to_seconds = [](timeval tv){ return std::chrono::duration<double>(tv.tv_sec + 1e-6 * tv.tv_usec); };
+  return to_seconds(usage.ru_utime) + to_seconds(usage.ru_stime);
+}
+
+void print(char const* name, Measurement const& measurement, size_t files, size_t bytes)
+{
+  std::cout << std::left << std::setw(40) << name << std::right << std::fixed << std::setprecision(1) <<
+    std::setw(8) << (measurement.m_wall.count() * 1000.0) << " ms, " <<
+    std::setw(8) << (bytes / (1024.0 * 1024.0) / measurement.m_wall.count()) << " MiB/s, " <<
+    std::setw(9) << (files / measurement.m_wall.count()) << " files/s, busy thread time " <<
+    std::setw(8) << (measurement.m_busy.count() * 1000.0) << " ms, cpu " <<
+    std::setw(8) << (measurement.m_cpu.count() * 1000.0) << " ms" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  if (argc != 2 || !std::filesystem::is_directory(argv[1]))
+  {
+    std::cerr << "Usage: " << argv[0] << " <directory>" << std::endl;
+    return 1;
+  }
+
+  std::vector<std::filesystem::path> paths;
+  size_t total_bytes = 0;
+  for (auto const& entry : std::filesystem::recursive_directory_iterator(argv[1], std::filesystem::directory_options::skip_permission_denied))
+    if (entry.is_regular_file())
+    {
+      paths.push_back(entry.path());
+      total_bytes += entry.file_size();
+    }
+  std::cout << paths.size() << " files, " << (total_bytes / (1024.0 * 1024.0)) << " MiB." << std::endl;
+  if (paths.empty())
+    return 1;
+
+  unsigned int const hardware_threads = std::max(1U, std::thread::hardware_concurrency());
+  AIThreadPool thread_pool(hardware_threads);
+  AIQueueHandle const queue_handle = thread_pool.new_queue(256);
+  auto& queue = thread_pool.get_queue(queue_handle);
+
+  // Warm up the page cache and remember the contents to check the other methods against.
+  std::vector<std::vector<std::byte>> reference(paths.size());
+  for (size_t i = 0; i < paths.size(); ++i)
+    reference[i] = vk_utils::get_binary_file_contents(paths[i]);
+
+  std::vector<std::vector<std::byte>> contents(paths.size());
+  int failures = 0;
+  auto verify = [&](char const* name){
+    size_t mismatches = 0;
+    for (size_t i = 0; i < paths.size(); ++i)
+      if (contents[i] != reference[i])
+        ++mismatches;
+    if (mismatches > 0)
+    {
+      std::cerr << "FAILED: " << name << " read " << mismatches << " files incorrectly." << std::endl;
+      ++failures;
+    }
+    contents.assign(paths.size(), {});
+  };
+
+  // The current path: one get_binary_file_contents per file, on the thread pool.
+  {
+    std::atomic<size_t> finished = 0;
+    std::atomic<int64_t> busy_ns = 0;
+    auto const cpu_start = cpu_time();
+    auto const start = clock_type::now();
+    for (size_t i = 0; i < paths.size(); ++i)
+    {
+      for (;;)
+      {
+        {
+          auto queue_access = queue.producer_access();
+          if (queue_access.length() < queue.capacity())
+          {
+            queue_access.move_in([&, i](){
+              auto const read_start = clock_type::now();
+              contents[i] = vk_utils::get_binary_file_contents(paths[i]);
+              busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - read_start).count();
+              finished.fetch_add(1, std::memory_order_release);
+              finished.notify_one();
+              return false;
+            });
+            break;
+          }
+        }
+        queue.notify_one();
+        std::this_thread::yield();
+      }
+      queue.notify_one();
+    }
+    for (size_t done; (done = finished.load(std::memory_order_acquire)) < paths.size();)
+      finished.wait(done, std::memory_order_acquire);
+    Measurement const measurement{ clock_type::now() - start, std::chrono::nanoseconds(busy_ns.load()), cpu_time() - cpu_start };
+    print("get_binary_file_contents on thread pool", measurement, paths.size(), total_bytes);
+    verify("get_binary_file_contents");
+  }
+
+  for (bool use_io_uring : { true, false })
+  {
+    AsyncFileReader reader(queue_handle, use_io_uring);
+    if (use_io_uring && !reader.uses_io_uring())
+    {
+      std::cout << "io_uring is not available." << std::endl;
+      continue;
+    }
+    auto const cpu_start = cpu_time();
+    auto const start = clock_type::now();
+    for (size_t i = 0; i < paths.size(); ++i)
+      reader.read_file(paths[i], contents[i], nullptr);
+    reader.submit();
+    // With io_uring, the calling thread is only busy queuing the reads.
+    auto const queued = clock_type::now();
+    reader.wait_idle();
+    auto const end = clock_type::now();
+    Measurement const measurement{ end - start, use_io_uring ? queued - start : std::chrono::duration<double>{}, cpu_time() - cpu_start };
+    print(use_io_uring ? "AsyncFileReader (io_uring)" : "AsyncFileReader (thread pool)", measurement, paths.size(), total_bytes);
+    verify(use_io_uring ? "AsyncFileReader (io_uring)" : "AsyncFileReader (thread pool)");
+  }
+
+  // Reads into registered buffers.
+  {
+    AsyncFileReader reader(queue_handle);
+    if (reader.uses_io_uring())
+    {
+      std::vector<std::byte> staging(total_bytes);
+      if (reader.register_buffers({ std::span<std::byte>(staging) }))
+      {
+        auto const cpu_start = cpu_time();
+        auto const start = clock_type::now();
+        size_t offset = 0;
+        for (size_t i = 0; i < paths.size(); ++i)
+        {
+          size_t const size = reference[i].size();
+          reader.read(paths[i], staging.data() + offset, size, 0, nullptr);
+          offset += size;
+        }
+        reader.submit();
+        auto const queued = clock_type::now();
+        reader.wait_idle();
+        Measurement const measurement{ clock_type::now() - start, queued - start, cpu_time() - cpu_start };
+        print("AsyncFileReader (registered buffer)", measurement, paths.size(), total_bytes);
+        offset = 0;
+        for (size_t i = 0; i < paths.size(); ++i)
+        {
+          contents[i].assign(staging.begin() + offset, staging.begin() + offset + reference[i].size());
+          offset += reference[i].size();
+        }
+        verify("AsyncFileReader (registered buffer)");
+      }
+      else
+        std::cout << "Could not register a buffer of " << total_bytes << " bytes (see ulimit -l)." << std::endl;
+    }
+  }
+
+  if (failures == 0)
+    std::cout << "Success!" << std::endl;
+  return failures == 0 ? 0 : 1;
+}
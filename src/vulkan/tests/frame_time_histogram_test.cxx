@@ -0,0 +1,47 @@
+#include "sys.h"
+#include "FrameTimeHistogram.h"
+#include <iostream>
+#include <cmath>
+#include "check.h"
+#include "debug.h"
+
+using vulkan::FrameTimeHistogram;
+
+namespace {
+
+bool near(float a, float b)
+{
+  return std::abs(a - b) < 1e-4f;
+}
+
+} // namespace
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  FrameTimeHistogram histogram;
+  check(histogram.count() == 0 && histogram.percentile(0.5f) == 0.0f && histogram.mean() == 0.0f, "empty");
+
+  // 98 frames of 16.6 ms, one of 33.3 ms and one of 250 ms (beyond max_ms).
+  for (int i = 0; i < 98; ++i)
+    histogram.add(16.6f);
+  histogram.add(33.3f);
+  histogram.add(250.0f);
+  histogram.add(-1.0f);
+  histogram.print_on(std::cout);
+  std::cout << std::endl;
+
+  check(histogram.count() == 100, "negative samples are ignored");
+  check(near(histogram.percentile(0.5f), 16.75f), "p50 is the upper edge of the bin");
+  check(near(histogram.percentile(0.98f), 16.75f), "p98");
+  check(near(histogram.percentile(0.99f), 33.5f), "p99");
+  check(near(histogram.percentile(1.0f), 250.0f), "overflow bin reports the maximum");
+  check(near(histogram.max(), 250.0f), "max");
+  check(std::abs(histogram.mean() - (98 * 16.6f + 33.3f + 250.0f) / 100) < 1e-3f, "mean");
+
+  histogram.reset();
+  check(histogram.count() == 0 && histogram.max() == 0.0f, "reset");
+
+  return checks_result();
+}
@@ -0,0 +1,523 @@
+#include "sys.h"
+#include "memory/ImagePool.h"
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include "check.h"
+#include "debug.h"
+
+using namespace vulkan;
+using memory::ImagePool;
+
+namespace {
+
+constexpr vk::DeviceSize MiB = 1024 * 1024;
+using frame_type = ImagePool::frame_type;
+using clock_type = std::chrono::steady_clock;
+
+// Wait without sleeping, to simulate the cost of a Vulkan call.
+void spin(std::chrono::nanoseconds duration)
+{
+  auto const end = clock_type::now() + duration;
+  while (clock_type::now() < end)
+    ;
+}
+
+// A Backend that hands out fake handles, checks that they are used correctly and simulates the cost
+// of the Vulkan calls (allocating memory being the most expensive).
+class FakeBackend final : public ImagePool::Backend
+{
+ public:
+  static constexpr uint32_t s_host_visible_memory_type = 2;
+
+  struct ImageInfo
+  {
+    ImagePool::Requirements m_requirements;
+    VmaAllocation m_bound = nullptr;
+  };
+
+  struct AllocationInfo
+  {
+    ImagePool::Requirements m_requirements;     // As passed to allocate_memory.
+    uint32_t m_memory_type;
+    VkImage m_bound_to = nullptr;
+  };
+
+  struct Counts
+  {
+    uint64_t m_creates = 0;
+    uint64_t m_destroys = 0;
+    uint64_t m_allocations = 0;
+    uint64_t m_binds = 0;
+    uint64_t m_frees = 0;
+
+    uint64_t total() const { return m_creates + m_destroys + m_allocations + m_binds + m_frees; }
+  };
+
+  std::mutex m_mutex;
+  std::map<VkImage, ImageInfo> m_images;
+  std::map<VmaAllocation, AllocationInfo> m_allocations;
+  Counts m_counts;
+  uintptr_t m_next_handle = 1;
+  bool m_simulate_cost = false;
+
+  // Images that might still be used by the GPU: the frame of their last use.
+  std::map<VkImage, frame_type> m_last_use;
+  frame_type m_retired_end = 0;                 // Every frame before this one finished.
+
+  bool in_use_by_gpu(VkImage vh_image) const
+  {
+    auto last_use = m_last_use.find(vh_image);
+    return last_use != m_last_use.end() && last_use->second >= m_retired_end;
+  }
+
+  static ImagePool::Requirements requirements(vk::ImageCreateInfo const& image_create_info)
+  {
+    vk::DeviceSize texels = vk::DeviceSize{image_create_info.extent.width} * image_create_info.extent.height * image_create_info.arrayLayers;
+    if (image_create_info.mipLevels > 1)
+      texels = texels * 4 / 3;
+    bool const linear = image_create_info.tiling == vk::ImageTiling::eLinear;
+    vk::DeviceSize const alignment = linear ? 256 : 4096;
+    vk::DeviceSize const size = (texels * 4 * static_cast<uint32_t>(image_create_info.samples) + alignment - 1) / alignment * alignment;
+    return { size, alignment, linear ? 0b100U : 0b111U };
+  }
+
+  vk::Image create_image(vk::ImageCreateInfo const& image_create_info, ImagePool::Requirements& requirements_out) override
+  {
+    if (m_simulate_cost)
+      spin(std::chrono::microseconds(2));
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_counts.m_creates;
+    VkImage vh_image = reinterpret_cast<VkImage>(m_next_handle++);
+    requirements_out = requirements(image_create_info);
+    m_images[vh_image] = { requirements_out };
+    return vh_image;
+  }
+
+  void destroy_image(vk::Image vh_image) override
+  {
+    if (m_simulate_cost)
+      spin(std::chrono::microseconds(2));
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_counts.m_destroys;
+    auto image = m_images.find(static_cast<VkImage>(vh_image));
+    check(image != m_images.end(), "destroy_image of an existing image");
+    if (image == m_images.end())
+      return;
+    check(!in_use_by_gpu(image->first), "no image is destroyed while the GPU might use it");
+    if (image->second.m_bound)
+      m_allocations[image->second.m_bound].m_bound_to = nullptr;
+    m_last_use.erase(image->first);
+    m_images.erase(image);
+  }
+
+  VmaAllocation allocate_memory(ImagePool::Requirements const& requirements, ImagePool::MemoryKey const& memory_key, uint32_t& memory_type_out) override
+  {
+    if (m_simulate_cost)
+      spin(std::chrono::microseconds(20));
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_counts.m_allocations;
+    check(requirements.m_size == ImagePool::size_class(requirements.m_size), "allocations have the size of a size class");
+    bool const host_visible = memory_key.m_flags & VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT;
+    uint32_t const allowed = requirements.m_memory_type_bits & (host_visible ? (1U << s_host_visible_memory_type) : ~0U);
+    check(allowed != 0, "there is a memory type for the allocation");
+    memory_type_out = std::countr_zero(allowed);
+    VmaAllocation vh_allocation = reinterpret_cast<VmaAllocation>(m_next_handle++);
+    m_allocations[vh_allocation] = { requirements, memory_type_out };
+    return vh_allocation;
+  }
+
+  void bind_image_memory(vk::Image vh_image, VmaAllocation vh_allocation) override
+  {
+    if (m_simulate_cost)
+      spin(std::chrono::microseconds(1));
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_counts.m_binds;
+    auto image = m_images.find(static_cast<VkImage>(vh_image));
+    auto allocation = m_allocations.find(vh_allocation);
+    check(image != m_images.end() && allocation != m_allocations.end(), "bind_image_memory of an existing image and allocation");
+    if (image == m_images.end() || allocation == m_allocations.end())
+      return;
+    ImagePool::Requirements const& image_requirements = image->second.m_requirements;
+    check(!image->second.m_bound, "an image is bound only once");
+    check(!allocation->second.m_bound_to, "memory is bound to one image at a time");
+    check(allocation->second.m_requirements.m_size >= image_requirements.m_size, "the memory is large enough for the image");
+    check(allocation->second.m_requirements.m_alignment % image_requirements.m_alignment == 0, "the memory is aligned for the image");
+    check(image_requirements.m_memory_type_bits & (1U << allocation->second.m_memory_type), "the memory type is supported by the image");
+    image->second.m_bound = vh_allocation;
+    allocation->second.m_bound_to = image->first;
+  }
+
+  void free_memory(VmaAllocation vh_allocation) override
+  {
+    if (m_simulate_cost)
+      spin(std::chrono::microseconds(10));
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_counts.m_frees;
+    auto allocation = m_allocations.find(vh_allocation);
+    check(allocation != m_allocations.end(), "free_memory of an existing allocation");
+    if (allocation == m_allocations.end())
+      return;
+    check(!allocation->second.m_bound_to, "memory is freed after the image that uses it was destroyed");
+    m_allocations.erase(allocation);
+  }
+};
+
+vk::ImageCreateInfo image_create_info(uint32_t width, uint32_t height, uint32_t mip_levels = 1, vk::ImageTiling tiling = vk::ImageTiling::eOptimal,
+    vk::Format format = vk::Format::eR8G8B8A8Unorm)
+{
+  vk::ImageCreateInfo result;
+  result.imageType = vk::ImageType::e2D;
+  result.format = format;
+  result.extent = vk::Extent3D{ width, height, 1 };
+  result.mipLevels = mip_levels;
+  result.arrayLayers = 1;
+  result.tiling = tiling;
+  return result;
+}
+
+ImagePool::MemoryKey const device_local;
+ImagePool::MemoryKey const host_visible{ VMA_MEMORY_USAGE_AUTO, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT };
+
+// Wraps an ImagePool and its FakeBackend, keeping track of the frames during which released images were last used.
+struct Fixture
+{
+  FakeBackend* m_backend;
+  ImagePool m_pool;
+  frame_type m_frame = 0;
+
+  Fixture(ImagePool::Policy const& policy = {}) : m_backend(new FakeBackend), m_pool(std::unique_ptr<ImagePool::Backend>(m_backend), policy) { }
+
+  void begin_frame(frame_type frame)
+  {
+    m_frame = frame;
+    m_pool.begin_frame(frame);
+  }
+
+  void retire(frame_type completed_frame)
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_backend->m_mutex);
+      m_backend->m_retired_end = std::max(m_backend->m_retired_end, completed_frame + 1);
+    }
+    m_pool.retire(completed_frame);
+  }
+
+  ImagePool::Acquired acquire(vk::ImageCreateInfo const& image_create_info, ImagePool::MemoryKey const& memory_key = device_local)
+  {
+    ImagePool::Acquired acquired = m_pool.acquire(image_create_info, memory_key);
+    std::lock_guard<std::mutex> lock(m_backend->m_mutex);
+    check(!m_backend->in_use_by_gpu(static_cast<VkImage>(acquired.m_vh_image)), "acquire() never returns an image that the GPU might use");
+    check(m_backend->m_images[static_cast<VkImage>(acquired.m_vh_image)].m_bound == acquired.m_vh_allocation, "the image is bound to the returned memory");
+    m_backend->m_last_use.erase(static_cast<VkImage>(acquired.m_vh_image));
+    return acquired;
+  }
+
+  void release(ImagePool::Acquired const& acquired)
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_backend->m_mutex);
+      m_backend->m_last_use[static_cast<VkImage>(acquired.m_vh_image)] = m_frame;
+    }
+    m_pool.release(acquired.m_vh_image, acquired.m_vh_allocation);
+  }
+};
+
+void test_size_class()
+{
+  bool at_least_size = true;
+  bool bounded_waste = true;
+  bool monotonic = true;
+  bool granular = true;
+  vk::DeviceSize previous = 0;
+  for (vk::DeviceSize size = 1; size < 1024 * MiB; size += 1 + size / 37)
+  {
+    vk::DeviceSize const size_class = ImagePool::size_class(size);
+    at_least_size &= size_class >= size;
+    if (size > 8 * ImagePool::s_min_size_class)
+      bounded_waste &= (size_class - size) * 8 <= size;
+    monotonic &= size_class >= previous;
+    granular &= size_class % ImagePool::s_min_size_class == 0;
+    previous = size_class;
+  }
+  check(at_least_size, "a size class is at least the size");
+  check(bounded_waste, "at most 12.5% of a large size class is wasted");
+  check(monotonic, "size classes grow with the size");
+  check(granular, "size classes are a multiple of s_min_size_class");
+  check(ImagePool::size_class(ImagePool::size_class(12345678)) == ImagePool::size_class(12345678), "a size class is its own size class");
+}
+
+void test_reuse()
+{
+  Fixture fixture;
+  fixture.begin_frame(1);
+  ImagePool::Acquired const first = fixture.acquire(image_create_info(1000, 1000));
+  fixture.release(first);
+
+  // Frame 1 didn't finish yet: the image can't be reused.
+  ImagePool::Acquired const second = fixture.acquire(image_create_info(1000, 1000));
+  check(second.m_vh_image != first.m_vh_image, "an image is not reused before its frame retired");
+  fixture.release(second);
+
+  fixture.begin_frame(2);
+  fixture.retire(1);
+  ImagePool::Acquired const third = fixture.acquire(image_create_info(1000, 1000));
+  check(third.m_vh_image == first.m_vh_image, "the least recently released image is reused once its frame retired");
+  ImagePool::Stats stats = fixture.m_pool.stats();
+  check(stats.m_image_reuses == 1 && stats.m_images_created == 2 && stats.m_allocations == 2, "one image reused, two created");
+
+  // An image with a slightly different extent reuses the memory of the second image.
+  uint64_t const allocations = fixture.m_backend->m_counts.m_allocations;
+  ImagePool::Acquired const fourth = fixture.acquire(image_create_info(1001, 999));
+  stats = fixture.m_pool.stats();
+  check(fourth.m_vh_allocation == second.m_vh_allocation, "an image with a different extent in the same size class reuses pooled memory");
+  check(stats.m_memory_reuses == 1 && fixture.m_backend->m_counts.m_allocations == allocations, "no memory was allocated for it");
+  check(stats.m_images_destroyed == 1 && stats.m_pooled_images == 0, "the image that used that memory was destroyed");
+
+  // Memory with a different memory usage, or a memory type that the image doesn't support, is not reused.
+  fixture.release(third);
+  fixture.release(fourth);
+  fixture.begin_frame(3);
+  fixture.retire(2);
+  ImagePool::Acquired const host = fixture.acquire(image_create_info(1002, 1000), host_visible);
+  check(host.m_vh_allocation != first.m_vh_allocation && host.m_vh_allocation != second.m_vh_allocation, "memory with a different memory usage is not reused");
+  ImagePool::Acquired const linear = fixture.acquire(image_create_info(1000, 1000, 1, vk::ImageTiling::eLinear));
+  check(linear.m_vh_allocation != third.m_vh_allocation && linear.m_vh_allocation != fourth.m_vh_allocation && fixture.m_pool.stats().m_pooled_images == 2, "memory of an unsupported memory type is not reused");
+  fixture.release(host);
+  fixture.release(linear);
+  // The pool may only be destroyed once the GPU is done with its images.
+  fixture.retire(3);
+}
+
+void test_trimming()
+{
+  ImagePool::Policy policy;
+  policy.m_max_idle_frames = 10;
+  policy.m_max_pooled_bytes = 12 * MiB;
+  Fixture fixture(policy);
+
+  // Five images of 4 MiB that were released in different frames.
+  fixture.begin_frame(1);
+  std::vector<ImagePool::Acquired> images;
+  for (int i = 0; i < 5; ++i)
+    images.push_back(fixture.acquire(image_create_info(1024 - 64 * i, 1024)));
+  for (int i = 0; i < 5; ++i)
+  {
+    fixture.begin_frame(1 + i);
+    fixture.release(images[i]);
+  }
+  // The images that might still be used are never destroyed, even if that exceeds the maximum.
+  check(fixture.m_pool.stats().m_pooled_images == 5 && fixture.m_pool.stats().m_images_destroyed == 0, "images that might be in use are kept");
+  fixture.begin_frame(7);
+  fixture.retire(5);
+  ImagePool::Stats stats = fixture.m_pool.stats();
+  check(stats.m_pooled_bytes <= policy.m_max_pooled_bytes && stats.m_pooled_images == 3, "retired images are destroyed to stay below the maximum");
+  check(fixture.m_backend->m_images.size() == 3, "the oldest images were destroyed");
+
+  // Images that aren't reused for m_max_idle_frames frames are destroyed.
+  fixture.begin_frame(14);
+  fixture.retire(13);
+  check(fixture.m_pool.stats().m_pooled_images == 2, "images that are idle for more than m_max_idle_frames frames are destroyed");
+  fixture.begin_frame(30);
+  fixture.retire(29);
+  stats = fixture.m_pool.stats();
+  check(stats.m_pooled_images == 0 && stats.m_pooled_bytes == 0, "all idle images are destroyed");
+  check(fixture.m_backend->m_images.empty() && fixture.m_backend->m_allocations.empty(), "all images and memory were freed");
+  check(stats.m_images_destroyed == 5 && stats.m_frees == 5, "the statistics count the destroyed images");
+}
+
+// Render a number of frames, with a few frames in flight, using images like an application does:
+// - render targets that are recreated when the window is resized (which happens often while dragging),
+// - a chain of half resolution transient images every frame,
+// - textures that are loaded and dropped again while streaming.
+// With the pool or by creating and destroying every image directly.
+struct WorkloadResult
+{
+  FakeBackend::Counts m_counts;
+  std::chrono::duration<double> m_time;
+};
+
+WorkloadResult run_workload(bool use_pool)
+{
+  constexpr int frames = 2000;
+  constexpr frame_type frames_in_flight = 3;
+
+  Fixture fixture;
+  FakeBackend& backend = *fixture.m_backend;
+  backend.m_simulate_cost = true;
+
+  // Without a pool, images are destroyed once the frames that use them retired.
+  std::vector<std::pair<frame_type, ImagePool::Acquired>> deferred;
+  auto acquire = [&](vk::ImageCreateInfo const& info) -> ImagePool::Acquired {
+    if (use_pool)
+      return fixture.acquire(info);
+    ImagePool::Requirements requirements;
+    vk::Image vh_image = backend.create_image(info, requirements);
+    uint32_t memory_type;
+    VmaAllocation vh_allocation = backend.allocate_memory({ ImagePool::size_class(requirements.m_size), requirements.m_alignment, requirements.m_memory_type_bits },
+        device_local, memory_type);
+    backend.bind_image_memory(vh_image, vh_allocation);
+    return { vh_image, vh_allocation };
+  };
+  auto release = [&](ImagePool::Acquired const& acquired) {
+    if (use_pool)
+      fixture.release(acquired);
+    else
+      deferred.emplace_back(fixture.m_frame, acquired);
+  };
+
+  std::mt19937 rng(42);
+  uint32_t width = 1280;
+  uint32_t height = 720;
+  std::vector<ImagePool::Acquired> render_targets;
+  struct StreamedTexture
+  {
+    ImagePool::Acquired m_image;
+    frame_type m_drop;
+  };
+  std::vector<StreamedTexture> textures;
+
+  auto const start = clock_type::now();
+  for (frame_type frame = 1; frame <= frames; ++frame)
+  {
+    fixture.begin_frame(frame);
+    if (frame > frames_in_flight)
+    {
+      frame_type const completed = frame - frames_in_flight;
+      fixture.retire(completed);
+      std::erase_if(deferred, [&](auto const& entry){
+        if (entry.first > completed)
+          return false;
+        backend.destroy_image(entry.second.m_vh_image);
+        backend.free_memory(entry.second.m_vh_allocation);
+        return true;
+      });
+    }
+
+    // A resize while dragging the window border every few frames.
+    if (render_targets.empty() || frame % 4 == 0)
+    {
+      if (frame % 200 < 40)
+      {
+        width += std::uniform_int_distribution<int>(-8, 8)(rng);
+        height += std::uniform_int_distribution<int>(-8, 8)(rng);
+      }
+      for (auto const& render_target : render_targets)
+        release(render_target);
+      render_targets.clear();
+      render_targets.push_back(acquire(image_create_info(width, height)));
+      render_targets.push_back(acquire(image_create_info(width, height, 1, vk::ImageTiling::eOptimal, vk::Format::eD32Sfloat)));
+    }
+
+    // Transient images of a bloom chain.
+    for (uint32_t level = 1; level <= 4; ++level)
+      release(acquire(image_create_info(std::max(1U, width >> level), std::max(1U, height >> level))));
+
+    // Streaming.
+    std::erase_if(textures, [&](StreamedTexture const& texture){
+      if (texture.m_drop > frame)
+        return false;
+      release(texture.m_image);
+      return true;
+    });
+    for (int i = std::uniform_int_distribution<int>(0, 2)(rng); i > 0; --i)
+    {
+      uint32_t const size = 64U << std::uniform_int_distribution<int>(0, 4)(rng);
+      textures.push_back({ acquire(image_create_info(size, size, std::bit_width(size))), frame + std::uniform_int_distribution<frame_type>(1, 60)(rng) });
+    }
+  }
+  for (auto const& render_target : render_targets)
+    release(render_target);
+  for (auto const& texture : textures)
+    release(texture.m_image);
+  fixture.begin_frame(frames + 1);
+  fixture.retire(frames);
+  for (auto const& entry : deferred)
+  {
+    backend.destroy_image(entry.second.m_vh_image);
+    backend.free_memory(entry.second.m_vh_allocation);
+  }
+  std::chrono::duration<double> const time = clock_type::now() - start;
+
+  if (use_pool)
+  {
+    std::cout << "With pool: ";
+    fixture.m_pool.stats().print_on(std::cout);
+    // Everything is destroyed once it is idle long enough.
+    fixture.begin_frame(frames + 1000);
+    fixture.retire(frames + 999);
+    check(fixture.m_pool.stats().m_pooled_images == 0, "all images are trimmed after the workload");
+  }
+  check(backend.m_images.empty() && backend.m_allocations.empty(), "no images or memory leaked");
+  return { backend.m_counts, time };
+}
+
+void test_workload()
+{
+  WorkloadResult const direct = run_workload(false);
+  WorkloadResult const pooled = run_workload(true);
+  auto print = [](char const* name, WorkloadResult const& result){
+    std::cout << name << ": " << result.m_counts.m_creates << " creates, " << result.m_counts.m_allocations << " allocations, " <<
+      result.m_counts.m_binds << " binds, " << result.m_counts.m_destroys << " destroys, " << result.m_counts.m_frees << " frees; " <<
+      result.m_counts.total() << " calls in " << (result.m_time.count() * 1000.0) << " ms." << std::endl;
+  };
+  print("Direct", direct);
+  print("Pooled", pooled);
+  check(pooled.m_counts.total() * 4 < direct.m_counts.total(), "the pool saves at least 75% of the Vulkan calls");
+  check(pooled.m_counts.m_allocations * 10 < direct.m_counts.m_allocations, "the pool saves at least 90% of the allocations");
+  check(pooled.m_time < direct.m_time, "the pool saves time");
+}
+
+void test_threads()
+{
+  Fixture fixture;
+  std::atomic<bool> stop = false;
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < 4; ++t)
+    threads.emplace_back([&, t](){
+      std::mt19937 rng(t);
+      for (int i = 0; i < 5000; ++i)
+      {
+        uint32_t const size = 64U << std::uniform_int_distribution<int>(0, 3)(rng);
+        ImagePool::Acquired const acquired = fixture.m_pool.acquire(image_create_info(size, size + t), device_local);
+        fixture.m_pool.release(acquired.m_vh_image, acquired.m_vh_allocation);
+      }
+    });
+  std::thread frames([&](){
+    for (frame_type frame = 1; !stop; ++frame)
+    {
+      fixture.m_pool.begin_frame(frame);
+      fixture.m_pool.retire(frame - 1);
+      std::this_thread::yield();
+    }
+  });
+  for (auto& thread : threads)
+    thread.join();
+  stop = true;
+  frames.join();
+  ImagePool::Stats const stats = fixture.m_pool.stats();
+  check(stats.m_acquires == 20000 && stats.m_image_reuses + stats.m_images_created == stats.m_acquires, "every acquire is counted once");
+  check(stats.m_images_created - stats.m_images_destroyed == stats.m_pooled_images, "the image count adds up");
+  check(stats.m_allocations - stats.m_frees == stats.m_pooled_images, "the allocation count adds up");
+}
+
+} // namespace
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  test_size_class();
+  test_reuse();
+  test_trimming();
+  test_workload();
+  test_threads();
+
+  return checks_result();
+}
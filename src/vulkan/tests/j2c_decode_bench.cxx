@@ -0,0 +1,141 @@
+#include "sys.h"
+#include "vk_utils/J2CImage.h"
+#include "threadpool/AIThreadPool.h"
+#include "utils/AIAlert.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "debug.h"
+
+// Microbenchmark of vk_utils::j2c::Decoder: decodes local JPEG 2000 files at discard levels 0 to 3
+// with an increasing number of threads and reports the decoded megapixels per second.
+//
+// Usage: j2c_decode_bench <file or directory>...
+// Directories are searched (not recursively) for .j2c, .j2k and .jp2 files.
+
+namespace {
+
+using namespace vk_utils::j2c;
+
+constexpr uint32_t max_benchmarked_discard_level = 3;
+constexpr std::chrono::milliseconds min_measure_time{500};
+
+bool is_jpeg2000(std::filesystem::path const& path)
+{
+  std::string const extension = path.extension().string();
+  return extension == ".j2c" || extension == ".j2k" || extension == ".jp2";
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  if (argc < 2)
+  {
+    std::cerr << "Usage: " << argv[0] << " <file or directory>..." << std::endl;
+    return 1;
+  }
+
+  std::vector<std::filesystem::path> paths;
+  for (int i = 1; i < argc; ++i)
+  {
+    std::filesystem::path const path(argv[i]);
+    if (std::filesystem::is_directory(path))
+    {
+      for (auto const& entry : std::filesystem::directory_iterator(path))
+        if (entry.is_regular_file() && is_jpeg2000(entry.path()))
+          paths.push_back(entry.path());
+    }
+    else
+      paths.push_back(path);
+  }
+  std::sort(paths.begin(), paths.end());
+
+  std::vector<std::unique_ptr<Codestream>> codestreams;
+  for (auto const& path : paths)
+  {
+    try
+    {
+      codestreams.push_back(std::make_unique<Codestream>(path));
+      Header const& header = codestreams.back()->header();
+      std::cout << path.filename().string() << ": " << header.m_extent.width << "x" << header.m_extent.height << ", " <<
+        header.m_components << " components, " << header.m_resolutions << " resolutions" << std::endl;
+    }
+    catch (AIAlert::Error const& error)
+    {
+      std::cerr << "Skipping " << path << ": " << error << std::endl;
+    }
+  }
+  if (codestreams.empty())
+  {
+    std::cerr << "No JPEG 2000 files found." << std::endl;
+    return 1;
+  }
+
+  unsigned int const hardware_threads = std::max(1U, std::thread::hardware_concurrency());
+  std::vector<int> thread_counts = { 1, 2, 4 };
+  if (hardware_threads > 4)
+    thread_counts.push_back(hardware_threads);
+
+  // The thread calling decode() decodes bands too, so use one worker less than the number of threads.
+  AIThreadPool thread_pool(1);
+  AIQueueHandle const queue_handle = thread_pool.new_queue(2 * hardware_threads);
+
+  std::vector<std::byte> pixels;
+  int mismatches = 0;
+  std::cout << std::fixed << std::setprecision(1);
+  for (uint32_t discard_level = 0; discard_level <= max_benchmarked_discard_level; ++discard_level)
+  {
+    std::vector<std::vector<std::byte>> reference(codestreams.size());
+    for (int threads : thread_counts)
+    {
+      thread_pool.change_number_of_threads_to(std::max(threads - 1, 1));
+      Decoder const decoder(queue_handle, threads);
+
+      using clock_type = std::chrono::steady_clock;
+      double megapixels = 0.0;
+      int passes = 0;
+      auto const start = clock_type::now();
+      do
+      {
+        for (size_t i = 0; i < codestreams.size(); ++i)
+        {
+          Codestream const& codestream = *codestreams[i];
+          uint32_t const level = std::min(discard_level, codestream.max_discard_level());
+          vk::Extent2D const extent = codestream.extent(level);
+          pixels.resize(size_t{4} * extent.width * extent.height);
+          decoder.decode(codestream, level, pixels.data());
+          megapixels += 1e-6 * extent.width * extent.height;
+          // The result must not depend on the number of threads.
+          if (passes == 0)
+          {
+            if (reference[i].empty())
+              reference[i] = pixels;
+            else if (reference[i] != pixels)
+              ++mismatches;
+          }
+        }
+        ++passes;
+      }
+      while (clock_type::now() - start < min_measure_time);
+      std::chrono::duration<double> const elapsed = clock_type::now() - start;
+
+      std::cout << "discard level " << discard_level << ", " << std::setw(2) << threads << " threads: " <<
+        std::setw(8) << (megapixels / elapsed.count()) << " MP/s (" << passes << " passes)" << std::endl;
+    }
+  }
+
+  if (mismatches > 0)
+  {
+    std::cerr << "FAILED: " << mismatches << " images decoded differently depending on the number of threads." << std::endl;
+    return 1;
+  }
+  return 0;
+}
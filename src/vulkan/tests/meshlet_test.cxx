@@ -0,0 +1,192 @@
+#include "sys.h"
+#include "meshlet/MeshletBuilder.h"
+#include "utils/AIAlert.h"
+#include <random>
+#include <sstream>
+#include <iostream>
+#include <cmath>
+#include "check.h"
+#include "debug.h"
+
+using namespace vulkan::meshlet;
+
+namespace {
+
+struct TestMesh
+{
+  std::vector<glsl::vec3> m_positions;
+  std::vector<uint32_t> m_indices;
+};
+
+// A UV sphere with counter-clockwise (outward facing) triangles.
+TestMesh make_sphere(int rings, int segments)
+{
+  TestMesh mesh;
+  for (int r = 0; r <= rings; ++r)
+  {
+    float const theta = M_PI * r / rings;
+    for (int s = 0; s <= segments; ++s)
+    {
+      float const phi = 2 * M_PI * s / segments;
+      mesh.m_positions.emplace_back(std::sin(theta) * std::cos(phi), std::sin(theta) * std::sin(phi), std::cos(theta));
+    }
+  }
+  auto vertex = [&](int r, int s) { return static_cast<uint32_t>(r * (segments + 1) + s); };
+  for (int r = 0; r < rings; ++r)
+    for (int s = 0; s < segments; ++s)
+    {
+      // The triangles at the poles are degenerate (two vertices at the same position, but with different indices).
+      mesh.m_indices.insert(mesh.m_indices.end(), { vertex(r, s), vertex(r + 1, s), vertex(r + 1, s + 1) });
+      mesh.m_indices.insert(mesh.m_indices.end(), { vertex(r, s), vertex(r + 1, s + 1), vertex(r, s + 1) });
+    }
+  return mesh;
+}
+
+glsl::vec3 triangle_vertex(MeshletMesh const& meshlet_mesh, Meshlet const& meshlet, TestMesh const& mesh, uint32_t t, int k)
+{
+  uint8_t local = meshlet_mesh.m_primitive_indices[3 * (meshlet.m_triangle_offset + t) + k];
+  return mesh.m_positions[meshlet_mesh.m_vertex_indices[meshlet.m_vertex_offset + local]];
+}
+
+// Check that the culling tests of meshlet are conservative for the given camera.
+void check_culling(MeshletMesh const& meshlet_mesh, Meshlet const& meshlet, TestMesh const& mesh,
+    glsl::vec3 const& camera_position, std::array<glsl::vec4, 6> const& planes)
+{
+  if (meshlet.is_backfacing(camera_position))
+  {
+    for (uint32_t t = 0; t < meshlet.m_triangle_count; ++t)
+    {
+      glsl::vec3 const p0 = triangle_vertex(meshlet_mesh, meshlet, mesh, t, 0);
+      glsl::vec3 const normal = (triangle_vertex(meshlet_mesh, meshlet, mesh, t, 1) - p0).cross(triangle_vertex(meshlet_mesh, meshlet, mesh, t, 2) - p0);
+      check((p0 - camera_position).dot(normal) >= -1e-5f, "a triangle of a back-facing meshlet faces the camera");
+    }
+  }
+  if (meshlet.is_outside(planes))
+  {
+    bool all_outside_one_plane = false;
+    for (glsl::vec4 const& plane : planes)
+    {
+      bool all_outside = true;
+      for (uint32_t v = 0; v < meshlet.m_vertex_count; ++v)
+        all_outside = all_outside && plane.head<3>().dot(mesh.m_positions[meshlet_mesh.m_vertex_indices[meshlet.m_vertex_offset + v]]) + plane[3] < 1e-5f;
+      all_outside_one_plane = all_outside_one_plane || all_outside;
+    }
+    check(all_outside_one_plane, "a meshlet that is outside the frustum has a vertex inside it");
+  }
+}
+
+glsl::mat4 perspective_look_at(glsl::vec3 const& eye, glsl::vec3 const& target)
+{
+  glsl::vec3 const forward = (target - eye).normalized();
+  glsl::vec3 const right = forward.cross(glsl::vec3(0, 0, 1)).normalized();
+  glsl::vec3 const up = right.cross(forward);
+  glsl::mat4 view = glsl::mat4::Identity();
+  view.block<1, 3>(0, 0) = right.transpose();
+  view.block<1, 3>(1, 0) = up.transpose();
+  view.block<1, 3>(2, 0) = forward.transpose();
+  view(0, 3) = -right.dot(eye);
+  view(1, 3) = -up.dot(eye);
+  view(2, 3) = -forward.dot(eye);
+  // A 60 degree vertical field of view, near = 0.1, far = 100; z in [0, w].
+  float const f = 1.0f / std::tan(M_PI / 6), n = 0.1f, far = 100.0f;
+  glsl::mat4 projection = glsl::mat4::Zero();
+  projection(0, 0) = f;
+  projection(1, 1) = f;
+  projection(2, 2) = far / (far - n);
+  projection(2, 3) = -far * n / (far - n);
+  projection(3, 2) = 1.0f;
+  return projection * view;
+}
+
+} // namespace
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+  Dout(dc::notice, "Entering main()");
+
+  TestMesh const mesh = make_sphere(40, 80);
+  MeshletBuilder const builder;
+  MeshletMesh const meshlet_mesh = builder.build(mesh.m_positions, mesh.m_indices);
+
+  // Every non-degenerate triangle must be present, in order, and the limits must be respected.
+  size_t triangle = 0;
+  for (Meshlet const& meshlet : meshlet_mesh.m_meshlets)
+  {
+    check(meshlet.m_vertex_count <= builder.max_vertices(), "too many vertices in a meshlet");
+    check(meshlet.m_triangle_count <= builder.max_triangles(), "too many triangles in a meshlet");
+    for (uint32_t t = 0; t < meshlet.m_triangle_count; ++t, ++triangle)
+    {
+      while (mesh.m_indices[3 * triangle] == mesh.m_indices[3 * triangle + 1] ||
+             mesh.m_indices[3 * triangle + 1] == mesh.m_indices[3 * triangle + 2] ||
+             mesh.m_indices[3 * triangle] == mesh.m_indices[3 * triangle + 2])
+        ++triangle;
+      for (int k = 0; k < 3; ++k)
+      {
+        uint8_t local = meshlet_mesh.m_primitive_indices[3 * (meshlet.m_triangle_offset + t) + k];
+        check(local < meshlet.m_vertex_count, "primitive index out of range");
+        check(meshlet_mesh.m_vertex_indices[meshlet.m_vertex_offset + local] == mesh.m_indices[3 * triangle + k], "wrong triangle");
+      }
+    }
+    // The bounding sphere contains all vertices.
+    for (uint32_t v = 0; v < meshlet.m_vertex_count; ++v)
+      check((mesh.m_positions[meshlet_mesh.m_vertex_indices[meshlet.m_vertex_offset + v]] - meshlet.center()).norm() <= meshlet.m_radius * 1.0001f,
+          "vertex outside of the bounding sphere");
+  }
+  check(triangle == mesh.m_indices.size() / 3, "not all triangles are part of a meshlet");
+
+  // Serialization round trip.
+  std::stringstream ss;
+  meshlet_mesh.write_to(ss);
+  check(ss.str().size() == meshlet_mesh.serialized_size(), "serialized_size is wrong");
+  MeshletMesh read_back;
+  read_back.read_from(ss);
+  check(read_back.m_vertex_indices == meshlet_mesh.m_vertex_indices, "vertex indices changed");
+  check(read_back.m_primitive_indices == meshlet_mesh.m_primitive_indices, "primitive indices changed");
+  check(read_back.m_meshlets.size() == meshlet_mesh.m_meshlets.size(), "number of meshlets changed");
+
+  // Culling must be conservative, also after quantization of the cone.
+  std::mt19937 engine(42);
+  std::uniform_real_distribution<float> coordinate(-5.0f, 5.0f);
+  int backfacing = 0;
+  int outside = 0;
+  for (int camera = 0; camera < 50; ++camera)
+  {
+    glsl::vec3 const camera_position(coordinate(engine), coordinate(engine), coordinate(engine));
+    if (camera_position.norm() < 1.5f)
+      continue;
+    glsl::vec3 const target(coordinate(engine) * 0.2f, coordinate(engine) * 0.2f, coordinate(engine) * 0.2f);
+    std::array<glsl::vec4, 6> const planes = frustum_planes(perspective_look_at(camera_position, target));
+    for (size_t m = 0; m < meshlet_mesh.m_meshlets.size(); ++m)
+    {
+      check_culling(meshlet_mesh, meshlet_mesh.m_meshlets[m], mesh, camera_position, planes);
+      check_culling(read_back, read_back.m_meshlets[m], mesh, camera_position, planes);
+      backfacing += meshlet_mesh.m_meshlets[m].is_backfacing(camera_position);
+      outside += meshlet_mesh.m_meshlets[m].is_outside(planes);
+    }
+  }
+  // Seen from outside, roughly half of a sphere faces away from the camera.
+  check(backfacing > 0, "no meshlet was ever back-facing");
+  check(outside > 0, "no meshlet was ever outside the frustum");
+
+  // Corrupt input must be rejected.
+  std::string truncated = ss.str().substr(0, ss.str().size() / 2);
+  std::istringstream corrupt(truncated);
+  bool threw = false;
+  try
+  {
+    MeshletMesh dummy;
+    dummy.read_from(corrupt);
+  }
+  catch (AIAlert::Error const&)
+  {
+    threw = true;
+  }
+  check(threw, "reading truncated meshlet data did not throw");
+
+  std::cout << meshlet_mesh.m_meshlets.size() << " meshlets, " << meshlet_mesh.serialized_size() << " bytes; culled " <<
+    backfacing << " (cone) and " << outside << " (frustum) meshlet draws." << std::endl;
+
+  Dout(dc::notice, "Leaving main()");
+  return checks_result();
+}
@@ -0,0 +1,144 @@
+#include "sys.h"
+#include "vk_utils/MipChain.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include "check.h"
+#include "debug.h"
+
+using namespace vk_utils;
+
+namespace {
+
+std::vector<std::byte> make_image(vk::Extent2D extent, uint32_t channels, auto&& texel)
+{
+  std::vector<std::byte> pixels(size_t{extent.width} * extent.height * channels);
+  for (uint32_t y = 0; y < extent.height; ++y)
+    for (uint32_t x = 0; x < extent.width; ++x)
+      for (uint32_t c = 0; c < channels; ++c)
+        pixels[(size_t{y} * extent.width + x) * channels + c] = static_cast<std::byte>(texel(x, y, c));
+  return pixels;
+}
+
+} // namespace
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  check(mip_level_count({ 1, 1 }) == 1, "mip_level_count 1x1");
+  check(mip_level_count({ 256, 256 }) == 9, "mip_level_count 256x256");
+  check(mip_level_count({ 300, 20 }) == 9, "mip_level_count 300x20");
+  check(mip_level_extent({ 300, 20 }, 3).width == 37 && mip_level_extent({ 300, 20 }, 3).height == 2, "mip_level_extent");
+  check(mip_level_extent({ 300, 20 }, 8).width == 1 && mip_level_extent({ 300, 20 }, 8).height == 1, "mip_level_extent clamps to 1");
+
+  // Every level of a uniform image has the same color, and the expected size.
+  {
+    vk::Extent2D const extent{ 300, 20 };
+    auto const pixels = make_image(extent, 4, [](uint32_t, uint32_t, uint32_t c){ return 10 + 50 * c; });
+    MipChain mip_chain(pixels.data(), extent, 4);
+    check(mip_chain.level_count() == 9, "uniform: level count");
+    bool sizes_ok = true;
+    bool uniform = true;
+    for (uint32_t level = 0; level < mip_chain.level_count(); ++level)
+    {
+      vk::Extent2D const level_extent = mip_level_extent(extent, level);
+      auto const& data = mip_chain.level(level);
+      sizes_ok = sizes_ok && data.size() == size_t{level_extent.width} * level_extent.height * 4;
+      for (size_t i = 0; i < data.size(); ++i)
+        uniform = uniform && std::to_integer<uint32_t>(data[i]) == 10 + 50 * (i % 4);
+    }
+    check(sizes_ok, "uniform: level sizes");
+    check(uniform, "uniform: colors preserved");
+  }
+
+  // A 2x2 box filter, repeating the edge for odd sizes.
+  {
+    vk::Extent2D const extent{ 3, 3 };
+    // 0 10 20
+    // 30 40 50
+    // 60 70 80
+    auto const pixels = make_image(extent, 1, [](uint32_t x, uint32_t y, uint32_t){ return 10 * (3 * y + x); });
+    MipChain mip_chain(pixels.data(), extent, 1);
+    check(mip_chain.level_count() == 2, "box: level count");
+    auto const& level1 = mip_chain.level(1);
+    check(level1.size() == 1, "box: level 1 is 1x1");
+    // (0 + 10 + 30 + 40) / 4 = 20.
+    check(std::to_integer<int>(level1[0]) == 20, "box: average of the top-left 2x2 block");
+  }
+  {
+    vk::Extent2D const extent{ 4, 2 };
+    // 0 4 8 12
+    // 2 6 10 14
+    auto const pixels = make_image(extent, 1, [](uint32_t x, uint32_t y, uint32_t){ return 4 * x + 2 * y; });
+    MipChain mip_chain(pixels.data(), extent, 1);
+    check(mip_chain.level_count() == 3, "box 4x2: level count");
+    auto const& level1 = mip_chain.level(1);
+    check(level1.size() == 2 && std::to_integer<int>(level1[0]) == 3 && std::to_integer<int>(level1[1]) == 11, "box 4x2: level 1");
+    auto const& level2 = mip_chain.level(2);
+    // (3 + 11 + 3 + 11 + 2) / 4 = 7 (the single row is repeated).
+    check(level2.size() == 1 && std::to_integer<int>(level2[0]) == 7, "box 4x2: level 2");
+  }
+
+  // The feeders hand out the pixels of each level, finest first.
+  {
+    vk::Extent2D const extent{ 64, 32 };
+    auto const pixels = make_image(extent, 4, [](uint32_t x, uint32_t y, uint32_t c){ return (x * 7 + y * 13 + c) & 0xff; });
+    MipChain mip_chain(pixels.data(), extent, 4);
+    std::vector<std::vector<std::byte>> expected;
+    for (uint32_t level = 0; level < mip_chain.level_count(); ++level)
+      expected.push_back(mip_chain.level(level));
+    auto feeders = std::move(mip_chain).take_level_feeders();
+    check(feeders.size() == expected.size(), "feeders: one per level");
+    bool same = true;
+    for (size_t level = 0; level < feeders.size(); ++level)
+    {
+      vulkan::DataFeeder& feeder = *feeders[level];
+      std::vector<std::byte> data(feeder.chunk_size() * feeder.chunk_count());
+      int const batch = feeder.next_batch();
+      same = same && batch == feeder.chunk_count();
+      feeder.get_chunks(reinterpret_cast<unsigned char*>(data.data()));
+      same = same && data == expected[level];
+    }
+    check(same, "feeders: pixels of each level");
+    check(expected[0] == pixels, "feeders: level 0 is the original image");
+  }
+
+  // The mip chain feeder (the CPU fallback of Texture::upload_with_mipmaps) reads level 0 from a feeder
+  // that hands out one row per chunk, and packs the requested levels finest first.
+  {
+    struct RowFeeder final : vulkan::DataFeeder
+    {
+      std::vector<std::byte> const& m_pixels;
+      uint32_t m_row_size;
+      int m_next_row = 0;
+
+      RowFeeder(std::vector<std::byte> const& pixels, uint32_t row_size) : m_pixels(pixels), m_row_size(row_size) { }
+      uint32_t chunk_size() const override { return m_row_size; }
+      int chunk_count() const override { return m_pixels.size() / m_row_size; }
+      int next_batch() override { return std::min(3, chunk_count() - m_next_row); }
+      void get_chunks(unsigned char* chunk_ptr) override
+      {
+        int const rows = next_batch();
+        std::memcpy(chunk_ptr, m_pixels.data() + size_t{m_row_size} * m_next_row, size_t{m_row_size} * rows);
+        m_next_row += rows;
+      }
+    };
+
+    vk::Extent2D const extent{ 40, 24 };
+    auto const pixels = make_image(extent, 4, [](uint32_t x, uint32_t y, uint32_t c){ return (x * 5 + y * 11 + c * 3) & 0xff; });
+    MipChain const reference(pixels.data(), extent, 4);
+    MipChainDataFeeder feeder(std::make_unique<RowFeeder>(pixels, extent.width * 4), extent, 4, 4);
+    std::vector<std::byte> expected;
+    for (uint32_t level = 0; level < 4; ++level)
+      expected.insert(expected.end(), reference.level(level).begin(), reference.level(level).end());
+    check(feeder.chunk_size() == expected.size() && feeder.chunk_count() == 1, "mip chain feeder: size of the first four levels");
+    std::vector<std::byte> data(feeder.chunk_size());
+    feeder.next_batch();
+    feeder.get_chunks(reinterpret_cast<unsigned char*>(data.data()));
+    check(data == expected, "mip chain feeder: levels equal the CPU reference");
+  }
+
+  return checks_result();
+}
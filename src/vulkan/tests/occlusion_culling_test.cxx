@@ -0,0 +1,258 @@
+#include "sys.h"
+#include "culling/OcclusionCuller.h"
+#include "meshlet/Meshlet.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include "check.h"
+#include "debug.h"
+
+using namespace vulkan::culling;
+
+namespace {
+
+constexpr uint32_t width = 320;
+constexpr uint32_t height = 200;
+constexpr float near = 0.1f;
+constexpr float far = 100.0f;
+
+// A perspective projection for vulkan clip space (y down, 0 <= z <= w) with the camera at the origin, looking along -z.
+glsl::mat4 perspective(float fov_y, float aspect)
+{
+  float const f = 1.0f / std::tan(fov_y / 2);
+  glsl::mat4 m = glsl::mat4::Zero();
+  m(0, 0) = f / aspect;
+  m(1, 1) = -f;
+  m(2, 2) = far / (near - far);
+  m(2, 3) = near * far / (near - far);
+  m(3, 2) = -1.0f;
+  return m;
+}
+
+// A square that faces the camera: the geometry of the test objects.
+struct Card
+{
+  float m_x, m_y, m_distance, m_half_size;
+
+  CullObject cull_object(uint32_t index) const
+  {
+    return { { m_x, m_y, -m_distance }, m_half_size * std::sqrt(2.0f), 6, 0, 0, index };
+  }
+};
+
+// A software depth buffer.
+class DepthBuffer
+{
+  std::vector<float> m_depth;
+
+ public:
+  DepthBuffer() : m_depth(width * height, 1.0f) { }
+
+  void draw(Card const& card, glsl::mat4 const& view_projection)
+  {
+    glsl::vec4 const low = view_projection * glsl::vec4(card.m_x - card.m_half_size, card.m_y - card.m_half_size, -card.m_distance, 1.0f);
+    glsl::vec4 const high = view_projection * glsl::vec4(card.m_x + card.m_half_size, card.m_y + card.m_half_size, -card.m_distance, 1.0f);
+    if (low.w() < near)
+      return;
+    float const depth = low.z() / low.w();
+    float const u0 = (low.x() / low.w() * 0.5f + 0.5f) * width;
+    float const u1 = (high.x() / high.w() * 0.5f + 0.5f) * width;
+    // Vulkan clip space is y down: the top edge of the card has the smaller y.
+    float const v0 = (high.y() / high.w() * 0.5f + 0.5f) * height;
+    float const v1 = (low.y() / low.w() * 0.5f + 0.5f) * height;
+    for (uint32_t y = 0; y < height; ++y)
+      for (uint32_t x = 0; x < width; ++x)
+        if (x + 0.5f >= u0 && x + 0.5f < u1 && y + 0.5f >= v0 && y + 0.5f < v1)
+          m_depth[y * width + x] = std::min(m_depth[y * width + x], depth);
+  }
+
+  std::vector<float> const& depth() const { return m_depth; }
+};
+
+// Render a frame with the two-phase culling; returns the final depth buffer and the number of draws per pass.
+struct FrameResult
+{
+  DepthBuffer m_depth_buffer;
+  std::vector<uint32_t> m_drawn;        // The object indices (first_instance) that were drawn.
+  size_t m_early_draws;
+  size_t m_late_draws;
+};
+
+FrameResult render(OcclusionCuller& culler, std::vector<Card> const& cards, glsl::mat4 const& view_projection)
+{
+  std::vector<CullObject> objects;
+  for (uint32_t i = 0; i < cards.size(); ++i)
+    objects.push_back(cards[i].cull_object(i));
+  auto const planes = vulkan::meshlet::frustum_planes(view_projection);
+  culler.resize(objects.size());
+
+  FrameResult result;
+  std::vector<DrawIndexedIndirectCommand> early_draws;
+  culler.early_pass(objects, planes, early_draws);
+  for (auto const& draw : early_draws)
+  {
+    result.m_depth_buffer.draw(cards[draw.m_first_instance], view_projection);
+    result.m_drawn.push_back(draw.m_first_instance);
+  }
+  DepthPyramid depth_pyramid;
+  depth_pyramid.build(width, height, result.m_depth_buffer.depth());
+  std::vector<DrawIndexedIndirectCommand> late_draws;
+  culler.late_pass(objects, view_projection, planes, depth_pyramid, late_draws);
+  for (auto const& draw : late_draws)
+  {
+    result.m_depth_buffer.draw(cards[draw.m_first_instance], view_projection);
+    result.m_drawn.push_back(draw.m_first_instance);
+  }
+  result.m_early_draws = early_draws.size();
+  result.m_late_draws = late_draws.size();
+  return result;
+}
+
+bool drawn(FrameResult const& result, uint32_t index)
+{
+  return std::find(result.m_drawn.begin(), result.m_drawn.end(), index) != result.m_drawn.end();
+}
+
+} // namespace
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  glsl::mat4 const view_projection = perspective(M_PI / 3, static_cast<float>(width) / height);
+
+  // The depth pyramid.
+  {
+    check(DepthPyramid::level_count(1, 1) == 1 && DepthPyramid::level_count(4, 4) == 3 && DepthPyramid::level_count(5, 3) == 4 &&
+        DepthPyramid::level_count(320, 200) == 10, "level_count");
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> depth_distribution(0.0f, 1.0f);
+    std::vector<float> depth(width * height);
+    for (float& d : depth)
+      d = depth_distribution(rng);
+    DepthPyramid depth_pyramid;
+    depth_pyramid.build(width, height, depth);
+    check(depth_pyramid.levels() == 10 && depth_pyramid.level(9).m_width == 1 && depth_pyramid.level(9).m_height == 1, "pyramid ends at 1x1");
+    // Each texel is the exact maximum of the pixels that it covers.
+    bool exact = true;
+    for (size_t n = 1; n < depth_pyramid.levels(); ++n)
+    {
+      auto const& level = depth_pyramid.level(n);
+      for (uint32_t y = 0; y < level.m_height; ++y)
+        for (uint32_t x = 0; x < level.m_width; ++x)
+        {
+          float expected = 0.0f;
+          for (uint32_t py = y << n; py < std::min(height, (y + 1) << n); ++py)
+            for (uint32_t px = x << n; px < std::min(width, (x + 1) << n); ++px)
+              expected = std::max(expected, depth[py * width + px]);
+          exact = exact && level.at(x, y) == expected;
+        }
+    }
+    check(exact, "pyramid texels are the maximum of the pixels they cover");
+    // max_depth is conservative.
+    std::uniform_int_distribution<uint32_t> x_distribution(0, width - 1);
+    std::uniform_int_distribution<uint32_t> y_distribution(0, height - 1);
+    bool conservative = true;
+    for (int i = 0; i < 1000; ++i)
+    {
+      uint32_t x0 = x_distribution(rng), x1 = x_distribution(rng);
+      uint32_t y0 = y_distribution(rng), y1 = y_distribution(rng);
+      if (x0 > x1)
+        std::swap(x0, x1);
+      if (y0 > y1)
+        std::swap(y0, y1);
+      float exact_max = 0.0f;
+      for (uint32_t y = y0; y <= y1; ++y)
+        for (uint32_t x = x0; x <= x1; ++x)
+          exact_max = std::max(exact_max, depth[y * width + x]);
+      conservative = conservative && depth_pyramid.max_depth(x0, y0, x1, y1) >= exact_max;
+    }
+    check(conservative, "max_depth is never less than the exact maximum");
+  }
+
+  // A scene with a known occluder: a wall at distance 5 that covers the center of the screen.
+  {
+    DepthBuffer depth_buffer;
+    depth_buffer.draw(Card{ 0.0f, 0.0f, 5.0f, 2.0f }, view_projection);
+    DepthPyramid depth_pyramid;
+    depth_pyramid.build(width, height, depth_buffer.depth());
+    auto occluded = [&](float x, float y, float distance, float radius){
+      return is_occluded(glsl::vec3(x, y, -distance), radius, view_projection, depth_pyramid);
+    };
+    check(occluded(0.0f, 0.0f, 20.0f, 1.0f), "wall: sphere straight behind the wall is occluded");
+    check(occluded(1.0f, -1.0f, 10.0f, 0.5f), "wall: sphere behind a corner of the wall is occluded");
+    check(!occluded(0.0f, 0.0f, 3.0f, 0.5f), "wall: sphere in front of the wall is visible");
+    check(!occluded(0.0f, 0.0f, 5.0f, 0.5f), "wall: sphere intersecting the wall is visible");
+    check(!occluded(12.0f, 0.0f, 20.0f, 1.0f), "wall: sphere beside the wall is visible");
+    check(!occluded(2.5f, 0.0f, 6.0f, 1.0f), "wall: sphere sticking out from behind the wall is visible");
+    check(!occluded(0.0f, 0.0f, 0.1f, 0.5f), "wall: sphere intersecting the near plane is visible");
+    check(!occluded(0.0f, 0.0f, -10.0f, 1.0f), "wall: sphere behind the camera is not occluded");
+    check(is_outside(glsl::vec3(0.0f, 0.0f, 10.0f), 1.0f, vulkan::meshlet::frustum_planes(view_projection)), "wall: sphere behind the camera is outside the frustum");
+  }
+
+  // Two-phase culling with a moving occluder.
+  {
+    OcclusionCuller culler;
+    std::vector<Card> cards = {
+      { 0.0f, 0.0f, 5.0f, 2.0f },       // 0: the wall.
+      { 0.0f, 0.0f, 20.0f, 1.0f },      // 1: behind the wall.
+      { 12.0f, 0.0f, 20.0f, 1.0f },     // 2: beside the wall.
+      { 0.0f, 0.0f, -5.0f, 1.0f }       // 3: behind the camera.
+    };
+    // The first frame has no visibility yet: everything is drawn by the late pass.
+    FrameResult frame = render(culler, cards, view_projection);
+    check(frame.m_early_draws == 0 && frame.m_late_draws == 3, "two-phase: first frame draws everything in the frustum in the late pass");
+    check(!drawn(frame, 3), "two-phase: frustum culling");
+    // The second frame finds out that object 1 is hidden.
+    frame = render(culler, cards, view_projection);
+    check(frame.m_early_draws == 3 && frame.m_late_draws == 0, "two-phase: second frame draws everything visible in the early pass");
+    check(!culler.was_visible(1) && culler.was_visible(0) && culler.was_visible(2), "two-phase: hidden object detected");
+    frame = render(culler, cards, view_projection);
+    check(frame.m_early_draws == 2 && frame.m_late_draws == 0 && !drawn(frame, 1), "two-phase: hidden object is culled");
+    // Move the wall away: object 1 is drawn by the late pass in the same frame.
+    cards[0].m_x = -8.0f;
+    frame = render(culler, cards, view_projection);
+    check(frame.m_late_draws == 1 && drawn(frame, 1), "two-phase: disoccluded object is drawn in the same frame");
+  }
+
+  // Random scenes: whatever moves, every frame must produce the same image as drawing everything.
+  {
+    std::mt19937 rng(2);
+    std::uniform_real_distribution<float> position(-10.0f, 10.0f);
+    std::uniform_real_distribution<float> distance(1.0f, 40.0f);
+    std::uniform_real_distribution<float> size(0.2f, 3.0f);
+    std::uniform_real_distribution<float> step(-1.0f, 1.0f);
+    std::vector<Card> cards(200);
+    for (Card& card : cards)
+      card = { position(rng), position(rng), distance(rng), size(rng) };
+    OcclusionCuller culler;
+    bool same_image = true;
+    size_t total_draws = 0;
+    size_t late_draws = 0;
+    int const frames = 50;
+    for (int f = 0; f < frames; ++f)
+    {
+      FrameResult const frame = render(culler, cards, view_projection);
+      DepthBuffer reference;
+      for (Card const& card : cards)
+        reference.draw(card, view_projection);
+      same_image = same_image && frame.m_depth_buffer.depth() == reference.depth();
+      total_draws += frame.m_early_draws + frame.m_late_draws;
+      if (f > 0)
+        late_draws += frame.m_late_draws;
+      // Move some cards.
+      for (Card& card : cards)
+        if (step(rng) > 0.5f)
+        {
+          card.m_x += step(rng);
+          card.m_distance = std::max(0.5f, card.m_distance + step(rng));
+        }
+    }
+    std::cout << "Random scenes: drew " << total_draws << " of " << cards.size() * frames << " objects; " << late_draws << " in late passes." << std::endl;
+    check(same_image, "random: the culled image is the same as the reference");
+    check(total_draws < cards.size() * frames * 3 / 4, "random: occlusion culling culls");
+  }
+
+  return checks_result();
+}
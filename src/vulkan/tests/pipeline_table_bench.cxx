@@ -0,0 +1,151 @@
+#include "sys.h"
+#include "pipeline/PipelineTable.h"
+#include "utils/Vector.h"
+#include <array>
+#include <chrono>
+#include <random>
+#include <iostream>
+#include "debug.h"
+
+// Microbenchmark comparing a PipelineTable lookup with the current path:
+// building a bit-packed pipeline::Index from the characteristic values
+// (see CharacteristicRange::update) and indexing SynchronousWindow::m_pipelines with it.
+
+// The test-only access to the private initialize and store of PipelineTable
+// (normally called by task::PipelineFactory and task::SynchronousWindow).
+struct vulkan::pipeline::PipelineTable::TestAccess
+{
+  static void initialize(PipelineTable& table, std::vector<Range> const& ranges)
+  {
+    table.initialize(ranges);
+  }
+
+  static void store(PipelineTable& table, Index pipeline_index, VkPipeline vh_pipeline)
+  {
+    table.store(pipeline_index, vh_pipeline);
+  }
+};
+
+namespace {
+
+using vulkan::pipeline::Index;
+using vulkan::pipeline::PipelineTable;
+
+struct TestRange
+{
+  int m_begin;
+  int m_end;
+};
+
+// Four characteristics, for example: cull mode, topology, blend mode and a shader variant.
+std::vector<TestRange> const test_ranges = { { 0, 3 }, { 2, 7 }, { 0, 2 }, { 10, 19 } };
+
+constexpr int number_of_lookups = 1 << 20;
+constexpr int number_of_passes = 32;
+
+VkPipeline fake_pipeline(size_t n)
+{
+  return reinterpret_cast<VkPipeline>(static_cast<uintptr_t>(n + 1));
+}
+
+} // namespace
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+  Dout(dc::notice, "Entering main()");
+
+  // Set up the bit-packed indexing, as PipelineFactory does.
+  std::vector<unsigned int> range_shift;
+  std::vector<PipelineTable::Range> ranges;
+  unsigned int shift = 0;
+  size_t number_of_pipelines = 1;
+  for (TestRange const& r : test_ranges)
+  {
+    range_shift.push_back(shift);
+    ranges.push_back({r.m_begin, r.m_end, false, shift});
+    shift += std::bit_width(static_cast<unsigned int>(r.m_end - r.m_begin - 1));
+    number_of_pipelines *= r.m_end - r.m_begin;
+  }
+
+  auto pack = [&](int const* values) -> Index {
+    unsigned int packed = 0;
+    for (size_t i = 0; i < test_ranges.size(); ++i)
+      packed |= static_cast<unsigned int>(values[i] - test_ranges[i].m_begin) << range_shift[i];
+    return Index{packed};
+  };
+
+  PipelineTable table;
+  PipelineTable::TestAccess::initialize(table, ranges);
+  ASSERT(table.size() == number_of_pipelines);
+
+  // The current path: a vector per factory, indexed by the bit-packed Index (with holes).
+  utils::Vector<VkPipeline, Index> packed_pipelines;
+  packed_pipelines.resize(size_t{1} << shift);
+
+  // Fill both; half of the pipelines are still pending.
+  size_t n = 0;
+  std::array<int, 4> values;
+  for (values[3] = test_ranges[3].m_begin; values[3] < test_ranges[3].m_end; ++values[3])
+    for (values[2] = test_ranges[2].m_begin; values[2] < test_ranges[2].m_end; ++values[2])
+      for (values[1] = test_ranges[1].m_begin; values[1] < test_ranges[1].m_end; ++values[1])
+        for (values[0] = test_ranges[0].m_begin; values[0] < test_ranges[0].m_end; ++values[0], ++n)
+        {
+          if (n % 2 == 1)
+            continue;
+          Index pipeline_index = pack(values.data());
+          packed_pipelines[pipeline_index] = fake_pipeline(n);
+          PipelineTable::TestAccess::store(table, pipeline_index, fake_pipeline(n));
+          // Both ways of calculating the slot must agree.
+          ASSERT(table.slot(pipeline_index) == table.slot(values[0], values[1], values[2], values[3]));
+        }
+
+  // Random lookups.
+  std::mt19937 engine(1234);
+  std::vector<std::array<int, 4>> queries(number_of_lookups);
+  for (auto& query : queries)
+    for (size_t i = 0; i < test_ranges.size(); ++i)
+      query[i] = std::uniform_int_distribution<int>(test_ranges[i].m_begin, test_ranges[i].m_end - 1)(engine);
+
+  using clock_type = std::chrono::steady_clock;
+  uintptr_t checksum_packed = 0;
+  size_t pending_packed = 0;
+  auto start = clock_type::now();
+  for (int pass = 0; pass < number_of_passes; ++pass)
+    for (auto const& query : queries)
+    {
+      VkPipeline vh_pipeline = packed_pipelines[pack(query.data())];
+      pending_packed += vh_pipeline == VK_NULL_HANDLE;
+      checksum_packed += reinterpret_cast<uintptr_t>(vh_pipeline);
+    }
+  auto packed_duration = clock_type::now() - start;
+
+  uintptr_t checksum_table = 0;
+  size_t pending_table = 0;
+  start = clock_type::now();
+  for (int pass = 0; pass < number_of_passes; ++pass)
+    for (auto const& query : queries)
+    {
+      vk::Pipeline vh_pipeline = table.lookup(query[0], query[1], query[2], query[3]);
+      pending_table += !vh_pipeline;
+      checksum_table += reinterpret_cast<uintptr_t>(static_cast<VkPipeline>(vh_pipeline));
+    }
+  auto table_duration = clock_type::now() - start;
+
+  if (checksum_packed != checksum_table || pending_packed != pending_table)
+  {
+    std::cerr << "FAILED: the lookups returned different pipelines." << std::endl;
+    return 1;
+  }
+
+  double const number_of_queries = static_cast<double>(number_of_lookups) * number_of_passes;
+  auto ns_per_lookup = [&](clock_type::duration duration){
+    return std::chrono::duration<double, std::nano>(duration).count() / number_of_queries;
+  };
+  std::cout << number_of_pipelines << " pipelines; " << (size_t{1} << shift) << " bit-packed slots versus " << table.size() << " table slots.\n";
+  std::cout << "bit-packed Index: " << ns_per_lookup(packed_duration) << " ns/lookup\n";
+  std::cout << "PipelineTable:    " << ns_per_lookup(table_duration) << " ns/lookup\n";
+  std::cout << "pending: " << pending_table << " of " << static_cast<size_t>(number_of_queries) << " lookups." << std::endl;
+
+  Dout(dc::notice, "Leaving main()");
+}
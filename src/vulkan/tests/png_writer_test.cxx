@@ -0,0 +1,90 @@
+#include "sys.h"
+#include "vk_utils/PngWriter.h"
+#define STB_IMAGE_IMPLEMENTATION
+#include "vk_utils/stb_image.h"
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include "check.h"
+#include "debug.h"
+
+namespace {
+
+// A test image with padding at the end of each row (like a readback buffer can have).
+struct TestImage
+{
+  uint32_t m_width;
+  uint32_t m_height;
+  uint32_t m_channels;
+  size_t m_row_pitch;
+  std::vector<std::byte> m_pixels;
+
+  TestImage(uint32_t width, uint32_t height, uint32_t channels) :
+    m_width(width), m_height(height), m_channels(channels), m_row_pitch(width * channels + 13), m_pixels(m_row_pitch * height)
+  {
+    for (uint32_t y = 0; y < height; ++y)
+      for (uint32_t x = 0; x < width; ++x)
+        for (uint32_t c = 0; c < channels; ++c)
+          m_pixels[y * m_row_pitch + x * channels + c] = static_cast<std::byte>((x * 7 + y * 13 + c * 101) & 0xff);
+  }
+
+  unsigned char expected(uint32_t x, uint32_t y, uint32_t c, bool swap_red_blue) const
+  {
+    if (swap_red_blue && (c == 0 || c == 2))
+      c = 2 - c;
+    return static_cast<unsigned char>(m_pixels[y * m_row_pitch + x * m_channels + c]);
+  }
+};
+
+// Encode image as PNG, decode it again with stb_image and compare.
+bool round_trip(TestImage const& image, bool swap_red_blue)
+{
+  std::ostringstream os;
+  vk_utils::write_png(os, image.m_width, image.m_height, image.m_channels, image.m_pixels.data(), image.m_row_pitch, swap_red_blue);
+  std::string const png = os.str();
+  int width, height, channels;
+  unsigned char* decoded = stbi_load_from_memory(reinterpret_cast<stbi_uc const*>(png.data()), png.size(), &width, &height, &channels, 0);
+  if (!decoded)
+  {
+    std::cerr << "stbi_load_from_memory failed: " << stbi_failure_reason() << std::endl;
+    return false;
+  }
+  bool ok = width == static_cast<int>(image.m_width) && height == static_cast<int>(image.m_height) && channels == static_cast<int>(image.m_channels);
+  for (uint32_t y = 0; ok && y < image.m_height; ++y)
+    for (uint32_t x = 0; x < image.m_width; ++x)
+      for (uint32_t c = 0; c < image.m_channels; ++c)
+        ok = ok && decoded[(y * image.m_width + x) * image.m_channels + c] == image.expected(x, y, c, swap_red_blue);
+  stbi_image_free(decoded);
+  return ok;
+}
+
+} // namespace
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  check(round_trip(TestImage(1, 1, 4), false), "1x1 RGBA");
+  check(round_trip(TestImage(17, 5, 3), false), "17x5 RGB");
+  check(round_trip(TestImage(64, 64, 4), true), "64x64 BGRA");
+  // Larger than one stored deflate block (65535 bytes).
+  check(round_trip(TestImage(320, 240, 4), false), "320x240 RGBA (multiple deflate blocks)");
+  check(round_trip(TestImage(320, 240, 4), true), "320x240 BGRA (multiple deflate blocks)");
+
+  // Raw output has no padding.
+  {
+    TestImage const image(5, 3, 4);
+    std::ostringstream os;
+    vk_utils::write_raw(os, image.m_width, image.m_height, image.m_channels, image.m_pixels.data(), image.m_row_pitch, true);
+    std::string const raw = os.str();
+    bool ok = raw.size() == 5 * 3 * 4;
+    for (uint32_t y = 0; ok && y < 3; ++y)
+      for (uint32_t x = 0; x < 5; ++x)
+        for (uint32_t c = 0; c < 4; ++c)
+          ok = ok && static_cast<unsigned char>(raw[(y * 5 + x) * 4 + c]) == image.expected(x, y, c, true);
+    check(ok, "raw BGRA --> RGBA without padding");
+  }
+
+  return checks_result();
+}
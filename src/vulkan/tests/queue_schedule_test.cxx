@@ -0,0 +1,261 @@
+#include "sys.h"
+#include "rendergraph/QueueSchedule.h"
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <random>
+#include "check.h"
+#include "debug.h"
+
+using namespace vulkan::rendergraph;
+
+namespace {
+
+constexpr QueueSchedule::QueueFamilies single_queue{ .m_graphics = 0, .m_async_compute = std::nullopt };
+constexpr QueueSchedule::QueueFamilies same_family{ .m_graphics = 0, .m_async_compute = 0 };
+constexpr QueueSchedule::QueueFamilies separate_family{ .m_graphics = 0, .m_async_compute = 1 };
+
+// Resources.
+enum : ResourceID { shadow_map, gbuffer, ambient_occlusion, particles, lit_image };
+
+// A typical frame: the ambient occlusion and particle simulation can run in parallel with the shadow pass.
+std::vector<ScheduleNode> const frame = {
+  { "shadow",         QueueType::graphics,      {},                                            { shadow_map } },
+  { "gbuffer",        QueueType::graphics,      {},                                            { gbuffer } },
+  { "ssao",           QueueType::async_compute, { gbuffer },                                   { ambient_occlusion } },
+  { "particle_sim",   QueueType::async_compute, {},                                            { particles } },
+  { "lighting",       QueueType::graphics,      { gbuffer, shadow_map, ambient_occlusion },    { lit_image } },
+  { "particle_draw",  QueueType::graphics,      { particles },                                 { lit_image } }
+};
+
+// Verify that the schedule is correct:
+// - every node is scheduled exactly once, and each queue keeps the given order,
+// - every dependency between queues is covered by a wait (possibly of an earlier step) for the producer or a later step,
+// - waits never refer to a step that comes later in the given order (which could deadlock),
+// - ownership transfers are consistent: a queue only accesses resources that it owns,
+// - the batches of each queue cover all its steps; only the first step of a batch waits and only the last one signals.
+void verify(std::vector<ScheduleNode> const& nodes, QueueSchedule const& schedule, QueueSchedule::QueueFamilies const& queue_families, char const* what)
+{
+  bool ok = true;
+  std::vector<int> seen(nodes.size(), 0);
+  for (QueueType queue : { QueueType::graphics, QueueType::async_compute })
+  {
+    auto const& steps = schedule.steps(queue);
+    for (size_t i = 0; i < steps.size(); ++i)
+    {
+      ++seen[steps[i].m_node];
+      ok = ok && schedule.assigned_queue(steps[i].m_node) == queue;
+      if (i > 0)
+        ok = ok && steps[i - 1].m_node < steps[i].m_node;
+      if (steps[i].m_wait)
+      {
+        auto const& other_steps = schedule.steps(steps[i].m_wait->m_queue);
+        ok = ok && steps[i].m_wait->m_queue != queue && steps[i].m_wait->m_value >= 1 && steps[i].m_wait->m_value <= other_steps.size();
+        if (ok)
+        {
+          QueueSchedule::Step const& signaler = other_steps[steps[i].m_wait->m_value - 1];
+          ok = ok && signaler.m_node < steps[i].m_node && signaler.m_signal_value == steps[i].m_wait->m_value;
+        }
+      }
+    }
+  }
+  ok = ok && std::all_of(seen.begin(), seen.end(), [](int count){ return count == 1; });
+  check(ok, what);
+
+  // Batches.
+  for (QueueType queue : { QueueType::graphics, QueueType::async_compute })
+  {
+    auto const& steps = schedule.steps(queue);
+    size_t next_step = 0;
+    for (QueueSchedule::Batch const& batch : schedule.batches(queue))
+    {
+      ok = ok && batch.m_first_step == next_step && batch.m_end_step > batch.m_first_step && batch.m_end_step <= steps.size();
+      for (size_t i = batch.m_first_step; ok && i < batch.m_end_step; ++i)
+        ok = (i == batch.m_first_step || !steps[i].m_wait) && (i == batch.m_end_step - 1 || !steps[i].m_signal_value);
+      next_step = batch.m_end_step;
+    }
+    ok = ok && next_step == steps.size();
+  }
+  check(ok, what);
+
+  // Dependencies.
+  auto position = [&](size_t node) -> size_t {
+    auto const& steps = schedule.steps(schedule.assigned_queue(node));
+    return std::find_if(steps.begin(), steps.end(), [node](auto const& step){ return step.m_node == node; }) - steps.begin();
+  };
+  for (auto [producer, consumer] : schedule.dependencies())
+  {
+    QueueType const producer_queue = schedule.assigned_queue(producer);
+    QueueType const consumer_queue = schedule.assigned_queue(consumer);
+    if (producer_queue == consumer_queue)
+    {
+      ok = ok && position(producer) < position(consumer);
+      continue;
+    }
+    // Find the largest value that was waited for up to and including the consumer.
+    uint64_t waited_for = 0;
+    auto const& steps = schedule.steps(consumer_queue);
+    for (size_t i = 0; i <= position(consumer); ++i)
+      if (steps[i].m_wait)
+        waited_for = std::max(waited_for, steps[i].m_wait->m_value);
+    ok = ok && waited_for >= position(producer) + 1;
+  }
+  check(ok, what);
+
+  // Ownership.
+  bool const transfers_expected = schedule.uses_async_compute() && *queue_families.m_async_compute != queue_families.m_graphics;
+  if (!transfers_expected)
+  {
+    check(schedule.ownership_transfers().empty(), what);
+    return;
+  }
+  std::map<ResourceID, QueueType> owner;
+  std::map<ResourceID, bool> released;
+  for (size_t node = 0; node < nodes.size(); ++node)
+  {
+    QueueType const queue = schedule.assigned_queue(node);
+    QueueSchedule::Step const& step = schedule.step_of(node);
+    for (ResourceID resource : step.m_acquires)
+    {
+      ok = ok && owner.contains(resource) && owner[resource] != queue && released[resource];
+      owner[resource] = queue;
+      released[resource] = false;
+    }
+    auto accessed = [&](ResourceID resource){
+      if (!owner.contains(resource))
+        owner[resource] = queue;
+      ok = ok && owner[resource] == queue && !released[resource];
+    };
+    std::ranges::for_each(nodes[node].m_reads, accessed);
+    std::ranges::for_each(nodes[node].m_writes, accessed);
+    for (ResourceID resource : step.m_releases)
+    {
+      ok = ok && owner[resource] == queue;
+      released[resource] = true;
+    }
+  }
+  check(ok, what);
+}
+
+} // namespace
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  // Without an async-compute queue everything runs on the graphics queue, in order, without synchronization.
+  {
+    QueueSchedule schedule;
+    schedule.generate(frame, single_queue);
+    schedule.print_on(std::cout, frame);
+    check(!schedule.uses_async_compute(), "single queue: no async compute");
+    check(schedule.steps(QueueType::graphics).size() == frame.size(), "single queue: all nodes on graphics");
+    check(schedule.number_of_waits() == 0, "single queue: no waits");
+    check(schedule.batches(QueueType::graphics).size() == 1, "single queue: a single batch");
+    check(schedule.ownership_transfers().empty(), "single queue: no ownership transfers");
+    verify(frame, schedule, single_queue, "single queue: valid schedule");
+  }
+
+  // A separate queue of the same family: overlap, but no ownership transfers.
+  {
+    QueueSchedule schedule;
+    schedule.generate(frame, same_family);
+    schedule.print_on(std::cout, frame);
+    check(schedule.assigned_queue(2) == QueueType::async_compute && schedule.assigned_queue(3) == QueueType::async_compute,
+        "same family: compute nodes on the async-compute queue");
+    check(schedule.ownership_transfers().empty(), "same family: no ownership transfers");
+    // ssao waits for gbuffer (graphics step 2); lighting waits for ssao (compute step 1); particle_draw waits for particle_sim (compute step 2).
+    auto const& ssao = schedule.step_of(2);
+    check(ssao.m_wait && ssao.m_wait->m_queue == QueueType::graphics && ssao.m_wait->m_value == 2, "same family: ssao waits for gbuffer");
+    check(!schedule.step_of(3).m_wait, "same family: particle_sim doesn't wait");
+    auto const& lighting = schedule.step_of(4);
+    check(lighting.m_wait && lighting.m_wait->m_queue == QueueType::async_compute && lighting.m_wait->m_value == 1, "same family: lighting waits for ssao");
+    auto const& particle_draw = schedule.step_of(5);
+    check(particle_draw.m_wait && particle_draw.m_wait->m_value == 2, "same family: particle_draw waits for particle_sim");
+    check(schedule.number_of_waits() == 3, "same family: three waits");
+    // {shadow, gbuffer signal(2)}, {wait(1) lighting}, {wait(2) particle_draw} and {wait(2) ssao signal(1)}, {particle_sim signal(2)}.
+    check(schedule.batches(QueueType::graphics).size() == 3 && schedule.batches(QueueType::async_compute).size() == 2, "same family: batches");
+    verify(frame, schedule, same_family, "same family: valid schedule");
+  }
+
+  // Different queue families: ownership of the gbuffer, ambient occlusion and particles is transferred.
+  {
+    QueueSchedule schedule;
+    schedule.generate(frame, separate_family);
+    schedule.print_on(std::cout, frame);
+    auto const& transfers = schedule.ownership_transfers();
+    auto transferred = [&](ResourceID resource, size_t release_node, size_t acquire_node){
+      return std::ranges::any_of(transfers, [=](QueueSchedule::OwnershipTransfer const& transfer){
+          return transfer.m_resource == resource && transfer.m_release_node == release_node && transfer.m_acquire_node == acquire_node; });
+    };
+    check(transferred(gbuffer, 1, 2), "separate family: gbuffer released by gbuffer, acquired by ssao");
+    check(transferred(gbuffer, 2, 4), "separate family: gbuffer released by ssao, acquired by lighting");
+    check(transferred(ambient_occlusion, 2, 4), "separate family: ambient occlusion released by ssao, acquired by lighting");
+    check(transferred(particles, 3, 5), "separate family: particles released by particle_sim, acquired by particle_draw");
+    check(transfers.size() == 4, "separate family: four transfers");
+    check(std::ranges::all_of(transfers, [](auto const& transfer){ return transfer.m_src_queue_family != transfer.m_dst_queue_family; }),
+        "separate family: transfers between different families");
+    verify(frame, schedule, separate_family, "separate family: valid schedule");
+  }
+
+  // A compute node that can't overlap with anything stays on the graphics queue.
+  {
+    std::vector<ScheduleNode> const chain = {
+      { "draw",    QueueType::graphics,      {},    { 0 } },
+      { "blur",    QueueType::async_compute, { 0 }, { 1 } },
+      { "present", QueueType::graphics,      { 1 }, { 2 } }
+    };
+    QueueSchedule schedule;
+    schedule.generate(chain, separate_family);
+    check(!schedule.uses_async_compute(), "chain: compute node kept on the graphics queue");
+    check(schedule.number_of_waits() == 0 && schedule.ownership_transfers().empty(), "chain: no synchronization");
+  }
+
+  // A wait that is already covered by an earlier wait is omitted.
+  {
+    std::vector<ScheduleNode> const nodes = {
+      { "sim",  QueueType::async_compute, {},        { 0, 1 } },
+      { "ui",   QueueType::graphics,      {},        { 5 } },
+      { "a",    QueueType::graphics,      { 0 },     { 2 } },
+      { "b",    QueueType::graphics,      { 1 },     { 3 } }
+    };
+    QueueSchedule schedule;
+    schedule.generate(nodes, same_family);
+    check(schedule.step_of(2).m_wait.has_value() && !schedule.step_of(3).m_wait.has_value(), "redundant: second wait omitted");
+    verify(nodes, schedule, same_family, "redundant: valid schedule");
+  }
+
+  // Random graphs.
+  {
+    std::mt19937 rng(4711);
+    int number_using_async_compute = 0;
+    for (int iteration = 0; iteration < 500; ++iteration)
+    {
+      int const number_of_nodes = std::uniform_int_distribution<int>(1, 12)(rng);
+      int const number_of_resources = std::uniform_int_distribution<int>(1, 8)(rng);
+      std::uniform_int_distribution<ResourceID> resource_distribution(0, number_of_resources - 1);
+      std::uniform_int_distribution<int> count_distribution(0, 2);
+      std::vector<ScheduleNode> nodes(number_of_nodes);
+      for (int n = 0; n < number_of_nodes; ++n)
+      {
+        nodes[n].m_name = "node" + std::to_string(n);
+        nodes[n].m_preferred_queue = rng() % 3 == 0 ? QueueType::async_compute : QueueType::graphics;
+        for (int r = count_distribution(rng); r > 0; --r)
+          nodes[n].m_reads.push_back(resource_distribution(rng));
+        for (int w = count_distribution(rng) + 1; w > 0; --w)
+          nodes[n].m_writes.push_back(resource_distribution(rng));
+      }
+      for (auto const& queue_families : { single_queue, same_family, separate_family })
+      {
+        QueueSchedule schedule;
+        schedule.generate(nodes, queue_families);
+        if (schedule.uses_async_compute())
+          ++number_using_async_compute;
+        verify(nodes, schedule, queue_families, "random: valid schedule");
+      }
+    }
+    check(number_using_async_compute > 0, "random: some schedules use async compute");
+  }
+
+  return checks_result();
+}
@@ -0,0 +1,339 @@
+#include "sys.h"
+#include "memory/SparseMipMemory.h"
+#include "memory/TextureResidency.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+#include "check.h"
+#include "debug.h"
+
+using namespace vulkan;
+using memory::SparseMipMemory;
+using memory::TextureResidency;
+
+namespace {
+
+constexpr vk::DeviceSize KiB = 1024;
+constexpr vk::DeviceSize MiB = 1024 * 1024;
+constexpr vk::DeviceSize page_size = 64 * KiB;
+constexpr vk::Extent2D granularity{ 128, 128 };         // The page of an R8G8B8A8 image.
+vk::MemoryRequirements const page_requirements{ 0, page_size, 0x3 };
+
+// A Backend that hands out fake allocations, keeps track of the allocated bytes and executes unbinds
+// when complete_unbinds() is called (as if the GPU finished them).
+class FakeBackend final : public SparseMipMemory::Backend
+{
+ public:
+  std::map<VmaAllocation, vk::DeviceSize> m_allocations;
+  vk::DeviceSize m_allocated_bytes = 0;
+  uintptr_t m_next_handle = 1;
+  std::vector<std::pair<std::vector<SparseMipMemory::Binding>, std::function<void()>>> m_unbinds;
+  bool m_valid = true;                  // Reset when the backend is used incorrectly.
+
+  VmaAllocation allocate_memory(vk::MemoryRequirements const& requirements) override
+  {
+    if (requirements.size == 0 || requirements.size % page_size != 0 || requirements.alignment != page_size)
+      m_valid = false;
+    VmaAllocation vh_allocation = reinterpret_cast<VmaAllocation>(m_next_handle++);
+    m_allocations[vh_allocation] = requirements.size;
+    m_allocated_bytes += requirements.size;
+    return vh_allocation;
+  }
+
+  void free_memory(VmaAllocation vh_allocation) override
+  {
+    auto allocation = m_allocations.find(vh_allocation);
+    if (allocation == m_allocations.end())
+    {
+      m_valid = false;
+      return;
+    }
+    m_allocated_bytes -= allocation->second;
+    m_allocations.erase(allocation);
+  }
+
+  void unbind(std::vector<SparseMipMemory::Binding> bindings, std::function<void()> done) override
+  {
+    for (auto const& binding : bindings)
+      if (binding.m_vh_allocation)
+        m_valid = false;
+    m_unbinds.emplace_back(std::move(bindings), std::move(done));
+  }
+
+  void complete_unbinds()
+  {
+    auto unbinds = std::move(m_unbinds);
+    m_unbinds.clear();
+    for (auto& unbind : unbinds)
+      unbind.second();
+  }
+};
+
+vk::Image fake_image(uintptr_t handle)
+{
+  return vk::Image{reinterpret_cast<VkImage>(handle)};
+}
+
+// The first mip level that is smaller than a page in some direction: the mip tail of an R8G8B8A8 image.
+uint32_t tail_level(vk::Extent2D extent, uint32_t number_of_levels)
+{
+  uint32_t level = 0;
+  while (level < number_of_levels && (extent.width >> level) >= granularity.width && (extent.height >> level) >= granularity.height)
+    ++level;
+  return level;
+}
+
+SparseMipMemory::Layout layout(vk::Extent2D extent)
+{
+  uint32_t const number_of_levels = std::bit_width(std::max(extent.width, extent.height));
+  return SparseMipMemory::layout(extent, number_of_levels, granularity, page_requirements, tail_level(extent, number_of_levels), page_size, 0);
+}
+
+// Textures on a line, seen by a camera that moves along that line (see texture_residency_test), whose
+// levels are committed in and released from a SparseMipMemory as requested by a TextureResidency.
+// Loads finish s_load_latency frames after they were requested, frames retire s_frames_in_flight
+// frames after they started, and unbinds finish one frame after they were made.
+class Simulation
+{
+ public:
+  static constexpr int s_view_distance = 60;
+  static constexpr TextureResidency::frame_type s_load_latency = 2;
+  static constexpr TextureResidency::frame_type s_frames_in_flight = 2;
+
+  struct PendingLoad
+  {
+    TextureResidency::texture_id_type m_id;
+    uint32_t m_level;
+    TextureResidency::frame_type m_done;
+  };
+
+  FakeBackend* m_backend;
+  SparseMipMemory m_memory;
+  std::vector<vk::Image> m_images;
+  std::vector<uint32_t> m_number_of_levels;
+  std::vector<uint32_t> m_resident_level;               // As seen through the callbacks.
+  std::vector<PendingLoad> m_pending;
+  std::vector<TextureResidency::texture_id_type> m_ids;
+  TextureResidency m_residency;
+  TextureResidency::frame_type m_frame = 0;
+  vk::DeviceSize m_max_allocated_bytes = 0;
+  bool m_budget_held = true;            // The allocated bytes never exceeded the budget.
+  bool m_charged = true;                // The allocated bytes never exceeded what m_residency counts.
+
+  Simulation(int number_of_textures, vk::DeviceSize budget, unsigned seed) :
+    m_backend(new FakeBackend),
+    m_memory(std::unique_ptr<SparseMipMemory::Backend>(m_backend)),
+    m_residency(
+        [this](TextureResidency::StreamIn const& stream_in){
+          m_memory.commit(m_images[stream_in.m_id], stream_in.m_level, stream_in.m_level + stream_in.m_count);
+          m_pending.push_back({ stream_in.m_id, stream_in.m_level, m_frame + s_load_latency });
+        },
+        [this](TextureResidency::texture_id_type id, uint32_t resident_level){
+          m_memory.release(m_images[id], m_resident_level[id], resident_level, [this](vk::DeviceSize bytes){ m_residency.released(bytes); });
+          m_resident_level[id] = resident_level;
+        }, 64, true)
+  {
+    std::mt19937 rng(seed);
+    // Mostly small textures, some big ones: 64, 128, ..., 2048 pixels square.
+    std::discrete_distribution<int> size_distribution({ 10, 20, 30, 20, 12, 8 });
+    for (int i = 0; i < number_of_textures; ++i)
+    {
+      uint32_t const size = 64U << size_distribution(rng);
+      SparseMipMemory::Layout texture_layout = layout({ size, size });
+      m_images.push_back(fake_image(i + 1));
+      m_number_of_levels.push_back(texture_layout.m_number_of_levels);
+      m_resident_level.push_back(texture_layout.m_number_of_levels);
+      m_ids.push_back(m_residency.add(texture_layout.residency_level_sizes()));
+      m_memory.add(m_images.back(), std::move(texture_layout));
+    }
+    m_residency.set_budget(budget);
+  }
+
+  ~Simulation()
+  {
+    for (vk::Image vh_image : m_images)
+      m_memory.remove(vh_image);
+    m_backend->complete_unbinds();
+  }
+
+  static uint32_t desired_level(int distance) { return std::bit_width(static_cast<unsigned>(distance) / 4); }
+  static float priority(int distance) { return 1.0f / (1.0f + distance); }
+
+  void check_allocated()
+  {
+    vk::DeviceSize const allocated = m_backend->m_allocated_bytes;
+    TextureResidency::Stats const stats = m_residency.stats();
+    m_max_allocated_bytes = std::max(m_max_allocated_bytes, allocated);
+    if (allocated > stats.m_budget)
+      m_budget_held = false;
+    if (allocated > stats.m_resident_bytes + stats.m_loading_bytes + stats.m_releasing_bytes)
+      m_charged = false;
+  }
+
+  void frame(int camera)
+  {
+    ++m_frame;
+    m_memory.begin_frame(m_frame);
+    // The unbinds of the previous frame finished, and so did an older frame.
+    m_backend->complete_unbinds();
+    check_allocated();
+    if (m_frame > s_frames_in_flight)
+      m_memory.retire(m_frame - s_frames_in_flight);
+
+    // Finish loads.
+    auto end = std::stable_partition(m_pending.begin(), m_pending.end(), [this](PendingLoad const& load){ return load.m_done <= m_frame; });
+    for (auto load = m_pending.begin(); load != end; ++load)
+    {
+      m_resident_level[load->m_id] = load->m_level;
+      m_residency.loaded(load->m_id, load->m_level);
+    }
+    m_pending.erase(m_pending.begin(), end);
+
+    for (int x = std::max(0, camera - s_view_distance); x < std::min<int>(m_ids.size(), camera + s_view_distance); ++x)
+    {
+      int const distance = std::abs(x - camera);
+      m_residency.use(m_ids[x], m_frame, desired_level(distance), priority(distance));
+    }
+    m_residency.update(m_frame);
+    check_allocated();
+  }
+
+  bool all_visible_resident(int camera) const
+  {
+    for (int x = std::max(0, camera - s_view_distance); x < std::min<int>(m_ids.size(), camera + s_view_distance); ++x)
+      if (m_residency.resident_level(m_ids[x]) == m_number_of_levels[x])
+        return false;
+    return true;
+  }
+};
+
+} // namespace
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  // The layout of a 1024x1024 R8G8B8A8 image: 8x8, 4x4, 2x2 and 1 page(s), then a mip tail of one page (64x64 and smaller).
+  {
+    SparseMipMemory::Layout const l = layout({ 1024, 1024 });
+    check(l.m_number_of_levels == 11 && l.tail_level() == 4 && l.has_tail(), "layout: levels and mip tail");
+    check(l.m_level_sizes == std::vector<vk::DeviceSize>{ 64 * page_size, 16 * page_size, 4 * page_size, page_size }, "layout: level sizes");
+    std::vector<vk::DeviceSize> const residency_sizes = l.residency_level_sizes();
+    vk::DeviceSize total = 0;
+    for (vk::DeviceSize size : residency_sizes)
+      total += size;
+    check(residency_sizes.size() == 11 && residency_sizes.back() == page_size && residency_sizes[4] == 0, "layout: the mip tail counts as the coarsest level");
+    check(total == 86 * page_size, "layout: residency sizes add up to the memory of all levels");
+    // Non-square, not a multiple of the page: 300x200 texels needs 3x2 pages.
+    SparseMipMemory::Layout const odd = SparseMipMemory::layout({ 300, 200 }, 9, granularity, page_requirements, 1, page_size, 0);
+    check(odd.m_level_sizes == std::vector<vk::DeviceSize>{ 6 * page_size }, "layout: partial pages are rounded up");
+  }
+
+  // Commit, release, retire and reclaim.
+  {
+    FakeBackend* backend = new FakeBackend;
+    SparseMipMemory memory{std::unique_ptr<SparseMipMemory::Backend>(backend)};
+    vk::Image const image = fake_image(1);
+    memory.add(image, layout({ 1024, 1024 }));
+    vk::DeviceSize released_bytes = 0;
+    auto released = [&](vk::DeviceSize bytes){ released_bytes += bytes; };
+
+    memory.begin_frame(1);
+    auto bindings = memory.commit(image, 3, 11);
+    check(bindings.size() == 2 && !bindings[0].m_tail && bindings[0].m_level == 3 && bindings[1].m_tail && bindings[1].m_vh_allocation,
+        "commit: level 3 and the mip tail are bound");
+    check(backend->m_allocated_bytes == 2 * page_size, "commit: memory allocated");
+    check(memory.commit(image, 5, 6).empty(), "commit: the mip tail is committed already");
+    bindings = memory.commit(image, 0, 3);
+    check(bindings.size() == 3 && backend->m_allocated_bytes == 86 * page_size, "commit: finer levels allocated");
+
+    // Releasing part of the mip tail doesn't release it.
+    memory.release(image, 5, 6, released);
+    check(memory.stats().m_releasing_bytes == 0, "release: the mip tail stays while levels of it are committed");
+    memory.commit(image, 5, 6);
+
+    memory.release(image, 0, 2, released);
+    check(memory.stats().m_releasing_bytes == 80 * page_size && backend->m_allocated_bytes == 86 * page_size, "release: memory kept while frames are in flight");
+    memory.begin_frame(2);
+    memory.retire(0);
+    check(backend->m_unbinds.empty(), "retire: frame 1 didn't retire yet");
+    memory.retire(1);
+    check(backend->m_unbinds.size() == 1 && backend->m_unbinds[0].first.size() == 2, "retire: the released levels are unbound");
+    check(backend->m_allocated_bytes == 86 * page_size && released_bytes == 0, "retire: memory kept until the unbind finished");
+    backend->complete_unbinds();
+    check(backend->m_allocated_bytes == 6 * page_size && released_bytes == 80 * page_size, "unbind finished: memory freed");
+    check(memory.stats().m_allocated_bytes == backend->m_allocated_bytes && memory.stats().m_releasing_bytes == 0, "unbind finished: stats");
+
+    // Memory that is committed again before it is unbound is reused.
+    memory.release(image, 2, 3, released);
+    bindings = memory.commit(image, 2, 3);
+    check(bindings.empty() && released_bytes == 84 * page_size && memory.stats().m_reclaims == 1, "reclaim: memory reused and released callback called");
+    memory.begin_frame(3);
+    memory.retire(2);
+    check(backend->m_unbinds.empty(), "reclaim: nothing to unbind");
+
+    // Releasing everything releases the mip tail too.
+    memory.release(image, 2, 11, released);
+    memory.retire(3);
+    backend->complete_unbinds();
+    check(backend->m_allocated_bytes == 0 && released_bytes == 90 * page_size, "release all: everything freed");
+    memory.commit(image, 0, 11);
+    memory.release(image, 0, 11, released);
+    memory.remove(image);
+    check(backend->m_allocated_bytes == 0 && memory.stats().m_releasing_bytes == 0, "remove: released memory freed");
+    check(backend->m_valid, "backend used correctly");
+  }
+
+  // The memory that is actually allocated stays within the budget while walking through a world of textures
+  // that is much larger than the budget.
+  {
+    int const number_of_textures = 1500;
+    vk::DeviceSize const budget = 96 * MiB;
+    Simulation simulation(number_of_textures, budget, 3);
+    int const start = 200;
+    for (int i = 0; i < 60; ++i)
+      simulation.frame(start);
+    check(simulation.all_visible_resident(start), "walk: all visible textures are resident");
+    for (int camera = start; camera < number_of_textures; ++camera)
+      for (int i = 0; i < 2; ++i)
+        simulation.frame(camera);
+    for (int camera = number_of_textures - 1; camera >= start; --camera)
+      simulation.frame(camera);
+    for (int i = 0; i < 20; ++i)
+      simulation.frame(start);
+
+    TextureResidency::Stats const stats = simulation.m_residency.stats();
+    SparseMipMemory::Stats const memory_stats = simulation.m_memory.stats();
+    std::cout << "Walk:\n";
+    stats.print_on(std::cout);
+    memory_stats.print_on(std::cout);
+    std::cout << "Maximum allocated: " << (simulation.m_max_allocated_bytes / MiB) << " MiB of a budget of " << (budget / MiB) << " MiB." << std::endl;
+    check(simulation.m_budget_held, "walk: the allocated bytes stay within the budget every frame");
+    check(simulation.m_charged, "walk: all allocated bytes are counted by the residency manager");
+    check(stats.m_evictions > 0 && memory_stats.m_frees > 0, "walk: evicted memory was freed");
+    check(simulation.m_max_allocated_bytes > budget / 2, "walk: the budget is used");
+    check(simulation.all_visible_resident(start), "walk: all visible textures resident after walking back");
+    check(memory_stats.m_allocated_bytes == simulation.m_backend->m_allocated_bytes, "walk: stats match the backend");
+
+    // Lower the budget: the allocated memory follows once the evicted levels are unbound.
+    vk::DeviceSize const low_budget = budget / 4;
+    simulation.m_residency.set_budget(low_budget);
+    for (TextureResidency::frame_type i = 0; i <= Simulation::s_frames_in_flight + Simulation::s_load_latency; ++i)
+      simulation.frame(start);
+    check(simulation.m_backend->m_allocated_bytes <= low_budget, "low budget: allocated bytes follow the budget");
+    simulation.m_budget_held = true;
+    for (int i = 0; i < 20; ++i)
+      simulation.frame(start);
+    check(simulation.m_budget_held, "low budget: the allocated bytes stay within the budget every frame");
+    check(simulation.m_charged, "low budget: all allocated bytes are counted by the residency manager");
+    check(simulation.all_visible_resident(start), "low budget: all visible textures are resident");
+    check(simulation.m_backend->m_valid, "walk: backend used correctly");
+  }
+
+  return checks_result();
+}
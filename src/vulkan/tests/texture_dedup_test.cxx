@@ -0,0 +1,260 @@
+#include "sys.h"
+#include "vk_utils/ContentHash.h"
+#include "vk_utils/ContentRegistry.h"
+#include "vk_utils/ImageData.h"
+#include "vk_utils/PngWriter.h"
+#include "vk_utils/get_binary_file_contents.h"
+#include <boost/container_hash/hash.hpp>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+#include "check.h"
+#include "debug.h"
+
+using namespace vulkan;
+
+namespace {
+
+int destroyed_textures = 0;
+
+// Stands in for a Texture: what the registry would have uploaded.
+struct FakeTexture
+{
+  vk::Extent2D m_extent;
+  uint64_t m_pixel_hash;
+
+  ~FakeTexture() { ++destroyed_textures; }
+};
+
+using Registry = vk_utils::ContentRegistry<FakeTexture>;
+
+// Uploads finish when finish_uploads() is called.
+std::vector<Registry::ready_callback_type> pending_uploads;
+int uploads = 0;
+
+void finish_uploads(bool success = true)
+{
+  std::vector<Registry::ready_callback_type> uploaded;
+  uploaded.swap(pending_uploads);
+  for (auto const& ready : uploaded)
+    ready(success);
+}
+
+// Create a FakeTexture from decoded image data; the upload finishes later.
+Registry::Created create_texture(vk_utils::stbi::ImageData const& image_data, Registry::ready_callback_type ready)
+{
+  ++uploads;
+  pending_uploads.push_back(std::move(ready));
+  std::span<std::byte const> const pixels(image_data.image_data(), image_data.size());
+  return { std::make_shared<FakeTexture>(FakeTexture{ image_data.extent(), vk_utils::content_hash(pixels) }), image_data.size() };
+}
+
+void write_ppm(std::filesystem::path const& filename, uint32_t width, uint32_t height, std::vector<std::byte> const& rgb)
+{
+  std::ofstream file(filename, std::ios::binary);
+  file << "P6\n" << width << ' ' << height << "\n255\n";
+  file.write(reinterpret_cast<char const*>(rgb.data()), rgb.size());
+}
+
+} // namespace
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  // Content hash.
+  {
+    std::vector<std::byte> data(1000);
+    for (size_t i = 0; i < data.size(); ++i)
+      data[i] = static_cast<std::byte>(i * 7);
+    uint64_t const hash = vk_utils::content_hash(data);
+    check(hash == vk_utils::content_hash(data), "the hash is deterministic");
+    std::vector<std::byte> changed = data;
+    changed[999] ^= std::byte{1};
+    check(vk_utils::content_hash(changed) != hash, "the last byte matters");
+    std::swap(changed[0], changed[8]);
+    changed[999] ^= std::byte{1};
+    check(changed == data || vk_utils::content_hash(changed) != hash, "the order of the words matters");
+    check(vk_utils::content_hash(std::span<std::byte const>(data).first(999)) != hash, "the size matters");
+    check(vk_utils::content_hash(data, 1) != hash, "the seed matters");
+  }
+
+  // A directory with 8 different images, each stored 6 times as PNG and twice as PPM under different names.
+  std::filesystem::path const directory = std::filesystem::temp_directory_path() / "texture_dedup_test";
+  std::filesystem::remove_all(directory);
+  std::filesystem::create_directories(directory);
+  constexpr int number_of_images = 8;
+  constexpr int png_copies = 6;
+  constexpr int ppm_copies = 2;
+  std::mt19937 rng(7);
+  for (int image = 0; image < number_of_images; ++image)
+  {
+    uint32_t const width = 16 + 8 * image;
+    uint32_t const height = 40 - 4 * image;
+    std::vector<std::byte> rgb(size_t{width} * height * 3);
+    for (std::byte& b : rgb)
+      b = static_cast<std::byte>(rng());
+    for (int copy = 0; copy < png_copies; ++copy)
+    {
+      std::ofstream file(directory / ("image" + std::to_string(image) + "_copy" + std::to_string(copy) + ".png"), std::ios::binary);
+      vk_utils::write_png(file, width, height, 3, rgb.data(), width * 3);
+    }
+    for (int copy = 0; copy < ppm_copies; ++copy)
+      write_ppm(directory / ("image" + std::to_string(image) + "_copy" + std::to_string(copy) + ".ppm"), width, height, rgb);
+  }
+  std::vector<std::filesystem::path> files;
+  for (auto const& entry : std::filesystem::directory_iterator(directory))
+    files.push_back(entry.path());
+  std::sort(files.begin(), files.end());
+  check(files.size() == number_of_images * (png_copies + ppm_copies), "all files were written");
+
+  constexpr uint64_t image_file_kind = 1;
+  constexpr uint64_t pixels_kind = 2;
+
+  // Keyed on the file contents: every file format of every image is decoded and uploaded once.
+  {
+    Registry registry;
+    std::vector<Registry::handle_type> handles;
+    uint64_t total_bytes = 0;
+    int decoded = 0;
+    uploads = 0;
+    for (auto const& filename : files)
+    {
+      std::vector<std::byte> const file_data = vk_utils::get_binary_file_contents(filename);
+      handles.push_back(registry.acquire({ vk_utils::content_hash(file_data), file_data.size(), image_file_kind },
+          [&](Registry::ready_callback_type ready){
+            ++decoded;
+            return create_texture(vk_utils::stbi::ImageData(file_data, 4), std::move(ready));
+          }, {}));
+      total_bytes += size_t{handles.back()->m_extent.width} * handles.back()->m_extent.height * 4;
+    }
+    finish_uploads();
+    Registry::Stats const stats = registry.stats();
+    check(decoded == 2 * number_of_images && uploads == 2 * number_of_images, "each image is decoded and uploaded once per file format");
+    check(stats.m_hits == files.size() - 2 * number_of_images, "all other files are hits");
+    check(stats.m_created_bytes + stats.m_saved_bytes == total_bytes, "the saved bytes are the bytes of the duplicates");
+    check(stats.m_live_resources == 2 * number_of_images && stats.m_live_bytes == stats.m_created_bytes, "the live resources are those created");
+    std::cout << "Keyed on file contents: "; stats.print_on(std::cout); std::cout << std::endl;
+
+    // Dropping all handles releases the resources; the next acquire creates them again.
+    handles.clear();
+    check(registry.stats().m_live_resources == 0, "resources are released with their last handle");
+    std::vector<std::byte> const file_data = vk_utils::get_binary_file_contents(files[0]);
+    auto handle = registry.acquire({ vk_utils::content_hash(file_data), file_data.size(), image_file_kind },
+        [&](Registry::ready_callback_type ready){ return create_texture(vk_utils::stbi::ImageData(file_data, 4), std::move(ready)); }, {});
+    finish_uploads();
+    check(registry.stats().m_hits == stats.m_hits && registry.stats().m_live_resources == 1, "a released resource is created again");
+  }
+
+  // Keyed on the decoded pixels: a PNG and a PPM of the same image share the texture.
+  {
+    Registry registry;
+    std::vector<Registry::handle_type> handles;
+    uploads = 0;
+    for (auto const& filename : files)
+    {
+      vk_utils::stbi::ImageData const image_data(filename, 4);
+      std::span<std::byte const> const pixels(image_data.image_data(), image_data.size());
+      uint64_t kind = pixels_kind;
+      boost::hash_combine(kind, image_data.extent().width);
+      boost::hash_combine(kind, image_data.extent().height);
+      handles.push_back(registry.acquire({ vk_utils::content_hash(pixels), pixels.size(), kind },
+          [&](Registry::ready_callback_type ready){ return create_texture(image_data, std::move(ready)); }, {}));
+    }
+    finish_uploads();
+    Registry::Stats const stats = registry.stats();
+    check(uploads == number_of_images, "each image is uploaded once");
+    check(stats.m_saved_bytes == stats.m_created_bytes * (png_copies + ppm_copies - 1), "the saved bytes are those of all copies");
+    bool same_pixels_same_texture = true;
+    for (size_t i = 0; i < files.size(); ++i)
+      for (size_t j = 0; j < files.size(); ++j)
+        if ((handles[i]->m_pixel_hash == handles[j]->m_pixel_hash) != (handles[i] == handles[j]))
+          same_pixels_same_texture = false;
+    check(same_pixels_same_texture, "files with the same pixels share the texture, and only those");
+    std::cout << "Keyed on pixels: "; stats.print_on(std::cout); std::cout << std::endl;
+  }
+
+  // Ready callbacks, the kind and failures.
+  {
+    Registry registry;
+    std::vector<std::byte> const file_data = vk_utils::get_binary_file_contents(files[0]);
+    Registry::Key const key{ vk_utils::content_hash(file_data), file_data.size(), image_file_kind };
+    auto create = [&](Registry::ready_callback_type ready){ return create_texture(vk_utils::stbi::ImageData(file_data, 4), std::move(ready)); };
+    std::vector<bool> results;
+    auto record = [&](bool success){ results.push_back(success); };
+
+    uploads = 0;
+    auto first = registry.acquire(key, create, record);
+    auto second = registry.acquire(key, create, record);
+    check(first == second && uploads == 1 && results.empty(), "a hit before the upload finished waits for it");
+    finish_uploads();
+    check(results == std::vector<bool>{ true, true }, "both acquires are told when the upload finished");
+    auto third = registry.acquire(key, create, record);
+    check(third == first && results.size() == 3 && results.back(), "a hit after the upload finished is ready right away");
+
+    // A different sampler or image view means a different texture.
+    Registry::Key other_kind = key;
+    other_kind.m_kind_hash = image_file_kind + 100;
+    auto other = registry.acquire(other_kind, create, {});
+    check(other != first && uploads == 2, "the same content of a different kind is a different texture");
+
+    // A failed upload is reported to everyone that waits for it, and is retried by the next acquire.
+    finish_uploads();
+    Registry::Key const key2{ key.m_content_hash + 1, key.m_content_size, key.m_kind_hash };
+    results.clear();
+    auto failed1 = registry.acquire(key2, create, record);
+    auto failed2 = registry.acquire(key2, create, record);
+    finish_uploads(false);
+    check(results == std::vector<bool>{ false, false } && registry.stats().m_failures == 1, "a failed upload is reported");
+    auto retried = registry.acquire(key2, create, record);
+    check(retried != failed1 && uploads == 4, "a failed resource is created again");
+    finish_uploads();
+  }
+
+  // Resources made with make() are destroyed once the frame in which they lost their last handle retired.
+  {
+    int const destroyed_before = destroyed_textures;
+    std::optional<Registry> registry(std::in_place);
+    Registry::Key const key{ 1, 4, pixels_kind };
+    // Like TextureRegistry, the upload keeps the resource alive until it finished.
+    auto create = [&](Registry::ready_callback_type ready) -> Registry::Created {
+      ++uploads;
+      std::shared_ptr<FakeTexture> resource = registry->make(vk::Extent2D{ 1, 1 }, uint64_t{1});
+      pending_uploads.push_back([resource, ready = std::move(ready)](bool success){ ready(success); });
+      return { std::move(resource), 4 };
+    };
+
+    registry->begin_frame(1);
+    auto handle = registry->acquire(key, create, {});
+    handle.reset();
+    check(registry->stats().m_live_resources == 1 && registry->stats().m_retiring_resources == 0, "the upload keeps the resource alive");
+    finish_uploads();
+    check(registry->stats().m_live_resources == 0 && registry->stats().m_retiring_resources == 1, "a resource without handles waits for its frame");
+    registry->begin_frame(2);
+    registry->retire(0);
+    check(destroyed_textures == destroyed_before, "the resource is not destroyed before its frame retired");
+    registry->retire(1);
+    check(destroyed_textures == destroyed_before + 1 && registry->stats().m_retiring_resources == 0, "the resource is destroyed when its frame retired");
+
+    // A resource that was released in the current frame is destroyed with the registry; a handle that outlives the registry destroys its resource itself.
+    handle = registry->acquire(key, create, {});
+    finish_uploads();
+    Registry::Key const key2{ 2, 4, pixels_kind };
+    auto survivor = registry->acquire(key2, create, {});
+    finish_uploads();
+    handle.reset();
+    registry.reset();
+    check(destroyed_textures == destroyed_before + 2, "the registry destroys the resources that it kept");
+    survivor.reset();
+    check(destroyed_textures == destroyed_before + 3, "a handle that outlived the registry destroys its resource");
+  }
+
+  std::filesystem::remove_all(directory);
+
+  return checks_result();
+}
@@ -0,0 +1,333 @@
+#include "sys.h"
+#include "memory/TextureResidency.h"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "check.h"
+#include "debug.h"
+
+using namespace vulkan;
+using memory::TextureResidency;
+
+namespace {
+
+constexpr vk::DeviceSize MiB = 1024 * 1024;
+
+// A world of textures on a line, one per unit, seen by a camera that moves along that line.
+// Textures within s_view_distance of the camera are drawn; the closer, the finer the desired mip level
+// and the higher the priority. Loads finish s_load_latency frames after they were requested.
+class Simulation
+{
+ public:
+  static constexpr int s_view_distance = 100;
+  static constexpr TextureResidency::frame_type s_load_latency = 2;
+
+  struct PendingLoad
+  {
+    TextureResidency::texture_id_type m_id;
+    uint32_t m_level;
+    TextureResidency::frame_type m_done;
+  };
+
+  std::vector<std::vector<vk::DeviceSize>> m_level_sizes;
+  std::vector<uint32_t> m_resident_level;               // As seen through the callbacks.
+  std::vector<PendingLoad> m_pending;
+  std::vector<TextureResidency::texture_id_type> m_ids;
+  TextureResidency m_residency;
+  TextureResidency::frame_type m_frame = 0;
+  bool m_budget_held = true;
+  bool m_tail_before_finer = true;
+  bool m_visible_now_for_tails = true;
+
+  Simulation(int number_of_textures, vk::DeviceSize budget, unsigned seed) :
+    m_residency(
+        [this](TextureResidency::StreamIn const& stream_in){
+          // Loads are always one level finer, except the first one that loads the mip tail.
+          bool const first = m_resident_level[stream_in.m_id] == m_level_sizes[stream_in.m_id].size();
+          if (!first && stream_in.m_count != 1)
+            m_tail_before_finer = false;
+          if (first != (stream_in.m_priority == UploadPriority::visible_now))
+            m_visible_now_for_tails = false;
+          m_pending.push_back({ stream_in.m_id, stream_in.m_level, m_frame + s_load_latency });
+        },
+        [this](TextureResidency::texture_id_type id, uint32_t resident_level){
+          m_resident_level[id] = resident_level;
+        })
+  {
+    std::mt19937 rng(seed);
+    // Mostly small textures, some big ones: 64, 128, ..., 2048 pixels square.
+    std::discrete_distribution<int> size_distribution({ 10, 20, 30, 20, 12, 8 });
+    for (int i = 0; i < number_of_textures; ++i)
+    {
+      uint32_t const size = 64U << size_distribution(rng);
+      m_level_sizes.push_back(TextureResidency::mip_level_sizes({ size, size }, 4));
+      m_resident_level.push_back(m_level_sizes.back().size());
+      m_ids.push_back(m_residency.add(m_level_sizes.back()));
+    }
+    m_residency.set_budget(budget);
+  }
+
+  static uint32_t desired_level(int distance) { return std::bit_width(static_cast<unsigned>(distance) / 4); }
+  static float priority(int distance) { return 1.0f / (1.0f + distance); }
+
+  void frame(int camera)
+  {
+    ++m_frame;
+    // Finish loads.
+    auto end = std::stable_partition(m_pending.begin(), m_pending.end(), [this](PendingLoad const& load){ return load.m_done <= m_frame; });
+    for (auto load = m_pending.begin(); load != end; ++load)
+    {
+      m_resident_level[load->m_id] = load->m_level;
+      m_residency.loaded(load->m_id, load->m_level);
+    }
+    m_pending.erase(m_pending.begin(), end);
+
+    for (int x = std::max(0, camera - s_view_distance); x < std::min<int>(m_ids.size(), camera + s_view_distance); ++x)
+    {
+      int const distance = std::abs(x - camera);
+      m_residency.use(m_ids[x], m_frame, desired_level(distance), priority(distance));
+    }
+    m_residency.update(m_frame);
+
+    TextureResidency::Stats const stats = m_residency.stats();
+    if (stats.m_resident_bytes + stats.m_loading_bytes > stats.m_budget)
+      m_budget_held = false;
+  }
+
+  // The total size that the textures that are visible from camera want to have resident.
+  vk::DeviceSize desired_bytes(int camera) const
+  {
+    vk::DeviceSize bytes = 0;
+    for (int x = std::max(0, camera - s_view_distance); x < std::min<int>(m_ids.size(), camera + s_view_distance); ++x)
+    {
+      auto const& sizes = m_level_sizes[x];
+      for (uint32_t level = std::min<uint32_t>(desired_level(std::abs(x - camera)), sizes.size() - 1); level < sizes.size(); ++level)
+        bytes += sizes[level];
+    }
+    return bytes;
+  }
+
+  bool all_visible_at_desired_level(int camera) const
+  {
+    for (int x = std::max(0, camera - s_view_distance); x < std::min<int>(m_ids.size(), camera + s_view_distance); ++x)
+      if (m_residency.resident_level(m_ids[x]) > desired_level(std::abs(x - camera)))
+        return false;
+    return true;
+  }
+
+  bool all_visible_resident(int camera) const
+  {
+    for (int x = std::max(0, camera - s_view_distance); x < std::min<int>(m_ids.size(), camera + s_view_distance); ++x)
+      if (m_residency.resident_level(m_ids[x]) == m_level_sizes[x].size())
+        return false;
+    return true;
+  }
+
+  bool callbacks_consistent() const
+  {
+    for (size_t i = 0; i < m_ids.size(); ++i)
+    {
+      uint32_t const level = m_residency.resident_level(m_ids[i]);
+      // A load that is in flight is only known to the simulation once it finished.
+      if (level != m_resident_level[i])
+        return false;
+    }
+    return true;
+  }
+};
+
+} // namespace
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  int const number_of_textures = 4000;
+  vk::DeviceSize const budget = 256 * MiB;
+
+  // Walk the camera through the whole world, stand still, then walk back.
+  {
+    Simulation simulation(number_of_textures, budget, 1);
+    std::cout << "Total size of all textures: " << [&](){
+      vk::DeviceSize total = 0;
+      for (auto const& sizes : simulation.m_level_sizes)
+        for (vk::DeviceSize size : sizes)
+          total += size;
+      return total / MiB;
+    }() << " MiB; budget: " << (budget / MiB) << " MiB." << std::endl;
+
+    // Stand still at the start until everything that is wanted is loaded.
+    int const start = 500;
+    for (int i = 0; i < 100; ++i)
+      simulation.frame(start);
+    check(simulation.all_visible_resident(start), "walk: all visible textures are resident");
+    if (simulation.desired_bytes(start) <= budget)
+      check(simulation.all_visible_at_desired_level(start), "walk: all visible textures reach their desired level");
+    else
+      std::cout << "Note: the desired bytes at the start (" << (simulation.desired_bytes(start) / MiB) << " MiB) exceed the budget." << std::endl;
+
+    // Walk, one unit every two frames, to the end and back.
+    for (int camera = start; camera < number_of_textures; ++camera)
+      for (int i = 0; i < 2; ++i)
+        simulation.frame(camera);
+    for (int camera = number_of_textures - 1; camera >= start; --camera)
+      for (int i = 0; i < 2; ++i)
+        simulation.frame(camera);
+    for (int i = 0; i < 10; ++i)
+      simulation.frame(start);
+
+    TextureResidency::Stats const stats = simulation.m_residency.stats();
+    std::cout << "Walk:\n";
+    stats.print_on(std::cout);
+    std::cout << "Reload churn: " << (100.0 * stats.m_reloaded_bytes / stats.m_loaded_bytes) << "% of the loaded bytes." << std::endl;
+    check(simulation.m_budget_held, "walk: budget holds every frame");
+    check(stats.m_resident_bytes <= budget, "walk: resident bytes within budget");
+    check(stats.m_evictions > 0, "walk: textures were evicted");
+    // Walking back reloads what was evicted while walking forward.
+    check(stats.m_reloaded_bytes > 0, "walk: churn is measured");
+    check(simulation.all_visible_resident(start), "walk: all visible textures resident after walking back");
+    check(simulation.m_tail_before_finer, "walk: the mip tail is loaded first, then one level at a time");
+    check(simulation.m_visible_now_for_tails, "walk: mip tails are loaded with priority visible_now");
+    check(simulation.callbacks_consistent(), "walk: callbacks are consistent with the resident levels");
+
+    // Lower the budget: the next update evicts until the budget holds again.
+    uint64_t const evictions = stats.m_evictions;
+    vk::DeviceSize const low_budget = budget / 4;
+    simulation.m_residency.set_budget(low_budget);
+    // The loads that were in flight when the budget was lowered still count.
+    for (TextureResidency::frame_type i = 0; i <= Simulation::s_load_latency; ++i)
+      simulation.frame(start);
+    TextureResidency::Stats const low_stats = simulation.m_residency.stats();
+    check(low_stats.m_resident_bytes + low_stats.m_loading_bytes <= low_budget, "low budget: budget holds again");
+    check(low_stats.m_evictions > evictions, "low budget: textures were evicted");
+    simulation.m_budget_held = true;
+    for (int i = 0; i < 20; ++i)
+      simulation.frame(start);
+    check(simulation.m_budget_held, "low budget: budget holds every frame");
+    // Mip tails are loaded before any finer level.
+    check(simulation.all_visible_resident(start), "low budget: all visible textures are resident");
+    check(simulation.callbacks_consistent(), "low budget: callbacks are consistent with the resident levels");
+  }
+
+  // Moving back and forth within an area that fits in the budget doesn't cause churn after the first pass:
+  // nothing is evicted unless room is needed.
+  {
+    Simulation simulation(number_of_textures, budget, 2);
+    int const left = 1000;
+    int const right = 1040;
+    // The size of all levels that are desired from at least one camera position.
+    vk::DeviceSize union_bytes = 0;
+    for (int x = left - Simulation::s_view_distance; x < right + Simulation::s_view_distance; ++x)
+    {
+      auto const& sizes = simulation.m_level_sizes[x];
+      int const distance = x < left ? left - x : x > right ? x - right : 0;
+      for (uint32_t level = std::min<uint32_t>(Simulation::desired_level(distance), sizes.size() - 1); level < sizes.size(); ++level)
+        union_bytes += sizes[level];
+    }
+    std::cout << "Oscillate: all desired levels in range are " << (union_bytes / MiB) << " MiB." << std::endl;
+    check(union_bytes <= budget, "oscillate: precondition");
+
+    auto pass = [&](){
+      for (int camera = left; camera < right; ++camera)
+        simulation.frame(camera);
+      for (int camera = right; camera > left; --camera)
+        simulation.frame(camera);
+    };
+    pass();
+    pass();
+    TextureResidency::Stats const before = simulation.m_residency.stats();
+    for (int i = 0; i < 5; ++i)
+      pass();
+    TextureResidency::Stats const after = simulation.m_residency.stats();
+    after.print_on(std::cout);
+    check(after.m_evictions == before.m_evictions, "oscillate: no evictions");
+    check(after.m_reloaded_bytes == 0, "oscillate: no churn");
+    check(simulation.m_budget_held, "oscillate: budget holds every frame");
+  }
+
+  // Higher priority textures take the room of lower priority textures when the budget is tight.
+  {
+    std::vector<TextureResidency::StreamIn> requested;
+    TextureResidency residency([&](TextureResidency::StreamIn const& stream_in){ requested.push_back(stream_in); }, [](auto, auto){ });
+    auto const sizes = TextureResidency::mip_level_sizes({ 1024, 1024 }, 4);
+    // The budget fits the full chain of one texture, plus the mip tail of the other.
+    residency.set_budget(sizes[0] + 2 * sizes[1]);
+    auto const first = residency.add(sizes);
+    auto const second = residency.add(sizes);
+    TextureResidency::frame_type frame = 0;
+    auto run = [&](float first_priority, float second_priority, int frames){
+      for (int i = 0; i < frames; ++i)
+      {
+        ++frame;
+        for (auto const& stream_in : requested)
+          residency.loaded(stream_in.m_id, stream_in.m_level);
+        requested.clear();
+        residency.use(first, frame, 0, first_priority);
+        residency.use(second, frame, 0, second_priority);
+        residency.update(frame);
+      }
+    };
+    run(0.5f, 0.1f, 40);
+    check(residency.resident_level(first) == 0, "priority: the high priority texture is fully loaded");
+    check(residency.resident_level(second) < sizes.size(), "priority: the low priority texture keeps its mip tail");
+    // Swap the priorities.
+    run(0.1f, 0.5f, 40);
+    check(residency.resident_level(second) == 0, "priority: after swapping, the other texture is fully loaded");
+    check(residency.resident_level(first) < sizes.size() && residency.resident_level(first) > 0, "priority: and the first one is reduced");
+    TextureResidency::Stats const stats = residency.stats();
+    check(stats.m_resident_bytes <= stats.m_budget, "priority: budget holds");
+    check(stats.m_starved_loads > 0, "priority: loads that don't fit are starved");
+
+    // Removing a texture while it is loading.
+    for (auto const& stream_in : requested)
+      residency.loaded(stream_in.m_id, stream_in.m_level);
+    requested.clear();
+    residency.set_budget(1024 * MiB);
+    auto const removed = residency.add(sizes);
+    ++frame;
+    residency.use(removed, frame, 0, 1.0f);
+    residency.update(frame);
+    check(requested.size() == 1 && requested.back().m_id == removed, "remove: load requested");
+    residency.remove(removed);
+    auto const reused = residency.add(sizes);
+    check(reused != removed, "remove: id is not reused while loading");
+    residency.loaded(removed, requested.back().m_level);
+    requested.clear();
+    ++frame;
+    residency.update(frame);
+    check(residency.stats().m_loading_bytes == 0, "remove: reserved bytes released");
+    check(residency.add(sizes) == removed, "remove: id reused after the load finished");
+    check(residency.stats().m_textures == 4, "remove: number of textures");
+  }
+
+  // A failed load releases its bytes and is requested again.
+  {
+    std::vector<TextureResidency::StreamIn> requested;
+    TextureResidency residency([&](TextureResidency::StreamIn const& stream_in){ requested.push_back(stream_in); }, [](auto, auto){ });
+    residency.set_budget(1024 * MiB);
+    auto const sizes = TextureResidency::mip_level_sizes({ 256, 256 }, 4);
+    auto const id = residency.add(sizes);
+    residency.use(id, 1, 0, 1.0f);
+    residency.update(1);
+    check(requested.size() == 1, "failed load: load requested");
+    TextureResidency::StreamIn const failed = requested.back();
+    requested.clear();
+    residency.loaded(failed.m_id, failed.m_level, false);
+    residency.use(id, 2, 0, 1.0f);
+    residency.update(2);
+    TextureResidency::Stats const stats = residency.stats();
+    check(stats.m_failed_loads == 1 && stats.m_resident_bytes == 0, "failed load: nothing became resident");
+    check(stats.m_loading_bytes == failed.m_bytes && requested.size() == 1 && requested.back().m_level == failed.m_level,
+        "failed load: the same levels are requested again");
+    check(residency.resident_level(id) == sizes.size(), "failed load: resident level unchanged");
+  }
+
+  // Budget from heap budgets.
+  check(TextureResidency::texture_budget(1000 * MiB, 400 * MiB, 300 * MiB, 0.1) == 800 * MiB, "texture_budget: other usage and headroom subtracted");
+  check(TextureResidency::texture_budget(1000 * MiB, 1000 * MiB, 0, 0.1) == 0, "texture_budget: no room");
+
+  return checks_result();
+}
@@ -0,0 +1,104 @@
+#include "sys.h"
+#include "TripleBuffer.h"
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include "check.h"
+#include "debug.h"
+
+using vulkan::TripleBuffer;
+
+namespace {
+
+// A value that is large enough that a torn read would be noticed.
+struct Payload
+{
+  uint64_t m_sequence = 0;
+  uint64_t m_values[15] = {};
+};
+
+// A value without a default constructor.
+struct Named
+{
+  int m_id;
+
+  explicit Named(int id) : m_id(id) { }
+};
+
+} // namespace
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  // Single threaded.
+  {
+    TripleBuffer<int> buffer;
+    check(!buffer.update(), "nothing published: update returns false");
+    buffer.write_buffer() = 1;
+    buffer.publish();
+    buffer.write_buffer() = 2;
+    buffer.publish();
+    check(buffer.update(), "published: update returns true");
+    check(buffer.read_buffer() == 2, "update takes the latest value");
+    check(!buffer.update(), "no new value: update returns false");
+    check(buffer.read_buffer() == 2, "read_buffer is stable without new values");
+    buffer.write_buffer() = 3;
+    buffer.publish();
+    check(buffer.read_buffer() == 2, "publish doesn't change read_buffer");
+    check(buffer.update() && buffer.read_buffer() == 3, "next value");
+  }
+
+  // Types that are not default constructible start with a copy of an initial value.
+  {
+    TripleBuffer<Named> buffer(Named{7});
+    check(!buffer.update() && buffer.read_buffer().m_id == 7, "read_buffer is the initial value before anything was published");
+    buffer.write_buffer() = Named{8};
+    buffer.publish();
+    check(buffer.update() && buffer.read_buffer().m_id == 8, "a published value replaces the initial value");
+  }
+
+  // A producer and a consumer thread.
+  {
+    constexpr uint64_t number_of_values = 2000000;
+    TripleBuffer<Payload> buffer;
+    std::atomic_bool done{false};
+    std::thread producer([&]{
+      for (uint64_t sequence = 1; sequence <= number_of_values; ++sequence)
+      {
+        Payload& payload = buffer.write_buffer();
+        payload.m_sequence = sequence;
+        for (uint64_t& value : payload.m_values)
+          value = sequence;
+        buffer.publish();
+      }
+      done = true;
+    });
+    uint64_t last_sequence = 0;
+    uint64_t number_of_updates = 0;
+    bool consistent = true;
+    bool increasing = true;
+    for (;;)
+    {
+      bool const finished = done.load();
+      if (buffer.update())
+      {
+        Payload const& payload = buffer.read_buffer();
+        for (uint64_t value : payload.m_values)
+          consistent = consistent && value == payload.m_sequence;
+        increasing = increasing && payload.m_sequence > last_sequence;
+        last_sequence = payload.m_sequence;
+        ++number_of_updates;
+      }
+      else if (finished)
+        break;
+    }
+    producer.join();
+    std::cout << "Consumer saw " << number_of_updates << " of " << number_of_values << " values." << std::endl;
+    check(consistent, "threads: no torn reads");
+    check(increasing, "threads: values arrive in order, without duplicates");
+    check(last_sequence == number_of_values, "threads: the last value is seen");
+  }
+
+  return checks_result();
+}
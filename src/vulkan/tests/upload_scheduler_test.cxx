@@ -0,0 +1,222 @@
+#include "sys.h"
+#include "queues/UploadScheduler.h"
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <vector>
+#include "check.h"
+#include "debug.h"
+
+using namespace vulkan;
+using clock_type = UploadScheduler::clock_type;
+using namespace std::chrono_literals;
+
+namespace {
+
+constexpr size_t KiB = 1024;
+constexpr size_t MiB = 1024 * KiB;
+
+// A transfer queue that processes the admitted uploads in order, at a fixed bandwidth.
+class SimulatedTransferQueue
+{
+ public:
+  struct Upload
+  {
+    int m_id;
+    size_t m_size;
+    UploadPriority m_priority;
+    clock_type::time_point m_enqueued;
+    clock_type::time_point m_admitted;
+    clock_type::time_point m_completed;
+    uint64_t m_batch;
+  };
+
+ private:
+  double m_bandwidth;                           // Bytes per second.
+  clock_type::time_point m_busy_until;
+  std::vector<std::shared_ptr<Upload>> m_in_flight;
+
+ public:
+  SimulatedTransferQueue(double bandwidth, clock_type::time_point start) : m_bandwidth(bandwidth), m_busy_until(start) { }
+
+  void start(std::shared_ptr<Upload> const& upload, clock_type::time_point now)
+  {
+    m_busy_until = std::max(m_busy_until, now) + std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(upload->m_size / m_bandwidth));
+    upload->m_admitted = now;
+    upload->m_completed = m_busy_until;
+    m_in_flight.push_back(upload);
+  }
+
+  // Report the uploads that completed before now to the scheduler.
+  void complete_until(clock_type::time_point now, UploadScheduler& scheduler, std::vector<std::shared_ptr<Upload>>& done)
+  {
+    auto end = std::stable_partition(m_in_flight.begin(), m_in_flight.end(), [now](auto const& upload){ return upload->m_completed <= now; });
+    for (auto upload = m_in_flight.begin(); upload != end; ++upload)
+    {
+      scheduler.completed((*upload)->m_batch, (*upload)->m_completed);
+      done.push_back(*upload);
+    }
+    m_in_flight.erase(m_in_flight.begin(), end);
+  }
+};
+
+} // namespace
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  UploadBudget budget;
+  budget.m_bytes_per_frame = 16 * MiB;
+  budget.m_time_per_frame = 2ms;
+  budget.m_frame_period = 16667us;
+  budget.m_max_background_wait = 500ms;
+  auto const frame_period = std::chrono::duration_cast<clock_type::duration>(budget.m_frame_period);
+
+  // Flood the scheduler with mixed priority uploads for 300 frames: every frame 2 small visible_now uploads,
+  // a 2 MiB prefetch upload and four 4 MiB background uploads; that is far more than the transfer queue can handle.
+  {
+    UploadScheduler scheduler(budget);
+    clock_type::time_point const start = clock_type::now();
+    double const bandwidth = 1024.0 * MiB;      // 1 GiB/s.
+    SimulatedTransferQueue transfer_queue(bandwidth, start);
+    std::vector<std::shared_ptr<SimulatedTransferQueue::Upload>> done;
+    std::map<int, size_t> non_visible_bytes_per_dispatch;
+    int next_id = 0;
+    int const number_of_frames = 300;
+    int frame = 0;
+    int last_prefetch_id = -1;
+    bool prefetch_in_order = true;
+
+    auto enqueue = [&](size_t size, UploadPriority priority, clock_type::time_point now){
+      auto upload = std::make_shared<SimulatedTransferQueue::Upload>(SimulatedTransferQueue::Upload{ .m_id = next_id++, .m_size = size, .m_priority = priority, .m_enqueued = now, .m_admitted = {}, .m_completed = {}, .m_batch = 0 });
+      scheduler.enqueue(size, priority, [&, upload](uint64_t batch){
+        upload->m_batch = batch;
+        if (upload->m_priority != UploadPriority::visible_now)
+          non_visible_bytes_per_dispatch[frame] += upload->m_size;
+        if (upload->m_priority == UploadPriority::prefetch)
+        {
+          prefetch_in_order = prefetch_in_order && upload->m_id > last_prefetch_id;
+          last_prefetch_id = upload->m_id;
+        }
+        transfer_queue.start(upload, start + frame * frame_period);
+      }, now);
+    };
+
+    for (; frame < number_of_frames + 200; ++frame)
+    {
+      clock_type::time_point const frame_start = start + frame * frame_period;
+      transfer_queue.complete_until(frame_start, scheduler, done);
+      scheduler.dispatch(frame_start);
+      if (frame < number_of_frames)
+      {
+        // The uploads are requested halfway the frame.
+        clock_type::time_point const now = frame_start + frame_period / 2;
+        enqueue(64 * KiB, UploadPriority::visible_now, now);
+        enqueue(128 * KiB, UploadPriority::visible_now, now);
+        enqueue(2 * MiB, UploadPriority::prefetch, now);
+        for (int i = 0; i < 4; ++i)
+          enqueue(4 * MiB, UploadPriority::background, now);
+      }
+    }
+
+    UploadScheduler::Stats const stats = scheduler.stats();
+    stats.print_on(std::cout);
+
+    {
+      auto const& visible = stats.m_classes[static_cast<size_t>(UploadPriority::visible_now)];
+      check(visible.m_admitted == 2u * number_of_frames, "flood: all visible_now uploads admitted");
+      // Requested halfway a frame, admitted at the start of the next.
+      check(visible.m_max_latency <= std::chrono::duration<double>(frame_period), "flood: visible_now admitted within one frame");
+    }
+
+    // The measured throughput is conservative, but in the right ballpark.
+    check(stats.m_throughput > 0.5 * bandwidth && stats.m_throughput <= 1.01 * bandwidth, "flood: throughput measured");
+    // The frame budget is limited by the time budget: 2 ms at ~1 GiB/s.
+    check(stats.m_frame_budget < 2.5 * MiB && stats.m_frame_budget > 0.9 * MiB, "flood: frame budget follows the time budget");
+
+    // After the first few frames (before the throughput is known) the lower priority classes stay within the budget,
+    // plus at most one upload of overdraft.
+    size_t max_non_visible = 0;
+    for (auto [dispatch_frame, bytes] : non_visible_bytes_per_dispatch)
+      if (dispatch_frame > 10)
+        max_non_visible = std::max(max_non_visible, bytes);
+    check(max_non_visible <= stats.m_frame_budget + 4 * MiB, "flood: prefetch and background stay within the budget");
+
+    // Because the transfer queue isn't flooded, visible_now uploads also complete quickly.
+    clock_type::duration max_visible_completion{};
+    for (auto const& upload : done)
+      if (upload->m_priority == UploadPriority::visible_now && upload->m_enqueued > start + 20 * frame_period)
+        max_visible_completion = std::max(max_visible_completion, upload->m_completed - upload->m_enqueued);
+    std::cout << "Max visible_now completion latency: " << std::chrono::duration<double, std::milli>(max_visible_completion).count() << " ms" << std::endl;
+    check(max_visible_completion <= 2 * frame_period, "flood: visible_now uploads complete within two frames");
+
+    check(prefetch_in_order, "flood: first in first out within a class");
+
+    // Background uploads are promoted and make progress during the flood; after the flood everything drains eventually.
+    auto const& background = stats.m_classes[static_cast<size_t>(UploadPriority::background)];
+    check(background.m_admitted > 0, "flood: background uploads are not starved");
+    check(background.m_max_latency >= std::chrono::duration<double>(budget.m_max_background_wait), "flood: background uploads were promoted");
+  }
+
+  // An upload larger than the whole budget is still admitted.
+  {
+    UploadBudget small_budget = budget;
+    small_budget.m_bytes_per_frame = 1 * MiB;
+    UploadScheduler scheduler(small_budget);
+    clock_type::time_point const start = clock_type::now();
+    bool admitted = false;
+    scheduler.enqueue(8 * MiB, UploadPriority::background, [&](uint64_t){ admitted = true; }, start);
+    bool const left = scheduler.dispatch(start);
+    check(admitted && !left, "large upload admitted");
+    // The debt of 7 MiB is paid off first: the next prefetch upload is admitted in the eighth frame.
+    int frames = 0;
+    admitted = false;
+    scheduler.enqueue(64 * KiB, UploadPriority::prefetch, [&](uint64_t){ admitted = true; }, start);
+    while (!admitted && frames < 100)
+      scheduler.dispatch(start + ++frames * std::chrono::duration_cast<clock_type::duration>(small_budget.m_frame_period));
+    check(frames == 8, "debt paid off before admitting more");
+  }
+
+  // Dispatching more often doesn't increase the budget.
+  {
+    UploadBudget small_budget = budget;
+    small_budget.m_bytes_per_frame = 1 * MiB;
+    UploadScheduler scheduler(small_budget);
+    clock_type::time_point const start = clock_type::now();
+    size_t admitted_bytes = 0;
+    for (int i = 0; i < 400; ++i)
+      scheduler.enqueue(64 * KiB, UploadPriority::prefetch, [&](uint64_t){ admitted_bytes += 64 * KiB; }, start);
+    // Ten frames, with a dispatch every millisecond.
+    for (int ms = 0; ms <= 167; ++ms)
+      scheduler.dispatch(start + ms * 1ms);
+    // The initial budget plus 167 ms worth (10.02 MiB), plus the overdraft of a single upload: the debt is paid off before the next one.
+    check(admitted_bytes <= 11 * MiB + 21 * KiB + 64 * KiB && admitted_bytes >= 10 * MiB, "frequent dispatch: budget is a rate");
+    check(scheduler.queue_depth() == 400 - admitted_bytes / (64 * KiB), "frequent dispatch: queue depth");
+  }
+
+  // The reserved background share is used even when prefetch uploads would take the whole budget (and are never promoted).
+  {
+    UploadBudget reserve_budget = budget;
+    reserve_budget.m_bytes_per_frame = 1 * MiB;
+    reserve_budget.m_max_background_wait = 3600s;
+    UploadScheduler scheduler(reserve_budget);
+    clock_type::time_point const start = clock_type::now();
+    size_t background_bytes = 0;
+    auto const frame_period = std::chrono::duration_cast<clock_type::duration>(reserve_budget.m_frame_period);
+    for (int frame = 0; frame < 100; ++frame)
+    {
+      clock_type::time_point const now = start + frame * frame_period;
+      for (int i = 0; i < 16; ++i)
+        scheduler.enqueue(64 * KiB, UploadPriority::prefetch, [](uint64_t){}, now);
+      for (int i = 0; i < 2; ++i)
+        scheduler.enqueue(64 * KiB, UploadPriority::background, [&](uint64_t){ background_bytes += 64 * KiB; }, now);
+      scheduler.dispatch(now);
+    }
+    // 10% of 100 frames of 1 MiB (while 128 kiB is requested per frame), within one upload.
+    check(background_bytes >= 10 * MiB - 64 * KiB && background_bytes <= 10 * MiB + 64 * KiB, "reserve: background uploads get their share");
+  }
+
+  return checks_result();
+}
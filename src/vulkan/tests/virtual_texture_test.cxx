@@ -0,0 +1,316 @@
+#include "sys.h"
+#include "memory/VirtualTexturePageTable.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <random>
+#include <set>
+#include <tuple>
+#include <vector>
+#include "check.h"
+#include "debug.h"
+
+using namespace vulkan;
+using memory::VirtualTexturePageTable;
+using PageId = VirtualTexturePageTable::PageId;
+using Entry = VirtualTexturePageTable::Entry;
+
+namespace {
+
+// A page table together with what its callbacks told about it: which page is (being loaded) in which slot.
+// Loads finish m_load_latency calls of step() after they were requested. Each step() is a frame, that
+// retires m_frames_in_flight steps later.
+struct Harness
+{
+  struct PendingLoad
+  {
+    PageId m_page;
+    int m_done;
+  };
+
+  std::map<VirtualTexturePageTable::slot_type, PageId> m_slots;
+  std::map<VirtualTexturePageTable::slot_type, VirtualTexturePageTable::frame_type> m_evicted_in;     // The frame in which each slot was last evicted.
+  std::vector<PendingLoad> m_pending;
+  int m_load_latency;
+  int m_frames_in_flight;
+  int m_step = 0;
+  VirtualTexturePageTable::frame_type m_retired = 0;
+  bool m_slots_reused_after_eviction = true;
+  bool m_slots_reused_after_retirement = true;
+  VirtualTexturePageTable m_table;
+
+  Harness(vk::Extent2D extent, uint32_t number_of_slots, int load_latency = 0, size_t max_loads_in_flight = 32, int frames_in_flight = 0) :
+    m_load_latency(load_latency),
+    m_frames_in_flight(frames_in_flight),
+    m_table(extent, number_of_slots,
+        [this](VirtualTexturePageTable::Load const& load){
+          if (!m_slots.emplace(load.m_slot, load.m_page).second)
+            m_slots_reused_after_eviction = false;
+          auto evicted = m_evicted_in.find(load.m_slot);
+          if (evicted != m_evicted_in.end() && evicted->second > m_retired)
+            m_slots_reused_after_retirement = false;
+          m_pending.push_back({ load.m_page, m_step + m_load_latency });
+        },
+        [this](PageId page, VirtualTexturePageTable::slot_type slot){
+          auto iter = m_slots.find(slot);
+          if (iter == m_slots.end() || !(iter->second == page))
+            m_slots_reused_after_eviction = false;
+          else
+            m_slots.erase(iter);
+          m_evicted_in[slot] = frame();
+        },
+        max_loads_in_flight)
+  {
+  }
+
+  // The frame of the current step.
+  VirtualTexturePageTable::frame_type frame() const { return m_step + 1; }
+
+  // Finish the loads that are due, retire the frame of m_frames_in_flight steps ago and update.
+  void step()
+  {
+    std::erase_if(m_pending, [this](PendingLoad const& pending){
+      if (pending.m_done > m_step)
+        return false;
+      m_table.loaded(pending.m_page);
+      return true;
+    });
+    if (m_step >= m_frames_in_flight)
+    {
+      m_retired = m_step - m_frames_in_flight;
+      m_table.retire(m_retired);
+    }
+    m_table.update(frame());
+    ++m_step;
+  }
+
+  // The pages that the page table should contain: those of which the load finished before the last update.
+  std::map<VirtualTexturePageTable::slot_type, PageId> resident() const
+  {
+    std::map<VirtualTexturePageTable::slot_type, PageId> result = m_slots;
+    std::erase_if(result, [this](auto const& slot_page){
+      return std::any_of(m_pending.begin(), m_pending.end(), [&](PendingLoad const& pending){ return pending.m_page == slot_page.second; });
+    });
+    return result;
+  }
+};
+
+// Check every entry of the page table against the finest resident ancestor, computed the hard way.
+bool page_table_consistent(VirtualTexturePageTable const& table, std::map<VirtualTexturePageTable::slot_type, PageId> const& resident)
+{
+  uint32_t const level_count = table.level_count();
+  std::map<std::tuple<uint32_t, uint32_t, uint32_t>, VirtualTexturePageTable::slot_type> slot_of;
+  for (auto const& [slot, page] : resident)
+    slot_of[{ page.m_level, page.m_x, page.m_y }] = slot;
+  for (uint32_t level = 0; level < level_count; ++level)
+  {
+    vk::Extent2D const extent = table.level_extent(level);
+    for (uint32_t y = 0; y < extent.height; ++y)
+      for (uint32_t x = 0; x < extent.width; ++x)
+      {
+        Entry expected{ VirtualTexturePageTable::no_slot, level_count };
+        for (PageId page{ level, x, y };; page = page.parent())
+        {
+          auto iter = slot_of.find({ page.m_level, page.m_x, page.m_y });
+          if (iter != slot_of.end())
+          {
+            expected = { iter->second, page.m_level };
+            break;
+          }
+          if (page.m_level + 1 == level_count)
+            break;
+        }
+        if (!(table.entry({ level, x, y }) == expected))
+          return false;
+      }
+  }
+  return true;
+}
+
+} // namespace
+
+int main()
+{
+  Debug(NAMESPACE_DEBUG::init());
+
+  // Feedback encoding.
+  {
+    bool round_trip = true;
+    for (PageId page : { PageId{ 0, 0, 0 }, PageId{ 3, 1234, 567 }, PageId{ 14, 0x3fff, 0x3fff } })
+      round_trip = round_trip && VirtualTexturePageTable::decode(VirtualTexturePageTable::encode(page)) == page;
+    check(round_trip, "encode and decode are each other's inverse");
+    check(VirtualTexturePageTable::decode(VirtualTexturePageTable::no_feedback).m_level >= VirtualTexturePageTable::max_levels,
+        "no_feedback doesn't encode a page");
+  }
+
+  // Levels, and the coarsest level being loaded first.
+  {
+    std::vector<VirtualTexturePageTable::Load> loads;
+    VirtualTexturePageTable table({ 8, 8 }, 16, [&](VirtualTexturePageTable::Load const& load){ loads.push_back(load); }, [](PageId, uint32_t){});
+    check(table.level_count() == 4, "8x8 pages have four levels");
+    check(table.level_extent(1) == vk::Extent2D{ 4, 4 } && table.level_extent(3) == vk::Extent2D{ 1, 1 }, "level extents halve");
+    check(table.entry({ 0, 3, 5 }) == Entry{ VirtualTexturePageTable::no_slot, 4 }, "nothing resident initially");
+
+    table.update(1);
+    check(loads.size() == 1 && loads[0].m_page == PageId{ 3, 0, 0 } && loads[0].m_slot == 0, "the coarsest page is loaded without feedback");
+    std::vector<VirtualTexturePageTable::IndirectionUpdate> updates = table.take_indirection_updates();
+    check(updates.size() == 4 && updates[0].m_rect.extent == vk::Extent2D{ 8, 8 } && updates[0].m_entries.size() == 64,
+        "the first indirection update covers the whole table");
+
+    table.loaded(loads[0].m_page);
+    check(table.entry({ 0, 7, 7 }) == Entry{ VirtualTexturePageTable::no_slot, 4 }, "loaded pages are mapped by update()");
+    table.update(2);
+    check(table.entry({ 0, 7, 7 }) == Entry{ 0, 3 } && table.entry({ 2, 1, 0 }) == Entry{ 0, 3 }, "everything falls back to the coarsest page");
+    updates = table.take_indirection_updates();
+    check(updates.size() == 4 && updates[0].m_entries[63] == Entry{ 0, 3 }, "mapping the coarsest page changes every level");
+    check(table.take_indirection_updates().empty(), "updates are only returned once");
+
+    // Request a fine page: its ancestors are loaded too, coarse first.
+    loads.clear();
+    table.use({ 0, 5, 6 }, 1);
+    table.update(3);
+    check(loads.size() == 3 && loads[0].m_page == PageId{ 2, 1, 1 } && loads[1].m_page == PageId{ 1, 2, 3 } && loads[2].m_page == PageId{ 0, 5, 6 },
+        "ancestors are loaded first");
+    for (auto const& load : loads)
+      table.loaded(load.m_page);
+    table.update(4);
+    check(table.entry({ 0, 5, 6 }) == Entry{ loads[2].m_slot, 0 }, "a resident page maps to itself");
+    check(table.entry({ 0, 4, 6 }) == Entry{ loads[1].m_slot, 1 }, "a sibling falls back to the parent");
+    check(table.entry({ 0, 7, 7 }) == Entry{ loads[0].m_slot, 2 }, "a cousin falls back to the grandparent");
+    check(table.entry({ 0, 0, 0 }) == Entry{ 0, 3 }, "other pages still fall back to the coarsest page");
+    updates = table.take_indirection_updates();
+    check(updates.size() == 3 && updates[0].m_level == 0 && updates[0].m_rect == vk::Rect2D{ { 4, 4 }, { 4, 4 } },
+        "only the subtree of the loaded pages is updated");
+
+    // Invalid feedback is ignored.
+    std::vector<uint32_t> const feedback = { VirtualTexturePageTable::no_feedback, VirtualTexturePageTable::encode({ 0, 8, 0 }),
+      VirtualTexturePageTable::encode({ 4, 0, 0 }), VirtualTexturePageTable::encode({ 0, 5, 6 }) };
+    table.process_feedback(2, feedback);
+    VirtualTexturePageTable::Stats const stats = table.stats();
+    check(stats.m_feedback_entries == 3 && stats.m_invalid_feedback == 2, "cleared feedback isn't counted and invalid feedback is");
+  }
+
+  // LRU replacement.
+  {
+    Harness harness({ 8, 8 }, 4);
+    harness.step();
+    // One slot for the coarsest page and three for the chain of one page of level 0.
+    PageId const a{ 0, 0, 0 };
+    PageId const b{ 0, 7, 7 };
+    harness.m_table.use(a, 1);
+    harness.step();
+    harness.step();
+    check(harness.m_table.entry(a).m_level == 0, "page a is resident");
+
+    harness.m_table.use(b, 2);
+    harness.step();
+    check(harness.m_table.stats().m_evictions == 3, "the chain of a is evicted for the chain of b");
+    check(harness.m_table.entry(a) == Entry{ 0, 3 }, "evicted pages fall back to the coarsest page");
+    check(harness.m_table.stats().m_quarantined_slots == 3 && harness.m_table.stats().m_loading_pages == 0,
+        "evicted slots are not reused before their frame retired");
+    harness.step();
+    check(harness.m_table.stats().m_quarantined_slots == 0 && harness.m_table.stats().m_loading_pages == 3,
+        "retired slots are reused for the requests that waited for them");
+    check(harness.m_table.stats().m_starved_loads == 0, "waiting for a quarantined slot isn't starving");
+    harness.step();
+    check(harness.m_table.entry(b).m_level == 0, "page b is resident");
+
+    // Both pages are used in the same frame; there is only room for one of them.
+    harness.m_table.use(a, 3);
+    harness.m_table.use(b, 3);
+    harness.step();
+    check(harness.m_table.stats().m_evictions == 3 && harness.m_table.stats().m_starved_loads > 0, "pages in use are not evicted");
+    check(harness.m_table.entry(b).m_level == 0, "page b stays resident");
+
+    // Only b's chain is in use; replacing it keeps its coarser pages the longest.
+    harness.m_table.use({ 0, 6, 7 }, 4);
+    harness.step();
+    harness.step();
+    harness.step();
+    check(harness.m_table.entry({ 0, 6, 7 }).m_level == 0 && harness.m_table.entry(b).m_level == 1, "the least recently used page is evicted");
+    check(harness.m_slots_reused_after_eviction, "slots are only reused after they were evicted");
+    check(harness.m_slots_reused_after_retirement, "slots are only reused after the frame that evicted them retired");
+  }
+
+  // Failed loads.
+  {
+    std::vector<VirtualTexturePageTable::Load> loads;
+    VirtualTexturePageTable table({ 1, 1 }, 2, [&](VirtualTexturePageTable::Load const& load){ loads.push_back(load); }, [](PageId, uint32_t){});
+    table.update(1);
+    table.loaded(loads[0].m_page, false);
+    table.update(2);
+    check(loads.size() == 2 && loads[1].m_page == PageId{ 0, 0, 0 }, "a failed load of the coarsest level is retried");
+    check(table.entry({ 0, 0, 0 }).m_slot == VirtualTexturePageTable::no_slot && table.stats().m_failed_loads == 1, "a failed load isn't mapped");
+  }
+
+  // A camera moving over a texture with an extent that isn't a power of two, with loads that take a few frames.
+  {
+    Harness harness({ 37, 23 }, 48, 2, 8, 2);
+    std::mt19937 rng(42);
+    uint32_t const level_count = harness.m_table.level_count();
+    bool consistent = true;
+    bool slots_unique = true;
+    double cx = 0.0, cy = 0.0;
+    std::vector<uint32_t> feedback;
+    for (uint64_t frame = 1; frame <= 400; ++frame)
+    {
+      // The camera sees a disk of pages; the further away, the coarser.
+      cx = std::fmod(cx + 0.37, 37.0);
+      cy = 11.0 + 10.0 * std::sin(frame * 0.05);
+      feedback.assign(256, VirtualTexturePageTable::no_feedback);
+      for (uint32_t& value : feedback)
+      {
+        if (rng() % 8 == 0)
+          continue;                             // A pixel that didn't sample the texture.
+        double const angle = std::uniform_real_distribution<double>(0.0, 6.2832)(rng);
+        double const distance = std::uniform_real_distribution<double>(0.0, 12.0)(rng);
+        int const x = static_cast<int>(cx + distance * std::cos(angle));
+        int const y = static_cast<int>(cy + distance * std::sin(angle));
+        uint32_t const level = std::min(level_count - 1, static_cast<uint32_t>(distance / 4.0));
+        if (x < 0 || y < 0)
+          continue;
+        value = VirtualTexturePageTable::encode({ level, static_cast<uint32_t>(x) >> level, static_cast<uint32_t>(y) >> level });
+      }
+      harness.m_table.process_feedback(frame, feedback);
+      harness.step();
+
+      std::map<VirtualTexturePageTable::slot_type, PageId> const resident = harness.resident();
+      consistent = consistent && page_table_consistent(harness.m_table, resident);
+      std::set<std::tuple<uint32_t, uint32_t, uint32_t>> pages;
+      for (auto const& [slot, page] : resident)
+        slots_unique = slots_unique && pages.insert({ page.m_level, page.m_x, page.m_y }).second;
+    }
+    VirtualTexturePageTable::Stats const stats = harness.m_table.stats();
+    check(consistent, "every entry is the finest resident ancestor");
+    check(slots_unique, "no page is resident twice");
+    check(stats.m_resident_pages + stats.m_loading_pages + stats.m_quarantined_slots <= 48, "at most one page per slot");
+    check(harness.m_slots_reused_after_eviction && harness.m_slots_reused_after_retirement, "evicted slots are reused only after their frame retired");
+    check(stats.m_evictions > 0 && stats.m_invalid_feedback > 0, "the camera caused evictions and invalid feedback");
+    std::cout << "Camera simulation: "; stats.print_on(std::cout);
+  }
+
+  // Feedback processing speed.
+  {
+    VirtualTexturePageTable table({ 256, 256 }, 1024, [](VirtualTexturePageTable::Load const&){}, [](PageId, uint32_t){});
+    std::mt19937 rng(1);
+    std::vector<uint32_t> feedback(1 << 20);
+    for (uint32_t& value : feedback)
+    {
+      uint32_t const level = rng() % 4;
+      value = VirtualTexturePageTable::encode({ level, static_cast<uint32_t>(64 + rng() % 64) >> level, static_cast<uint32_t>(64 + rng() % 64) >> level });
+    }
+    auto const start = std::chrono::steady_clock::now();
+    for (uint64_t frame = 1; frame <= 8; ++frame)
+    {
+      table.process_feedback(frame, feedback);
+      table.update(frame);
+    }
+    double const ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Processing 8 frames of " << feedback.size() << " feedback entries took " << ms << " ms." << std::endl;
+    check(table.stats().m_feedback_entries == 8 * feedback.size(), "all feedback was processed");
+  }
+
+  return checks_result();
+}
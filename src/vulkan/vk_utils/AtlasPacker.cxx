@@ -0,0 +1,339 @@
+#include "sys.h"
+#include "AtlasPacker.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include "debug.h"
+
+namespace vk_utils {
+
+SkylinePacker::SkylinePacker(vk::Extent2D extent) : m_extent(extent)
+{
+  reset();
+}
+
+void SkylinePacker::reset()
+{
+  m_skyline.assign(1, { 0, 0, m_extent.width });
+  m_used_area = 0;
+}
+
+std::optional<uint32_t> SkylinePacker::fit(size_t index, uint32_t width, uint32_t height) const
+{
+  uint32_t const x = m_skyline[index].m_x;
+  if (x + width > m_extent.width)
+    return std::nullopt;
+  uint32_t y = 0;
+  for (uint32_t covered = 0; covered < width; covered += m_skyline[index++].m_width)
+  {
+    y = std::max(y, m_skyline[index].m_y);
+    if (y + height > m_extent.height)
+      return std::nullopt;
+  }
+  return y;
+}
+
+std::optional<vk::Offset2D> SkylinePacker::insert(vk::Extent2D extent)
+{
+  ASSERT(extent.width > 0 && extent.height > 0);
+  size_t best_index = m_skyline.size();
+  uint32_t best_top = std::numeric_limits<uint32_t>::max();
+  uint32_t best_width = std::numeric_limits<uint32_t>::max();
+  uint32_t best_y = 0;
+  for (size_t index = 0; index < m_skyline.size(); ++index)
+  {
+    std::optional<uint32_t> y = fit(index, extent.width, extent.height);
+    if (!y)
+      continue;
+    uint32_t const top = *y + extent.height;
+    if (top < best_top || (top == best_top && m_skyline[index].m_width < best_width))
+    {
+      best_index = index;
+      best_top = top;
+      best_width = m_skyline[index].m_width;
+      best_y = *y;
+    }
+  }
+  if (best_index == m_skyline.size())
+    return std::nullopt;
+
+  // Put a new segment on top of the rectangle and cut away the part of the segments below it.
+  uint32_t const x = m_skyline[best_index].m_x;
+  uint32_t const right = x + extent.width;
+  m_skyline.insert(m_skyline.begin() + best_index, { x, best_top, extent.width });
+  size_t index = best_index + 1;
+  while (index < m_skyline.size() && m_skyline[index].m_x < right)
+  {
+    Segment& segment = m_skyline[index];
+    uint32_t const shrink = right - segment.m_x;
+    if (shrink < segment.m_width)
+    {
+      segment.m_x += shrink;
+      segment.m_width -= shrink;
+      break;
+    }
+    m_skyline.erase(m_skyline.begin() + index);
+  }
+  // Merge neighbouring segments of the same height.
+  for (index = std::max(best_index, size_t{1}); index < m_skyline.size() && index <= best_index + 1;)
+  {
+    if (m_skyline[index - 1].m_y == m_skyline[index].m_y)
+    {
+      m_skyline[index - 1].m_width += m_skyline[index].m_width;
+      m_skyline.erase(m_skyline.begin() + index);
+    }
+    else
+      ++index;
+  }
+
+  m_used_area += uint64_t{extent.width} * extent.height;
+  return vk::Offset2D{ static_cast<int32_t>(x), static_cast<int32_t>(best_y) };
+}
+
+AtlasPacker::AtlasPacker(vk::Extent2D layer_extent, uint32_t max_layers, uint32_t padding, uint32_t texel_size) :
+  m_layer_extent(layer_extent), m_max_layers(max_layers), m_padding(padding), m_texel_size(texel_size)
+{
+  DoutEntering(dc::vulkan, "AtlasPacker::AtlasPacker(" << layer_extent << ", " << max_layers << ", " << padding << ", " << texel_size << ")");
+  ASSERT(layer_extent.width > 2 * padding && layer_extent.height > 2 * padding && max_layers > 0 && texel_size > 0);
+}
+
+vk::Rect2D AtlasPacker::padded_rect(vk::Rect2D const& rect) const
+{
+  return { { rect.offset.x - static_cast<int32_t>(m_padding), rect.offset.y - static_cast<int32_t>(m_padding) },
+           { rect.extent.width + 2 * m_padding, rect.extent.height + 2 * m_padding } };
+}
+
+std::optional<AtlasPacker::Placement> AtlasPacker::pack(vk::Extent2D extent)
+{
+  vk::Extent2D const padded_extent{ extent.width + 2 * m_padding, extent.height + 2 * m_padding };
+  for (;;)
+  {
+    for (uint32_t layer = 0; layer < m_layers.size(); ++layer)
+      if (std::optional<vk::Offset2D> offset = m_layers[layer].m_packer.insert(padded_extent))
+        return Placement{ layer, { { offset->x + static_cast<int32_t>(m_padding), offset->y + static_cast<int32_t>(m_padding) }, extent } };
+    if (m_layers.size() == m_max_layers)
+      return std::nullopt;
+    m_layers.emplace_back(m_layer_extent, m_texel_size);
+  }
+}
+
+void AtlasPacker::write_pixels(Placement const& placement, std::span<std::byte const> pixels)
+{
+  vk::Extent2D const extent = placement.m_rect.extent;
+  // pixels must contain the whole image.
+  ASSERT(pixels.size() == size_t{extent.width} * extent.height * m_texel_size);
+  vk::Rect2D const padded = padded_rect(placement.m_rect);
+  std::byte* const layer_pixels = m_layers[placement.m_layer].m_pixels.data();
+  size_t const row_size = size_t{extent.width} * m_texel_size;
+  for (uint32_t py = 0; py < padded.extent.height; ++py)
+  {
+    // The gutter repeats the edge texels.
+    uint32_t const y = std::clamp<int64_t>(int64_t{py} - m_padding, 0, extent.height - 1);
+    std::byte const* src = pixels.data() + y * row_size;
+    std::byte* dst = layer_pixels + ((static_cast<size_t>(padded.offset.y) + py) * m_layer_extent.width + padded.offset.x) * m_texel_size;
+    for (uint32_t i = 0; i < m_padding; ++i, dst += m_texel_size)
+      std::memcpy(dst, src, m_texel_size);
+    std::memcpy(dst, src, row_size);
+    dst += row_size;
+    for (uint32_t i = 0; i < m_padding; ++i, dst += m_texel_size)
+      std::memcpy(dst, src + row_size - m_texel_size, m_texel_size);
+  }
+  m_layers[placement.m_layer].m_dirty.push_back(padded);
+}
+
+std::optional<AtlasPacker::id_type> AtlasPacker::insert(vk::Extent2D extent, std::span<std::byte const> pixels)
+{
+  ASSERT(extent.width > 0 && extent.height > 0);
+  uint64_t const padded_area = uint64_t{extent.width + 2 * m_padding} * (extent.height + 2 * m_padding);
+  if (extent.width + 2 * m_padding > m_layer_extent.width || extent.height + 2 * m_padding > m_layer_extent.height)
+    return std::nullopt;
+
+  std::optional<Placement> placement = pack(extent);
+  // Reclaim the space of removed images if that might make room.
+  if (!placement && m_stats.m_garbage_area >= padded_area && defragment())
+    placement = pack(extent);
+  if (!placement)
+    return std::nullopt;
+
+  id_type id;
+  if (m_free_ids.empty())
+  {
+    id = m_entries.size();
+    m_entries.emplace_back();
+  }
+  else
+  {
+    id = m_free_ids.back();
+    m_free_ids.pop_back();
+  }
+  m_entries[id] = { *placement, true };
+  write_pixels(*placement, pixels);
+  ++m_stats.m_images;
+  m_stats.m_image_area += uint64_t{extent.width} * extent.height;
+  m_stats.m_packed_area += padded_area;
+  return id;
+}
+
+void AtlasPacker::update(id_type id, std::span<std::byte const> pixels)
+{
+  // id must be in use.
+  ASSERT(id < m_entries.size() && m_entries[id].m_in_use);
+  write_pixels(m_entries[id].m_placement, pixels);
+}
+
+void AtlasPacker::erase(id_type id)
+{
+  // id must be in use.
+  ASSERT(id < m_entries.size() && m_entries[id].m_in_use);
+  Entry& entry = m_entries[id];
+  vk::Rect2D const padded = padded_rect(entry.m_placement.m_rect);
+  uint64_t const padded_area = uint64_t{padded.extent.width} * padded.extent.height;
+  entry.m_in_use = false;
+  m_free_ids.push_back(id);
+  --m_stats.m_images;
+  m_stats.m_image_area -= uint64_t{entry.m_placement.m_rect.extent.width} * entry.m_placement.m_rect.extent.height;
+  m_stats.m_packed_area -= padded_area;
+  m_stats.m_garbage_area += padded_area;
+}
+
+bool AtlasPacker::defragment()
+{
+  DoutEntering(dc::vulkan, "AtlasPacker::defragment()");
+
+  std::vector<id_type> ids;
+  for (id_type id = 0; id < m_entries.size(); ++id)
+    if (m_entries[id].m_in_use)
+      ids.push_back(id);
+  // Tallest first, then widest first.
+  std::sort(ids.begin(), ids.end(), [this](id_type lhs, id_type rhs){
+    vk::Extent2D const& l = m_entries[lhs].m_placement.m_rect.extent;
+    vk::Extent2D const& r = m_entries[rhs].m_placement.m_rect.extent;
+    return l.height != r.height ? l.height > r.height : l.width > r.width;
+  });
+
+  std::vector<Layer> old_layers = std::move(m_layers);
+  m_layers.clear();
+  std::vector<Placement> placements;
+  placements.reserve(ids.size());
+  for (id_type id : ids)
+  {
+    std::optional<Placement> placement = pack(m_entries[id].m_placement.m_rect.extent);
+    if (!placement)
+    {
+      Dout(dc::warning, "AtlasPacker::defragment: the images don't fit anymore.");
+      m_layers = std::move(old_layers);
+      return false;
+    }
+    placements.push_back(*placement);
+  }
+
+  // Regions that were changed and not uploaded yet stay dirty, in case they didn't move.
+  for (uint32_t layer = 0; layer < m_layers.size() && layer < old_layers.size(); ++layer)
+    m_layers[layer].m_dirty = std::move(old_layers[layer].m_dirty);
+
+  uint64_t moved = 0;
+  for (size_t i = 0; i < ids.size(); ++i)
+  {
+    Placement& placement = m_entries[ids[i]].m_placement;
+    Placement const& new_placement = placements[i];
+    vk::Rect2D const src = padded_rect(placement.m_rect);
+    vk::Rect2D const dst = padded_rect(new_placement.m_rect);
+    size_t const row_size = size_t{src.extent.width} * m_texel_size;
+    std::byte const* src_pixels = old_layers[placement.m_layer].m_pixels.data();
+    std::byte* dst_pixels = m_layers[new_placement.m_layer].m_pixels.data();
+    for (uint32_t y = 0; y < src.extent.height; ++y)
+      std::memcpy(dst_pixels + ((static_cast<size_t>(dst.offset.y) + y) * m_layer_extent.width + dst.offset.x) * m_texel_size,
+          src_pixels + ((static_cast<size_t>(src.offset.y) + y) * m_layer_extent.width + src.offset.x) * m_texel_size, row_size);
+    if (placement.m_layer != new_placement.m_layer || placement.m_rect.offset != new_placement.m_rect.offset)
+    {
+      m_layers[new_placement.m_layer].m_dirty.push_back(dst);
+      ++moved;
+    }
+    placement = new_placement;
+  }
+
+  ++m_generation;
+  ++m_stats.m_defragmentations;
+  m_stats.m_moved_images += moved;
+  m_stats.m_garbage_area = 0;
+  Dout(dc::vulkan, "Moved " << moved << " of " << ids.size() << " images; " << m_layers.size() << " layers are in use.");
+  return true;
+}
+
+AtlasPacker::UVRect AtlasPacker::uv(id_type id) const
+{
+  // id must be in use.
+  ASSERT(id < m_entries.size() && m_entries[id].m_in_use);
+  vk::Rect2D const& rect = m_entries[id].m_placement.m_rect;
+  float const width = m_layer_extent.width;
+  float const height = m_layer_extent.height;
+  return { rect.offset.x / width, rect.offset.y / height,
+           (rect.offset.x + rect.extent.width) / width, (rect.offset.y + rect.extent.height) / height,
+           m_entries[id].m_placement.m_layer };
+}
+
+std::vector<AtlasPacker::Region> AtlasPacker::take_dirty_regions()
+{
+  std::vector<Region> regions;
+  for (uint32_t layer = 0; layer < m_layers.size(); ++layer)
+  {
+    std::vector<vk::Rect2D>& dirty = m_layers[layer].m_dirty;
+    if (dirty.empty())
+      continue;
+    int32_t x0 = dirty[0].offset.x, y0 = dirty[0].offset.y, x1 = x0, y1 = y0;
+    uint64_t area = 0;
+    for (vk::Rect2D const& rect : dirty)
+    {
+      x0 = std::min(x0, rect.offset.x);
+      y0 = std::min(y0, rect.offset.y);
+      x1 = std::max(x1, rect.offset.x + static_cast<int32_t>(rect.extent.width));
+      y1 = std::max(y1, rect.offset.y + static_cast<int32_t>(rect.extent.height));
+      area += uint64_t{rect.extent.width} * rect.extent.height;
+    }
+    uint64_t const bounding_area = uint64_t(x1 - x0) * (y1 - y0);
+    // Upload the bounding box if there are many small regions, or if they cover most of it anyway.
+    if (dirty.size() > s_max_regions_per_layer || 2 * area >= bounding_area)
+      regions.push_back({ layer, { { x0, y0 }, { static_cast<uint32_t>(x1 - x0), static_cast<uint32_t>(y1 - y0) } } });
+    else
+      for (vk::Rect2D const& rect : dirty)
+        regions.push_back({ layer, rect });
+    dirty.clear();
+  }
+  return regions;
+}
+
+void AtlasPacker::mark_all_dirty()
+{
+  for (Layer& layer : m_layers)
+  {
+    layer.m_dirty.clear();
+    layer.m_dirty.push_back({ {}, m_layer_extent });
+  }
+}
+
+std::vector<std::byte> AtlasPacker::region_pixels(Region const& region) const
+{
+  vk::Rect2D const& rect = region.m_rect;
+  size_t const row_size = size_t{rect.extent.width} * m_texel_size;
+  std::vector<std::byte> pixels(row_size * rect.extent.height);
+  std::byte const* src = m_layers[region.m_layer].m_pixels.data();
+  for (uint32_t y = 0; y < rect.extent.height; ++y)
+    std::memcpy(pixels.data() + y * row_size, src + ((static_cast<size_t>(rect.offset.y) + y) * m_layer_extent.width + rect.offset.x) * m_texel_size, row_size);
+  return pixels;
+}
+
+AtlasPacker::Stats AtlasPacker::stats() const
+{
+  Stats stats = m_stats;
+  stats.m_layers = m_layers.size();
+  return stats;
+}
+
+void AtlasPacker::Stats::print_on(std::ostream& os) const
+{
+  os << m_images << " images in " << m_layers << " layers; image area: " << m_image_area << ", packed area: " << m_packed_area <<
+    ", garbage area: " << m_garbage_area << "; " << m_defragmentations << " defragmentations moved " << m_moved_images << " images";
+}
+
+} // namespace vk_utils
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <vulkan/vulkan.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace vk_utils {
+
+// SkylinePacker
+//
+// Packs rectangles into a bin of a fixed size, using the skyline bottom-left heuristic: the top edge
+// of everything that was packed so far is kept as a list of horizontal segments (the skyline), and
+// every rectangle is placed on top of it where its top edge ends up lowest (the narrowest fitting
+// segment on a tie). Space below the skyline that isn't covered is lost until reset().
+//
+class SkylinePacker
+{
+ private:
+  struct Segment
+  {
+    uint32_t m_x;
+    uint32_t m_y;                               // The height of the skyline over [m_x, m_x + m_width).
+    uint32_t m_width;
+  };
+
+  vk::Extent2D m_extent;
+  std::vector<Segment> m_skyline;               // Ordered by m_x, covering [0, m_extent.width) without gaps.
+  uint64_t m_used_area = 0;                     // The total area of the packed rectangles.
+
+ public:
+  SkylinePacker(vk::Extent2D extent);
+
+  // Return the position of a rectangle of size extent, or nullopt if it doesn't fit anymore.
+  std::optional<vk::Offset2D> insert(vk::Extent2D extent);
+
+  // Forget all packed rectangles.
+  void reset();
+
+  vk::Extent2D extent() const { return m_extent; }
+  uint64_t used_area() const { return m_used_area; }
+  // The fraction of the bin that is covered by packed rectangles.
+  double occupancy() const { return static_cast<double>(m_used_area) / (uint64_t{m_extent.width} * m_extent.height); }
+
+ private:
+  // If a rectangle of width `width` fits on top of the skyline starting at segment `index`, return the y coordinate that it gets.
+  std::optional<uint32_t> fit(size_t index, uint32_t width, uint32_t height) const;
+};
+
+// AtlasPacker
+//
+// The CPU side of a texture atlas (see vulkan::TextureAtlas): packs small images into the layers of
+// an array texture and keeps a copy of the pixels of every layer, so that only the changed regions
+// have to be uploaded.
+//
+// Every image is surrounded by a gutter of m_padding texels that repeats its edge texels, so that
+// linear filtering near the edge of an image doesn't pick up its neighbours. The UV rectangle that
+// is returned by uv() covers the image itself.
+//
+// Images can be added and removed in any order. The space of removed images is only reclaimed by
+// defragment(), which repacks all images (tallest first) and therefore moves them: their ids stay
+// the same but their placement changes, which is reflected by generation(). insert() defragments by
+// itself when an image doesn't fit while enough space was freed by removals.
+//
+// Changes are recorded as dirty regions; take_dirty_regions() returns them (merged where that is
+// cheaper to upload) and region_pixels() returns the pixels of a region.
+//
+class AtlasPacker
+{
+ public:
+  using id_type = uint32_t;
+
+  // The place of an image in the atlas.
+  struct Placement
+  {
+    uint32_t m_layer;
+    vk::Rect2D m_rect;                          // Without the gutter.
+  };
+
+  // A texture coordinate rectangle.
+  struct UVRect
+  {
+    float m_u0;
+    float m_v0;
+    float m_u1;
+    float m_v1;
+    uint32_t m_layer;
+  };
+
+  // A part of a layer that must be uploaded.
+  struct Region
+  {
+    uint32_t m_layer;
+    vk::Rect2D m_rect;
+  };
+
+  struct Stats
+  {
+    uint32_t m_layers = 0;                      // The number of layers that are used.
+    size_t m_images = 0;                        // The number of images in the atlas.
+    uint64_t m_image_area = 0;                  // The total number of texels of those images (without gutter).
+    uint64_t m_packed_area = 0;                 // The total area that is occupied by images and their gutter.
+    uint64_t m_garbage_area = 0;                // The area (including gutter) of removed images that wasn't reclaimed yet.
+    uint64_t m_defragmentations = 0;
+    uint64_t m_moved_images = 0;                // The total number of images moved by defragmentation.
+
+    void print_on(std::ostream& os) const;
+  };
+
+  // The maximum number of dirty regions per layer that take_dirty_regions() returns separately.
+  static constexpr size_t s_max_regions_per_layer = 32;
+
+ private:
+  struct Layer
+  {
+    SkylinePacker m_packer;
+    std::vector<std::byte> m_pixels;
+    std::vector<vk::Rect2D> m_dirty;
+
+    Layer(vk::Extent2D extent, size_t texel_size) : m_packer(extent), m_pixels(size_t{extent.width} * extent.height * texel_size) { }
+  };
+
+  struct Entry
+  {
+    Placement m_placement;
+    bool m_in_use = false;
+  };
+
+  vk::Extent2D const m_layer_extent;
+  uint32_t const m_max_layers;
+  uint32_t const m_padding;
+  uint32_t const m_texel_size;
+  std::vector<Layer> m_layers;
+  std::vector<Entry> m_entries;                 // Indexed by id.
+  std::vector<id_type> m_free_ids;
+  uint64_t m_generation = 0;
+  Stats m_stats;
+
+ public:
+  // An atlas of at most max_layers layers of layer_extent, with texel_size bytes per texel and a gutter of padding texels.
+  AtlasPacker(vk::Extent2D layer_extent, uint32_t max_layers, uint32_t padding, uint32_t texel_size);
+
+  // Add an image of size extent; pixels contains its rows without padding.
+  // Returns nullopt if it doesn't fit, even after defragmentation.
+  std::optional<id_type> insert(vk::Extent2D extent, std::span<std::byte const> pixels);
+
+  // Replace the pixels of image id (of the same size).
+  void update(id_type id, std::span<std::byte const> pixels);
+
+  // Remove image id. Its space is reclaimed by the next defragmentation.
+  void erase(id_type id);
+
+  // Repack all images. Returns false (and changes nothing) if they don't fit anymore; that can only happen
+  // when the atlas is nearly full.
+  bool defragment();
+
+  Placement placement(id_type id) const { return m_entries[id].m_placement; }
+  UVRect uv(id_type id) const;
+
+  // Incremented every time that images moved (by defragment); uv() must be called again for all images then.
+  uint64_t generation() const { return m_generation; }
+
+  // Return the regions that changed since the last call.
+  std::vector<Region> take_dirty_regions();
+  // Mark all layers completely dirty (for example, because an upload failed).
+  void mark_all_dirty();
+  // Return the pixels of region (rows without padding).
+  std::vector<std::byte> region_pixels(Region const& region) const;
+
+  vk::Extent2D layer_extent() const { return m_layer_extent; }
+  uint32_t max_layers() const { return m_max_layers; }
+  uint32_t texel_size() const { return m_texel_size; }
+  uint32_t layer_count() const { return m_layers.size(); }
+  std::vector<std::byte> const& layer_pixels(uint32_t layer) const { return m_layers[layer].m_pixels; }
+  Stats stats() const;
+
+ private:
+  // Pack an image of size extent (plus gutter) into the first layer where it fits, adding layers as needed.
+  std::optional<Placement> pack(vk::Extent2D extent);
+  // Write pixels of the image at placement into its layer, including the gutter.
+  void write_pixels(Placement const& placement, std::span<std::byte const> pixels);
+  vk::Rect2D padded_rect(vk::Rect2D const& rect) const;
+};
+
+} // namespace vk_utils
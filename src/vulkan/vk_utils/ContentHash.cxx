@@ -0,0 +1,48 @@
+#include "sys.h"
+#include "ContentHash.h"
+#include <bit>
+#include <cstring>
+#include "debug.h"
+
+namespace vk_utils {
+
+namespace {
+
+constexpr uint64_t golden_ratio = 0x9e3779b97f4a7c15;
+
+// The 64-bit finalizer of MurmurHash3.
+uint64_t mix(uint64_t k)
+{
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccd;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53;
+  k ^= k >> 33;
+  return k;
+}
+
+} // namespace
+
+uint64_t content_hash(std::span<std::byte const> data, uint64_t seed)
+{
+  uint64_t hash = seed ^ (data.size() * golden_ratio);
+  size_t const words = data.size() / sizeof(uint64_t);
+  std::byte const* ptr = data.data();
+  for (size_t i = 0; i < words; ++i, ptr += sizeof(uint64_t))
+  {
+    uint64_t word;
+    std::memcpy(&word, ptr, sizeof(uint64_t));
+    // The rotation makes the result depend on the order of the words.
+    hash = std::rotl(hash ^ mix(word), 27) * golden_ratio;
+  }
+  size_t const tail = data.size() % sizeof(uint64_t);
+  if (tail > 0)
+  {
+    uint64_t word = 0;
+    std::memcpy(&word, ptr, tail);
+    hash = std::rotl(hash ^ mix(word), 27) * golden_ratio;
+  }
+  return mix(hash);
+}
+
+} // namespace vk_utils
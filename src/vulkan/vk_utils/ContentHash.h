@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace vk_utils {
+
+// A 64-bit hash of the bytes of data, for content addressing (see ContentRegistry).
+//
+// Processes eight bytes per step with the 64-bit finalizer of MurmurHash3 as mixing function,
+// which is fast enough to hash the decoded pixels of every texture that is loaded. This is not a
+// cryptographic hash: only use it for data that comes from trusted sources.
+uint64_t content_hash(std::span<std::byte const> data, uint64_t seed = 0);
+
+} // namespace vk_utils
@@ -0,0 +1,283 @@
+#pragma once
+
+#include "threadsafe/aithreadsafe.h"
+#include <algorithm>
+#include <compare>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "debug.h"
+
+namespace vk_utils {
+
+// ContentRegistry
+//
+// Content addressed sharing of resources (for example textures): acquire() returns the resource
+// that was created before for the same key, as long as any handle to it still exists, and only
+// creates a new one otherwise. The key consists of a hash of the content (see content_hash) and
+// a hash of everything else that determines the resource (format, extent, sampler, ...).
+//
+// Creating a resource usually starts an asynchronous upload. create() is passed a `ready` callback
+// that it must call (from any thread, but not before it returned) once the resource can be used.
+// Every acquire() passes its own ready callback, which is called once the resource is ready: right
+// away by acquire() if it already was. If the creation failed the entry is removed, so that the next
+// acquire() of the same content tries again.
+//
+// create() is called while holding the lock of the registry, so that concurrent acquires of the same
+// content never create it twice. The registry must outlive the ready callbacks of the resources it created.
+//
+// A resource might still be used by frames that are in flight when its last handle is destroyed.
+// Resources that create() made with make() are therefore not destroyed by their last handle, but kept
+// by the registry until the frame during which that happened retired: the render loop calls
+// begin_frame() at the start of every frame and retire() once a frame finished on the GPU (like
+// memory::ImagePool). Destroying the registry destroys the resources that it still keeps; the GPU
+// must be done with them by then. A handle that outlives the registry destroys its resource itself.
+//
+template<typename T>
+class ContentRegistry
+{
+ public:
+  using handle_type = std::shared_ptr<T const>;
+  using ready_callback_type = std::function<void(bool success)>;
+  using frame_type = uint64_t;
+
+  struct Key
+  {
+    uint64_t m_content_hash;                    // The hash of the content.
+    uint64_t m_content_size;                    // The size of the content, in bytes.
+    uint64_t m_kind_hash;                       // The hash of everything else that determines the resource.
+
+    auto operator<=>(Key const&) const = default;
+  };
+
+  // The result of create().
+  struct Created
+  {
+    std::shared_ptr<T> m_resource;
+    uint64_t m_bytes;                           // The size of the resource, used for the statistics.
+  };
+
+  using create_type = std::function<Created(ready_callback_type ready)>;
+
+  struct Stats
+  {
+    uint64_t m_acquires = 0;                    // The number of calls to acquire().
+    uint64_t m_hits = 0;                        // The number of those that returned an existing resource.
+    uint64_t m_created_bytes = 0;               // The total size of the resources that were created.
+    uint64_t m_saved_bytes = 0;                 // The total size of the resources that were shared instead of created again.
+    uint64_t m_failures = 0;                    // The number of resources of which the creation failed.
+    size_t m_live_resources = 0;                // The number of resources that currently have handles.
+    uint64_t m_live_bytes = 0;                  // Their total size.
+    size_t m_retiring_resources = 0;            // The number of resources without handles that wait for their frame to retire.
+
+    void print_on(std::ostream& os) const
+    {
+      os << "acquires: " << m_acquires << " (" << m_hits << " hits), created: " << m_created_bytes << " bytes, saved: " <<
+        m_saved_bytes << " bytes, failures: " << m_failures << ", live: " << m_live_resources << " (" << m_live_bytes << " bytes), retiring: " <<
+        m_retiring_resources;
+    }
+  };
+
+ private:
+  struct Entry
+  {
+    std::weak_ptr<T const> m_resource;
+    uint64_t m_bytes = 0;
+    uint64_t m_generation = 0;                  // Distinguishes an entry from one that was created before for the same key.
+    bool m_ready = false;
+    std::vector<ready_callback_type> m_waiters; // The ready callbacks of the acquires of the resource before it became ready.
+  };
+
+  struct State
+  {
+    std::map<Key, Entry> m_entries;
+    uint64_t m_last_generation = 0;
+    size_t m_purge_threshold = 64;              // Expired entries are removed when the number of entries reaches this.
+    Stats m_stats;
+  };
+
+  using state_t = aithreadsafe::Wrapper<State, aithreadsafe::policy::Primitive<std::mutex>>;
+  mutable state_t m_state;
+
+  struct Retiring
+  {
+    frame_type m_current_frame = 0;
+    std::deque<std::pair<frame_type, std::unique_ptr<T>>> m_resources;  // Resources without handles, and the frame in which that happened, oldest first.
+  };
+
+  // Shared with the deleters of the resources returned by make(), which might outlive the registry.
+  using retiring_t = aithreadsafe::Wrapper<Retiring, aithreadsafe::policy::Primitive<std::mutex>>;
+  std::shared_ptr<retiring_t> m_retiring = std::make_shared<retiring_t>();
+
+ public:
+  // Return the resource for key, calling create() if there is none. Calls ready once the resource is ready (ready may be empty).
+  handle_type acquire(Key const& key, create_type const& create, ready_callback_type ready);
+
+  // Thread-safe. Construct a resource for create() to return, of which the destruction is delayed until the frame during which its last handle was destroyed retired.
+  template<typename... Args>
+  std::shared_ptr<T> make(Args&&... args);
+
+  // Resources that lose their last handle from now on might be used by frame (frame numbers must increase).
+  void begin_frame(frame_type frame);
+  // Every frame up to and including completed_frame finished on the GPU: destroy the resources that were waiting for that.
+  void retire(frame_type completed_frame);
+
+  Stats stats() const;
+
+ private:
+  void created(Key const& key, uint64_t generation, bool success);
+  static void purge(State& state);
+};
+
+template<typename T>
+typename ContentRegistry<T>::handle_type ContentRegistry<T>::acquire(Key const& key, create_type const& create, ready_callback_type ready)
+{
+  handle_type handle;
+  bool call_ready = false;
+  {
+    typename state_t::wat state_w(m_state);
+    State& state = *state_w;
+    ++state.m_stats.m_acquires;
+    auto [iter, inserted] = state.m_entries.try_emplace(key);
+    Entry& entry = iter->second;
+    if (!inserted)
+      handle = entry.m_resource.lock();
+    if (handle)
+    {
+      ++state.m_stats.m_hits;
+      state.m_stats.m_saved_bytes += entry.m_bytes;
+      if (entry.m_ready)
+        call_ready = true;
+      else if (ready)
+        entry.m_waiters.push_back(std::move(ready));
+    }
+    else
+    {
+      // There is no entry, or the last handle of its resource was destroyed.
+      entry = Entry{};
+      entry.m_generation = ++state.m_last_generation;
+      if (ready)
+        entry.m_waiters.push_back(std::move(ready));
+      Created result;
+      try
+      {
+        result = create([this, key, generation = entry.m_generation](bool success){ created(key, generation, success); });
+      }
+      catch (...)
+      {
+        state.m_entries.erase(iter);
+        throw;
+      }
+      entry.m_resource = result.m_resource;
+      entry.m_bytes = result.m_bytes;
+      state.m_stats.m_created_bytes += result.m_bytes;
+      handle = std::move(result.m_resource);
+      if (state.m_entries.size() >= state.m_purge_threshold)
+        purge(state);
+    }
+  }
+  if (call_ready)
+    ready(true);
+  return handle;
+}
+
+template<typename T>
+template<typename... Args>
+std::shared_ptr<T> ContentRegistry<T>::make(Args&&... args)
+{
+  std::unique_ptr<T> resource = std::make_unique<T>(std::forward<Args>(args)...);
+  return std::shared_ptr<T>(resource.release(), [weak_retiring = std::weak_ptr<retiring_t>(m_retiring)](T* ptr){
+    std::unique_ptr<T> resource(ptr);
+    // If the registry was destroyed, then the GPU is done with the resource and it can be destroyed right away.
+    if (std::shared_ptr<retiring_t> retiring = weak_retiring.lock())
+    {
+      typename retiring_t::wat retiring_w(*retiring);
+      retiring_w->m_resources.emplace_back(retiring_w->m_current_frame, std::move(resource));
+    }
+  });
+}
+
+template<typename T>
+void ContentRegistry<T>::begin_frame(frame_type frame)
+{
+  typename retiring_t::wat retiring_w(*m_retiring);
+  ASSERT(frame >= retiring_w->m_current_frame);
+  retiring_w->m_current_frame = frame;
+}
+
+template<typename T>
+void ContentRegistry<T>::retire(frame_type completed_frame)
+{
+  std::vector<std::unique_ptr<T>> retired;
+  {
+    typename retiring_t::wat retiring_w(*m_retiring);
+    while (!retiring_w->m_resources.empty() && retiring_w->m_resources.front().first <= completed_frame)
+    {
+      retired.push_back(std::move(retiring_w->m_resources.front().second));
+      retiring_w->m_resources.pop_front();
+    }
+  }
+  // The resources are destroyed here, without holding the lock.
+}
+
+template<typename T>
+void ContentRegistry<T>::created(Key const& key, uint64_t generation, bool success)
+{
+  std::vector<ready_callback_type> waiters;
+  {
+    typename state_t::wat state_w(m_state);
+    State& state = *state_w;
+    auto iter = state.m_entries.find(key);
+    // Ignore resources that were replaced already (all their handles were destroyed before they became ready).
+    if (iter == state.m_entries.end() || iter->second.m_generation != generation)
+      return;
+    waiters.swap(iter->second.m_waiters);
+    if (success)
+      iter->second.m_ready = true;
+    else
+    {
+      Dout(dc::warning, "ContentRegistry: failed to create the resource with content hash " << std::hex << key.m_content_hash << std::dec << ".");
+      ++state.m_stats.m_failures;
+      state.m_entries.erase(iter);
+    }
+  }
+  for (ready_callback_type const& waiter : waiters)
+    waiter(success);
+}
+
+//static
+template<typename T>
+void ContentRegistry<T>::purge(State& state)
+{
+  std::erase_if(state.m_entries, [](auto const& key_entry){ return key_entry.second.m_resource.expired(); });
+  // Amortize the cost of purging over at least as many acquires as there are live entries.
+  state.m_purge_threshold = std::max(size_t{64}, 2 * state.m_entries.size());
+}
+
+template<typename T>
+typename ContentRegistry<T>::Stats ContentRegistry<T>::stats() const
+{
+  Stats stats;
+  {
+    typename state_t::crat state_r(m_state);
+    stats = state_r->m_stats;
+    for (auto const& [key, entry] : state_r->m_entries)
+      if (!entry.m_resource.expired())
+      {
+        ++stats.m_live_resources;
+        stats.m_live_bytes += entry.m_bytes;
+      }
+  }
+  {
+    typename retiring_t::crat retiring_r(*m_retiring);
+    stats.m_retiring_resources = retiring_r->m_resources.size();
+  }
+  return stats;
+}
+
+} // namespace vk_utils
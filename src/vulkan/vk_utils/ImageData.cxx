@@ -15,8 +15,36 @@ ImageData::ImageData(std::filesystem::path const& filename, int requested_compon
 {
   DoutEntering(dc::vulkan, "ImageData::ImageData(" << filename << ", " << requested_components << ")");
 
-  auto const file_data = get_binary_file_contents(filename);
+  decode(filename, get_binary_file_contents(filename), requested_components);
+}
+
+ImageData::ImageData(std::filesystem::path const& filename, int requested_components, vulkan::AsyncFileReader& file_reader)
+{
+  DoutEntering(dc::vulkan, "ImageData::ImageData(" << filename << ", " << requested_components << ", <file_reader>)");
+
+  decode(filename, get_binary_file_contents(filename, file_reader), requested_components);
+}
+
+ImageData::ImageData(std::span<std::byte const> file_data, int requested_components)
+{
+  DoutEntering(dc::vulkan, "ImageData::ImageData(<" << file_data.size() << " bytes>, " << requested_components << ")");
+  decode(file_data, requested_components);
+}
+
+void ImageData::decode(std::filesystem::path const& filename, std::span<std::byte const> file_data, int requested_components)
+{
+  try
+  {
+    decode(file_data, requested_components);
+  }
+  catch (AIAlert::Error const& error)
+  {
+    THROW_ALERT("Could not get image data for file \"[FILENAME]\"", AIArgs("[FILENAME]", filename), error);
+  }
+}
 
+void ImageData::decode(std::span<std::byte const> file_data, int requested_components)
+{
   int width = 0, height = 0;
   m_image_data = reinterpret_cast<std::byte*>(stbi_load_from_memory(
       reinterpret_cast<stbi_uc const*>(file_data.data()), static_cast<int>(file_data.size()), &width, &height, &m_components, requested_components));
@@ -24,7 +52,7 @@ ImageData::ImageData(std::filesystem::path const& filename, int requested_compon
   m_extent = vk::Extent2D{ static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
 
   if (m_image_data == nullptr || width <= 0 || height <= 0 || m_components <= 0)
-    THROW_ALERT("Could not get image data for file \"[FILENAME]\"", AIArgs("[FILENAME]", filename));
+    THROW_ALERT("Could not decode image data: [REASON]", AIArgs("[REASON]", m_image_data ? "invalid size" : stbi_failure_reason()));
 
   m_size = width * height * (requested_components > 0 ? requested_components : m_components);
 }
@@ -4,9 +4,14 @@
 #include <vulkan/vulkan.hpp>
 #include <vector>
 #include <filesystem>
+#include <span>
 #include <cstddef>
 #include "debug.h"
 
+namespace vulkan {
+class AsyncFileReader;
+} // namespace vulkan
+
 namespace vk_utils {
 namespace stbi {
 
@@ -22,6 +27,10 @@ class ImageData
 
  public:
   ImageData(std::filesystem::path const& filename, int requested_components);
+  // Same, but read the file with file_reader.
+  ImageData(std::filesystem::path const& filename, int requested_components, vulkan::AsyncFileReader& file_reader);
+  // Decode image data that was already read from a file (for example with AsyncFileReader::read_file).
+  ImageData(std::span<std::byte const> file_data, int requested_components);
   ~ImageData();
 
   // Accessors.
@@ -37,6 +46,10 @@ class ImageData
     m_image_data = nullptr;
     return image_data;
   }
+
+ private:
+  void decode(std::span<std::byte const> file_data, int requested_components);
+  void decode(std::filesystem::path const& filename, std::span<std::byte const> file_data, int requested_components);
 };
 
 class ImageDataFeeder final : public vulkan::DataFeeder
@@ -0,0 +1,196 @@
+#include "sys.h"
+#include "IoUring.h"
+#include "utils/AIAlert.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include "debug.h"
+
+namespace vk_utils {
+
+namespace {
+
+int io_uring_setup(unsigned entries, io_uring_params* params)
+{
+  return syscall(__NR_io_uring_setup, entries, params);
+}
+
+int io_uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+  return syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+int io_uring_register(int ring_fd, unsigned opcode, void const* arg, unsigned nr_args)
+{
+  return syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+}
+
+// The kernel reads the tail of the submission queue and writes the tail of the completion queue concurrently.
+unsigned load_acquire(unsigned const* ptr)
+{
+  return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+void store_release(unsigned* ptr, unsigned value)
+{
+  __atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+}
+
+} // namespace
+
+IoUring::IoUring(unsigned entries)
+{
+  DoutEntering(dc::vulkan, "IoUring::IoUring(" << entries << ")");
+
+  m_ring_fd = io_uring_setup(entries, &m_params);
+  if (m_ring_fd < 0)
+    THROW_ALERT("io_uring_setup failed: [ERROR]", AIArgs("[ERROR]", std::strerror(errno)));
+
+  m_sq_ring_size = m_params.sq_off.array + m_params.sq_entries * sizeof(unsigned);
+  m_cq_ring_size = m_params.cq_off.cqes + m_params.cq_entries * sizeof(io_uring_cqe);
+  bool const single_mmap = m_params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap)
+    m_sq_ring_size = m_cq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+
+  m_sq_ring = mmap(nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQ_RING);
+  if (m_sq_ring == MAP_FAILED)
+  {
+    m_sq_ring = nullptr;
+    int const error = errno;
+    release();
+    THROW_ALERT("mmap of the io_uring submission queue failed: [ERROR]", AIArgs("[ERROR]", std::strerror(error)));
+  }
+  if (single_mmap)
+    m_cq_ring = m_sq_ring;
+  else
+  {
+    m_cq_ring = mmap(nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_CQ_RING);
+    if (m_cq_ring == MAP_FAILED)
+    {
+      m_cq_ring = nullptr;
+      int const error = errno;
+      release();
+      THROW_ALERT("mmap of the io_uring completion queue failed: [ERROR]", AIArgs("[ERROR]", std::strerror(error)));
+    }
+  }
+  void* sqes = mmap(nullptr, m_params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED)
+  {
+    int const error = errno;
+    release();
+    THROW_ALERT("mmap of the io_uring submission queue entries failed: [ERROR]", AIArgs("[ERROR]", std::strerror(error)));
+  }
+  m_sqes = static_cast<io_uring_sqe*>(sqes);
+
+  char* sq_ring = static_cast<char*>(m_sq_ring);
+  m_sq_head = reinterpret_cast<unsigned*>(sq_ring + m_params.sq_off.head);
+  m_sq_tail = reinterpret_cast<unsigned*>(sq_ring + m_params.sq_off.tail);
+  m_sq_mask = *reinterpret_cast<unsigned*>(sq_ring + m_params.sq_off.ring_mask);
+  m_sq_array = reinterpret_cast<unsigned*>(sq_ring + m_params.sq_off.array);
+  m_sq_local_tail = *m_sq_tail;
+
+  char* cq_ring = static_cast<char*>(m_cq_ring);
+  m_cq_head = reinterpret_cast<unsigned*>(cq_ring + m_params.cq_off.head);
+  m_cq_tail = reinterpret_cast<unsigned*>(cq_ring + m_params.cq_off.tail);
+  m_cq_mask = *reinterpret_cast<unsigned*>(cq_ring + m_params.cq_off.ring_mask);
+  m_cqes = reinterpret_cast<io_uring_cqe*>(cq_ring + m_params.cq_off.cqes);
+
+  Dout(dc::vulkan, "sq_entries = " << m_params.sq_entries << ", cq_entries = " << m_params.cq_entries << ", features = " << std::hex << m_params.features);
+}
+
+IoUring::~IoUring()
+{
+  release();
+}
+
+void IoUring::release()
+{
+  if (m_sqes)
+    munmap(m_sqes, m_params.sq_entries * sizeof(io_uring_sqe));
+  if (m_cq_ring && m_cq_ring != m_sq_ring)
+    munmap(m_cq_ring, m_cq_ring_size);
+  if (m_sq_ring)
+    munmap(m_sq_ring, m_sq_ring_size);
+  if (m_ring_fd >= 0)
+    close(m_ring_fd);
+  m_sqes = nullptr;
+  m_cq_ring = m_sq_ring = nullptr;
+  m_ring_fd = -1;
+}
+
+io_uring_sqe* IoUring::get_sqe()
+{
+  unsigned const head = load_acquire(m_sq_head);
+  if (m_sq_local_tail - head >= m_params.sq_entries)
+    return nullptr;
+  unsigned const index = m_sq_local_tail & m_sq_mask;
+  m_sq_array[index] = index;
+  ++m_sq_local_tail;
+  io_uring_sqe* sqe = &m_sqes[index];
+  std::memset(sqe, 0, sizeof(io_uring_sqe));
+  return sqe;
+}
+
+int IoUring::submit()
+{
+  store_release(m_sq_tail, m_sq_local_tail);
+  // Also pass entries that the kernel didn't consume during a previous call.
+  unsigned const to_submit = m_sq_local_tail - load_acquire(m_sq_head);
+  if (to_submit == 0)
+    return 0;
+  int result;
+  do
+    result = io_uring_enter(m_ring_fd, to_submit, 0, 0);
+  while (result < 0 && errno == EINTR);
+  return result < 0 ? -errno : result;
+}
+
+std::vector<uint64_t> IoUring::take_unsubmitted()
+{
+  // The kernel only consumes entries during io_uring_enter (this ring doesn't use IORING_SETUP_SQPOLL),
+  // so everything from the head onwards is still ours.
+  unsigned const head = load_acquire(m_sq_head);
+  std::vector<uint64_t> user_data;
+  for (unsigned i = head; i != m_sq_local_tail; ++i)
+    user_data.push_back(m_sqes[m_sq_array[i & m_sq_mask]].user_data);
+  m_sq_local_tail = head;
+  store_release(m_sq_tail, head);
+  return user_data;
+}
+
+int IoUring::wait(unsigned min_complete)
+{
+  int result;
+  do
+    result = io_uring_enter(m_ring_fd, 0, min_complete, IORING_ENTER_GETEVENTS);
+  while (result < 0 && errno == EINTR);
+  return result < 0 ? -errno : 0;
+}
+
+io_uring_cqe* IoUring::peek_cqe()
+{
+  unsigned const head = *m_cq_head;
+  if (head == load_acquire(m_cq_tail))
+    return nullptr;
+  return &m_cqes[head & m_cq_mask];
+}
+
+void IoUring::cqe_seen()
+{
+  store_release(m_cq_head, *m_cq_head + 1);
+}
+
+int IoUring::register_buffers(iovec const* iovecs, unsigned count)
+{
+  return io_uring_register(m_ring_fd, IORING_REGISTER_BUFFERS, iovecs, count) < 0 ? -errno : 0;
+}
+
+int IoUring::unregister_buffers()
+{
+  return io_uring_register(m_ring_fd, IORING_UNREGISTER_BUFFERS, nullptr, 0) < 0 ? -errno : 0;
+}
+
+} // namespace vk_utils
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace vk_utils {
+
+// IoUring
+//
+// A minimal wrapper around a Linux io_uring instance, using the system calls directly.
+//
+// Not thread-safe: the submission queue (get_sqe, submit) and the completion queue (wait, peek_cqe,
+// cqe_seen) may be used by two different threads, but each by one thread at a time.
+//
+class IoUring
+{
+ private:
+  int m_ring_fd = -1;
+  io_uring_params m_params{};
+
+  // The mapped rings.
+  void* m_sq_ring = nullptr;
+  size_t m_sq_ring_size = 0;
+  void* m_cq_ring = nullptr;
+  size_t m_cq_ring_size = 0;
+  io_uring_sqe* m_sqes = nullptr;
+
+  // Pointers into the submission queue ring.
+  unsigned* m_sq_head;
+  unsigned* m_sq_tail;
+  unsigned m_sq_mask;
+  unsigned* m_sq_array;
+  unsigned m_sq_local_tail = 0;         // The tail including the entries that were not submitted yet.
+
+  // Pointers into the completion queue ring.
+  unsigned* m_cq_head;
+  unsigned* m_cq_tail;
+  unsigned m_cq_mask;
+  io_uring_cqe* m_cqes;
+
+ public:
+  // Create a ring with (at least) entries submission queue entries. Throws if io_uring is not available.
+  IoUring(unsigned entries);
+  ~IoUring();
+
+  IoUring(IoUring const&) = delete;
+  IoUring& operator=(IoUring const&) = delete;
+
+  unsigned sq_entries() const { return m_params.sq_entries; }
+
+  // Return the next free submission queue entry (zeroed), or nullptr if the submission queue is full.
+  io_uring_sqe* get_sqe();
+
+  // Pass all entries obtained with get_sqe to the kernel. Returns the number of submitted entries, or -errno.
+  int submit();
+
+  // Remove the entries that the kernel did not consume (for example because submit failed) from the
+  // submission queue and return their user_data, oldest first.
+  std::vector<uint64_t> take_unsubmitted();
+
+  // Block until at least min_complete completions are available. Returns 0 or -errno.
+  int wait(unsigned min_complete);
+
+  // Return the oldest unseen completion, or nullptr if there is none.
+  io_uring_cqe* peek_cqe();
+  // Mark the completion returned by peek_cqe as seen.
+  void cqe_seen();
+
+  // Register the memory regions in iovecs for use with IORING_OP_READ_FIXED (buf_index is the index into iovecs).
+  // Returns 0 or -errno.
+  int register_buffers(iovec const* iovecs, unsigned count);
+  int unregister_buffers();
+
+ private:
+  // Unmap the rings and close the ring file descriptor.
+  void release();
+};
+
+} // namespace vk_utils
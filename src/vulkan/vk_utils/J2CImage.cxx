@@ -0,0 +1,307 @@
+#include "sys.h"
+#include "J2CImage.h"
+#include "get_binary_file_contents.h"
+#include "threadpool/AIThreadPool.h"
+#include "utils/AIAlert.h"
+#include <openjpeg.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <string>
+#include "debug.h"
+
+namespace vk_utils {
+namespace j2c {
+
+namespace {
+
+uint32_t ceil_div_pow2(uint32_t value, uint32_t power)
+{
+  return static_cast<uint32_t>((uint64_t{value} + (uint64_t{1} << power) - 1) >> power);
+}
+
+// An OpenJPEG codec that reads from memory.
+class Decompressor
+{
+ private:
+  std::byte const* m_data;
+  size_t m_size;
+  size_t m_position = 0;
+  std::string m_error;                          // The last error reported by OpenJPEG.
+  opj_codec_t* m_codec = nullptr;
+  opj_stream_t* m_stream = nullptr;
+
+ public:
+  opj_image_t* m_image = nullptr;
+
+  Decompressor(std::vector<std::byte> const& data, bool is_jp2, uint32_t discard_level) : m_data(data.data()), m_size(data.size())
+  {
+    m_codec = opj_create_decompress(is_jp2 ? OPJ_CODEC_JP2 : OPJ_CODEC_J2K);
+    opj_set_error_handler(m_codec, [](char const* msg, void* user_data){ static_cast<Decompressor*>(user_data)->m_error = msg; }, this);
+    opj_set_warning_handler(m_codec, []([[maybe_unused]] char const* msg, void*){ Dout(dc::warning, "OpenJPEG: " << msg); }, this);
+    opj_dparameters_t parameters;
+    opj_set_default_decoder_parameters(&parameters);
+    parameters.cp_reduce = discard_level;
+    if (!opj_setup_decoder(m_codec, &parameters))
+      fail("opj_setup_decoder");
+
+    m_stream = opj_stream_create(OPJ_J2K_STREAM_CHUNK_SIZE, OPJ_TRUE);
+    opj_stream_set_user_data(m_stream, this, nullptr);
+    opj_stream_set_user_data_length(m_stream, m_size);
+    opj_stream_set_read_function(m_stream, [](void* buffer, OPJ_SIZE_T bytes, void* user_data) -> OPJ_SIZE_T {
+      Decompressor* self = static_cast<Decompressor*>(user_data);
+      if (self->m_position >= self->m_size)
+        return static_cast<OPJ_SIZE_T>(-1);
+      bytes = std::min<OPJ_SIZE_T>(bytes, self->m_size - self->m_position);
+      std::memcpy(buffer, self->m_data + self->m_position, bytes);
+      self->m_position += bytes;
+      return bytes;
+    });
+    opj_stream_set_skip_function(m_stream, [](OPJ_OFF_T bytes, void* user_data) -> OPJ_OFF_T {
+      Decompressor* self = static_cast<Decompressor*>(user_data);
+      OPJ_OFF_T const position = std::clamp<OPJ_OFF_T>(self->m_position + bytes, 0, self->m_size);
+      bytes = position - self->m_position;
+      self->m_position = position;
+      return bytes;
+    });
+    opj_stream_set_seek_function(m_stream, [](OPJ_OFF_T position, void* user_data) -> OPJ_BOOL {
+      Decompressor* self = static_cast<Decompressor*>(user_data);
+      if (position < 0 || static_cast<size_t>(position) > self->m_size)
+        return OPJ_FALSE;
+      self->m_position = position;
+      return OPJ_TRUE;
+    });
+
+    if (!opj_read_header(m_stream, m_codec, &m_image))
+      fail("opj_read_header");
+  }
+
+  ~Decompressor()
+  {
+    if (m_image)
+      opj_image_destroy(m_image);
+    if (m_stream)
+      opj_stream_destroy(m_stream);
+    if (m_codec)
+      opj_destroy_codec(m_codec);
+  }
+
+  // The number of resolution levels of the first tile-component.
+  uint32_t resolutions() const
+  {
+    opj_codestream_info_v2_t* info = opj_get_cstr_info(m_codec);
+    uint32_t const resolutions = info->m_default_tile_info.tccp_info ? info->m_default_tile_info.tccp_info[0].numresolutions : 1;
+    opj_destroy_cstr_info(&info);
+    return resolutions;
+  }
+
+  // Decode the rectangle [x0, x1) x [y0, y1) (on the full resolution reference grid).
+  void decode(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1)
+  {
+    if (!opj_set_decode_area(m_codec, m_image, x0, y0, x1, y1))
+      fail("opj_set_decode_area");
+    if (!opj_decode(m_codec, m_stream, m_image) || !opj_end_decompress(m_codec, m_stream))
+      fail("opj_decode");
+  }
+
+ private:
+  [[noreturn]] void fail(char const* function)
+  {
+    THROW_ALERT("[FUNCTION] failed: [ERROR]", AIArgs("[FUNCTION]", function)("[ERROR]", m_error.empty() ? "unknown error" : m_error));
+  }
+};
+
+// Convert a decoded sample to 8 bits.
+inline std::byte to_unorm8(int32_t sample, opj_image_comp_t const& comp)
+{
+  uint32_t const max = (uint32_t{1} << comp.prec) - 1;
+  int64_t value = sample;
+  if (comp.sgnd)
+    value += int64_t{1} << (comp.prec - 1);
+  uint32_t const clamped = std::clamp<int64_t>(value, 0, max);
+  return static_cast<std::byte>(comp.prec > 8 ? clamped >> (comp.prec - 8) : (clamped * 255 + max / 2) / max);
+}
+
+} // namespace
+
+Codestream::Codestream(std::filesystem::path const& filename) : Codestream(get_binary_file_contents(filename))
+{
+}
+
+Codestream::Codestream(std::vector<std::byte>&& data) : m_data(std::move(data))
+{
+  static constexpr unsigned char jp2_signature[] = { 0x00, 0x00, 0x00, 0x0C, 0x6A, 0x50, 0x20, 0x20 };
+  m_is_jp2 = m_data.size() >= sizeof(jp2_signature) && std::memcmp(m_data.data(), jp2_signature, sizeof(jp2_signature)) == 0;
+  read_header();
+}
+
+void Codestream::read_header()
+{
+  DoutEntering(dc::vulkan, "Codestream::read_header() [" << this << "]");
+  Decompressor decompressor(m_data, m_is_jp2, 0);
+  opj_image_t const* image = decompressor.m_image;
+  if (image->x1 <= image->x0 || image->y1 <= image->y0 || image->numcomps == 0)
+    THROW_ALERT("Invalid JPEG 2000 image size");
+  for (uint32_t c = 0; c < std::min(image->numcomps, 4U); ++c)
+    if (image->comps[c].dx != 1 || image->comps[c].dy != 1 || image->comps[c].prec == 0 || image->comps[c].prec > 31)
+      THROW_ALERT("Unsupported JPEG 2000 component [COMPONENT] (subsampling [DX]x[DY], precision [PREC])",
+          AIArgs("[COMPONENT]", c)("[DX]", image->comps[c].dx)("[DY]", image->comps[c].dy)("[PREC]", image->comps[c].prec));
+  m_header.m_offset = vk::Offset2D{ static_cast<int32_t>(image->x0), static_cast<int32_t>(image->y0) };
+  m_header.m_extent = vk::Extent2D{ image->x1 - image->x0, image->y1 - image->y0 };
+  m_header.m_components = image->numcomps;
+  m_header.m_resolutions = decompressor.resolutions();
+  Dout(dc::vulkan, "extent: " << m_header.m_extent << ", components: " << m_header.m_components << ", resolutions: " << m_header.m_resolutions);
+}
+
+vk::Extent2D Codestream::extent(uint32_t discard_level) const
+{
+  // See B.5 of the JPEG 2000 standard: the reduced image spans [ceil(x0 / 2^d), ceil(x1 / 2^d)).
+  uint32_t const x0 = m_header.m_offset.x;
+  uint32_t const y0 = m_header.m_offset.y;
+  uint32_t const x1 = x0 + m_header.m_extent.width;
+  uint32_t const y1 = y0 + m_header.m_extent.height;
+  return { ceil_div_pow2(x1, discard_level) - ceil_div_pow2(x0, discard_level), ceil_div_pow2(y1, discard_level) - ceil_div_pow2(y0, discard_level) };
+}
+
+void Codestream::decode_rows(uint32_t discard_level, uint32_t row_begin, uint32_t row_end, std::byte* dst) const
+{
+  ASSERT(discard_level <= max_discard_level());
+  vk::Extent2D const reduced_extent = extent(discard_level);
+  ASSERT(row_begin < row_end && row_end <= reduced_extent.height);
+
+  // Convert the rows to the full resolution reference grid.
+  uint32_t const x0 = m_header.m_offset.x;
+  uint32_t const y0 = m_header.m_offset.y;
+  uint32_t const x1 = x0 + m_header.m_extent.width;
+  uint32_t const y1 = y0 + m_header.m_extent.height;
+  uint32_t const reduced_y0 = ceil_div_pow2(y0, discard_level);
+  uint32_t const area_y0 = std::max<uint64_t>(y0, uint64_t{reduced_y0 + row_begin} << discard_level);
+  uint32_t const area_y1 = std::min<uint64_t>(y1, uint64_t{reduced_y0 + row_end} << discard_level);
+
+  Decompressor decompressor(m_data, m_is_jp2, discard_level);
+  decompressor.decode(x0, area_y0, x1, area_y1);
+  opj_image_t const* image = decompressor.m_image;
+
+  uint32_t const rows = row_end - row_begin;
+  uint32_t const components = std::min(image->numcomps, 4U);
+  for (uint32_t c = 0; c < components; ++c)
+    if (image->comps[c].w != reduced_extent.width || image->comps[c].h != rows || !image->comps[c].data)
+      THROW_ALERT("Decoded JPEG 2000 component [COMPONENT] has size [W]x[H], expected [EW]x[EH]",
+          AIArgs("[COMPONENT]", c)("[W]", image->comps[c].w)("[H]", image->comps[c].h)("[EW]", reduced_extent.width)("[EH]", rows));
+
+  // Interleave the components as RGBA.
+  opj_image_comp_t const* comps = image->comps;
+  size_t const texels = size_t{reduced_extent.width} * rows;
+  for (size_t i = 0; i < texels; ++i)
+  {
+    std::byte* texel = dst + 4 * i;
+    switch (components)
+    {
+      case 1:
+      case 2:
+        texel[0] = texel[1] = texel[2] = to_unorm8(comps[0].data[i], comps[0]);
+        texel[3] = components == 2 ? to_unorm8(comps[1].data[i], comps[1]) : std::byte{0xff};
+        break;
+      case 3:
+      case 4:
+        texel[0] = to_unorm8(comps[0].data[i], comps[0]);
+        texel[1] = to_unorm8(comps[1].data[i], comps[1]);
+        texel[2] = to_unorm8(comps[2].data[i], comps[2]);
+        texel[3] = components == 4 ? to_unorm8(comps[3].data[i], comps[3]) : std::byte{0xff};
+        break;
+    }
+  }
+}
+
+// The state shared between the thread calling Decoder::decode and the thread pool workers.
+// Workers only access m_codestream and m_dst after claiming a band, which can't happen
+// anymore once decode() returned; hence it is fine that those outlive the call.
+struct Decoder::Job
+{
+  Codestream const* m_codestream;
+  uint32_t m_discard_level;
+  std::byte* m_dst;
+  uint32_t m_rows;                              // The height of the decoded image.
+  uint32_t m_band_rows;                         // The height of each band (the last band might be smaller).
+  size_t m_row_bytes;
+  int m_bands;
+  std::atomic<int> m_next_band = 0;
+  std::atomic<int> m_finished_bands = 0;
+  std::mutex m_error_mutex;
+  std::exception_ptr m_error;                   // The first exception thrown by any band.
+
+  // Decode bands until none are left.
+  void run()
+  {
+    for (int band; (band = m_next_band.fetch_add(1, std::memory_order_relaxed)) < m_bands;)
+    {
+      uint32_t const row_begin = band * m_band_rows;
+      uint32_t const row_end = std::min(m_rows, row_begin + m_band_rows);
+      try
+      {
+        m_codestream->decode_rows(m_discard_level, row_begin, row_end, m_dst + row_begin * m_row_bytes);
+      }
+      catch (...)
+      {
+        std::lock_guard<std::mutex> lock(m_error_mutex);
+        if (!m_error)
+          m_error = std::current_exception();
+      }
+      if (m_finished_bands.fetch_add(1, std::memory_order_release) + 1 == m_bands)
+        m_finished_bands.notify_all();
+    }
+  }
+};
+
+void Decoder::decode(Codestream const& codestream, uint32_t discard_level, std::byte* dst) const
+{
+  DoutEntering(dc::vulkan, "Decoder::decode(" << &codestream << ", " << discard_level << ", " << (void*)dst << ")");
+
+  vk::Extent2D const extent = codestream.extent(discard_level);
+  auto job = std::make_shared<Job>();
+  job->m_codestream = &codestream;
+  job->m_discard_level = discard_level;
+  job->m_dst = dst;
+  job->m_rows = extent.height;
+  job->m_row_bytes = size_t{4} * extent.width;
+  // Cut the image into at most m_max_bands bands of a multiple of s_band_alignment rows.
+  uint32_t const max_bands = std::clamp<uint32_t>((extent.height + s_band_alignment - 1) / s_band_alignment, 1, std::max(m_max_bands, 1));
+  job->m_band_rows = ((extent.height + max_bands - 1) / max_bands + s_band_alignment - 1) / s_band_alignment * s_band_alignment;
+  job->m_bands = (extent.height + job->m_band_rows - 1) / job->m_band_rows;
+
+  // Let thread pool workers help; the calling thread decodes one band itself.
+  if (job->m_bands > 1)
+  {
+    auto& queue = AIThreadPool::instance().get_queue(m_queue_handle);
+    int posted = 0;
+    {
+      auto queue_access = queue.producer_access();
+      int const room = queue.capacity() - queue_access.length();
+      for (; posted < std::min(job->m_bands - 1, room); ++posted)
+        queue_access.move_in([job](){ job->run(); return false; });
+    }
+    for (int i = 0; i < posted; ++i)
+      queue.notify_one();
+  }
+
+  job->run();
+
+  // Wait for the bands that were claimed by workers.
+  for (int finished; (finished = job->m_finished_bands.load(std::memory_order_acquire)) < job->m_bands;)
+    job->m_finished_bands.wait(finished, std::memory_order_acquire);
+
+  if (job->m_error)
+    std::rethrow_exception(job->m_error);
+}
+
+J2CDataFeeder::J2CDataFeeder(std::shared_ptr<Codestream const> codestream, uint32_t discard_level, Decoder const& decoder) :
+  m_codestream(std::move(codestream)), m_discard_level(discard_level), m_decoder(decoder)
+{
+  vk::Extent2D const extent = m_codestream->extent(m_discard_level);
+  m_size = 4 * extent.width * extent.height;
+}
+
+} // namespace j2c
+} // namespace vk_utils
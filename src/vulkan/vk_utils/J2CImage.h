@@ -0,0 +1,109 @@
+#pragma once
+
+#include "memory/DataFeeder.h"
+#include "threadpool/AIQueueHandle.h"
+#include <vulkan/vulkan.hpp>
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+namespace vk_utils {
+namespace j2c {
+
+// The main header of a JPEG 2000 codestream.
+struct Header
+{
+  vk::Offset2D m_offset;                        // The image offset on the reference grid.
+  vk::Extent2D m_extent;                        // The size of the full resolution image.
+  uint32_t m_components;                        // The number of components (1: grey, 2: grey + alpha, 3: RGB, 4: RGBA, more are ignored).
+  uint32_t m_resolutions;                       // The number of resolution levels; the largest discard level is m_resolutions - 1.
+};
+
+// Codestream
+//
+// A JPEG 2000 image (a raw J2C codestream or a JP2 file) in memory, of which the main header was read.
+//
+// A discard level d means that the d highest resolution levels are not decoded: the image is then
+// decoded at 1/2^d of its size, which is the same size as mip level d. Decoding at a higher discard
+// level is correspondingly cheaper, because the code-blocks of the discarded levels are skipped.
+//
+class Codestream
+{
+ private:
+  std::vector<std::byte> m_data;
+  bool m_is_jp2;                                // Set if m_data is a JP2 file, rather than a raw codestream.
+  Header m_header;
+
+ public:
+  Codestream(std::filesystem::path const& filename);
+  Codestream(std::vector<std::byte>&& data);
+
+  // Accessors.
+  Header const& header() const { return m_header; }
+  uint32_t max_discard_level() const { return m_header.m_resolutions - 1; }
+
+  // The size of the image decoded at discard_level.
+  vk::Extent2D extent(uint32_t discard_level) const;
+
+  // Decode rows [row_begin, row_end) of the image at discard_level into dst, as RGBA8 (the row at dst is row_begin).
+  // Only the code-blocks that contribute to those rows are decoded. Thread-safe.
+  void decode_rows(uint32_t discard_level, uint32_t row_begin, uint32_t row_end, std::byte* dst) const;
+
+ private:
+  void read_header();
+};
+
+// Decoder
+//
+// Decodes a Codestream on multiple threads. The image is cut into horizontal bands that are decoded
+// independently (each band only decodes the code-blocks that intersect it); the bands are distributed
+// over the thread calling decode() and thread pool workers of the queue passed to the constructor.
+//
+// The calling thread keeps taking bands until none are left, so decode() also finishes when the thread
+// pool is busy (or when it is called from a thread pool worker itself).
+//
+class Decoder
+{
+ public:
+  // Bands are a multiple of this many rows (the default code-block height), so that
+  // neighbouring bands at the highest decoded resolution do not decode the same code-blocks.
+  static constexpr uint32_t s_band_alignment = 64;
+
+ private:
+  struct Job;
+
+  AIQueueHandle m_queue_handle;                 // The thread pool queue to run bands on.
+  int m_max_bands;                              // The maximum number of bands to cut an image into.
+
+ public:
+  Decoder(AIQueueHandle queue_handle, int max_bands) : m_queue_handle(queue_handle), m_max_bands(max_bands) { }
+
+  // Decode codestream at discard_level into dst (RGBA8, rows without padding). Blocks until finished.
+  void decode(Codestream const& codestream, uint32_t discard_level, std::byte* dst) const;
+};
+
+// Feeds the image of a Codestream, decoded at a given discard level, as RGBA8.
+// The image is decoded straight into the staging buffer.
+class J2CDataFeeder final : public vulkan::DataFeeder
+{
+ private:
+  std::shared_ptr<Codestream const> m_codestream;
+  uint32_t m_discard_level;
+  Decoder const& m_decoder;
+  uint32_t m_size;
+
+ public:
+  J2CDataFeeder(std::shared_ptr<Codestream const> codestream, uint32_t discard_level, Decoder const& decoder);
+
+  // The size of the image that will be fed.
+  vk::Extent2D extent() const { return m_codestream->extent(m_discard_level); }
+
+  uint32_t chunk_size() const override { return m_size; }
+  int chunk_count() const override { return 1; }
+  int next_batch() override { return 1; }
+  void get_chunks(unsigned char* chunk_ptr) override { m_decoder.decode(*m_codestream, m_discard_level, reinterpret_cast<std::byte*>(chunk_ptr)); }
+};
+
+} // namespace j2c
+} // namespace vk_utils
@@ -0,0 +1,115 @@
+#include "sys.h"
+#include "MipChain.h"
+#include <algorithm>
+#include <bit>
+#include "debug.h"
+
+namespace vk_utils {
+
+uint32_t mip_level_count(vk::Extent2D extent)
+{
+  return std::bit_width(std::max(extent.width, extent.height));
+}
+
+vk::Extent2D mip_level_extent(vk::Extent2D extent, uint32_t level)
+{
+  return { std::max(1U, extent.width >> level), std::max(1U, extent.height >> level) };
+}
+
+MipChain::MipChain(std::byte const* pixels, vk::Extent2D extent, uint32_t channels) : m_extent(extent), m_channels(channels)
+{
+  DoutEntering(dc::vulkan, "MipChain::MipChain(" << (void const*)pixels << ", " << extent << ", " << channels << ")");
+  ASSERT(extent.width > 0 && extent.height > 0 && channels > 0);
+
+  uint32_t const levels = mip_level_count(extent);
+  m_levels.resize(levels);
+  m_levels[0].assign(pixels, pixels + size_t{extent.width} * extent.height * channels);
+  for (uint32_t level = 1; level < levels; ++level)
+  {
+    vk::Extent2D const src_extent = mip_level_extent(extent, level - 1);
+    vk::Extent2D const dst_extent = mip_level_extent(extent, level);
+    std::vector<std::byte> const& src = m_levels[level - 1];
+    std::vector<std::byte>& dst = m_levels[level];
+    dst.resize(size_t{dst_extent.width} * dst_extent.height * channels);
+    for (uint32_t y = 0; y < dst_extent.height; ++y)
+    {
+      uint32_t const y0 = std::min(2 * y, src_extent.height - 1);
+      uint32_t const y1 = std::min(2 * y + 1, src_extent.height - 1);
+      for (uint32_t x = 0; x < dst_extent.width; ++x)
+      {
+        uint32_t const x0 = std::min(2 * x, src_extent.width - 1);
+        uint32_t const x1 = std::min(2 * x + 1, src_extent.width - 1);
+        for (uint32_t c = 0; c < channels; ++c)
+        {
+          auto texel = [&](uint32_t sx, uint32_t sy){ return std::to_integer<uint32_t>(src[(size_t{sy} * src_extent.width + sx) * channels + c]); };
+          // Round to nearest.
+          uint32_t const sum = texel(x0, y0) + texel(x1, y0) + texel(x0, y1) + texel(x1, y1);
+          dst[(size_t{y} * dst_extent.width + x) * channels + c] = static_cast<std::byte>((sum + 2) / 4);
+        }
+      }
+    }
+  }
+}
+
+std::vector<std::unique_ptr<vulkan::DataFeeder>> MipChain::take_level_feeders() &&
+{
+  std::vector<std::unique_ptr<vulkan::DataFeeder>> feeders;
+  feeders.reserve(m_levels.size());
+  for (auto& level : m_levels)
+    feeders.push_back(std::make_unique<MipLevelDataFeeder>(std::move(level)));
+  m_levels.clear();
+  return feeders;
+}
+
+std::vector<std::unique_ptr<vulkan::DataFeeder>> MipChain::level_feeders(uint32_t first_level, uint32_t end_level) const
+{
+  ASSERT(first_level <= end_level && end_level <= m_levels.size());
+  std::vector<std::unique_ptr<vulkan::DataFeeder>> feeders(m_levels.size());
+  for (uint32_t level = first_level; level < end_level; ++level)
+    feeders[level] = std::make_unique<MipLevelDataFeeder>(std::vector<std::byte>(m_levels[level]));
+  return feeders;
+}
+
+MipChainDataFeeder::MipChainDataFeeder(std::unique_ptr<vulkan::DataFeeder> level0_feeder, vk::Extent2D extent, uint32_t channels, uint32_t level_count) :
+  m_level0_feeder(std::move(level0_feeder)), m_extent(extent), m_channels(channels), m_level_count(level_count)
+{
+  // An image can't have more levels than its full mip chain.
+  ASSERT(0 < level_count && level_count <= mip_level_count(extent));
+}
+
+uint32_t MipChainDataFeeder::chunk_size() const
+{
+  uint32_t size = 0;
+  for (uint32_t level = 0; level < m_level_count; ++level)
+  {
+    vk::Extent2D const extent = mip_level_extent(m_extent, level);
+    size += extent.width * extent.height * m_channels;
+  }
+  return size;
+}
+
+void MipChainDataFeeder::get_chunks(unsigned char* chunk_ptr)
+{
+  // Read all of level 0.
+  uint32_t const level0_chunk_size = m_level0_feeder->chunk_size();
+  int const level0_chunk_count = m_level0_feeder->chunk_count();
+  std::vector<std::byte> level0(size_t{level0_chunk_size} * level0_chunk_count);
+  // The level 0 feeder must provide exactly one level.
+  ASSERT(level0.size() == size_t{m_extent.width} * m_extent.height * m_channels);
+  int next_batch;
+  for (int chunks = 0; chunks < level0_chunk_count; chunks += next_batch)
+  {
+    next_batch = m_level0_feeder->next_batch();
+    m_level0_feeder->get_chunks(reinterpret_cast<unsigned char*>(level0.data()) + size_t{level0_chunk_size} * chunks);
+  }
+
+  MipChain const mip_chain(level0.data(), m_extent, m_channels);
+  for (uint32_t level = 0; level < m_level_count; ++level)
+  {
+    std::vector<std::byte> const& pixels = mip_chain.level(level);
+    std::memcpy(chunk_ptr, pixels.data(), pixels.size());
+    chunk_ptr += pixels.size();
+  }
+}
+
+} // namespace vk_utils
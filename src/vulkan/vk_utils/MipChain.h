@@ -0,0 +1,87 @@
+#pragma once
+
+#include "memory/DataFeeder.h"
+#include <vulkan/vulkan.hpp>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace vk_utils {
+
+// The number of mip levels of a full mip chain of an image with the given extent.
+uint32_t mip_level_count(vk::Extent2D extent);
+
+// The extent of mip level `level` of an image whose level 0 has the given extent.
+vk::Extent2D mip_level_extent(vk::Extent2D extent, uint32_t level);
+
+// MipChain
+//
+// A full mip chain of an 8-bit per channel image, generated on the CPU with a 2x2 box filter
+// (edge texels are repeated for odd sizes). The filter averages the stored values, so for sRGB
+// data the coarser levels come out slightly darker than a linear-space filter would produce.
+//
+// Used by Texture::upload_progressive and Texture::stream_in to stream the levels coarse to fine.
+//
+class MipChain
+{
+ private:
+  vk::Extent2D m_extent;                        // The extent of level 0.
+  uint32_t m_channels;
+  std::vector<std::vector<std::byte>> m_levels; // The pixels of each level, rows without padding; finest first.
+
+ public:
+  // Generate the mip chain of the image of size extent with channels bytes per pixel at pixels (rows without padding).
+  MipChain(std::byte const* pixels, vk::Extent2D extent, uint32_t channels);
+
+  // Accessors.
+  vk::Extent2D extent() const { return m_extent; }
+  uint32_t channels() const { return m_channels; }
+  uint32_t level_count() const { return m_levels.size(); }
+  std::vector<std::byte> const& level(uint32_t level) const { return m_levels[level]; }
+
+  // Move the pixels of each level into a DataFeeder, finest level first.
+  std::vector<std::unique_ptr<vulkan::DataFeeder>> take_level_feeders() &&;
+  // Copy the pixels of levels [first_level, end_level) into a DataFeeder each; the other elements are null.
+  // Used to (re)load levels with Texture::stream_in.
+  std::vector<std::unique_ptr<vulkan::DataFeeder>> level_feeders(uint32_t first_level, uint32_t end_level) const;
+};
+
+// Feeds the pixels of one mip level.
+class MipLevelDataFeeder final : public vulkan::DataFeeder
+{
+ private:
+  std::vector<std::byte> m_pixels;
+
+ public:
+  MipLevelDataFeeder(std::vector<std::byte>&& pixels) : m_pixels(std::move(pixels)) { }
+
+  uint32_t chunk_size() const override { return m_pixels.size(); }
+  int chunk_count() const override { return 1; }
+  int next_batch() override { return 1; }
+  void get_chunks(unsigned char* chunk_ptr) override { std::memcpy(chunk_ptr, m_pixels.data(), m_pixels.size()); }
+};
+
+// Feeds the first level_count levels of the mip chain of the image provided by a level 0 feeder, tightly packed,
+// finest level first (the layout that CopyDataToImage expects for a range of mip levels).
+//
+// The mip chain is generated on the CPU (from the thread that reads the feeder); this is the fallback for
+// formats that can't be blitted with linear filtering (see LogicalDevice::supports_blit_mip_generation).
+class MipChainDataFeeder final : public vulkan::DataFeeder
+{
+ private:
+  std::unique_ptr<vulkan::DataFeeder> m_level0_feeder;
+  vk::Extent2D m_extent;
+  uint32_t m_channels;
+  uint32_t m_level_count;
+
+ public:
+  MipChainDataFeeder(std::unique_ptr<vulkan::DataFeeder> level0_feeder, vk::Extent2D extent, uint32_t channels, uint32_t level_count);
+
+  uint32_t chunk_size() const override;
+  int chunk_count() const override { return 1; }
+  int next_batch() override { return 1; }
+  void get_chunks(unsigned char* chunk_ptr) override;
+};
+
+} // namespace vk_utils
@@ -0,0 +1,145 @@
+#include "sys.h"
+#include "PngWriter.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <ostream>
+#include <vector>
+#include "debug.h"
+
+namespace vk_utils {
+
+namespace {
+
+std::array<uint32_t, 256> const crc_table = []{
+  std::array<uint32_t, 256> table;
+  for (uint32_t n = 0; n < 256; ++n)
+  {
+    uint32_t c = n;
+    for (int k = 0; k < 8; ++k)
+      c = (c & 1) ? 0xedb88320U ^ (c >> 1) : c >> 1;
+    table[n] = c;
+  }
+  return table;
+}();
+
+uint32_t update_crc(uint32_t crc, unsigned char const* data, size_t size)
+{
+  for (size_t i = 0; i < size; ++i)
+    crc = crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  return crc;
+}
+
+void put_u32_be(std::vector<unsigned char>& out, uint32_t value)
+{
+  out.push_back(value >> 24);
+  out.push_back(value >> 16);
+  out.push_back(value >> 8);
+  out.push_back(value);
+}
+
+void write_chunk(std::ostream& os, char const (&type)[5], std::vector<unsigned char> const& data)
+{
+  std::vector<unsigned char> header;
+  put_u32_be(header, static_cast<uint32_t>(data.size()));
+  header.insert(header.end(), type, type + 4);
+  uint32_t crc = update_crc(0xffffffffU, header.data() + 4, 4);
+  crc = update_crc(crc, data.data(), data.size()) ^ 0xffffffffU;
+  std::vector<unsigned char> trailer;
+  put_u32_be(trailer, crc);
+  os.write(reinterpret_cast<char const*>(header.data()), header.size());
+  os.write(reinterpret_cast<char const*>(data.data()), data.size());
+  os.write(reinterpret_cast<char const*>(trailer.data()), trailer.size());
+}
+
+// Copy a row of pixels, optionally swapping the red and blue channels.
+void copy_row(unsigned char* dst, std::byte const* src, uint32_t width, uint32_t channels, bool swap_red_blue)
+{
+  std::memcpy(dst, src, width * channels);
+  if (swap_red_blue)
+    for (uint32_t x = 0; x < width; ++x)
+      std::swap(dst[x * channels], dst[x * channels + 2]);
+}
+
+} // namespace
+
+void write_png(std::ostream& os, uint32_t width, uint32_t height, uint32_t channels, std::byte const* pixels, size_t row_pitch, bool swap_red_blue)
+{
+  DoutEntering(dc::vulkan, "write_png(os, " << width << ", " << height << ", " << channels << ", " << (void const*)pixels << ", " << row_pitch << ", " << swap_red_blue << ")");
+  // Only 8-bit RGB and RGBA are supported.
+  ASSERT(channels == 3 || channels == 4);
+  ASSERT(row_pitch >= width * channels);
+
+  static constexpr unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+  os.write(reinterpret_cast<char const*>(signature), sizeof(signature));
+
+  std::vector<unsigned char> ihdr;
+  put_u32_be(ihdr, width);
+  put_u32_be(ihdr, height);
+  ihdr.push_back(8);                            // Bit depth.
+  ihdr.push_back(channels == 4 ? 6 : 2);        // Color type: RGBA or RGB.
+  ihdr.push_back(0);                            // Compression method: deflate.
+  ihdr.push_back(0);                            // Filter method: adaptive (we only use filter type None).
+  ihdr.push_back(0);                            // No interlace.
+  write_chunk(os, "IHDR", ihdr);
+
+  // The filtered image data: every row starts with its filter type (0: None).
+  size_t const row_size = 1 + size_t{width} * channels;
+  std::vector<unsigned char> filtered(row_size * height);
+  for (uint32_t y = 0; y < height; ++y)
+  {
+    filtered[y * row_size] = 0;
+    copy_row(&filtered[y * row_size + 1], pixels + y * row_pitch, width, channels, swap_red_blue);
+  }
+
+  // A zlib stream with stored (uncompressed) deflate blocks of at most 65535 bytes.
+  static constexpr size_t max_block_size = 65535;
+  size_t const number_of_blocks = std::max<size_t>(1, (filtered.size() + max_block_size - 1) / max_block_size);
+  std::vector<unsigned char> idat;
+  idat.reserve(2 + filtered.size() + 5 * number_of_blocks + 4);
+  idat.push_back(0x78);                         // CMF: deflate with a 32K window.
+  idat.push_back(0x01);                         // FLG: no dictionary, fastest; (0x78 * 256 + 0x01) % 31 == 0.
+  uint32_t adler_a = 1;
+  uint32_t adler_b = 0;
+  size_t offset = 0;
+  for (size_t block = 0; block < number_of_blocks; ++block)
+  {
+    size_t const size = std::min(max_block_size, filtered.size() - offset);
+    bool const final_block = block == number_of_blocks - 1;
+    idat.push_back(final_block ? 1 : 0);        // BFINAL and BTYPE = 00 (stored).
+    idat.push_back(size & 0xff);
+    idat.push_back(size >> 8);
+    idat.push_back(~size & 0xff);
+    idat.push_back((~size >> 8) & 0xff);
+    idat.insert(idat.end(), filtered.begin() + offset, filtered.begin() + offset + size);
+    // Reduce modulo 65521 only every 5552 bytes: the largest n for which the sums can't overflow 32 bits.
+    for (size_t begin = offset; begin < offset + size; begin += 5552)
+    {
+      size_t const end = std::min(begin + 5552, offset + size);
+      for (size_t i = begin; i < end; ++i)
+      {
+        adler_a += filtered[i];
+        adler_b += adler_a;
+      }
+      adler_a %= 65521;
+      adler_b %= 65521;
+    }
+    offset += size;
+  }
+  put_u32_be(idat, (adler_b << 16) | adler_a);
+  write_chunk(os, "IDAT", idat);
+
+  write_chunk(os, "IEND", {});
+}
+
+void write_raw(std::ostream& os, uint32_t width, uint32_t height, uint32_t channels, std::byte const* pixels, size_t row_pitch, bool swap_red_blue)
+{
+  std::vector<unsigned char> row(size_t{width} * channels);
+  for (uint32_t y = 0; y < height; ++y)
+  {
+    copy_row(row.data(), pixels + y * row_pitch, width, channels, swap_red_blue);
+    os.write(reinterpret_cast<char const*>(row.data()), row.size());
+  }
+}
+
+} // namespace vk_utils
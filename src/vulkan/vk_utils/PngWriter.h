@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <iosfwd>
+
+namespace vk_utils {
+
+// Write an 8-bit per channel RGB (channels = 3) or RGBA (channels = 4) image as PNG.
+//
+// pixels points to the first row; rows are row_pitch bytes apart (at least width * channels).
+// When swap_red_blue is true the first and third channel of each pixel are swapped (for BGRA input).
+//
+// The image data is stored without compression (deflate "stored" blocks): encoding is little more
+// than a memcpy plus a CRC, which keeps the cost of frame capture predictable. Use an external tool
+// to recompress the files if size matters.
+void write_png(std::ostream& os, uint32_t width, uint32_t height, uint32_t channels, std::byte const* pixels, size_t row_pitch, bool swap_red_blue = false);
+
+// Write the same data without any header: width * channels bytes per row, rows without padding.
+void write_raw(std::ostream& os, uint32_t width, uint32_t height, uint32_t channels, std::byte const* pixels, size_t row_pitch, bool swap_red_blue = false);
+
+} // namespace vk_utils
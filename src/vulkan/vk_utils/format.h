@@ -22,4 +22,36 @@ inline uint32_t format_component_count(vk::Format format)
   return FormatComponentCount(static_cast<VkFormat>(format));
 }
 
+// The size of one texel in bytes. Only for uncompressed, single plane formats.
+inline uint32_t format_texel_size(vk::Format format)
+{
+  return FormatElementSize(static_cast<VkFormat>(format));
+}
+
+// Returns true if every component of format is an 8-bit unsigned normalized value (linear or sRGB encoded).
+// Those are the formats that the CPU mip chain generation (see MipChainDataFeeder) can handle.
+inline bool format_is_8bit_unorm_or_srgb(vk::Format format)
+{
+  switch (format)
+  {
+    case vk::Format::eR8Unorm:
+    case vk::Format::eR8Srgb:
+    case vk::Format::eR8G8Unorm:
+    case vk::Format::eR8G8Srgb:
+    case vk::Format::eR8G8B8Unorm:
+    case vk::Format::eR8G8B8Srgb:
+    case vk::Format::eB8G8R8Unorm:
+    case vk::Format::eB8G8R8Srgb:
+    case vk::Format::eR8G8B8A8Unorm:
+    case vk::Format::eR8G8B8A8Srgb:
+    case vk::Format::eB8G8R8A8Unorm:
+    case vk::Format::eB8G8R8A8Srgb:
+    case vk::Format::eA8B8G8R8UnormPack32:
+    case vk::Format::eA8B8G8R8SrgbPack32:
+      return true;
+    default:
+      return false;
+  }
+}
+
 } // namespace vk_utils
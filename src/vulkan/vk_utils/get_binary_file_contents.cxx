@@ -1,6 +1,8 @@
 #include "sys.h"
 #include "get_binary_file_contents.h"
+#include "AsyncFileReader.h"
 #include "utils/AIAlert.h"
+#include <cstring>
 #include <fstream>
 #include <vector>
 #include "debug.h"
@@ -30,4 +32,18 @@ std::vector<std::byte> get_binary_file_contents(std::filesystem::path const& fil
   return result;
 }
 
+std::vector<std::byte> get_binary_file_contents(std::filesystem::path const& filename, vulkan::AsyncFileReader& file_reader)
+{
+  std::vector<std::byte> result;
+  vulkan::AsyncFileReader::Result const read_result = file_reader.read_file(filename, result);
+
+  if (read_result.m_error != 0)
+    THROW_ALERT("Could not read [FILENAME] file: [ERROR]", AIArgs("[FILENAME]", filename)("[ERROR]", std::strerror(read_result.m_error)));
+
+  if (read_result.m_bytes_read != result.size())
+    THROW_ALERT("Reading [SIZE] bytes from [FILENAME] failed!", AIArgs("[SIZE]", result.size())("[FILENAME]", filename));
+
+  return result;
+}
+
 } // namespace vk_utils
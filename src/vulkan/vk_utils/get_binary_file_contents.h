@@ -2,8 +2,15 @@
 #include <cstddef>
 #include <filesystem>
 
+namespace vulkan {
+class AsyncFileReader;
+} // namespace vulkan
+
 namespace vk_utils {
 
 std::vector<std::byte> get_binary_file_contents(std::filesystem::path const& filename);
 
+// Same, but read the file with file_reader (io_uring when available); only the calling thread is blocked.
+std::vector<std::byte> get_binary_file_contents(std::filesystem::path const& filename, vulkan::AsyncFileReader& file_reader);
+
 } // namespace vk_utils